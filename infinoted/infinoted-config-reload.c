@@ -24,6 +24,7 @@
 
 #include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/server/infd-filesystem-account-storage.h>
+#include <libinfinity/server/infd-loop-connection.h>
 #include <libinfinity/inf-config.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -36,6 +37,11 @@ static void
 infinoted_config_reload_update_connection_sasl_context(InfXmlConnection* xml,
                                                        gpointer userdata)
 {
+  /* The connection loops are paused at this point, so we can access the
+   * XMPP connection directly. */
+  if(INFD_IS_LOOP_CONNECTION(xml))
+    xml = infd_loop_connection_get_base(INFD_LOOP_CONNECTION(xml));
+
   if(!INF_IS_XMPP_CONNECTION(xml))
     return;
 
@@ -62,7 +68,6 @@ infinoted_config_reload(InfinotedRun* run,
                         GError** error)
 {
   InfinotedStartup* startup;
-  gnutls_dh_params_t dh_params;
   InfdTcpServer* tcp6;
   InfdTcpServer* tcp4;
 
@@ -89,22 +94,8 @@ infinoted_config_reload(InfinotedRun* run,
 
   /* Acquire DH params if necessary (if security policy changed from
    * no-tls to one of allow-tls or require-tls). */
-  dh_params = run->dh_params;
   if(startup->credentials)
-  {
-    result = infinoted_dh_params_ensure(
-      startup->log,
-      startup->credentials,
-      &dh_params,
-      error
-    );
-
-    if(!result)
-    {
-      infinoted_startup_free(startup);
-      return FALSE;
-    }
-  }
+    infinoted_run_ensure_dh_params(run, startup);
 
   if((startup->options->listen_address != NULL &&
       run->startup->options->listen_address == NULL) ||
@@ -160,6 +151,7 @@ infinoted_config_reload(InfinotedRun* run,
     tcp6 = g_object_new(
       INFD_TYPE_TCP_SERVER,
       "io", run->io,
+      "loop-pool", run->loop_pool,
       "local-address", addr6,
       "local-port", startup->options->port,
       NULL
@@ -177,6 +169,7 @@ infinoted_config_reload(InfinotedRun* run,
     tcp4 = g_object_new(
       INFD_TYPE_TCP_SERVER,
       "io", run->io,
+      "loop-pool", run->loop_pool,
       "local-address", addr4,
       "local-port", startup->options->port,
       NULL
@@ -375,6 +368,31 @@ infinoted_config_reload(InfinotedRun* run,
     }
   }
 
+  /* Apply admission limits and the compression level to both new and
+   * existing servers. The compression level only affects new
+   * connections. */
+  if(run->xmpp6 != NULL)
+  {
+    g_object_set(
+      G_OBJECT(run->xmpp6),
+      "max-accept-rate", startup->options->max_accept_rate,
+      "max-handshakes", startup->options->max_handshakes,
+      "compression-level", startup->options->compression_level,
+      NULL
+    );
+  }
+
+  if(run->xmpp4 != NULL)
+  {
+    g_object_set(
+      G_OBJECT(run->xmpp4),
+      "max-accept-rate", startup->options->max_accept_rate,
+      "max-handshakes", startup->options->max_handshakes,
+      "compression-level", startup->options->compression_level,
+      NULL
+    );
+  }
+
   /* Now, re-initialize plugins. This is a bit tricky, because it can fail,
    * and because we need to unload the previous plugins first.
    *
@@ -384,6 +402,11 @@ infinoted_config_reload(InfinotedRun* run,
    * unloaded.
    */
 
+  /* Stop the connection loops while plugins and SASL contexts are replaced,
+   * since the loops might call into either of them. */
+  if(run->loop_pool != NULL)
+    infd_loop_pool_pause(run->loop_pool);
+
   /* TODO: Make sure this unloads all plugins... at the moment it wouldn't
    * happen if some plugin ref-ed the plugin manager. */
   g_assert(run->plugin_manager != NULL);
@@ -405,6 +428,18 @@ infinoted_config_reload(InfinotedRun* run,
     g_object_unref(filesystem_account_storage);
   }
 
+  infd_directory_set_memory_budget(
+    run->directory,
+    (guint64)startup->options->memory_budget * 1024 * 1024
+  );
+
+  g_object_set(
+    G_OBJECT(run->directory),
+    "send-queue-limit", (guint64)startup->options->send_queue_limit * 1024,
+    "slow-consumer-policy", startup->options->slow_consumer_policy,
+    NULL
+  );
+
 #ifdef G_OS_WIN32
   module_path = g_win32_get_package_installation_directory_of_module(NULL);
   plugin_path = g_build_filename(module_path, "lib", PLUGIN_PATH, NULL);
@@ -490,6 +525,9 @@ infinoted_config_reload(InfinotedRun* run,
   infinoted_startup_free(run->startup);
   run->startup = startup;
 
+  if(run->loop_pool != NULL)
+    infd_loop_pool_resume(run->loop_pool);
+
   return TRUE;
 }
 
@@ -25,6 +25,105 @@
 #include <glib/gstdio.h>
 #include <sys/stat.h>
 
+struct _InfinotedDhParamsGeneration {
+  gint ref_count;
+  InfIo* io;
+  gchar* filename;
+
+  InfinotedDhParamsFunc func;
+  gpointer user_data;
+  gboolean cancelled; /* only accessed in the thread of io */
+
+  gnutls_dh_params_t dh_params;
+  GError* error;
+};
+
+static gchar*
+infinoted_dh_params_get_filename(void)
+{
+  return g_build_filename(g_get_home_dir(), ".infinoted", "dh.pem", NULL);
+}
+
+static gnutls_dh_params_t
+infinoted_dh_params_read_cached(const gchar* filename)
+{
+  struct stat st;
+
+  if(g_stat(filename, &st) == 0)
+  {
+    /* DH params expire every week */
+    /*if(st.st_mtime + 60 * 60 * 24 * 7 > time(NULL))*/
+      return inf_cert_util_read_dh_params(filename, NULL);
+  }
+
+  return NULL;
+}
+
+static void
+infinoted_dh_params_generation_unref(gpointer data)
+{
+  InfinotedDhParamsGeneration* generation;
+  generation = (InfinotedDhParamsGeneration*)data;
+
+  if(g_atomic_int_dec_and_test(&generation->ref_count))
+  {
+    if(generation->dh_params != NULL)
+      gnutls_dh_params_deinit(generation->dh_params);
+    if(generation->error != NULL)
+      g_error_free(generation->error);
+
+    g_free(generation->filename);
+    g_object_unref(generation->io);
+    g_slice_free(InfinotedDhParamsGeneration, generation);
+  }
+}
+
+static void
+infinoted_dh_params_generation_finished_func(gpointer user_data)
+{
+  InfinotedDhParamsGeneration* generation;
+  gnutls_dh_params_t dh_params;
+
+  generation = (InfinotedDhParamsGeneration*)user_data;
+  if(generation->cancelled)
+    return;
+
+  dh_params = generation->dh_params;
+  generation->dh_params = NULL;
+
+  generation->func(dh_params, generation->error, generation->user_data);
+}
+
+static gpointer
+infinoted_dh_params_generation_thread_func(gpointer data)
+{
+  InfinotedDhParamsGeneration* generation;
+  generation = (InfinotedDhParamsGeneration*)data;
+
+  generation->dh_params = inf_cert_util_create_dh_params(&generation->error);
+
+  if(generation->dh_params != NULL)
+  {
+    infinoted_util_create_dirname(generation->filename, NULL);
+
+    inf_cert_util_write_dh_params(
+      generation->dh_params,
+      generation->filename,
+      NULL
+    );
+  }
+
+  /* This passes our reference on to the main thread */
+  inf_io_add_dispatch(
+    generation->io,
+    infinoted_dh_params_generation_finished_func,
+    generation,
+    infinoted_dh_params_generation_unref
+  );
+
+  return NULL;
+}
+
 /**
  * infinoted_dh_params_ensure:
  * @log: A #InfinotedLog, or %NULL.
@@ -54,7 +153,6 @@ infinoted_dh_params_ensure(InfinotedLog* log,
 {
   gnutls_certificate_credentials_t creds;
   gchar* filename;
-  struct stat st;
 
   creds = inf_certificate_credentials_get(credentials);
   if(*dh_params != NULL)
@@ -63,15 +161,8 @@ infinoted_dh_params_ensure(InfinotedLog* log,
     return TRUE;
   }
 
-  filename =
-    g_build_filename(g_get_home_dir(), ".infinoted", "dh.pem", NULL);
-
-  if(g_stat(filename, &st) == 0)
-  {
-    /* DH params expire every week */
-    /*if(st.st_mtime + 60 * 60 * 24 * 7 > time(NULL))*/
-      *dh_params = inf_cert_util_read_dh_params(filename, NULL);
-  }
+  filename = infinoted_dh_params_get_filename();
+  *dh_params = infinoted_dh_params_read_cached(filename);
 
   if(*dh_params == NULL)
   {
@@ -100,4 +191,107 @@ infinoted_dh_params_ensure(InfinotedLog* log,
   return TRUE;
 }
 
+/**
+ * infinoted_dh_params_ensure_async:
+ * @log: A #InfinotedLog, or %NULL.
+ * @io: The #InfIo of the main loop.
+ * @credentials: A #InfCertificateCredentials.
+ * @dh_params: A pointer to a gnutls_dh_params_t structure.
+ * @func: Function to call when DH parameters have been generated.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Like infinoted_dh_params_ensure(), but if no DH parameters are available
+ * and they need to be generated, then this is done in a separate thread
+ * instead of blocking the caller. In that case the function returns a
+ * #InfinotedDhParamsGeneration, and @func is called in @io when the
+ * parameters are ready, taking ownership of them, or when their generation
+ * failed. It is up to @func to set the new parameters in the credentials
+ * that are in use at that time. The returned object must be freed with
+ * infinoted_dh_params_generation_cancel() exactly once, at the latest from
+ * within @func.
+ * Until then, TLS connections can still be made, but without cipher suites
+ * that require DH parameters.
+ *
+ * If parameters are available right away, they are set in @credentials
+ * and stored in *@dh_params, and the function returns %NULL without
+ * calling @func.
+ *
+ * Returns: (transfer full): A #InfinotedDhParamsGeneration, or %NULL.
+ */
+InfinotedDhParamsGeneration*
+infinoted_dh_params_ensure_async(InfinotedLog* log,
+                                 InfIo* io,
+                                 InfCertificateCredentials* credentials,
+                                 gnutls_dh_params_t* dh_params,
+                                 InfinotedDhParamsFunc func,
+                                 gpointer user_data)
+{
+  InfinotedDhParamsGeneration* generation;
+  gchar* filename;
+  GThread* thread;
+
+  if(*dh_params == NULL)
+  {
+    filename = infinoted_dh_params_get_filename();
+    *dh_params = infinoted_dh_params_read_cached(filename);
+
+    if(*dh_params == NULL)
+    {
+      if(log != NULL)
+      {
+        infinoted_log_info(
+          log,
+          _("Generating 2048 bit Diffie-Hellman parameters in the "
+            "background...")
+        );
+      }
+
+      generation = g_slice_new(InfinotedDhParamsGeneration);
+      generation->ref_count = 2; /* one for us, one for the thread */
+      generation->io = io;
+      generation->filename = filename;
+      generation->func = func;
+      generation->user_data = user_data;
+      generation->cancelled = FALSE;
+      generation->dh_params = NULL;
+      generation->error = NULL;
+      g_object_ref(io);
+
+      thread = g_thread_new(
+        "infinoted-dh-params",
+        infinoted_dh_params_generation_thread_func,
+        generation
+      );
+
+      g_thread_unref(thread);
+      return generation;
+    }
+
+    g_free(filename);
+  }
+
+  gnutls_certificate_set_dh_params(
+    inf_certificate_credentials_get(credentials),
+    *dh_params
+  );
+
+  return NULL;
+}
+
+/**
+ * infinoted_dh_params_generation_cancel:
+ * @generation: A #InfinotedDhParamsGeneration.
+ *
+ * Makes sure the callback of @generation is not called anymore, and frees
+ * @generation. This must be called from the main loop, either before the
+ * callback was called or from within the callback. The generation itself
+ * cannot be interrupted, but its result is dropped.
+ */
+void
+infinoted_dh_params_generation_cancel(InfinotedDhParamsGeneration* generation)
+{
+  generation->cancelled = TRUE;
+  infinoted_dh_params_generation_unref(generation);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -23,18 +23,36 @@
 #include <infinoted/infinoted-log.h>
 
 #include <libinfinity/common/inf-certificate-credentials.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <gnutls/gnutls.h>
 #include <glib.h>
 
 G_BEGIN_DECLS
 
+typedef struct _InfinotedDhParamsGeneration InfinotedDhParamsGeneration;
+
+typedef void(*InfinotedDhParamsFunc)(gnutls_dh_params_t dh_params,
+                                     const GError* error,
+                                     gpointer user_data);
+
 gboolean
 infinoted_dh_params_ensure(InfinotedLog* log,
                            InfCertificateCredentials* creds,
                            gnutls_dh_params_t* dh_params,
                            GError** error);
 
+InfinotedDhParamsGeneration*
+infinoted_dh_params_ensure_async(InfinotedLog* log,
+                                 InfIo* io,
+                                 InfCertificateCredentials* creds,
+                                 gnutls_dh_params_t* dh_params,
+                                 InfinotedDhParamsFunc func,
+                                 gpointer user_data);
+
+void
+infinoted_dh_params_generation_cancel(InfinotedDhParamsGeneration* generation);
+
 G_END_DECLS
 
 #endif /* __INFINOTED_DH_PARAMS_H__ */
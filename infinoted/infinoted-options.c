@@ -128,6 +128,110 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "documents on the server, and where they are read from after a "
        "server restart. [Default=~/.infinote]"),
     N_("DIRECTORY")
+  }, {
+    "memory-budget",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, memory_budget),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The amount of memory, in MiB, that documents may use on the server. "
+       "If they use more, then documents that nobody is subscribed to are "
+       "saved and removed from memory right away, instead of 60 seconds "
+       "after the last user left, starting with the ones that have been "
+       "unused for the longest time. They are loaded again when needed. "
+       "0 means no limit. [Default=0]"),
+    N_("MIB")
+  }, {
+    "send-queue-limit",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, send_queue_limit),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The amount of data in KiB that may wait to be sent to a single "
+       "client. Messages queue up when a client does not receive them fast "
+       "enough, for example because of a slow network connection. If more "
+       "is waiting, then the client is handled according to "
+       "slow-consumer-policy. 0 means no limit. [Default=0]"),
+    N_("KIB")
+  }, {
+    "slow-consumer-policy",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedOptions, slow_consumer_policy),
+    infinoted_parameter_convert_slow_consumer_policy,
+    0,
+    N_("What to do with clients exceeding send-queue-limit. With "
+       "\"disconnect\" they are disconnected. With \"throttle\" the server "
+       "stops reading from them until they have caught up, and disconnects "
+       "them only if twice as much data is waiting. "
+       "[Default=disconnect]"),
+    N_("disconnect|throttle")
+  }, {
+    "max-accept-rate",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, max_accept_rate),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The maximum number of new connections accepted per second. "
+       "Connections coming in faster than that are closed immediately. "
+       "0 means no limit. [Default=0]"),
+    N_("N")
+  }, {
+    "max-handshakes",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, max_handshakes),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The maximum number of new connections which are still performing "
+       "the TLS handshake and authentication at the same time. Further "
+       "connections are closed immediately. 0 means no limit. [Default=0]"),
+    N_("N")
+  }, {
+    "compression-level",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, compression_level),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The zlib compression level from 1 to 9 offered to clients, or 0 to "
+       "not offer compression. Compression can reveal the content of "
+       "encrypted connections to an attacker who can inject data into "
+       "them. [Default=0]"),
+    N_("LEVEL")
+  }, {
+    "event-loops",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, event_loops),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of threads in which client connections are run. Each "
+       "connection is assigned to one of these threads, where its network "
+       "traffic, encryption and message parsing are handled, so that busy "
+       "connections do not slow down the others. Each document is assigned "
+       "to one of these threads as well, so that changes to different "
+       "documents are processed in parallel. 0 means that everything is "
+       "done in the main thread. Changing this requires a restart of the "
+       "server. [Default=0]"),
+    N_("N")
+  }, {
+    "handshake-threads",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, handshake_threads),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of threads in which new client connections perform the "
+       "TLS handshake and authentication. Once established, connections "
+       "are handed back to the main thread. This has no effect if "
+       "event-loops is set, since then connections run in those threads "
+       "altogether. 0 means that handshakes are done in the main thread. "
+       "Changing this requires a restart of the server. [Default=0]"),
+    N_("N")
   }, {
     "plugins",
     INFINOTED_PARAMETER_STRING_LIST,
@@ -186,6 +290,18 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "connect to the server. This option can be given multiple times to "
        "allow multiple groups."),
     N_("GROUPS")
+  }, {
+    "pam-threads",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, pam_threads),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The maximum number of logins which are checked with PAM at the "
+       "same time. Logins are checked in the background, so that a slow "
+       "PAM service does not block the server. Further logins wait until "
+       "one of these checks has finished. [Default=4]"),
+    N_("N")
 #endif
   }, {
     NULL,
@@ -249,6 +365,18 @@ infinoted_options_validate(InfinotedOptions* options,
     );
   }
 
+  if(options->compression_level > 9)
+  {
+    g_set_error_literal(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_NUMBER,
+      _("The compression level must be between 0 and 9.")
+    );
+
+    return FALSE;
+  }
+
   if(options->create_key == TRUE && options->create_certificate == FALSE)
   {
     g_set_error_literal(
@@ -975,6 +1103,14 @@ infinoted_options_new(const gchar* const* config_files,
   options->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
   options->root_directory =
     g_build_filename(g_get_home_dir(), ".infinote", NULL);
+  options->memory_budget = 0;
+  options->send_queue_limit = 0;
+  options->slow_consumer_policy = INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT;
+  options->max_accept_rate = 0;
+  options->max_handshakes = 0;
+  options->compression_level = 0;
+  options->event_loops = 0;
+  options->handshake_threads = 0;
   options->plugins = g_malloc(2 * sizeof(gchar*));
   options->plugins[0] = g_strdup("note-text");
   options->plugins[1] = NULL;
@@ -984,6 +1120,7 @@ infinoted_options_new(const gchar* const* config_files,
   options->pam_service = NULL;
   options->pam_allowed_users = NULL;
   options->pam_allowed_groups = NULL;
+  options->pam_threads = 4;
 #endif /* LIBINFINITY_HAVE_PAM */
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
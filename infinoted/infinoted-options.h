@@ -20,6 +20,7 @@
 #ifndef __INFINOTED_OPTIONS_H__
 #define __INFINOTED_OPTIONS_H__
 
+#include <libinfinity/server/infd-directory.h>
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-config.h>
 
@@ -42,6 +43,14 @@ struct _InfinotedOptions {
   InfIpAddress *listen_address;
   InfXmppConnectionSecurityPolicy security_policy;
   gchar* root_directory;
+  guint memory_budget;
+  guint send_queue_limit;
+  InfdDirectorySlowConsumerPolicy slow_consumer_policy;
+  guint max_accept_rate;
+  guint max_handshakes;
+  guint compression_level;
+  guint event_loops;
+  guint handshake_threads;
 
   gchar** plugins;
 
@@ -51,6 +60,7 @@ struct _InfinotedOptions {
   gchar* pam_service;
   gchar** pam_allowed_users;
   gchar** pam_allowed_groups;
+  guint pam_threads;
 #endif /* LIBINFINITY_HAVE_PAM */
 
 #ifdef LIBINFINITY_HAVE_LIBDAEMON
@@ -34,6 +34,45 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Upper bounds of the latency histogram buckets, in microseconds. The last
+ * bucket takes everything above. */
+static const gint64 INFINOTED_PAM_POOL_LATENCY_BOUNDS[
+  INFINOTED_PAM_POOL_N_LATENCY_BUCKETS - 1] = {
+  10 * 1000, 100 * 1000, 1000 * 1000, 10 * 1000 * 1000
+};
+
+struct _InfinotedPamPool {
+  gint ref_count;
+  InfinotedLog* log;
+
+  /* Has at most as many threads as logins may be checked at the same
+   * time. Further logins wait in the queue of the thread pool. */
+  GThreadPool* threads;
+
+  /* Protected by mutex, since logins finish in different event loops */
+  GMutex mutex;
+  guint latency_histogram[INFINOTED_PAM_POOL_N_LATENCY_BUCKETS];
+};
+
+/* Everything the worker thread needs is copied, since the options might be
+ * reloaded and the SASL session might go away while it runs. */
+typedef struct _InfinotedPamPoolVerification InfinotedPamPoolVerification;
+struct _InfinotedPamPoolVerification {
+  InfinotedPamPool* pool;
+  InfIo* io;
+  gint64 begin;
+
+  gchar* service;
+  gchar** allowed_users;
+  gchar** allowed_groups;
+  gchar* username;
+  gchar* password;
+  GError* error;
+
+  InfinotedPamPoolFunc func;
+  gpointer user_data;
+};
+
 /* cannot use g_strdup because that requires its return value to be free'd
  * with g_free(), but pam is not aware of that. */
 
@@ -183,13 +222,13 @@ infinoted_pam_user_is_in_group(const gchar* username,
   return FALSE;
 }
 
-gboolean
-infinoted_pam_user_is_allowed(InfinotedStartup* startup,
+static gboolean
+infinoted_pam_user_is_allowed(InfinotedLog* log,
+                              gchar** allowed_users,
+                              gchar** allowed_groups,
                               const gchar* username,
                               GError** error)
 {
-  InfinotedOptions* options;
-
   char* buf;
   long buf_size_gr, buf_size_pw, buf_size;
   gboolean status;
@@ -197,25 +236,22 @@ infinoted_pam_user_is_allowed(InfinotedStartup* startup,
 
   gchar** iter;
 
-  options = startup->options;
-
-  if(options->pam_allowed_users == NULL
-     && options->pam_allowed_groups == NULL)
+  if(allowed_users == NULL && allowed_groups == NULL)
   {
     return TRUE;
   }
   else
   {
-    if(options->pam_allowed_users != NULL)
+    if(allowed_users != NULL)
     {
-      for(iter = options->pam_allowed_users; *iter; ++iter)
+      for(iter = allowed_users; *iter; ++iter)
       {
         if(strcmp(*iter, username) == 0)
           return TRUE;
       }
     }
 
-    if(options->pam_allowed_groups != NULL)
+    if(allowed_groups != NULL)
     {
       /* avoid reallocating this buffer over and over */
       buf_size_pw = sysconf(_SC_GETPW_R_SIZE_MAX);
@@ -225,10 +261,10 @@ infinoted_pam_user_is_allowed(InfinotedStartup* startup,
 
       status = FALSE;
       local_error = NULL;
-      for(iter = options->pam_allowed_groups; *iter; ++iter)
+      for(iter = allowed_groups; *iter; ++iter)
       {
         if(infinoted_pam_user_is_in_group(
-             username, *iter, buf, buf_size, startup->log, &local_error))
+             username, *iter, buf, buf_size, log, &local_error))
         {
           status = TRUE;
           break;
@@ -289,6 +325,280 @@ infinoted_pam_authenticate(const char* service,
   return status == PAM_SUCCESS;
 }
 
+static void
+infinoted_pam_pool_verification_free(InfinotedPamPoolVerification* verification)
+{
+  /* Don't leave the password in freed memory */
+  memset(verification->password, 0, strlen(verification->password));
+
+  g_free(verification->service);
+  g_strfreev(verification->allowed_users);
+  g_strfreev(verification->allowed_groups);
+  g_free(verification->username);
+  g_free(verification->password);
+
+  if(verification->error != NULL)
+    g_error_free(verification->error);
+
+  g_object_unref(verification->io);
+  infinoted_pam_pool_unref(verification->pool);
+  g_slice_free(InfinotedPamPoolVerification, verification);
+}
+
+/* Runs in the event loop in which the verification was started */
+static void
+infinoted_pam_pool_done_func(gpointer user_data)
+{
+  InfinotedPamPoolVerification* verification;
+  InfinotedPamPool* pool;
+  gint64 latency;
+  guint bucket;
+
+  verification = (InfinotedPamPoolVerification*)user_data;
+  pool = verification->pool;
+
+  latency = g_get_monotonic_time() - verification->begin;
+  for(bucket = 0;
+      bucket < INFINOTED_PAM_POOL_N_LATENCY_BUCKETS - 1;
+      ++bucket)
+  {
+    if(latency < INFINOTED_PAM_POOL_LATENCY_BOUNDS[bucket])
+      break;
+  }
+
+  g_mutex_lock(&pool->mutex);
+  ++pool->latency_histogram[bucket];
+  g_mutex_unlock(&pool->mutex);
+
+  verification->func(verification->error, verification->user_data);
+}
+
+/* Runs in a thread of the pool */
+static void
+infinoted_pam_pool_run_func(gpointer data,
+                            gpointer user_data)
+{
+  InfinotedPamPoolVerification* verification;
+  InfinotedPamPool* pool;
+
+  verification = (InfinotedPamPoolVerification*)data;
+  pool = (InfinotedPamPool*)user_data;
+
+  if(!infinoted_pam_authenticate(verification->service,
+                                 verification->username,
+                                 verification->password))
+  {
+    g_set_error_literal(
+      &verification->error,
+      inf_authentication_detail_error_quark(),
+      INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED,
+      inf_authentication_detail_strerror(
+        INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED
+      )
+    );
+  }
+  else if(!infinoted_pam_user_is_allowed(pool->log,
+                                         verification->allowed_users,
+                                         verification->allowed_groups,
+                                         verification->username,
+                                         &verification->error) &&
+          verification->error == NULL)
+  {
+    g_set_error_literal(
+      &verification->error,
+      inf_authentication_detail_error_quark(),
+      INF_AUTHENTICATION_DETAIL_ERROR_USER_NOT_AUTHORIZED,
+      inf_authentication_detail_strerror(
+        INF_AUTHENTICATION_DETAIL_ERROR_USER_NOT_AUTHORIZED
+      )
+    );
+  }
+
+  /* verification must not be accessed anymore after this call, since the
+   * dispatch might already be running in the other thread. */
+  inf_io_add_dispatch(
+    verification->io,
+    infinoted_pam_pool_done_func,
+    verification,
+    (GDestroyNotify)infinoted_pam_pool_verification_free
+  );
+}
+
+/**
+ * infinoted_pam_pool_new:
+ * @log: A #InfinotedLog to write errors to.
+ * @max_workers: The maximum number of logins to verify at the same time.
+ *
+ * Creates a new #InfinotedPamPool, which checks user names and passwords
+ * with PAM in worker threads, so that a slow PAM backend does not block the
+ * event loops of the server. It uses at most @max_workers threads, so that
+ * at most @max_workers logins are checked at the same time. Further logins
+ * are queued until a thread becomes available.
+ *
+ * Returns: A new #InfinotedPamPool. Free with infinoted_pam_pool_unref().
+ */
+InfinotedPamPool*
+infinoted_pam_pool_new(InfinotedLog* log,
+                       guint max_workers)
+{
+  InfinotedPamPool* pool;
+  guint i;
+
+  g_return_val_if_fail(INFINOTED_IS_LOG(log), NULL);
+  g_return_val_if_fail(max_workers > 0, NULL);
+
+  pool = g_slice_new(InfinotedPamPool);
+  pool->ref_count = 1;
+  pool->log = log;
+  g_object_ref(log);
+
+  /* This cannot fail for a pool that is not exclusive */
+  pool->threads = g_thread_pool_new(
+    infinoted_pam_pool_run_func,
+    pool,
+    max_workers,
+    FALSE,
+    NULL
+  );
+
+  g_mutex_init(&pool->mutex);
+
+  for(i = 0; i < INFINOTED_PAM_POOL_N_LATENCY_BUCKETS; ++i)
+    pool->latency_histogram[i] = 0;
+
+  return pool;
+}
+
+/**
+ * infinoted_pam_pool_ref:
+ * @pool: A #InfinotedPamPool.
+ *
+ * Increases the reference count of @pool by one.
+ *
+ * Returns: The passed #InfinotedPamPool, @pool.
+ */
+InfinotedPamPool*
+infinoted_pam_pool_ref(InfinotedPamPool* pool)
+{
+  g_atomic_int_inc(&pool->ref_count);
+  return pool;
+}
+
+/**
+ * infinoted_pam_pool_unref:
+ * @pool: A #InfinotedPamPool.
+ *
+ * Decreases the reference count of @pool by one. Every pending verification
+ * holds a reference, so @pool is only freed once all of them have
+ * finished.
+ */
+void
+infinoted_pam_pool_unref(InfinotedPamPool* pool)
+{
+  if(g_atomic_int_dec_and_test(&pool->ref_count))
+  {
+    /* All verifications are done, but the thread that finished the last
+     * one might not have returned yet. */
+    g_thread_pool_free(pool->threads, FALSE, TRUE);
+
+    g_mutex_clear(&pool->mutex);
+    g_object_unref(pool->log);
+    g_slice_free(InfinotedPamPool, pool);
+  }
+}
+
+/**
+ * infinoted_pam_pool_verify:
+ * @pool: A #InfinotedPamPool.
+ * @io: The #InfIo of the event loop in which to call @func.
+ * @options: The #InfinotedOptions with the PAM service and the allowed
+ * users and groups.
+ * @username: The name of the user to log in.
+ * @password: The password of the user.
+ * @func: Function to call with the result.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Checks in a thread of @pool whether @username can log in with @password,
+ * and whether that user is allowed to use the server. When done, @func is
+ * called in @io with a %NULL error on success, or with an error in the
+ * inf_authentication_detail_error_quark() domain otherwise. If all threads
+ * of @pool are busy, or no further thread can be created right now, the
+ * verification waits until a thread becomes available.
+ */
+void
+infinoted_pam_pool_verify(InfinotedPamPool* pool,
+                          InfIo* io,
+                          const InfinotedOptions* options,
+                          const gchar* username,
+                          const gchar* password,
+                          InfinotedPamPoolFunc func,
+                          gpointer user_data)
+{
+  InfinotedPamPoolVerification* verification;
+
+  g_return_if_fail(pool != NULL);
+  g_return_if_fail(INF_IS_IO(io));
+  g_return_if_fail(options != NULL);
+  g_return_if_fail(options->pam_service != NULL);
+  g_return_if_fail(username != NULL);
+  g_return_if_fail(password != NULL);
+  g_return_if_fail(func != NULL);
+
+  verification = g_slice_new(InfinotedPamPoolVerification);
+  verification->pool = infinoted_pam_pool_ref(pool);
+  verification->io = io;
+  g_object_ref(io);
+  verification->begin = g_get_monotonic_time();
+
+  verification->service = g_strdup(options->pam_service);
+  verification->allowed_users = g_strdupv(options->pam_allowed_users);
+  verification->allowed_groups = g_strdupv(options->pam_allowed_groups);
+  verification->username = g_strdup(username);
+  verification->password = g_strdup(password);
+  verification->error = NULL;
+
+  verification->func = func;
+  verification->user_data = user_data;
+
+  /* This only fails if a new thread could not be created. The verification
+   * is queued anyway then, and runs in one of the existing threads, or in
+   * the next one that can be created. */
+  g_thread_pool_push(pool->threads, verification, NULL);
+}
+
+/**
+ * infinoted_pam_pool_take_latency_histogram:
+ * @pool: A #InfinotedPamPool.
+ * @histogram: An array of %INFINOTED_PAM_POOL_N_LATENCY_BUCKETS elements.
+ *
+ * Writes into @histogram how many logins finished, successfully or not,
+ * within less than 10 ms, 100 ms, 1 s, 10 s, and longer, counting from
+ * the call to infinoted_pam_pool_verify(). The counters are reset
+ * afterwards.
+ *
+ * Returns: The total number of logins in @histogram.
+ */
+guint
+infinoted_pam_pool_take_latency_histogram(InfinotedPamPool* pool,
+                                          guint* histogram)
+{
+  guint total;
+  guint i;
+
+  total = 0;
+
+  g_mutex_lock(&pool->mutex);
+  for(i = 0; i < INFINOTED_PAM_POOL_N_LATENCY_BUCKETS; ++i)
+  {
+    histogram[i] = pool->latency_histogram[i];
+    pool->latency_histogram[i] = 0;
+    total += histogram[i];
+  }
+  g_mutex_unlock(&pool->mutex);
+
+  return total;
+}
+
 #endif /* LIBINFINITY_HAVE_PAM */
 
 /* vim:set et sw=2 ts=2: */
@@ -24,25 +24,52 @@
 
 #ifdef LIBINFINITY_HAVE_PAM
 
-#include <infinoted/infinoted-startup.h>
+#include <infinoted/infinoted-options.h>
+#include <infinoted/infinoted-log.h>
 
-#include <libinfinity/common/inf-xmpp-connection.h>
-#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <glib.h>
 
 G_BEGIN_DECLS
 
-gboolean
-infinoted_pam_user_is_allowed(InfinotedStartup* startup,
-                              const gchar* username,
-                              GError** error);
+/* Number of buckets in the login latency histogram. The buckets count
+ * logins which took less than 10 ms, 100 ms, 1 s and 10 s, and longer. */
+#define INFINOTED_PAM_POOL_N_LATENCY_BUCKETS 5
+
+typedef struct _InfinotedPamPool InfinotedPamPool;
+
+typedef void(*InfinotedPamPoolFunc)(const GError* error,
+                                    gpointer user_data);
 
 gboolean
 infinoted_pam_authenticate(const char* service,
                            const char* username,
                            const char* password);
 
+InfinotedPamPool*
+infinoted_pam_pool_new(InfinotedLog* log,
+                       guint max_workers);
+
+InfinotedPamPool*
+infinoted_pam_pool_ref(InfinotedPamPool* pool);
+
+void
+infinoted_pam_pool_unref(InfinotedPamPool* pool);
+
+void
+infinoted_pam_pool_verify(InfinotedPamPool* pool,
+                          InfIo* io,
+                          const InfinotedOptions* options,
+                          const gchar* username,
+                          const gchar* password,
+                          InfinotedPamPoolFunc func,
+                          gpointer user_data);
+
+guint
+infinoted_pam_pool_take_latency_histogram(InfinotedPamPool* pool,
+                                          guint* histogram);
+
 G_END_DECLS
 
 #endif /* LIBINFINITY_HAVE_PAM */
@@ -705,6 +705,59 @@ infinoted_parameter_convert_security_policy(gpointer out,
   return TRUE;
 }
 
+/**
+ * infinoted_parameter_convert_slow_consumer_policy:
+ * @out: (type InfdDirectorySlowConsumerPolicy*) (out): The pointer to the
+ * output #InfdDirectorySlowConsumerPolicy.
+ * @in: (type gchar**) (in): The pointer to the input string location.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Converts the string that @in points to to an
+ * #InfdDirectorySlowConsumerPolicy value, by requiring that it is either
+ * "disconnect" or "throttle". If the string is neither of these the
+ * function fails and @error is set.
+ *
+ * This is a #InfinotedParameterConvertFunc function that can be used for
+ * fields of type #InfdDirectorySlowConsumerPolicy.
+ *
+ * Returns: %TRUE on success, or %FALSE otherwise.
+ */
+gboolean
+infinoted_parameter_convert_slow_consumer_policy(gpointer out,
+                                                 gpointer in,
+                                                 GError** error)
+{
+  gchar** in_str;
+  InfdDirectorySlowConsumerPolicy* out_val;
+
+  in_str = (gchar**)in;
+  out_val = (InfdDirectorySlowConsumerPolicy*)out;
+
+  if(strcmp(*in_str, "disconnect") == 0)
+  {
+    *out_val = INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT;
+  }
+  else if(strcmp(*in_str, "throttle") == 0)
+  {
+    *out_val = INFD_DIRECTORY_SLOW_CONSUMER_THROTTLE;
+  }
+  else
+  {
+    g_set_error(
+      error,
+      infinoted_parameter_error_quark(),
+      INFINOTED_PARAMETER_ERROR_INVALID_SLOW_CONSUMER_POLICY,
+      _("\"%s\" is not a valid slow consumer policy. Allowed values are "
+        "\"disconnect\" or \"throttle\""),
+      *in_str
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 /**
  * infinoted_parameter_convert_flags:
  * @out: (type gint*) (out): The pointer to the output flags (a #gint).
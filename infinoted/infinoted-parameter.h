@@ -20,6 +20,7 @@
 #ifndef __INFINOTED_PARAMETER_H__
 #define __INFINOTED_PARAMETER_H__
 
+#include <libinfinity/server/infd-directory.h>
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-config.h>
 
@@ -163,6 +164,9 @@ struct _InfinotedParameterInfo {
  * &quot;no-tls&quot;, &quot;allow-tls&quot;, and &quot;require-tls&quot;.
  * @INFINOTED_PARAMETER_ERROR_INVALID_IP_ADDRESS: The value given as a
  * parameter is not a valid IP address.
+ * @INFINOTED_PARAMETER_ERROR_INVALID_SLOW_CONSUMER_POLICY: A slow consumer
+ * policy given as a parameter is not valid. The only allowed values are
+ * &quot;disconnect&quot; and &quot;throttle&quot;.
  *
  * Specifies the possible error conditions for errors in the
  * <literal>INFINOTED_PARAMETER_ERROR</literal> domain. These typically
@@ -173,7 +177,8 @@ typedef enum _InfinotedParameterError {
   INFINOTED_PARAMETER_ERROR_INVALID_NUMBER,
   INFINOTED_PARAMETER_ERROR_INVALID_FLAG,
   INFINOTED_PARAMETER_ERROR_INVALID_SECURITY_POLICY,
-  INFINOTED_PARAMETER_ERROR_INVALID_IP_ADDRESS
+  INFINOTED_PARAMETER_ERROR_INVALID_IP_ADDRESS,
+  INFINOTED_PARAMETER_ERROR_INVALID_SLOW_CONSUMER_POLICY
 } InfinotedParameterError;
 
 GQuark
@@ -238,6 +243,11 @@ infinoted_parameter_convert_security_policy(gpointer out,
                                             gpointer in,
                                             GError** error);
 
+gboolean
+infinoted_parameter_convert_slow_consumer_policy(gpointer out,
+                                                 gpointer in,
+                                                 GError** error);
+
 gboolean
 infinoted_parameter_convert_flags(gpointer out,
                                   gpointer in,
@@ -38,6 +38,102 @@
 static const guint8 INFINOTED_RUN_IPV6_ANY_ADDR[16] =
   { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
+#ifdef LIBINFINITY_HAVE_PAM
+/* Interval in seconds in which PAM login latencies are written to the log */
+#define INFINOTED_RUN_PAM_SUMMARY_INTERVAL 60
+
+static void
+infinoted_run_pam_summary_timeout_cb(gpointer user_data)
+{
+  InfinotedRun* run;
+  guint histogram[INFINOTED_PAM_POOL_N_LATENCY_BUCKETS];
+  guint total;
+
+  run = (InfinotedRun*)user_data;
+
+  /* The pool can come and go with configuration reloads, so look it up
+   * every time. */
+  if(run->startup->pam_pool != NULL)
+  {
+    total = infinoted_pam_pool_take_latency_histogram(
+      run->startup->pam_pool,
+      histogram
+    );
+
+    if(total > 0)
+    {
+      infinoted_log_info(
+        run->startup->log,
+        _("PAM logins in the last %u seconds: %u; latency below 10 ms: %u, "
+          "below 100 ms: %u, below 1 s: %u, below 10 s: %u, longer: %u"),
+        (guint)INFINOTED_RUN_PAM_SUMMARY_INTERVAL,
+        total,
+        histogram[0],
+        histogram[1],
+        histogram[2],
+        histogram[3],
+        histogram[4]
+      );
+    }
+  }
+
+  run->pam_summary_timeout = inf_io_add_timeout(
+    INF_IO(run->io),
+    INFINOTED_RUN_PAM_SUMMARY_INTERVAL * 1000,
+    infinoted_run_pam_summary_timeout_cb,
+    run,
+    NULL
+  );
+}
+#endif /* LIBINFINITY_HAVE_PAM */
+
+static void
+infinoted_run_dh_params_cb(gnutls_dh_params_t dh_params,
+                           const GError* error,
+                           gpointer user_data)
+{
+  InfinotedRun* run;
+  run = (InfinotedRun*)user_data;
+
+  infinoted_dh_params_generation_cancel(run->dh_params_generation);
+  run->dh_params_generation = NULL;
+
+  if(dh_params == NULL)
+  {
+    infinoted_log_error(
+      run->startup->log,
+      _("Failed to generate Diffie-Hellman parameters: %s"),
+      error->message
+    );
+
+    return;
+  }
+
+  infinoted_log_info(
+    run->startup->log,
+    _("Diffie-Hellman parameters have been generated")
+  );
+
+  g_assert(run->dh_params == NULL);
+  run->dh_params = dh_params;
+
+  /* The configuration might have been reloaded in the meanwhile, so use the
+   * current credentials. Connection loops might be using them right now. */
+  if(run->startup->credentials != NULL)
+  {
+    if(run->loop_pool != NULL)
+      infd_loop_pool_pause(run->loop_pool);
+
+    gnutls_certificate_set_dh_params(
+      inf_certificate_credentials_get(run->startup->credentials),
+      dh_params
+    );
+
+    if(run->loop_pool != NULL)
+      infd_loop_pool_resume(run->loop_pool);
+  }
+}
+
 static gboolean
 infinoted_run_load_directory(InfinotedRun* run,
                              InfinotedStartup* startup,
@@ -59,6 +155,30 @@ infinoted_run_load_directory(InfinotedRun* run,
 
   run->io = inf_standalone_io_new();
 
+  /* Connections run in these loops, and so do the requests made to
+   * sessions if event loops are configured. The directory stays in the main
+   * loop. With handshake threads only, connections come back to the main
+   * loop once they are established. */
+  if(startup->options->event_loops > 0)
+  {
+    run->loop_pool = infd_loop_pool_new(startup->options->event_loops);
+  }
+  else if(startup->options->handshake_threads > 0)
+  {
+    run->loop_pool = INFD_LOOP_POOL(
+      g_object_new(
+        INFD_TYPE_LOOP_POOL,
+        "n-loops", startup->options->handshake_threads,
+        "handshake-only", TRUE,
+        NULL
+      )
+    );
+  }
+  else
+  {
+    run->loop_pool = NULL;
+  }
+
   run->directory = infd_directory_new(
     INF_IO(run->io),
     INFD_STORAGE(storage),
@@ -67,6 +187,24 @@ infinoted_run_load_directory(InfinotedRun* run,
 
   infd_directory_enable_chat(run->directory, TRUE);
 
+  if(startup->options->event_loops > 0)
+    infd_directory_set_loop_pool(run->directory, run->loop_pool);
+
+  infd_directory_set_memory_budget(
+    run->directory,
+    (guint64)startup->options->memory_budget * 1024 * 1024
+  );
+
+  infd_directory_set_send_queue_limit(
+    run->directory,
+    (guint64)startup->options->send_queue_limit * 1024
+  );
+
+  infd_directory_set_slow_consumer_policy(
+    run->directory,
+    startup->options->slow_consumer_policy
+  );
+
   g_object_unref(communication_manager);
 
   /* Load server plugins via plugin manager */
@@ -173,6 +311,9 @@ infinoted_run_create_server(InfinotedRun* run,
 
   infd_tcp_server_set_keepalive(tcp, &startup->keepalive);
 
+  if(run->loop_pool != NULL)
+    g_object_set(G_OBJECT(tcp), "loop-pool", run->loop_pool, NULL);
+
   if(!infd_tcp_server_bind(tcp, error))
   {
     g_object_unref(tcp);
@@ -187,6 +328,21 @@ infinoted_run_create_server(InfinotedRun* run,
     startup->sasl_context ? "PLAIN" : NULL
   );
 
+  infd_xmpp_server_set_max_accept_rate(
+    xmpp,
+    startup->options->max_accept_rate
+  );
+
+  infd_xmpp_server_set_max_handshakes(
+    xmpp,
+    startup->options->max_handshakes
+  );
+
+  infd_xmpp_server_set_compression_level(
+    xmpp,
+    startup->options->compression_level
+  );
+
   infd_server_pool_add_server(run->pool, INFD_XML_SERVER(xmpp));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -230,6 +386,7 @@ infinoted_run_new(InfinotedStartup* startup,
   run = g_slice_new(InfinotedRun);
   run->startup = startup;
   run->dh_params = NULL;
+  run->dh_params_generation = NULL;
 
   if(infinoted_run_load_directory(run, startup, error) == FALSE)
   {
@@ -296,6 +453,8 @@ infinoted_run_new(InfinotedStartup* startup,
 #endif
       g_object_unref(run->pool);
       g_object_unref(run->directory);
+      if(run->loop_pool != NULL)
+        g_object_unref(run->loop_pool);
       g_object_unref(run->io);
       g_slice_free(InfinotedRun, run);
       run = NULL;
@@ -304,6 +463,19 @@ infinoted_run_new(InfinotedStartup* startup,
 
   inf_ip_address_free(address);
 
+#ifdef LIBINFINITY_HAVE_PAM
+  if(run != NULL)
+  {
+    run->pam_summary_timeout = inf_io_add_timeout(
+      INF_IO(run->io),
+      INFINOTED_RUN_PAM_SUMMARY_INTERVAL * 1000,
+      infinoted_run_pam_summary_timeout_cb,
+      run,
+      NULL
+    );
+  }
+#endif
+
   return run;
 }
 
@@ -343,16 +515,36 @@ infinoted_run_free(InfinotedRun* run)
   g_object_unref(run->avahi);
 #endif
 
+  /* Plugins might have set up connections with callbacks running in the
+   * connection loops, so keep the loops from running them while the plugins
+   * are unloaded. */
+  if(run->loop_pool != NULL)
+    infd_loop_pool_pause(run->loop_pool);
+
   if(run->plugin_manager != NULL)
   {
     g_object_unref(run->plugin_manager);
     run->plugin_manager = NULL;
   }
 
+  if(run->loop_pool != NULL)
+    infd_loop_pool_resume(run->loop_pool);
+
+#ifdef LIBINFINITY_HAVE_PAM
+  inf_io_remove_timeout(INF_IO(run->io), run->pam_summary_timeout);
+#endif
+
   g_object_unref(run->io);
   g_object_unref(run->directory);
   g_object_unref(run->pool);
 
+  /* This waits until the loops have released the remaining connections */
+  if(run->loop_pool != NULL)
+    g_object_unref(run->loop_pool);
+
+  if(run->dh_params_generation != NULL)
+    infinoted_dh_params_generation_cancel(run->dh_params_generation);
+
   if(run->dh_params != NULL)
     gnutls_dh_params_deinit(run->dh_params);
 
@@ -362,14 +554,47 @@ infinoted_run_free(InfinotedRun* run)
   g_slice_free(InfinotedRun, run);
 }
 
+/**
+ * infinoted_run_ensure_dh_params:
+ * @run: A #InfinotedRun.
+ * @startup: The startup parameters whose credentials need DH parameters.
+ *
+ * Sets DH parameters for key exchange in the credentials of @startup. If
+ * there are none yet, they are read from the disk cache, or generated in
+ * the background if they are not cached. In the latter case the server
+ * runs without them until they are ready, and then they are set in the
+ * credentials that are in use at that time.
+ */
+void
+infinoted_run_ensure_dh_params(InfinotedRun* run,
+                               InfinotedStartup* startup)
+{
+  g_assert(startup->credentials != NULL);
+
+  /* A generation is running already and will set the parameters once it
+   * has finished */
+  if(run->dh_params_generation != NULL)
+    return;
+
+  run->dh_params_generation = infinoted_dh_params_ensure_async(
+    startup->log,
+    INF_IO(run->io),
+    startup->credentials,
+    &run->dh_params,
+    infinoted_run_dh_params_cb,
+    run
+  );
+}
+
 /**
  * infinoted_run_start:
  * @run: A #InfinotedRun.
  *
  * Starts the infinote server. This runs in a loop until infinoted_run_stop()
  * is called. This may fail in theory, but hardly does in practise. If it
- * fails, it prints an error message to stderr and returns. It may also block
- * before starting to generate DH parameters for key exchange.
+ * fails, it prints an error message to stderr and returns. If DH parameters
+ * for key exchange need to be generated, this happens in the background
+ * while the server is already running.
  */
 void
 infinoted_run_start(InfinotedRun* run)
@@ -378,7 +603,6 @@ infinoted_run_start(InfinotedRun* run)
   GError* error4;
   GError* error6;
   guint port;
-  gboolean result;
   InfdTcpServer* tcp;
 
   error = NULL;
@@ -387,22 +611,7 @@ infinoted_run_start(InfinotedRun* run)
 
   /* Load DH parameters */
   if(run->startup->credentials)
-  {
-    result = infinoted_dh_params_ensure(
-      run->startup->log, run->startup->credentials, &run->dh_params, &error);
-
-    if(result == FALSE)
-    {
-      infinoted_log_error(
-        run->startup->log,
-        _("Failed to generate Diffie-Hellman parameters: %s"),
-        error->message
-      );
-
-      g_error_free(error);
-      return;
-    }
-  }
+    infinoted_run_ensure_dh_params(run, run->startup);
 
   /* Open server sockets, accepting incoming connections... TODO: Prevent
    * code duplication here. */
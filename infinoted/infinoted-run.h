@@ -24,9 +24,11 @@
 
 #include <infinoted/infinoted-startup.h>
 #include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-dh-params.h>
 
 #include <libinfinity/server/infd-server-pool.h>
 #include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-loop-pool.h>
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-discovery-avahi.h>
 
@@ -39,6 +41,7 @@ struct _InfinotedRun {
   InfinotedStartup* startup;
 
   InfStandaloneIo* io;
+  InfdLoopPool* loop_pool;
   InfdDirectory* directory;
   InfdServerPool* pool;
 
@@ -47,10 +50,15 @@ struct _InfinotedRun {
   InfdXmppServer* xmpp4;
   InfdXmppServer* xmpp6;
   gnutls_dh_params_t dh_params;
+  InfinotedDhParamsGeneration* dh_params_generation;
 
 #ifdef LIBINFINITY_HAVE_AVAHI
   InfDiscoveryAvahi* avahi;
 #endif
+
+#ifdef LIBINFINITY_HAVE_PAM
+  InfIoTimeout* pam_summary_timeout;
+#endif
 };
 
 InfinotedRun*
@@ -60,6 +68,10 @@ infinoted_run_new(InfinotedStartup* startup,
 void
 infinoted_run_free(InfinotedRun* run);
 
+void
+infinoted_run_ensure_dh_params(InfinotedRun* run,
+                               InfinotedStartup* startup);
+
 void
 infinoted_run_start(InfinotedRun* run);
 
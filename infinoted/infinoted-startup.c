@@ -23,6 +23,7 @@
 
 #include <infinoted/infinoted-pam.h>
 
+#include <libinfinity/common/inf-tcp-connection.h>
 #include <libinfinity/common/inf-cert-util.h>
 #include <libinfinity/common/inf-init.h>
 #include <libinfinity/common/inf-error.h>
@@ -280,6 +281,144 @@ infinoted_startup_sasl_callback_set_error(InfXmppConnection* connection,
   }
 }
 
+#ifdef LIBINFINITY_HAVE_PAM
+typedef struct _InfinotedStartupPamLogin InfinotedStartupPamLogin;
+struct _InfinotedStartupPamLogin {
+  InfinotedLog* log;
+  InfSaslContextSession* session;
+  GWeakRef xmpp;
+  gchar* username;
+  gchar* remote_id;
+};
+
+static void
+infinoted_startup_pam_login_free(InfinotedStartupPamLogin* login)
+{
+  inf_sasl_context_session_unref(login->session);
+  g_weak_ref_clear(&login->xmpp);
+  g_object_unref(login->log);
+  g_free(login->username);
+  g_free(login->remote_id);
+  g_slice_free(InfinotedStartupPamLogin, login);
+}
+
+static void
+infinoted_startup_pam_login_done_cb(const GError* error,
+                                    gpointer user_data)
+{
+  InfinotedStartupPamLogin* login;
+  InfXmppConnection* xmpp;
+
+  login = (InfinotedStartupPamLogin*)user_data;
+  xmpp = g_weak_ref_get(&login->xmpp);
+
+  /* If the connection has been closed in the meanwhile, then it has
+   * stopped the session or is gone altogether, and there is nobody to tell
+   * the result to. */
+  if(xmpp != NULL && inf_sasl_context_session_is_processing(login->session))
+  {
+    if(error == NULL)
+    {
+      infinoted_log_info(
+        login->log,
+        _("User %s logged in from %s via PAM"),
+        login->username,
+        login->remote_id
+      );
+
+      inf_sasl_context_session_continue(login->session, GSASL_OK);
+    }
+    else if(error->code ==
+            INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED)
+    {
+      infinoted_log_warning(
+        login->log,
+        _("User %s failed to log in from %s: PAM authentication failed"),
+        login->username,
+        login->remote_id
+      );
+
+      infinoted_startup_sasl_callback_set_error(
+        xmpp,
+        INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED,
+        NULL
+      );
+
+      inf_sasl_context_session_continue(
+        login->session,
+        GSASL_AUTHENTICATION_ERROR
+      );
+    }
+    else
+    {
+      infinoted_log_warning(
+        login->log,
+        _("User %s failed to log in from %s: PAM user not allowed"),
+        login->username,
+        login->remote_id
+      );
+
+      infinoted_startup_sasl_callback_set_error(
+        xmpp,
+        error->code,
+        error
+      );
+
+      inf_sasl_context_session_continue(
+        login->session,
+        GSASL_AUTHENTICATION_ERROR
+      );
+    }
+  }
+
+  if(xmpp != NULL)
+    g_object_unref(xmpp);
+
+  infinoted_startup_pam_login_free(login);
+}
+
+static void
+infinoted_startup_pam_login(InfinotedStartup* startup,
+                            InfSaslContextSession* session,
+                            InfXmppConnection* xmpp,
+                            const gchar* username,
+                            const gchar* password,
+                            const gchar* remote_id)
+{
+  InfinotedStartupPamLogin* login;
+  InfTcpConnection* tcp;
+  InfIo* io;
+
+  g_object_get(G_OBJECT(xmpp), "tcp-connection", &tcp, NULL);
+  g_object_get(G_OBJECT(tcp), "io", &io, NULL);
+  g_object_unref(tcp);
+
+  /* PAM modules can take seconds to answer, so the password is checked in
+   * a worker thread, and the session is continued once the result is
+   * available. The login keeps the session alive, but not the connection,
+   * which stops the session when it is closed. */
+  login = g_slice_new(InfinotedStartupPamLogin);
+  login->log = startup->log;
+  g_object_ref(login->log);
+  login->session = inf_sasl_context_session_ref(session);
+  g_weak_ref_init(&login->xmpp, xmpp);
+  login->username = g_strdup(username);
+  login->remote_id = g_strdup(remote_id);
+
+  infinoted_pam_pool_verify(
+    startup->pam_pool,
+    io,
+    startup->options,
+    username,
+    password,
+    infinoted_startup_pam_login_done_cb,
+    login
+  );
+
+  g_object_unref(io);
+}
+#endif /* LIBINFINITY_HAVE_PAM */
+
 static void
 infinoted_startup_sasl_callback(InfSaslContextSession* session,
                                 Gsasl_property prop,
@@ -293,11 +432,6 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
   gchar cmp;
   gsize password_len;
   gsize i;
-
-#ifdef LIBINFINITY_HAVE_PAM
-  const gchar* pam_service;
-  GError* error;
-#endif
   gchar* remote_id;
 
   xmpp = INF_XMPP_CONNECTION(session_data);
@@ -310,61 +444,16 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
     username = inf_sasl_context_session_get_property(session, GSASL_AUTHID);
     password = inf_sasl_context_session_get_property(session, GSASL_PASSWORD);
 #ifdef LIBINFINITY_HAVE_PAM
-    pam_service = startup->options->pam_service;
-    if(pam_service != NULL)
+    if(startup->pam_pool != NULL)
     {
-      error = NULL;
-      if(!infinoted_pam_authenticate(pam_service, username, password))
-      {
-        infinoted_log_warning(
-          startup->log,
-          _("User %s failed to log in from %s: PAM authentication failed"),
-          username,
-          remote_id
-        );
-
-        infinoted_startup_sasl_callback_set_error(
-          xmpp,
-          INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED,
-          NULL
-        );
-
-        inf_sasl_context_session_continue(
-          session,
-          GSASL_AUTHENTICATION_ERROR
-        );
-      }
-      else if(!infinoted_pam_user_is_allowed(startup, username, &error))
-      {
-        infinoted_log_warning(
-          startup->log,
-          _("User %s failed to log in from %s: PAM user not allowed"),
-          username,
-          remote_id
-        );
-
-        infinoted_startup_sasl_callback_set_error(
-          xmpp,
-          INF_AUTHENTICATION_DETAIL_ERROR_USER_NOT_AUTHORIZED,
-          error
-        );
-
-        inf_sasl_context_session_continue(
-          session,
-          GSASL_AUTHENTICATION_ERROR
-        );
-      }
-      else
-      {
-        infinoted_log_info(
-          startup->log,
-          _("User %s logged in from %s via PAM"),
-          username,
-          remote_id
-        );
-
-        inf_sasl_context_session_continue(session, GSASL_OK);
-      }
+      infinoted_startup_pam_login(
+        startup,
+        session,
+        xmpp,
+        username,
+        password,
+        remote_id
+      );
     }
     else
 #endif /* LIBINFINITY_HAVE_PAM */
@@ -451,6 +540,16 @@ infinoted_startup_load(InfinotedStartup* startup,
     requires_password || startup->options->pam_service != NULL;
 #endif /* LIBINFINITY_HAVE_PAM */
 
+#ifdef LIBINFINITY_HAVE_PAM
+  if(startup->options->pam_service != NULL)
+  {
+    startup->pam_pool = infinoted_pam_pool_new(
+      startup->log,
+      startup->options->pam_threads
+    );
+  }
+#endif /* LIBINFINITY_HAVE_PAM */
+
   if(requires_password)
   {
     startup->sasl_context = inf_sasl_context_new(error);
@@ -494,6 +593,9 @@ infinoted_startup_new(int* argc,
   startup->certificates = NULL;
   startup->credentials = NULL;
   startup->sasl_context = NULL;
+#ifdef LIBINFINITY_HAVE_PAM
+  startup->pam_pool = NULL;
+#endif
 
   if(infinoted_startup_load(startup, argc, argv, error) == FALSE)
   {
@@ -539,6 +641,11 @@ infinoted_startup_free(InfinotedStartup* startup)
   if(startup->sasl_context != NULL)
     inf_sasl_context_unref(startup->sasl_context);
 
+#ifdef LIBINFINITY_HAVE_PAM
+  if(startup->pam_pool != NULL)
+    infinoted_pam_pool_unref(startup->pam_pool);
+#endif
+
   g_slice_free(InfinotedStartup, startup);
   inf_deinit();
 }
@@ -22,6 +22,7 @@
 
 #include <infinoted/infinoted-options.h>
 #include <infinoted/infinoted-log.h>
+#include <infinoted/infinoted-pam.h>
 #include <libinfinity/common/inf-certificate-credentials.h>
 
 #include <glib.h>
@@ -36,6 +37,9 @@ struct _InfinotedStartup {
   InfCertificateChain* certificates;
   InfCertificateCredentials* credentials;
   InfSaslContext* sasl_context;
+#ifdef LIBINFINITY_HAVE_PAM
+  InfinotedPamPool* pam_pool;
+#endif
 
   InfKeepalive keepalive;
 };
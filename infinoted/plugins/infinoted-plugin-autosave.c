@@ -24,6 +24,7 @@
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-buffer.h>
 
+#include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -38,11 +39,20 @@ struct _InfinotedPluginAutosave {
 
 typedef struct _InfinotedPluginAutosaveSessionInfo
   InfinotedPluginAutosaveSessionInfo;
+
+/* A save that is in progress. If the session is removed before the save
+ * finishes, info is reset to NULL. */
+typedef struct _InfinotedPluginAutosaveSave InfinotedPluginAutosaveSave;
+struct _InfinotedPluginAutosaveSave {
+  InfinotedPluginAutosaveSessionInfo* info;
+};
+
 struct _InfinotedPluginAutosaveSessionInfo {
   InfinotedPluginAutosave* plugin;
   InfBrowserIter iter;
   InfSessionProxy* proxy;
   InfIoTimeout* timeout;
+  InfinotedPluginAutosaveSave* save;
 };
 
 static void
@@ -84,6 +94,249 @@ infinoted_plugin_autosave_stop(InfinotedPluginAutosaveSessionInfo* info)
 }
 
 
+static void
+infinoted_plugin_autosave_buffer_notify_modified_cb(GObject* object,
+                                                    GParamSpec* pspec,
+                                                    gpointer user_data)
+{
+  InfinotedPluginAutosaveSessionInfo* info;
+  InfSession* session;
+  InfBuffer* buffer;
+
+  info = (InfinotedPluginAutosaveSessionInfo*)user_data;
+  g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
+  buffer = inf_session_get_buffer(session);
+
+  if(inf_buffer_get_modified(buffer) == TRUE)
+  {
+    if(info->timeout == NULL)
+      infinoted_plugin_autosave_start(info);
+  }
+  else
+  {
+    if(info->timeout != NULL)
+      infinoted_plugin_autosave_stop(info);
+  }
+
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_autosave_set_modified(
+  InfinotedPluginAutosaveSessionInfo* info,
+  gboolean modified)
+{
+  InfSession* session;
+  InfBuffer* buffer;
+
+  g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
+  buffer = inf_session_get_buffer(session);
+
+  inf_signal_handlers_block_by_func(
+    G_OBJECT(buffer),
+    G_CALLBACK(infinoted_plugin_autosave_buffer_notify_modified_cb),
+    info
+  );
+
+  inf_buffer_set_modified(buffer, modified);
+
+  inf_signal_handlers_unblock_by_func(
+    G_OBJECT(buffer),
+    G_CALLBACK(infinoted_plugin_autosave_buffer_notify_modified_cb),
+    info
+  );
+
+  g_object_unref(session);
+}
+
+static void
+infinoted_plugin_autosave_failed(InfinotedPluginAutosaveSessionInfo* info,
+                                 const GError* error)
+{
+  InfdDirectory* directory;
+  gchar* path;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+
+  infinoted_log_warning(
+    infinoted_plugin_manager_get_log(info->plugin->manager),
+    _("Failed to auto-save session \"%s\": %s\n\n"
+      "Will retry in %u seconds."),
+    path,
+    error->message,
+    info->plugin->interval
+  );
+
+  g_free(path);
+
+  /* The content has not been stored, so the buffer is still modified. The
+   * timeout might be running already if the buffer has been changed while
+   * the save was in progress. */
+  infinoted_plugin_autosave_set_modified(info, TRUE);
+  if(info->timeout == NULL)
+    infinoted_plugin_autosave_start(info);
+}
+
+static void
+infinoted_plugin_autosave_run_hook(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfdDirectory* directory;
+  GError* error;
+  gchar* path;
+  gchar* root_directory;
+  gchar* argv[4];
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+  error = NULL;
+
+  g_object_get(
+    G_OBJECT(infd_directory_get_storage(directory)),
+    "root-directory",
+    &root_directory,
+    NULL
+  );
+
+  argv[0] = info->plugin->hook;
+  argv[1] = root_directory;
+  argv[2] = path;
+  argv[3] = NULL;
+
+  if(!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
+                    NULL, NULL, NULL, &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(info->plugin->manager),
+      _("Could not execute autosave hook: \"%s\""),
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  g_free(path);
+  g_free(root_directory);
+}
+
+static void
+infinoted_plugin_autosave_save_cb(InfdDirectory* directory,
+                                  const InfBrowserIter* iter,
+                                  const GError* error,
+                                  gpointer user_data)
+{
+  InfinotedPluginAutosaveSave* save;
+  InfinotedPluginAutosaveSessionInfo* info;
+
+  save = (InfinotedPluginAutosaveSave*)user_data;
+  info = save->info;
+
+  /* Ignore the result if the session has been removed in the meanwhile, or
+   * if this save has been superseded by a newer one. */
+  if(info != NULL && info->save == save)
+  {
+    info->save = NULL;
+
+    if(error != NULL)
+    {
+      /* A cancelled save has been superseded by a synchronous save by the
+       * directory, or the node is being removed. */
+      if(error->domain != inf_directory_error_quark() ||
+         error->code != INF_DIRECTORY_ERROR_SAVE_CANCELLED)
+      {
+        infinoted_plugin_autosave_failed(info, error);
+      }
+    }
+    else if(info->plugin->hook != NULL)
+    {
+      infinoted_plugin_autosave_run_hook(info);
+    }
+  }
+
+  g_slice_free(InfinotedPluginAutosaveSave, save);
+}
+
+static void
+infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfdDirectory* directory;
+  InfinotedPluginAutosaveSave* save;
+  GError* error;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  error = NULL;
+
+  if(info->timeout != NULL)
+  {
+    inf_io_remove_timeout(infd_directory_get_io(directory), info->timeout);
+    info->timeout = NULL;
+  }
+
+  /* The session is written in the background, so that a large document
+   * does not block the server. The save cancels one that might still be in
+   * progress, whose result is then ignored. */
+  save = g_slice_new(InfinotedPluginAutosaveSave);
+  save->info = info;
+  info->save = save;
+
+  /* What is saved is a snapshot of the current content, so from now on the
+   * buffer is unmodified. Changes made while the save is in progress set
+   * the flag again, which schedules the next save. */
+  /* TODO: Remove this as soon as directory itself unsets modified flag
+   * on session_write */
+  infinoted_plugin_autosave_set_modified(info, FALSE);
+
+  if(!infd_directory_iter_save_session_async(directory, &info->iter,
+                                             infinoted_plugin_autosave_save_cb,
+                                             save, &error))
+  {
+    info->save = NULL;
+    g_slice_free(InfinotedPluginAutosaveSave, save);
+
+    infinoted_plugin_autosave_failed(info, error);
+    g_error_free(error);
+  }
+}
+
+static void
+infinoted_plugin_autosave_timeout_cb(gpointer user_data);
+
+static void
+infinoted_plugin_autosave_start(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfIo* io;
+
+  io = infd_directory_get_io(
+    infinoted_plugin_manager_get_directory(info->plugin->manager)
+  );
+
+  g_assert(info->timeout == NULL);
+
+  info->timeout = inf_io_add_timeout(
+    io,
+    info->plugin->interval * 1000,
+    infinoted_plugin_autosave_timeout_cb,
+    info,
+    NULL
+  );
+}
+
+static void
+infinoted_plugin_autosave_stop(InfinotedPluginAutosaveSessionInfo* info)
+{
+  InfIo* io;
+
+  io = infd_directory_get_io(
+    infinoted_plugin_manager_get_directory(info->plugin->manager)
+  );
+
+  g_assert(info->timeout != NULL);
+
+  inf_io_remove_timeout(io, info->timeout);
+  info->timeout = NULL;
+}
+
+
 static void
 infinoted_plugin_autosave_buffer_notify_modified_cb(GObject* object,
                                                     GParamSpec* pspec,
@@ -269,6 +522,7 @@ infinoted_plugin_autosave_session_added(const InfBrowserIter* iter,
   info->iter = *iter;
   info->proxy = proxy;
   info->timeout = NULL;
+  info->save = NULL;
   g_object_ref(proxy);
 
   g_object_get(G_OBJECT(proxy), "session", &session, NULL);
@@ -304,6 +558,14 @@ infinoted_plugin_autosave_session_removed(const InfBrowserIter* iter,
   if(info->timeout != NULL)
     infinoted_plugin_autosave_stop(info);
 
+  /* Let a save in progress finish, but do not touch the session info
+   * anymore when it does. */
+  if(info->save != NULL)
+  {
+    info->save->info = NULL;
+    info->save = NULL;
+  }
+
   g_object_get(G_OBJECT(info->proxy), "session", &session, NULL);
   buffer = inf_session_get_buffer(session);
 
@@ -23,6 +23,7 @@
 
 #include <libinfinity/common/inf-cert-util.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/server/infd-loop-connection.h>
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -494,27 +495,23 @@ infinoted_plugin_certificate_auth_deinitialize(gpointer plugin_info)
 }
 
 static void
-infinoted_plugin_certificate_auth_connection_added(InfXmlConnection* conn,
-                                                   gpointer plugin_info,
-                                                   gpointer connection_info)
+infinoted_plugin_certificate_auth_set_callback(InfXmlConnection* conn,
+                                               gpointer user_data)
 {
   InfinotedPluginCertificateAuth* plugin;
-  InfXmppConnection* xmpp;
   gnutls_certificate_request_t cert_req;
 
-  plugin = (InfinotedPluginCertificateAuth*)plugin_info;
+  plugin = (InfinotedPluginCertificateAuth*)user_data;
 
   if(INF_IS_XMPP_CONNECTION(conn))
   {
-    xmpp = INF_XMPP_CONNECTION(conn);
-
     if(plugin->accept_unauthenticated_clients == TRUE)
       cert_req = GNUTLS_CERT_REQUEST;
     else
       cert_req = GNUTLS_CERT_REQUIRE;
 
     inf_xmpp_connection_set_certificate_callback(
-      xmpp,
+      INF_XMPP_CONNECTION(conn),
       cert_req,
       infinoted_plugin_certificate_auth_certificate_func,
       plugin,
@@ -524,21 +521,13 @@ infinoted_plugin_certificate_auth_connection_added(InfXmlConnection* conn,
 }
 
 static void
-infinoted_plugin_certificate_auth_connection_removed(InfXmlConnection* conn,
-                                                     gpointer plugin_info,
-                                                     gpointer session_info)
+infinoted_plugin_certificate_auth_unset_callback(InfXmlConnection* conn,
+                                                 gpointer user_data)
 {
-  InfinotedPluginCertificateAuth* plugin;
-  InfXmppConnection* xmpp;
-
-  plugin = (InfinotedPluginCertificateAuth*)plugin_info;
-
   if(INF_IS_XMPP_CONNECTION(conn))
   {
-    xmpp = INF_XMPP_CONNECTION(conn);
-
     inf_xmpp_connection_set_certificate_callback(
-      xmpp,
+      INF_XMPP_CONNECTION(conn),
       GNUTLS_CERT_IGNORE,
       NULL,
       NULL,
@@ -547,6 +536,52 @@ infinoted_plugin_certificate_auth_connection_removed(InfXmlConnection* conn,
   }
 }
 
+static void
+infinoted_plugin_certificate_auth_connection_added(InfXmlConnection* conn,
+                                                   gpointer plugin_info,
+                                                   gpointer connection_info)
+{
+  /* If the connection runs in a separate event loop, then the certificate
+   * needs to be verified there. This is queued before the TLS handshake can
+   * start, so no client gets past it without verification. */
+  if(INFD_IS_LOOP_CONNECTION(conn))
+  {
+    infd_loop_connection_invoke(
+      INFD_LOOP_CONNECTION(conn),
+      infinoted_plugin_certificate_auth_set_callback,
+      plugin_info,
+      NULL
+    );
+  }
+  else
+  {
+    infinoted_plugin_certificate_auth_set_callback(conn, plugin_info);
+  }
+}
+
+static void
+infinoted_plugin_certificate_auth_connection_removed(InfXmlConnection* conn,
+                                                     gpointer plugin_info,
+                                                     gpointer session_info)
+{
+  /* When the plugin is unloaded, the loops are paused, and this runs
+   * immediately, so the callback is never invoked after the plugin is
+   * gone. */
+  if(INFD_IS_LOOP_CONNECTION(conn))
+  {
+    infd_loop_connection_invoke(
+      INFD_LOOP_CONNECTION(conn),
+      infinoted_plugin_certificate_auth_unset_callback,
+      NULL,
+      NULL
+    );
+  }
+  else
+  {
+    infinoted_plugin_certificate_auth_unset_callback(conn, NULL);
+  }
+}
+
 static const GFlagsValue INFINOTED_PLUGIN_CERTIFICATE_AUTH_VERIFY_FLAGS[] = {
   {
     GNUTLS_VERIFY_DISABLE_CA_SIGN,
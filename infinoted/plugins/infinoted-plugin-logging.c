@@ -33,6 +33,9 @@
 
 #include <string.h>
 
+/* Interval in seconds at which the handshake summary is written */
+#define INFINOTED_PLUGIN_LOGGING_HANDSHAKE_INTERVAL 60
+
 typedef struct _InfinotedPluginLogging InfinotedPluginLogging;
 struct _InfinotedPluginLogging {
   InfinotedPluginManager* manager;
@@ -41,12 +44,37 @@ struct _InfinotedPluginLogging {
   gboolean log_connection_errors;
   gboolean log_session_errors;
   gboolean log_session_request_extra;
+  gboolean log_handshakes;
+
+  /* Messages are logged from the threads of connection loops, and requests
+   * are executed in the loops owning their session, so the context of a
+   * log message is kept per thread. Maps GThread* to
+   * InfinotedPluginLoggingThread*. */
+  GHashTable* threads;
+  GMutex threads_mutex;
+
+  /* Handshake statistics since the last summary was written */
+  InfIoTimeout* handshake_timeout;
+  guint n_handshakes_pending;
+  guint n_handshakes_completed;
+  guint n_handshakes_failed;
+  gint64 handshake_time_total;
+  gint64 handshake_time_max;
+};
 
-  /* TODO: Make this a hash table, and use the thread ID as a key */
+typedef struct _InfinotedPluginLoggingThread InfinotedPluginLoggingThread;
+struct _InfinotedPluginLoggingThread {
   gchar* extra_message;
   InfSessionProxy* current_session;
 };
 
+typedef struct _InfinotedPluginLoggingConnectionInfo
+  InfinotedPluginLoggingConnectionInfo;
+struct _InfinotedPluginLoggingConnectionInfo {
+  InfinotedPluginLogging* plugin;
+  gint64 handshake_begin;
+};
+
 typedef struct _InfinotedPluginLoggingSessionInfo
   InfinotedPluginLoggingSessionInfo;
 struct _InfinotedPluginLoggingSessionInfo {
@@ -55,6 +83,39 @@ struct _InfinotedPluginLoggingSessionInfo {
   InfBrowserIter iter;
 };
 
+static void
+infinoted_plugin_logging_thread_free(gpointer data)
+{
+  InfinotedPluginLoggingThread* thread;
+  thread = (InfinotedPluginLoggingThread*)data;
+
+  g_free(thread->extra_message);
+  g_slice_free(InfinotedPluginLoggingThread, thread);
+}
+
+/* Returns the context of the calling thread. Only the calling thread
+ * accesses it, so the lock is only needed for the lookup. */
+static InfinotedPluginLoggingThread*
+infinoted_plugin_logging_get_thread(InfinotedPluginLogging* plugin,
+                                    gboolean create)
+{
+  InfinotedPluginLoggingThread* thread;
+
+  g_mutex_lock(&plugin->threads_mutex);
+  thread = g_hash_table_lookup(plugin->threads, g_thread_self());
+
+  if(thread == NULL && create)
+  {
+    thread = g_slice_new(InfinotedPluginLoggingThread);
+    thread->extra_message = NULL;
+    thread->current_session = NULL;
+    g_hash_table_insert(plugin->threads, g_thread_self(), thread);
+  }
+
+  g_mutex_unlock(&plugin->threads_mutex);
+  return thread;
+}
+
 static gchar*
 infinoted_plugin_logging_connection_string(InfXmlConnection* connection)
 {
@@ -153,6 +214,7 @@ infinoted_plugin_logging_log_message_cb(InfinotedLog* log,
                                         gpointer user_data)
 {
   InfinotedPluginLogging* plugin;
+  InfinotedPluginLoggingThread* thread;
   InfinotedPluginLoggingSessionInfo* info;
   InfAdoptedSession* session;
   InfAdoptedRequest* request;
@@ -164,24 +226,28 @@ infinoted_plugin_logging_log_message_cb(InfinotedLog* log,
   gchar* document_name;
 
   plugin = (InfinotedPluginLogging*)user_data;
+  thread = NULL;
 
   if(depth == 0)
+    thread = infinoted_plugin_logging_get_thread(plugin, FALSE);
+
+  if(thread != NULL)
   {
-    if(plugin->extra_message != NULL)
-      infinoted_log_log(log, priority, "%s", plugin->extra_message);
+    if(thread->extra_message != NULL)
+      infinoted_log_log(log, priority, "%s", thread->extra_message);
 
-    if(plugin->current_session)
+    if(thread->current_session)
     {
       info = infinoted_plugin_manager_get_session_info(
         plugin->manager,
         plugin,
-        plugin->current_session
+        thread->current_session
       );
 
       g_assert(info != NULL);
 
       g_object_get(
-        G_OBJECT(plugin->current_session),
+        G_OBJECT(thread->current_session),
         "session", &session,
         NULL
       );
@@ -244,11 +310,14 @@ infinoted_plugin_logging_begin_execute_request_cb(InfAdoptedAlgorithm* algo,
                                                   gpointer user_data)
 {
   InfinotedPluginLoggingSessionInfo* info;
+  InfinotedPluginLoggingThread* thread;
+
   info = (InfinotedPluginLoggingSessionInfo*)user_data;
+  thread = infinoted_plugin_logging_get_thread(info->plugin, TRUE);
 
   /* Don't need to ref this */
-  g_assert(info->plugin->current_session == NULL);
-  info->plugin->current_session = info->proxy;
+  g_assert(thread->current_session == NULL);
+  thread->current_session = info->proxy;
 }
 
 static void
@@ -260,13 +329,16 @@ infinoted_plugin_logging_end_execute_request_cb(InfAdoptedAlgorithm* algo,
                                                 gpointer user_data)
 {
   InfinotedPluginLoggingSessionInfo* info;
+  InfinotedPluginLoggingThread* thread;
+
   info = (InfinotedPluginLoggingSessionInfo*)user_data;
+  thread = infinoted_plugin_logging_get_thread(info->plugin, TRUE);
 
   /* TODO: If error is set then log it here, so that the actual request that
    * caused the error is written in the log file. */
 
-  g_assert(info->plugin->current_session != NULL);
-  info->plugin->current_session = NULL;
+  g_assert(thread->current_session != NULL);
+  thread->current_session = NULL;
 }
 
 static void
@@ -298,6 +370,7 @@ infinoted_pluggin_logging_session_error_cb(InfSession* session,
                                            gpointer user_data)
 {
   InfinotedPluginLoggingSessionInfo* info;
+  InfinotedPluginLoggingThread* thread;
   InfAdoptedSessionRecord* record;
   gchar* connection_str;
   gchar* document_name;
@@ -317,8 +390,10 @@ infinoted_pluggin_logging_session_error_cb(InfSession* session,
   xmlSaveTree(ctx, xml);
   xmlSaveClose(ctx);
 
-  g_assert(info->plugin->extra_message == NULL);
-  info->plugin->extra_message = g_strdup_printf(
+  thread = infinoted_plugin_logging_get_thread(info->plugin, TRUE);
+
+  g_assert(thread->extra_message == NULL);
+  thread->extra_message = g_strdup_printf(
     _("in document %s from connection %s. The request was: %s"),
     document_name,
     connection_str,
@@ -337,8 +412,8 @@ infinoted_pluggin_logging_session_error_cb(InfSession* session,
     error->message
   );
 
-  g_free(info->plugin->extra_message);
-  info->plugin->extra_message = NULL;
+  g_free(thread->extra_message);
+  thread->extra_message = NULL;
 }
 
 static void
@@ -373,6 +448,100 @@ infinoted_plugin_logging_notify_status_cb(InfSession* session,
   }
 }
 
+static void
+infinoted_plugin_logging_handshake_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginLogging* plugin;
+  guint n_finished;
+  gint64 average;
+
+  plugin = (InfinotedPluginLogging*)user_data;
+  plugin->handshake_timeout = NULL;
+
+  n_finished = plugin->n_handshakes_completed + plugin->n_handshakes_failed;
+  if(n_finished > 0 || plugin->n_handshakes_pending > 0)
+  {
+    average = 0;
+    if(plugin->n_handshakes_completed > 0)
+      average = plugin->handshake_time_total / plugin->n_handshakes_completed;
+
+    infinoted_log_info(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Handshakes in the last %u seconds: %u completed, %u failed, "
+        "%u in progress; average duration %u ms, maximum %u ms"),
+      INFINOTED_PLUGIN_LOGGING_HANDSHAKE_INTERVAL,
+      plugin->n_handshakes_completed,
+      plugin->n_handshakes_failed,
+      plugin->n_handshakes_pending,
+      (guint)(average / 1000),
+      (guint)(plugin->handshake_time_max / 1000)
+    );
+  }
+
+  plugin->n_handshakes_completed = 0;
+  plugin->n_handshakes_failed = 0;
+  plugin->handshake_time_total = 0;
+  plugin->handshake_time_max = 0;
+
+  plugin->handshake_timeout = inf_io_add_timeout(
+    infd_directory_get_io(
+      infinoted_plugin_manager_get_directory(plugin->manager)
+    ),
+    INFINOTED_PLUGIN_LOGGING_HANDSHAKE_INTERVAL * 1000,
+    infinoted_plugin_logging_handshake_timeout_cb,
+    plugin,
+    NULL
+  );
+}
+
+static void
+infinoted_plugin_logging_handshake_notify_status_cb(GObject* object,
+                                                    GParamSpec* pspec,
+                                                    gpointer user_data)
+{
+  InfinotedPluginLoggingConnectionInfo* info;
+  InfinotedPluginLogging* plugin;
+  InfXmlConnectionStatus status;
+  gint64 duration;
+
+  info = (InfinotedPluginLoggingConnectionInfo*)user_data;
+  plugin = info->plugin;
+
+  g_object_get(G_OBJECT(object), "status", &status, NULL);
+
+  switch(status)
+  {
+  case INF_XML_CONNECTION_OPENING:
+    /* Still in progress */
+    return;
+  case INF_XML_CONNECTION_OPEN:
+    duration = g_get_monotonic_time() - info->handshake_begin;
+
+    ++plugin->n_handshakes_completed;
+    plugin->handshake_time_total += duration;
+    if(duration > plugin->handshake_time_max)
+      plugin->handshake_time_max = duration;
+
+    break;
+  case INF_XML_CONNECTION_CLOSING:
+  case INF_XML_CONNECTION_CLOSED:
+    ++plugin->n_handshakes_failed;
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  g_assert(plugin->n_handshakes_pending > 0);
+  --plugin->n_handshakes_pending;
+
+  inf_signal_handlers_disconnect_by_func(
+    object,
+    G_CALLBACK(infinoted_plugin_logging_handshake_notify_status_cb),
+    info
+  );
+}
+
 static void
 infinoted_plugin_logging_info_initialize(gpointer plugin_info)
 {
@@ -384,6 +553,7 @@ infinoted_plugin_logging_info_initialize(gpointer plugin_info)
   plugin->log_connection_errors = TRUE;
   plugin->log_session_errors = TRUE;
   plugin->log_session_request_extra = TRUE;
+  plugin->log_handshakes = TRUE;
 }
 
 static gboolean
@@ -396,6 +566,16 @@ infinoted_plugin_logging_initialize(InfinotedPluginManager* manager,
 
   plugin->manager = manager;
 
+  /* Set up before connecting, since loops might log right away */
+  plugin->threads = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    infinoted_plugin_logging_thread_free
+  );
+
+  g_mutex_init(&plugin->threads_mutex);
+
   g_signal_connect(
     G_OBJECT(infinoted_plugin_manager_get_log(manager)),
     "log-message",
@@ -403,8 +583,23 @@ infinoted_plugin_logging_initialize(InfinotedPluginManager* manager,
     plugin
   );
 
-  plugin->extra_message = NULL;
-  plugin->current_session = NULL;
+  plugin->handshake_timeout = NULL;
+  plugin->n_handshakes_pending = 0;
+  plugin->n_handshakes_completed = 0;
+  plugin->n_handshakes_failed = 0;
+  plugin->handshake_time_total = 0;
+  plugin->handshake_time_max = 0;
+
+  if(plugin->log_handshakes)
+  {
+    plugin->handshake_timeout = inf_io_add_timeout(
+      infd_directory_get_io(infinoted_plugin_manager_get_directory(manager)),
+      INFINOTED_PLUGIN_LOGGING_HANDSHAKE_INTERVAL * 1000,
+      infinoted_plugin_logging_handshake_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
 
   return TRUE;
 }
@@ -420,6 +615,19 @@ infinoted_plugin_logging_deinitialize(gpointer plugin_info)
     G_CALLBACK(infinoted_plugin_logging_log_message_cb),
     plugin
   );
+
+  if(plugin->handshake_timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infd_directory_get_io(
+        infinoted_plugin_manager_get_directory(plugin->manager)
+      ),
+      plugin->handshake_timeout
+    );
+  }
+
+  g_hash_table_destroy(plugin->threads);
+  g_mutex_clear(&plugin->threads_mutex);
 }
 
 static void
@@ -475,10 +683,33 @@ infinoted_plugin_logging_connection_added(InfXmlConnection* connection,
                                           gpointer connection_info)
 {
   InfinotedPluginLogging* plugin;
+  InfinotedPluginLoggingConnectionInfo* info;
   gchar* connection_str;
   InfXmlConnectionStatus status;
 
   plugin = (InfinotedPluginLogging*)plugin_info;
+  info = (InfinotedPluginLoggingConnectionInfo*)connection_info;
+  info->plugin = plugin;
+
+  if(plugin->log_handshakes)
+  {
+    g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+    /* The handshake is measured from the time the directory sees the
+     * connection, which is right after it has been accepted. */
+    if(status == INF_XML_CONNECTION_OPENING)
+    {
+      info->handshake_begin = g_get_monotonic_time();
+      ++plugin->n_handshakes_pending;
+
+      g_signal_connect(
+        G_OBJECT(connection),
+        "notify::status",
+        G_CALLBACK(infinoted_plugin_logging_handshake_notify_status_cb),
+        info
+      );
+    }
+  }
 
   if(plugin->log_connection_errors)
   {
@@ -534,10 +765,29 @@ infinoted_plugin_logging_connection_removed(InfXmlConnection* connection,
                                             gpointer connection_info)
 {
   InfinotedPluginLogging* plugin;
+  InfinotedPluginLoggingConnectionInfo* info;
   gchar* connection_str;
   guint n_connected;
 
   plugin = (InfinotedPluginLogging*)plugin_info;
+  info = (InfinotedPluginLoggingConnectionInfo*)connection_info;
+
+  if(plugin->log_handshakes)
+  {
+    n_connected = inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(connection),
+      G_CALLBACK(infinoted_plugin_logging_handshake_notify_status_cb),
+      info
+    );
+
+    /* Removed before the handshake finished */
+    if(n_connected > 0)
+    {
+      g_assert(plugin->n_handshakes_pending > 0);
+      --plugin->n_handshakes_pending;
+      ++plugin->n_handshakes_failed;
+    }
+  }
 
   if(plugin->log_connection_errors)
   {
@@ -743,6 +993,17 @@ static const InfinotedParameterInfo INFINOTED_PLUGIN_LOGGING_OPTIONS[] = {
        "used for debugging purposes to find problems in the server "
        "implementation itself."),
     NULL
+  }, {
+    "log-handshakes",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginLogging, log_handshakes),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to periodically write a summary of the connection "
+       "handshakes, that is how many connections completed or failed the "
+       "initial handshake, how many are still in it, and how long it took."),
+    NULL
   }, {
     NULL,
     0,
@@ -759,7 +1020,7 @@ const InfinotedPlugin INFINOTED_PLUGIN = {
      "can be turned off with the plugin options."),
   INFINOTED_PLUGIN_LOGGING_OPTIONS,
   sizeof(InfinotedPluginLogging),
-  0,
+  sizeof(InfinotedPluginLoggingConnectionInfo),
   sizeof(InfinotedPluginLoggingSessionInfo),
   NULL,
   infinoted_plugin_logging_info_initialize,
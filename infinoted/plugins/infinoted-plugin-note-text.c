@@ -19,19 +19,53 @@
 
 #include <infinoted/infinoted-plugin-manager.h>
 #include <infinoted/infinoted-parameter.h>
+#include <infinoted/infinoted-log.h>
 
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-default-buffer.h>
 #include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-journal.h>
 
+#include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
 typedef struct _InfinotedPluginNoteText InfinotedPluginNoteText;
 struct _InfinotedPluginNoteText {
   InfinotedPluginManager* manager;
   const InfdNotePlugin* plugin;
+  gboolean journal;
 };
 
+typedef struct _InfinotedPluginNoteTextSessionInfo
+  InfinotedPluginNoteTextSessionInfo;
+struct _InfinotedPluginNoteTextSessionInfo {
+  InfinotedPluginNoteText* plugin;
+  InfBrowserIter iter;
+  InfSession* session;
+};
+
+/* A session being read with infinoted_plugin_note_text_session_read_begin()
+ * and friends. */
+typedef struct _InfinotedPluginNoteTextRead InfinotedPluginNoteTextRead;
+struct _InfinotedPluginNoteTextRead {
+  InfdStorage* storage;
+  InfIo* io;
+  InfCommunicationManager* manager;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  /* NULL once all of the session has been read, or reading failed */
+  InfTextFilesystemFormatReader* reader;
+  guint n_steps;
+  gboolean done;
+};
+
+/* The journal is attached to the session, so that the note plugin can find
+ * it when the directory asks it to write the session. */
+#define INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY "infinoted-note-text-journal"
+
+/* Progress of reading a session is reported in steps of this many bytes */
+#define INFINOTED_PLUGIN_NOTE_TEXT_PROGRESS_STEP (64 * 1024)
+
 /* Note plugin implementation */
 static InfSession*
 infinoted_plugin_note_text_session_new(InfIo* io,
@@ -61,25 +95,26 @@ infinoted_plugin_note_text_session_new(InfIo* io,
   return INF_SESSION(session);
 }
 
-static InfSession*
-infinoted_plugin_note_text_session_read(InfdStorage* storage,
-                                        InfIo* io,
-                                        InfCommunicationManager* manager,
-                                        const gchar* path,
-                                        gpointer user_data,
-                                        GError** error)
+static gpointer
+infinoted_plugin_note_text_session_read_begin(InfdStorage* storage,
+                                              InfIo* io,
+                                              InfCommunicationManager* manager,
+                                              const gchar* path,
+                                              guint* n_steps,
+                                              gpointer user_data,
+                                              GError** error)
 {
+  InfinotedPluginNoteTextRead* read;
   InfUserTable* user_table;
   InfTextBuffer* buffer;
-  gboolean result;
-  InfTextSession* session;
+  InfTextFilesystemFormatReader* reader;
 
   g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
 
   user_table = inf_user_table_new();
   buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
 
-  result = inf_text_filesystem_format_read(
+  reader = inf_text_filesystem_format_reader_new(
     INFD_FILESYSTEM_STORAGE(storage),
     path,
     user_table,
@@ -87,27 +122,157 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
     error
   );
 
-  if(result == FALSE)
+  if(reader == NULL)
   {
     g_object_unref(user_table);
     g_object_unref(buffer);
     return NULL;
   }
 
-  session = inf_text_session_new_with_user_table(
-    manager,
-    buffer,
+  read = g_slice_new(InfinotedPluginNoteTextRead);
+  read->storage = storage;
+  read->io = io;
+  read->manager = manager;
+  read->user_table = user_table;
+  read->buffer = buffer;
+  read->reader = reader;
+  read->done = FALSE;
+
+  /* The reader refers to the storage until it is done */
+  g_object_ref(storage);
+  g_object_ref(io);
+  g_object_ref(manager);
+
+  /* The last step is replaying the journal, so there is at least one step
+   * even for an empty file. */
+  read->n_steps = inf_text_filesystem_format_reader_get_size(reader) /
+    INFINOTED_PLUGIN_NOTE_TEXT_PROGRESS_STEP + 1;
+
+  *n_steps = read->n_steps;
+  return read;
+}
+
+static gboolean
+infinoted_plugin_note_text_session_read_next(gpointer data,
+                                             guint* step,
+                                             GError** error)
+{
+  InfinotedPluginNoteTextRead* read;
+  GError* local_error;
+  guint64 position;
+
+  read = (InfinotedPluginNoteTextRead*)data;
+  g_assert(read->reader != NULL);
+
+  local_error = NULL;
+  if(inf_text_filesystem_format_reader_read_next(read->reader, &local_error))
+  {
+    position = inf_text_filesystem_format_reader_get_position(read->reader);
+
+    *step = MIN(
+      position / INFINOTED_PLUGIN_NOTE_TEXT_PROGRESS_STEP,
+      read->n_steps - 1
+    );
+
+    return TRUE;
+  }
+
+  inf_text_filesystem_format_reader_free(read->reader);
+  read->reader = NULL;
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  read->done = TRUE;
+  *step = read->n_steps;
+  return FALSE;
+}
+
+static InfSession*
+infinoted_plugin_note_text_session_read_end(gpointer data)
+{
+  InfinotedPluginNoteTextRead* read;
+  InfSession* session;
+
+  read = (InfinotedPluginNoteTextRead*)data;
+  session = NULL;
+
+  if(read->reader != NULL)
+    inf_text_filesystem_format_reader_free(read->reader);
+
+  if(read->done == TRUE)
+  {
+    session = INF_SESSION(
+      inf_text_session_new_with_user_table(
+        read->manager,
+        read->buffer,
+        read->io,
+        read->user_table,
+        INF_SESSION_RUNNING,
+        NULL,
+        NULL
+      )
+    );
+  }
+
+  g_object_unref(read->storage);
+  g_object_unref(read->io);
+  g_object_unref(read->manager);
+  g_object_unref(read->user_table);
+  g_object_unref(read->buffer);
+  g_slice_free(InfinotedPluginNoteTextRead, read);
+
+  return session;
+}
+
+static InfSession*
+infinoted_plugin_note_text_session_read(InfdStorage* storage,
+                                        InfIo* io,
+                                        InfCommunicationManager* manager,
+                                        const gchar* path,
+                                        gpointer user_data,
+                                        GError** error)
+{
+  gpointer read;
+  GError* local_error;
+  guint n_steps;
+  guint step;
+  gboolean result;
+
+  read = infinoted_plugin_note_text_session_read_begin(
+    storage,
     io,
-    user_table,
-    INF_SESSION_RUNNING,
-    NULL,
-    NULL
+    manager,
+    path,
+    &n_steps,
+    user_data,
+    error
   );
 
-  g_object_unref(user_table);
-  g_object_unref(buffer);
+  if(read == NULL)
+    return NULL;
 
-  return INF_SESSION(session);
+  local_error = NULL;
+  do
+  {
+    result = infinoted_plugin_note_text_session_read_next(
+      read,
+      &step,
+      &local_error
+    );
+  } while(result == TRUE);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    infinoted_plugin_note_text_session_read_end(read);
+    return NULL;
+  }
+
+  return infinoted_plugin_note_text_session_read_end(read);
 }
 
 static gboolean
@@ -122,6 +287,37 @@ infinoted_plugin_note_text_session_write(InfdStorage* storage,
     path,
     inf_session_get_user_table(session),
     INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    g_object_get_data(
+      G_OBJECT(session),
+      INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY
+    ),
+    error
+  );
+}
+
+static InfAsyncOperation*
+infinoted_plugin_note_text_session_write_async(
+  InfdStorage* storage,
+  InfIo* io,
+  InfSession* session,
+  const gchar* path,
+  InfdNotePluginSessionWriteFunc func,
+  gpointer func_data,
+  gpointer user_data,
+  GError** error)
+{
+  return inf_text_filesystem_format_write_async(
+    INFD_FILESYSTEM_STORAGE(storage),
+    io,
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    g_object_get_data(
+      G_OBJECT(session),
+      INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY
+    ),
+    func,
+    func_data,
     error
   );
 }
@@ -132,7 +328,11 @@ const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
   "InfText",
   infinoted_plugin_note_text_session_new,
   infinoted_plugin_note_text_session_read,
-  infinoted_plugin_note_text_session_write
+  infinoted_plugin_note_text_session_write,
+  infinoted_plugin_note_text_session_write_async,
+  infinoted_plugin_note_text_session_read_begin,
+  infinoted_plugin_note_text_session_read_next,
+  infinoted_plugin_note_text_session_read_end
 };
 
 /* Infinoted plugin glue */
@@ -144,6 +344,7 @@ infinoted_plugin_note_text_info_initialize(gpointer plugin_info)
 
   plugin->manager = NULL;
   plugin->plugin = NULL;
+  plugin->journal = FALSE;
 }
 
 static gboolean
@@ -202,8 +403,165 @@ infinoted_plugin_note_text_deinitialize(gpointer plugin_info)
   }
 }
 
+static void
+infinoted_plugin_note_text_start_journal(
+  InfinotedPluginNoteTextSessionInfo* info)
+{
+  InfdDirectory* directory;
+  InfdStorage* storage;
+  InfTextJournal* journal;
+  gchar* path;
+  GError* error;
+
+  directory = infinoted_plugin_manager_get_directory(info->plugin->manager);
+  storage = infd_directory_get_storage(directory);
+  if(!INFD_IS_FILESYSTEM_STORAGE(storage))
+    return;
+
+  path = inf_browser_get_path(INF_BROWSER(directory), &info->iter);
+  error = NULL;
+
+  journal = inf_text_filesystem_format_open_journal(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    INF_TEXT_SESSION(info->session),
+    &error
+  );
+
+  /* The journal is only replayed on top of a file that has been written
+   * together with it, so write one if the journal is new. */
+  if(journal != NULL && inf_text_journal_get_sequence(journal) == 0)
+  {
+    if(!inf_text_filesystem_format_write(
+         INFD_FILESYSTEM_STORAGE(storage),
+         path,
+         inf_session_get_user_table(info->session),
+         INF_TEXT_BUFFER(inf_session_get_buffer(info->session)),
+         journal,
+         &error))
+    {
+      g_object_unref(journal);
+      journal = NULL;
+    }
+  }
+
+  if(journal == NULL)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(info->plugin->manager),
+      _("Failed to start journal for session \"%s\": %s"),
+      path,
+      error->message
+    );
+
+    g_error_free(error);
+  }
+  else
+  {
+    g_object_set_data_full(
+      G_OBJECT(info->session),
+      INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY,
+      journal,
+      g_object_unref
+    );
+  }
+
+  g_free(path);
+}
+
+static void
+infinoted_plugin_note_text_synchronization_complete_cb(InfSession* session,
+                                                       InfXmlConnection* conn,
+                                                       gpointer user_data)
+{
+  InfinotedPluginNoteTextSessionInfo* info;
+  info = (InfinotedPluginNoteTextSessionInfo*)user_data;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(infinoted_plugin_note_text_synchronization_complete_cb),
+    info
+  );
+
+  infinoted_plugin_note_text_start_journal(info);
+}
+
+static void
+infinoted_plugin_note_text_session_added(const InfBrowserIter* iter,
+                                         InfSessionProxy* proxy,
+                                         gpointer plugin_info,
+                                         gpointer session_info)
+{
+  InfinotedPluginNoteTextSessionInfo* info;
+
+  info = (InfinotedPluginNoteTextSessionInfo*)session_info;
+  info->plugin = (InfinotedPluginNoteText*)plugin_info;
+  info->iter = *iter;
+  g_object_get(G_OBJECT(proxy), "session", &info->session, NULL);
+
+  if(!info->plugin->journal)
+    return;
+
+  /* Start journaling once the initial content is there */
+  switch(inf_session_get_status(info->session))
+  {
+  case INF_SESSION_SYNCHRONIZING:
+    g_signal_connect_after(
+      G_OBJECT(info->session),
+      "synchronization-complete",
+      G_CALLBACK(infinoted_plugin_note_text_synchronization_complete_cb),
+      info
+    );
+
+    break;
+  case INF_SESSION_RUNNING:
+    infinoted_plugin_note_text_start_journal(info);
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+infinoted_plugin_note_text_session_removed(const InfBrowserIter* iter,
+                                           InfSessionProxy* proxy,
+                                           gpointer plugin_info,
+                                           gpointer session_info)
+{
+  InfinotedPluginNoteTextSessionInfo* info;
+  info = (InfinotedPluginNoteTextSessionInfo*)session_info;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(info->session),
+    G_CALLBACK(infinoted_plugin_note_text_synchronization_complete_cb),
+    info
+  );
+
+  /* The directory has saved the session already, if it is going to. A save
+   * still in progress leaves the journal alone once it is gone. */
+  g_object_set_data(
+    G_OBJECT(info->session),
+    INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY,
+    NULL
+  );
+
+  g_object_unref(info->session);
+}
+
 static const InfinotedParameterInfo INFINOTED_PLUGIN_NOTE_TEXT_OPTIONS[] = {
   {
+    "journal",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginNoteText, journal),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to append every change to a document to a journal next to "
+       "it, so that no changes are lost if the server crashes before the "
+       "document has been saved. The journal is shrunk whenever the "
+       "document is saved."),
+    NULL
+  }, {
     NULL,
     0,
     0,
@@ -218,15 +576,15 @@ const InfinotedPlugin INFINOTED_PLUGIN = {
   INFINOTED_PLUGIN_NOTE_TEXT_OPTIONS,
   sizeof(InfinotedPluginNoteText),
   0,
-  0,
-  NULL,
+  sizeof(InfinotedPluginNoteTextSessionInfo),
+  "InfTextSession",
   infinoted_plugin_note_text_info_initialize,
   infinoted_plugin_note_text_initialize,
   infinoted_plugin_note_text_deinitialize,
   NULL,
   NULL,
-  NULL,
-  NULL
+  infinoted_plugin_note_text_session_added,
+  infinoted_plugin_note_text_session_removed
 };
 
 /* vim:set et sw=2 ts=2: */
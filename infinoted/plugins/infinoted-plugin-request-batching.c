@@ -0,0 +1,144 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/inf-i18n.h>
+
+typedef struct _InfinotedPluginRequestBatching InfinotedPluginRequestBatching;
+struct _InfinotedPluginRequestBatching {
+  InfinotedPluginManager* manager;
+  guint interval;
+  guint size;
+};
+
+static void
+infinoted_plugin_request_batching_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginRequestBatching* plugin;
+  plugin = (InfinotedPluginRequestBatching*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->interval = 0;
+  plugin->size = 32;
+}
+
+static gboolean
+infinoted_plugin_request_batching_initialize(InfinotedPluginManager* manager,
+                                             gpointer plugin_info,
+                                             GError** error)
+{
+  InfinotedPluginRequestBatching* plugin;
+  plugin = (InfinotedPluginRequestBatching*)plugin_info;
+
+  plugin->manager = manager;
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_request_batching_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginRequestBatching* plugin;
+  plugin = (InfinotedPluginRequestBatching*)plugin_info;
+}
+
+static void
+infinoted_plugin_request_batching_session_added(const InfBrowserIter* iter,
+                                                InfSessionProxy* proxy,
+                                                gpointer plugin_info,
+                                                gpointer session_info)
+{
+  InfinotedPluginRequestBatching* plugin;
+  InfSession* session;
+
+  plugin = (InfinotedPluginRequestBatching*)plugin_info;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  g_assert(INF_ADOPTED_IS_SESSION(session));
+
+  /* Subscribing clients which support batching are told these settings
+   * and then batch their own requests in the same way. */
+  g_object_set(
+    G_OBJECT(session),
+    "request-batch-interval", plugin->interval,
+    "request-batch-size", plugin->size,
+    NULL
+  );
+
+  g_object_unref(session);
+}
+
+static const InfinotedParameterInfo
+INFINOTED_PLUGIN_REQUEST_BATCHING_OPTIONS[] = {
+  {
+    "interval",
+    INFINOTED_PARAMETER_INT,
+    INFINOTED_PARAMETER_REQUIRED,
+    offsetof(InfinotedPluginRequestBatching, interval),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The maximum time, in milliseconds, for which requests are held back "
+       "so that they can be sent together with following requests of the "
+       "same user."),
+    N_("MILLISECONDS")
+  }, {
+    "size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginRequestBatching, size),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The maximum number of requests to send in a single message. The "
+       "default is 32."),
+    N_("REQUESTS")
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "request-batching",
+  N_("Lets the server and all clients subscribed to a session collect "
+     "requests of the same user that are made in quick succession, and send "
+     "them in a single message. This reduces the number of messages and the "
+     "amount of data sent for fast typists, at the cost of a small delay. "
+     "Clients that do not support request batching keep receiving the "
+     "requests one by one."),
+  INFINOTED_PLUGIN_REQUEST_BATCHING_OPTIONS,
+  sizeof(InfinotedPluginRequestBatching),
+  0,
+  0,
+  "InfAdoptedSession",
+  infinoted_plugin_request_batching_info_initialize,
+  infinoted_plugin_request_batching_initialize,
+  infinoted_plugin_request_batching_deinitialize,
+  NULL,
+  NULL,
+  infinoted_plugin_request_batching_session_added,
+  NULL
+};
+
+/* vim:set et sw=2 ts=2: */
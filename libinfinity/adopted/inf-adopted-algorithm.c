@@ -77,11 +77,54 @@ struct _InfAdoptedAlgorithmLocalUser {
   gboolean can_redo;
 };
 
+/* An entry in the translation cache. The request is referenced by the
+ * entry, so that its address cannot be reused for another request while the
+ * entry exists. */
+typedef struct _InfAdoptedAlgorithmCacheEntry InfAdoptedAlgorithmCacheEntry;
+struct _InfAdoptedAlgorithmCacheEntry {
+  InfAdoptedRequest* request;
+  InfAdoptedStateVector* to;
+  guint hash;
+
+  InfAdoptedRequest* result;
+  GList* link;
+};
+
+/* An intermediate result of inf_adopted_algorithm_translate_request(). The
+ * translation moves it through state space one fold, transformation or
+ * mirror at a time, in place. An InfAdoptedRequest is only created for it
+ * when it is put into a request log cache or when it is the final result.
+ * If request is not NULL, it is the request at the step's current state.
+ * vector is NULL as long as that is still the request the step started
+ * from. Unused steps are kept in a pool by the algorithm, linked via next. */
+typedef struct _InfAdoptedAlgorithmStep InfAdoptedAlgorithmStep;
+struct _InfAdoptedAlgorithmStep {
+  InfAdoptedRequestType type;
+  InfAdoptedStateVector* vector;
+  guint user_id;
+  InfAdoptedOperation* operation;
+  gint64 received;
+  gint64 executed;
+
+  InfAdoptedRequest* request;
+  InfAdoptedAlgorithmStep* next;
+};
+
 typedef struct _InfAdoptedAlgorithmPrivate InfAdoptedAlgorithmPrivate;
 struct _InfAdoptedAlgorithmPrivate {
   /* request log policy */
   guint max_total_log_size;
 
+  /* LRU cache of translated requests. The table maps entries to themselves,
+   * the queue is ordered from most to least recently used. */
+  GHashTable* translation_cache;
+  GQueue translation_cache_queue;
+  guint translation_cache_size;
+  guint translation_cache_hits;
+  guint translation_cache_misses;
+
+  InfAdoptedAlgorithmStep* step_pool;
+
   InfAdoptedStateVector* current;
   InfAdoptedStateVector* buffer_modified_time;
 
@@ -95,6 +138,24 @@ struct _InfAdoptedAlgorithmPrivate {
   InfAdoptedUser** users_begin;
   InfAdoptedUser** users_end;
 
+  /* The least common predecessor of the current state and the vectors of
+   * all available users, which is the state that all sites are guaranteed
+   * to have reached. It is kept up to date as the vectors advance, so that
+   * inf_adopted_algorithm_cleanup() does not need to recompute it.
+   * lcp_count stores for each component how many of these vectors have the
+   * same value as the lcp, so that a component only needs to be recomputed
+   * when the last of them advances. lcp_vectors maps each available user to
+   * a copy of its vector as it is accounted for in lcp. */
+  InfAdoptedStateVector* lcp;
+  InfAdoptedStateVector* lcp_count;
+  guint lcp_sum;
+  GHashTable* lcp_vectors;
+
+  /* For each user in the users array, the sum of the lcp at which the
+   * oldest requests in the user's request log can first be removed by
+   * inf_adopted_algorithm_cleanup(). Logs are not looked at before. */
+  guint* cleanup_thresholds;
+
   GSList* local_users;
 };
 
@@ -105,10 +166,15 @@ enum {
   PROP_USER_TABLE,
   PROP_BUFFER,
   PROP_MAX_TOTAL_LOG_SIZE,
+
+  /* read/write */
+  PROP_TRANSLATION_CACHE_SIZE,
   
   /* read/only */
   PROP_CURRENT_STATE,
-  PROP_BUFFER_MODIFIED_STATE
+  PROP_BUFFER_MODIFIED_STATE,
+  PROP_TRANSLATION_CACHE_HITS,
+  PROP_TRANSLATION_CACHE_MISSES
 };
 
 enum {
@@ -129,76 +195,194 @@ static guint algorithm_signals[LAST_SIGNAL];
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedAlgorithm, inf_adopted_algorithm, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfAdoptedAlgorithm))
 
-/* Returns a new state vector v so that both first and second are causally
- * before v and so that there is no other state vector with the same property
- * that is causally before v. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_successor(InfAdoptedAlgorithm* algorithm,
-                                             InfAdoptedStateVector* first,
-                                             InfAdoptedStateVector* second)
+/* Recomputes the lcp component for the user with the given ID from the
+ * current state and the vectors of all available users. */
+static void
+inf_adopted_algorithm_lcp_recompute_component(InfAdoptedAlgorithm* algorithm,
+                                              guint id)
 {
   InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
+  GHashTableIter iter;
+  gpointer vector;
+  guint value;
+  guint min;
+  guint count;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
 
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  min = inf_adopted_state_vector_get(priv->current, id);
+  count = 1;
+
+  g_hash_table_iter_init(&iter, priv->lcp_vectors);
+  while(g_hash_table_iter_next(&iter, NULL, &vector))
   {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MAX(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
+    value = inf_adopted_state_vector_get(vector, id);
+    if(value < min)
+    {
+      min = value;
+      count = 1;
+    }
+    else if(value == min)
+    {
+      ++count;
+    }
   }
 
-  g_assert(inf_adopted_state_vector_causally_before(first, result));
-  g_assert(inf_adopted_state_vector_causally_before(second, result));
-  return result;
+  priv->lcp_sum = priv->lcp_sum - inf_adopted_state_vector_get(priv->lcp, id);
+  priv->lcp_sum += min;
+
+  inf_adopted_state_vector_set(priv->lcp, id, min);
+  inf_adopted_state_vector_set(priv->lcp_count, id, count);
 }
 
-/* Returns a new state vector v so that v is both causally before first and
- * second and so that there is no other state vector with the same property
- * so that v is causally before that vector. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-/* TODO: A version modifying first instead of returning a new result,
- * use in inf_adopted_algorithm_cleanup(). */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_predecessor(InfAdoptedAlgorithm* algorithm,
-                                               InfAdoptedStateVector* first,
-                                               InfAdoptedStateVector* second)
+/* Updates the lcp after the component for the user with the given ID of
+ * one of the vectors it is computed from changed from old_value to
+ * new_value. */
+static void
+inf_adopted_algorithm_lcp_update_component(InfAdoptedAlgorithm* algorithm,
+                                           guint id,
+                                           guint old_value,
+                                           guint new_value)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  guint lcp_value;
+  guint count;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  lcp_value = inf_adopted_state_vector_get(priv->lcp, id);
+  count = inf_adopted_state_vector_get(priv->lcp_count, id);
+
+  if(new_value < lcp_value)
+  {
+    /* Vectors normally only advance, but a user can be given an older
+     * vector when it rejoins. */
+    priv->lcp_sum -= lcp_value - new_value;
+    inf_adopted_state_vector_set(priv->lcp, id, new_value);
+    inf_adopted_state_vector_set(priv->lcp_count, id, 1);
+  }
+  else if(new_value == lcp_value)
+  {
+    if(old_value != lcp_value)
+      inf_adopted_state_vector_set(priv->lcp_count, id, count + 1);
+  }
+  else if(old_value == lcp_value)
+  {
+    g_assert(count > 0);
+
+    if(count == 1)
+      inf_adopted_algorithm_lcp_recompute_component(algorithm, id);
+    else
+      inf_adopted_state_vector_set(priv->lcp_count, id, count - 1);
+  }
+}
+
+/* Updates the lcp after one of the vectors it is computed from changed from
+ * old_vector to new_vector. NULL stands for a vector that does not take
+ * part, for example because its user is unavailable. */
+static void
+inf_adopted_algorithm_lcp_update_vector(InfAdoptedAlgorithm* algorithm,
+                                        InfAdoptedStateVector* old_vector,
+                                        InfAdoptedStateVector* new_vector)
 {
   InfAdoptedAlgorithmPrivate* priv;
   InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
   guint id;
+  guint old_value;
+  guint new_value;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
 
   for(user = priv->users_begin; user != priv->users_end; ++ user)
   {
     id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MIN(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
+
+    if(old_vector != NULL)
+      old_value = inf_adopted_state_vector_get(old_vector, id);
+    else
+      old_value = G_MAXUINT;
+
+    if(new_vector != NULL)
+      new_value = inf_adopted_state_vector_get(new_vector, id);
+    else
+      new_value = G_MAXUINT;
+
+    if(old_value != new_value)
+    {
+      inf_adopted_algorithm_lcp_update_component(
+        algorithm,
+        id,
+        old_value,
+        new_value
+      );
+    }
   }
+}
 
-  return result;
+static void
+inf_adopted_algorithm_user_notify_vector_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedStateVector* old_vector;
+  InfAdoptedStateVector* new_vector;
+
+  algorithm = INF_ADOPTED_ALGORITHM(user_data);
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  /* Unavailable users do not take part in the lcp */
+  old_vector = g_hash_table_lookup(priv->lcp_vectors, object);
+  if(old_vector == NULL)
+    return;
+
+  /* Replace the vector first, so that components which need to be
+   * recomputed see the new values. */
+  new_vector = inf_adopted_state_vector_copy(
+    inf_adopted_user_get_vector(INF_ADOPTED_USER(object))
+  );
+
+  g_hash_table_steal(priv->lcp_vectors, object);
+  g_hash_table_insert(priv->lcp_vectors, object, new_vector);
+
+  inf_adopted_algorithm_lcp_update_vector(algorithm, old_vector, new_vector);
+  inf_adopted_state_vector_free(old_vector);
+}
+
+static void
+inf_adopted_algorithm_user_notify_status_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedStateVector* vector;
+
+  algorithm = INF_ADOPTED_ALGORITHM(user_data);
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  vector = g_hash_table_lookup(priv->lcp_vectors, object);
+
+  if(inf_user_get_status(INF_USER(object)) != INF_USER_UNAVAILABLE)
+  {
+    if(vector == NULL)
+    {
+      vector = inf_adopted_state_vector_copy(
+        inf_adopted_user_get_vector(INF_ADOPTED_USER(object))
+      );
+
+      g_hash_table_insert(priv->lcp_vectors, object, vector);
+      inf_adopted_algorithm_lcp_update_vector(algorithm, NULL, vector);
+    }
+  }
+  else
+  {
+    if(vector != NULL)
+    {
+      g_hash_table_steal(priv->lcp_vectors, object);
+      inf_adopted_algorithm_lcp_update_vector(algorithm, vector, NULL);
+      inf_adopted_state_vector_free(vector);
+    }
+  }
 }
 
 /* Checks whether the given request can be undone (or redone if it is an
@@ -346,6 +530,7 @@ inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
   InfAdoptedAlgorithmPrivate* priv;
   InfAdoptedRequestLog* log;
   InfAdoptedStateVector* time;
+  InfAdoptedStateVector* vector;
   guint user_count;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
@@ -364,6 +549,37 @@ inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
     g_realloc(priv->users_begin, sizeof(InfAdoptedUser*) * user_count);
   priv->users_end = priv->users_begin + user_count;
   priv->users_begin[user_count - 1] = user;
+
+  priv->cleanup_thresholds =
+    g_realloc(priv->cleanup_thresholds, sizeof(guint) * user_count);
+  priv->cleanup_thresholds[user_count - 1] = 0;
+
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify::vector",
+    G_CALLBACK(inf_adopted_algorithm_user_notify_vector_cb),
+    algorithm
+  );
+
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify::status",
+    G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+    algorithm
+  );
+
+  if(inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE)
+  {
+    vector = inf_adopted_state_vector_copy(time);
+    g_hash_table_insert(priv->lcp_vectors, user, vector);
+    inf_adopted_algorithm_lcp_update_vector(algorithm, NULL, vector);
+  }
+
+  /* The new user's component of the current state has changed as well */
+  inf_adopted_algorithm_lcp_recompute_component(
+    algorithm,
+    inf_user_get_id(INF_USER(user))
+  );
 }
 
 static void
@@ -596,105 +812,406 @@ inf_adopted_algorithm_can_cache(InfAdoptedRequest* request)
   return flags == INF_ADOPTED_OPERATION_CACHABLE;
 }
 
-/* Translates two requests to state at and then transforms them against each
- * other. The result needs to be unref()ed. */
+static guint
+inf_adopted_algorithm_cache_hash(InfAdoptedRequest* request,
+                                 InfAdoptedStateVector* to)
+{
+  return inf_adopted_request_get_user_id(request) * 31 +
+    inf_adopted_request_get_index(request) +
+    inf_adopted_state_vector_hash(to);
+}
+
+static guint
+inf_adopted_algorithm_cache_entry_hash(gconstpointer key)
+{
+  return ((const InfAdoptedAlgorithmCacheEntry*)key)->hash;
+}
+
+static gboolean
+inf_adopted_algorithm_cache_entry_equal(gconstpointer a,
+                                        gconstpointer b)
+{
+  const InfAdoptedAlgorithmCacheEntry* entry_a;
+  const InfAdoptedAlgorithmCacheEntry* entry_b;
+
+  entry_a = (const InfAdoptedAlgorithmCacheEntry*)a;
+  entry_b = (const InfAdoptedAlgorithmCacheEntry*)b;
+
+  /* The request identity implies equal user and index. Comparing the
+   * request itself instead of only user and index makes sure that two
+   * different requests with the same index, such as one that failed to
+   * execute and its replacement, or a non-reversible request and its
+   * reversible counterpart in the request log, never share an entry. */
+  if(entry_a->request != entry_b->request)
+    return FALSE;
+
+  return inf_adopted_state_vector_equal(entry_a->to, entry_b->to);
+}
+
+static void
+inf_adopted_algorithm_cache_remove_entry(InfAdoptedAlgorithm* algorithm,
+                                         InfAdoptedAlgorithmCacheEntry* entry)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  g_hash_table_remove(priv->translation_cache, entry);
+  g_queue_delete_link(&priv->translation_cache_queue, entry->link);
+
+  g_object_unref(entry->request);
+  g_object_unref(entry->result);
+  inf_adopted_state_vector_free(entry->to);
+  g_slice_free(InfAdoptedAlgorithmCacheEntry, entry);
+}
+
+/* Evicts the least recently used entries until there are at most
+ * max_entries entries left in the cache. */
+static void
+inf_adopted_algorithm_cache_trim(InfAdoptedAlgorithm* algorithm,
+                                 guint max_entries)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  while(g_queue_get_length(&priv->translation_cache_queue) > max_entries)
+  {
+    inf_adopted_algorithm_cache_remove_entry(
+      algorithm,
+      (InfAdoptedAlgorithmCacheEntry*)g_queue_peek_tail(
+        &priv->translation_cache_queue
+      )
+    );
+  }
+}
+
+/* Returns the cached translation of request to to, or NULL. The returned
+ * request is not referenced. */
 static InfAdoptedRequest*
-inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
-                                        InfAdoptedRequest* request,
-                                        InfAdoptedRequest* against,
-                                        InfAdoptedStateVector* at)
+inf_adopted_algorithm_cache_lookup(InfAdoptedAlgorithm* algorithm,
+                                   InfAdoptedRequest* request,
+                                   InfAdoptedStateVector* to)
 {
-  InfAdoptedRequest* request_at;
-  InfAdoptedRequest* against_at;
-  InfAdoptedConcurrencyId concurrency_id;
-  InfAdoptedStateVector* lcs;
-  InfAdoptedRequest* lcs_against;
-  InfAdoptedRequest* lcs_request;
-  InfAdoptedRequest* result;
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmCacheEntry key;
+  InfAdoptedAlgorithmCacheEntry* entry;
 
-  g_assert(
-    inf_adopted_state_vector_causally_before(
-      inf_adopted_request_get_vector(request),
-      at
-    )
-  );
-  g_assert(
-    inf_adopted_state_vector_causally_before(
-      inf_adopted_request_get_vector(against),
-      at
-    )
-  );
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
-  against_at = inf_adopted_algorithm_translate_request(
-    algorithm,
-    against,
-    at
-  );
+  key.request = request;
+  key.to = to;
+  key.hash = inf_adopted_algorithm_cache_hash(request, to);
+
+  entry = g_hash_table_lookup(priv->translation_cache, &key);
+  if(entry == NULL)
+  {
+    ++priv->translation_cache_misses;
+    return NULL;
+  }
+
+  ++priv->translation_cache_hits;
 
-  request_at = inf_adopted_algorithm_translate_request(
+  /* Mark as most recently used */
+  g_queue_unlink(&priv->translation_cache_queue, entry->link);
+  g_queue_push_head_link(&priv->translation_cache_queue, entry->link);
+  return entry->result;
+}
+
+static void
+inf_adopted_algorithm_cache_insert(InfAdoptedAlgorithm* algorithm,
+                                   InfAdoptedRequest* request,
+                                   InfAdoptedStateVector* to,
+                                   InfAdoptedRequest* result)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmCacheEntry* entry;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  if(priv->translation_cache_size == 0)
+    return;
+
+  /* Make room for the new entry */
+  inf_adopted_algorithm_cache_trim(
     algorithm,
-    request,
-    at
+    priv->translation_cache_size - 1
   );
 
-  concurrency_id = INF_ADOPTED_CONCURRENCY_NONE;
-  if(inf_adopted_request_need_concurrency_id(request_at, against_at) == TRUE)
+  entry = g_slice_new(InfAdoptedAlgorithmCacheEntry);
+  entry->request = request;
+  entry->to = inf_adopted_state_vector_copy(to);
+  entry->hash = inf_adopted_algorithm_cache_hash(request, to);
+  entry->result = result;
+
+  g_object_ref(request);
+  g_object_ref(result);
+
+  g_queue_push_head(&priv->translation_cache_queue, entry);
+  entry->link = g_queue_peek_head_link(&priv->translation_cache_queue);
+  g_hash_table_insert(priv->translation_cache, entry, entry);
+}
+
+static InfAdoptedStateVector*
+inf_adopted_algorithm_step_get_vector(InfAdoptedAlgorithmStep* step)
+{
+  if(step->vector != NULL)
+    return step->vector;
+  return inf_adopted_request_get_vector(step->request);
+}
+
+/* Starts a translation step at request, taking a step from the pool if one
+ * is available. */
+static InfAdoptedAlgorithmStep*
+inf_adopted_algorithm_step_new(InfAdoptedAlgorithm* algorithm,
+                               InfAdoptedRequest* request)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmStep* step;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  step = priv->step_pool;
+  if(step != NULL)
+    priv->step_pool = step->next;
+  else
+    step = g_slice_new(InfAdoptedAlgorithmStep);
+
+  step->type = inf_adopted_request_get_request_type(request);
+  step->vector = NULL;
+  step->user_id = inf_adopted_request_get_user_id(request);
+  step->operation = inf_adopted_request_get_operation(request);
+  step->received = inf_adopted_request_get_receive_time(request);
+  step->executed = inf_adopted_request_get_execute_time(request);
+  step->request = request;
+  step->next = NULL;
+
+  if(step->operation != NULL)
+    g_object_ref(step->operation);
+  g_object_ref(request);
+
+  return step;
+}
+
+/* Makes the step independent from its request, before it is moved to
+ * another state. */
+static void
+inf_adopted_algorithm_step_detach(InfAdoptedAlgorithmStep* step)
+{
+  if(step->request != NULL)
   {
-    lcs = inf_adopted_algorithm_least_common_successor(
-      algorithm,
-      inf_adopted_request_get_vector(request),
-      inf_adopted_request_get_vector(against)
-    );
+    if(step->vector == NULL)
+    {
+      step->vector = inf_adopted_state_vector_copy(
+        inf_adopted_request_get_vector(step->request)
+      );
+    }
 
-    g_assert(inf_adopted_state_vector_causally_before(lcs, at));
+    g_object_unref(step->request);
+    step->request = NULL;
+  }
+}
+
+/* Replaces the operation of the step with the one of request, which must
+ * be equivalent to the step. */
+static void
+inf_adopted_algorithm_step_set_request(InfAdoptedAlgorithmStep* step,
+                                       InfAdoptedRequest* request)
+{
+  InfAdoptedOperation* operation;
+
+  if(request == step->request)
+    return;
+
+  g_object_ref(request);
+  if(step->request != NULL)
+    g_object_unref(step->request);
+  step->request = request;
+
+  operation = inf_adopted_request_get_operation(request);
+  if(operation != NULL)
+    g_object_ref(operation);
+  if(step->operation != NULL)
+    g_object_unref(step->operation);
+  step->operation = operation;
+}
 
-    if(inf_adopted_state_vector_compare(lcs, at) != 0)
+/* Returns an InfAdoptedRequest for the current state of the step, creating
+ * one if the step was moved since it was last needed as a request. */
+static InfAdoptedRequest*
+inf_adopted_algorithm_step_get_request(InfAdoptedAlgorithmStep* step)
+{
+  if(step->request == NULL)
+  {
+    switch(step->type)
     {
-      lcs_against = inf_adopted_algorithm_translate_request(
-        algorithm,
-        against,
-        lcs
+    case INF_ADOPTED_REQUEST_DO:
+      step->request = inf_adopted_request_new_do(
+        step->vector,
+        step->user_id,
+        step->operation,
+        step->received
       );
 
-      lcs_request = inf_adopted_algorithm_translate_request(
-        algorithm,
-        request,
-        lcs
+      break;
+    case INF_ADOPTED_REQUEST_UNDO:
+      step->request = inf_adopted_request_new_undo(
+        step->vector,
+        step->user_id,
+        step->received
       );
-    }
-    else
-    {
-      lcs_against = against_at;
-      lcs_request = request_at;
 
-      g_object_ref(lcs_against);
-      g_object_ref(lcs_request);
+      break;
+    case INF_ADOPTED_REQUEST_REDO:
+      step->request = inf_adopted_request_new_redo(
+        step->vector,
+        step->user_id,
+        step->received
+      );
+
+      break;
+    default:
+      g_assert_not_reached();
+      break;
     }
 
-    inf_adopted_state_vector_free(lcs);
+    inf_adopted_request_set_execute_time(step->request, step->executed);
   }
-  else
+
+  return step->request;
+}
+
+/* Returns the step to the pool. The return value is the request
+ * corresponding to the final state of the step. */
+static InfAdoptedRequest*
+inf_adopted_algorithm_step_free(InfAdoptedAlgorithm* algorithm,
+                                InfAdoptedAlgorithmStep* step)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedRequest* request;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  request = inf_adopted_algorithm_step_get_request(step);
+
+  if(step->vector != NULL)
+    inf_adopted_state_vector_free(step->vector);
+  if(step->operation != NULL)
+    g_object_unref(step->operation);
+
+  step->next = priv->step_pool;
+  priv->step_pool = step;
+  return request;
+}
+
+/* Same as inf_adopted_request_fold(), in place */
+static void
+inf_adopted_algorithm_step_fold(InfAdoptedAlgorithmStep* step,
+                                guint into,
+                                guint by)
+{
+  inf_adopted_algorithm_step_detach(step);
+  inf_adopted_state_vector_add(step->vector, into, by);
+}
+
+/* Same as inf_adopted_request_mirror(), in place */
+static void
+inf_adopted_algorithm_step_mirror(InfAdoptedAlgorithmStep* step,
+                                  guint by)
+{
+  InfAdoptedOperation* new_operation;
+
+  g_assert(step->type == INF_ADOPTED_REQUEST_DO);
+  g_assert(inf_adopted_operation_is_reversible(step->operation));
+
+  inf_adopted_algorithm_step_detach(step);
+  inf_adopted_state_vector_add(step->vector, step->user_id, by);
+
+  new_operation = inf_adopted_operation_revert(step->operation);
+  g_object_unref(step->operation);
+  step->operation = new_operation;
+}
+
+/* Transforms the step against against, which must be at the same state,
+ * in place. */
+static void
+inf_adopted_algorithm_step_transform(InfAdoptedAlgorithm* algorithm,
+                                     InfAdoptedAlgorithmStep* step,
+                                     InfAdoptedRequest* against)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedOperation* against_operation;
+  InfAdoptedOperation* new_operation;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  InfAdoptedConcurrencyId concurrency_id;
+  guint against_user_id;
+  gboolean need_lcs;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  g_assert(step->type == INF_ADOPTED_REQUEST_DO);
+  g_assert(
+    inf_adopted_state_vector_compare(
+      inf_adopted_algorithm_step_get_vector(step),
+      inf_adopted_request_get_vector(against)
+    ) == 0
+  );
+
+  /* The request log caches requests of its user at any state they have
+   * been translated to. Make this state known to the log, or use the
+   * version that it has already. */
+  if(inf_adopted_operation_get_flags(step->operation) &
+     INF_ADOPTED_OPERATION_AFFECTS_BUFFER)
   {
-    lcs_against = NULL;
-    lcs_request = NULL;
+    log = inf_adopted_user_get_request_log(
+      INF_ADOPTED_USER(
+        inf_user_table_lookup_user_by_id(priv->user_table, step->user_id)
+      )
+    );
+
+    request = inf_adopted_request_log_lookup_cached_request(
+      log,
+      inf_adopted_algorithm_step_get_vector(step)
+    );
+
+    if(request != NULL)
+    {
+      inf_adopted_algorithm_step_set_request(step, request);
+    }
+    else
+    {
+      request = inf_adopted_algorithm_step_get_request(step);
+      if(inf_adopted_algorithm_can_cache(request))
+        inf_adopted_request_log_add_cached_request(log, request);
+    }
   }
 
-  result = inf_adopted_request_transform(
-    request_at,
-    against_at,
-    lcs_request,
-    lcs_against
+  against_operation = inf_adopted_request_get_operation(against);
+  against_user_id = inf_adopted_request_get_user_id(against);
+  g_assert(step->user_id != against_user_id);
+
+  if(step->user_id > against_user_id)
+    concurrency_id = INF_ADOPTED_CONCURRENCY_OTHER;
+  else
+    concurrency_id = INF_ADOPTED_CONCURRENCY_SELF;
+
+  /* Both are at the same state, which therefore also is the least common
+   * successor of their states. */
+  need_lcs = inf_adopted_operation_need_concurrency_id(
+    step->operation,
+    against_operation
   );
 
-  if(lcs_request != NULL)
-    g_object_unref(lcs_request);
-  if(lcs_against != NULL)
-    g_object_unref(lcs_against);
+  new_operation = inf_adopted_operation_transform(
+    step->operation,
+    against_operation,
+    need_lcs ? step->operation : NULL,
+    need_lcs ? against_operation : NULL,
+    concurrency_id
+  );
 
-  g_object_unref(request_at);
-  g_object_unref(against_at);
+  inf_adopted_algorithm_step_detach(step);
+  inf_adopted_state_vector_add(step->vector, against_user_id, 1);
 
-  return result;
+  g_object_unref(step->operation);
+  step->operation = new_operation;
 }
 
 static InfAdoptedRequest*
@@ -708,9 +1225,9 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
   InfAdoptedRequestLog* log;
   guint user_id;
 
-  InfAdoptedRequest* cur_req;
-  InfAdoptedRequest* next_req;
+  InfAdoptedAlgorithmStep* step;
   InfAdoptedStateVector* vector;
+  gboolean moved;
 
   InfAdoptedRequest* index;
   InfAdoptedRequest* associated;
@@ -722,13 +1239,12 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
-  cur_req = request;
-  vector = inf_adopted_request_get_vector(cur_req);
-  g_object_ref(cur_req);
+  step = inf_adopted_algorithm_step_new(algorithm, request);
+  vector = inf_adopted_algorithm_step_get_vector(step);
 
-  while(inf_adopted_state_vector_compare(vector, to) != 0)
+  while(!inf_adopted_state_vector_equal(vector, to))
   {
-    next_req = NULL;
+    moved = FALSE;
 
     g_assert(inf_adopted_state_vector_causally_before(vector, to) == TRUE);
     for(user_it = priv->users_begin; user_it != priv->users_end; ++user_it)
@@ -736,7 +1252,7 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
       user = *user_it;
       user_id = inf_user_get_id(INF_USER(user));
 
-      if(user_id == inf_adopted_request_get_user_id(cur_req)) continue;
+      if(user_id == step->user_id) continue;
 
       from_n = inf_adopted_state_vector_get(vector, user_id);
       to_n = inf_adopted_state_vector_get(to, user_id);
@@ -753,12 +1269,13 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
       if(associated != NULL &&
          inf_adopted_request_get_index(associated) < to_n)
       {
-        next_req = inf_adopted_request_fold(
-          cur_req,
+        inf_adopted_algorithm_step_fold(
+          step,
           user_id,
           inf_adopted_request_get_index(associated) - from_n + 1
         );
 
+        moved = TRUE;
         break;
       }
       else
@@ -774,29 +1291,25 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
             vector
           );
 
-          next_req = inf_adopted_algorithm_transform_request(
-            algorithm,
-            cur_req,
-            translated,
-            vector
-          );
-
+          inf_adopted_algorithm_step_transform(algorithm, step, translated);
           g_object_unref(translated);
+
+          moved = TRUE;
           break;
         }
       }
     }
 
     /* Late Mirror, only if no transformations or folds possible */
-    if(next_req == NULL)
+    if(!moved)
     {
-      user_id = inf_adopted_request_get_user_id(cur_req);
+      user_id = step->user_id;
       user = INF_ADOPTED_USER(
         inf_user_table_lookup_user_by_id(priv->user_table, user_id)
       );
 
       log = inf_adopted_user_get_request_log(user);
-      from_n = inf_adopted_request_get_index(cur_req);
+      from_n = inf_adopted_state_vector_get(vector, user_id);
       to_n = inf_adopted_state_vector_get(to, user_id);
       index = inf_adopted_request_log_get_request(log, from_n);
       associated = inf_adopted_request_log_next_associated(log, index);
@@ -827,22 +1340,17 @@ inf_adopted_algorithm_translate_request_forward(InfAdoptedAlgorithm* algorithm,
 
       if(associated_index != G_MAXUINT && associated_index <= to_n)
       {
-        next_req = inf_adopted_request_mirror(
-          cur_req,
-          associated_index - from_n
-        );
+        inf_adopted_algorithm_step_mirror(step, associated_index - from_n);
+        moved = TRUE;
       }
     }
 
-    /* If next_req == NULL, to is not reachable in state space */
-    g_assert(next_req != NULL);
-
-    g_object_unref(cur_req);
-    cur_req = next_req;
-    vector = inf_adopted_request_get_vector(cur_req);
+    /* If nothing moved, to is not reachable in state space */
+    g_assert(moved == TRUE);
+    vector = inf_adopted_algorithm_step_get_vector(step);
   }
 
-  return cur_req;
+  return inf_adopted_algorithm_step_free(algorithm, step);
 }
 
 static void
@@ -855,6 +1363,7 @@ inf_adopted_algorithm_log_request(InfAdoptedAlgorithm* algorithm,
 /*  InfAdoptedStateVector* user_vector;
   InfAdoptedStateVector* request_vector;*/
   guint user_id;
+  guint value;
   gboolean equivalent;
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
@@ -872,7 +1381,15 @@ inf_adopted_algorithm_log_request(InfAdoptedAlgorithm* algorithm,
     /* First, add to request log */
     inf_adopted_request_log_add_request(log, request);
     /* Update current document state */
+    value = inf_adopted_state_vector_get(priv->current, user_id);
     inf_adopted_state_vector_add(priv->current, user_id, 1);
+
+    inf_adopted_algorithm_lcp_update_component(
+      algorithm,
+      user_id,
+      value,
+      value + 1
+    );
     /* Update local user times */
     inf_adopted_algorithm_update_local_user_times(algorithm);
 
@@ -1036,6 +1553,18 @@ inf_adopted_algorithm_init(InfAdoptedAlgorithm* algorithm)
   priv->max_total_log_size = 2048;
   priv->execute_request = NULL;
 
+  priv->translation_cache = g_hash_table_new(
+    inf_adopted_algorithm_cache_entry_hash,
+    inf_adopted_algorithm_cache_entry_equal
+  );
+
+  g_queue_init(&priv->translation_cache_queue);
+  priv->translation_cache_size = 1024;
+  priv->translation_cache_hits = 0;
+  priv->translation_cache_misses = 0;
+
+  priv->step_pool = NULL;
+
   priv->current = inf_adopted_state_vector_new();
   priv->buffer_modified_time = NULL;
   priv->user_table = NULL;
@@ -1046,6 +1575,19 @@ inf_adopted_algorithm_init(InfAdoptedAlgorithm* algorithm)
   priv->users_begin = NULL;
   priv->users_end = NULL;
 
+  priv->lcp = inf_adopted_state_vector_new();
+  priv->lcp_count = inf_adopted_state_vector_new();
+  priv->lcp_sum = 0;
+
+  priv->lcp_vectors = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    (GDestroyNotify)inf_adopted_state_vector_free
+  );
+
+  priv->cleanup_thresholds = NULL;
+
   priv->local_users = NULL;
 }
 
@@ -1106,6 +1648,7 @@ inf_adopted_algorithm_dispose(GObject* object)
 {
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user;
   GList* item;
 
   algorithm = INF_ADOPTED_ALGORITHM(object);
@@ -1114,7 +1657,30 @@ inf_adopted_algorithm_dispose(GObject* object)
   while(priv->local_users != NULL)
     inf_adopted_algorithm_local_user_free(algorithm, priv->local_users->data);
 
+  inf_adopted_algorithm_cache_trim(algorithm, 0);
+
+  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(*user),
+      G_CALLBACK(inf_adopted_algorithm_user_notify_vector_cb),
+      algorithm
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(*user),
+      G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+      algorithm
+    );
+  }
+
+  g_hash_table_remove_all(priv->lcp_vectors);
+
   g_free(priv->users_begin);
+  g_free(priv->cleanup_thresholds);
+  priv->users_begin = NULL;
+  priv->users_end = NULL;
+  priv->cleanup_thresholds = NULL;
 
   if(priv->buffer != NULL)
   {
@@ -1163,11 +1729,23 @@ inf_adopted_algorithm_finalize(GObject* object)
 {
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmStep* step;
 
   algorithm = INF_ADOPTED_ALGORITHM(object);
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
   inf_adopted_state_vector_free(priv->current);
+  inf_adopted_state_vector_free(priv->lcp);
+  inf_adopted_state_vector_free(priv->lcp_count);
+  g_hash_table_destroy(priv->lcp_vectors);
+  g_hash_table_destroy(priv->translation_cache);
+
+  while(priv->step_pool != NULL)
+  {
+    step = priv->step_pool;
+    priv->step_pool = step->next;
+    g_slice_free(InfAdoptedAlgorithmStep, step);
+  }
 
   G_OBJECT_CLASS(inf_adopted_algorithm_parent_class)->finalize(object);
 }
@@ -1229,8 +1807,14 @@ inf_adopted_algorithm_set_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     priv->max_total_log_size = g_value_get_uint(value);
     break;
+  case PROP_TRANSLATION_CACHE_SIZE:
+    priv->translation_cache_size = g_value_get_uint(value);
+    inf_adopted_algorithm_cache_trim(algorithm, priv->translation_cache_size);
+    break;
   case PROP_CURRENT_STATE:
   case PROP_BUFFER_MODIFIED_STATE:
+  case PROP_TRANSLATION_CACHE_HITS:
+  case PROP_TRANSLATION_CACHE_MISSES:
     /* read/only */
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -1261,12 +1845,21 @@ inf_adopted_algorithm_get_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     g_value_set_uint(value, priv->max_total_log_size);
     break;
+  case PROP_TRANSLATION_CACHE_SIZE:
+    g_value_set_uint(value, priv->translation_cache_size);
+    break;
   case PROP_CURRENT_STATE:
     g_value_set_boxed(value, priv->current);
     break;
   case PROP_BUFFER_MODIFIED_STATE:
     g_value_set_boxed(value, priv->buffer_modified_time);
     break;
+  case PROP_TRANSLATION_CACHE_HITS:
+    g_value_set_uint(value, priv->translation_cache_hits);
+    break;
+  case PROP_TRANSLATION_CACHE_MISSES:
+    g_value_set_uint(value, priv->translation_cache_misses);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1380,6 +1973,49 @@ inf_adopted_algorithm_class_init(InfAdoptedAlgorithmClass* algorithm_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_TRANSLATION_CACHE_SIZE,
+    g_param_spec_uint(
+      "translation-cache-size",
+      "Translation cache size",
+      "The maximum number of translated requests to keep in the cache, or 0 "
+      "to disable the cache",
+      0,
+      G_MAXUINT,
+      1024,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TRANSLATION_CACHE_HITS,
+    g_param_spec_uint(
+      "translation-cache-hits",
+      "Translation cache hits",
+      "The number of request translations that were found in the cache",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TRANSLATION_CACHE_MISSES,
+    g_param_spec_uint(
+      "translation-cache-misses",
+      "Translation cache misses",
+      "The number of request translations that were not found in the cache",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfAdoptedAlgorithm::can-undo-changed:
    * @algorithm: The #InfAdoptedAlgorithm for which a user's
@@ -1695,6 +2331,10 @@ inf_adopted_algorithm_generate_request(InfAdoptedAlgorithm* algorithm,
  * translated in forward direction, so @request's vector time must be
  * causally before (see inf_adopted_state_vector_causally_before()) @to.
  *
+ * Translation results, including the intermediate ones computed while
+ * translating @request, are kept in a least-recently-used cache whose size
+ * is given by the #InfAdoptedAlgorithm:translation-cache-size property.
+ *
  * Returns: (transfer full): A new or cached #InfAdoptedRequest. Free with
  * g_object_unref() when no longer needed.
  */
@@ -1709,6 +2349,7 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
   InfAdoptedUser* user;
   InfAdoptedRequestLog* log;
   InfAdoptedRequest* result;
+  gboolean is_identity;
 
   g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
@@ -1738,6 +2379,24 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
     NULL
   );
 
+  /* Translating a request to its own state is trivial */
+  is_identity = inf_adopted_state_vector_equal(
+    inf_adopted_request_get_vector(request),
+    to
+  );
+
+  if(!is_identity)
+  {
+    /* This also finds requests which cannot be cached in the request log,
+     * and intermediate results of the recursive translation. */
+    result = inf_adopted_algorithm_cache_lookup(algorithm, request, to);
+    if(result != NULL)
+    {
+      g_object_ref(result);
+      return result;
+    }
+  }
+
   /* If the request affects the buffer, then it might have been cached
    * earlier. */
   if(inf_adopted_request_affects_buffer(request))
@@ -1745,6 +2404,9 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
     result = inf_adopted_request_log_lookup_cached_request(log, to);
     if(result != NULL)
     {
+      if(!is_identity)
+        inf_adopted_algorithm_cache_insert(algorithm, request, to, result);
+
       g_object_ref(result);
       return result;
     }
@@ -1766,6 +2428,8 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
 
   if(inf_adopted_algorithm_can_cache(result))
     inf_adopted_request_log_add_cached_request(log, result);
+  if(!is_identity)
+    inf_adopted_algorithm_cache_insert(algorithm, request, to, result);
   return result;
 }
 
@@ -2055,15 +2719,16 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
  *
  * This function can be called after every executed request to keep memory use
  * to a minimum, or it can be called in regular intervals, or it can also be
- * omitted if the request history should be preserved.
+ * omitted if the request history should be preserved. Request logs which
+ * do not contain any removable requests are skipped quickly, so that calling
+ * it often is cheap even with many users.
  **/
 void
 inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
 {
   InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedStateVector* temp;
-  InfAdoptedStateVector* lcp;
   InfAdoptedUser** user;
+  guint* threshold;
   InfAdoptedRequestLog* log;
   InfAdoptedRequest* req;
   InfAdoptedStateVector* req_vec;
@@ -2102,27 +2767,24 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
    * are additional conditions. However, in the current case, some requests
    * are just kept a bit longer than necessary, in favor of simplicity. */
 
-  lcp = inf_adopted_state_vector_copy(priv->current);
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  /* The lcp itself is maintained as the user vectors advance. Since the
+   * vdiff of a request to the lcp is the difference of their sums, we also
+   * remember for each user at which lcp sum the oldest set of related
+   * requests in its log becomes old enough, and skip the user until then.
+   * Requests are only ever appended to the log, so the oldest request stays
+   * the same until it is removed here. This way, the cost of cleanup is
+   * proportional to the number of removed requests, not to the total
+   * number of users and requests. */
+  threshold = priv->cleanup_thresholds;
+  for(user = priv->users_begin; user != priv->users_end; ++ user, ++ threshold)
   {
-    if(inf_user_get_status(INF_USER(*user)) != INF_USER_UNAVAILABLE)
-    {
-      temp = inf_adopted_algorithm_least_common_predecessor(
-        algorithm,
-        lcp,
-        inf_adopted_user_get_vector(*user)
-      );
-
-      inf_adopted_state_vector_free(lcp);
-      lcp = temp;
-    }
-  }
+    if(priv->lcp_sum < *threshold)
+      continue;
 
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
     id = inf_user_get_id(INF_USER(*user));
     log = inf_adopted_user_get_request_log(*user);
     n = inf_adopted_request_log_get_begin(log);
+    *threshold = 0;
 
     /* Remove all sets of related requests whose upper related request has
      * a large enough vdiff to lcp. */
@@ -2138,7 +2800,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
        * the request needs to be available to reach its target vector time. */
       req_before_lcp = inf_adopted_state_vector_causally_before_inc(
         req_vec,
-        lcp,
+        priv->lcp,
         id
       );
 
@@ -2153,7 +2815,7 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
         inf_adopted_request_log_get_request(log, n)
       );
 
-      vdiff = inf_adopted_state_vector_vdiff(low_vec, lcp);
+      vdiff = inf_adopted_state_vector_vdiff(low_vec, priv->lcp);
 
       /* TODO: Again, I experimentally changed <= to < here. If the vdiff is
        * equal to the log size, then nobody can do anything with the request
@@ -2163,7 +2825,15 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
        * too much request in the request log. Note again that changing this
        * requires changing the cleanup tests, too. */
       if(vdiff < priv->max_total_log_size)
+      {
+        /* The lcp sum at which vdiff reaches max-total-log-size */
+        if(priv->max_total_log_size - vdiff > G_MAXUINT - priv->lcp_sum)
+          *threshold = G_MAXUINT;
+        else
+          *threshold = priv->lcp_sum + (priv->max_total_log_size - vdiff);
+
         break;
+      }
 
       /* Check next set of related requests */
       n = inf_adopted_state_vector_get(req_vec, id) + 1;
@@ -2171,8 +2841,6 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
 
     inf_adopted_request_log_remove_requests(log, n);
   }
-
-  inf_adopted_state_vector_free(lcp);
 }
 
 /**
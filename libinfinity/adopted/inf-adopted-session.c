@@ -33,12 +33,28 @@
  * also makes sure to periodically send the state the local host is in to
  * other uses even if the local users are idle (which is required for others
  * to cleanup their request logs and request caches).
+ *
+ * If the #InfAdoptedSession:request-batch-interval property is nonzero,
+ * consecutive requests of the same local user are not sent immediately but
+ * are collected for at most that many milliseconds, or until
+ * #InfAdoptedSession:request-batch-size requests have been collected, and
+ * are then sent in a single &lt;request-batch&gt; message. This saves
+ * per-message overhead when a user types quickly. Batches are only sent to
+ * connections added with inf_adopted_session_add_batching_connection(),
+ * which are also told the batching parameters so that they batch their own
+ * requests in the same way. All other members of the subscription group
+ * receive the contained requests one by one, so hosts which do not
+ * understand batches can still take part in the session. A session that is
+ * not the publisher of its subscription group only batches as its publisher
+ * told it to, and stops batching when it loses the subscription group.
  */
 
 /* TODO: warning if no update from a particular non-local user for some time */
 
 #include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/communication/inf-communication-joined-group.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
@@ -54,6 +70,25 @@ struct _InfAdoptedSessionToXmlSyncForeachData {
   xmlNodePtr parent_xml;
 };
 
+typedef struct _InfAdoptedSessionResumeForeachData
+  InfAdoptedSessionResumeForeachData;
+struct _InfAdoptedSessionResumeForeachData {
+  InfAdoptedSession* session;
+  InfCommunicationGroup* group;
+  InfXmlConnection* connection;
+  const gchar* name;
+
+  InfAdoptedStateVector* vector;
+  gboolean result;
+};
+
+typedef struct _InfAdoptedSessionBufferLookup InfAdoptedSessionBufferLookup;
+struct _InfAdoptedSessionBufferLookup {
+  InfAdoptedStateVector* current;
+  gboolean found;
+  guint user_id;
+};
+
 typedef struct _InfAdoptedSessionLocalUser InfAdoptedSessionLocalUser;
 struct _InfAdoptedSessionLocalUser {
   InfAdoptedUser* user;
@@ -73,8 +108,24 @@ struct _InfAdoptedSessionPrivate {
   InfIoTimeout* noop_timeout;
   /* User to send the time for */
   InfAdoptedSessionLocalUser* next_noop_user;
-  /* Buffer for requests that are not ready to be executed yet */
-  GPtrArray* request_buffer;
+  /* Buffer for requests that are not ready to be executed yet. Maps the ID
+   * of the user whose request they are waiting for to a GSequence of the
+   * waiting requests, ordered by the component they wait for. */
+  GHashTable* request_buffer;
+
+  /* Outgoing requests of a single local user that have not been sent yet */
+  guint batch_interval;
+  guint batch_size;
+  xmlNodePtr batch;
+  guint batch_user_id;
+  guint batch_count;
+  InfIoTimeout* batch_timeout;
+
+  /* Members of the subscription group if it is hosted, split into those
+   * which understand request batches and those which do not */
+  InfCommunicationGroup* member_group;
+  GSList* batch_members;
+  GSList* plain_members;
 };
 
 enum {
@@ -84,6 +135,10 @@ enum {
   PROP_IO,
   PROP_MAX_TOTAL_LOG_SIZE,
 
+  /* read/write */
+  PROP_REQUEST_BATCH_INTERVAL,
+  PROP_REQUEST_BATCH_SIZE,
+
   /* read only */
   PROP_ALGORITHM
 };
@@ -102,6 +157,10 @@ static GQuark inf_adopted_session_error_quark;
 /* TODO: This should perhaps be a property: */
 static const int INF_ADOPTED_SESSION_NOOP_INTERVAL = 30;
 
+/* Estimated memory used by a request in a request log, including its state
+ * vector and its operation. */
+static const gsize INF_ADOPTED_SESSION_REQUEST_SIZE = 256;
+
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedSession, inf_adopted_session, INF_TYPE_SESSION,
   G_ADD_PRIVATE(InfAdoptedSession))
 
@@ -218,11 +277,25 @@ inf_adopted_session_user_from_request_xml(InfAdoptedSession* session,
   InfUserTable* user_table;
   InfUser* user;
   guint user_id;
+  xmlNodePtr user_xml;
 
   user_table = inf_session_get_user_table(INF_SESSION(session));
 
-  if(!inf_xml_util_get_attribute_uint_required(xml, "user", &user_id, error))
+  /* Requests within a request batch do not repeat the user, it is stored
+   * only once in the batch itself. */
+  user_xml = xml;
+  if(xml->parent != NULL && xml->parent->type == XML_ELEMENT_NODE &&
+     strcmp((const char*)xml->parent->name, "request-batch") == 0 &&
+     xmlHasProp(xml, (const xmlChar*)"user") == NULL)
+  {
+    user_xml = xml->parent;
+  }
+
+  if(!inf_xml_util_get_attribute_uint_required(user_xml, "user", &user_id,
+                                               error))
+  {
     return FALSE;
+  }
 
   /* User ID 0 means no user */
   if(user_id == 0) return NULL;
@@ -382,6 +455,398 @@ inf_adopted_session_stop_noop_timer(InfAdoptedSession* session,
   }
 }
 
+/*
+ * Request batching
+ */
+
+/* Returns a copy of members without except, holding a reference on each
+ * connection. Sending to one of the connections can run callbacks which
+ * change the member lists, so sends need to iterate over such a copy. */
+static GSList*
+inf_adopted_session_copy_members(GSList* members,
+                                 InfXmlConnection* except)
+{
+  GSList* copy;
+  GSList* item;
+
+  copy = NULL;
+  for(item = members; item != NULL; item = item->next)
+    if(item->data != except)
+      copy = g_slist_prepend(copy, g_object_ref(item->data));
+
+  return g_slist_reverse(copy);
+}
+
+static void
+inf_adopted_session_free_members(GSList* members)
+{
+  while(members != NULL)
+  {
+    g_object_unref(members->data);
+    members = g_slist_delete_link(members, members);
+  }
+}
+
+/* Tells connection, or all members which understand batches if connection
+ * is NULL, how to batch their own requests. This has to wait until the
+ * session is running, since a connection which synchronizes the session to
+ * us does not expect it earlier. */
+static void
+inf_adopted_session_announce_batching(InfAdoptedSession* session,
+                                      InfXmlConnection* connection)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfCommunicationGroup* group;
+  GSList* connections;
+  GSList* item;
+  xmlNodePtr xml;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_assert(priv->member_group != NULL);
+
+  if(inf_session_get_status(INF_SESSION(session)) != INF_SESSION_RUNNING)
+    return;
+
+  group = g_object_ref(priv->member_group);
+  if(connection != NULL)
+    connections = g_slist_prepend(NULL, g_object_ref(connection));
+  else
+    connections = inf_adopted_session_copy_members(priv->batch_members, NULL);
+
+  for(item = connections; item != NULL; item = item->next)
+  {
+    xml = xmlNewNode(NULL, (const xmlChar*)"request-batching");
+    inf_xml_util_set_attribute_uint(xml, "interval", priv->batch_interval);
+    inf_xml_util_set_attribute_uint(xml, "size", priv->batch_size);
+
+    inf_communication_group_send_message(
+      group,
+      INF_XML_CONNECTION(item->data),
+      xml
+    );
+  }
+
+  inf_adopted_session_free_members(connections);
+  g_object_unref(group);
+}
+
+/* Sends xml, a <request-batch> message, to all members of the subscription
+ * group except except. Members which do not understand batches get the
+ * requests of the batch one by one. Takes ownership of xml. */
+static void
+inf_adopted_session_send_batch(InfAdoptedSession* session,
+                               xmlNodePtr xml,
+                               InfXmlConnection* except)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfCommunicationGroup* group;
+  GSList* batch_members;
+  GSList* plain_members;
+  GSList* item;
+  xmlNodePtr child;
+  xmlNodePtr request;
+  xmlChar* user;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_assert(priv->member_group != NULL);
+
+  group = g_object_ref(priv->member_group);
+
+  batch_members = inf_adopted_session_copy_members(
+    priv->batch_members,
+    except
+  );
+
+  plain_members = inf_adopted_session_copy_members(
+    priv->plain_members,
+    except
+  );
+
+  for(item = batch_members; item != NULL; item = item->next)
+  {
+    inf_communication_group_send_message(
+      group,
+      INF_XML_CONNECTION(item->data),
+      xmlCopyNode(xml, 1)
+    );
+  }
+
+  if(plain_members != NULL)
+  {
+    user = inf_xml_util_get_attribute(xml, "user");
+
+    for(child = xml->children; child != NULL; child = child->next)
+    {
+      if(child->type != XML_ELEMENT_NODE)
+        continue;
+
+      for(item = plain_members; item != NULL; item = item->next)
+      {
+        request = xmlCopyNode(child, 1);
+        if(user != NULL)
+          xmlSetProp(request, (const xmlChar*)"user", user);
+
+        inf_communication_group_send_message(
+          group,
+          INF_XML_CONNECTION(item->data),
+          request
+        );
+      }
+    }
+
+    if(user != NULL)
+      xmlFree(user);
+  }
+
+  inf_adopted_session_free_members(batch_members);
+  inf_adopted_session_free_members(plain_members);
+  g_object_unref(group);
+  xmlFreeNode(xml);
+}
+
+static void
+inf_adopted_session_member_added_cb(InfCommunicationGroup* group,
+                                    InfXmlConnection* connection,
+                                    gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+
+  session = INF_ADOPTED_SESSION(user_data);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  /* Batches are only sent once the connection asked for them */
+  g_object_ref(connection);
+  priv->plain_members = g_slist_prepend(priv->plain_members, connection);
+}
+
+static void
+inf_adopted_session_member_removed_cb(InfCommunicationGroup* group,
+                                      InfXmlConnection* connection,
+                                      gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+  GSList* item;
+
+  session = INF_ADOPTED_SESSION(user_data);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  item = g_slist_find(priv->batch_members, connection);
+  if(item != NULL)
+  {
+    priv->batch_members = g_slist_delete_link(priv->batch_members, item);
+    g_object_unref(connection);
+  }
+
+  item = g_slist_find(priv->plain_members, connection);
+  if(item != NULL)
+  {
+    priv->plain_members = g_slist_delete_link(priv->plain_members, item);
+    g_object_unref(connection);
+  }
+}
+
+static void
+inf_adopted_session_release_member_group(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->member_group != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->member_group),
+      G_CALLBACK(inf_adopted_session_member_added_cb),
+      session
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->member_group),
+      G_CALLBACK(inf_adopted_session_member_removed_cb),
+      session
+    );
+
+    inf_adopted_session_free_members(priv->batch_members);
+    inf_adopted_session_free_members(priv->plain_members);
+    priv->batch_members = NULL;
+    priv->plain_members = NULL;
+
+    g_object_unref(priv->member_group);
+    priv->member_group = NULL;
+  }
+}
+
+/* Only the publisher of the subscription group sends to each member
+ * separately. Other hosts send everything to the publisher, which can then
+ * relay it in a form every member understands. Members are expected to be
+ * added only after the session has been given the group, which is how
+ * InfdDirectory and InfdSessionProxy use it. */
+static void
+inf_adopted_session_track_member_group(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfCommunicationGroup* group;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+
+  if(group == priv->member_group)
+    return;
+
+  inf_adopted_session_release_member_group(session);
+
+  if(group != NULL && INF_COMMUNICATION_IS_HOSTED_GROUP(group))
+  {
+    priv->member_group = group;
+    g_object_ref(group);
+
+    g_signal_connect(
+      G_OBJECT(group),
+      "member-added",
+      G_CALLBACK(inf_adopted_session_member_added_cb),
+      session
+    );
+
+    g_signal_connect(
+      G_OBJECT(group),
+      "member-removed",
+      G_CALLBACK(inf_adopted_session_member_removed_cb),
+      session
+    );
+  }
+}
+
+static void
+inf_adopted_session_notify_subscription_group_cb(GObject* object,
+                                                 GParamSpec* pspec,
+                                                 gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+
+  session = INF_ADOPTED_SESSION(object);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  inf_adopted_session_track_member_group(session);
+
+  /* The batching parameters of a joined session were announced by the
+   * publisher, which might not batch anymore when we subscribe again. */
+  if(inf_session_get_subscription_group(INF_SESSION(session)) == NULL &&
+     priv->batch_interval > 0)
+  {
+    g_object_set(G_OBJECT(session), "request-batch-interval", 0, NULL);
+  }
+}
+
+static void
+inf_adopted_session_flush_batch(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  xmlNodePtr xml;
+  xmlNodePtr child;
+  gboolean is_batch;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->batch_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->batch_timeout);
+    priv->batch_timeout = NULL;
+  }
+
+  if(priv->batch == NULL)
+    return;
+
+  xml = priv->batch;
+  priv->batch = NULL;
+  is_batch = (priv->batch_count > 1);
+
+  if(!is_batch)
+  {
+    /* A single request is sent as is, the batch would only add overhead */
+    child = xml->children;
+    xmlUnlinkNode(child);
+    xmlFreeNode(xml);
+    xml = child;
+  }
+  else
+  {
+    /* The user is stored in the batch, no need to repeat it */
+    for(child = xml->children; child != NULL; child = child->next)
+      xmlUnsetProp(child, (const xmlChar*)"user");
+  }
+
+  priv->batch_count = 0;
+
+  /* The subscription group might have gone away already, for example if the
+   * connection to the server was lost. */
+  if(inf_session_get_subscription_group(INF_SESSION(session)) == NULL)
+    xmlFreeNode(xml);
+  else if(!is_batch || priv->plain_members == NULL)
+    inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+  else
+    inf_adopted_session_send_batch(session, xml, NULL);
+}
+
+static void
+inf_adopted_session_batch_timeout_func(gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+
+  session = INF_ADOPTED_SESSION(user_data);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  priv->batch_timeout = NULL;
+
+  inf_adopted_session_flush_batch(session);
+}
+
+/* Sends xml, a <request> message, either directly or as part of a batch.
+ * The request is serialized relative to the previous request of the same
+ * user, so within a batch each request time is a diff to the previous one
+ * and only the first one is relative to what was sent before. */
+static void
+inf_adopted_session_send_request_xml(InfAdoptedSession* session,
+                                     guint user_id,
+                                     xmlNodePtr xml)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(priv->batch_interval == 0)
+  {
+    inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+    return;
+  }
+
+  /* A batch contains requests of a single user only */
+  if(priv->batch != NULL && priv->batch_user_id != user_id)
+    inf_adopted_session_flush_batch(session);
+
+  if(priv->batch == NULL)
+  {
+    priv->batch = xmlNewNode(NULL, (const xmlChar*)"request-batch");
+    inf_xml_util_set_attribute_uint(priv->batch, "user", user_id);
+    priv->batch_user_id = user_id;
+
+    g_assert(priv->batch_timeout == NULL);
+    priv->batch_timeout = inf_io_add_timeout(
+      priv->io,
+      priv->batch_interval,
+      inf_adopted_session_batch_timeout_func,
+      session,
+      NULL
+    );
+  }
+
+  xmlAddChild(priv->batch, xml);
+  ++priv->batch_count;
+
+  if(priv->batch_count >= priv->batch_size)
+    inf_adopted_session_flush_batch(session);
+}
+
 /* Breadcasts a request N times - makes only sense for undo and redo requests,
  * so that's the only thing we offer API for. */
 static void
@@ -423,7 +888,7 @@ inf_adopted_session_broadcast_n_requests(InfAdoptedSession* session,
   );
 
   if(n > 1) inf_xml_util_set_attribute_uint(xml, "num", n);
-  inf_session_send_to_subscriptions(INF_SESSION(session), xml);
+  inf_adopted_session_send_request_xml(session, user_id, xml);
 
   inf_adopted_state_vector_free(local->last_send_vector);
   local->last_send_vector = inf_adopted_state_vector_copy(
@@ -438,37 +903,157 @@ inf_adopted_session_broadcast_n_requests(InfAdoptedSession* session,
   inf_adopted_session_stop_noop_timer(session, local);
 }
 
-static gboolean
-inf_adopted_session_process_request(InfAdoptedSession* session,
-                                    InfAdoptedRequest* request,
-                                    InfAdoptedUser* user,
-                                    GError** error)
+static void
+inf_adopted_session_buffer_lookup_foreach_func(guint id,
+                                               guint value,
+                                               gpointer user_data)
 {
-  InfAdoptedSessionPrivate* priv;
-  InfAdoptedStateVector* request_vector;
-  InfAdoptedStateVector* current_vector;
-  gboolean reject_request;
-  GError* local_error;
-  gboolean execute_result;
+  InfAdoptedSessionBufferLookup* lookup;
+  lookup = (InfAdoptedSessionBufferLookup*)user_data;
 
-  xmlNodePtr reply_xml;
-  gchar* request_str;
-  gchar* current_str;
+  if(!lookup->found &&
+     value > inf_adopted_state_vector_get(lookup->current, id))
+  {
+    lookup->found = TRUE;
+    lookup->user_id = id;
+  }
+}
 
-  priv = INF_ADOPTED_SESSION_PRIVATE(session);
-  request_vector = inf_adopted_request_get_vector(request);
-  current_vector = inf_adopted_algorithm_get_current(priv->algorithm);
+static gint
+inf_adopted_session_buffer_compare_func(gconstpointer a,
+                                        gconstpointer b,
+                                        gpointer user_data)
+{
+  guint user_id;
+  guint first;
+  guint second;
 
-  if(inf_adopted_state_vector_causally_before(request_vector, current_vector))
+  user_id = GPOINTER_TO_UINT(user_data);
+
+  first = inf_adopted_state_vector_get(
+    inf_adopted_request_get_vector((InfAdoptedRequest*)a),
+    user_id
+  );
+
+  second = inf_adopted_state_vector_get(
+    inf_adopted_request_get_vector((InfAdoptedRequest*)b),
+    user_id
+  );
+
+  return (first < second) ? -1 : ((first > second) ? 1 : 0);
+}
+
+static void
+inf_adopted_session_buffer_free_func(gpointer data)
+{
+  GSequence* sequence;
+  GSequenceIter* iter;
+
+  sequence = (GSequence*)data;
+  for(iter = g_sequence_get_begin_iter(sequence);
+      !g_sequence_iter_is_end(iter);
+      iter = g_sequence_iter_next(iter))
   {
-    g_signal_emit(
-      G_OBJECT(session),
-      session_signals[CHECK_REQUEST],
-      0,
-      request,
-      user,
-      &reject_request
-    );
+    g_object_unref(g_sequence_get(iter));
+  }
+
+  g_sequence_free(sequence);
+}
+
+/* Puts request into the request buffer, indexed by a request it is still
+ * waiting for, and returns TRUE. If it is not waiting for any request
+ * anymore, returns FALSE and does not buffer it. Takes ownership of
+ * request if it is buffered. */
+static gboolean
+inf_adopted_session_buffer_request(InfAdoptedSession* session,
+                                   InfAdoptedRequest* request)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionBufferLookup lookup;
+  GSequence* sequence;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  lookup.current = inf_adopted_algorithm_get_current(priv->algorithm);
+  lookup.found = FALSE;
+  lookup.user_id = 0;
+
+  inf_adopted_state_vector_foreach(
+    inf_adopted_request_get_vector(request),
+    inf_adopted_session_buffer_lookup_foreach_func,
+    &lookup
+  );
+
+  if(!lookup.found)
+    return FALSE;
+
+  if(priv->request_buffer == NULL)
+  {
+    priv->request_buffer = g_hash_table_new_full(
+      NULL,
+      NULL,
+      NULL,
+      inf_adopted_session_buffer_free_func
+    );
+  }
+
+  sequence = g_hash_table_lookup(
+    priv->request_buffer,
+    GUINT_TO_POINTER(lookup.user_id)
+  );
+
+  if(sequence == NULL)
+  {
+    sequence = g_sequence_new(NULL);
+
+    g_hash_table_insert(
+      priv->request_buffer,
+      GUINT_TO_POINTER(lookup.user_id),
+      sequence
+    );
+  }
+
+  g_sequence_insert_sorted(
+    sequence,
+    request,
+    inf_adopted_session_buffer_compare_func,
+    GUINT_TO_POINTER(lookup.user_id)
+  );
+
+  return TRUE;
+}
+
+static gboolean
+inf_adopted_session_process_request(InfAdoptedSession* session,
+                                    InfAdoptedRequest* request,
+                                    InfAdoptedUser* user,
+                                    GError** error)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedStateVector* request_vector;
+  InfAdoptedStateVector* current_vector;
+  gboolean reject_request;
+  GError* local_error;
+  gboolean execute_result;
+
+  xmlNodePtr reply_xml;
+  gchar* request_str;
+  gchar* current_str;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  request_vector = inf_adopted_request_get_vector(request);
+  current_vector = inf_adopted_algorithm_get_current(priv->algorithm);
+
+  if(inf_adopted_state_vector_causally_before(request_vector, current_vector))
+  {
+    g_signal_emit(
+      G_OBJECT(session),
+      session_signals[CHECK_REQUEST],
+      0,
+      request,
+      user,
+      &reject_request
+    );
 
     local_error = NULL;
     
@@ -549,14 +1134,18 @@ inf_adopted_session_process_request(InfAdoptedSession* session,
   }
   else
   {
-    if(priv->request_buffer == NULL)
-      priv->request_buffer = g_ptr_array_new();
-    g_ptr_array_add(priv->request_buffer, request);
     g_object_ref(request);
+    if(!inf_adopted_session_buffer_request(session, request))
+      g_assert_not_reached();
     return TRUE;
   }
 }
 
+/* Executes the buffered requests that have become ready. Executing a
+ * request of some user only advances the current state in that user's
+ * component, so afterwards only the requests waiting for that user need to
+ * be looked at. Each of them either becomes ready or is put back into the
+ * buffer for another component it is still waiting for. */
 static void
 inf_adopted_session_process_buffered_requests(InfAdoptedSession* session)
 {
@@ -564,29 +1153,68 @@ inf_adopted_session_process_buffered_requests(InfAdoptedSession* session)
   InfUserTable* user_table;
   InfAdoptedStateVector* current;
 
-  guint i;
+  GQueue check_users;
+  GHashTableIter iter;
+  gpointer key;
+  guint check_user_id;
+  GSequence* sequence;
+  GSequenceIter* first;
   InfAdoptedRequest* request;
-  InfAdoptedStateVector* vector;
 
   guint user_id;
   InfUser* user;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
-  if(priv->request_buffer != NULL)
+  if(priv->request_buffer == NULL)
+    return;
+
+  user_table = inf_session_get_user_table(INF_SESSION(session));
+  current = inf_adopted_algorithm_get_current(priv->algorithm);
+
+  /* We do not know which components have advanced since the last call, so
+   * start with all users that requests are waiting for. */
+  g_queue_init(&check_users);
+  g_hash_table_iter_init(&iter, priv->request_buffer);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+    g_queue_push_tail(&check_users, key);
+
+  while(!g_queue_is_empty(&check_users))
   {
-    user_table = inf_session_get_user_table(INF_SESSION(session));
-    current = inf_adopted_algorithm_get_current(priv->algorithm);
-    for(i = 0; i < priv->request_buffer->len; ++i)
+    check_user_id = GPOINTER_TO_UINT(g_queue_pop_head(&check_users));
+
+    for(;;)
     {
-      request =
-        INF_ADOPTED_REQUEST(g_ptr_array_index(priv->request_buffer, i));
-      vector = inf_adopted_request_get_vector(request);
+      sequence = g_hash_table_lookup(
+        priv->request_buffer,
+        GUINT_TO_POINTER(check_user_id)
+      );
+
+      if(sequence == NULL)
+        break;
 
-      if(inf_adopted_state_vector_causally_before(vector, current))
+      first = g_sequence_get_begin_iter(sequence);
+      request = INF_ADOPTED_REQUEST(g_sequence_get(first));
+
+      if(inf_adopted_state_vector_get(
+           inf_adopted_request_get_vector(request),
+           check_user_id
+         ) > inf_adopted_state_vector_get(current, check_user_id))
       {
-        g_ptr_array_remove_index_fast(priv->request_buffer, i);
+        break;
+      }
 
+      g_sequence_remove(first);
+      if(g_sequence_get_length(sequence) == 0)
+      {
+        g_hash_table_remove(
+          priv->request_buffer,
+          GUINT_TO_POINTER(check_user_id)
+        );
+      }
+
+      if(!inf_adopted_session_buffer_request(session, request))
+      {
         user_id = inf_adopted_request_get_user_id(request);
         user = inf_user_table_lookup_user_by_id(user_table, user_id);
         g_assert(INF_ADOPTED_IS_USER(user));
@@ -603,7 +1231,9 @@ inf_adopted_session_process_buffered_requests(InfAdoptedSession* session)
         );
 
         g_object_unref(request);
-        return inf_adopted_session_process_buffered_requests(session);
+
+        if(user_id != check_user_id)
+          g_queue_push_tail(&check_users, GUINT_TO_POINTER(user_id));
       }
     }
   }
@@ -672,6 +1302,10 @@ inf_adopted_session_remove_local_user_cb(InfUserTable* user_table,
   );
   g_assert(local != NULL);
 
+  /* Send out pending requests of the user before it goes away */
+  if(priv->batch != NULL && priv->batch_user_id == inf_user_get_id(user))
+    inf_adopted_session_flush_batch(session);
+
   inf_adopted_session_stop_noop_timer(session, local);
   inf_adopted_state_vector_free(local->last_send_vector);
   priv->local_users = g_slist_remove(priv->local_users, local);
@@ -721,6 +1355,9 @@ inf_adopted_session_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
   session = INF_ADOPTED_SESSION(user_data);
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
+  /* Request logs and state vectors changed */
+  inf_session_invalidate_sync_snapshot(INF_SESSION(session));
+
   if(translated != NULL)
   {
     if(inf_adopted_request_affects_buffer(translated))
@@ -804,6 +1441,17 @@ inf_adopted_session_init(InfAdoptedSession* session)
   priv->noop_timeout = NULL;
   priv->next_noop_user = NULL;
   priv->request_buffer = NULL;
+
+  priv->batch_interval = 0;
+  priv->batch_size = 32;
+  priv->batch = NULL;
+  priv->batch_user_id = 0;
+  priv->batch_count = 0;
+  priv->batch_timeout = NULL;
+
+  priv->member_group = NULL;
+  priv->batch_members = NULL;
+  priv->plain_members = NULL;
 }
 
 static void
@@ -838,6 +1486,15 @@ inf_adopted_session_constructed(GObject* object)
     session
   );
 
+  g_signal_connect(
+    G_OBJECT(session),
+    "notify::subscription-group",
+    G_CALLBACK(inf_adopted_session_notify_subscription_group_cb),
+    NULL
+  );
+
+  inf_adopted_session_track_member_group(session);
+
   switch(status)
   {
   case INF_SESSION_PRESYNC:
@@ -872,7 +1529,6 @@ inf_adopted_session_dispose(GObject* object)
   InfAdoptedSession* session;
   InfAdoptedSessionPrivate* priv;
   InfUserTable* user_table;
-  guint i;
 
   session = INF_ADOPTED_SESSION(object);
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
@@ -903,11 +1559,21 @@ inf_adopted_session_dispose(GObject* object)
 
   g_assert(priv->local_users == NULL);
 
+  /* Pending requests have been sent or dropped on close */
+  g_assert(priv->batch == NULL);
+  g_assert(priv->batch_timeout == NULL);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(inf_adopted_session_notify_subscription_group_cb),
+    NULL
+  );
+
+  inf_adopted_session_release_member_group(session);
+
   if(priv->request_buffer != NULL)
   {
-    for(i = 0; i < priv->request_buffer->len; ++i)
-      g_object_unref(g_ptr_array_index(priv->request_buffer, i));
-    g_ptr_array_free(priv->request_buffer, TRUE);
+    g_hash_table_destroy(priv->request_buffer);
     priv->request_buffer = NULL;
   }
 
@@ -966,6 +1632,20 @@ inf_adopted_session_set_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     priv->max_total_log_size = g_value_get_uint(value);
     break;
+  case PROP_REQUEST_BATCH_INTERVAL:
+    priv->batch_interval = g_value_get_uint(value);
+    if(priv->batch_interval == 0)
+      inf_adopted_session_flush_batch(session);
+    if(priv->member_group != NULL)
+      inf_adopted_session_announce_batching(session, NULL);
+    break;
+  case PROP_REQUEST_BATCH_SIZE:
+    priv->batch_size = g_value_get_uint(value);
+    if(priv->batch_count >= priv->batch_size)
+      inf_adopted_session_flush_batch(session);
+    if(priv->member_group != NULL)
+      inf_adopted_session_announce_batching(session, NULL);
+    break;
   case PROP_ALGORITHM:
     /* read only */
   default:
@@ -994,6 +1674,12 @@ inf_adopted_session_get_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     g_value_set_uint(value, priv->max_total_log_size);
     break;
+  case PROP_REQUEST_BATCH_INTERVAL:
+    g_value_set_uint(value, priv->batch_interval);
+    break;
+  case PROP_REQUEST_BATCH_SIZE:
+    g_value_set_uint(value, priv->batch_size);
+    break;
   case PROP_ALGORITHM:
     g_value_set_object(value, G_OBJECT(priv->algorithm));
     break;
@@ -1044,6 +1730,102 @@ inf_adopted_session_to_xml_sync_foreach_user_func(InfUser* user,
   }
 }
 
+static void
+inf_adopted_session_can_resume_foreach_component_func(guint id,
+                                                      guint value,
+                                                      gpointer user_data)
+{
+  InfAdoptedSessionResumeForeachData* data;
+  InfUserTable* user_table;
+
+  data = (InfAdoptedSessionResumeForeachData*)user_data;
+  user_table = inf_session_get_user_table(INF_SESSION(data->session));
+
+  if(inf_user_table_lookup_user_by_id(user_table, id) == NULL)
+    data->result = FALSE;
+}
+
+static void
+inf_adopted_session_can_resume_foreach_user_func(InfUser* user,
+                                                 gpointer user_data)
+{
+  InfAdoptedSessionResumeForeachData* data;
+  InfAdoptedRequestLog* log;
+  guint n;
+
+  g_assert(INF_ADOPTED_IS_USER(user));
+
+  data = (InfAdoptedSessionResumeForeachData*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  n = inf_adopted_state_vector_get(data->vector, inf_user_get_id(user));
+
+  if(n < inf_adopted_request_log_get_begin(log) ||
+     n > inf_adopted_request_log_get_end(log))
+  {
+    data->result = FALSE;
+  }
+}
+
+static void
+inf_adopted_session_resume_to_foreach_user_func(InfUser* user,
+                                                gpointer user_data)
+{
+  InfAdoptedSessionResumeForeachData* data;
+  xmlNodePtr xml;
+
+  data = (InfAdoptedSessionResumeForeachData*)user_data;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)data->name);
+  inf_session_user_to_xml(INF_SESSION(data->session), user, xml);
+
+  inf_communication_group_send_message(data->group, data->connection, xml);
+}
+
+/* Sends the requests of user that are causally ready with respect to
+ * data->vector, which is the state the remote side will be in after having
+ * processed all requests sent so far. */
+static void
+inf_adopted_session_resume_to_foreach_request_func(InfUser* user,
+                                                   gpointer user_data)
+{
+  InfAdoptedSessionResumeForeachData* data;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  guint user_id;
+  guint i;
+  guint end;
+  xmlNodePtr xml;
+
+  g_assert(INF_ADOPTED_IS_USER(user));
+
+  data = (InfAdoptedSessionResumeForeachData*)user_data;
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(data->session);
+  g_assert(session_class->request_to_xml != NULL);
+
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  end = inf_adopted_request_log_get_end(log);
+  user_id = inf_user_get_id(user);
+
+  for(i = inf_adopted_state_vector_get(data->vector, user_id); i < end; ++ i)
+  {
+    request = inf_adopted_request_log_get_request(log, i);
+
+    if(!inf_adopted_state_vector_causally_before(
+         inf_adopted_request_get_vector(request), data->vector))
+    {
+      break;
+    }
+
+    xml = xmlNewNode(NULL, (const xmlChar*)"resume-request");
+    session_class->request_to_xml(data->session, xml, request, NULL, TRUE);
+    inf_communication_group_send_message(data->group, data->connection, xml);
+
+    inf_adopted_state_vector_add(data->vector, user_id, 1);
+    data->result = TRUE;
+  }
+}
+
 static void
 inf_adopted_session_to_xml_sync(InfSession* session,
                                 xmlNodePtr parent)
@@ -1103,21 +1885,476 @@ inf_adopted_session_process_xml_sync(InfSession* session,
       )
     );
 
-    log = inf_adopted_user_get_request_log(user);
-    if(inf_adopted_session_validate_request(log, request, error) == FALSE)
-    {
-      g_object_unref(request);
-      return FALSE;
-    }
+    log = inf_adopted_user_get_request_log(user);
+    if(inf_adopted_session_validate_request(log, request, error) == FALSE)
+    {
+      g_object_unref(request);
+      return FALSE;
+    }
+
+    inf_adopted_request_log_add_request(log, request);
+    g_object_unref(request);
+
+    return TRUE;
+  }
+
+  parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
+  return parent_class->process_xml_sync(session, connection, xml, error);
+}
+
+/* Processes a single <request> message, either standalone or as part of a
+ * <request-batch>. Cleanup of the algorithm is left to the caller, so that
+ * it only needs to be done once per batch. */
+static InfCommunicationScope
+inf_adopted_session_process_request_xml(InfAdoptedSession* session,
+                                        InfXmlConnection* connection,
+                                        xmlNodePtr xml,
+                                        GError** error)
+{
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  InfAdoptedUser* user;
+  guint user_id;
+
+  InfAdoptedStateVector* user_vector;
+  InfAdoptedStateVector* request_vector;
+
+  gboolean has_num;
+  gboolean process_request;
+  guint num;
+  GError* local_error;
+  InfAdoptedRequest* copy_req;
+  guint i;
+
+  gchar* request_str;
+  gchar* user_str;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->xml_to_request != NULL);
+
+  user = inf_adopted_session_user_from_request_xml(session, xml, error);
+
+  if(user == NULL)
+    return INF_COMMUNICATION_SCOPE_PTP;
+
+  if(inf_user_get_status(INF_USER(user)) == INF_USER_UNAVAILABLE ||
+     inf_user_get_connection(INF_USER(user)) != connection)
+  {
+    g_set_error_literal(
+      error,
+      inf_user_error_quark(),
+      INF_USER_ERROR_NOT_JOINED,
+      _("User did not join from this connection")
+    );
+
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+
+  local_error = NULL;
+  has_num = inf_xml_util_get_attribute_uint(xml, "num", &num, &local_error);
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+
+  if(has_num == FALSE)
+    num = 1;
+
+  user_id = inf_user_get_id(INF_USER(user));
+  user_vector = inf_adopted_user_get_vector(user);
+
+  request = session_class->xml_to_request(
+    session,
+    xml,
+    user_vector,
+    FALSE,
+    error
+  );
+
+  if(request == NULL)
+    return INF_COMMUNICATION_SCOPE_PTP;
+
+  request_vector = inf_adopted_request_get_vector(request);
+
+  if(!inf_adopted_state_vector_causally_before(user_vector, request_vector))
+  {
+    /* Note that this can actually not happen, since the request time is
+     * transferred as a diff to the previous user time. If the absolute
+     * time were transmitted this would need to be handled as an error. */
+    g_assert_not_reached();
+  }
+  else if(inf_adopted_request_get_index(request) !=
+          inf_adopted_state_vector_get(user_vector, user_id))
+  {
+    request_str = inf_adopted_state_vector_to_string(request_vector);
+    user_str = inf_adopted_state_vector_to_string(user_vector);
+
+    g_set_error(
+      error,
+      inf_adopted_session_error_quark,
+      INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
+      _("Request \"%s\" by user \"%s\" is not consecutive with respect to "
+        "previously received request \"%s\""),
+      request_str,
+      inf_user_get_name(INF_USER(user)),
+      user_str
+    );
+
+    g_free(request_str);
+    g_free(user_str);
+    g_object_unref(request);
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+
+  /* Update the user vector to the state of the request. */
+  user_vector = inf_adopted_state_vector_copy(request_vector);
+  /* Note that this function takes ownership of user_vector */
+  inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
+
+  /* Apply the request more than once if num >= 2 is given. This is mostly
+   * used for multiple undos and redos, but is in general allowed for any
+   * request. */
+  for(i = 0; i < num; ++i)
+  {
+    if(i == 0)
+    {
+      copy_req = request;
+      g_object_ref(copy_req);
+    }
+    else
+    {
+      copy_req = inf_adopted_request_copy(request);
+
+      /* TODO: This is a bit of a hack since requests are normally
+       * immutable. It avoids an additional vector copy here though. */
+      inf_adopted_state_vector_add(
+        inf_adopted_request_get_vector(copy_req),
+        inf_user_get_id(INF_USER(user)),
+        i
+      );
+    }
+
+    process_request = inf_adopted_session_process_request(
+      session,
+      copy_req,
+      user,
+      error
+    );
+
+    g_object_unref(copy_req);
+
+    /* Update the user vector again, including the component of the processed request. */
+    if(inf_adopted_request_affects_buffer(request))
+    {
+      user_vector = inf_adopted_state_vector_copy(
+        inf_adopted_request_get_vector(copy_req)
+      );
+
+      inf_adopted_state_vector_add(user_vector, user_id, 1);
+      /* Note that this function takes ownership of user_vector */
+      inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
+    }
+
+    /* If an error occurred then break here, and do not process the
+     * subsequent requests -- they will likely fail as well. */
+    if(process_request == FALSE)
+      break;
+  }
+
+  g_object_unref(request);
+
+  /* The processed request(s) might have caused some of the buffered
+   * requests to become ready. */
+  if(i > 0)
+  {
+    inf_adopted_session_process_buffered_requests(session);
+  }
+
+  /* Requests can always be forwarded since user is given. Explicitly allow
+   * forwarding if the request could not be applied... maybe others are more
+   * lucky? In the worst case it will just fail for them as well. */
+  return INF_COMMUNICATION_SCOPE_GROUP;
+}
+
+/* Resume messages may only be sent to us by the publisher of the session,
+ * we never accept them from clients. */
+static gboolean
+inf_adopted_session_check_resume(InfAdoptedSession* session,
+                                 InfXmlConnection* connection,
+                                 GError** error)
+{
+  InfCommunicationGroup* group;
+  InfCommunicationJoinedGroup* joined_group;
+
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+  if(INF_COMMUNICATION_IS_JOINED_GROUP(group))
+  {
+    joined_group = INF_COMMUNICATION_JOINED_GROUP(group);
+    if(inf_communication_joined_group_get_publisher(joined_group) ==
+       connection)
+    {
+      return TRUE;
+    }
+  }
+
+  g_set_error_literal(
+    error,
+    inf_adopted_session_error_quark,
+    INF_ADOPTED_SESSION_ERROR_INVALID_RESUME,
+    _("The session can only be resumed by its publisher")
+  );
+
+  return FALSE;
+}
+
+/* Processes a <request-batching> message, with which the publisher tells
+ * us how to batch our requests after we announced that we understand
+ * request batches. */
+static void
+inf_adopted_session_process_request_batching(InfAdoptedSession* session,
+                                             InfXmlConnection* connection,
+                                             xmlNodePtr xml,
+                                             GError** error)
+{
+  InfCommunicationGroup* group;
+  guint interval;
+  guint size;
+
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+  if(!INF_COMMUNICATION_IS_JOINED_GROUP(group) ||
+     inf_communication_joined_group_get_publisher(
+       INF_COMMUNICATION_JOINED_GROUP(group)) != connection)
+  {
+    g_set_error_literal(
+      error,
+      inf_adopted_session_error_quark,
+      INF_ADOPTED_SESSION_ERROR_FAILED,
+      _("Request batching can only be configured by the publisher")
+    );
+
+    return;
+  }
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "interval",
+                                               &interval, error))
+  {
+    return;
+  }
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "size", &size, error))
+    return;
+
+  if(size == 0)
+  {
+    g_set_error_literal(
+      error,
+      inf_adopted_session_error_quark,
+      INF_ADOPTED_SESSION_ERROR_FAILED,
+      _("Request batch size must not be zero")
+    );
+
+    return;
+  }
+
+  g_object_set(
+    G_OBJECT(session),
+    "request-batch-interval", interval,
+    "request-batch-size", size,
+    NULL
+  );
+}
+
+/* Processes a <resume-add-user> or <resume-update-user> message. The former
+ * only adds users we do not know yet, so that the requests which follow can
+ * refer to them. The latter also brings the properties of users we know
+ * already up to date. */
+static gboolean
+inf_adopted_session_process_resume_user(InfAdoptedSession* session,
+                                        InfXmlConnection* connection,
+                                        xmlNodePtr xml,
+                                        gboolean update,
+                                        GError** error)
+{
+  InfSessionClass* session_class;
+  GArray* array;
+  const GParameter* const_param;
+  GParameter* param;
+  InfUser* user;
+  guint id;
+  gboolean available;
+  gboolean result;
+  guint i;
+
+  session_class = INF_SESSION_GET_CLASS(session);
+  array = session_class->get_xml_user_props(
+    INF_SESSION(session),
+    connection,
+    xml
+  );
+
+  const_param = inf_session_lookup_user_property(
+    (const GParameter*)array->data,
+    array->len,
+    "id"
+  );
+
+  if(const_param == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_NO_SUCH_ATTRIBUTE,
+      _("Request does not contain required attribute \"id\"")
+    );
+
+    result = FALSE;
+  }
+  else
+  {
+    id = g_value_get_uint(&const_param->value);
+    user = inf_user_table_lookup_user_by_id(
+      inf_session_get_user_table(INF_SESSION(session)),
+      id
+    );
+
+    const_param = inf_session_lookup_user_property(
+      (const GParameter*)array->data,
+      array->len,
+      "status"
+    );
+
+    available = const_param != NULL &&
+      g_value_get_enum(&const_param->value) != INF_USER_UNAVAILABLE;
+
+    /* Available users are connected through the publisher. Any connection
+     * that unavailable users had before is gone. */
+    param = inf_session_get_user_property(array, "connection");
+    if(!G_IS_VALUE(&param->value))
+    {
+      g_value_init(&param->value, INF_TYPE_XML_CONNECTION);
+      if(available)
+        g_value_set_object(&param->value, G_OBJECT(connection));
+    }
+
+    if(user == NULL)
+    {
+      result = session_class->validate_user_props(
+        INF_SESSION(session),
+        (const GParameter*)array->data,
+        array->len,
+        NULL,
+        error
+      );
+
+      if(result == TRUE)
+      {
+        user = inf_session_add_user(
+          INF_SESSION(session),
+          (const GParameter*)array->data,
+          array->len
+        );
+
+        g_assert(user != NULL);
+      }
+    }
+    else if(update == TRUE &&
+            (inf_user_get_flags(user) & INF_USER_LOCAL) == 0)
+    {
+      /* Users that have been joined by us stay unavailable until they are
+       * rejoined explicitly. */
+      result = session_class->validate_user_props(
+        INF_SESSION(session),
+        (const GParameter*)array->data,
+        array->len,
+        user,
+        error
+      );
+
+      if(result == TRUE)
+      {
+        g_object_freeze_notify(G_OBJECT(user));
+
+        for(i = 0; i < array->len; ++ i)
+        {
+          param = &g_array_index(array, GParameter, i);
+          if(strcmp(param->name, "id") != 0)
+            g_object_set_property(G_OBJECT(user), param->name, &param->value);
+        }
+
+        g_object_thaw_notify(G_OBJECT(user));
+      }
+    }
+    else
+    {
+      result = TRUE;
+    }
+  }
+
+  for(i = 0; i < array->len; ++ i)
+    g_value_unset(&g_array_index(array, GParameter, i).value);
+  g_array_free(array, TRUE);
+
+  return result;
+}
+
+/* Processes a <resume-request> message. These are sent in causal order,
+ * with absolute state vectors, so each of them can be executed as soon as
+ * it arrives. */
+static gboolean
+inf_adopted_session_process_resume_request(InfAdoptedSession* session,
+                                           xmlNodePtr xml,
+                                           GError** error)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  InfAdoptedUser* user;
+  InfAdoptedStateVector* current;
+  InfAdoptedStateVector* vector;
+  guint user_id;
+  gboolean result;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->xml_to_request != NULL);
 
-    inf_adopted_request_log_add_request(log, request);
-    g_object_unref(request);
+  request = session_class->xml_to_request(session, xml, NULL, TRUE, error);
+  if(request == NULL) return FALSE;
+
+  user_id = inf_adopted_request_get_user_id(request);
+  user = INF_ADOPTED_USER(
+    inf_user_table_lookup_user_by_id(
+      inf_session_get_user_table(INF_SESSION(session)),
+      user_id
+    )
+  );
 
+  /* Skip requests which we had received before the connection was lost */
+  current = inf_adopted_algorithm_get_current(priv->algorithm);
+  if(inf_adopted_request_get_index(request) <
+     inf_adopted_state_vector_get(current, user_id))
+  {
+    g_object_unref(request);
     return TRUE;
   }
 
-  parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
-  return parent_class->process_xml_sync(session, connection, xml, error);
+  vector = inf_adopted_request_get_vector(request);
+  inf_adopted_user_set_vector(user, inf_adopted_state_vector_copy(vector));
+
+  result = inf_adopted_session_process_request(session, request, user, error);
+
+  /* Requests from a request log always affect the buffer */
+  vector = inf_adopted_state_vector_copy(vector);
+  inf_adopted_state_vector_add(vector, user_id, 1);
+  inf_adopted_user_set_vector(user, vector);
+
+  g_object_unref(request);
+
+  if(result == TRUE)
+    inf_adopted_session_process_buffered_requests(session);
+
+  return result;
 }
 
 static InfCommunicationScope
@@ -1127,188 +2364,157 @@ inf_adopted_session_process_xml_run(InfSession* session,
                                     GError** error)
 {
   InfAdoptedSessionPrivate* priv;
-  InfAdoptedSessionClass* session_class;
-  InfAdoptedRequest* request;
-  InfAdoptedUser* user;
-  guint user_id;
-
-  InfAdoptedStateVector* user_vector;
-  InfAdoptedStateVector* request_vector;
-
-  gboolean has_num;
-  gboolean process_request;
-  guint num;
+  InfCommunicationScope scope;
+  InfCommunicationScope child_scope;
+  xmlNodePtr child;
   GError* local_error;
-  InfAdoptedRequest* copy_req;
-  guint i;
-
-  gchar* request_str;
-  gchar* user_str;
-
   InfSessionClass* parent_class;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
   if(strcmp((const char*)xml->name, "request") == 0)
   {
-    session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
-    g_assert(session_class->xml_to_request != NULL);
-
-    user = inf_adopted_session_user_from_request_xml(
+    scope = inf_adopted_session_process_request_xml(
       INF_ADOPTED_SESSION(session),
+      connection,
       xml,
       error
     );
 
-    if(user == NULL)
-      return INF_COMMUNICATION_SCOPE_PTP;
+    /* Cleanup requests that are no longer used after
+     * having processed everything */
+    inf_adopted_algorithm_cleanup(
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
+    );
+
+    return scope;
+  }
+  else if(strcmp((const char*)xml->name, "request-batch") == 0)
+  {
+    scope = INF_COMMUNICATION_SCOPE_PTP;
+    local_error = NULL;
 
-    if(inf_user_get_status(INF_USER(user)) == INF_USER_UNAVAILABLE ||
-       inf_user_get_connection(INF_USER(user)) != connection)
+    for(child = xml->children; child != NULL; child = child->next)
     {
-      g_set_error_literal(
-        error,
-        inf_user_error_quark(),
-        INF_USER_ERROR_NOT_JOINED,
-        _("User did not join from this connection")
+      if(child->type != XML_ELEMENT_NODE)
+        continue;
+
+      if(strcmp((const char*)child->name, "request") != 0)
+      {
+        g_set_error(
+          &local_error,
+          inf_adopted_session_error_quark,
+          INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
+          _("Unexpected element \"%s\" in request batch"),
+          (const gchar*)child->name
+        );
+
+        break;
+      }
+
+      child_scope = inf_adopted_session_process_request_xml(
+        INF_ADOPTED_SESSION(session),
+        connection,
+        child,
+        &local_error
       );
 
-      return INF_COMMUNICATION_SCOPE_PTP;
+      /* Forward the batch if at least one of its requests has been
+       * processed, others need to see that one as well. */
+      if(child_scope == INF_COMMUNICATION_SCOPE_GROUP)
+        scope = INF_COMMUNICATION_SCOPE_GROUP;
+
+      /* The following requests are relative to this one, so they cannot be
+       * processed if this one failed. */
+      if(local_error != NULL)
+        break;
     }
 
-    local_error = NULL;
-    has_num = inf_xml_util_get_attribute_uint(xml, "num", &num, &local_error);
-    if(local_error != NULL)
+    inf_adopted_algorithm_cleanup(
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
+    );
+
+    /* Not all members understand batches, so relay it ourselves */
+    if(scope == INF_COMMUNICATION_SCOPE_GROUP && priv->plain_members != NULL)
     {
-      g_propagate_error(error, local_error);
-      return INF_COMMUNICATION_SCOPE_PTP;
-    }
+      inf_adopted_session_send_batch(
+        INF_ADOPTED_SESSION(session),
+        xmlCopyNode(xml, 1),
+        connection
+      );
 
-    if(has_num == FALSE)
-      num = 1;
+      scope = INF_COMMUNICATION_SCOPE_PTP;
+    }
 
-    user_id = inf_user_get_id(INF_USER(user));
-    user_vector = inf_adopted_user_get_vector(user);
+    if(local_error != NULL)
+      g_propagate_error(error, local_error);
 
-    request = session_class->xml_to_request(
+    return scope;
+  }
+  else if(strcmp((const char*)xml->name, "request-batching") == 0)
+  {
+    inf_adopted_session_process_request_batching(
       INF_ADOPTED_SESSION(session),
+      connection,
       xml,
-      user_vector,
-      FALSE,
       error
     );
 
-    if(request == NULL)
-      return INF_COMMUNICATION_SCOPE_PTP;
-
-    request_vector = inf_adopted_request_get_vector(request);
-
-    if(!inf_adopted_state_vector_causally_before(user_vector, request_vector))
-    {
-      /* Note that this can actually not happen, since the request time is
-       * transferred as a diff to the previous user time. If the absolute
-       * time were transmitted this would need to be handled as an error. */
-      g_assert_not_reached();
-    }
-    else if(inf_adopted_request_get_index(request) !=
-            inf_adopted_state_vector_get(user_vector, user_id))
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+  else if(strcmp((const char*)xml->name, "resume-add-user") == 0)
+  {
+    if(inf_adopted_session_check_resume(INF_ADOPTED_SESSION(session),
+                                        connection, error))
     {
-      request_str = inf_adopted_state_vector_to_string(request_vector);
-      user_str = inf_adopted_state_vector_to_string(user_vector);
-
-      g_set_error(
-        error,
-        inf_adopted_session_error_quark,
-        INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
-        _("Request \"%s\" by user \"%s\" is not consecutive with respect to "
-          "previously received request \"%s\""),
-        request_str,
-        inf_user_get_name(INF_USER(user)),
-        user_str
+      inf_adopted_session_process_resume_user(
+        INF_ADOPTED_SESSION(session),
+        connection,
+        xml,
+        FALSE,
+        error
       );
-
-      g_free(request_str);
-      g_free(user_str);
-      g_object_unref(request);
-      return INF_COMMUNICATION_SCOPE_PTP;
     }
 
-    /* Update the user vector to the state of the request. */
-    user_vector = inf_adopted_state_vector_copy(request_vector);
-    /* Note that this function takes ownership of user_vector */
-    inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
-
-    /* Apply the request more than once if num >= 2 is given. This is mostly
-     * used for multiple undos and redos, but is in general allowed for any
-     * request. */
-    for(i = 0; i < num; ++i)
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+  else if(strcmp((const char*)xml->name, "resume-request") == 0)
+  {
+    /* No cleanup here: The users are still unavailable while the requests
+     * are resumed, and so they do not take part in determining which
+     * requests are no longer needed. This happens once their state is
+     * updated with <resume-update-user>. */
+    if(inf_adopted_session_check_resume(INF_ADOPTED_SESSION(session),
+                                        connection, error))
     {
-      if(i == 0)
-      {
-        copy_req = request;
-        g_object_ref(copy_req);
-      }
-      else
-      {
-        copy_req = inf_adopted_request_copy(request);
-
-        /* TODO: This is a bit of a hack since requests are normally
-         * immutable. It avoids an additional vector copy here though. */
-        inf_adopted_state_vector_add(
-          inf_adopted_request_get_vector(copy_req),
-          inf_user_get_id(INF_USER(user)),
-          i
-        );
-      }
-
-      process_request = inf_adopted_session_process_request(
+      inf_adopted_session_process_resume_request(
         INF_ADOPTED_SESSION(session),
-        copy_req,
-        user,
+        xml,
         error
       );
-
-      g_object_unref(copy_req);
-
-      /* Update the user vector again, including the component of the processed request. */
-      if(inf_adopted_request_affects_buffer(request))
-      {
-        user_vector = inf_adopted_state_vector_copy(
-          inf_adopted_request_get_vector(copy_req)
-        );
-
-        inf_adopted_state_vector_add(user_vector, user_id, 1);
-        /* Note that this function takes ownership of user_vector */
-        inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
-      }
-
-      /* If an error occurred then break here, and do not process the
-       * subsequent requests -- they will likely fail as well. */
-      if(process_request == FALSE)
-        break;
     }
 
-    g_object_unref(request);
-
-    /* The processed request(s) might have caused some of the buffered
-     * requests to become ready. */
-    if(i > 0)
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+  else if(strcmp((const char*)xml->name, "resume-update-user") == 0)
+  {
+    if(inf_adopted_session_check_resume(INF_ADOPTED_SESSION(session),
+                                        connection, error))
     {
-      inf_adopted_session_process_buffered_requests(
-        INF_ADOPTED_SESSION(session)
+      inf_adopted_session_process_resume_user(
+        INF_ADOPTED_SESSION(session),
+        connection,
+        xml,
+        TRUE,
+        error
       );
-    }
 
-    /* Cleanup requests that are no longer used after
-     * having processed everything */
-    inf_adopted_algorithm_cleanup(
-      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
-    );
+      inf_adopted_algorithm_cleanup(
+        inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
+      );
+    }
 
-    /* Requests can always be forwarded since user is given. Explicitly allow
-     * forwarding if the request could not be applied... maybe others are more
-     * lucky? In the worst case it will just fail for them as well. */
-    return INF_COMMUNICATION_SCOPE_GROUP;
+    return INF_COMMUNICATION_SCOPE_PTP;
   }
 
   parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
@@ -1451,6 +2657,10 @@ inf_adopted_session_close(InfSession* session)
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
+  /* Normally inf_session_close() flushed already, but the subscription group
+   * might be gone by now, in which case this drops pending requests. */
+  inf_adopted_session_flush_batch(INF_ADOPTED_SESSION(session));
+
   /* Local user info is no longer required */
   for(item = priv->local_users; item != NULL; item = g_slist_next(item))
   {
@@ -1465,6 +2675,45 @@ inf_adopted_session_close(InfSession* session)
   INF_SESSION_CLASS(inf_adopted_session_parent_class)->close(session);
 }
 
+static void
+inf_adopted_session_flush(InfSession* session)
+{
+  inf_adopted_session_flush_batch(INF_ADOPTED_SESSION(session));
+}
+
+static void
+inf_adopted_session_get_memory_usage_foreach_user_func(InfUser* user,
+                                                       gpointer data)
+{
+  InfAdoptedRequestLog* log;
+  gsize* usage;
+
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  usage = (gsize*)data;
+
+  *usage += INF_ADOPTED_SESSION_REQUEST_SIZE *
+    (inf_adopted_request_log_get_end(log) -
+     inf_adopted_request_log_get_begin(log));
+}
+
+static gsize
+inf_adopted_session_get_memory_usage(InfSession* session)
+{
+  InfSessionClass* parent_class;
+  gsize usage;
+
+  parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
+  usage = parent_class->get_memory_usage(session);
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(session),
+    inf_adopted_session_get_memory_usage_foreach_user_func,
+    &usage
+  );
+
+  return usage;
+}
+
 static void
 inf_adopted_session_synchronization_complete_foreach_user_func(InfUser* user,
                                                                gpointer data)
@@ -1514,6 +2763,16 @@ inf_adopted_session_synchronization_complete(InfSession* session,
     /* Create adOPTed algorithm upon successful synchronization */
     g_assert(priv->algorithm == NULL);
     inf_adopted_session_create_algorithm(INF_ADOPTED_SESSION(session));
+
+    /* Members which subscribed while the session was synchronized to us
+     * have not been told how to batch yet */
+    if(priv->member_group != NULL && priv->batch_interval > 0)
+    {
+      inf_adopted_session_announce_batching(
+        INF_ADOPTED_SESSION(session),
+        NULL
+      );
+    }
   }
 
   g_object_thaw_notify(G_OBJECT(session));
@@ -1555,8 +2814,11 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
   session_class->validate_user_props =
     inf_adopted_session_validate_user_props;
 
+  session_class->flush = inf_adopted_session_flush;
+  session_class->get_memory_usage = inf_adopted_session_get_memory_usage;
+
   session_class->close = inf_adopted_session_close;
-  
+
   session_class->synchronization_complete =
     inf_adopted_session_synchronization_complete;
 
@@ -1623,6 +2885,36 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_REQUEST_BATCH_INTERVAL,
+    g_param_spec_uint(
+      "request-batch-interval",
+      "Request batch interval",
+      "The maximum time in milliseconds for which local requests are held "
+      "back to be sent together with following ones, or 0 to send every "
+      "request immediately",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_REQUEST_BATCH_SIZE,
+    g_param_spec_uint(
+      "request-batch-size",
+      "Request batch size",
+      "The maximum number of requests to send in a single message",
+      1,
+      G_MAXUINT,
+      32,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_ALGORITHM,
@@ -1941,4 +3233,170 @@ inf_adopted_session_write_request_info(InfAdoptedSession* session,
     xmlAddChild(xml, operation);
 }
 
+/**
+ * inf_adopted_session_can_resume:
+ * @session: A #InfAdoptedSession with status %INF_SESSION_RUNNING.
+ * @vector: The state in which a remote copy of @session is.
+ *
+ * Returns whether a remote copy of @session which has executed all requests
+ * up to @vector, but none after it, can be brought up to date with
+ * inf_adopted_session_resume_to() instead of synchronizing the whole
+ * session again. This is the case if all users in @vector exist in
+ * @session and the request logs still contain all requests that have been
+ * executed since @vector.
+ *
+ * Returns: %TRUE if the session can be resumed from @vector, or %FALSE
+ * otherwise.
+ */
+gboolean
+inf_adopted_session_can_resume(InfAdoptedSession* session,
+                               InfAdoptedStateVector* vector)
+{
+  InfAdoptedSessionResumeForeachData data;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION(session), FALSE);
+  g_return_val_if_fail(vector != NULL, FALSE);
+
+  if(inf_session_get_status(INF_SESSION(session)) != INF_SESSION_RUNNING)
+    return FALSE;
+
+  data.session = session;
+  data.vector = vector;
+  data.result = TRUE;
+
+  inf_adopted_state_vector_foreach(
+    vector,
+    inf_adopted_session_can_resume_foreach_component_func,
+    &data
+  );
+
+  if(data.result == TRUE)
+  {
+    inf_user_table_foreach_user(
+      inf_session_get_user_table(INF_SESSION(session)),
+      inf_adopted_session_can_resume_foreach_user_func,
+      &data
+    );
+  }
+
+  return data.result;
+}
+
+/**
+ * inf_adopted_session_resume_to:
+ * @session: A #InfAdoptedSession with status %INF_SESSION_RUNNING.
+ * @group: A #InfCommunicationGroup containing @connection.
+ * @connection: A #InfXmlConnection whose copy of @session is in state
+ * @vector.
+ * @vector: The state in which the copy of @session at @connection is.
+ *
+ * Brings the copy of @session at @connection up to date by sending it all
+ * users of @session and all requests that have been executed since
+ * @vector, in an order in which they can be executed on arrival. The
+ * caller needs to make sure that inf_adopted_session_can_resume() returns
+ * %TRUE for @vector. This is not checked again here, since it needs to look
+ * at the request logs of all users.
+ *
+ * Requests held back for batching need to be sent with inf_session_flush()
+ * before @connection is added to @group, otherwise @connection receives
+ * them twice.
+ */
+void
+inf_adopted_session_resume_to(InfAdoptedSession* session,
+                              InfCommunicationGroup* group,
+                              InfXmlConnection* connection,
+                              InfAdoptedStateVector* vector)
+{
+  InfAdoptedSessionResumeForeachData data;
+  InfUserTable* user_table;
+
+  g_return_if_fail(INF_ADOPTED_IS_SESSION(session));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(vector != NULL);
+
+  g_return_if_fail(
+    inf_session_get_status(INF_SESSION(session)) == INF_SESSION_RUNNING
+  );
+
+  user_table = inf_session_get_user_table(INF_SESSION(session));
+
+  data.session = session;
+  data.group = group;
+  data.connection = connection;
+
+  /* Users first, so that the requests can refer to users which joined
+   * while the remote side was not connected. */
+  data.name = "resume-add-user";
+  inf_user_table_foreach_user(
+    user_table,
+    inf_adopted_session_resume_to_foreach_user_func,
+    &data
+  );
+
+  data.vector = inf_adopted_state_vector_copy(vector);
+
+  do
+  {
+    data.result = FALSE;
+
+    inf_user_table_foreach_user(
+      user_table,
+      inf_adopted_session_resume_to_foreach_request_func,
+      &data
+    );
+  } while(data.result == TRUE);
+
+  inf_adopted_state_vector_free(data.vector);
+
+  /* Finally the users' current state, including their vector time */
+  data.name = "resume-update-user";
+  inf_user_table_foreach_user(
+    user_table,
+    inf_adopted_session_resume_to_foreach_user_func,
+    &data
+  );
+}
+
+/**
+ * inf_adopted_session_add_batching_connection:
+ * @session: A #InfAdoptedSession.
+ * @connection: A member of the subscription group of @session.
+ *
+ * Lets @session send &lt;request-batch&gt; messages to @connection, and
+ * tells @connection to batch its own requests according to the
+ * #InfAdoptedSession:request-batch-interval and
+ * #InfAdoptedSession:request-batch-size properties. This should only be
+ * called for connections which announced that they understand request
+ * batches. All other members of the subscription group receive the
+ * requests of a batch one by one.
+ *
+ * @session needs to be the publisher of its subscription group, that is
+ * the group needs to be a #InfCommunicationHostedGroup.
+ * When @connection leaves the group, it is forgotten and needs to be added
+ * again if it subscribes again.
+ */
+void
+inf_adopted_session_add_batching_connection(InfAdoptedSession* session,
+                                            InfXmlConnection* connection)
+{
+  InfAdoptedSessionPrivate* priv;
+  GSList* item;
+
+  g_return_if_fail(INF_ADOPTED_IS_SESSION(session));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_return_if_fail(priv->member_group != NULL);
+
+  item = g_slist_find(priv->plain_members, connection);
+  g_return_if_fail(item != NULL);
+
+  priv->plain_members = g_slist_remove_link(priv->plain_members, item);
+  priv->batch_members = g_slist_concat(item, priv->batch_members);
+
+  if(priv->batch_interval > 0)
+    inf_adopted_session_announce_batching(session, connection);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -51,6 +51,8 @@ typedef struct _InfAdoptedSessionClass InfAdoptedSessionClass;
  * or Redo request without a request to Undo or Redo, respectively.
  * @INF_ADOPTED_SESSION_ERROR_MISSING_STATE_VECTOR: A synchronized user does
  * not contain that the state that user currently is in.
+ * @INF_ADOPTED_SESSION_ERROR_INVALID_RESUME: A message to resume the session
+ * was not received from the publisher of the session.
  * @INF_ADOPTED_SESSION_ERROR_FAILED: No further specified error code.
  *
  * Error codes for #InfAdoptedSession. These only occur when invalid requests
@@ -62,7 +64,8 @@ typedef enum _InfAdoptedSessionError {
   INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
 
   INF_ADOPTED_SESSION_ERROR_MISSING_STATE_VECTOR,
-  
+  INF_ADOPTED_SESSION_ERROR_INVALID_RESUME,
+
   INF_ADOPTED_SESSION_ERROR_FAILED
 } InfAdoptedSessionError;
 
@@ -156,6 +159,20 @@ inf_adopted_session_write_request_info(InfAdoptedSession* session,
                                        xmlNodePtr xml,
                                        xmlNodePtr operation);
 
+gboolean
+inf_adopted_session_can_resume(InfAdoptedSession* session,
+                               InfAdoptedStateVector* vector);
+
+void
+inf_adopted_session_resume_to(InfAdoptedSession* session,
+                              InfCommunicationGroup* group,
+                              InfXmlConnection* connection,
+                              InfAdoptedStateVector* vector);
+
+void
+inf_adopted_session_add_batching_connection(InfAdoptedSession* session,
+                                            InfXmlConnection* connection);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_SESSION_H__ */
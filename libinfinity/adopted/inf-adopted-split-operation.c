@@ -229,6 +229,23 @@ inf_adopted_split_operation_class_init(
   );
 }
 
+/* Creates a new split operation without going through the GObject property
+ * machinery, taking ownership of @first and @second. */
+static InfAdoptedOperation*
+inf_adopted_split_operation_new_take(InfAdoptedOperation* first,
+                                     InfAdoptedOperation* second)
+{
+  GObject* object;
+  InfAdoptedSplitOperationPrivate* priv;
+
+  object = g_object_new(INF_ADOPTED_TYPE_SPLIT_OPERATION, NULL);
+  priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(object);
+
+  priv->first = first;
+  priv->second = second;
+  return INF_ADOPTED_OPERATION(object);
+}
+
 static gboolean
 inf_adopted_split_operation_need_concurrency_id(InfAdoptedOperation* op,
                                                 InfAdoptedOperation* against)
@@ -276,8 +293,7 @@ inf_adopted_split_operation_transform(InfAdoptedOperation* operation,
   InfAdoptedOperation* new_first;
   InfAdoptedOperation* new_against;
   InfAdoptedOperation* new_second;
-  InfAdoptedOperation* result;
-  
+
   InfAdoptedSplitOperationPrivate* priv_lcs;
   InfAdoptedOperation* first_lcs;
   InfAdoptedOperation* second_lcs;
@@ -351,14 +367,7 @@ inf_adopted_split_operation_transform(InfAdoptedOperation* operation,
    * at this point. Parts of the split operation implementation relies on the
    * fact that a split operation is never un-split during transformation. */
 
-  result = INF_ADOPTED_OPERATION(
-    inf_adopted_split_operation_new(new_first, new_second)
-  );
-
-  g_object_unref(G_OBJECT(new_first));
-  g_object_unref(G_OBJECT(new_second));
-
-  return result;
+  return inf_adopted_split_operation_new_take(new_first, new_second);
 }
 
 static InfAdoptedOperation*
@@ -370,11 +379,9 @@ inf_adopted_split_operation_copy(InfAdoptedOperation* operation)
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
 
-  return INF_ADOPTED_OPERATION(
-    inf_adopted_split_operation_new(
-      inf_adopted_operation_copy(priv->first),
-      inf_adopted_operation_copy(priv->second)
-    )
+  return inf_adopted_split_operation_new_take(
+    inf_adopted_operation_copy(priv->first),
+    inf_adopted_operation_copy(priv->second)
   );
 }
 
@@ -443,7 +450,6 @@ inf_adopted_split_operation_apply_transformed(InfAdoptedOperation* operation,
 
   InfAdoptedOperation* ret_first;
   InfAdoptedOperation* ret_second;
-  InfAdoptedSplitOperation* result;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
@@ -489,15 +495,7 @@ inf_adopted_split_operation_apply_transformed(InfAdoptedOperation* operation,
   else
   {
     /* Otherwise create a new operation */
-    result = inf_adopted_split_operation_new(
-      ret_first,
-      ret_second
-    );
-
-    g_object_unref(ret_first);
-    g_object_unref(ret_second);
-
-    return INF_ADOPTED_OPERATION(result);
+    return inf_adopted_split_operation_new_take(ret_first, ret_second);
   }
 }
 
@@ -509,7 +507,6 @@ inf_adopted_split_operation_revert(InfAdoptedOperation* operation)
 
   InfAdoptedOperation* revert_first;
   InfAdoptedOperation* revert_second;
-  InfAdoptedSplitOperation* result;
 
   split = INF_ADOPTED_SPLIT_OPERATION(operation);
   priv = INF_ADOPTED_SPLIT_OPERATION_PRIVATE(split);
@@ -517,12 +514,7 @@ inf_adopted_split_operation_revert(InfAdoptedOperation* operation)
   revert_first = inf_adopted_operation_revert(priv->first);
   revert_second = inf_adopted_operation_revert(priv->second);
 
-  result = inf_adopted_split_operation_new(revert_second, revert_first);
-
-  g_object_unref(revert_first);
-  g_object_unref(revert_second);
-
-  return INF_ADOPTED_OPERATION(result);
+  return inf_adopted_split_operation_new_take(revert_second, revert_first);
 }
 
 static void
@@ -553,19 +545,15 @@ InfAdoptedSplitOperation*
 inf_adopted_split_operation_new(InfAdoptedOperation* first,
                                 InfAdoptedOperation* second)
 {
-  GObject* object;
-
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(first), NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(second), NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_SPLIT_OPERATION,
-    "first", first,
-    "second", second,
-    NULL
+  return INF_ADOPTED_SPLIT_OPERATION(
+    inf_adopted_split_operation_new_take(
+      INF_ADOPTED_OPERATION(g_object_ref(first)),
+      INF_ADOPTED_OPERATION(g_object_ref(second))
+    )
   );
-
-  return INF_ADOPTED_SPLIT_OPERATION(object);
 }
 
 /**
@@ -56,12 +56,57 @@ struct _InfAdoptedStateVectorForeachData {
   gpointer user_data;
 };
 
+/* Number of components stored within the InfAdoptedStateVector structure
+ * itself. Most sessions only have a few users, so that creating or copying
+ * a state vector usually needs only a single allocation. */
+#define INF_ADOPTED_STATE_VECTOR_INLINE_SIZE 8
+
 struct _InfAdoptedStateVector {
   gsize size;
   gsize max_size;
+  /* Either inline_data or a separately allocated array */
   InfAdoptedStateVectorComponent* data;
+
+  /* The sum of all components, and the sum of the hashes of all non-zero
+   * components. Both are kept up to date on every modification. */
+  guint sum;
+  guint hash;
+
+  InfAdoptedStateVectorComponent
+    inline_data[INF_ADOPTED_STATE_VECTOR_INLINE_SIZE];
 };
 
+static guint
+inf_adopted_state_vector_component_hash(guint id,
+                                        guint n)
+{
+  guint hash;
+
+  /* Components with value 0 are treated like missing components */
+  if(n == 0) return 0;
+
+  hash = id * 0x9e3779b1u + n;
+  hash ^= hash >> 15;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  return hash;
+}
+
+/* Sets comp, which must be a component of vec, to value */
+static void
+inf_adopted_state_vector_set_component(InfAdoptedStateVector* vec,
+                                       InfAdoptedStateVectorComponent* comp,
+                                       guint value)
+{
+  vec->sum = vec->sum - comp->n + value;
+
+  vec->hash = vec->hash -
+    inf_adopted_state_vector_component_hash(comp->id, comp->n) +
+    inf_adopted_state_vector_component_hash(comp->id, value);
+
+  comp->n = value;
+}
+
 static gsize
 inf_adopted_state_vector_find_insert_pos(const InfAdoptedStateVector* vec,
                                          guint id)
@@ -120,9 +165,20 @@ inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
 
   if(vec->max_size <= vec->size)
   {
-    vec->max_size += 5;
-    vec->data = g_realloc(vec->data,
-                vec->max_size * sizeof(InfAdoptedStateVectorComponent));
+    vec->max_size *= 2;
+
+    if(vec->data == vec->inline_data)
+    {
+      vec->data =
+        g_malloc(vec->max_size * sizeof(InfAdoptedStateVectorComponent));
+      memcpy(vec->data, vec->inline_data,
+             vec->size * sizeof(InfAdoptedStateVectorComponent));
+    }
+    else
+    {
+      vec->data = g_realloc(vec->data,
+                  vec->max_size * sizeof(InfAdoptedStateVectorComponent));
+    }
   }
 
   comp = vec->data + insert_pos;
@@ -141,6 +197,9 @@ inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
   comp->id = id;
   comp->n = value;
 
+  vec->sum += value;
+  vec->hash += inf_adopted_state_vector_component_hash(id, value);
+
   return comp;
 }
 
@@ -171,8 +230,10 @@ inf_adopted_state_vector_new(void)
 
   vec = g_slice_new(InfAdoptedStateVector);
   vec->size = 0;
-  vec->max_size = 0;
-  vec->data = NULL;
+  vec->max_size = INF_ADOPTED_STATE_VECTOR_INLINE_SIZE;
+  vec->data = vec->inline_data;
+  vec->sum = 0;
+  vec->hash = 0;
 
   return vec;
 }
@@ -194,20 +255,24 @@ inf_adopted_state_vector_copy(InfAdoptedStateVector* vec)
 
   new_vec = g_slice_new(InfAdoptedStateVector);
   new_vec->size = vec->size;
-  new_vec->max_size = vec->max_size;
+  new_vec->sum = vec->sum;
+  new_vec->hash = vec->hash;
 
-  if(new_vec->max_size == 0)
+  if(vec->size <= INF_ADOPTED_STATE_VECTOR_INLINE_SIZE)
   {
-    new_vec->data = NULL;
+    new_vec->max_size = INF_ADOPTED_STATE_VECTOR_INLINE_SIZE;
+    new_vec->data = new_vec->inline_data;
   }
   else
   {
+    new_vec->max_size = vec->size;
     new_vec->data =
       g_malloc(new_vec->max_size * sizeof(InfAdoptedStateVectorComponent));
-    memcpy(new_vec->data, vec->data,
-           new_vec->size * sizeof(InfAdoptedStateVectorComponent));
   }
 
+  memcpy(new_vec->data, vec->data,
+         new_vec->size * sizeof(InfAdoptedStateVectorComponent));
+
   return new_vec;
 }
 
@@ -223,7 +288,8 @@ inf_adopted_state_vector_free(InfAdoptedStateVector* vec)
 {
   g_return_if_fail(vec != NULL);
 
-  g_free(vec->data);
+  if(vec->data != vec->inline_data)
+    g_free(vec->data);
   g_slice_free(InfAdoptedStateVector, vec);
 }
 
@@ -272,7 +338,7 @@ inf_adopted_state_vector_set(InfAdoptedStateVector* vec,
 
   pos = inf_adopted_state_vector_find_insert_pos(vec, id);
   if(pos < vec->size && vec->data[pos].id == id)
-    vec->data[pos].n = value;
+    inf_adopted_state_vector_set_component(vec, vec->data + pos, value);
   else
     inf_adopted_state_vector_insert(vec, id, value, pos);
 }
@@ -308,7 +374,7 @@ inf_adopted_state_vector_add(InfAdoptedStateVector* vec,
   {
     g_assert(value > 0 || comp->n >= (guint)-value);
 
-    comp->n += value;
+    inf_adopted_state_vector_set_component(vec, comp, comp->n + value);
   }
 }
 
@@ -431,6 +497,51 @@ inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
   }
 }
 
+/**
+ * inf_adopted_state_vector_equal:
+ * @first: A #InfAdoptedStateVector.
+ * @second: Another #InfAdoptedStateVector.
+ *
+ * Returns whether @first and @second are equal, i.e. whether
+ * inf_adopted_state_vector_compare() would return 0. This is faster than
+ * inf_adopted_state_vector_compare() for vectors that differ, since their
+ * hash values can be compared first.
+ *
+ * Returns: %TRUE if @first and @second are equal, %FALSE otherwise.
+ **/
+gboolean
+inf_adopted_state_vector_equal(const InfAdoptedStateVector* first,
+                               const InfAdoptedStateVector* second)
+{
+  g_return_val_if_fail(first != NULL, FALSE);
+  g_return_val_if_fail(second != NULL, FALSE);
+
+  if(first == second)
+    return TRUE;
+  if(first->hash != second->hash || first->sum != second->sum)
+    return FALSE;
+
+  return inf_adopted_state_vector_compare(first, second) == 0;
+}
+
+/**
+ * inf_adopted_state_vector_hash:
+ * @vec: A #InfAdoptedStateVector.
+ *
+ * Returns a hash value for @vec. Vectors that are equal according to
+ * inf_adopted_state_vector_equal() have the same hash value. The hash value
+ * is updated on every modification of @vec, so this function runs in
+ * constant time.
+ *
+ * Returns: A hash value for @vec.
+ **/
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec)
+{
+  g_return_val_if_fail(vec != NULL, 0);
+  return vec->hash;
+}
+
 /**
  * inf_adopted_state_vector_causally_before:
  * @first: A #InfAdoptedStateVector.
@@ -447,53 +558,38 @@ gboolean
 inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
                                          const InfAdoptedStateVector* second)
 {
-  gsize first_pos;
-  gsize second_pos;
-  InfAdoptedStateVectorComponent* first_comp;
-  InfAdoptedStateVectorComponent* second_comp;
+  const InfAdoptedStateVectorComponent* first_comp;
+  const InfAdoptedStateVectorComponent* first_end;
+  const InfAdoptedStateVectorComponent* second_comp;
+  const InfAdoptedStateVectorComponent* second_end;
 
   g_return_val_if_fail(first != NULL, FALSE);
   g_return_val_if_fail(second != NULL, FALSE);
 
-  first_pos = 0;
-  second_pos = 0;
+  /* If every component of first is less or equal than the corresponding
+   * one in second, then so is the sum. */
+  if(first->sum > second->sum)
+    return FALSE;
+
+  first_end = first->data + first->size;
+  second_comp = second->data;
+  second_end = second->data + second->size;
 
-  while(first_pos < first->size)
+  for(first_comp = first->data; first_comp != first_end; ++first_comp)
   {
-    first_comp = first->data + first_pos++;
+    /* 0 <= everything */
+    if(first_comp->n == 0)
+      continue;
 
-    if(second_pos == second->size)
-    {
-      /* That component is not contained in second (thus 0) */
-      if(first_comp->n > 0)
-        return FALSE;
-    }
-    else
-    {
-      second_comp = second->data + second_pos;
-      while(second_comp != NULL && first_comp->id > second_comp->id)
-      {
-        ++second_pos;
-        if(second_pos != second->size)
-          second_comp = second->data + second_pos;
-        else
-          second_comp = NULL;
-      }
+    while(second_comp != second_end && second_comp->id < first_comp->id)
+      ++second_comp;
 
-      if(second_comp == NULL || first_comp->id < second_comp->id)
-      {
-        /* That component is not contained in second (thus 0) */
-        if(first_comp->n > 0)
-          return FALSE;
-        else
-          /* 0 <= 0 */
-          continue;
-      }
+    /* That component is not contained in second (thus 0) */
+    if(second_comp == second_end || second_comp->id != first_comp->id)
+      return FALSE;
 
-      g_assert(first_comp->id == second_comp->id);
-      if(first_comp->n > second_comp->n)
-        return FALSE;
-    }
+    if(first_comp->n > second_comp->n)
+      return FALSE;
   }
 
   return TRUE;
@@ -536,6 +632,9 @@ inf_adopted_state_vector_causally_before_inc(
   g_return_val_if_fail(first != NULL, FALSE);
   g_return_val_if_fail(second != NULL, FALSE);
 
+  if(first->sum + 1 > second->sum)
+    return FALSE;
+
   first_pos = 0;
   second_pos = 0;
   inc_comp.id = inc_component;
@@ -626,7 +725,8 @@ inf_adopted_state_vector_causally_before_inc(
  *
  * This function returns the sum of the differences between each component
  * of @first and @second. This function can only be called if
- * inf_adopted_state_vector_causally_before() returns %TRUE.
+ * inf_adopted_state_vector_causally_before() returns %TRUE. Apart from
+ * checking that precondition, it runs in constant time.
  *
  * Returns: The sum of the differences between each component of @first and
  * @second.
@@ -635,25 +735,13 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second)
 {
-  gsize n;
-  guint first_sum;
-  guint second_sum;
-
   g_return_val_if_fail(
     inf_adopted_state_vector_causally_before(first, second) == TRUE,
     0
   );
 
-  first_sum = 0;
-  second_sum = 0;
-
-  for(n = 0; n < first->size; ++ n)
-    first_sum += first->data[n].n;
-  for(n = 0; n < second->size; ++ n)
-    second_sum += second->data[n].n;
-
-  g_assert(second_sum >= first_sum);
-  return second_sum - first_sum;
+  g_assert(second->sum >= first->sum);
+  return second->sum - first->sum;
 }
 
 /**
@@ -931,7 +1019,12 @@ inf_adopted_state_vector_from_string_diff(const gchar* str,
 
       if(vec_comp->id == orig_comp->id)
       {
-        vec_comp->n += orig_comp->n;
+        inf_adopted_state_vector_set_component(
+          vec,
+          vec_comp,
+          vec_comp->n + orig_comp->n
+        );
+
         ++vec_pos;
       }
       else
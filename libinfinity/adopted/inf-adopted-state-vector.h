@@ -101,6 +101,13 @@ int
 inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
                                  const InfAdoptedStateVector* second);
 
+gboolean
+inf_adopted_state_vector_equal(const InfAdoptedStateVector* first,
+                               const InfAdoptedStateVector* second);
+
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec);
+
 gboolean
 inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
                                          const InfAdoptedStateVector* second);
@@ -32,6 +32,7 @@
 #include <libinfinity/client/infc-browser.h>
 #include <libinfinity/client/infc-progress-request.h>
 #include <libinfinity/client/infc-request-manager.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
 
 #include <libinfinity/common/inf-request-result.h>
 #include <libinfinity/common/inf-chat-session.h>
@@ -113,6 +114,8 @@ struct _InfcBrowserNode {
     struct {
       InfcSessionProxy* session;
       const InfcNotePlugin* plugin;
+      /* Proxy whose subscription we asked the server to resume */
+      InfcSessionProxy* resume;
     } known;
 
     struct {
@@ -163,6 +166,8 @@ struct _InfcBrowserSubreq {
       InfcBrowserNode* node;
       InfcRequest* request;
       InfCommunicationJoinedGroup* subscription_group;
+      gchar* identity;
+      InfcSessionProxy* resume; /* can be NULL */
     } session;
 
     /* TODO: It would simplify some code if we merge the add_node
@@ -592,6 +597,7 @@ infc_browser_node_new_note(InfcBrowser* browser,
   {
     node->shared.known.plugin = plugin;
     node->shared.known.session = NULL;
+    node->shared.known.resume = NULL;
   }
   else
   {
@@ -739,6 +745,8 @@ infc_browser_node_free(InfcBrowser* browser,
   case INFC_BROWSER_NODE_NOTE_KNOWN:
     /* Is first unlinked with remove_child_sessions */
     g_assert(node->shared.known.session == NULL);
+    if(node->shared.known.resume != NULL)
+      g_object_unref(node->shared.known.resume);
     break;
   case INFC_BROWSER_NODE_NOTE_UNKNOWN:
     g_free(node->shared.unknown.type);
@@ -1977,6 +1985,8 @@ infc_browser_add_subreq_session(InfcBrowser* browser,
   subreq->shared.session.node = node;
   subreq->shared.session.request = request;
   subreq->shared.session.subscription_group = group;
+  subreq->shared.session.identity = NULL;
+  subreq->shared.session.resume = NULL;
 
   /* TODO: Document in what case request can be NULL, or assert if it can't */
   if(request != NULL)
@@ -2087,6 +2097,10 @@ infc_browser_free_subreq(InfcBrowserSubreq* request)
     if(request->shared.session.request != NULL)
       g_object_unref(request->shared.session.request);
 
+    if(request->shared.session.resume != NULL)
+      g_object_unref(request->shared.session.resume);
+
+    g_free(request->shared.session.identity);
     break;
   case INFC_BROWSER_SUBREQ_ADD_NODE:
     g_object_unref(request->shared.add_node.subscription_group);
@@ -2388,8 +2402,14 @@ infc_browser_subscribe_ack(InfcBrowser* browser,
 
   xml = xmlNewNode(NULL, (const xmlChar*)"subscribe-ack");
   if(request->type != INFC_BROWSER_SUBREQ_CHAT)
+  {
     inf_xml_util_set_attribute_uint(xml, "id", request->node_id);
 
+    /* Let the server know that it can send us request batches. Servers
+     * which do not support batching ignore this. */
+    inf_xml_util_set_attribute(xml, "request-batching", "true");
+  }
+
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
     connection,
@@ -2699,14 +2719,19 @@ infc_browser_create_group_from_xml(InfcBrowser* browser,
 }
 
 /* If initial_sync is TRUE, then the session is initially synchronized in the 
- * subscription group. Otherwise, an empty session is used. */
+ * subscription group. Otherwise, an empty session is used. If resume is
+ * given, then the server brings the session of that proxy up to date, and
+ * it is reused instead of creating a new session. identity is the one the
+ * server told for its copy of the session, if any. */
 static void
 infc_browser_subscribe_session(InfcBrowser* browser,
                                InfcBrowserNode* node,
                                InfcRequest* request,
                                InfCommunicationJoinedGroup* group,
                                InfXmlConnection* connection,
-                               gboolean initial_sync)
+                               gboolean initial_sync,
+                               InfcSessionProxy* resume,
+                               const gchar* identity)
 {
   InfcBrowserPrivate* priv;
   InfcSessionProxy* proxy;
@@ -2720,37 +2745,49 @@ infc_browser_subscribe_session(InfcBrowser* browser,
   g_assert(node->shared.known.plugin != NULL);
   g_assert(node->shared.known.session == NULL);
 
-  path = g_string_sized_new(128);
-  infc_browser_node_get_path_string(node, path);
-
-  if(initial_sync)
+  if(resume != NULL)
   {
-    session = node->shared.known.plugin->session_new(
-      priv->io,
-      priv->communication_manager,
-      INF_SESSION_SYNCHRONIZING,
-      INF_COMMUNICATION_GROUP(group),
-      connection,
-      path->str,
-      node->shared.known.plugin->user_data
-    );
+    proxy = resume;
+    g_object_ref(proxy);
   }
   else
   {
-    session = node->shared.known.plugin->session_new(
-      priv->io,
-      priv->communication_manager,
-      INF_SESSION_RUNNING,
-      NULL,
-      NULL,
-      path->str,
-      node->shared.known.plugin->user_data
-    );
-  }
+    path = g_string_sized_new(128);
+    infc_browser_node_get_path_string(node, path);
 
-  g_string_free(path, TRUE);
+    if(initial_sync)
+    {
+      session = node->shared.known.plugin->session_new(
+        priv->io,
+        priv->communication_manager,
+        INF_SESSION_SYNCHRONIZING,
+        INF_COMMUNICATION_GROUP(group),
+        connection,
+        path->str,
+        node->shared.known.plugin->user_data
+      );
+    }
+    else
+    {
+      session = node->shared.known.plugin->session_new(
+        priv->io,
+        priv->communication_manager,
+        INF_SESSION_RUNNING,
+        NULL,
+        NULL,
+        path->str,
+        node->shared.known.plugin->user_data
+      );
+    }
+
+    g_string_free(path, TRUE);
 
-  proxy = g_object_new(INFC_TYPE_SESSION_PROXY, "session", session, NULL);
+    proxy = g_object_new(INFC_TYPE_SESSION_PROXY, "session", session, NULL);
+    g_object_unref(session);
+  }
+
+  if(identity != NULL)
+    g_object_set(G_OBJECT(proxy), "identity", identity, NULL);
 
   inf_communication_group_set_target(
     INF_COMMUNICATION_GROUP(group),
@@ -2759,8 +2796,6 @@ infc_browser_subscribe_session(InfcBrowser* browser,
 
   infc_session_proxy_set_connection(proxy, group, connection, priv->seq_id);
 
-  g_object_unref(session);
-
   iter.node_id = node->id;
   iter.node = node;
 
@@ -3554,6 +3589,8 @@ infc_browser_handle_subscribe_session(InfcBrowser* browser,
   InfcRequest* request;
   InfCommunicationJoinedGroup* group;
   InfcBrowserSubreq* subreq;
+  xmlChar* identity;
+  xmlChar* resume;
 
   priv = INFC_BROWSER_PRIVATE(browser);
 
@@ -3621,6 +3658,33 @@ infc_browser_handle_subscribe_session(InfcBrowser* browser,
   subreq = infc_browser_add_subreq_session(browser, node, request, group);
   g_object_unref(group);
 
+  identity = inf_xml_util_get_attribute(xml, "identity");
+  if(identity != NULL)
+  {
+    subreq->shared.session.identity = g_strdup((const gchar*)identity);
+    xmlFree(identity);
+  }
+
+  /* Reuse the proxy passed to infc_browser_iter_resume_session() if the
+   * server agreed to resume its subscription. Otherwise, the session is
+   * synchronized from scratch. */
+  if(node->shared.known.resume != NULL)
+  {
+    resume = inf_xml_util_get_attribute(xml, "resume");
+    if(request != NULL && resume != NULL &&
+       strcmp((const char*)resume, "true") == 0)
+    {
+      subreq->shared.session.resume = node->shared.known.resume;
+    }
+    else
+    {
+      g_object_unref(node->shared.known.resume);
+    }
+
+    if(resume != NULL) xmlFree(resume);
+    node->shared.known.resume = NULL;
+  }
+
   infc_browser_subscribe_ack(browser, connection, subreq);
 
   return TRUE;
@@ -5351,7 +5415,9 @@ infc_browser_communication_object_sent(InfCommunicationObject* object,
           subreq->shared.session.request,
           subreq->shared.session.subscription_group,
           connection,
-          TRUE
+          TRUE,
+          subreq->shared.session.resume,
+          subreq->shared.session.identity
         );
 
         if(subreq->shared.session.request != NULL)
@@ -5411,7 +5477,9 @@ infc_browser_communication_object_sent(InfCommunicationObject* object,
           subreq->shared.add_node.request,
           subreq->shared.add_node.subscription_group,
           connection,
-          FALSE
+          FALSE,
+          NULL,
+          NULL
         );
 
         /* Finish request */
@@ -7129,6 +7197,124 @@ infc_browser_iter_save_session(InfcBrowser* browser,
   return INF_REQUEST(request);
 }
 
+/**
+ * infc_browser_iter_resume_session:
+ * @browser: A #InfcBrowser.
+ * @iter: A #InfBrowserIter pointing to a note in @browser.
+ * @proxy: A #InfcSessionProxy that was subscribed to the note @iter points
+ * to before the connection to the server was lost.
+ * @func: (scope async): The function to be called when the request finishes,
+ * or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Subscribes to the note @iter points to like inf_browser_subscribe(), but
+ * asks the server to bring the session of @proxy up to date instead of
+ * synchronizing the whole session again. Only the requests that have been
+ * made since @proxy lost its connection are then transmitted.
+ *
+ * The server agrees if it still has the copy of the session identified by
+ * infc_session_proxy_get_identity() and if its request logs still contain
+ * all requests that @proxy's session has not seen yet. In that case @proxy
+ * is subscribed again and becomes the result of the request. Otherwise, a
+ * new session is synchronized as with inf_browser_subscribe(), and @proxy
+ * is left alone.
+ *
+ * Only sessions based on #InfAdoptedSession can be resumed. @proxy must not
+ * be subscribed, its session must be running, and the server must have
+ * told it an identity.
+ *
+ * Returns: (transfer none): A #InfRequest that may be used to get notified
+ * when the request finishes or fails.
+ **/
+InfRequest*
+infc_browser_iter_resume_session(InfcBrowser* browser,
+                                 const InfBrowserIter* iter,
+                                 InfcSessionProxy* proxy,
+                                 InfRequestFunc func,
+                                 gpointer user_data)
+{
+  InfcBrowserPrivate* priv;
+  InfcBrowserNode* node;
+  InfcRequest* request;
+  InfSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  const gchar* identity;
+  gchar* vector_str;
+  xmlNodePtr xml;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), NULL);
+  infc_browser_return_val_if_iter_fail(browser, iter, NULL);
+  g_return_val_if_fail(INFC_IS_SESSION_PROXY(proxy), NULL);
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+  node = (InfcBrowserNode*)iter->node;
+
+  g_return_val_if_fail(priv->connection != NULL, NULL);
+  g_return_val_if_fail(priv->status == INF_BROWSER_OPEN, NULL);
+  g_return_val_if_fail(node->type == INFC_BROWSER_NODE_NOTE_KNOWN, NULL);
+  g_return_val_if_fail(node->shared.known.session == NULL, NULL);
+  g_return_val_if_fail(infc_session_proxy_get_connection(proxy) == NULL, NULL);
+
+  g_return_val_if_fail(
+    inf_browser_get_pending_request(
+      INF_BROWSER(browser),
+      iter,
+      "subscribe-session"
+    ) == NULL,
+    NULL
+  );
+
+  identity = infc_session_proxy_get_identity(proxy);
+  g_return_val_if_fail(identity != NULL, NULL);
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  if(!INF_ADOPTED_IS_SESSION(session) ||
+     inf_session_get_status(session) != INF_SESSION_RUNNING)
+  {
+    g_object_unref(session);
+    g_return_val_if_reached(NULL);
+  }
+
+  request = infc_request_manager_add_request(
+    priv->request_manager,
+    INFC_TYPE_REQUEST,
+    "subscribe-session",
+    G_CALLBACK(func),
+    user_data,
+    "node-id", iter->node_id,
+    NULL
+  );
+
+  inf_browser_begin_request(INF_BROWSER(browser), iter, INF_REQUEST(request));
+
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+  vector_str = inf_adopted_state_vector_to_string(
+    inf_adopted_algorithm_get_current(algorithm)
+  );
+
+  xml = infc_browser_request_to_xml(request);
+  inf_xml_util_set_attribute_uint(xml, "id", node->id);
+  inf_xml_util_set_attribute(xml, "resume-identity", identity);
+  inf_xml_util_set_attribute(xml, "resume-vector", vector_str);
+
+  g_free(vector_str);
+  g_object_unref(session);
+
+  /* Remember the proxy until the server replies */
+  if(node->shared.known.resume != NULL)
+    g_object_unref(node->shared.known.resume);
+  node->shared.known.resume = proxy;
+  g_object_ref(proxy);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    priv->connection,
+    xml
+  );
+
+  return INF_REQUEST(request);
+}
+
 /**
  * infc_browser_iter_get_sync_in:
  * @browser: A #InfcBrowser.
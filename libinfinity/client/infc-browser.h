@@ -91,6 +91,13 @@ infc_browser_iter_save_session(InfcBrowser* browser,
                                InfRequestFunc func,
                                gpointer user_data);
 
+InfRequest*
+infc_browser_iter_resume_session(InfcBrowser* browser,
+                                 const InfBrowserIter* iter,
+                                 InfcSessionProxy* proxy,
+                                 InfRequestFunc func,
+                                 gpointer user_data);
+
 InfcSessionProxy*
 infc_browser_iter_get_sync_in(InfcBrowser* browser,
                               const InfBrowserIter* iter);
@@ -57,6 +57,9 @@ struct _InfcSessionProxyPrivate {
   InfCommunicationJoinedGroup* subscription_group;
   InfXmlConnection* connection;
   InfcRequestManager* request_manager;
+
+  /* Identity of the server's copy of the session */
+  gchar* identity;
 };
 
 enum {
@@ -65,7 +68,8 @@ enum {
   PROP_SESSION,
   PROP_SUBSCRIPTION_GROUP,
   PROP_SEQUENCE_ID,
-  PROP_CONNECTION
+  PROP_CONNECTION,
+  PROP_IDENTITY
 };
 
 #define INFC_SESSION_PROXY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFC_TYPE_SESSION_PROXY, InfcSessionProxyPrivate))
@@ -371,6 +375,7 @@ infc_session_proxy_init(InfcSessionProxy* proxy)
   priv->subscription_group = NULL;
   priv->connection = NULL;
   priv->request_manager = NULL;
+  priv->identity = NULL;
 }
 
 static void
@@ -414,6 +419,20 @@ infc_session_proxy_dispose(GObject* object)
   G_OBJECT_CLASS(infc_session_proxy_parent_class)->dispose(object);
 }
 
+static void
+infc_session_proxy_finalize(GObject* object)
+{
+  InfcSessionProxy* proxy;
+  InfcSessionProxyPrivate* priv;
+
+  proxy = INFC_SESSION_PROXY(object);
+  priv = INFC_SESSION_PROXY_PRIVATE(proxy);
+
+  g_free(priv->identity);
+
+  G_OBJECT_CLASS(infc_session_proxy_parent_class)->finalize(object);
+}
+
 static void
 infc_session_proxy_set_property(GObject* object,
                                 guint prop_id,
@@ -453,6 +472,10 @@ infc_session_proxy_set_property(GObject* object,
       proxy
     );
 
+    break;
+  case PROP_IDENTITY:
+    g_free(priv->identity);
+    priv->identity = g_value_dup_string(value);
     break;
   case PROP_SUBSCRIPTION_GROUP:
   case PROP_CONNECTION:
@@ -487,6 +510,9 @@ infc_session_proxy_get_property(GObject* object,
   case PROP_CONNECTION:
     g_value_set_object(value, G_OBJECT(priv->connection));
     break;
+  case PROP_IDENTITY:
+    g_value_set_string(value, priv->identity);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1072,6 +1098,7 @@ infc_session_proxy_class_init(InfcSessionProxyClass* proxy_class)
   object_class = G_OBJECT_CLASS(proxy_class);
 
   object_class->dispose = infc_session_proxy_dispose;
+  object_class->finalize = infc_session_proxy_finalize;
   object_class->set_property = infc_session_proxy_set_property;
   object_class->get_property = infc_session_proxy_get_property;
 
@@ -1101,6 +1128,19 @@ infc_session_proxy_class_init(InfcSessionProxyClass* proxy_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_IDENTITY,
+    g_param_spec_string(
+      "identity",
+      "Identity",
+      "Identifies the server's copy of the session, to resume the "
+      "subscription after the connection was lost",
+      NULL,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_SESSION, "session");
 }
 
@@ -1181,6 +1221,7 @@ infc_session_proxy_set_connection(InfcSessionProxy* proxy,
   {
     /* Unsubscribe from running session. Always send the unsubscribe request
      * because synchronizations are not cancelled through this call. */
+    inf_session_flush(priv->session);
     xml = xmlNewNode(NULL, (const xmlChar*)"session-unsubscribe");
 
     inf_communication_group_send_message(
@@ -1260,4 +1301,23 @@ infc_session_proxy_get_subscription_group(InfcSessionProxy* proxy)
   return INFC_SESSION_PROXY_PRIVATE(proxy)->subscription_group;
 }
 
+/**
+ * infc_session_proxy_get_identity:
+ * @proxy: A #InfcSessionProxy.
+ *
+ * Returns the identity of the server's copy of the session, as told by the
+ * server on subscription. If the connection to the server is lost, the
+ * subscription can be resumed with infc_browser_iter_resume_session() as
+ * long as the server still has the copy with this identity. Returns %NULL
+ * if the server did not tell an identity.
+ *
+ * Returns: (allow-none): The identity of the session, or %NULL.
+ **/
+const gchar*
+infc_session_proxy_get_identity(InfcSessionProxy* proxy)
+{
+  g_return_val_if_fail(INFC_IS_SESSION_PROXY(proxy), NULL);
+  return INFC_SESSION_PROXY_PRIVATE(proxy)->identity;
+}
+
 /* vim:set et sw=2 ts=2: */
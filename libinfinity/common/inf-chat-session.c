@@ -580,6 +580,8 @@ inf_chat_session_add_message_cb(InfChatBuffer* buffer,
                                 const InfChatBufferMessage* message,
                                 gpointer user_data)
 {
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+
   /* Ignore these messages, we cannot send them */
   if(message->type != INF_CHAT_BUFFER_MESSAGE_USERJOIN &&
      message->type != INF_CHAT_BUFFER_MESSAGE_USERPART)
@@ -813,6 +815,30 @@ inf_chat_session_to_xml_sync(InfSession* session,
   }
 }
 
+static gsize
+inf_chat_session_get_memory_usage(InfSession* session)
+{
+  InfChatBuffer* buffer;
+  InfSessionClass* parent_class;
+  const InfChatBufferMessage* message;
+  gsize usage;
+  guint i;
+
+  buffer = INF_CHAT_BUFFER(inf_session_get_buffer(session));
+  parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
+
+  g_assert(parent_class->get_memory_usage != NULL);
+  usage = parent_class->get_memory_usage(session);
+
+  for(i = 0; i < inf_chat_buffer_get_n_messages(buffer); ++i)
+  {
+    message = inf_chat_buffer_get_message(buffer, i);
+    usage += sizeof(InfChatBufferMessage) + message->length;
+  }
+
+  return usage;
+}
+
 static gboolean
 inf_chat_session_process_xml_sync(InfSession* session,
                                   InfXmlConnection* connection,
@@ -991,6 +1017,8 @@ inf_chat_session_receive_message_handler(InfChatSession* session,
     session
   );
 
+  inf_session_invalidate_sync_snapshot(INF_SESSION(session));
+
   /* Backlog messages (received during synchronization) are not yet logged.
    * We will need to parse the last messages in the log first and check
    * whether they have already been logged. */
@@ -1033,6 +1061,7 @@ inf_chat_session_class_init(InfChatSessionClass* chat_session_class)
   session_class->to_xml_sync = inf_chat_session_to_xml_sync;
   session_class->process_xml_sync = inf_chat_session_process_xml_sync;
   session_class->process_xml_run = inf_chat_session_process_xml_run;
+  session_class->get_memory_usage = inf_chat_session_get_memory_usage;
   session_class->synchronization_complete =
     inf_chat_session_synchronization_complete;
   session_class->synchronization_failed =
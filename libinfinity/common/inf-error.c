@@ -228,6 +228,10 @@ inf_directory_strerror(InfDirectoryError code)
     return _("The ACL has already been queried");
   case INF_DIRECTORY_ERROR_ACL_NOT_QUERIED:
     return _("The ACL has not been queried");
+  case INF_DIRECTORY_ERROR_SAVE_CANCELLED:
+    return _("Saving the session was cancelled");
+  case INF_DIRECTORY_ERROR_SLOW_CONSUMER:
+    return _("Too much data is waiting to be sent to the connection");
   case INF_DIRECTORY_ERROR_FAILED:
     return _("An unknown directory error has occurred");
   default:
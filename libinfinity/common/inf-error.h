@@ -168,6 +168,12 @@ typedef enum _InfUserError {
  * already been queried before.
  * @INF_DIRECTORY_ERROR_ACL_NOT_QUERIED: The ACL for a node has
  * not yet been queried, but is required to perform the operation.
+ * @INF_DIRECTORY_ERROR_SAVE_CANCELLED: An asynchronous save of a session was
+ * cancelled because the session was saved again or removed from memory
+ * before the save finished.
+ * @INF_DIRECTORY_ERROR_SLOW_CONSUMER: A connection was closed because the
+ * remote host did not receive the messages sent to it fast enough, and too
+ * much data was waiting to be sent.
  * @INF_DIRECTORY_ERROR_FAILED: Generic error code when no further reason of
  * failure is known.
  *
@@ -208,6 +214,8 @@ typedef enum _InfDirectoryError {
   INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
   INF_DIRECTORY_ERROR_ACL_ALREADY_QUERIED,
   INF_DIRECTORY_ERROR_ACL_NOT_QUERIED,
+  INF_DIRECTORY_ERROR_SAVE_CANCELLED,
+  INF_DIRECTORY_ERROR_SLOW_CONSUMER,
 
   INF_DIRECTORY_ERROR_FAILED
 } InfDirectoryError;
@@ -69,6 +69,11 @@ typedef enum _InfSaslContextSessionStatus {
 } InfSaslContextSessionStatus;
 
 struct _InfSaslContextSession {
+  /* Holders of a reference only keep the structure alive. The session
+   * itself ends with inf_sasl_context_stop_session(), which sets session
+   * and session_queue to NULL. */
+  gint ref_count;
+
   InfSaslContext* context;
   Gsasl_session* session;
   gpointer session_data;
@@ -492,6 +497,7 @@ inf_sasl_context_start_session(InfSaslContext* context,
   InfSaslContextSession* session;
   session = g_slice_new(InfSaslContextSession);
 
+  session->ref_count = 1;
   session->context = context;
   session->session = gsasl_session;
   session->session_data = session_data;
@@ -952,6 +958,47 @@ inf_sasl_context_server_supports_mechanism(InfSaslContext* context,
   return ret != 0;
 }
 
+/**
+ * inf_sasl_context_session_ref:
+ * @session: A #InfSaslContextSession.
+ *
+ * Increases the reference count of @session by one. This keeps @session
+ * valid after inf_sasl_context_stop_session() has been called for it. This
+ * is useful for a #InfSaslContextCallbackFunc which provides a property
+ * asynchronously, since it can then find out whether the session has been
+ * stopped in the meanwhile with inf_sasl_context_session_is_processing().
+ *
+ * Returns: (transfer full): The passed #InfSaslContextSession, @session.
+ */
+InfSaslContextSession*
+inf_sasl_context_session_ref(InfSaslContextSession* session)
+{
+  g_return_val_if_fail(session != NULL, NULL);
+
+  g_atomic_int_inc(&session->ref_count);
+  return session;
+}
+
+/**
+ * inf_sasl_context_session_unref:
+ * @session: A #InfSaslContextSession.
+ *
+ * Releases a reference on @session obtained with
+ * inf_sasl_context_session_ref(). This does not stop the session; use
+ * inf_sasl_context_stop_session() for that.
+ */
+void
+inf_sasl_context_session_unref(InfSaslContextSession* session)
+{
+  g_return_if_fail(session != NULL);
+
+  if(g_atomic_int_dec_and_test(&session->ref_count))
+  {
+    g_assert(session->session == NULL);
+    g_slice_free(InfSaslContextSession, session);
+  }
+}
+
 /**
  * inf_sasl_context_stop_session:
  * @context: A #InfSaslContext.
@@ -961,7 +1008,13 @@ inf_sasl_context_server_supports_mechanism(InfSaslContext* context,
  * to cancel an authentication session, or to free it after it finished
  * (either successfully or not).
  *
- * @session should no longer be used after this function was called.
+ * @session should no longer be used after this function was called, except
+ * when a reference to it is held with inf_sasl_context_session_ref(). In
+ * that case, @session stays valid but inactive:
+ * inf_sasl_context_session_is_processing() returns %FALSE,
+ * inf_sasl_context_session_get_property() returns %NULL, and
+ * inf_sasl_context_session_set_property() and
+ * inf_sasl_context_session_continue() have no effect.
  */
 void
 inf_sasl_context_stop_session(InfSaslContext* context,
@@ -995,11 +1048,17 @@ inf_sasl_context_stop_session(InfSaslContext* context,
    * message into the end of the queue, and all other queued messages will
    * have been processed before. */
   g_async_queue_unref(session->session_queue);
+  session->session_queue = NULL;
+  session->session = NULL;
+  session->stepping = FALSE;
 
   g_object_unref(session->main_io);
+  session->main_io = NULL;
 
   g_free(session->step64);
-  g_slice_free(InfSaslContextSession, session);
+  session->step64 = NULL;
+
+  inf_sasl_context_session_unref(session);
 }
 
 /**
@@ -1008,8 +1067,8 @@ inf_sasl_context_stop_session(InfSaslContext* context,
  * @prop: A SASL property.
  *
  * Returns the value of the property @prop in @session. If the value does not
- * yet exist then this function returns %NULL. It does not invoke the
- * #InfSaslContextCallbackFunc to query it.
+ * yet exist, or if @session has been stopped, then this function returns
+ * %NULL. It does not invoke the #InfSaslContextCallbackFunc to query it.
  *
  * Returns: (allow-none): The value of the property, or %NULL. The value is
  * owned by the session and must not be freed.
@@ -1022,6 +1081,9 @@ inf_sasl_context_session_get_property(InfSaslContextSession* session,
 
   g_return_val_if_fail(session != NULL, NULL);
 
+  if(session->session == NULL)
+    return NULL;
+
   /* TODO: We should g_strdup the return value for thread safety reasons */
 
   g_mutex_lock(&session->context->mutex);
@@ -1046,6 +1108,9 @@ inf_sasl_context_session_set_property(InfSaslContextSession* session,
 {
   g_return_if_fail(session != NULL);
 
+  if(session->session == NULL)
+    return;
+
   g_mutex_lock(&session->context->mutex);
   gsasl_property_set(session->session, prop, value);
   g_mutex_unlock(&session->context->mutex);
@@ -1062,7 +1127,8 @@ inf_sasl_context_session_set_property(InfSaslContextSession* session,
  * requested property using inf_sasl_context_session_set_property() with
  * @retval being %GSASL_OK. If it decides that the property cannot be provided
  * then it should still call this function with @retval being a SASL error
- * code specifying the problem.
+ * code specifying the problem. If @session has been stopped in the
+ * meanwhile, this function does nothing.
  */
 void
 inf_sasl_context_session_continue(InfSaslContextSession* session,
@@ -1070,6 +1136,9 @@ inf_sasl_context_session_continue(InfSaslContextSession* session,
 {
   g_return_if_fail(session != NULL);
 
+  if(session->session_queue == NULL)
+    return;
+
   g_async_queue_push(
     session->session_queue,
     inf_sasl_context_message_continue(session, retval)
@@ -1099,6 +1168,7 @@ inf_sasl_context_session_feed(InfSaslContextSession* session,
                               gpointer user_data)
 {
   g_return_if_fail(session != NULL);
+  g_return_if_fail(session->session_queue != NULL);
   g_return_if_fail(func != NULL);
   g_return_if_fail(session->stepping == FALSE);
   /*g_return_if_fail(session->context->callback != NULL); not threadsafe */
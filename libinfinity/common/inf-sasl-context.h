@@ -152,6 +152,12 @@ void
 inf_sasl_context_stop_session(InfSaslContext* context,
                               InfSaslContextSession* session);
 
+InfSaslContextSession*
+inf_sasl_context_session_ref(InfSaslContextSession* session);
+
+void
+inf_sasl_context_session_unref(InfSaslContextSession* session);
+
 const char*
 inf_sasl_context_session_get_property(InfSaslContextSession* session,
                                       Gsasl_property prop);
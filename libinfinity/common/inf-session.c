@@ -105,6 +105,14 @@ struct _InfSessionSync {
   InfSessionSyncStatus status;
 };
 
+/* A message of the synchronization snapshot, together with its
+ * serialization which is shared by all synchronizations that send it. */
+typedef struct _InfSessionSnapshotMessage InfSessionSnapshotMessage;
+struct _InfSessionSnapshotMessage {
+  xmlNodePtr xml;
+  GBytes* serialized;
+};
+
 typedef struct _InfSessionPrivate InfSessionPrivate;
 struct _InfSessionPrivate {
   InfCommunicationManager* manager;
@@ -135,6 +143,9 @@ struct _InfSessionPrivate {
     /* INF_SESSION_RUNNING */
     struct {
       GSList* syncs;
+      /* Synchronization messages for the current state of the session,
+       * built on demand and dropped when the session changes. */
+      GPtrArray* snapshot;
     } run;
   } shared;
 };
@@ -443,6 +454,113 @@ inf_session_connection_notify_status_cb(InfXmlConnection* connection,
   }
 }
 
+/*
+ * Synchronization snapshot.
+ */
+
+static void
+inf_session_snapshot_message_free(gpointer data)
+{
+  InfSessionSnapshotMessage* message;
+  message = (InfSessionSnapshotMessage*)data;
+
+  xmlFreeNode(message->xml);
+  g_bytes_unref(message->serialized);
+  g_slice_free(InfSessionSnapshotMessage, message);
+}
+
+static GPtrArray*
+inf_session_snapshot_new(InfSession* session)
+{
+  InfSessionClass* session_class;
+  GPtrArray* snapshot;
+  InfSessionSnapshotMessage* message;
+  xmlNodePtr messages;
+  xmlNodePtr xml;
+  xmlNodePtr next;
+  xmlBufferPtr buffer;
+
+  session_class = INF_SESSION_GET_CLASS(session);
+  g_assert(session_class->to_xml_sync != NULL);
+
+  /* Name is irrelevant because the node is only used to collect the child
+   * nodes via the to_xml_sync vfunc. */
+  messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  session_class->to_xml_sync(session, messages);
+
+  snapshot = g_ptr_array_new_with_free_func(inf_session_snapshot_message_free);
+  buffer = xmlBufferCreate();
+
+  for(xml = messages->children; xml != NULL; xml = next)
+  {
+    next = xml->next;
+    xmlUnlinkNode(xml);
+
+    xmlBufferEmpty(buffer);
+    xmlNodeDump(buffer, NULL, xml, 0, 0);
+
+    message = g_slice_new(InfSessionSnapshotMessage);
+    message->xml = xml;
+    message->serialized =
+      g_bytes_new(xmlBufferContent(buffer), xmlBufferLength(buffer));
+
+    g_ptr_array_add(snapshot, message);
+  }
+
+  xmlBufferFree(buffer);
+  xmlFreeNode(messages);
+  return snapshot;
+}
+
+static void
+inf_session_user_notify_cb(GObject* object,
+                           GParamSpec* pspec,
+                           gpointer user_data)
+{
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+}
+
+static void
+inf_session_connect_user_func(InfUser* user,
+                              gpointer user_data)
+{
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify",
+    G_CALLBACK(inf_session_user_notify_cb),
+    user_data
+  );
+}
+
+static void
+inf_session_disconnect_user_func(InfUser* user,
+                                 gpointer user_data)
+{
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(user),
+    G_CALLBACK(inf_session_user_notify_cb),
+    user_data
+  );
+}
+
+static void
+inf_session_add_user_cb(InfUserTable* user_table,
+                        InfUser* user,
+                        gpointer user_data)
+{
+  inf_session_connect_user_func(user, user_data);
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+}
+
+static void
+inf_session_remove_user_cb(InfUserTable* user_table,
+                           InfUser* user,
+                           gpointer user_data)
+{
+  inf_session_disconnect_user_func(user, user_data);
+  inf_session_invalidate_sync_snapshot(INF_SESSION(user_data));
+}
+
 /*
  * GObject overrides.
  */
@@ -459,6 +577,7 @@ inf_session_init(InfSession* session)
   priv->status = INF_SESSION_RUNNING;
 
   priv->shared.run.syncs = NULL;
+  priv->shared.run.snapshot = NULL;
 }
 
 static void
@@ -475,6 +594,27 @@ inf_session_constructed(GObject* object)
   if(priv->user_table == NULL)
     priv->user_table = inf_user_table_new();
 
+  /* Any change to the users makes the synchronization snapshot outdated */
+  inf_user_table_foreach_user(
+    priv->user_table,
+    inf_session_connect_user_func,
+    object
+  );
+
+  g_signal_connect(
+    G_OBJECT(priv->user_table),
+    "add-user",
+    G_CALLBACK(inf_session_add_user_cb),
+    object
+  );
+
+  g_signal_connect(
+    G_OBJECT(priv->user_table),
+    "remove-user",
+    G_CALLBACK(inf_session_remove_user_cb),
+    object
+  );
+
   switch(priv->status)
   {
   case INF_SESSION_PRESYNC:
@@ -523,6 +663,24 @@ inf_session_dispose(GObject* object)
     inf_session_close(session);
   }
 
+  inf_user_table_foreach_user(
+    priv->user_table,
+    inf_session_disconnect_user_func,
+    session
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(priv->user_table),
+    G_CALLBACK(inf_session_add_user_cb),
+    session
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(priv->user_table),
+    G_CALLBACK(inf_session_remove_user_cb),
+    session
+  );
+
   g_object_unref(G_OBJECT(priv->user_table));
   priv->user_table = NULL;
 
@@ -1152,6 +1310,53 @@ inf_session_validate_user_props_impl(InfSession* session,
   return TRUE;
 }
 
+static void
+inf_session_get_memory_usage_impl_foreach_func(InfUser* user,
+                                               gpointer user_data)
+{
+  gsize* usage;
+  GTypeQuery query;
+
+  usage = (gsize*)user_data;
+
+  g_type_query(G_TYPE_FROM_INSTANCE(user), &query);
+  *usage += query.instance_size + strlen(inf_user_get_name(user)) + 1;
+}
+
+static gsize
+inf_session_get_memory_usage_impl(InfSession* session)
+{
+  InfSessionPrivate* priv;
+  GTypeQuery query;
+  gsize usage;
+  InfSessionSnapshotMessage* message;
+  guint i;
+
+  priv = INF_SESSION_PRIVATE(session);
+
+  g_type_query(G_TYPE_FROM_INSTANCE(session), &query);
+  usage = query.instance_size;
+
+  inf_user_table_foreach_user(
+    priv->user_table,
+    inf_session_get_memory_usage_impl_foreach_func,
+    &usage
+  );
+
+  /* The XML tree of a snapshot message takes at least as much memory as
+   * its serialization, so count the serialization twice. */
+  if(priv->status == INF_SESSION_RUNNING && priv->shared.run.snapshot != NULL)
+  {
+    for(i = 0; i < priv->shared.run.snapshot->len; ++i)
+    {
+      message = g_ptr_array_index(priv->shared.run.snapshot, i);
+      usage += 2 * g_bytes_get_size(message->serialized);
+    }
+  }
+
+  return usage;
+}
+
 /*
  * InfCommunicationObject implementation.
  */
@@ -1680,6 +1885,7 @@ inf_session_close_handler(InfSession* session)
       inf_session_cancel_synchronization(session, sync->conn);
     }
 
+    inf_session_invalidate_sync_snapshot(session);
     break;
   case INF_SESSION_CLOSED:
   default:
@@ -1708,9 +1914,10 @@ inf_session_synchronization_begin_handler(InfSession* session,
   InfSessionPrivate* priv;
   InfSessionClass* session_class;
   InfSessionSync* sync;
-  xmlNodePtr messages;
-  xmlNodePtr next;
+  GPtrArray* snapshot;
+  InfSessionSnapshotMessage* message;
   xmlNodePtr xml;
+  guint i;
   gchar num_messages_buf[16];
 
   priv = INF_SESSION_PRIVATE(session);
@@ -1743,13 +1950,15 @@ inf_session_synchronization_begin_handler(InfSession* session,
   /* The group needs to contain that connection, of course. */
   g_assert(inf_communication_group_is_member(sync->group, connection));
 
-  /* Name is irrelevant because the node is only used to collect the child
-   * nodes via the to_xml_sync vfunc. */
-  messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
-  session_class->to_xml_sync(session, messages);
+  /* The snapshot is shared by all synchronizations until the session
+   * changes, so that many connections subscribing at the same time only
+   * cost one to_xml_sync call and one serialization. Keep a reference,
+   * since sending can run callbacks which change the session. */
+  if(priv->shared.run.snapshot == NULL)
+    priv->shared.run.snapshot = inf_session_snapshot_new(session);
 
-  for(xml = messages->children; xml != NULL; xml = xml->next)
-    ++ sync->messages_total;
+  snapshot = g_ptr_array_ref(priv->shared.run.snapshot);
+  sync->messages_total += snapshot->len;
 
   sprintf(num_messages_buf, "%u", sync->messages_total - 2);
 
@@ -1764,15 +1973,19 @@ inf_session_synchronization_begin_handler(InfSession* session,
   inf_communication_group_send_message(sync->group, connection, xml);
 
   /* TODO: Add a function that can send multiple messages */
-  for(xml = messages->children; xml != NULL; xml = next)
+  for(i = 0; i < snapshot->len; ++i)
   {
-    next = xml->next;
-    xmlUnlinkNode(xml);
+    message = g_ptr_array_index(snapshot, i);
 
-    inf_communication_group_send_message(sync->group, connection, xml);
+    inf_communication_group_send_serialized_message(
+      sync->group,
+      connection,
+      message->xml,
+      message->serialized
+    );
   }
 
-  xmlFreeNode(messages);
+  g_ptr_array_unref(snapshot);
   xml = xmlNewNode(NULL, (const xmlChar*)"sync-end");
   inf_communication_group_send_message(sync->group, connection, xml);
 }
@@ -1796,6 +2009,7 @@ inf_session_synchronization_complete_handler(InfSession* session,
 
     priv->status = INF_SESSION_RUNNING;
     priv->shared.run.syncs = NULL;
+    priv->shared.run.snapshot = NULL;
 
     g_object_notify(G_OBJECT(session), "status");
     break;
@@ -1888,6 +2102,8 @@ inf_session_class_init(InfSessionClass* session_class)
   session_class->validate_user_props = inf_session_validate_user_props_impl;
 
   session_class->user_new = NULL;
+  session_class->flush = NULL;
+  session_class->get_memory_usage = inf_session_get_memory_usage_impl;
 
   session_class->close = inf_session_close_handler;
   session_class->error = NULL;
@@ -2284,9 +2500,92 @@ inf_session_close(InfSession* session)
 {
   g_return_if_fail(INF_IS_SESSION(session));
   g_return_if_fail(inf_session_get_status(session) != INF_SESSION_CLOSED);
+
+  /* Send everything that is held back while we are still connected */
+  inf_session_flush(session);
   g_signal_emit(G_OBJECT(session), session_signals[CLOSE], 0);
 }
 
+/**
+ * inf_session_flush:
+ * @session: A #InfSession.
+ *
+ * Sends all messages that @session holds back to the subscription group
+ * right away. Sessions may delay messages to send several of them at once,
+ * for example #InfAdoptedSession when request batching is enabled. This
+ * needs to be called before sending other messages to the subscription
+ * group whose order relative to the held back ones matters. Session proxies
+ * do so before a connection unsubscribes or subscribes, and
+ * inf_session_set_user_status() and inf_session_close() do so
+ * automatically.
+ */
+void
+inf_session_flush(InfSession* session)
+{
+  InfSessionClass* session_class;
+
+  g_return_if_fail(INF_IS_SESSION(session));
+
+  session_class = INF_SESSION_GET_CLASS(session);
+  if(session_class->flush != NULL)
+    session_class->flush(session);
+}
+
+/**
+ * inf_session_get_memory_usage:
+ * @session: A #InfSession.
+ *
+ * Returns an estimate of the number of bytes of memory that @session uses
+ * for its buffer, its users and any other state such as request logs. This
+ * is meant to decide which sessions to drop from memory when it becomes
+ * scarce, not to be exact.
+ *
+ * Returns: The estimated memory usage of @session, in bytes.
+ */
+gsize
+inf_session_get_memory_usage(InfSession* session)
+{
+  InfSessionClass* session_class;
+
+  g_return_val_if_fail(INF_IS_SESSION(session), 0);
+
+  session_class = INF_SESSION_GET_CLASS(session);
+  g_assert(session_class->get_memory_usage != NULL);
+
+  return session_class->get_memory_usage(session);
+}
+
+/**
+ * inf_session_invalidate_sync_snapshot:
+ * @session: A #InfSession.
+ *
+ * Drops the messages that @session keeps to synchronize itself to other
+ * connections. When @session is synchronized to a connection, it creates
+ * the synchronization messages with the @to_xml_sync virtual function and
+ * serializes them only once, and reuses them for further synchronizations
+ * until they are dropped, so that many connections can subscribe at the
+ * same time without creating the messages for each of them.
+ *
+ * #InfSession drops them itself when a user is added or removed or a
+ * property of a user changes. Subclasses need to call this function
+ * whenever anything else that @to_xml_sync writes changes, such as the
+ * buffer content.
+ */
+void
+inf_session_invalidate_sync_snapshot(InfSession* session)
+{
+  InfSessionPrivate* priv;
+
+  g_return_if_fail(INF_IS_SESSION(session));
+  priv = INF_SESSION_PRIVATE(session);
+
+  if(priv->status == INF_SESSION_RUNNING && priv->shared.run.snapshot != NULL)
+  {
+    g_ptr_array_unref(priv->shared.run.snapshot);
+    priv->shared.run.snapshot = NULL;
+  }
+}
+
 /**
  * inf_session_get_communication_manager:
  * @session: A #InfSession.
@@ -2435,6 +2734,9 @@ inf_session_set_user_status(InfSession* session,
 
   if(inf_user_get_status(user) != status)
   {
+    /* Requests of the user need to arrive before it leaves */
+    inf_session_flush(session);
+
     xml = xmlNewNode(NULL, (const xmlChar*)"user-status-change");
     inf_xml_util_set_attribute_uint(xml, "id", inf_user_get_id(user));
 
@@ -154,7 +154,9 @@ typedef enum _InfSessionSyncError {
  * much nodes as possible within that root node and not in sub-nodes because
  * these are sent to a client and it is not allowed that other traffic is put
  * in between those nodes. This way, communication through the same connection
- * does not hang just because a large session is synchronized.
+ * does not hang just because a large session is synchronized. The result is
+ * reused for further synchronizations until
+ * inf_session_invalidate_sync_snapshot() is called.
  * @process_xml_sync: Virtual function that is called for every node in the
  * XML document created by @to_xml_sync. It is supposed to reconstruct the
  * session content from the XML data.
@@ -172,6 +174,12 @@ typedef enum _InfSessionSyncError {
  * function does ignore it when validating.
  * @user_new: Virtual function that creates a new user object with the given
  * properties.
+ * @flush: Virtual function that sends out messages which the session holds
+ * back, such as batched requests, see inf_session_flush(). Can be %NULL if
+ * the session never holds back any messages.
+ * @get_memory_usage: Virtual function that estimates the memory used by the
+ * session, see inf_session_get_memory_usage(). Subclasses which keep state
+ * of their own should chain up and add it to the result.
  * @close: Default signal handler for the #InfSession::close signal. This
  * cancels currently running synchronization in #InfSession.
  * @error: Default signal handler for the #InfSession::error signal.
@@ -231,6 +239,10 @@ struct _InfSessionClass {
                       GParameter* params,
                       guint n_params);
 
+  void(*flush)(InfSession* session);
+
+  gsize(*get_memory_usage)(InfSession* session);
+
   /* Signals */
   void(*close)(InfSession* session);
   void(*error)(InfSession* session,
@@ -288,6 +300,15 @@ inf_session_user_to_xml(InfSession* session,
 void
 inf_session_close(InfSession* session);
 
+void
+inf_session_flush(InfSession* session);
+
+gsize
+inf_session_get_memory_usage(InfSession* session);
+
+void
+inf_session_invalidate_sync_snapshot(InfSession* session);
+
 InfCommunicationManager*
 inf_session_get_communication_manager(InfSession* session);
 
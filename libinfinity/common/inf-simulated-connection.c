@@ -27,13 +27,17 @@
  * #InfSimulatedConnection simulates a connection and can be used everywhere
  * where a #InfXmlConnection is expected. Use
  * inf_simulated_connection_connect() to connect two such connections so that
- * data sent through one is received by the other.
+ * data sent through one is received by the other. Messages sent with
+ * inf_xml_connection_send_serialized() are parsed from their serialization,
+ * so that the receiving side sees exactly what was serialized.
  */
 
 #include <libinfinity/common/inf-simulated-connection.h>
 #include <libinfinity/common/inf-xml-connection.h>
 #include <libinfinity/inf-define-enum.h>
 
+#include <libxml/parser.h>
+
 static const GEnumValue inf_simulated_connection_mode_values[] = {
   {
     INF_SIMULATED_CONNECTION_IMMEDIATE,
@@ -379,6 +383,31 @@ inf_simulated_connection_xml_connection_send(InfXmlConnection* connection,
   }
 }
 
+static void
+inf_simulated_connection_xml_connection_send_serialized(
+  InfXmlConnection* connection,
+  xmlNodePtr xml,
+  GBytes* serialized,
+  GBytes* binary)
+{
+  xmlDocPtr doc;
+  xmlNodePtr message;
+  gconstpointer data;
+  gsize size;
+
+  /* The target receives what was serialized, not xml itself, which might
+   * only carry the name and attributes of the message. */
+  data = g_bytes_get_data(serialized, &size);
+  doc = xmlReadMemory(data, size, NULL, "UTF-8", XML_PARSE_NONET);
+  g_assert(doc != NULL && xmlDocGetRootElement(doc) != NULL);
+
+  message = xmlDocCopyNode(xmlDocGetRootElement(doc), NULL, 1);
+  xmlFreeDoc(doc);
+  xmlFreeNode(xml);
+
+  inf_simulated_connection_xml_connection_send(connection, message);
+}
+
 /*
  * GObject type registration
  */
@@ -455,6 +484,8 @@ inf_simulated_connection_xml_connection_iface_init(
 {
   iface->close = inf_simulated_connection_xml_connection_close;
   iface->send = inf_simulated_connection_xml_connection_send;
+  iface->send_serialized =
+    inf_simulated_connection_xml_connection_send_serialized;
 }
 
 /*
@@ -37,17 +37,29 @@
  * instead which implements the #InfIo interface. For the GTK+ toolkit, there
  * is #InfGtkIo in the libinfgtk library, to integrate with the Glib main
  * loop.
+ *
+ * Where epoll is available, #InfStandaloneIo uses it to wait for events, so
+ * that the cost of a main loop iteration does not grow with the number of
+ * idle sockets being watched. Timeouts are kept in a binary heap.
  */
 
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-io.h>
 
-/* TODO: Modularize the FD handling, then add epoll support */
+#include "config.h"
+
+#if defined(HAVE_EPOLL) && !defined(G_OS_WIN32)
+# define INF_STANDALONE_IO_USE_EPOLL
+#endif
 
 #ifdef G_OS_WIN32
 # include <winsock2.h>
 #else
-# include <poll.h>
+# ifdef INF_STANDALONE_IO_USE_EPOLL
+#  include <sys/epoll.h>
+# else
+#  include <poll.h>
+# endif
 # include <errno.h>
 # include <unistd.h>
 #endif /* !G_OS_WIN32 */
@@ -58,28 +70,38 @@
 typedef WSAEVENT InfStandaloneIoNativeEvent;
 typedef DWORD InfStandaloneIoPollTimeout;
 typedef DWORD InfStandaloneIoPollResult;
-static const InfStandaloneIoPollResult INF_STANDALONE_IO_POLL_TIMEOUT =
-  WSA_WAIT_TIMEOUT;
 static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE =
   WSA_INFINITE;
 #define inf_standalone_io_poll(events, num_events, timeout) \
   ((num_events) == 0 ? \
     (Sleep(timeout), WSA_WAIT_TIMEOUT) : \
     (WSAWaitForMultipleEvents(num_events, events, FALSE, timeout, TRUE)))
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+typedef int InfStandaloneIoPollTimeout;
+static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE = -1;
+/* Maximum number of events that a single epoll_wait() call reports */
+#define INF_STANDALONE_IO_EPOLL_MAX_EVENTS 64
 #else
 typedef struct pollfd InfStandaloneIoNativeEvent;
 typedef int InfStandaloneIoPollTimeout;
 typedef int InfStandaloneIoPollResult;
-static const InfStandaloneIoPollResult INF_STANDALONE_IO_POLL_TIMEOUT = 0;
 static const InfStandaloneIoPollTimeout INF_STANDALONE_IO_POLL_INFINITE = -1;
 #define inf_standalone_io_poll(events, num_events, timeout) \
   (poll(events, (nfds_t)num_events, timeout))
 #endif
 
 struct _InfIoWatch {
-  /* TODO: Do we actually need this? We can access the event by
-   * priv->events[watchindex+1]. */
-  InfStandaloneIoNativeEvent* event;
+  /* Position in the watches array. Without epoll, the native event of the
+   * watch is at index + 1 in the events array, after the wakeup event. */
+  guint index;
+
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+  /* The socket might have been closed and reset to INVALID_SOCKET by the
+   * time the watch is removed, so remember which file descriptor we added
+   * to the epoll set. */
+  int fd;
+  InfIoEvent events;
+#endif
 
   InfNativeSocket* socket;
   InfIoWatchFunc func;
@@ -93,8 +115,14 @@ struct _InfIoWatch {
 };
 
 struct _InfIoTimeout {
-  GTimeVal begin;
-  guint msecs;
+  /* Monotonic time, in microseconds, at which the timeout elapses */
+  gint64 expiry;
+  /* Makes timeouts that elapse at the same time run in the order in which
+   * they were added */
+  guint64 serial;
+  /* Position in the timeout heap */
+  guint index;
+
   InfIoTimeoutFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -108,16 +136,35 @@ struct _InfIoDispatch {
 
 typedef struct _InfStandaloneIoPrivate InfStandaloneIoPrivate;
 struct _InfStandaloneIoPrivate {
-  InfStandaloneIoNativeEvent* events;
   GMutex mutex;
 
-  guint fd_size;
-  guint fd_alloc;
-
-  /* this array has fd_size-1 entries and fd_alloc-1 allocations: */
   InfIoWatch** watches;
+  guint n_watches;
+  guint watches_alloc;
+
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+  int epoll_fd;
+
+  /* Events reported by the last epoll_wait() call which have not yet been
+   * processed. The data of events for watches that have been removed in
+   * the meanwhile is set to NULL. */
+  struct epoll_event ready[INF_STANDALONE_IO_EPOLL_MAX_EVENTS];
+  guint n_ready;
+  guint ready_pos;
+
+  /* Watches removed while waiting for events. They can only be freed once
+   * we know whether the wait reported them. */
+  GSList* disposed_watches;
+#else
+  /* this array has n_watches+1 entries and watches_alloc+1 allocations,
+   * the first one being the wakeup event: */
+  InfStandaloneIoNativeEvent* events;
+#endif
+
+  /* A binary heap of InfIoTimeout, ordered by expiry */
+  GPtrArray* timeouts;
+  guint64 timeout_serial;
 
-  GList* timeouts;
   GList* dispatchs;
 
 #ifndef G_OS_WIN32
@@ -155,280 +202,596 @@ G_DEFINE_TYPE_WITH_CODE(InfStandaloneIo, inf_standalone_io, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfStandaloneIo)
   G_IMPLEMENT_INTERFACE(INF_TYPE_IO, inf_standalone_io_io_iface_init))
 
-static guint
-inf_standalone_io_timeval_diff(GTimeVal* first,
-                               GTimeVal* second)
+static gboolean
+inf_standalone_io_timeout_before(const InfIoTimeout* first,
+                                 const InfIoTimeout* second)
 {
-  g_assert(first->tv_sec > second->tv_sec ||
-           (first->tv_sec == second->tv_sec &&
-            first->tv_usec >= second->tv_usec));
+  if(first->expiry != second->expiry)
+    return first->expiry < second->expiry;
+  return first->serial < second->serial;
+}
 
-  /* Don't risk overflow, don't need to convert to signed int */
-  return (first->tv_sec - second->tv_sec) * 1000 +
-         (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
+static void
+inf_standalone_io_timeout_heap_set(GPtrArray* heap,
+                                   guint index,
+                                   InfIoTimeout* timeout)
+{
+  heap->pdata[index] = timeout;
+  timeout->index = index;
 }
 
-/* Run one iteration of the main loop. Call this only with the mutex locked
- * and a local reference added to io. */
 static void
-inf_standalone_io_iteration_impl(InfStandaloneIo* io,
-                                 InfStandaloneIoPollTimeout timeout)
+inf_standalone_io_timeout_heap_up(GPtrArray* heap,
+                                  guint index)
 {
-  InfStandaloneIoPrivate* priv;
-  InfIoEvent events;
-  InfStandaloneIoPollResult result;
-  guint i;
+  InfIoTimeout* timeout;
+  InfIoTimeout* parent;
 
-  GList* item;
-  GTimeVal current;
-  InfIoWatch* watch;
-  InfIoTimeout* cur_timeout;
-  InfIoDispatch* dispatch;
-  guint elapsed;
+  timeout = (InfIoTimeout*)heap->pdata[index];
+  while(index > 0)
+  {
+    parent = (InfIoTimeout*)heap->pdata[(index - 1) / 2];
+    if(!inf_standalone_io_timeout_before(timeout, parent))
+      break;
+
+    inf_standalone_io_timeout_heap_set(heap, index, parent);
+    index = (index - 1) / 2;
+  }
+
+  inf_standalone_io_timeout_heap_set(heap, index, timeout);
+}
+
+static void
+inf_standalone_io_timeout_heap_down(GPtrArray* heap,
+                                    guint index)
+{
+  InfIoTimeout* timeout;
+  InfIoTimeout* child;
+  guint child_index;
+
+  timeout = (InfIoTimeout*)heap->pdata[index];
+  for(;;)
+  {
+    child_index = 2 * index + 1;
+    if(child_index >= heap->len)
+      break;
+
+    child = (InfIoTimeout*)heap->pdata[child_index];
+    if(child_index + 1 < heap->len &&
+       inf_standalone_io_timeout_before(heap->pdata[child_index + 1], child))
+    {
+      ++child_index;
+      child = (InfIoTimeout*)heap->pdata[child_index];
+    }
+
+    if(!inf_standalone_io_timeout_before(child, timeout))
+      break;
+
+    inf_standalone_io_timeout_heap_set(heap, index, child);
+    index = child_index;
+  }
+
+  inf_standalone_io_timeout_heap_set(heap, index, timeout);
+}
+
+static void
+inf_standalone_io_timeout_heap_remove(GPtrArray* heap,
+                                      guint index)
+{
+  InfIoTimeout* moved;
+
+  /* This moves the last element into the gap */
+  g_ptr_array_remove_index_fast(heap, index);
+
+  if(index < heap->len)
+  {
+    moved = (InfIoTimeout*)heap->pdata[index];
+    moved->index = index;
+
+    if(index > 0 &&
+       inf_standalone_io_timeout_before(moved, heap->pdata[(index - 1) / 2]))
+    {
+      inf_standalone_io_timeout_heap_up(heap, index);
+    }
+    else
+    {
+      inf_standalone_io_timeout_heap_down(heap, index);
+    }
+  }
+}
+
+static long
+inf_standalone_io_native_events(InfIoEvent events)
+{
+  long pevents;
 
+  pevents = 0;
 #ifdef G_OS_WIN32
-  gchar* error_message;
-  WSANETWORKEVENTS wsa_events;
-  const InfStandaloneIoEventTableEntry* entry;
+  if(events & INF_IO_INCOMING)
+    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
+  if(events & INF_IO_OUTGOING)
+    pevents |= (FD_WRITE | FD_CONNECT);
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+  /* EPOLLERR and EPOLLHUP are always reported */
+  if(events & INF_IO_INCOMING)
+    pevents |= EPOLLIN;
+  if(events & INF_IO_OUTGOING)
+    pevents |= EPOLLOUT;
+  if(events & INF_IO_ERROR)
+    pevents |= EPOLLPRI;
 #else
+  if(events & INF_IO_INCOMING)
+    pevents |= POLLIN;
+  if(events & INF_IO_OUTGOING)
+    pevents |= POLLOUT;
+  if(events & INF_IO_ERROR)
+    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
+#endif
+
+  return pevents;
+}
+
+static gboolean
+inf_standalone_io_has_watch(InfStandaloneIo* io,
+                            InfIoWatch* watch)
+{
+  InfStandaloneIoPrivate* priv;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* A watch that was removed while its callback was running keeps its old
+   * index, but another watch, if any, has taken its place by now. */
+  return watch->index < priv->n_watches &&
+         priv->watches[watch->index] == watch;
+}
+
+#ifndef INF_STANDALONE_IO_USE_EPOLL
+static InfIoWatch*
+inf_standalone_io_find_watch_by_socket(InfStandaloneIo* io,
+                                       InfNativeSocket* socket)
+{
+  InfStandaloneIoPrivate* priv;
+  guint i;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  for(i = 0; i < priv->n_watches; ++i)
+    if(priv->watches[i]->socket == socket)
+      return priv->watches[i];
+
+  return NULL;
+}
+#endif
+
+/* Makes room for one more watch in the watches array (and, without epoll,
+ * the events array). */
+static void
+inf_standalone_io_reserve_watch(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  if(priv->n_watches == priv->watches_alloc)
+  {
+    priv->watches_alloc *= 2;
+
+    priv->watches = g_realloc(
+      priv->watches,
+      priv->watches_alloc * sizeof(InfIoWatch*)
+    );
+
+#ifndef INF_STANDALONE_IO_USE_EPOLL
+    priv->events = g_realloc(
+      priv->events,
+      (priv->watches_alloc + 1) * sizeof(InfStandaloneIoNativeEvent)
+    );
+#endif
+  }
+}
+
+#ifndef G_OS_WIN32
+static void
+inf_standalone_io_read_wakeup(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
   ssize_t ret;
   char buf[1];
-#endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
-  /* Find number of milliseconds to wait */
-  if(priv->dispatchs != NULL)
+  ret = read(priv->wakeup_pipe[0], &buf, 1);
+  if(ret == -1)
   {
-    /* TODO: Don't even poll */
-    timeout = 0;
+    g_warning(
+      "read() on wakeup pipe failed: %s",
+      strerror(errno)
+    );
+
+    /* TODO: Is there anything we could do here?
+     * Try to re-establish pipe? */
+  }
+  else if(ret == 0)
+  {
+    g_warning("Wakeup pipe received EOF");
+    /* TODO: Is there anything we could do here?
+     * Try to re-establish pipe? */
   }
   else
   {
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
-    {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
-
-      if(elapsed >= cur_timeout->msecs)
-      {
-        /* already elapsed */
-        /* TODO: Don't even poll */
-        timeout = 0;
-        /* no need to check other timeouts */
-        break;
-      }
-      else
-      {
-        if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
-           cur_timeout->msecs - elapsed < (guint)timeout)
-        {
-          timeout = cur_timeout->msecs - elapsed;
-        }
-      }
-    }
+    /* this is what we send as wakeup call */
+    g_assert(buf[0] == 'c');
   }
+}
+#endif
+
+/* Waits at most timeout milliseconds for a watch to become ready, and
+ * returns it together with the events that occurred. Returns NULL if no
+ * watch became ready, for example because the main loop was woken up
+ * instead. Call this only with the mutex locked. */
+#ifdef G_OS_WIN32
+static InfIoWatch*
+inf_standalone_io_wait(InfStandaloneIo* io,
+                       InfStandaloneIoPollTimeout timeout,
+                       InfIoEvent* events)
+{
+  InfStandaloneIoPrivate* priv;
+  InfStandaloneIoPollResult result;
+  InfIoWatch* watch;
+  gchar* error_message;
+  WSANETWORKEVENTS wsa_events;
+  const InfStandaloneIoEventTableEntry* entry;
+  guint i;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
 
   priv->polling = TRUE;
   g_mutex_unlock(&priv->mutex);
 
-  result = inf_standalone_io_poll(priv->events, priv->fd_size, timeout);
+  result = inf_standalone_io_poll(priv->events, priv->n_watches + 1, timeout);
 
   g_mutex_lock(&priv->mutex);
   priv->polling = FALSE;
 
-#ifdef G_OS_WIN32
   switch(result)
   {
   case WSA_WAIT_FAILED:
     error_message = g_win32_error_message(WSAGetLastError());
     g_warning("WSAWaitForMultipleEvents() failed: %s\n", error_message);
     g_free(error_message);
-    return;
+    return NULL;
   case WSA_WAIT_IO_COMPLETION:
-    return;
+  case WSA_WAIT_TIMEOUT:
+    return NULL;
   default:
     break;
   }
-#else
+
+  if(result < WSA_WAIT_EVENT_0 ||
+     result >= WSA_WAIT_EVENT_0 + priv->n_watches + 1)
+  {
+    return NULL;
+  }
+
+  if(result == WSA_WAIT_EVENT_0)
+  {
+    /* wakeup call */
+    WSAResetEvent(priv->events[0]);
+    return NULL;
+  }
+
+  watch = priv->watches[result - WSA_WAIT_EVENT_0 - 1];
+
+  if(WSAEnumNetworkEvents(*watch->socket, priv->events[watch->index + 1],
+                          &wsa_events) == SOCKET_ERROR)
+  {
+    error_message = g_win32_error_message(WSAGetLastError());
+    g_warning("WSAEnumNetworkEvents failed: %s\n", error_message);
+    g_free(error_message);
+
+    *events = INF_IO_ERROR;
+  }
+  else
+  {
+    *events = 0;
+    for(i = 0; i < G_N_ELEMENTS(inf_standalone_io_event_table); ++ i)
+    {
+      entry = &inf_standalone_io_event_table[i];
+      if(wsa_events.lNetworkEvents & entry->flag_val)
+      {
+        *events |= entry->io_val;
+        if(wsa_events.iErrorCode[entry->flag_bit])
+          *events |= INF_IO_ERROR;
+      }
+    }
+  }
+
+  return watch;
+}
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+/* Fills the ready array with new events from the kernel */
+static void
+inf_standalone_io_epoll_wait(InfStandaloneIo* io,
+                             InfStandaloneIoPollTimeout timeout)
+{
+  InfStandaloneIoPrivate* priv;
+  InfIoWatch* watch;
+  GSList* disposed;
+  GSList* item;
+  int result;
+  guint i;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  priv->polling = TRUE;
+  g_mutex_unlock(&priv->mutex);
+
+  result = epoll_wait(
+    priv->epoll_fd,
+    priv->ready,
+    INF_STANDALONE_IO_EPOLL_MAX_EVENTS,
+    timeout
+  );
+
+  g_mutex_lock(&priv->mutex);
+  priv->polling = FALSE;
+
   if(result == -1)
   {
     if(errno != EINTR)
-      g_warning("poll() failed: %s\n", strerror(errno));
+      g_warning("epoll_wait() failed: %s\n", strerror(errno));
 
-    return;
+    result = 0;
   }
-#endif
 
-  if(result == INF_STANDALONE_IO_POLL_TIMEOUT)
+  priv->n_ready = result;
+  priv->ready_pos = 0;
+
+  if(priv->disposed_watches != NULL)
   {
-    /* No file descriptor is active, so check whether a timeout elapsed */
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    for(i = 0; i < priv->n_ready; ++i)
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
-      if(elapsed >= cur_timeout->msecs)
-      {
-        priv->timeouts = g_list_delete_link(priv->timeouts, item);
-        g_mutex_unlock(&priv->mutex);
+      watch = (InfIoWatch*)priv->ready[i].data.ptr;
+      if(watch != NULL && (gpointer)watch != priv && watch->disposed)
+        priv->ready[i].data.ptr = NULL;
+    }
 
-        cur_timeout->func(cur_timeout->user_data);
-        if(cur_timeout->notify)
-          cur_timeout->notify(cur_timeout->user_data);
-        g_slice_free(InfIoTimeout, cur_timeout);
+    disposed = priv->disposed_watches;
+    priv->disposed_watches = NULL;
+    g_mutex_unlock(&priv->mutex);
 
-        g_mutex_lock(&priv->mutex);
-        return;
-      }
+    for(item = disposed; item != NULL; item = g_slist_next(item))
+    {
+      watch = (InfIoWatch*)item->data;
+      if(watch->notify) watch->notify(watch->user_data);
+      g_slice_free(InfIoWatch, watch);
     }
+
+    g_slist_free(disposed);
+    g_mutex_lock(&priv->mutex);
   }
-#ifdef G_OS_WIN32
-  else if(result >= WSA_WAIT_EVENT_0 &&
-          result < WSA_WAIT_EVENT_0 + priv->fd_size)
+}
+
+static InfIoWatch*
+inf_standalone_io_wait(InfStandaloneIo* io,
+                       InfStandaloneIoPollTimeout timeout,
+                       InfIoEvent* events)
+{
+  InfStandaloneIoPrivate* priv;
+  struct epoll_event* event;
+  InfIoWatch* watch;
+  gboolean waited;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* Only ask the kernel again once all previously reported events have
+   * been processed. Since epoll is level-triggered, anything we do not get
+   * to in this round is reported again in the next one. If the remaining
+   * events all turn out to be stale, then we wait for new ones. */
+  waited = FALSE;
+  for(;;)
   {
-    if(result == WSA_WAIT_EVENT_0)
+    if(priv->ready_pos == priv->n_ready)
     {
-      /* wakeup call */
-      WSAResetEvent(priv->events[0]);
+      if(waited)
+        return NULL;
+
+      inf_standalone_io_epoll_wait(io, timeout);
+      waited = TRUE;
+      continue;
     }
-    else
+
+    event = &priv->ready[priv->ready_pos++];
+
+    /* The wakeup pipe is registered with the private data as its data */
+    if(event->data.ptr == priv)
     {
-      watch = priv->watches[result - WSA_WAIT_EVENT_0 - 1];
+      if(event->events & (EPOLLERR | EPOLLHUP))
+        g_warning("Error condition on wakeup pipe");
+      else
+        inf_standalone_io_read_wakeup(io);
 
-      if(WSAEnumNetworkEvents(*watch->socket, *watch->event, &wsa_events) ==
-         SOCKET_ERROR)
-      {
-        error_message = g_win32_error_message(WSAGetLastError());
-        g_warning("WSAEnumNetworkEvents failed: %s\n", error_message);
-        g_free(error_message);
+      continue;
+    }
+
+    /* Removed since the event was reported */
+    watch = (InfIoWatch*)event->data.ptr;
+    if(watch == NULL)
+      continue;
+
+    *events = 0;
+    if(event->events & EPOLLIN)
+      *events |= INF_IO_INCOMING;
+    if(event->events & EPOLLOUT)
+      *events |= INF_IO_OUTGOING;
+    /* We treat EPOLLPRI as error because it should not occur in
+     * infinote. */
+    if(event->events & (EPOLLERR | EPOLLPRI | EPOLLHUP))
+      *events |= INF_IO_ERROR;
+
+    /* The watch might have been updated since the event was reported */
+    *events &= watch->events | INF_IO_ERROR;
+    if(*events != 0)
+      return watch;
+  }
+}
+#else
+static InfIoWatch*
+inf_standalone_io_wait(InfStandaloneIo* io,
+                       InfStandaloneIoPollTimeout timeout,
+                       InfIoEvent* events)
+{
+  InfStandaloneIoPrivate* priv;
+  InfStandaloneIoPollResult result;
+  short revents;
+  guint i;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
 
-        events = INF_IO_ERROR;
+  priv->polling = TRUE;
+  g_mutex_unlock(&priv->mutex);
+
+  result = inf_standalone_io_poll(priv->events, priv->n_watches + 1, timeout);
+
+  g_mutex_lock(&priv->mutex);
+  priv->polling = FALSE;
+
+  if(result == -1)
+  {
+    if(errno != EINTR)
+      g_warning("poll() failed: %s\n", strerror(errno));
+
+    return NULL;
+  }
+
+  for(i = 0; i < priv->n_watches + 1 && result > 0; ++i)
+  {
+    revents = priv->events[i].revents;
+    if(revents != 0)
+    {
+      --result;
+      priv->events[i].revents = 0;
+
+      *events = 0;
+      if(revents & POLLIN)
+        *events |= INF_IO_INCOMING;
+      if(revents & POLLOUT)
+        *events |= INF_IO_OUTGOING;
+      /* We treat POLLPRI as error because it should not occur in
+       * infinote. */
+      if(revents & (POLLERR | POLLPRI | POLLHUP | POLLNVAL))
+        *events |= INF_IO_ERROR;
+
+      if(i > 0)
+        return priv->watches[i - 1];
+
+      /* wakeup call */
+
+      /* we were not polling for outgoing */
+      g_assert(~*events & INF_IO_OUTGOING);
+      if(*events & INF_IO_ERROR)
+      {
+        /* TODO: Read error from FD? */
+        g_warning("Error condition on wakeup pipe");
+        /* TODO: Is there anything we could do here?
+         * Try to re-establish pipe? */
       }
       else
       {
-        events = 0;
-        for(i = 0; i < G_N_ELEMENTS(inf_standalone_io_event_table); ++ i)
-        {
-          entry = &inf_standalone_io_event_table[i];
-          if(wsa_events.lNetworkEvents & entry->flag_val)
-          {
-            events |= entry->io_val;
-            if(wsa_events.iErrorCode[entry->flag_bit])
-              events |= INF_IO_ERROR;
-          }
-        }
+        inf_standalone_io_read_wakeup(io);
       }
+    }
+  }
 
-      /* protect from removing the watch object via
-       * inf_io_remove_watch() when running the callback. */
-      watch->executing = TRUE;
-      g_mutex_unlock(&priv->mutex);
+  return NULL;
+}
+#endif
 
-      watch->func(watch->socket, events, watch->user_data);
+/* Run one iteration of the main loop. Call this only with the mutex locked
+ * and a local reference added to io. */
+static void
+inf_standalone_io_iteration_impl(InfStandaloneIo* io,
+                                 InfStandaloneIoPollTimeout timeout)
+{
+  InfStandaloneIoPrivate* priv;
+  InfIoEvent events;
+  InfIoWatch* watch;
+  InfIoTimeout* cur_timeout;
+  InfIoDispatch* dispatch;
+  gint64 remaining;
 
-      g_mutex_lock(&priv->mutex);
-      watch->executing = FALSE;
-      if(watch->disposed == TRUE)
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+
+  /* Find number of milliseconds to wait. The first timeout in the heap is
+   * the one that elapses first. */
+  if(priv->dispatchs != NULL)
+  {
+    /* TODO: Don't even poll */
+    timeout = 0;
+  }
+  else if(priv->timeouts->len > 0)
+  {
+    cur_timeout = (InfIoTimeout*)g_ptr_array_index(priv->timeouts, 0);
+    remaining = cur_timeout->expiry - g_get_monotonic_time();
+
+    if(remaining <= 0)
+    {
+      /* already elapsed */
+      /* TODO: Don't even poll */
+      timeout = 0;
+    }
+    else
+    {
+      /* Round up, so that we do not wake up right before the timeout
+       * elapses and then have to wait again. */
+      remaining = MIN((remaining + 999) / 1000, G_MAXINT);
+
+      if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
+         remaining < (gint64)timeout)
       {
-        g_mutex_unlock(&priv->mutex);
-        if(watch->notify) watch->notify(watch->user_data);
-        g_slice_free(InfIoWatch, watch);
-        g_mutex_lock(&priv->mutex);
+        timeout = (InfStandaloneIoPollTimeout)remaining;
       }
+    }
+  }
 
-      return;
+  watch = inf_standalone_io_wait(io, timeout, &events);
+  if(watch != NULL)
+  {
+    /* protect from removing the watch object via
+     * inf_io_remove_watch() when running the callback. */
+    watch->executing = TRUE;
+    g_mutex_unlock(&priv->mutex);
+
+    watch->func(watch->socket, events, watch->user_data);
+
+    g_mutex_lock(&priv->mutex);
+    watch->executing = FALSE;
+    if(watch->disposed == TRUE)
+    {
+      g_mutex_unlock(&priv->mutex);
+      if(watch->notify) watch->notify(watch->user_data);
+      g_slice_free(InfIoWatch, watch);
+      g_mutex_lock(&priv->mutex);
     }
+
+    return;
   }
-#else
-  else if(result > 0)
+
+  /* No file descriptor is active, so check whether a timeout elapsed */
+  if(priv->timeouts->len > 0)
   {
-    while(result--)
+    cur_timeout = (InfIoTimeout*)g_ptr_array_index(priv->timeouts, 0);
+    if(cur_timeout->expiry <= g_get_monotonic_time())
     {
-      for(i = 0; i < priv->fd_size; ++ i)
-      {
-        if(priv->events[i].revents != 0)
-        {
-          events = 0;
-          if(priv->events[i].revents & POLLIN)
-            events |= INF_IO_INCOMING;
-          if(priv->events[i].revents & POLLOUT)
-            events |= INF_IO_OUTGOING;
-          /* We treat POLLPRI as error because it should not occur in
-           * infinote. */
-          if(priv->events[i].revents & (POLLERR | POLLPRI | POLLHUP | POLLNVAL))
-            events |= INF_IO_ERROR;
-
-          priv->events[i].revents = 0;
-
-          if(i == 0)
-          {
-            /* wakeup call */
-
-            /* we were not polling for outgoing */
-            g_assert(~events & INF_IO_OUTGOING);
-            if(events & INF_IO_ERROR)
-            {
-              /* TODO: Read error from FD? */
-              g_warning("Error condition on wakeup pipe");
-              /* TODO: Is there anything we could do here?
-               * Try to re-establish pipe? */
-            }
-            else
-            {
-              ret = read(priv->events[0].fd, &buf, 1);
-              if(ret == -1)
-              {
-                g_warning(
-                  "read() on wakeup pipe failed: %s",
-                  strerror(errno)
-                );
-
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else if(ret == 0)
-              {
-                g_warning("Wakeup pipe received EOF");
-                /* TODO: Is there anything we could do here?
-                 * Try to re-establish pipe? */
-              }
-              else
-              {
-                /* this is what we send as wakeup call */
-                g_assert(buf[0] == 'c');
-              }
-            }
-          }
-          else
-          {
-            watch = priv->watches[i-1];
-
-            /* protect from removing the watch object via
-             * inf_io_remove_watch() when running the callback. */
-            watch->executing = TRUE;
-            g_mutex_unlock(&priv->mutex);
-
-            watch->func(watch->socket, events, watch->user_data);
-
-            g_mutex_lock(&priv->mutex);
-            watch->executing = FALSE;
-            if(watch->disposed == TRUE)
-            {
-              g_mutex_unlock(&priv->mutex);
-              if(watch->notify) watch->notify(watch->user_data);
-              g_slice_free(InfIoWatch, watch);
-              g_mutex_lock(&priv->mutex);
-            }
-
-            return;
-          }
-        }
-      }
+      inf_standalone_io_timeout_heap_remove(priv->timeouts, 0);
+      g_mutex_unlock(&priv->mutex);
+
+      cur_timeout->func(cur_timeout->user_data);
+      if(cur_timeout->notify)
+        cur_timeout->notify(cur_timeout->user_data);
+      g_slice_free(InfIoTimeout, cur_timeout);
+
+      g_mutex_lock(&priv->mutex);
+      return;
     }
   }
-#endif
 
   /* neither timeout nor IO fired, so try a dispatched message */
   if(priv->dispatchs != NULL)
@@ -453,17 +816,31 @@ inf_standalone_io_init(InfStandaloneIo* io)
 
 #ifdef G_OS_WIN32
   gchar* error_message;
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+  struct epoll_event event;
 #endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_init(&priv->mutex);
 
-  priv->fd_size = 0;
-  priv->fd_alloc = 4;
+  priv->n_watches = 0;
+  priv->watches_alloc = 4;
+  priv->watches = g_malloc(sizeof(InfIoWatch*) * priv->watches_alloc);
 
-  priv->events =
-    g_malloc(sizeof(InfStandaloneIoNativeEvent) * priv->fd_alloc);
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+  priv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(priv->epoll_fd == -1)
+    g_error("Failed to create epoll instance: %s", strerror(errno));
+
+  priv->n_ready = 0;
+  priv->ready_pos = 0;
+  priv->disposed_watches = NULL;
+#else
+  priv->events = g_malloc(
+    sizeof(InfStandaloneIoNativeEvent) * (priv->watches_alloc + 1)
+  );
+#endif
 
 #ifdef G_OS_WIN32
   priv->events[0] = WSACreateEvent();
@@ -473,10 +850,6 @@ inf_standalone_io_init(InfStandaloneIo* io)
     g_error("Failed to create wakeup event: %s", error_message);
     g_free(error_message); /* will not be called since g_error abort()s */
   }
-  else
-  {
-    ++priv->fd_size;
-  }
 #else
   if(pipe(priv->wakeup_pipe) == -1)
   {
@@ -484,15 +857,25 @@ inf_standalone_io_init(InfStandaloneIo* io)
   }
   else
   {
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+    event.events = EPOLLIN;
+    event.data.ptr = priv;
+
+    if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, priv->wakeup_pipe[0],
+                 &event) == -1)
+    {
+      g_error("Failed to watch wakeup pipe: %s", strerror(errno));
+    }
+#else
     priv->events[0].fd = priv->wakeup_pipe[0];
     priv->events[0].events = POLLIN | POLLERR;
     priv->events[0].revents = 0;
-    ++priv->fd_size;
+#endif
   }
 #endif
 
-  priv->watches = g_malloc(sizeof(InfIoWatch*) * (priv->fd_alloc - 1) );
-  priv->timeouts = NULL;
+  priv->timeouts = g_ptr_array_new();
+  priv->timeout_serial = 0;
   priv->dispatchs = NULL;
 
   priv->polling = FALSE;
@@ -512,22 +895,25 @@ inf_standalone_io_finalize(GObject* object)
 #ifdef G_OS_WIN32
   gchar* error_message;
 #endif
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+  GSList* disposed_item;
+#endif
 
   io = INF_STANDALONE_IO(object);
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  for(i = 1; i < priv->fd_size; ++i)
+  for(i = 0; i < priv->n_watches; ++i)
   {
-    watch = priv->watches[i - 1];
+    watch = priv->watches[i];
 
     /* cannot dispose the IO while running a callback since the IO is
      * reffed on the stack. */
     g_assert(watch->executing == FALSE);
 
 #ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, 0) ==
+    if(WSAEventSelect(*watch->socket, priv->events[i + 1], 0) ==
        SOCKET_ERROR)
     {
       error_message = g_win32_error_message(WSAGetLastError());
@@ -541,9 +927,23 @@ inf_standalone_io_finalize(GObject* object)
     g_slice_free(InfIoWatch, watch);
   }
 
-  for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+  for(disposed_item = priv->disposed_watches;
+      disposed_item != NULL;
+      disposed_item = g_slist_next(disposed_item))
   {
-    timeout = (InfIoTimeout*)item->data;
+    watch = (InfIoWatch*)disposed_item->data;
+    if(watch->notify)
+      watch->notify(watch->user_data);
+    g_slice_free(InfIoWatch, watch);
+  }
+
+  g_slist_free(priv->disposed_watches);
+#endif
+
+  for(i = 0; i < priv->timeouts->len; ++i)
+  {
+    timeout = (InfIoTimeout*)g_ptr_array_index(priv->timeouts, i);
     if(timeout->notify)
       timeout->notify(timeout->user_data);
     g_slice_free(InfIoTimeout, timeout);
@@ -558,7 +958,7 @@ inf_standalone_io_finalize(GObject* object)
   }
 
 #ifdef G_OS_WIN32
-  for(i = 0; i < priv->fd_size; ++ i)
+  for(i = 0; i < priv->n_watches + 1; ++ i)
   {
     if(WSACloseEvent(priv->events[i]) == FALSE)
     {
@@ -569,9 +969,15 @@ inf_standalone_io_finalize(GObject* object)
   }
 #endif
 
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+  if(close(priv->epoll_fd) == -1)
+    g_warning("Failed to close epoll instance: %s", strerror(errno));
+#else
   g_free(priv->events);
+#endif
+
   g_free(priv->watches);
-  g_list_free(priv->timeouts);
+  g_ptr_array_free(priv->timeouts, TRUE);
   g_list_free(priv->dispatchs);
 
 #ifndef G_OS_WIN32
@@ -598,43 +1004,13 @@ inf_standalone_io_finalize(GObject* object)
   G_OBJECT_CLASS(inf_standalone_io_parent_class)->finalize(object);
 }
 
-static InfIoWatch**
-inf_standalone_io_find_watch(InfStandaloneIo* io,
-                             InfIoWatch* watch)
-{
-  InfStandaloneIoPrivate* priv;
-  guint i;
-
-  priv = INF_STANDALONE_IO_PRIVATE(io);
-  for(i = 1; i < priv->fd_size; ++i)
-    if(priv->watches[i-1] == watch)
-      return &priv->watches[i-1];
-
-  return NULL;
-
-}
-
-static InfIoWatch**
-inf_standalone_io_find_watch_by_socket(InfStandaloneIo* io,
-                                       InfNativeSocket* socket)
-{
-  InfStandaloneIoPrivate* priv;
-  guint i;
-
-  priv = INF_STANDALONE_IO_PRIVATE(io);
-  for(i = 1; i < priv->fd_size; ++i)
-    if(priv->watches[i-1]->socket == socket)
-      return &priv->watches[i-1];
-
-  return NULL;
-}
-
 static void
 inf_standalone_io_wakeup(InfStandaloneIo* io)
 {
   /* Wake up the main loop in case it is currently sleeping. This function is
    * called whenever a watch changes or a timeout or dispatch is added, so
-   * that the new event is taken into account. */
+   * that the new event is taken into account. With epoll, changes to
+   * watches take effect immediately, so it is not called for them. */
   /* Should only ever be called with the IO's mutex being locked. */
   /* TODO: Turn this into a noop if called from the same thread the loop
    * runs in? */
@@ -700,107 +1076,103 @@ inf_standalone_io_io_add_watch(InfIo* io,
   InfStandaloneIoPrivate* priv;
   InfIoWatch* watch;
   long pevents;
-  guint i;
 
 #ifdef G_OS_WIN32
+  InfStandaloneIoNativeEvent event;
   gchar* error_message;
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+  struct epoll_event event;
 #endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
+  pevents = inf_standalone_io_native_events(events);
 
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
-#endif
+  watch = g_slice_new(InfIoWatch);
+  watch->socket = socket;
+  watch->func = func;
+  watch->user_data = user_data;
+  watch->notify = notify;
+  watch->executing = FALSE;
+  watch->disposed = FALSE;
 
   g_mutex_lock(&priv->mutex);
 
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+  watch->fd = *socket;
+  watch->events = events;
+
+  event.events = pevents;
+  event.data.ptr = watch;
+
+  /* The kernel tells us if the socket is being watched already */
+  if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, *socket, &event) == -1)
+  {
+    if(errno != EEXIST)
+      g_warning("epoll_ctl() failed: %s", strerror(errno));
+
+    g_mutex_unlock(&priv->mutex);
+    g_slice_free(InfIoWatch, watch);
+    return NULL;
+  }
+#else
   /* Watching the same socket for different events at least won't work on
    * Windows since WSAEventSelect cancels the effect of previous
    * WSAEventSelect calls for the same socket. */
   if(inf_standalone_io_find_watch_by_socket(INF_STANDALONE_IO(io), socket))
   {
     g_mutex_unlock(&priv->mutex);
+    g_slice_free(InfIoWatch, watch);
     return NULL;
   }
 
   /* TODO: If we are currently polling we should not modify the fds array
    * array but do this after wakeup directly after the poll call. */
 
-  /* Socket is not already present, so create new watch */
-  if(priv->fd_size == priv->fd_alloc)
-  {
-    priv->fd_alloc += 4;
-
-    priv->events = g_realloc(
-      priv->events,
-      priv->fd_alloc * sizeof(InfStandaloneIoNativeEvent)
-    );
-
-    priv->watches = g_realloc(
-      priv->watches,
-      (priv->fd_alloc - 1) * sizeof(InfIoWatch*)
-    );
-
-    /* Update event pointers, the location of the events in memory might have
-     * changed after realloc. */
-    for(i = 1; i < priv->fd_size; ++i)
-      priv->watches[i-1]->event = &priv->events[i];
-  }
-
 #ifdef G_OS_WIN32
-  priv->events[priv->fd_size] = WSACreateEvent();
-  if(priv->events[priv->fd_size] == WSA_INVALID_EVENT)
+  event = WSACreateEvent();
+  if(event == WSA_INVALID_EVENT)
   {
     error_message = g_win32_error_message(WSAGetLastError());
     g_warning("WSACreateEvent() failed: %s", error_message);
     g_free(error_message);
 
     g_mutex_unlock(&priv->mutex);
+    g_slice_free(InfIoWatch, watch);
     return NULL;
   }
 
-  if(WSAEventSelect(*socket, priv->events[priv->fd_size], pevents) ==
-     SOCKET_ERROR)
+  if(WSAEventSelect(*socket, event, pevents) == SOCKET_ERROR)
   {
     error_message = g_win32_error_message(WSAGetLastError());
     g_warning("WSAEventSelect() failed: %s", error_message);
     g_free(error_message);
 
-    WSACloseEvent(priv->events[priv->fd_size]);
+    WSACloseEvent(event);
     g_mutex_unlock(&priv->mutex);
+    g_slice_free(InfIoWatch, watch);
     return NULL;
   }
-#else
-  priv->events[priv->fd_size].fd = *socket;
-  priv->events[priv->fd_size].events = pevents;
-  priv->events[priv->fd_size].revents = 0;
+#endif
 #endif
 
-  watch = g_slice_new(InfIoWatch);
-  watch->event = &priv->events[priv->fd_size];
-  watch->socket = socket;
-  watch->func = func;
-  watch->user_data = user_data;
-  watch->notify = notify;
-  watch->executing = FALSE;
-  watch->disposed = FALSE;
+  /* Socket is not already present, so add the new watch */
+  inf_standalone_io_reserve_watch(INF_STANDALONE_IO(io));
 
-  priv->watches[priv->fd_size-1] = watch;
-  ++priv->fd_size;
+#ifdef G_OS_WIN32
+  priv->events[priv->n_watches + 1] = event;
+#elif !defined(INF_STANDALONE_IO_USE_EPOLL)
+  priv->events[priv->n_watches + 1].fd = *socket;
+  priv->events[priv->n_watches + 1].events = pevents;
+  priv->events[priv->n_watches + 1].revents = 0;
+#endif
 
+  watch->index = priv->n_watches;
+  priv->watches[priv->n_watches] = watch;
+  ++priv->n_watches;
+
+#ifndef INF_STANDALONE_IO_USE_EPOLL
   inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+#endif
   g_mutex_unlock(&priv->mutex);
 
   return watch;
@@ -812,52 +1184,49 @@ inf_standalone_io_io_update_watch(InfIo* io,
                                   InfIoEvent events)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoWatch** watch_iter;
   long pevents;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+  struct epoll_event event;
 #endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
-
-#ifdef G_OS_WIN32
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= (FD_READ | FD_ACCEPT | FD_CLOSE);
-  if(events & INF_IO_OUTGOING)
-    pevents |= (FD_WRITE | FD_CONNECT);
-#else
-  pevents = 0;
-  if(events & INF_IO_INCOMING)
-    pevents |= POLLIN;
-  if(events & INF_IO_OUTGOING)
-    pevents |= POLLOUT;
-  if(events & INF_IO_ERROR)
-    pevents |= (POLLERR | POLLHUP | POLLNVAL | POLLPRI);
-#endif
+  pevents = inf_standalone_io_native_events(events);
 
   g_mutex_lock(&priv->mutex);
 
-  watch_iter = inf_standalone_io_find_watch(INF_STANDALONE_IO(io), watch);
-  if(watch_iter != NULL)
+  if(inf_standalone_io_has_watch(INF_STANDALONE_IO(io), watch))
   {
-    /* TODO: If we are currently polling we should not modify the fds array
-     * array but do this after wakeup directly after the poll call. */
-
     /* Update */
 #ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, pevents) == SOCKET_ERROR)
+    if(WSAEventSelect(*watch->socket, priv->events[watch->index + 1],
+                      pevents) == SOCKET_ERROR)
     {
       error_message = g_win32_error_message(WSAGetLastError());
       g_warning("WSAEventSelect() failed: %s", error_message);
       g_free(error_message);
     }
-#else
-    watch->event->events = pevents;
-#endif
 
     inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+    if(watch->events != events)
+    {
+      event.events = pevents;
+      event.data.ptr = watch;
+
+      if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_MOD, watch->fd, &event) == -1)
+        g_warning("epoll_ctl() failed: %s", strerror(errno));
+
+      watch->events = events;
+    }
+#else
+    /* TODO: If we are currently polling we should not modify the fds array
+     * array but do this after wakeup directly after the poll call. */
+    priv->events[watch->index + 1].events = pevents;
+    inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+#endif
   }
 
   g_mutex_unlock(&priv->mutex);
@@ -868,38 +1237,75 @@ inf_standalone_io_io_remove_watch(InfIo* io,
                                   InfIoWatch* watch)
 {
   InfStandaloneIoPrivate* priv;
-  InfIoWatch** watch_iter;
+  InfIoWatch* last;
   guint index;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+  guint i;
 #endif
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  watch_iter = inf_standalone_io_find_watch(INF_STANDALONE_IO(io), watch);
-  if(watch_iter != NULL)
+  if(inf_standalone_io_has_watch(INF_STANDALONE_IO(io), watch))
   {
+    index = watch->index;
+
 #ifdef G_OS_WIN32
-    if(WSAEventSelect(*watch->socket, *watch->event, 0) == SOCKET_ERROR)
+    if(WSAEventSelect(*watch->socket, priv->events[index + 1], 0) ==
+       SOCKET_ERROR)
     {
       error_message = g_win32_error_message(WSAGetLastError());
       g_warning("WSAEventSelect() failed: %s", error_message);
       g_free(error_message);
     }
 
-    if(WSACloseEvent(*watch->event) == FALSE)
+    if(WSACloseEvent(priv->events[index + 1]) == FALSE)
     {
       error_message = g_win32_error_message(WSAGetLastError());
       g_warning("WSACloseEvent() failed: %s", error_message);
       g_free(error_message);
     }
+#elif defined(INF_STANDALONE_IO_USE_EPOLL)
+    /* If the socket has been closed already, then the kernel has removed
+     * it from the epoll set by itself. */
+    if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL) == -1 &&
+       errno != EBADF && errno != ENOENT)
+    {
+      g_warning("epoll_ctl() failed: %s", strerror(errno));
+    }
+
+    /* Drop events for this watch that have been reported but not yet
+     * processed. */
+    for(i = priv->ready_pos; i < priv->n_ready; ++i)
+      if(priv->ready[i].data.ptr == watch)
+        priv->ready[i].data.ptr = NULL;
 #endif
 
+    /* Remove watch by replacing it by the last watch */
     /* TODO: If we are currently polling we should not modify the fds array
      * array but do this after wakeup directly after the poll call. */
+    if(index != priv->n_watches - 1)
+    {
+      last = priv->watches[priv->n_watches - 1];
+
+#ifndef INF_STANDALONE_IO_USE_EPOLL
+      memcpy(
+        &priv->events[index + 1],
+        &priv->events[priv->n_watches],
+        sizeof(InfStandaloneIoNativeEvent)
+      );
+#endif
+
+      priv->watches[index] = last;
+      last->index = index;
+    }
+
+    --priv->n_watches;
+
     if(watch->executing)
     {
       /* The callback of the watch is currently running. We don't want to
@@ -908,6 +1314,17 @@ inf_standalone_io_io_remove_watch(InfIo* io,
        * user_data and the InfIoWatch struct. */
       watch->disposed = TRUE;
     }
+#ifdef INF_STANDALONE_IO_USE_EPOLL
+    else if(priv->polling)
+    {
+      /* Another thread is waiting for events, and the kernel might just
+       * be reporting one for this watch. The waiting thread frees it
+       * when it wakes up. */
+      watch->disposed = TRUE;
+      priv->disposed_watches = g_slist_prepend(priv->disposed_watches, watch);
+      inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+    }
+#endif
     else
     {
       /* Free user_data */
@@ -916,28 +1333,9 @@ inf_standalone_io_io_remove_watch(InfIo* io,
       g_slice_free(InfIoWatch, watch);
     }
 
-    /* Remove watch by replacing it by the last pollfd/watch */
-    index = 1 + (watch_iter - priv->watches);
-    if(index != priv->fd_size - 1)
-    {
-      memcpy(
-        &priv->events[index],
-        &priv->events[priv->fd_size - 1],
-        sizeof(InfStandaloneIoNativeEvent)
-      );
-
-      memcpy(
-        &priv->watches[index - 1],
-        &priv->watches[priv->fd_size - 2],
-        sizeof(InfIoWatch*)
-      );
-
-      priv->watches[index - 1]->event = &priv->events[index];
-    }
-
-    --priv->fd_size;
-
+#ifndef INF_STANDALONE_IO_USE_EPOLL
     inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+#endif
   }
 
   g_mutex_unlock(&priv->mutex);
@@ -956,15 +1354,22 @@ inf_standalone_io_io_add_timeout(InfIo* io,
   priv = INF_STANDALONE_IO_PRIVATE(io);
   timeout = g_slice_new(InfIoTimeout);
 
-  g_get_current_time(&timeout->begin);
-  timeout->msecs = msecs;
+  timeout->expiry = g_get_monotonic_time() + (gint64)msecs * 1000;
   timeout->func = func;
   timeout->user_data = user_data;
   timeout->notify = notify;
 
   g_mutex_lock(&priv->mutex);
-  priv->timeouts = g_list_prepend(priv->timeouts, timeout);
-  inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+
+  timeout->serial = priv->timeout_serial++;
+  g_ptr_array_add(priv->timeouts, timeout);
+  inf_standalone_io_timeout_heap_up(priv->timeouts, priv->timeouts->len - 1);
+
+  /* The main loop only needs to wait less long than it currently does if
+   * the new timeout is the next one to elapse. */
+  if(timeout->index == 0)
+    inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+
   g_mutex_unlock(&priv->mutex);
 
   return timeout;
@@ -975,16 +1380,15 @@ inf_standalone_io_io_remove_timeout(InfIo* io,
                                     InfIoTimeout* timeout)
 {
   InfStandaloneIoPrivate* priv;
-  GList* item;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  item = g_list_find(priv->timeouts, timeout);
-  if(item != NULL)
+  if(timeout->index < priv->timeouts->len &&
+     g_ptr_array_index(priv->timeouts, timeout->index) == timeout)
   {
-    priv->timeouts = g_list_delete_link(priv->timeouts, item);
+    inf_standalone_io_timeout_heap_remove(priv->timeouts, timeout->index);
     g_mutex_unlock(&priv->mutex);
 
     if(timeout->notify)
@@ -35,6 +35,28 @@ _inf_tcp_connection_accepted(InfIo* io,
                              const InfKeepalive* keepalive,
                              GError** error);
 
+InfTcpConnection*
+_inf_tcp_connection_accepted_deferred(InfIo* io,
+                                      InfNativeSocket socket,
+                                      InfIpAddress* address,
+                                      guint port,
+                                      const InfKeepalive* keepalive,
+                                      GError** error);
+
+void
+_inf_tcp_connection_accepted_start(InfTcpConnection* connection);
+
+void
+_inf_tcp_connection_detach(InfTcpConnection* connection);
+
+void
+_inf_tcp_connection_attach(InfTcpConnection* connection,
+                           InfIo* io);
+
+void
+_inf_tcp_connection_set_throttled(InfTcpConnection* connection,
+                                  gboolean throttled);
+
 G_END_DECLS
 
 #endif /* __INF_TCP_CONNECTION_PRIVATE_H__ */
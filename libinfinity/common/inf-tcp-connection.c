@@ -38,6 +38,15 @@
  * When the hostname has been resolved and a connection has been made, the
  * #InfTcpConnection:remote-address and #InfTcpConnection:remote-port
  * properties are updated to reflect the address actually connected to.
+ *
+ * Incoming data is read into a buffer that grows while the remote side
+ * keeps it filled and shrinks again when the connection becomes idle, and
+ * outgoing data that could not be sent immediately is transmitted with a
+ * single scatter/gather call for many queued pieces. The
+ * #InfTcpConnection:send-calls and #InfTcpConnection:receive-calls
+ * properties count the system calls made for this, so the number of system
+ * calls per MiB of payload is
+ * <literal>send-calls * 1048576 / bytes-sent</literal>.
  **/
 
 #include <libinfinity/common/inf-tcp-connection.h>
@@ -60,6 +69,7 @@
 # include <netinet/in.h>
 # include <net/if.h>
 # include <arpa/inet.h>
+# include <sys/uio.h>
 # include <unistd.h>
 # include <fcntl.h>
 
@@ -89,11 +99,36 @@ static const GEnumValue inf_tcp_connection_status_values[] = {
   }
 };
 
+/* Size limits of the receive buffer */
+#define INF_TCP_CONNECTION_RECV_MIN 4096
+#define INF_TCP_CONNECTION_RECV_MAX 262144
+
+/* Minimum allocation for a chunk of the send queue */
+#define INF_TCP_CONNECTION_CHUNK_SIZE 16384
+
+/* Maximum number of chunks passed to a single scatter/gather call */
+#define INF_TCP_CONNECTION_MAX_IOV 64
+
+/* A piece of queued outgoing data. The data follows the struct in memory.
+ * Chunks are never reallocated, so that the data can be handed out in
+ * the "sent" signal while more data is being appended. */
+typedef struct _InfTcpConnectionChunk InfTcpConnectionChunk;
+struct _InfTcpConnectionChunk {
+  InfTcpConnectionChunk* next;
+  gsize begin;
+  gsize end;
+  gsize alloc;
+};
+
+#define INF_TCP_CONNECTION_CHUNK_DATA(chunk) \
+  ((guint8*)(chunk) + sizeof(InfTcpConnectionChunk))
+
 typedef struct _InfTcpConnectionPrivate InfTcpConnectionPrivate;
 struct _InfTcpConnectionPrivate {
   InfIo* io;
   InfIoEvent events;
   InfIoWatch* watch;
+  gboolean throttled; /* Whether not to read from the socket */
 
   InfNameResolver* resolver;
   guint resolver_index;
@@ -106,10 +141,18 @@ struct _InfTcpConnectionPrivate {
   guint remote_port;
   unsigned int device_index;
 
-  guint8* queue;
-  gsize front_pos;
-  gsize back_pos;
-  gsize alloc;
+  InfTcpConnectionChunk* queue_head;
+  InfTcpConnectionChunk* queue_tail;
+
+  /* NULL while not allocated or in use. The buffer is only allocated on the
+   * heap if it is larger than INF_TCP_CONNECTION_RECV_MIN. */
+  gchar* recv_buf;
+  gsize recv_size;
+
+  guint64 bytes_sent;
+  guint64 bytes_received;
+  guint64 send_calls;
+  guint64 receive_calls;
 };
 
 enum {
@@ -127,7 +170,13 @@ enum {
   PROP_LOCAL_PORT,
 
   PROP_DEVICE_INDEX,
-  PROP_DEVICE_NAME
+  PROP_DEVICE_NAME,
+
+  PROP_RECEIVE_BUFFER_SIZE,
+  PROP_BYTES_SENT,
+  PROP_BYTES_RECEIVED,
+  PROP_SEND_CALLS,
+  PROP_RECEIVE_CALLS
 };
 
 enum {
@@ -269,6 +318,30 @@ inf_tcp_connection_system_error(InfTcpConnection* connection,
   g_error_free(error);
 }
 
+static void
+inf_tcp_connection_free_chunks(InfTcpConnectionChunk* chunk)
+{
+  InfTcpConnectionChunk* next;
+
+  while(chunk != NULL)
+  {
+    next = chunk->next;
+    g_free(chunk);
+    chunk = next;
+  }
+}
+
+static void
+inf_tcp_connection_clear_queue(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  inf_tcp_connection_free_chunks(priv->queue_head);
+  priv->queue_head = NULL;
+  priv->queue_tail = NULL;
+}
+
 static void
 inf_tcp_connection_io(InfNativeSocket* socket,
                       InfIoEvent events,
@@ -282,10 +355,11 @@ inf_tcp_connection_connected(InfTcpConnection* connection)
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
 
   priv->status = INF_TCP_CONNECTION_CONNECTED;
-  priv->front_pos = 0;
-  priv->back_pos = 0;
+  inf_tcp_connection_clear_queue(connection);
 
-  priv->events = INF_IO_INCOMING | INF_IO_ERROR;
+  priv->events = INF_IO_ERROR;
+  if(!priv->throttled)
+    priv->events |= INF_IO_INCOMING;
 
   if(priv->watch == NULL)
   {
@@ -608,6 +682,7 @@ inf_tcp_connection_send_real(InfTcpConnection* connection,
 
     /* Preserve error code so that it is not modified by future calls */
     errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+    ++priv->send_calls;
 
     if(result < 0 &&
        errcode != INF_NATIVE_SOCKET_EINTR &&
@@ -623,6 +698,7 @@ inf_tcp_connection_send_real(InfTcpConnection* connection,
     }
     else if(result > 0)
     {
+      priv->bytes_sent += result;
       send_data = (const char*)send_data + result;
       send_len -= result;
     }
@@ -638,7 +714,12 @@ static void
 inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 {
   InfTcpConnectionPrivate* priv;
-  gchar buf[2048];
+  gchar stack_buf[INF_TCP_CONNECTION_RECV_MIN];
+  gchar* heap_buf;
+  gchar* buf;
+  gsize size;
+  gsize total;
+  gboolean full;
   int errcode;
   ssize_t result;
 
@@ -646,11 +727,31 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 
   g_assert(priv->status == INF_TCP_CONNECTION_CONNECTED);
 
+  /* Take the receive buffer, so that it is not freed or reused while a
+   * signal handler runs. */
+  heap_buf = priv->recv_buf;
+  priv->recv_buf = NULL;
+  size = priv->recv_size;
+  total = 0;
+
   do
   {
-    result = recv(priv->socket, buf, 2048, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+    if(size > INF_TCP_CONNECTION_RECV_MIN)
+    {
+      if(heap_buf == NULL)
+        heap_buf = g_malloc(size);
+      buf = heap_buf;
+    }
+    else
+    {
+      buf = stack_buf;
+    }
+
+    result = recv(priv->socket, buf, size, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
     errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+    ++priv->receive_calls;
 
+    full = FALSE;
     if(result < 0 &&
        errcode != INF_NATIVE_SOCKET_EINTR &&
        errcode != INF_NATIVE_SOCKET_EAGAIN)
@@ -663,6 +764,10 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
     }
     else if(result > 0)
     {
+      priv->bytes_received += result;
+      total += result;
+      full = ((gsize)result == size);
+
       g_signal_emit(
         G_OBJECT(connection),
         tcp_connection_signals[RECEIVED],
@@ -670,10 +775,210 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
         buf,
         (guint)result
       );
+
+      /* If the buffer has been filled completely, then there is probably
+       * more data waiting, so read the rest in larger pieces. */
+      if(full && size < INF_TCP_CONNECTION_RECV_MAX)
+      {
+        g_free(heap_buf);
+        heap_buf = NULL;
+        size *= 2;
+      }
     }
-  } while( ((result > 0) ||
-            (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
+
+    /* If the buffer has not been filled, then there is nothing left to
+     * read, so we can save the call that would fail with EAGAIN. */
+  } while( (full || (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
            (priv->status != INF_TCP_CONNECTION_CLOSED));
+
+  /* Shrink the buffer again if most of it has not been used */
+  if(size > INF_TCP_CONNECTION_RECV_MIN && total < size / 4)
+  {
+    g_free(heap_buf);
+    heap_buf = NULL;
+    size /= 2;
+  }
+
+  if(priv->status == INF_TCP_CONNECTION_CONNECTED && priv->recv_buf == NULL)
+  {
+    priv->recv_buf = heap_buf;
+    priv->recv_size = size;
+  }
+  else
+  {
+    g_free(heap_buf);
+  }
+}
+
+/* Sends as much of the queue as possible with scatter/gather calls, and
+ * emits the "sent" signal for what has been sent. */
+static void
+inf_tcp_connection_send_queue(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+#ifdef G_OS_WIN32
+  WSABUF bufs[INF_TCP_CONNECTION_MAX_IOV];
+  DWORD sent;
+#else
+  struct iovec bufs[INF_TCP_CONNECTION_MAX_IOV];
+  struct msghdr msg;
+#endif
+  guint n_bufs;
+  gsize requested;
+  gsize remaining;
+  gsize head_begin;
+  int errcode;
+  ssize_t result;
+
+  InfTcpConnectionChunk* chunk;
+  InfTcpConnectionChunk* sent_head;
+  InfTcpConnectionChunk* sent_tail;
+  InfTcpConnectionChunk* partial;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_assert(priv->queue_head != NULL);
+
+  /* Chunks that have been sent completely are moved into this list, with
+   * their begin position where it was before sending. */
+  sent_head = NULL;
+  sent_tail = NULL;
+  head_begin = priv->queue_head->begin;
+
+  do
+  {
+    n_bufs = 0;
+    requested = 0;
+
+    for(chunk = priv->queue_head;
+        chunk != NULL && n_bufs < INF_TCP_CONNECTION_MAX_IOV;
+        chunk = chunk->next)
+    {
+#ifdef G_OS_WIN32
+      bufs[n_bufs].buf =
+        (char*)INF_TCP_CONNECTION_CHUNK_DATA(chunk) + chunk->begin;
+      bufs[n_bufs].len = chunk->end - chunk->begin;
+#else
+      bufs[n_bufs].iov_base =
+        INF_TCP_CONNECTION_CHUNK_DATA(chunk) + chunk->begin;
+      bufs[n_bufs].iov_len = chunk->end - chunk->begin;
+#endif
+      requested += chunk->end - chunk->begin;
+      ++n_bufs;
+    }
+
+#ifdef G_OS_WIN32
+    if(WSASend(priv->socket, bufs, n_bufs, &sent, 0, NULL, NULL) == 0)
+      result = sent;
+    else
+      result = -1;
+#else
+    /* sendmsg() instead of writev(), to be able to pass MSG_NOSIGNAL */
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = bufs;
+    msg.msg_iovlen = n_bufs;
+
+    result = sendmsg(priv->socket, &msg, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+#endif
+
+    errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+    ++priv->send_calls;
+
+    if(result < 0 &&
+       errcode != INF_NATIVE_SOCKET_EINTR &&
+       errcode != INF_NATIVE_SOCKET_EAGAIN)
+    {
+      inf_tcp_connection_system_error(connection, errcode);
+    }
+    else if(result == 0)
+    {
+      inf_tcp_connection_close(connection);
+    }
+    else if(result > 0)
+    {
+      priv->bytes_sent += result;
+
+      for(remaining = result; remaining > 0; )
+      {
+        chunk = priv->queue_head;
+        if(remaining < chunk->end - chunk->begin)
+        {
+          chunk->begin += remaining;
+          remaining = 0;
+        }
+        else
+        {
+          remaining -= chunk->end - chunk->begin;
+
+          priv->queue_head = chunk->next;
+          if(priv->queue_head == NULL)
+            priv->queue_tail = NULL;
+
+          chunk->begin = head_begin;
+          chunk->next = NULL;
+          if(sent_tail != NULL)
+            sent_tail->next = chunk;
+          else
+            sent_head = chunk;
+          sent_tail = chunk;
+
+          if(priv->queue_head != NULL)
+            head_begin = priv->queue_head->begin;
+        }
+      }
+    }
+
+    /* If everything we asked for has been sent, then there might be more
+     * space available for the rest of the queue. */
+  } while( ((result > 0 && (gsize)result == requested) ||
+            (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
+           (priv->queue_head != NULL) &&
+           (priv->status == INF_TCP_CONNECTION_CONNECTED) );
+
+  partial = NULL;
+  if(priv->status == INF_TCP_CONNECTION_CONNECTED)
+  {
+    if(priv->queue_head == NULL)
+    {
+      /* sent everything */
+      priv->events &= ~INF_IO_OUTGOING;
+      inf_io_update_watch(priv->io, priv->watch, priv->events);
+    }
+    else if(priv->queue_head->begin > head_begin)
+    {
+      partial = priv->queue_head;
+    }
+  }
+
+  /* Signal handlers might close the connection, which frees the queue, or
+   * they might enqueue more data. Chunks in the sent list stay valid, so
+   * only stop emitting the signal if the connection has been closed. */
+  for(chunk = sent_head;
+      chunk != NULL && priv->status == INF_TCP_CONNECTION_CONNECTED;
+      chunk = chunk->next)
+  {
+    g_signal_emit(
+      G_OBJECT(connection),
+      tcp_connection_signals[SENT],
+      0,
+      INF_TCP_CONNECTION_CHUNK_DATA(chunk) + chunk->begin,
+      (guint)(chunk->end - chunk->begin)
+    );
+  }
+
+  if(partial != NULL &&
+     priv->status == INF_TCP_CONNECTION_CONNECTED &&
+     priv->queue_head == partial)
+  {
+    g_signal_emit(
+      G_OBJECT(connection),
+      tcp_connection_signals[SENT],
+      0,
+      INF_TCP_CONNECTION_CHUNK_DATA(partial) + head_begin,
+      (guint)(partial->begin - head_begin)
+    );
+  }
+
+  inf_tcp_connection_free_chunks(sent_head);
 }
 
 static void
@@ -684,9 +989,6 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
   socklen_t len;
   int errcode;
 
-  gconstpointer data;
-  guint data_len;
-
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
   switch(priv->status)
   {
@@ -709,35 +1011,10 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
 
     break;
   case INF_TCP_CONNECTION_CONNECTED:
-    g_assert(priv->back_pos < priv->front_pos);
+    g_assert(priv->queue_head != NULL);
     g_assert(priv->events & INF_IO_OUTGOING);
 
-    data = priv->queue + priv->back_pos;
-    data_len = priv->front_pos - priv->back_pos;
-    if(inf_tcp_connection_send_real(connection, data, &data_len) == TRUE)
-    {
-      priv->back_pos += data_len;
-
-      if(priv->front_pos == priv->back_pos)
-      {
-        /* sent everything */
-        priv->front_pos = 0;
-        priv->back_pos = 0;
-
-        priv->events &= ~INF_IO_OUTGOING;
-
-        inf_io_update_watch(priv->io, priv->watch, priv->events);
-      }
-
-      g_signal_emit(
-        G_OBJECT(connection),
-        tcp_connection_signals[SENT],
-        0,
-        data,
-        data_len
-      );
-    }
-
+    inf_tcp_connection_send_queue(connection);
     break;
   case INF_TCP_CONNECTION_CLOSED:
   default:
@@ -900,6 +1177,7 @@ inf_tcp_connection_init(InfTcpConnection* connection)
   priv->io = NULL;
   priv->events = 0;
   priv->watch = NULL;
+  priv->throttled = FALSE;
   priv->resolver = NULL;
   priv->resolver_index = 0;
   priv->status = INF_TCP_CONNECTION_CLOSED;
@@ -910,10 +1188,16 @@ inf_tcp_connection_init(InfTcpConnection* connection)
   priv->remote_port = 0;
   priv->device_index = 0;
 
-  priv->queue = g_malloc(1024);
-  priv->front_pos = 0;
-  priv->back_pos = 0;
-  priv->alloc = 1024;
+  priv->queue_head = NULL;
+  priv->queue_tail = NULL;
+
+  priv->recv_buf = NULL;
+  priv->recv_size = INF_TCP_CONNECTION_RECV_MIN;
+
+  priv->bytes_sent = 0;
+  priv->bytes_received = 0;
+  priv->send_calls = 0;
+  priv->receive_calls = 0;
 }
 
 static void
@@ -954,7 +1238,8 @@ inf_tcp_connection_finalize(GObject* object)
   if(priv->socket != INVALID_SOCKET)
     closesocket(priv->socket);
 
-  g_free(priv->queue);
+  inf_tcp_connection_clear_queue(connection);
+  g_free(priv->recv_buf);
 
   G_OBJECT_CLASS(inf_tcp_connection_parent_class)->finalize(object);
 }
@@ -1158,6 +1443,21 @@ inf_tcp_connection_get_property(GObject* object,
     }
 #endif
     break;
+  case PROP_RECEIVE_BUFFER_SIZE:
+    g_value_set_uint(value, (guint)priv->recv_size);
+    break;
+  case PROP_BYTES_SENT:
+    g_value_set_uint64(value, priv->bytes_sent);
+    break;
+  case PROP_BYTES_RECEIVED:
+    g_value_set_uint64(value, priv->bytes_received);
+    break;
+  case PROP_SEND_CALLS:
+    g_value_set_uint64(value, priv->send_calls);
+    break;
+  case PROP_RECEIVE_CALLS:
+    g_value_set_uint64(value, priv->receive_calls);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1331,6 +1631,110 @@ inf_tcp_connection_class_init(InfTcpConnectionClass* tcp_connection_class)
     )
   );
 
+  /**
+   * InfTcpConnection:receive-buffer-size:
+   *
+   * The current size of the buffer that incoming data is read into. It
+   * grows while every read fills the buffer completely, up to 256 KiB, and
+   * shrinks again when reads use only a small part of it. This property is
+   * not notified when it changes.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_RECEIVE_BUFFER_SIZE,
+    g_param_spec_uint(
+      "receive-buffer-size",
+      "Receive buffer size",
+      "The current size of the receive buffer",
+      0,
+      G_MAXUINT,
+      INF_TCP_CONNECTION_RECV_MIN,
+      G_PARAM_READABLE
+    )
+  );
+
+  /**
+   * InfTcpConnection:bytes-sent:
+   *
+   * The total number of bytes that have been sent through the connection.
+   * This property is not notified when it changes.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_BYTES_SENT,
+    g_param_spec_uint64(
+      "bytes-sent",
+      "Bytes sent",
+      "The number of bytes sent through the connection",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  /**
+   * InfTcpConnection:bytes-received:
+   *
+   * The total number of bytes that have been received through the
+   * connection. This property is not notified when it changes.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_BYTES_RECEIVED,
+    g_param_spec_uint64(
+      "bytes-received",
+      "Bytes received",
+      "The number of bytes received through the connection",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  /**
+   * InfTcpConnection:send-calls:
+   *
+   * The number of system calls that have been made to send data, including
+   * calls that failed because the kernel buffer was full. This property is
+   * not notified when it changes.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_SEND_CALLS,
+    g_param_spec_uint64(
+      "send-calls",
+      "Send calls",
+      "The number of system calls made to send data",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  /**
+   * InfTcpConnection:receive-calls:
+   *
+   * The number of system calls that have been made to receive data,
+   * including calls that failed because no data was available. This
+   * property is not notified when it changes.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_RECEIVE_CALLS,
+    g_param_spec_uint64(
+      "receive-calls",
+      "Receive calls",
+      "The number of system calls made to receive data",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfTcpConnection::sent:
    * @connection: The #InfTcpConnection through which the data has been sent.
@@ -1588,8 +1992,12 @@ inf_tcp_connection_close(InfTcpConnection* connection)
     priv->watch = NULL;
   }
 
-  priv->front_pos = 0;
-  priv->back_pos = 0;
+  inf_tcp_connection_clear_queue(connection);
+
+  /* Give back the receive buffer while the connection is not used */
+  g_free(priv->recv_buf);
+  priv->recv_buf = NULL;
+  priv->recv_size = INF_TCP_CONNECTION_RECV_MIN;
 
   priv->status = INF_TCP_CONNECTION_CLOSED;
   g_object_notify(G_OBJECT(connection), "status");
@@ -1612,8 +2020,10 @@ inf_tcp_connection_send(InfTcpConnection* connection,
                         guint len)
 {
   InfTcpConnectionPrivate* priv;
+  InfTcpConnectionChunk* chunk;
   gconstpointer sent_data;
   guint sent_len;
+  gsize alloc;
 
   g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
   g_return_if_fail(len == 0 || data != NULL);
@@ -1625,7 +2035,7 @@ inf_tcp_connection_send(InfTcpConnection* connection,
 
   /* Check whether we have data currently queued. If we have, then we need
    * to wait until that data has been sent before sending the new data. */
-  if(priv->front_pos == priv->back_pos)
+  if(priv->queue_head == NULL)
   {
     /* Must not be set, because otherwise we would need something to send,
      * but there is nothing in the queue. */
@@ -1657,35 +2067,28 @@ inf_tcp_connection_send(InfTcpConnection* connection,
   /* If we couldn't send all the data... */
   if(len > 0)
   {
-    /* If we have not enough space for the new data, move queue data back
-     * onto the beginning of the queue, if not already */
-    if(priv->alloc - priv->front_pos < len && priv->back_pos > 0)
+    /* Append the data to the last chunk in the queue if it fits, or
+     * start a new chunk otherwise. Existing chunks are never moved, since
+     * their data might currently be referenced by a "sent" handler. */
+    chunk = priv->queue_tail;
+    if(chunk == NULL || chunk->alloc - chunk->end < len)
     {
-      memmove(
-        priv->queue,
-        priv->queue + priv->back_pos,
-        priv->front_pos - priv->back_pos
-      );
-
-      priv->front_pos -= priv->back_pos;
-      priv->back_pos = 0;
-    }
-
-    /* Allocate more memory if there is still not enough space */
-    if(priv->alloc - priv->front_pos < len)
-    {
-      /* Make sure we allocate enough */
-      priv->alloc = priv->front_pos + len;
-
-      /* Always allocate a multiple of 1024 */
-      if(priv->alloc % 1024 != 0)
-        priv->alloc = priv->alloc + (1024 - priv->alloc % 1024);
-
-      priv->queue = g_realloc(priv->queue, priv->alloc);
+      alloc = MAX(len, INF_TCP_CONNECTION_CHUNK_SIZE);
+      chunk = g_malloc(sizeof(InfTcpConnectionChunk) + alloc);
+      chunk->next = NULL;
+      chunk->begin = 0;
+      chunk->end = 0;
+      chunk->alloc = alloc;
+
+      if(priv->queue_tail != NULL)
+        priv->queue_tail->next = chunk;
+      else
+        priv->queue_head = chunk;
+      priv->queue_tail = chunk;
     }
 
-    memcpy(priv->queue + priv->front_pos, data, len);
-    priv->front_pos += len;
+    memcpy(INF_TCP_CONNECTION_CHUNK_DATA(chunk) + chunk->end, data, len);
+    chunk->end += len;
 
     if(~priv->events & INF_IO_OUTGOING)
     {
@@ -1800,17 +2203,20 @@ inf_tcp_connection_get_keepalive(InfTcpConnection* connection)
 /* Creates a new TCP connection from an accepted socket. This is only used
  * by InfdTcpServer and should not be considered regular API. Do not call
  * this function. Language bindings should not wrap it. */
+/* Creates the connection for an accepted socket in status
+ * INF_TCP_CONNECTION_CONNECTING, without watching the socket yet. This
+ * allows to set up the connection for another thread before it becomes
+ * active in that thread with _inf_tcp_connection_accepted_start(). */
 InfTcpConnection*
-_inf_tcp_connection_accepted(InfIo* io,
-                             InfNativeSocket socket,
-                             InfIpAddress* address,
-                             guint port,
-                             const InfKeepalive* keepalive,
-                             GError** error)
+_inf_tcp_connection_accepted_deferred(InfIo* io,
+                                      InfNativeSocket socket,
+                                      InfIpAddress* address,
+                                      guint port,
+                                      const InfKeepalive* keepalive,
+                                      GError** error)
 {
   InfTcpConnection* connection;
   InfTcpConnectionPrivate* priv;
-  int errcode;
 
   g_return_val_if_fail(INF_IS_IO(io), NULL);
   g_return_val_if_fail(socket != INVALID_SOCKET, NULL);
@@ -1830,8 +2236,120 @@ _inf_tcp_connection_accepted(InfIo* io,
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
   priv->socket = socket;
   priv->keepalive = *keepalive;
+  priv->status = INF_TCP_CONNECTION_CONNECTING;
+
+  return connection;
+}
+
+/* Starts a connection created with _inf_tcp_connection_accepted_deferred().
+ * Does nothing if the connection has been closed in the meanwhile. */
+void
+_inf_tcp_connection_accepted_start(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->status == INF_TCP_CONNECTION_CONNECTING)
+    inf_tcp_connection_connected(connection);
+}
+
+/* Stops watching the socket of a connected connection, so that it can be
+ * moved to another InfIo with _inf_tcp_connection_attach(). Must be called
+ * from the thread of the current InfIo. Incoming data stays in the socket
+ * until the connection is attached again. */
+void
+_inf_tcp_connection_detach(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->status == INF_TCP_CONNECTION_CONNECTED);
+
+  if(priv->watch != NULL)
+  {
+    inf_io_remove_watch(priv->io, priv->watch);
+    priv->watch = NULL;
+  }
+}
+
+/* Continues a connection detached with _inf_tcp_connection_detach() in
+ * io. Must be called from the thread of io. */
+void
+_inf_tcp_connection_attach(InfTcpConnection* connection,
+                           InfIo* io)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->watch == NULL);
+
+  g_object_ref(io);
+  g_object_unref(priv->io);
+  priv->io = io;
+
+  if(priv->status == INF_TCP_CONNECTION_CONNECTED && priv->events != 0)
+  {
+    priv->watch = inf_io_add_watch(
+      priv->io,
+      &priv->socket,
+      priv->events,
+      inf_tcp_connection_io,
+      connection,
+      NULL
+    );
+  }
+}
+
+/* Stops or continues reading from the socket. While throttled, incoming
+ * data stays in the kernel buffers, so that eventually the remote side
+ * stops sending. Sending is not affected. Must be called from the thread
+ * of the connection's InfIo. */
+void
+_inf_tcp_connection_set_throttled(InfTcpConnection* connection,
+                                  gboolean throttled)
+{
+  InfTcpConnectionPrivate* priv;
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  if(priv->throttled == throttled)
+    return;
+
+  priv->throttled = throttled;
+  if(priv->status == INF_TCP_CONNECTION_CONNECTED)
+  {
+    if(throttled)
+      priv->events &= ~INF_IO_INCOMING;
+    else
+      priv->events |= INF_IO_INCOMING;
+
+    /* The connection might currently be detached */
+    if(priv->watch != NULL)
+      inf_io_update_watch(priv->io, priv->watch, priv->events);
+  }
+}
+
+InfTcpConnection*
+_inf_tcp_connection_accepted(InfIo* io,
+                             InfNativeSocket socket,
+                             InfIpAddress* address,
+                             guint port,
+                             const InfKeepalive* keepalive,
+                             GError** error)
+{
+  InfTcpConnection* connection;
+
+  connection = _inf_tcp_connection_accepted_deferred(
+    io,
+    socket,
+    address,
+    port,
+    keepalive,
+    error
+  );
+
+  if(connection != NULL)
+    inf_tcp_connection_connected(connection);
 
-  inf_tcp_connection_connected(connection);
   return connection;
 }
 
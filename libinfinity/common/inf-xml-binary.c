@@ -0,0 +1,499 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* This is a compact binary representation of XML trees, used by
+ * InfXmppConnection for frequent messages once both sides have agreed on
+ * it. It only represents what the infinote protocol actually uses: elements
+ * without namespace prefixes, plain attributes and text. Anything else is
+ * rejected by _inf_xml_binary_encode(), and the caller then sends the
+ * message as XML instead.
+ *
+ * All integers are encoded as variable-length unsigned integers with seven
+ * bits per byte, least significant group first. A string is its length in
+ * bytes followed by the UTF-8 encoded string itself.
+ *
+ * element   := name uint(n_attrs) (name value)* uint(n_children) child*
+ * child     := 0x00 element | 0x01 string
+ * name      := uint(0) string | uint(i + 1)          (i-th dictionary entry)
+ * value     := uint(0) string | uint(n + 1)          (decimal number n)
+ *
+ * The dictionary below is part of the protocol. Entries may only ever be
+ * appended to it, never removed or reordered.
+ *
+ * A decoded tree is handed on like one that was parsed from XML, and the
+ * server may forward it to other connections as XML. Therefore the decoder
+ * only accepts names that are valid XML names without a namespace prefix,
+ * and strings that consist of characters allowed in XML. */
+
+#include <libinfinity/common/inf-xml-binary-private.h>
+
+#include <string.h>
+
+#define INF_XML_BINARY_MAX_DEPTH 32
+
+static const gchar* const inf_xml_binary_dictionary[] = {
+  "group",
+  "name",
+  "publisher",
+  "request",
+  "request-batch",
+  "user",
+  "time",
+  "num",
+  "insert-caret",
+  "delete-caret",
+  "move",
+  "no-op",
+  "undo",
+  "undo-caret",
+  "redo",
+  "redo-caret",
+  "pos",
+  "len",
+  "caret",
+  "selection",
+  "segment",
+  "author"
+};
+
+#define INF_XML_BINARY_DICTIONARY_SIZE \
+  (sizeof(inf_xml_binary_dictionary) / sizeof(inf_xml_binary_dictionary[0]))
+
+typedef struct _InfXmlBinaryReader InfXmlBinaryReader;
+struct _InfXmlBinaryReader {
+  const guint8* data;
+  gsize len;
+  gsize pos;
+};
+
+static void
+inf_xml_binary_append_uint(GByteArray* array,
+                           guint32 value)
+{
+  guint8 bytes[5];
+  guint n;
+
+  n = 0;
+  while(value >= 0x80)
+  {
+    bytes[n++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+
+  bytes[n++] = value;
+  g_byte_array_append(array, bytes, n);
+}
+
+static void
+inf_xml_binary_append_string(GByteArray* array,
+                             const xmlChar* str)
+{
+  gsize len;
+  len = strlen((const char*)str);
+
+  inf_xml_binary_append_uint(array, len);
+  g_byte_array_append(array, str, len);
+}
+
+static gboolean
+inf_xml_binary_append_name(GByteArray* array,
+                           const xmlChar* name)
+{
+  guint i;
+
+  for(i = 0; i < INF_XML_BINARY_DICTIONARY_SIZE; ++i)
+  {
+    if(strcmp(inf_xml_binary_dictionary[i], (const char*)name) == 0)
+    {
+      inf_xml_binary_append_uint(array, i + 1);
+      return TRUE;
+    }
+  }
+
+  /* The decoder would reject it */
+  if(xmlValidateNCName(name, 0) != 0)
+    return FALSE;
+
+  inf_xml_binary_append_uint(array, 0);
+  inf_xml_binary_append_string(array, name);
+  return TRUE;
+}
+
+static void
+inf_xml_binary_append_value(GByteArray* array,
+                            const xmlChar* value)
+{
+  const xmlChar* pos;
+  guint32 number;
+
+  /* Only numbers in canonical form are encoded as such, so that decoding
+   * reproduces the exact same string. Nine digits always fit. */
+  if(value[0] != '\0' && (value[0] != '0' || value[1] == '\0'))
+  {
+    number = 0;
+    for(pos = value; *pos >= '0' && *pos <= '9' && pos - value < 9; ++pos)
+      number = number * 10 + (*pos - '0');
+
+    if(*pos == '\0')
+    {
+      inf_xml_binary_append_uint(array, number + 1);
+      return;
+    }
+  }
+
+  inf_xml_binary_append_uint(array, 0);
+  inf_xml_binary_append_string(array, value);
+}
+
+static gboolean
+inf_xml_binary_append_element(GByteArray* array,
+                              xmlNodePtr xml,
+                              guint depth)
+{
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+  guint count;
+
+  if(depth >= INF_XML_BINARY_MAX_DEPTH || xml->ns != NULL)
+    return FALSE;
+
+  if(!inf_xml_binary_append_name(array, xml->name))
+    return FALSE;
+
+  count = 0;
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    /* Attributes with namespaces or entity references cannot be
+     * represented. */
+    if(attr->ns != NULL)
+      return FALSE;
+    if(attr->children != NULL && (attr->children->type != XML_TEXT_NODE ||
+                                  attr->children->next != NULL))
+      return FALSE;
+
+    ++count;
+  }
+
+  inf_xml_binary_append_uint(array, count);
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    if(!inf_xml_binary_append_name(array, attr->name))
+      return FALSE;
+
+    if(attr->children != NULL)
+      inf_xml_binary_append_value(array, attr->children->content);
+    else
+      inf_xml_binary_append_value(array, (const xmlChar*)"");
+  }
+
+  count = 0;
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    switch(child->type)
+    {
+    case XML_ELEMENT_NODE:
+    case XML_TEXT_NODE:
+    case XML_CDATA_SECTION_NODE:
+      ++count;
+      break;
+    default:
+      return FALSE;
+    }
+  }
+
+  inf_xml_binary_append_uint(array, count);
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE)
+    {
+      g_byte_array_append(array, (const guint8*)"\0", 1);
+      if(!inf_xml_binary_append_element(array, child, depth + 1))
+        return FALSE;
+    }
+    else
+    {
+      g_byte_array_append(array, (const guint8*)"\1", 1);
+      inf_xml_binary_append_string(array, child->content);
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_xml_binary_read_uint(InfXmlBinaryReader* reader,
+                         guint32* value)
+{
+  guint shift;
+  guint8 byte;
+
+  *value = 0;
+  for(shift = 0; shift < 35; shift += 7)
+  {
+    if(reader->pos == reader->len)
+      return FALSE;
+
+    byte = reader->data[reader->pos++];
+    if(shift == 28 && (byte & 0x70) != 0)
+      return FALSE;
+
+    *value |= (guint32)(byte & 0x7f) << shift;
+    if((byte & 0x80) == 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Returns a newly allocated, NUL-terminated copy of the string at the
+ * current position, or NULL if it is not valid UTF-8 or contains characters
+ * that are not allowed in XML. */
+static xmlChar*
+inf_xml_binary_read_string(InfXmlBinaryReader* reader)
+{
+  const gchar* str;
+  const gchar* pos;
+  gunichar c;
+  guint32 len;
+
+  if(!inf_xml_binary_read_uint(reader, &len))
+    return NULL;
+  if(len > reader->len - reader->pos)
+    return NULL;
+
+  /* This also rejects embedded NUL characters */
+  str = (const gchar*)reader->data + reader->pos;
+  if(!g_utf8_validate(str, len, NULL))
+    return NULL;
+
+  /* Char ::= #x9 | #xA | #xD | [#x20-#xD7FF] | [#xE000-#xFFFD] |
+   *          [#x10000-#x10FFFF], see the XML specification. Surrogates are
+   * already rejected by g_utf8_validate(). */
+  for(pos = str; pos < str + len; pos = g_utf8_next_char(pos))
+  {
+    c = g_utf8_get_char(pos);
+    if(c < 0x20 && c != 0x9 && c != 0xa && c != 0xd)
+      return NULL;
+    if(c == 0xfffe || c == 0xffff)
+      return NULL;
+  }
+
+  reader->pos += len;
+  return xmlStrndup((const xmlChar*)str, len);
+}
+
+static xmlChar*
+inf_xml_binary_read_name(InfXmlBinaryReader* reader)
+{
+  xmlChar* name;
+  guint32 idx;
+
+  if(!inf_xml_binary_read_uint(reader, &idx))
+    return NULL;
+
+  if(idx > 0)
+  {
+    if(idx > INF_XML_BINARY_DICTIONARY_SIZE)
+      return NULL;
+    return xmlStrdup((const xmlChar*)inf_xml_binary_dictionary[idx - 1]);
+  }
+
+  /* This also rejects empty names and names with a namespace prefix */
+  name = inf_xml_binary_read_string(reader);
+  if(name != NULL && xmlValidateNCName(name, 0) != 0)
+  {
+    xmlFree(name);
+    return NULL;
+  }
+
+  return name;
+}
+
+static xmlChar*
+inf_xml_binary_read_value(InfXmlBinaryReader* reader)
+{
+  gchar buffer[16];
+  guint32 number;
+
+  if(!inf_xml_binary_read_uint(reader, &number))
+    return NULL;
+
+  if(number == 0)
+    return inf_xml_binary_read_string(reader);
+
+  g_snprintf(buffer, sizeof(buffer), "%u", (guint)(number - 1));
+  return xmlStrdup((const xmlChar*)buffer);
+}
+
+static xmlNodePtr
+inf_xml_binary_read_element(InfXmlBinaryReader* reader,
+                            guint depth)
+{
+  xmlNodePtr xml;
+  xmlNodePtr child;
+  xmlChar* name;
+  xmlChar* value;
+  guint32 count;
+  guint32 i;
+  guint8 kind;
+
+  if(depth >= INF_XML_BINARY_MAX_DEPTH)
+    return NULL;
+
+  name = inf_xml_binary_read_name(reader);
+  if(name == NULL)
+    return NULL;
+
+  xml = xmlNewNode(NULL, name);
+  xmlFree(name);
+
+  /* Each attribute and child takes at least one byte, so this bounds the
+   * loops below by the size of the input. */
+  if(!inf_xml_binary_read_uint(reader, &count) ||
+     count > reader->len - reader->pos)
+  {
+    xmlFreeNode(xml);
+    return NULL;
+  }
+
+  for(i = 0; i < count; ++i)
+  {
+    /* Namespace declarations would change the meaning of the element
+     * once it is serialized as XML, and duplicate attributes would make it
+     * malformed. */
+    name = inf_xml_binary_read_name(reader);
+    if(name == NULL || xmlStrEqual(name, (const xmlChar*)"xmlns") ||
+       xmlHasProp(xml, name) != NULL)
+    {
+      if(name != NULL) xmlFree(name);
+      xmlFreeNode(xml);
+      return NULL;
+    }
+
+    value = inf_xml_binary_read_value(reader);
+    if(value == NULL)
+    {
+      xmlFree(name);
+      xmlFreeNode(xml);
+      return NULL;
+    }
+
+    xmlNewProp(xml, name, value);
+    xmlFree(name);
+    xmlFree(value);
+  }
+
+  if(!inf_xml_binary_read_uint(reader, &count) ||
+     count > reader->len - reader->pos)
+  {
+    xmlFreeNode(xml);
+    return NULL;
+  }
+
+  for(i = 0; i < count; ++i)
+  {
+    if(reader->pos == reader->len)
+    {
+      xmlFreeNode(xml);
+      return NULL;
+    }
+
+    kind = reader->data[reader->pos++];
+    switch(kind)
+    {
+    case 0:
+      child = inf_xml_binary_read_element(reader, depth + 1);
+      if(child == NULL)
+      {
+        xmlFreeNode(xml);
+        return NULL;
+      }
+
+      xmlAddChild(xml, child);
+      break;
+    case 1:
+      value = inf_xml_binary_read_string(reader);
+      if(value == NULL)
+      {
+        xmlFreeNode(xml);
+        return NULL;
+      }
+
+      xmlNodeAddContentLen(xml, value, xmlStrlen(value));
+      xmlFree(value);
+      break;
+    default:
+      xmlFreeNode(xml);
+      return NULL;
+    }
+  }
+
+  return xml;
+}
+
+/* Appends the binary representation of xml to array. Returns FALSE if xml
+ * contains something that cannot be represented, in which case array is
+ * left unmodified. */
+gboolean
+_inf_xml_binary_encode(GByteArray* array,
+                       xmlNodePtr xml)
+{
+  guint len;
+
+  g_return_val_if_fail(array != NULL, FALSE);
+  g_return_val_if_fail(xml != NULL, FALSE);
+
+  len = array->len;
+  if(xml->type != XML_ELEMENT_NODE ||
+     !inf_xml_binary_append_element(array, xml, 0))
+  {
+    g_byte_array_set_size(array, len);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Decodes a tree that was encoded with _inf_xml_binary_encode(). The data
+ * comes from the network, so it is not trusted. Returns NULL if it is
+ * malformed. */
+xmlNodePtr
+_inf_xml_binary_decode(const guint8* data,
+                       gsize len)
+{
+  InfXmlBinaryReader reader;
+  xmlNodePtr xml;
+
+  g_return_val_if_fail(data != NULL || len == 0, NULL);
+
+  reader.data = data;
+  reader.len = len;
+  reader.pos = 0;
+
+  xml = inf_xml_binary_read_element(&reader, 0);
+  if(xml != NULL && reader.pos != reader.len)
+  {
+    xmlFreeNode(xml);
+    return NULL;
+  }
+
+  return xml;
+}
+
+/* vim:set et sw=2 ts=2: */
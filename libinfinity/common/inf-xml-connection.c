@@ -294,6 +294,125 @@ void inf_xml_connection_send(InfXmlConnection* connection,
   iface->send(connection, xml);
 }
 
+/**
+ * inf_xml_connection_supports_serialized:
+ * @connection: A #InfXmlConnection.
+ *
+ * Returns whether @connection can transmit messages that have already been
+ * serialized with inf_xml_connection_send_serialized(). If this returns
+ * %FALSE, messages need to be sent with inf_xml_connection_send().
+ *
+ * Returns: %TRUE if inf_xml_connection_send_serialized() can be used on
+ * @connection, or %FALSE otherwise.
+ **/
+gboolean
+inf_xml_connection_supports_serialized(InfXmlConnection* connection)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+  return iface->send_serialized != NULL;
+}
+
+/**
+ * inf_xml_connection_send_serialized:
+ * @connection: A #InfXmlConnection.
+ * @xml: (transfer full): The XML message that is being sent. The function
+ * takes ownership of the XML node.
+ * @serialized: (transfer none): The serialized form of the message.
+ * @binary: (transfer none) (allow-none): The message in the compact binary
+ * encoding of libinfinity, or %NULL.
+ *
+ * Sends a message to the remote host for which the serialization has
+ * already been computed. The content of @serialized is transmitted verbatim
+ * instead of serializing @xml again. This allows the same serialization to
+ * be shared between many connections when a message is broadcast.
+ *
+ * Connections which negotiated a binary framing with the remote host send
+ * @binary instead of @serialized if it is given. It is only produced by
+ * #InfCommunicationRegistry, other callers should pass %NULL.
+ *
+ * @xml is only used for the #InfXmlConnection::sent signal emission once the
+ * message has been transmitted, and it does not need to have any children.
+ * It is enough if it carries the name and attributes of the message, so
+ * that signal handlers can identify it.
+ *
+ * This function can only be called if
+ * inf_xml_connection_supports_serialized() returns %TRUE for @connection.
+ **/
+void
+inf_xml_connection_send_serialized(InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   GBytes* serialized,
+                                   GBytes* binary)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+  g_return_if_fail(serialized != NULL);
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+  g_return_if_fail(iface->send_serialized != NULL);
+
+  iface->send_serialized(connection, xml, serialized, binary);
+}
+
+/**
+ * inf_xml_connection_supports_throttling:
+ * @connection: A #InfXmlConnection.
+ *
+ * Returns whether @connection can stop reading incoming data with
+ * inf_xml_connection_set_throttled().
+ *
+ * Returns: %TRUE if inf_xml_connection_set_throttled() can be used on
+ * @connection, or %FALSE otherwise.
+ **/
+gboolean
+inf_xml_connection_supports_throttling(InfXmlConnection* connection)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+  return iface->set_throttled != NULL;
+}
+
+/**
+ * inf_xml_connection_set_throttled:
+ * @connection: A #InfXmlConnection.
+ * @throttled: Whether to stop reading incoming data.
+ *
+ * Stops reading incoming data from the remote host if @throttled is %TRUE,
+ * or continues reading it if @throttled is %FALSE. While the connection is
+ * throttled, no more data is read, so that the underlying transport
+ * eventually keeps the remote host from sending more. Messages that have
+ * been read already might still be reported with the
+ * #InfXmlConnection::received signal. Sending messages is not affected.
+ *
+ * This can be used to keep a remote host from making more requests while
+ * the replies to its previous requests have not been transmitted yet.
+ *
+ * This function can only be called if
+ * inf_xml_connection_supports_throttling() returns %TRUE for @connection.
+ **/
+void
+inf_xml_connection_set_throttled(InfXmlConnection* connection,
+                                 gboolean throttled)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+  g_return_if_fail(iface->set_throttled != NULL);
+
+  iface->set_throttled(connection, throttled);
+}
+
 /**
  * inf_xml_connection_sent:
  * @connection: A #InfXmlConnection.
@@ -68,6 +68,11 @@ typedef enum _InfXmlConnectionStatus {
  * @received: Default signal handler of the #InfXmlConnection::received
  * signal.
  * @error: Default signal handler of the #InfXmlConnection::error signal.
+ * @send_serialized: Virtual function to transmit an already serialized
+ * message over the connection. This can be %NULL if the connection does not
+ * support it, in which case the message needs to be sent with @send.
+ * @set_throttled: Virtual function to stop or continue reading incoming
+ * data. This can be %NULL if the connection does not support throttling.
  *
  * Virtual functions and default signal handlers for the #InfXmlConnection
  * interface.
@@ -92,6 +97,15 @@ struct _InfXmlConnectionInterface {
                    const xmlNodePtr xml);
   void (*error)(InfXmlConnection* connection,
                 const GError* error);
+
+  /* Virtual table, continued. New members go here so that the offsets of
+   * the ones above do not change. */
+  void (*send_serialized)(InfXmlConnection* connection,
+                          xmlNodePtr xml,
+                          GBytes* serialized,
+                          GBytes* binary);
+  void (*set_throttled)(InfXmlConnection* connection,
+                        gboolean throttled);
 };
 
 GType
@@ -111,6 +125,22 @@ void
 inf_xml_connection_send(InfXmlConnection* connection,
                         xmlNodePtr xml);
 
+gboolean
+inf_xml_connection_supports_serialized(InfXmlConnection* connection);
+
+void
+inf_xml_connection_send_serialized(InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   GBytes* serialized,
+                                   GBytes* binary);
+
+gboolean
+inf_xml_connection_supports_throttling(InfXmlConnection* connection);
+
+void
+inf_xml_connection_set_throttled(InfXmlConnection* connection,
+                                 gboolean throttled);
+
 void
 inf_xml_connection_sent(InfXmlConnection* connection,
                         const xmlNodePtr xml);
@@ -290,6 +290,75 @@ inf_xml_util_valid_xml_char(gunichar codepoint)
  */
 #define inf_utf8_next_char(p) ((p) + g_utf8_skip[*(const guchar *)(p)])
 
+/* The lowest and the highest bit of each byte in a 64 bit word */
+#define INF_XML_UTIL_LOW_BITS G_GUINT64_CONSTANT(0x0101010101010101)
+#define INF_XML_UTIL_HIGH_BITS G_GUINT64_CONSTANT(0x8080808080808080)
+
+/* Returns the number of characters in the valid UTF-8 text, which is the
+ * number of bytes that do not continue a multibyte sequence. Eight bytes
+ * are looked at in one go, which is considerably faster than
+ * g_utf8_strlen() for all but the shortest strings. */
+static gsize
+inf_xml_util_utf8_strlen(const gchar* text,
+                         gsize bytes)
+{
+  const guchar* p;
+  guint64 word;
+  guint64 continuation;
+  gsize count;
+
+  p = (const guchar*)text;
+  count = bytes;
+
+  for(; bytes >= 8; bytes -= 8, p += 8)
+  {
+    memcpy(&word, p, 8);
+
+    /* The high bit of each byte is set if the byte is 10xxxxxx */
+    continuation = word & ~(word << 1) & INF_XML_UTIL_HIGH_BITS;
+    /* Sum up these bits in the highest byte */
+    count -= ((continuation >> 7) * INF_XML_UTIL_LOW_BITS) >> 56;
+  }
+
+  for(; bytes > 0; --bytes, ++p)
+    if((*p & 0xc0) == 0x80)
+      --count;
+
+  return count;
+}
+
+/* Returns the number of bytes at the beginning of text that are printable
+ * ASCII characters, none of which needs to be escaped by
+ * inf_xml_util_add_child_text(). */
+static gsize
+inf_xml_util_ascii_prefix(const gchar* text,
+                          gsize bytes)
+{
+  const guchar* p;
+  guint64 word;
+
+  p = (const guchar*)text;
+
+  /* Stop at the first word with a byte that has the high bit set, or that
+   * is less than 0x20. */
+  for(; bytes >= 8; bytes -= 8, p += 8)
+  {
+    memcpy(&word, p, 8);
+
+    if( (word & INF_XML_UTIL_HIGH_BITS) != 0 ||
+        ((word - 0x20 * INF_XML_UTIL_LOW_BITS) & INF_XML_UTIL_HIGH_BITS) != 0)
+    {
+      break;
+    }
+  }
+
+  for(; bytes > 0; --bytes, ++p)
+    if(*p < 0x20 || *p >= 0x80)
+      break;
+
+  return p - (const guchar*)text;
+}
+
 /**
  * inf_xml_util_add_child_text:
  * @xml: A #xmlNodePtr.
@@ -311,12 +380,17 @@ inf_xml_util_add_child_text(xmlNodePtr xml,
 {
   const gchar* p;
   const gchar* next;
+  const gchar* end;
   gchar* node_value;
   xmlNodePtr child_node;
   gunichar ch;
-  gsize i;
-  for(i = 0, p = text; i < bytes; i += next - p, p = next)
+  for(p = text, end = text + bytes; p < end; p = next)
   {
+    /* Printable ASCII characters are always valid */
+    p += inf_xml_util_ascii_prefix(p, end - p);
+    if(p == end)
+      break;
+
     next = inf_utf8_next_char(p);
     ch = g_utf8_get_char(p);
     if(!inf_xml_util_valid_xml_char(ch))
@@ -366,13 +440,19 @@ inf_xml_util_get_child_text(xmlNodePtr xml,
   GString* result = g_string_sized_new(16);
   guint num_codepoint;
   gsize char_count = 0;
+  gsize len;
   for(child = xml->children; child; child = child->next)
   {
     switch(child->type)
     {
     case XML_TEXT_NODE:
-      g_string_append(result, (const gchar*)child->content);
-      char_count += g_utf8_strlen((const gchar*)child->content, -1);
+      /* libxml2 made sure the content is valid UTF-8 */
+      len = strlen((const gchar*)child->content);
+      g_string_append_len(result, (const gchar*)child->content, len);
+      char_count += inf_xml_util_utf8_strlen(
+        (const gchar*)child->content,
+        len
+      );
       break;
     case XML_ELEMENT_NODE:
       if(strcmp((const char*) child->name, "uchar") != 0) {
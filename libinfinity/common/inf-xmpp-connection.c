@@ -33,10 +33,36 @@
  * not need to adhere to the XMPP standard. It is in the responsibility of the
  * user of this class to send only XML message that the remote counterpart can
  * understand.
+ *
+ * If the remote side supports it, messages are exchanged in a more compact
+ * binary encoding instead of XML text once the connection has been
+ * established. This is transparent to the user of the #InfXmlConnection
+ * interface, and it can be turned off with the
+ * #InfXmppConnection:binary-framing property.
+ *
+ * With binary framing, the stream can also be compressed with zlib, which
+ * mostly helps with large transfers such as the initial synchronization of
+ * a session. Compression is not available without binary framing, and it
+ * is turned off by default: data is compressed before it is encrypted, so
+ * the length of the encrypted stream reveals how well secret content
+ * compresses together with data an attacker might control, in the style of
+ * the CRIME and BREACH attacks. It should only be enabled if that is not a
+ * concern, for example because the connection is not encrypted anyway or
+ * because all users of a server trust each other. The
+ * #InfXmppConnection:compression-level and
+ * #InfXmppConnection:compression-flush properties control the compression,
+ * and the #InfXmppConnection:bytes-sent,
+ * #InfXmppConnection:compressed-bytes-sent,
+ * #InfXmppConnection:bytes-received and
+ * #InfXmppConnection:compressed-bytes-received properties show how much
+ * data was transferred before and after compression. These counters do not
+ * emit change notifications.
  **/
 
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-xml-binary-private.h>
+#include <libinfinity/common/inf-tcp-connection-private.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-error.h>
@@ -46,6 +72,7 @@
 #include <libinfinity/inf-define-enum.h>
 
 #include <gnutls/x509.h>
+#include <zlib.h>
 
 #include <errno.h>
 #include <string.h>
@@ -69,6 +96,26 @@ static const GEnumValue inf_xmpp_connection_site_values[] = {
   }
 };
 
+static const GEnumValue inf_xmpp_connection_compression_flush_values[] = {
+  {
+    INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC,
+    "INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC",
+    "sync"
+  }, {
+    INF_XMPP_CONNECTION_COMPRESSION_FLUSH_PARTIAL,
+    "INF_XMPP_CONNECTION_COMPRESSION_FLUSH_PARTIAL",
+    "partial"
+  }, {
+    INF_XMPP_CONNECTION_COMPRESSION_FLUSH_FULL,
+    "INF_XMPP_CONNECTION_COMPRESSION_FLUSH_FULL",
+    "full"
+  }, {
+    0,
+    NULL,
+    NULL
+  }
+};
+
 static const GEnumValue inf_xmpp_connection_security_policy_values[] = {
   {
     INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
@@ -135,6 +182,51 @@ typedef enum _InfXmppConnectionStatus {
   INF_XMPP_CONNECTION_CLOSED
 } InfXmppConnectionStatus;
 
+/* Namespace of the <binary/> stream feature. When the server offers it, the
+ * client can switch to framed transfer by sending a single NUL byte after
+ * the final <stream:features>. The server acknowledges with a NUL byte of its
+ * own. NUL cannot occur in XML, so neither side can misinterpret the marker,
+ * and a peer that does not know about the feature simply never sends it.
+ * After its marker, each side sends frames consisting of a type byte, the
+ * payload length as a variable-length integer and the payload itself. The
+ * payload is either XML text or a tree in the format of inf-xml-binary.c. */
+#define INF_XMPP_CONNECTION_BINARY_NS \
+  "http://infinote.0x539.de/protocol/binary-framing"
+
+#define INF_XMPP_CONNECTION_FRAME_XML 1
+#define INF_XMPP_CONNECTION_FRAME_BINARY 2
+/* Everything after this frame is compressed with the method named in its
+ * payload. Only sent if the server offered stream compression, in the style
+ * of XEP-0138. */
+#define INF_XMPP_CONNECTION_FRAME_COMPRESS 3
+
+#define INF_XMPP_CONNECTION_COMPRESSION_NS \
+  "http://jabber.org/features/compress"
+/* Compression is off unless enabled explicitly, see the section
+ * documentation above. */
+#define INF_XMPP_CONNECTION_COMPRESSION_LEVEL_DEFAULT 0
+
+/* Type byte plus a length of at most five bytes */
+#define INF_XMPP_CONNECTION_FRAME_HEADER_SIZE 6
+/* Binary frames need to be buffered until they are complete, so limit their
+ * size. XML frames are fed to the parser as they come in. */
+#define INF_XMPP_CONNECTION_FRAME_MAX_BINARY (1024 * 1024)
+/* Don't keep larger send buffers around after a big message */
+#define INF_XMPP_CONNECTION_FRAME_MAX_CACHED (64 * 1024)
+
+typedef enum _InfXmppConnectionBinaryStatus {
+  /* Incoming data is plain XML */
+  INF_XMPP_CONNECTION_BINARY_NONE,
+  /* Incoming data is plain XML up to a NUL marker */
+  INF_XMPP_CONNECTION_BINARY_EXPECTED,
+  /* Waiting for the type byte of the next frame */
+  INF_XMPP_CONNECTION_BINARY_FRAME_TYPE,
+  /* Reading the length of the current frame */
+  INF_XMPP_CONNECTION_BINARY_FRAME_LENGTH,
+  /* Reading the payload of the current frame */
+  INF_XMPP_CONNECTION_BINARY_FRAME_PAYLOAD
+} InfXmppConnectionBinaryStatus;
+
 typedef void(*InfXmppConnectionSentFunc)(InfXmppConnection* xmpp,
                                          gpointer user_data);
 
@@ -198,6 +290,28 @@ struct _InfXmppConnectionPrivate {
   gchar* sasl_remote_mechanisms;
 
   GError* sasl_error;
+
+  /* Binary framing */
+  gboolean binary_framing;
+  gboolean binary_send;
+  InfXmppConnectionBinaryStatus binary_recv;
+  GByteArray* binary_out;
+  GByteArray* binary_in;
+  guint frame_type;
+  guint32 frame_len;
+  guint frame_shift;
+
+  /* Stream compression */
+  gint compression_level;
+  InfXmppConnectionCompressionFlush compression_flush;
+  z_stream* deflate;
+  z_stream* inflate;
+  GByteArray* deflate_buf;
+
+  guint64 bytes_sent;
+  guint64 compressed_bytes_sent;
+  guint64 bytes_received;
+  guint64 compressed_bytes_received;
 };
 
 enum {
@@ -215,6 +329,15 @@ enum {
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
 
+  PROP_BINARY_FRAMING,
+  PROP_COMPRESSION_LEVEL,
+  PROP_COMPRESSION_FLUSH,
+
+  PROP_BYTES_SENT,
+  PROP_COMPRESSED_BYTES_SENT,
+  PROP_BYTES_RECEIVED,
+  PROP_COMPRESSED_BYTES_RECEIVED,
+
   /* From InfXmlConnection */
   PROP_STATUS,
   PROP_NETWORK,
@@ -232,6 +355,7 @@ static GQuark inf_xmpp_connection_auth_error_quark;
 static void inf_xmpp_connection_xml_connection_iface_init(InfXmlConnectionInterface* iface);
 INF_DEFINE_ENUM_TYPE(InfXmppConnectionSite, inf_xmpp_connection_site, inf_xmpp_connection_site_values)
 INF_DEFINE_ENUM_TYPE(InfXmppConnectionSecurityPolicy, inf_xmpp_connection_security_policy, inf_xmpp_connection_security_policy_values)
+INF_DEFINE_ENUM_TYPE(InfXmppConnectionCompressionFlush, inf_xmpp_connection_compression_flush, inf_xmpp_connection_compression_flush_values)
 G_DEFINE_TYPE_WITH_CODE(InfXmppConnection, inf_xmpp_connection, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfXmppConnection)
   G_IMPLEMENT_INTERFACE(INF_TYPE_XML_CONNECTION, inf_xmpp_connection_xml_connection_iface_init))
@@ -693,13 +817,37 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
   priv->pull_data = NULL;
   priv->pull_len = 0;
 
+  /* Binary framing is negotiated again for a new stream */
+  priv->binary_send = FALSE;
+  priv->binary_recv = INF_XMPP_CONNECTION_BINARY_NONE;
+  if(priv->binary_in != NULL)
+  {
+    g_byte_array_free(priv->binary_in, TRUE);
+    priv->binary_in = NULL;
+  }
+
+  if(priv->deflate != NULL)
+  {
+    deflateEnd(priv->deflate);
+    g_slice_free(z_stream, priv->deflate);
+    priv->deflate = NULL;
+  }
+
+  if(priv->inflate != NULL)
+  {
+    inflateEnd(priv->inflate);
+    g_slice_free(z_stream, priv->inflate);
+    priv->inflate = NULL;
+  }
+
   g_object_thaw_notify(G_OBJECT(xmpp));
 }
 
+/* Sends data that has already been compressed, if compression is in use. */
 static void
-inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
-                               gconstpointer data,
-                               guint len)
+inf_xmpp_connection_send_raw(InfXmppConnection* xmpp,
+                             gconstpointer data,
+                             guint len)
 {
   InfXmppConnectionPrivate* priv;
   ssize_t cur_bytes;
@@ -710,8 +858,7 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
            priv->status != INF_XMPP_CONNECTION_CLOSED);
 
-  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
+  priv->compressed_bytes_sent += len;
 
   /* From here on we go into a GnuTLS callback. Set this flag to prevent
    * premature cleanup -- make sure that if the connection is being brought
@@ -773,6 +920,193 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
+                               gconstpointer data,
+                               guint len)
+{
+  InfXmppConnectionPrivate* priv;
+  GByteArray* buf;
+  guint offset;
+  guint chunk;
+  int flush;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
+
+  priv->bytes_sent += len;
+  if(priv->deflate == NULL)
+  {
+    inf_xmpp_connection_send_raw(xmpp, data, len);
+    return;
+  }
+
+  switch(priv->compression_flush)
+  {
+  case INF_XMPP_CONNECTION_COMPRESSION_FLUSH_PARTIAL:
+    flush = Z_PARTIAL_FLUSH;
+    break;
+  case INF_XMPP_CONNECTION_COMPRESSION_FLUSH_FULL:
+    flush = Z_FULL_FLUSH;
+    break;
+  case INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC:
+  default:
+    flush = Z_SYNC_FLUSH;
+    break;
+  }
+
+  /* Take the buffer out of the connection while in use, in case a callback
+   * of the send call sends more data. */
+  buf = priv->deflate_buf;
+  priv->deflate_buf = NULL;
+  if(buf == NULL)
+    buf = g_byte_array_new();
+
+  g_byte_array_set_size(buf, 0);
+
+  /* Every message is flushed, so that the remote site can process it
+   * without waiting for more data. */
+  priv->deflate->next_in = (Bytef*)data;
+  priv->deflate->avail_in = len;
+  chunk = len + 64;
+
+  do
+  {
+    offset = buf->len;
+    g_byte_array_set_size(buf, offset + chunk);
+
+    priv->deflate->next_out = buf->data + offset;
+    priv->deflate->avail_out = chunk;
+
+    ret = deflate(priv->deflate, flush);
+    g_assert(ret == Z_OK || ret == Z_BUF_ERROR);
+
+    g_byte_array_set_size(buf, offset + chunk - priv->deflate->avail_out);
+  } while(priv->deflate->avail_out == 0);
+
+  g_object_ref(xmpp);
+
+  inf_xmpp_connection_send_raw(xmpp, buf->data, buf->len);
+
+  if(priv->deflate_buf == NULL &&
+     buf->len <= INF_XMPP_CONNECTION_FRAME_MAX_CACHED)
+  {
+    priv->deflate_buf = buf;
+  }
+  else
+  {
+    g_byte_array_free(buf, TRUE);
+  }
+
+  g_object_unref(xmpp);
+}
+
+/* Returns a buffer to write a frame payload into. The payload starts at
+ * INF_XMPP_CONNECTION_FRAME_HEADER_SIZE, and the header is filled in by
+ * inf_xmpp_connection_frame_send(). The buffer is taken out of the
+ * connection while in use, in case a callback of the send call sends
+ * another frame. */
+static GByteArray*
+inf_xmpp_connection_frame_begin(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  GByteArray* frame;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  frame = priv->binary_out;
+  priv->binary_out = NULL;
+
+  if(frame == NULL)
+    frame = g_byte_array_new();
+
+  g_byte_array_set_size(frame, INF_XMPP_CONNECTION_FRAME_HEADER_SIZE);
+  return frame;
+}
+
+static void
+inf_xmpp_connection_frame_release(InfXmppConnection* xmpp,
+                                  GByteArray* frame)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->binary_out == NULL &&
+     frame->len <= INF_XMPP_CONNECTION_FRAME_MAX_CACHED)
+  {
+    priv->binary_out = frame;
+  }
+  else
+  {
+    g_byte_array_free(frame, TRUE);
+  }
+}
+
+static void
+inf_xmpp_connection_frame_send(InfXmppConnection* xmpp,
+                               GByteArray* frame,
+                               guint type)
+{
+  guint8 length[INF_XMPP_CONNECTION_FRAME_HEADER_SIZE - 1];
+  guint32 value;
+  guint start;
+  guint n;
+
+  g_assert(frame->len >= INF_XMPP_CONNECTION_FRAME_HEADER_SIZE);
+
+  value = frame->len - INF_XMPP_CONNECTION_FRAME_HEADER_SIZE;
+  n = 0;
+  while(value >= 0x80)
+  {
+    length[n++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  length[n++] = value;
+
+  /* Place the header directly in front of the payload so that the whole
+   * frame goes out with a single call. */
+  start = INF_XMPP_CONNECTION_FRAME_HEADER_SIZE - 1 - n;
+  frame->data[start] = type;
+  memcpy(frame->data + start + 1, length, n);
+
+  g_object_ref(xmpp);
+
+  inf_xmpp_connection_send_chars(
+    xmpp,
+    frame->data + start,
+    frame->len - start
+  );
+
+  inf_xmpp_connection_frame_release(xmpp, frame);
+  g_object_unref(xmpp);
+}
+
+/* Sends XML text, as a frame if framing has been negotiated. */
+static void
+inf_xmpp_connection_send_text(InfXmppConnection* xmpp,
+                              gconstpointer data,
+                              guint len)
+{
+  InfXmppConnectionPrivate* priv;
+  GByteArray* frame;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->binary_send)
+  {
+    frame = inf_xmpp_connection_frame_begin(xmpp);
+    g_byte_array_append(frame, data, len);
+    inf_xmpp_connection_frame_send(xmpp, frame, INF_XMPP_CONNECTION_FRAME_XML);
+  }
+  else
+  {
+    inf_xmpp_connection_send_chars(xmpp, data, len);
+  }
+}
+
 static void
 inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
                              xmlNodePtr xml)
@@ -792,14 +1126,14 @@ inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
    * the buffer variable afterwards. */
   g_object_ref(xmpp);
 
-  inf_xmpp_connection_send_chars(
+  inf_xmpp_connection_send_text(
     xmpp,
     xmlBufferContent(priv->buf),
     xmlBufferLength(priv->buf)
   );
 
   /* The connection might be closed & cleared as a result from
-   * inf_xmpp_connection_send_chars(), so make sure the buffer still
+   * inf_xmpp_connection_send_text(), so make sure the buffer still
    * exists before emptying it. */
   if(priv->buf != NULL)
     xmlBufferEmpty(priv->buf);
@@ -891,7 +1225,7 @@ inf_xmpp_connection_terminate(InfXmppConnection* xmpp)
        * status update: */
       if(priv->status != INF_XMPP_CONNECTION_CLOSED)
       {
-        inf_xmpp_connection_send_chars(
+        inf_xmpp_connection_send_text(
           xmpp,
           xmpp_connection_deinit_request,
           sizeof(xmpp_connection_deinit_request) - 1
@@ -1930,6 +2264,7 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   xmlNodePtr features;
   xmlNodePtr starttls;
+  xmlNodePtr compression;
   xmlNodePtr mechanisms;
   xmlNodePtr mechanism;
   gchar* mechanism_dup;
@@ -2057,12 +2392,43 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
         g_free(mech_list);
     }
   }
+  else if(priv->binary_framing)
+  {
+    /* Authentication is done, so these are the final features. Offer
+     * binary framing; the client switches to it by sending a NUL byte. */
+    xmlAddChild(
+      features,
+      inf_xmpp_connection_node_new("binary", INF_XMPP_CONNECTION_BINARY_NS)
+    );
+
+    /* Stream compression is requested with a frame, so it is only available
+     * together with binary framing. */
+    if(priv->compression_level > 0)
+    {
+      compression = inf_xmpp_connection_node_new(
+        "compression",
+        INF_XMPP_CONNECTION_COMPRESSION_NS
+      );
+
+      xmlNewTextChild(
+        compression,
+        NULL,
+        (const xmlChar*)"method",
+        (const xmlChar*)"zlib"
+      );
+
+      xmlAddChild(features, compression);
+    }
+  }
 
   inf_xmpp_connection_send_xml(xmpp, features);
   xmlFreeNode(features);
 
   if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED)
   {
+    if(priv->binary_framing)
+      priv->binary_recv = INF_XMPP_CONNECTION_BINARY_EXPECTED;
+
     /* Authentication done, <stream:features> sent. Session is ready. */
     priv->status = INF_XMPP_CONNECTION_READY;
     g_object_notify(G_OBJECT(xmpp), "status");
@@ -2435,6 +2801,28 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   }
   else if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
   {
+    if(priv->binary_framing)
+    {
+      for(child = xml->children; child != NULL; child = child->next)
+        if(strcmp((const gchar*)child->name, "binary") == 0)
+          break;
+
+      if(child != NULL)
+      {
+        /* Everything we send from now on is framed. The server answers
+         * with a marker of its own. */
+        inf_xmpp_connection_send_chars(xmpp, "", 1);
+        priv->binary_send = TRUE;
+        priv->binary_recv = INF_XMPP_CONNECTION_BINARY_EXPECTED;
+
+        if(priv->compression_level > 0 &&
+           inf_xmpp_connection_features_have_zlib(xml))
+        {
+          inf_xmpp_connection_start_deflate(xmpp);
+        }
+      }
+    }
+
     priv->status = INF_XMPP_CONNECTION_READY;
     g_object_notify(G_OBJECT(xmpp), "status");
   }
@@ -3097,6 +3485,411 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
   }
 }
 
+/*
+ * Binary framing and compression
+ */
+
+static void
+inf_xmpp_connection_parse(InfXmppConnection* xmpp,
+                          const gchar* data,
+                          gsize len);
+
+/* Sends a compress frame, and compresses everything sent after it. */
+static void
+inf_xmpp_connection_start_deflate(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  GByteArray* frame;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->binary_send);
+  g_assert(priv->deflate == NULL);
+  g_assert(priv->compression_level > 0);
+
+  frame = inf_xmpp_connection_frame_begin(xmpp);
+  g_byte_array_append(frame, (const guint8*)"zlib", 4);
+  inf_xmpp_connection_frame_send(
+    xmpp,
+    frame,
+    INF_XMPP_CONNECTION_FRAME_COMPRESS
+  );
+
+  priv->deflate = g_slice_new0(z_stream);
+  ret = deflateInit(priv->deflate, priv->compression_level);
+  g_assert(ret == Z_OK);
+}
+
+/* Returns whether the given <stream:features> offer zlib compression. */
+static gboolean
+inf_xmpp_connection_features_have_zlib(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+  xmlNodePtr method;
+  xmlChar* content;
+  gboolean result;
+
+  for(child = xml->children; child != NULL; child = child->next)
+    if(strcmp((const gchar*)child->name, "compression") == 0)
+      break;
+
+  if(child == NULL)
+    return FALSE;
+
+  result = FALSE;
+  for(method = child->children; method != NULL; method = method->next)
+  {
+    if(strcmp((const gchar*)method->name, "method") == 0)
+    {
+      content = xmlNodeGetContent(method);
+      if(content != NULL && strcmp((const gchar*)content, "zlib") == 0)
+        result = TRUE;
+      xmlFree(content);
+    }
+  }
+
+  return result;
+}
+
+/* Inflates received data and passes it on to the parser. */
+static void
+inf_xmpp_connection_inflate(InfXmppConnection* xmpp,
+                            const gchar* data,
+                            gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  gchar buffer[4096];
+  gsize n;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->inflate != NULL);
+
+  priv->inflate->next_in = (Bytef*)data;
+  priv->inflate->avail_in = len;
+
+  /* Pass the output on in small pieces, so that we never need to hold a
+   * lot of decompressed data in memory. */
+  do
+  {
+    priv->inflate->next_out = (Bytef*)buffer;
+    priv->inflate->avail_out = sizeof(buffer);
+
+    ret = inflate(priv->inflate, Z_SYNC_FLUSH);
+    if(ret != Z_OK && ret != Z_BUF_ERROR)
+    {
+      inf_xmpp_connection_terminate_error(
+        xmpp,
+        INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+        _("Received invalid compressed data")
+      );
+
+      return;
+    }
+
+    n = sizeof(buffer) - priv->inflate->avail_out;
+    if(n > 0)
+    {
+      inf_xmpp_connection_parse(xmpp, buffer, n);
+
+      if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+         priv->status == INF_XMPP_CONNECTION_CLOSED)
+      {
+        return;
+      }
+    }
+  } while(ret == Z_OK &&
+          (priv->inflate->avail_in > 0 || priv->inflate->avail_out == 0));
+}
+
+/* Handles a compress frame from the remote site. Returns FALSE if the
+ * connection was closed because of it. */
+static gboolean
+inf_xmpp_connection_process_compress(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->inflate != NULL)
+  {
+    inf_xmpp_connection_terminate_error(
+      xmpp,
+      INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+      _("Stream compression was requested twice")
+    );
+
+    return FALSE;
+  }
+
+  if(priv->binary_in->len != 4 ||
+     memcmp(priv->binary_in->data, "zlib", 4) != 0)
+  {
+    inf_xmpp_connection_terminate_error(
+      xmpp,
+      INF_XMPP_CONNECTION_STREAM_ERROR_UNSUPPORTED_ENCODING,
+      _("Unsupported compression method requested")
+    );
+
+    return FALSE;
+  }
+
+  priv->inflate = g_slice_new0(z_stream);
+  ret = inflateInit(priv->inflate);
+  g_assert(ret == Z_OK);
+
+  /* If we are the server, then this is the client's request to compress the
+   * stream, so compress our side as well. The compression feature is only
+   * offered if the compression level is nonzero. */
+  if(priv->deflate == NULL && priv->compression_level > 0 &&
+     priv->site == INF_XMPP_CONNECTION_SERVER &&
+     priv->status == INF_XMPP_CONNECTION_READY)
+  {
+    inf_xmpp_connection_start_deflate(xmpp);
+  }
+
+  return TRUE;
+}
+
+static void
+inf_xmpp_connection_process_binary(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr xml;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  /* Binary frames can only come in between two complete XML messages */
+  xml = NULL;
+  if(priv->root == NULL)
+    xml = _inf_xml_binary_decode(priv->binary_in->data, priv->binary_in->len);
+
+  if(xml == NULL)
+  {
+    inf_xmpp_connection_terminate_error(
+      xmpp,
+      INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+      _("Received malformed binary message")
+    );
+  }
+  else
+  {
+    /* Binary framing is only negotiated once the connection is ready, and
+     * other messages are ignored while we wait for </stream:stream>, as in
+     * inf_xmpp_connection_process_end_element(). */
+    if(priv->status == INF_XMPP_CONNECTION_READY)
+      inf_xml_connection_received(INF_XML_CONNECTION(xmpp), xml);
+
+    xmlFreeNode(xml);
+  }
+}
+
+/* Hands decompressed data to the XML parser, or, if binary framing has
+ * been negotiated, splits it into frames first. */
+static void
+inf_xmpp_connection_parse(InfXmppConnection* xmpp,
+                          const gchar* data,
+                          gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  const gchar* marker;
+  guint8 byte;
+  gsize n;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  priv->bytes_received += len;
+
+  /* Print the data after decryption and decompression */
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+  {
+    if(priv->session != NULL)
+      printf("\033[00;32m%.*s\033[00;00m\n", (int)len, data);
+    else
+      printf("\033[00;31m%.*s\033[00;00m\n", (int)len, data);
+  }
+
+  while(len > 0)
+  {
+    /* A message we processed might have caused the connection to be
+     * closed. */
+    if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+       priv->status == INF_XMPP_CONNECTION_CLOSED)
+    {
+      return;
+    }
+
+    switch(priv->binary_recv)
+    {
+    case INF_XMPP_CONNECTION_BINARY_NONE:
+      xmlParseChunk(priv->parser, data, len, 0);
+      return;
+    case INF_XMPP_CONNECTION_BINARY_EXPECTED:
+      marker = memchr(data, '\0', len);
+      if(marker == NULL)
+      {
+        xmlParseChunk(priv->parser, data, len, 0);
+        return;
+      }
+
+      if(marker > data)
+      {
+        /* Process what the remote side sent before it switched */
+        xmlParseChunk(priv->parser, data, marker - data, 0);
+        if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+           priv->status == INF_XMPP_CONNECTION_CLOSED)
+        {
+          return;
+        }
+      }
+
+      len -= marker + 1 - data;
+      data = marker + 1;
+      priv->binary_recv = INF_XMPP_CONNECTION_BINARY_FRAME_TYPE;
+      priv->binary_in = g_byte_array_new();
+
+      /* If we are the server, then this is the client's request to switch,
+       * so acknowledge it. */
+      if(!priv->binary_send && priv->status == INF_XMPP_CONNECTION_READY)
+      {
+        inf_xmpp_connection_send_chars(xmpp, "", 1);
+        priv->binary_send = TRUE;
+      }
+
+      break;
+    case INF_XMPP_CONNECTION_BINARY_FRAME_TYPE:
+      byte = *data;
+      ++data;
+      --len;
+
+      if(byte != INF_XMPP_CONNECTION_FRAME_XML &&
+         byte != INF_XMPP_CONNECTION_FRAME_BINARY &&
+         byte != INF_XMPP_CONNECTION_FRAME_COMPRESS)
+      {
+        inf_xmpp_connection_terminate_error(
+          xmpp,
+          INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+          _("Received frame of unknown type")
+        );
+
+        return;
+      }
+
+      priv->frame_type = byte;
+      priv->frame_len = 0;
+      priv->frame_shift = 0;
+      priv->binary_recv = INF_XMPP_CONNECTION_BINARY_FRAME_LENGTH;
+      break;
+    case INF_XMPP_CONNECTION_BINARY_FRAME_LENGTH:
+      byte = *data;
+      ++data;
+      --len;
+
+      if(priv->frame_shift == 28 && (byte & 0xf0) != 0)
+      {
+        inf_xmpp_connection_terminate_error(
+          xmpp,
+          INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+          _("Received frame with invalid length")
+        );
+
+        return;
+      }
+
+      priv->frame_len |= (guint32)(byte & 0x7f) << priv->frame_shift;
+      priv->frame_shift += 7;
+
+      if((byte & 0x80) == 0)
+      {
+        if(priv->frame_type != INF_XMPP_CONNECTION_FRAME_XML &&
+           priv->frame_len > INF_XMPP_CONNECTION_FRAME_MAX_BINARY)
+        {
+          inf_xmpp_connection_terminate_error(
+            xmpp,
+            INF_XMPP_CONNECTION_STREAM_ERROR_POLICY_VIOLATION,
+            _("Received binary message is too large")
+          );
+
+          return;
+        }
+
+        g_byte_array_set_size(priv->binary_in, 0);
+        if(priv->frame_len > 0)
+          priv->binary_recv = INF_XMPP_CONNECTION_BINARY_FRAME_PAYLOAD;
+        else
+          priv->binary_recv = INF_XMPP_CONNECTION_BINARY_FRAME_TYPE;
+
+        /* Empty frames are complete right away */
+        if(priv->frame_len == 0 &&
+           priv->frame_type == INF_XMPP_CONNECTION_FRAME_BINARY)
+        {
+          inf_xmpp_connection_process_binary(xmpp);
+        }
+        else if(priv->frame_len == 0 &&
+                priv->frame_type == INF_XMPP_CONNECTION_FRAME_COMPRESS)
+        {
+          inf_xmpp_connection_process_compress(xmpp);
+          return;
+        }
+      }
+
+      break;
+    case INF_XMPP_CONNECTION_BINARY_FRAME_PAYLOAD:
+      n = MIN(len, priv->frame_len);
+      if(priv->frame_type == INF_XMPP_CONNECTION_FRAME_XML)
+        xmlParseChunk(priv->parser, data, n, 0);
+      else
+        g_byte_array_append(priv->binary_in, (const guint8*)data, n);
+
+      data += n;
+      len -= n;
+      priv->frame_len -= n;
+
+      if(priv->frame_len == 0)
+      {
+        priv->binary_recv = INF_XMPP_CONNECTION_BINARY_FRAME_TYPE;
+        if(priv->frame_type == INF_XMPP_CONNECTION_FRAME_BINARY)
+        {
+          inf_xmpp_connection_process_binary(xmpp);
+        }
+        else if(priv->frame_type == INF_XMPP_CONNECTION_FRAME_COMPRESS)
+        {
+          /* The rest of the input is compressed */
+          if(inf_xmpp_connection_process_compress(xmpp) && len > 0)
+          {
+            priv->bytes_received -= len;
+            inf_xmpp_connection_inflate(xmpp, data, len);
+          }
+
+          return;
+        }
+      }
+
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+  }
+}
+
+/* Processes data received from the TCP connection, after TLS decryption. */
+static void
+inf_xmpp_connection_feed(InfXmppConnection* xmpp,
+                         const gchar* data,
+                         gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  priv->compressed_bytes_received += len;
+
+  if(priv->inflate != NULL)
+    inf_xmpp_connection_inflate(xmpp, data, len);
+  else
+    inf_xmpp_connection_parse(xmpp, data, len);
+}
+
 /*
  * Signal handlers.
  */
@@ -3258,9 +4051,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
         else
         {
           /* Feed decoded data into XML parser */
-          if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-            printf("\033[00;32m%.*s\033[00;00m\n", (int)res, buffer);
-          xmlParseChunk(priv->parser, buffer, res, 0);
+          inf_xmpp_connection_feed(xmpp, buffer, res);
 
           /* If the callback changed made us disconnect then don't try
            * to read more data. */
@@ -3275,9 +4066,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
     else
     {
       /* Feed input directly into XML parser */
-      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-        printf("\033[00;31m%.*s\033[00;00m\n", (int)len, (const char*)data);
-      xmlParseChunk(priv->parser, data, len, 0);
+      inf_xmpp_connection_feed(xmpp, data, len);
     }
   }
 
@@ -3631,6 +4420,26 @@ inf_xmpp_connection_init(InfXmppConnection* connection)
   priv->sasl_local_mechanisms = NULL;
   priv->sasl_remote_mechanisms = NULL;
   priv->sasl_error = NULL;
+
+  priv->binary_framing = TRUE;
+  priv->binary_send = FALSE;
+  priv->binary_recv = INF_XMPP_CONNECTION_BINARY_NONE;
+  priv->binary_out = NULL;
+  priv->binary_in = NULL;
+  priv->frame_type = 0;
+  priv->frame_len = 0;
+  priv->frame_shift = 0;
+
+  priv->compression_level = INF_XMPP_CONNECTION_COMPRESSION_LEVEL_DEFAULT;
+  priv->compression_flush = INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC;
+  priv->deflate = NULL;
+  priv->inflate = NULL;
+  priv->deflate_buf = NULL;
+
+  priv->bytes_sent = 0;
+  priv->compressed_bytes_sent = 0;
+  priv->bytes_received = 0;
+  priv->compressed_bytes_received = 0;
 }
 
 static void
@@ -3735,6 +4544,11 @@ inf_xmpp_connection_finalize(GObject* object)
   if(priv->sasl_error)
     g_error_free(priv->sasl_error);
 
+  if(priv->binary_out != NULL)
+    g_byte_array_free(priv->binary_out, TRUE);
+  if(priv->deflate_buf != NULL)
+    g_byte_array_free(priv->deflate_buf, TRUE);
+
   G_OBJECT_CLASS(inf_xmpp_connection_parent_class)->finalize(object);
 }
 
@@ -3826,6 +4640,17 @@ inf_xmpp_connection_set_property(GObject* object,
     g_free(priv->sasl_local_mechanisms);
     priv->sasl_local_mechanisms = g_value_dup_string(value);
     break;
+  case PROP_BINARY_FRAMING:
+    /* Only takes effect for the next stream */
+    priv->binary_framing = g_value_get_boolean(value);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    /* Only takes effect for the next stream */
+    priv->compression_level = g_value_get_int(value);
+    break;
+  case PROP_COMPRESSION_FLUSH:
+    priv->compression_flush = g_value_get_enum(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -3876,6 +4701,27 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_SASL_MECHANISMS:
     g_value_set_string(value, priv->sasl_local_mechanisms);
     break;
+  case PROP_BINARY_FRAMING:
+    g_value_set_boolean(value, priv->binary_framing);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_int(value, priv->compression_level);
+    break;
+  case PROP_COMPRESSION_FLUSH:
+    g_value_set_enum(value, priv->compression_flush);
+    break;
+  case PROP_BYTES_SENT:
+    g_value_set_uint64(value, priv->bytes_sent);
+    break;
+  case PROP_COMPRESSED_BYTES_SENT:
+    g_value_set_uint64(value, priv->compressed_bytes_sent);
+    break;
+  case PROP_BYTES_RECEIVED:
+    g_value_set_uint64(value, priv->bytes_received);
+    break;
+  case PROP_COMPRESSED_BYTES_RECEIVED:
+    g_value_set_uint64(value, priv->compressed_bytes_received);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, inf_xmpp_connection_get_xml_status(xmpp));
     break;
@@ -4020,11 +4866,42 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
                                         xmlNodePtr xml)
 {
   InfXmppConnectionPrivate* priv;
+  GByteArray* frame;
+
   priv = INF_XMPP_CONNECTION_PRIVATE(connection);
 
   g_assert(priv->status == INF_XMPP_CONNECTION_READY);
 
-  inf_xmpp_connection_send_xml(INF_XMPP_CONNECTION(connection), xml);
+  /* Keep the traffic readable when it is being printed */
+  frame = NULL;
+  if(priv->binary_send && !INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+  {
+    frame = inf_xmpp_connection_frame_begin(INF_XMPP_CONNECTION(connection));
+    if(!_inf_xml_binary_encode(frame, xml) ||
+       frame->len - INF_XMPP_CONNECTION_FRAME_HEADER_SIZE >
+       INF_XMPP_CONNECTION_FRAME_MAX_BINARY)
+    {
+      inf_xmpp_connection_frame_release(
+        INF_XMPP_CONNECTION(connection),
+        frame
+      );
+
+      frame = NULL;
+    }
+  }
+
+  if(frame != NULL)
+  {
+    inf_xmpp_connection_frame_send(
+      INF_XMPP_CONNECTION(connection),
+      frame,
+      INF_XMPP_CONNECTION_FRAME_BINARY
+    );
+  }
+  else
+  {
+    inf_xmpp_connection_send_xml(INF_XMPP_CONNECTION(connection), xml);
+  }
 
   /* It can happen that while calling inf_xmpp_connection_send_xml we
    * notice that the connection is down. Only proceed with sent notification
@@ -4044,6 +4921,74 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
   }
 }
 
+static void
+inf_xmpp_connection_xml_connection_send_serialized(InfXmlConnection* conn,
+                                                   xmlNodePtr xml,
+                                                   GBytes* serialized,
+                                                   GBytes* binary)
+{
+  InfXmppConnectionPrivate* priv;
+  GByteArray* frame;
+  gconstpointer data;
+  gsize size;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(conn);
+
+  g_assert(priv->status == INF_XMPP_CONNECTION_READY);
+
+  /* The serializations are shared with other connections, so the only
+   * thing we do per connection is handing one of them to GnuTLS or to the
+   * TCP connection. Without the binary encoding, the text goes out as an
+   * XML frame if binary framing is in use. */
+  if(priv->binary_send && binary != NULL &&
+     !INF_XMPP_CONNECTION_PRINT_TRAFFIC &&
+     g_bytes_get_size(binary) <= INF_XMPP_CONNECTION_FRAME_MAX_BINARY)
+  {
+    data = g_bytes_get_data(binary, &size);
+
+    frame = inf_xmpp_connection_frame_begin(INF_XMPP_CONNECTION(conn));
+    g_byte_array_append(frame, data, size);
+
+    inf_xmpp_connection_frame_send(
+      INF_XMPP_CONNECTION(conn),
+      frame,
+      INF_XMPP_CONNECTION_FRAME_BINARY
+    );
+  }
+  else
+  {
+    data = g_bytes_get_data(serialized, &size);
+    inf_xmpp_connection_send_text(INF_XMPP_CONNECTION(conn), data, size);
+  }
+
+  if(priv->status == INF_XMPP_CONNECTION_READY)
+  {
+    inf_xmpp_connection_push_message(
+      INF_XMPP_CONNECTION(conn),
+      inf_xmpp_connection_xml_connection_send_sent,
+      inf_xmpp_connection_xml_connection_send_free,
+      xml
+    );
+  }
+  else
+  {
+    xmlFreeNode(xml);
+  }
+}
+
+static void
+inf_xmpp_connection_xml_connection_set_throttled(InfXmlConnection* conn,
+                                                 gboolean throttled)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(conn);
+
+  /* Data which has been read already is still processed, but no more is
+   * read from the TCP connection. */
+  if(priv->tcp != NULL)
+    _inf_tcp_connection_set_throttled(priv->tcp, throttled);
+}
+
 /*
  * GObject type registration
  */
@@ -4178,6 +5123,105 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_BINARY_FRAMING,
+    g_param_spec_boolean(
+      "binary-framing",
+      "Binary framing",
+      "Whether to use a compact binary encoding for messages if the remote "
+      "site supports it",
+      TRUE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_int(
+      "compression-level",
+      "Compression level",
+      "The zlib compression level from 1 to 9 to compress the stream with if "
+      "the remote site supports it and binary framing is used, or 0 to not "
+      "compress the stream",
+      0,
+      9,
+      INF_XMPP_CONNECTION_COMPRESSION_LEVEL_DEFAULT,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_FLUSH,
+    g_param_spec_enum(
+      "compression-flush",
+      "Compression flush",
+      "How to flush the compressed stream after each message",
+      INF_TYPE_XMPP_CONNECTION_COMPRESSION_FLUSH,
+      INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BYTES_SENT,
+    g_param_spec_uint64(
+      "bytes-sent",
+      "Bytes sent",
+      "The number of bytes sent over the connection before compression",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSED_BYTES_SENT,
+    g_param_spec_uint64(
+      "compressed-bytes-sent",
+      "Compressed bytes sent",
+      "The number of bytes sent over the connection after compression",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BYTES_RECEIVED,
+    g_param_spec_uint64(
+      "bytes-received",
+      "Bytes received",
+      "The number of bytes received over the connection after decompression",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSED_BYTES_RECEIVED,
+    g_param_spec_uint64(
+      "compressed-bytes-received",
+      "Compressed bytes received",
+      "The number of bytes received over the connection before "
+      "decompression",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -4203,6 +5247,8 @@ inf_xmpp_connection_xml_connection_iface_init(
   iface->open = inf_xmpp_connection_xml_connection_open;
   iface->close = inf_xmpp_connection_xml_connection_close;
   iface->send = inf_xmpp_connection_xml_connection_send;
+  iface->send_serialized = inf_xmpp_connection_xml_connection_send_serialized;
+  iface->set_throttled = inf_xmpp_connection_xml_connection_set_throttled;
 }
 
 /*
@@ -42,6 +42,7 @@ G_BEGIN_DECLS
 
 #define INF_TYPE_XMPP_CONNECTION_SITE            (inf_xmpp_connection_site_get_type())
 #define INF_TYPE_XMPP_CONNECTION_SECURITY_POLICY (inf_xmpp_connection_security_policy_get_type())
+#define INF_TYPE_XMPP_CONNECTION_COMPRESSION_FLUSH (inf_xmpp_connection_compression_flush_get_type())
 
 typedef struct _InfXmppConnection InfXmppConnection;
 typedef struct _InfXmppConnectionClass InfXmppConnectionClass;
@@ -89,6 +90,29 @@ typedef enum _InfXmppConnectionSecurityPolicy {
   INF_XMPP_CONNECTION_SECURITY_BOTH_PREFER_TLS
 } InfXmppConnectionSecurityPolicy;
 
+/**
+ * InfXmppConnectionCompressionFlush:
+ * @INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC: Flush the compressed stream
+ * after every message, so that the remote site can process it right away.
+ * This is the default.
+ * @INF_XMPP_CONNECTION_COMPRESSION_FLUSH_PARTIAL: Like
+ * @INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC, but the compressed data is
+ * not padded to a byte boundary, which saves a few bytes per message.
+ * @INF_XMPP_CONNECTION_COMPRESSION_FLUSH_FULL: Flush the compressed stream
+ * after every message, and also reset the compression state. This achieves
+ * a worse compression ratio, but limits how much of a message can be
+ * inferred from the size of its compressed form.
+ *
+ * The #InfXmppConnectionCompressionFlush enumeration specifies how the
+ * compressed stream is flushed after each message when stream compression
+ * is in use.
+ */
+typedef enum _InfXmppConnectionCompressionFlush {
+  INF_XMPP_CONNECTION_COMPRESSION_FLUSH_SYNC,
+  INF_XMPP_CONNECTION_COMPRESSION_FLUSH_PARTIAL,
+  INF_XMPP_CONNECTION_COMPRESSION_FLUSH_FULL
+} InfXmppConnectionCompressionFlush;
+
 /**
  * InfXmppConnectionError:
  * @INF_XMPP_CONNECTION_ERROR_TLS_UNSUPPORTED: Server does not support TLS,
@@ -310,6 +334,9 @@ inf_xmpp_connection_security_policy_get_type(void) G_GNUC_CONST;
 GType
 inf_xmpp_connection_site_get_type(void) G_GNUC_CONST;
 
+GType
+inf_xmpp_connection_compression_flush_get_type(void) G_GNUC_CONST;
+
 GType
 inf_xmpp_connection_get_type(void) G_GNUC_CONST;
 
@@ -69,73 +69,38 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
   InfCommunicationGroup* group;
   GSList* connections;
   GSList* item;
-  InfXmlConnection* connection;
-  gboolean is_registered;
-  InfXmlConnectionStatus status;
 
   priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
 
-  /* Each of the inf_communication_registry_send() calls can do a callback
-   * which might possibly screw up our connection list completely. So be safe
-   * here by copying all relevant information on the stack. */
+  /* Sending to one of the connections can do a callback which might
+   * possibly screw up our connection list completely. So be safe here by
+   * copying all relevant information on the stack. The registry checks
+   * for each connection whether it is still registered and open before
+   * sending to it. */
   g_object_ref(method);
   registry = g_object_ref(priv->registry);
   group = g_object_ref(priv->group);
 
-  connections = g_slist_copy(priv->connections);
-  for(item = connections; item != NULL; item = item->next)
-    g_object_ref(item->data);
-
-  while(connections)
-  {
-    connection = INF_XML_CONNECTION(connections->data);
+  connections = NULL;
+  for(item = priv->connections; item != NULL; item = item->next)
+    if(item->data != except)
+      connections = g_slist_prepend(connections, g_object_ref(item->data));
+  connections = g_slist_reverse(connections);
 
-    /* A callback from a prior iteration might have unregistered the
-     * connection. */
-    is_registered = inf_communication_registry_is_registered(
-      registry,
-      group,
-      connection
-    );
+  /* The registry serializes the message only once for all connections
+   * that support it, instead of copying and serializing it for each
+   * connection separately. */
+  inf_communication_registry_broadcast(registry, group, connections, xml);
 
-    /* in case our remove member was not yet called we also check the
-     * status here, i.e. if we are called in response to a handler of the
-     * notify::status signal that ran before ours. */
-    g_object_get(G_OBJECT(connection), "status", &status, NULL);
-    if(is_registered &&
-       status == INF_XML_CONNECTION_OPEN &&
-       connection != except)
-    {
-      if(connections->next != NULL)
-      {
-        /* Keep ownership of XML if there might be more connections we should
-         * send it to. */
-        inf_communication_registry_send(
-          registry,
-          group,
-          connection,
-          xmlCopyNode(xml, 1)
-        );
-      }
-      else
-      {
-        /* Pass ownership of XML if this is definitely the last connection
-         * in the list. */
-        inf_communication_registry_send(registry, group, connection, xml);
-        xml = NULL;
-      }
-    }
-
-    g_object_unref(connection);
+  while(connections != NULL)
+  {
+    g_object_unref(connections->data);
     connections = g_slist_delete_link(connections, connections);
   }
 
   g_object_unref(method);
   g_object_unref(registry);
   g_object_unref(group);
-
-  if(xml != NULL)
-    xmlFreeNode(xml);
 }
 
 static void
@@ -282,6 +247,25 @@ inf_communication_central_method_send_single(InfCommunicationMethod* method,
   );
 }
 
+static void
+inf_communication_central_method_send_single_serialized(
+  InfCommunicationMethod* method,
+  InfXmlConnection* connection,
+  xmlNodePtr xml,
+  GBytes* serialized)
+{
+  InfCommunicationCentralMethodPrivate* priv;
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+
+  inf_communication_registry_send_serialized(
+    priv->registry,
+    priv->group,
+    connection,
+    xml,
+    serialized
+  );
+}
+
 static void
 inf_communication_central_method_send_all(InfCommunicationMethod* method,
                                           xmlNodePtr xml)
@@ -639,6 +623,8 @@ inf_communication_central_method_method_iface_init(
   iface->is_member = inf_communication_central_method_is_member;
   iface->send_single = inf_communication_central_method_send_single;
   iface->send_all = inf_communication_central_method_send_all;
+  iface->send_single_serialized =
+    inf_communication_central_method_send_single_serialized;
   iface->cancel_messages = inf_communication_central_method_cancel_messages;
   iface->received = inf_communication_central_method_received;
   iface->enqueued = inf_communication_central_method_enqueued;
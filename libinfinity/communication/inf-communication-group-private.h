@@ -26,6 +26,8 @@
 typedef void(*InfCommunicationGroupForeachFunc)(InfCommunicationMethod* meth,
                                                 gpointer user_data);
 
+typedef void(*InfCommunicationGroupDeferFunc)(gpointer user_data);
+
 void
 _inf_communication_group_add_member(InfCommunicationGroup* group,
                                     InfXmlConnection* connection);
@@ -39,6 +41,18 @@ _inf_communication_group_foreach_method(InfCommunicationGroup* group,
                                         InfCommunicationGroupForeachFunc func,
                                         gpointer user_data);
 
+void
+_inf_communication_group_hold(InfCommunicationGroup* group);
+
+void
+_inf_communication_group_defer(InfCommunicationGroup* group,
+                               InfCommunicationGroupDeferFunc func,
+                               gpointer user_data,
+                               GDestroyNotify notify);
+
+void
+_inf_communication_group_release(InfCommunicationGroup* group);
+
 #endif /* __INF_COMMUNICATION_GROUP_PRIVATE_H__ */
 
 /* vim:set et sw=2 ts=2: */
@@ -48,6 +48,29 @@
 
 #include <string.h>
 
+typedef enum _InfCommunicationGroupHeldType {
+  INF_COMMUNICATION_GROUP_HELD_SEND,
+  INF_COMMUNICATION_GROUP_HELD_SEND_SERIALIZED,
+  INF_COMMUNICATION_GROUP_HELD_SEND_GROUP,
+  INF_COMMUNICATION_GROUP_HELD_CANCEL,
+  INF_COMMUNICATION_GROUP_HELD_FUNC
+} InfCommunicationGroupHeldType;
+
+/* A message, or another call, which is delayed while the group is held with
+ * _inf_communication_group_hold(). */
+typedef struct _InfCommunicationGroupHeld InfCommunicationGroupHeld;
+struct _InfCommunicationGroupHeld {
+  InfCommunicationGroupHeldType type;
+
+  InfXmlConnection* connection;
+  xmlNodePtr xml;
+  GBytes* serialized;
+
+  InfCommunicationGroupDeferFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
 typedef struct _InfCommunicationGroupPrivate InfCommunicationGroupPrivate;
 struct _InfCommunicationGroupPrivate {
   InfCommunicationManager* communication_manager;
@@ -57,6 +80,9 @@ struct _InfCommunicationGroupPrivate {
   InfCommunicationObject* target;
 
   GHashTable* methods;
+
+  gboolean held;
+  GQueue held_messages;
 };
 
 enum {
@@ -188,6 +214,206 @@ inf_communication_group_lookup_method_for_connection(InfCommunicationGroup* g,
   return method;
 }
 
+static InfCommunicationGroupHeld*
+inf_communication_group_held_new(InfCommunicationGroupHeldType type,
+                                 InfXmlConnection* connection)
+{
+  InfCommunicationGroupHeld* held;
+
+  held = g_slice_new(InfCommunicationGroupHeld);
+  held->type = type;
+  held->connection = connection;
+  held->xml = NULL;
+  held->serialized = NULL;
+  held->func = NULL;
+  held->user_data = NULL;
+  held->notify = NULL;
+
+  if(connection != NULL)
+    g_object_ref(connection);
+
+  return held;
+}
+
+static void
+inf_communication_group_held_free(InfCommunicationGroupHeld* held)
+{
+  if(held->notify != NULL)
+    held->notify(held->user_data);
+  if(held->serialized != NULL)
+    g_bytes_unref(held->serialized);
+  if(held->xml != NULL)
+    xmlFreeNode(held->xml);
+  if(held->connection != NULL)
+    g_object_unref(held->connection);
+
+  g_slice_free(InfCommunicationGroupHeld, held);
+}
+
+/* Drops the held messages to connection, since they would be cancelled
+ * anyway. */
+static void
+inf_communication_group_held_cancel(InfCommunicationGroup* group,
+                                    InfXmlConnection* connection)
+{
+  InfCommunicationGroupPrivate* priv;
+  InfCommunicationGroupHeld* held;
+  GList* item;
+  GList* next;
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+
+  for(item = priv->held_messages.head; item != NULL; item = next)
+  {
+    next = item->next;
+    held = (InfCommunicationGroupHeld*)item->data;
+
+    if(held->connection == connection &&
+       (held->type == INF_COMMUNICATION_GROUP_HELD_SEND ||
+        held->type == INF_COMMUNICATION_GROUP_HELD_SEND_SERIALIZED))
+    {
+      g_queue_delete_link(&priv->held_messages, item);
+      inf_communication_group_held_free(held);
+    }
+  }
+}
+
+static void
+inf_communication_group_send_message_now(InfCommunicationGroup* group,
+                                         InfXmlConnection* connection,
+                                         xmlNodePtr xml)
+{
+  InfCommunicationMethod* method;
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  g_return_if_fail(method != NULL);
+
+  inf_communication_method_send_single(method, connection, xml);
+}
+
+static void
+inf_communication_group_send_serialized_message_now(InfCommunicationGroup* g,
+                                                    InfXmlConnection* conn,
+                                                    xmlNodePtr xml,
+                                                    GBytes* serialized)
+{
+  InfCommunicationMethod* method;
+
+  method = inf_communication_group_lookup_method_for_connection(g, conn);
+  g_return_if_fail(method != NULL);
+
+  inf_communication_method_send_single_serialized(
+    method,
+    conn,
+    xml,
+    serialized
+  );
+}
+
+static void
+inf_communication_group_send_group_message_now(InfCommunicationGroup* group,
+                                               xmlNodePtr xml)
+{
+  InfCommunicationGroupPrivate* priv;
+  GHashTableIter iter;
+  gpointer value;
+  InfCommunicationMethod* method;
+  gboolean has_next;
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+  g_hash_table_iter_init(&iter, priv->methods);
+
+  has_next = g_hash_table_iter_next(&iter, NULL, &value);
+
+  if(!has_next)
+  {
+    xmlFreeNode(xml);
+  }
+  else
+  {
+    do
+    {
+      method = INF_COMMUNICATION_METHOD(value);
+      has_next = g_hash_table_iter_next(&iter, NULL, &value);
+
+      inf_communication_method_send_all(
+        method,
+        has_next ? xmlCopyNode(xml, 1) : xml
+      );
+    } while(has_next);
+  }
+}
+
+static void
+inf_communication_group_cancel_messages_now(InfCommunicationGroup* group,
+                                            InfXmlConnection* connection)
+{
+  InfCommunicationMethod* method;
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  g_return_if_fail(method != NULL);
+  inf_communication_method_cancel_messages(method, connection);
+}
+
+/* Runs a held call. Messages to connections which have left the group in
+ * the meanwhile are dropped. */
+static void
+inf_communication_group_held_run(InfCommunicationGroup* group,
+                                 InfCommunicationGroupHeld* held)
+{
+  xmlNodePtr xml;
+
+  switch(held->type)
+  {
+  case INF_COMMUNICATION_GROUP_HELD_SEND:
+    if(inf_communication_group_is_member(group, held->connection))
+    {
+      xml = held->xml;
+      held->xml = NULL;
+
+      inf_communication_group_send_message_now(group, held->connection, xml);
+    }
+
+    break;
+  case INF_COMMUNICATION_GROUP_HELD_SEND_SERIALIZED:
+    if(inf_communication_group_is_member(group, held->connection))
+    {
+      inf_communication_group_send_serialized_message_now(
+        group,
+        held->connection,
+        held->xml,
+        held->serialized
+      );
+    }
+
+    break;
+  case INF_COMMUNICATION_GROUP_HELD_SEND_GROUP:
+    xml = held->xml;
+    held->xml = NULL;
+
+    inf_communication_group_send_group_message_now(group, xml);
+    break;
+  case INF_COMMUNICATION_GROUP_HELD_CANCEL:
+    if(inf_communication_group_is_member(group, held->connection))
+      inf_communication_group_cancel_messages_now(group, held->connection);
+    break;
+  case INF_COMMUNICATION_GROUP_HELD_FUNC:
+    held->func(held->user_data);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
 /*
  * Weak ref handling
  */
@@ -332,6 +558,9 @@ inf_communication_group_init(InfCommunicationGroup* group)
 
   priv->methods =
     g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  priv->held = FALSE;
+  g_queue_init(&priv->held_messages);
 }
 
 static void
@@ -365,6 +594,10 @@ inf_communication_group_finalize(GObject* object)
   group = INF_COMMUNICATION_GROUP(object);
   priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
 
+  /* The group is only finalized while it is held if the caller of
+   * _inf_communication_group_hold() did not keep a reference on it. */
+  g_assert(priv->held == FALSE);
+
   g_free(priv->name);
 
   G_OBJECT_CLASS(inf_communication_group_parent_class)->finalize(object);
@@ -690,20 +923,79 @@ inf_communication_group_send_message(InfCommunicationGroup* group,
                                      InfXmlConnection* connection,
                                      xmlNodePtr xml)
 {
-  InfCommunicationMethod* method;
+  InfCommunicationGroupPrivate* priv;
+  InfCommunicationGroupHeld* held;
 
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
   g_return_if_fail(INF_IS_XML_CONNECTION(connection));
   g_return_if_fail(xml != NULL);
 
-  method = inf_communication_group_lookup_method_for_connection(
-    group,
-    connection
-  );
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+  if(priv->held)
+  {
+    held = inf_communication_group_held_new(
+      INF_COMMUNICATION_GROUP_HELD_SEND,
+      connection
+    );
 
-  g_return_if_fail(method != NULL);
+    held->xml = xml;
+    g_queue_push_tail(&priv->held_messages, held);
+  }
+  else
+  {
+    inf_communication_group_send_message_now(group, connection, xml);
+  }
+}
 
-  inf_communication_method_send_single(method, connection, xml);
+/**
+ * inf_communication_group_send_serialized_message:
+ * @group: A #InfCommunicationGroup.
+ * @connection: The #InfXmlConnection to which to send the message.
+ * @xml: (transfer none): The message to send.
+ * @serialized: The serialization of @xml, as written by xmlNodeDump().
+ *
+ * Sends a message to @connection which must be a member of @group, like
+ * inf_communication_group_send_message(). The message is not serialized
+ * again if the connection allows sending @serialized instead, so that
+ * @serialized can be shared between many calls to this function, for
+ * example if the same message is sent to many connections. This function
+ * does not take ownership of @xml.
+ */
+void
+inf_communication_group_send_serialized_message(InfCommunicationGroup* group,
+                                                InfXmlConnection* connection,
+                                                xmlNodePtr xml,
+                                                GBytes* serialized)
+{
+  InfCommunicationGroupPrivate* priv;
+  InfCommunicationGroupHeld* held;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+  g_return_if_fail(serialized != NULL);
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+  if(priv->held)
+  {
+    held = inf_communication_group_held_new(
+      INF_COMMUNICATION_GROUP_HELD_SEND_SERIALIZED,
+      connection
+    );
+
+    held->xml = xmlCopyNode(xml, 1);
+    held->serialized = g_bytes_ref(serialized);
+    g_queue_push_tail(&priv->held_messages, held);
+  }
+  else
+  {
+    inf_communication_group_send_serialized_message_now(
+      group,
+      connection,
+      xml,
+      serialized
+    );
+  }
 }
 
 /**
@@ -719,35 +1011,25 @@ inf_communication_group_send_group_message(InfCommunicationGroup* group,
                                            xmlNodePtr xml)
 {
   InfCommunicationGroupPrivate* priv;
-  GHashTableIter iter;
-  gpointer value;
-  InfCommunicationMethod* method;
-  gboolean has_next;
+  InfCommunicationGroupHeld* held;
 
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
   g_return_if_fail(xml != NULL);
 
   priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
-  g_hash_table_iter_init(&iter, priv->methods);
-
-  has_next = g_hash_table_iter_next(&iter, NULL, &value);
-
-  if(!has_next)
+  if(priv->held)
   {
-    xmlFreeNode(xml);
+    held = inf_communication_group_held_new(
+      INF_COMMUNICATION_GROUP_HELD_SEND_GROUP,
+      NULL
+    );
+
+    held->xml = xml;
+    g_queue_push_tail(&priv->held_messages, held);
   }
   else
   {
-    do
-    {
-      method = INF_COMMUNICATION_METHOD(value);
-      has_next = g_hash_table_iter_next(&iter, NULL, &value);
-
-      inf_communication_method_send_all(
-        method,
-        has_next ? xmlCopyNode(xml, 1) : xml
-      );
-    } while(has_next);
+    inf_communication_group_send_group_message_now(group, xml);
   }
 }
 
@@ -764,18 +1046,30 @@ void
 inf_communication_group_cancel_messages(InfCommunicationGroup* group,
                                         InfXmlConnection* connection)
 {
-  InfCommunicationMethod* method;
+  InfCommunicationGroupPrivate* priv;
 
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
   g_return_if_fail(INF_IS_XML_CONNECTION(connection));
 
-  method = inf_communication_group_lookup_method_for_connection(
-    group,
-    connection
-  );
-
-  g_return_if_fail(method != NULL);
-  inf_communication_method_cancel_messages(method, connection);
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+  if(priv->held)
+  {
+    inf_communication_group_held_cancel(group, connection);
+
+    /* Messages which were scheduled before the group was held are
+     * cancelled on release */
+    g_queue_push_tail(
+      &priv->held_messages,
+      inf_communication_group_held_new(
+        INF_COMMUNICATION_GROUP_HELD_CANCEL,
+        connection
+      )
+    );
+  }
+  else
+  {
+    inf_communication_group_cancel_messages_now(group, connection);
+  }
 }
 
 /**
@@ -976,4 +1270,77 @@ _inf_communication_group_foreach_method(InfCommunicationGroup* group,
   }
 }
 
+/* Holds back all messages sent to the group, until
+ * _inf_communication_group_release() is called. This allows the target of
+ * the group to run in another thread, while the communication manager and
+ * the methods of the group are only used by the main thread. The caller
+ * needs to keep a reference on the group while it is held. None of these
+ * functions are thread-safe: The group must only be used by one thread at
+ * a time. */
+void
+_inf_communication_group_hold(InfCommunicationGroup* group)
+{
+  InfCommunicationGroupPrivate* priv;
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+
+  g_assert(priv->held == FALSE);
+  priv->held = TRUE;
+}
+
+/* Runs func when the group is released, in order with the messages held
+ * until then, or right away if the group is not held. */
+void
+_inf_communication_group_defer(InfCommunicationGroup* group,
+                               InfCommunicationGroupDeferFunc func,
+                               gpointer user_data,
+                               GDestroyNotify notify)
+{
+  InfCommunicationGroupPrivate* priv;
+  InfCommunicationGroupHeld* held;
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+
+  held = inf_communication_group_held_new(
+    INF_COMMUNICATION_GROUP_HELD_FUNC,
+    NULL
+  );
+
+  held->func = func;
+  held->user_data = user_data;
+  held->notify = notify;
+
+  if(priv->held)
+  {
+    g_queue_push_tail(&priv->held_messages, held);
+  }
+  else
+  {
+    inf_communication_group_held_run(group, held);
+    inf_communication_group_held_free(held);
+  }
+}
+
+/* Sends all messages held since _inf_communication_group_hold(). */
+void
+_inf_communication_group_release(InfCommunicationGroup* group)
+{
+  InfCommunicationGroupPrivate* priv;
+  InfCommunicationGroupHeld* held;
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+  g_assert(priv->held == TRUE);
+
+  /* The group stays held while replaying, so that messages sent by deferred
+   * functions are appended, and sent in order. */
+  while(!g_queue_is_empty(&priv->held_messages))
+  {
+    held = (InfCommunicationGroupHeld*)g_queue_pop_head(&priv->held_messages);
+
+    inf_communication_group_held_run(group, held);
+    inf_communication_group_held_free(held);
+  }
+
+  priv->held = FALSE;
+}
+
 /* vim:set et sw=2 ts=2: */
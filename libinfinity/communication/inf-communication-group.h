@@ -104,6 +104,12 @@ inf_communication_group_send_message(InfCommunicationGroup* group,
                                      InfXmlConnection* connection,
                                      xmlNodePtr xml);
 
+void
+inf_communication_group_send_serialized_message(InfCommunicationGroup* group,
+                                                InfXmlConnection* connection,
+                                                xmlNodePtr xml,
+                                                GBytes* serialized);
+
 void
 inf_communication_group_send_group_message(InfCommunicationGroup* group,
                                            xmlNodePtr xml);
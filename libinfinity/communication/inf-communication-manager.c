@@ -32,6 +32,7 @@
 
 #include <libinfinity/communication/inf-communication-manager.h>
 #include <libinfinity/communication/inf-communication-central-factory.h>
+#include <libinfinity/inf-signals.h>
 
 #include <string.h>
 
@@ -55,8 +56,16 @@ struct _InfCommunicationManagerPrivate {
   GHashTable* joined_groups;
 };
 
+enum {
+  QUEUE_SIZE_EXCEEDED,
+
+  LAST_SIGNAL
+};
+
 #define INF_COMMUNICATION_MANAGER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_COMMUNICATION_TYPE_MANAGER, InfCommunicationManagerPrivate))
 
+static guint manager_signals[LAST_SIGNAL];
+
 G_DEFINE_TYPE_WITH_CODE(InfCommunicationManager, inf_communication_manager, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfCommunicationManager))
 
@@ -171,6 +180,20 @@ inf_communication_manager_joined_group_unrefed(gpointer data,
   }
 }
 
+static void
+inf_communication_manager_queue_size_exceeded_cb(
+  InfCommunicationRegistry* registry,
+  InfXmlConnection* connection,
+  gpointer user_data)
+{
+  g_signal_emit(
+    INF_COMMUNICATION_MANAGER(user_data),
+    manager_signals[QUEUE_SIZE_EXCEEDED],
+    0,
+    connection
+  );
+}
+
 /*
  * GObject overrides.
  */
@@ -182,6 +205,14 @@ inf_communication_manager_init(InfCommunicationManager* manager)
   priv = INF_COMMUNICATION_MANAGER_PRIVATE(manager);
 
   priv->registry = g_object_new(INF_COMMUNICATION_TYPE_REGISTRY, NULL);
+
+  g_signal_connect(
+    G_OBJECT(priv->registry),
+    "queue-size-exceeded",
+    G_CALLBACK(inf_communication_manager_queue_size_exceeded_cb),
+    manager
+  );
+
   priv->factories = g_ptr_array_new();
   priv->hosted_groups = g_hash_table_new(g_str_hash, g_str_equal);
 
@@ -228,6 +259,12 @@ inf_communication_manager_dispose(GObject* object)
 
   if(priv->registry != NULL)
   {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->registry),
+      G_CALLBACK(inf_communication_manager_queue_size_exceeded_cb),
+      manager
+    );
+
     g_object_unref(priv->registry);
     priv->registry = NULL;
   }
@@ -243,6 +280,29 @@ inf_communication_manager_class_init(
   object_class = G_OBJECT_CLASS(manager_class);
 
   object_class->dispose = inf_communication_manager_dispose;
+
+  /**
+   * InfCommunicationManager::queue-size-exceeded:
+   * @manager: The #InfCommunicationManager emitting the signal.
+   * @connection: The connection whose backlog exceeds the limit.
+   *
+   * This signal is emitted when the number of bytes waiting to be sent to
+   * @connection grows beyond the limit set with
+   * inf_communication_manager_set_queue_size_limit(). See
+   * #InfCommunicationRegistry::queue-size-exceeded. Handlers must neither
+   * send messages nor close @connection.
+   */
+  manager_signals[QUEUE_SIZE_EXCEEDED] = g_signal_new(
+    "queue-size-exceeded",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    g_cclosure_marshal_VOID__OBJECT,
+    G_TYPE_NONE,
+    1,
+    INF_TYPE_XML_CONNECTION
+  );
 }
 
 /**
@@ -498,4 +558,72 @@ inf_communication_manager_get_factory_for(InfCommunicationManager* manager,
   return NULL;
 }
 
+/**
+ * inf_communication_manager_get_queue_size:
+ * @manager: A #InfCommunicationManager.
+ * @connection: A #InfXmlConnection.
+ *
+ * Returns the number of bytes of messages in any of the groups of @manager
+ * that are waiting to be sent to @connection. See
+ * inf_communication_registry_get_queue_size().
+ *
+ * Returns: The number of bytes waiting to be sent to @connection.
+ */
+gsize
+inf_communication_manager_get_queue_size(InfCommunicationManager* manager,
+                                         InfXmlConnection* connection)
+{
+  g_return_val_if_fail(INF_COMMUNICATION_IS_MANAGER(manager), 0);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), 0);
+
+  return inf_communication_registry_get_queue_size(
+    INF_COMMUNICATION_MANAGER_PRIVATE(manager)->registry,
+    connection
+  );
+}
+
+/**
+ * inf_communication_manager_set_queue_size_limit:
+ * @manager: A #InfCommunicationManager.
+ * @limit: The number of bytes that may wait to be sent to a connection, or
+ * 0.
+ *
+ * Makes @manager emit the #InfCommunicationManager::queue-size-exceeded
+ * signal whenever the number of bytes waiting to be sent to a connection
+ * grows beyond @limit. If @limit is 0, then the signal is not emitted.
+ */
+void
+inf_communication_manager_set_queue_size_limit(
+  InfCommunicationManager* manager,
+  gsize limit)
+{
+  g_return_if_fail(INF_COMMUNICATION_IS_MANAGER(manager));
+
+  inf_communication_registry_set_queue_size_limit(
+    INF_COMMUNICATION_MANAGER_PRIVATE(manager)->registry,
+    limit
+  );
+}
+
+/**
+ * inf_communication_manager_get_queue_size_limit:
+ * @manager: A #InfCommunicationManager.
+ *
+ * Returns the limit set with
+ * inf_communication_manager_set_queue_size_limit().
+ *
+ * Returns: The number of bytes that may wait to be sent to a connection
+ * before #InfCommunicationManager::queue-size-exceeded is emitted, or 0.
+ */
+gsize
+inf_communication_manager_get_queue_size_limit(
+  InfCommunicationManager* manager)
+{
+  g_return_val_if_fail(INF_COMMUNICATION_IS_MANAGER(manager), 0);
+
+  return inf_communication_registry_get_queue_size_limit(
+    INF_COMMUNICATION_MANAGER_PRIVATE(manager)->registry
+  );
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -86,6 +86,19 @@ inf_communication_manager_get_factory_for(InfCommunicationManager* manager,
                                           const gchar* network,
                                           const gchar* method_name);
 
+gsize
+inf_communication_manager_get_queue_size(InfCommunicationManager* manager,
+                                         InfXmlConnection* connection);
+
+void
+inf_communication_manager_set_queue_size_limit(
+  InfCommunicationManager* manager,
+  gsize limit);
+
+gsize
+inf_communication_manager_get_queue_size_limit(
+  InfCommunicationManager* manager);
+
 G_END_DECLS
 
 #endif /* __INF_COMMUNICATION_MANAGER_H__ */
@@ -210,6 +210,47 @@ inf_communication_method_send_all(InfCommunicationMethod* method,
   iface->send_all(method, xml);
 }
 
+/**
+ * inf_communication_method_send_single_serialized:
+ * @meth: A #InfCommunicationMethod.
+ * @connection: A #InfXmlConnection that is a group member.
+ * @xml: (transfer none): The message to send.
+ * @serialized: The serialization of @xml.
+ *
+ * Sends an XML message to @connection, like
+ * inf_communication_method_send_single(). @serialized is the serialization
+ * of @xml alone, as written by xmlNodeDump(), and is used instead of
+ * serializing @xml again if possible. See
+ * inf_communication_registry_send_serialized(). This function does not take
+ * ownership of @xml.
+ */
+void
+inf_communication_method_send_single_serialized(InfCommunicationMethod* meth,
+                                                InfXmlConnection* connection,
+                                                xmlNodePtr xml,
+                                                GBytes* serialized)
+{
+  InfCommunicationMethodInterface* iface;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_METHOD(meth));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(inf_communication_method_is_member(meth, connection));
+  g_return_if_fail(xml != NULL);
+  g_return_if_fail(serialized != NULL);
+
+  iface = INF_COMMUNICATION_METHOD_GET_IFACE(meth);
+
+  if(iface->send_single_serialized != NULL)
+  {
+    iface->send_single_serialized(meth, connection, xml, serialized);
+  }
+  else
+  {
+    g_return_if_fail(iface->send_single != NULL);
+    iface->send_single(meth, connection, xmlCopyNode(xml, 1));
+  }
+}
+
 /**
  * inf_communication_method_cancel_messages:
  * @method: A #InfCommunicationMethod.
@@ -54,6 +54,9 @@ typedef struct _InfCommunicationMethodInterface InfCommunicationMethodInterface;
  * @xml.
  * @send_all: Sends a message to all group members, except @except. Takes
  * ownership of @xml.
+ * @send_single_serialized: Sends a message to a single connection whose
+ * serialization is already known. Does not take ownership of @xml. If this
+ * is %NULL, a copy of @xml is sent with @send_single instead.
  * @cancel_messages: Cancel sending messages that have not yet been sent
  * to the given connection.
  * @received: Handles reception of a message from a registered connection.
@@ -86,6 +89,10 @@ struct _InfCommunicationMethodInterface {
                       xmlNodePtr xml);
   void (*send_all)(InfCommunicationMethod* method,
                    xmlNodePtr xml);
+  void (*send_single_serialized)(InfCommunicationMethod* method,
+                                 InfXmlConnection* connection,
+                                 xmlNodePtr xml,
+                                 GBytes* serialized);
   void (*cancel_messages)(InfCommunicationMethod* method,
                           InfXmlConnection* connection);
 
@@ -124,6 +131,12 @@ void
 inf_communication_method_send_all(InfCommunicationMethod* method,
                                   xmlNodePtr xml);
 
+void
+inf_communication_method_send_single_serialized(InfCommunicationMethod* meth,
+                                                InfXmlConnection* connection,
+                                                xmlNodePtr xml,
+                                                GBytes* serialized);
+
 void
 inf_communication_method_cancel_messages(InfCommunicationMethod* method,
                                          InfXmlConnection* connection);
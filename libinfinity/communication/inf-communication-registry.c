@@ -34,10 +34,17 @@
  * inf_communication_method_enqueued() when sending the message cannot be
  * cancelled anymore via inf_communication_registry_cancel_messages() and
  * inf_communication_method_sent() when the message has been sent.
+ *
+ * The registry keeps track of how many bytes are waiting to be sent to each
+ * connection, see inf_communication_registry_get_queue_size(). With
+ * inf_communication_registry_set_queue_size_limit(), it reports connections
+ * whose backlog grows beyond a given size with the
+ * #InfCommunicationRegistry::queue-size-exceeded signal.
  **/
 
 #include <libinfinity/communication/inf-communication-registry.h>
 #include <libinfinity/communication/inf-communication-group-private.h>
+#include <libinfinity/common/inf-xml-binary-private.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/inf-signals.h>
 
@@ -53,6 +60,16 @@ struct _InfCommunicationRegistryKey {
   const gchar* group_name;
 };
 
+typedef struct _InfCommunicationRegistryConnection
+  InfCommunicationRegistryConnection;
+struct _InfCommunicationRegistryConnection {
+  guint registrations;
+
+  /* Number of bytes in the queues of all registered entries for the
+   * connection, which have not yet been handed to the connection. */
+  gsize queue_size;
+};
+
 typedef struct _InfCommunicationRegistryEntry InfCommunicationRegistryEntry;
 struct _InfCommunicationRegistryEntry {
   InfCommunicationRegistry* registry;
@@ -62,10 +79,15 @@ struct _InfCommunicationRegistryEntry {
   InfCommunicationGroup* group;
   InfCommunicationMethod* method;
 
+  /* NULL while not registered */
+  InfCommunicationRegistryConnection* connection_info;
+
   /* Queue of messages to send */
   guint inner_count;
   xmlNodePtr queue_begin;
   xmlNodePtr queue_end;
+  guint queue_length;
+  gsize queue_size;
 
   /* Activation status */
   gboolean registered;
@@ -85,29 +107,151 @@ struct _InfCommunicationRegistryForeachMethodData {
 typedef struct _InfCommunicationRegistryPrivate
   InfCommunicationRegistryPrivate;
 struct _InfCommunicationRegistryPrivate {
-  GHashTable* connections;
+  GHashTable* connections; /* InfCommunicationRegistryConnection */
   GHashTable* entries;
+
+  gsize queue_size_limit;
+};
+
+enum {
+  QUEUE_SIZE_EXCEEDED,
+
+  LAST_SIGNAL
 };
 
 #define INF_COMMUNICATION_REGISTRY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_COMMUNICATION_TYPE_REGISTRY, InfCommunicationRegistryPrivate))
 
+static guint registry_signals[LAST_SIGNAL];
+
 G_DEFINE_TYPE_WITH_CODE(InfCommunicationRegistry, inf_communication_registry, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfCommunicationRegistry))
 
 /* Maximum number of messages enqueued at the same time */
 static const guint INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT = 5;
 
+/* Messages in the queue of an entry can carry a serialization of the whole
+ * container they are going to be sent in, shared with other entries. It is
+ * stored in the _private field of the message node. Broadcast messages
+ * come with the binary encoding of the container as well, for connections
+ * which negotiated binary framing. */
+typedef struct _InfCommunicationRegistrySerialized
+  InfCommunicationRegistrySerialized;
+struct _InfCommunicationRegistrySerialized {
+  GBytes* text;
+  GBytes* binary;
+};
+
+static InfCommunicationRegistrySerialized*
+inf_communication_registry_serialized_new(GBytes* text,
+                                          GBytes* binary)
+{
+  InfCommunicationRegistrySerialized* serialized;
+
+  serialized = g_slice_new(InfCommunicationRegistrySerialized);
+  serialized->text = g_bytes_ref(text);
+  serialized->binary = binary != NULL ? g_bytes_ref(binary) : NULL;
+  return serialized;
+}
+
 static void
-inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
-                                     guint num_messages)
+inf_communication_registry_serialized_free(
+  InfCommunicationRegistrySerialized* serialized)
 {
-  InfXmlConnection* connection;
-  InfXmlConnectionStatus status;
+  g_bytes_unref(serialized->text);
+  if(serialized->binary != NULL)
+    g_bytes_unref(serialized->binary);
+  g_slice_free(InfCommunicationRegistrySerialized, serialized);
+}
 
-  xmlNodePtr container;
+static gsize
+inf_communication_registry_estimate_size(xmlNodePtr xml)
+{
+  xmlAttrPtr attr;
   xmlNodePtr child;
-  xmlNodePtr xml;
-  guint i;
+  gsize size;
+
+  /* Opening and closing tag */
+  size = 2 * xmlStrlen(xml->name) + 5;
+
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    size += xmlStrlen(attr->name) + 4;
+    if(attr->children != NULL)
+      size += xmlStrlen(attr->children->content);
+  }
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE)
+      size += inf_communication_registry_estimate_size(child);
+    else
+      size += xmlStrlen(child->content);
+  }
+
+  return size;
+}
+
+/* Returns the number of bytes a message in the queue of an entry is going
+ * to occupy on the connection. For messages with a shared serialization
+ * this is exact. Other messages are only serialized by the connection, so
+ * their size is estimated, without escaping and namespaces, rather than
+ * serializing them twice. */
+static gsize
+inf_communication_registry_message_size(xmlNodePtr xml)
+{
+  InfCommunicationRegistrySerialized* serialized;
+
+  serialized = (InfCommunicationRegistrySerialized*)xml->_private;
+  if(serialized != NULL)
+    return g_bytes_get_size(serialized->text);
+
+  return inf_communication_registry_estimate_size(xml);
+}
+
+static void
+inf_communication_registry_free_queue(xmlNodePtr queue)
+{
+  xmlNodePtr next;
+
+  while(queue != NULL)
+  {
+    next = queue->next;
+
+    if(queue->_private != NULL)
+    {
+      inf_communication_registry_serialized_free(
+        (InfCommunicationRegistrySerialized*)queue->_private
+      );
+    }
+
+    xmlUnlinkNode(queue);
+    xmlFreeNode(queue);
+    queue = next;
+  }
+}
+
+static void
+inf_communication_registry_entry_clear_queue(
+  InfCommunicationRegistryEntry* entry)
+{
+  inf_communication_registry_free_queue(entry->queue_begin);
+  entry->queue_begin = NULL;
+  entry->queue_end = NULL;
+
+  if(entry->connection_info != NULL)
+  {
+    g_assert(entry->connection_info->queue_size >= entry->queue_size);
+    entry->connection_info->queue_size -= entry->queue_size;
+  }
+
+  entry->queue_length = 0;
+  entry->queue_size = 0;
+}
+
+static xmlNodePtr
+inf_communication_registry_new_container(InfCommunicationRegistryEntry* entry)
+{
+  xmlNodePtr container;
 
   container = xmlNewNode(NULL, (const xmlChar*)"group");
   if(entry->publisher_string != NULL)
@@ -120,15 +264,148 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
   }
 
   inf_xml_util_set_attribute(container, "name", entry->key.group_name);
+  return container;
+}
+
+static GBytes*
+inf_communication_registry_serialize(InfCommunicationRegistryEntry* entry,
+                                     xmlNodePtr xml)
+{
+  xmlNodePtr container;
+  xmlBufferPtr buffer;
+  GBytes* bytes;
+
+  /* Link xml into the container temporarily, so that we do not need to
+   * copy it. The caller keeps ownership of xml. */
+  container = inf_communication_registry_new_container(entry);
+  xmlAddChild(container, xml);
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, NULL, container, 0, 0);
+  xmlUnlinkNode(xml);
+
+  bytes = g_bytes_new(xmlBufferContent(buffer), xmlBufferLength(buffer));
+
+  xmlBufferFree(buffer);
+  xmlFreeNode(container);
+  return bytes;
+}
+
+/* Returns the binary encoding of xml within its container, or NULL if xml
+ * cannot be represented in it. */
+static GBytes*
+inf_communication_registry_serialize_binary(
+  InfCommunicationRegistryEntry* entry,
+  xmlNodePtr xml)
+{
+  xmlNodePtr container;
+  GByteArray* array;
+  gboolean result;
+
+  container = inf_communication_registry_new_container(entry);
+  xmlAddChild(container, xml);
+
+  array = g_byte_array_new();
+  result = _inf_xml_binary_encode(array, container);
+  xmlUnlinkNode(xml);
+  xmlFreeNode(container);
+
+  if(!result)
+  {
+    g_byte_array_free(array, TRUE);
+    return NULL;
+  }
+
+  return g_byte_array_free_to_bytes(array);
+}
+
+/* Wraps the serialization of a message alone into the serialization of its
+ * group container. The container is serialized with an empty text child so
+ * that libxml2 writes separate start and end tags, and the message is then
+ * spliced in between them. */
+static GBytes*
+inf_communication_registry_wrap(InfCommunicationRegistryEntry* entry,
+                                GBytes* serialized)
+{
+  static const gsize END_TAG_LEN = sizeof("</group>") - 1;
+
+  xmlNodePtr container;
+  xmlBufferPtr buffer;
+  const guchar* content;
+  gsize length;
+  gconstpointer data;
+  gsize size;
+  guchar* result;
+
+  container = inf_communication_registry_new_container(entry);
+  xmlAddChild(container, xmlNewText((const xmlChar*)""));
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, NULL, container, 0, 0);
+  xmlFreeNode(container);
+
+  content = xmlBufferContent(buffer);
+  length = xmlBufferLength(buffer);
+  g_assert(length > END_TAG_LEN);
+
+  data = g_bytes_get_data(serialized, &size);
+  result = g_malloc(length + size);
+
+  memcpy(result, content, length - END_TAG_LEN);
+  memcpy(result + length - END_TAG_LEN, data, size);
+  memcpy(
+    result + length - END_TAG_LEN + size,
+    content + length - END_TAG_LEN,
+    END_TAG_LEN
+  );
+
+  xmlBufferFree(buffer);
+  return g_bytes_new_take(result, length + size);
+}
+
+static void
+inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
+                                     guint num_messages)
+{
+  InfXmlConnection* connection;
+  InfXmlConnectionStatus status;
+
+  xmlNodePtr container;
+  xmlNodePtr child;
+  xmlNodePtr xml;
+  InfCommunicationRegistrySerialized* serialized;
+  gsize size;
+  guint i;
+
+  container = inf_communication_registry_new_container(entry);
 
   for(i = 0; i < num_messages && ((xml = entry->queue_begin) != NULL); ++ i)
   {
+    /* A message with a shared serialization needs to be sent in a
+     * container of its own, since the serialization covers the whole
+     * container. */
+    if(xml->_private != NULL && container->children != NULL)
+      break;
+
     entry->queue_begin = entry->queue_begin->next;
     if(entry->queue_begin == NULL) entry->queue_end = NULL;
     ++ entry->inner_count;
 
+    size = inf_communication_registry_message_size(xml);
+    -- entry->queue_length;
+    entry->queue_size -= size;
+    if(entry->connection_info != NULL)
+      entry->connection_info->queue_size -= size;
+
     xmlUnlinkNode(xml);
     xmlAddChild(container, xml);
+
+    if(xml->_private != NULL)
+    {
+      container->_private = xml->_private;
+      xml->_private = NULL;
+      break;
+    }
   }
 
   /* Keep order of enqueued() calls and inf_xml_connection_send() calls
@@ -180,7 +457,24 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
        * will simply append to entry->enqueued_list, and we will enqueue and
        * send the messages within the next iteration(s).
        */
-      inf_xml_connection_send(connection, xml);
+      serialized = (InfCommunicationRegistrySerialized*)xml->_private;
+      if(serialized != NULL)
+      {
+        xml->_private = NULL;
+
+        inf_xml_connection_send_serialized(
+          connection,
+          xml,
+          serialized->text,
+          serialized->binary
+        );
+
+        inf_communication_registry_serialized_free(serialized);
+      }
+      else
+      {
+        inf_xml_connection_send(connection, xml);
+      }
 
       /* Break if sending the data lead to connection closure */
       g_object_get(G_OBJECT(connection), "status", &status, NULL);
@@ -220,14 +514,19 @@ inf_communication_registry_entry_free(gpointer data)
    * 3) Allow connection manager to return existing groups on join or host,
    * as the groups can live longer than people expect.
    */
+  /* Messages with a shared serialization are sent in a container of their
+   * own, so it might take more than one round to send everything. */
   g_object_get(G_OBJECT(entry->key.connection), "status", &status, NULL);
-  if(status != INF_XML_CONNECTION_CLOSING &&
-     status != INF_XML_CONNECTION_CLOSED)
+  while(entry->queue_begin != NULL &&
+        status != INF_XML_CONNECTION_CLOSING &&
+        status != INF_XML_CONNECTION_CLOSED)
   {
-    if(entry->queue_begin != NULL)
-      inf_communication_registry_send_real(entry, G_MAXUINT);
+    inf_communication_registry_send_real(entry, G_MAXUINT);
+    g_object_get(G_OBJECT(entry->key.connection), "status", &status, NULL);
   }
 
+  inf_communication_registry_entry_clear_queue(entry);
+
   if(entry->group)
   {
     g_object_weak_unref(
@@ -548,25 +847,23 @@ inf_communication_registry_notify_status_cb(GObject* object,
   }
 }
 
-static void
+static InfCommunicationRegistryConnection*
 inf_communication_registry_add_connection(InfCommunicationRegistry* registry,
                                           InfXmlConnection* connection)
 {
   InfCommunicationRegistryPrivate* priv;
-  gpointer reg;
+  InfCommunicationRegistryConnection* info;
 
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
-  reg = g_hash_table_lookup(priv->connections, connection);
-  g_hash_table_steal(priv->connections, connection);
+  info = g_hash_table_lookup(priv->connections, connection);
 
-  if(reg == NULL)
+  if(info == NULL)
   {
-    g_hash_table_insert(
-      priv->connections,
-      connection,
-      GUINT_TO_POINTER(1)
-    );
+    info = g_slice_new(InfCommunicationRegistryConnection);
+    info->registrations = 1;
+    info->queue_size = 0;
 
+    g_hash_table_insert(priv->connections, connection, info);
     g_object_ref(connection);
 
     g_signal_connect_after(
@@ -592,12 +889,10 @@ inf_communication_registry_add_connection(InfCommunicationRegistry* registry,
   }
   else
   {
-    g_hash_table_insert(
-      priv->connections,
-      connection,
-      GUINT_TO_POINTER(1+GPOINTER_TO_UINT(reg))
-    );
+    ++ info->registrations;
   }
+
+  return info;
 }
 
 static void
@@ -605,26 +900,20 @@ inf_communication_registry_remove_connection(InfCommunicationRegistry* rgstry,
                                              InfXmlConnection* connection)
 {
   InfCommunicationRegistryPrivate* priv;
-  gpointer reg;
-  guint count;
+  InfCommunicationRegistryConnection* info;
 
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(rgstry);
-  reg = g_hash_table_lookup(priv->connections, connection);
-  g_assert(reg != NULL);
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL);
 
-  g_hash_table_steal(priv->connections, connection);
-
-  count = GPOINTER_TO_UINT(reg);
-  if(--count > 0)
-  {
-    g_hash_table_insert(
-      priv->connections,
-      connection,
-      GUINT_TO_POINTER(count)
-    );
-  }
-  else
+  if(--info->registrations == 0)
   {
+    /* All entries have either been removed or unregistered */
+    g_assert(info->queue_size == 0);
+
+    g_hash_table_remove(priv->connections, connection);
+    g_slice_free(InfCommunicationRegistryConnection, info);
+
     inf_signal_handlers_disconnect_by_func(
       G_OBJECT(connection),
       G_CALLBACK(inf_communication_registry_received_cb),
@@ -698,6 +987,69 @@ inf_communication_registry_group_unrefed(gpointer user_data,
   }
 }
 
+static void
+inf_communication_registry_enqueue(InfCommunicationRegistryEntry* entry,
+                                   xmlNodePtr xml)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryConnection* info;
+  gsize size;
+  gboolean exceeded;
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(entry->registry);
+  info = entry->connection_info;
+  size = inf_communication_registry_message_size(xml);
+  exceeded = FALSE;
+
+  if(entry->queue_end == NULL)
+  {
+    entry->queue_begin = xml;
+    entry->queue_end = xml;
+  }
+  else
+  {
+    entry->queue_end->next = xml;
+    entry->queue_end = xml;
+  }
+
+  ++ entry->queue_length;
+  entry->queue_size += size;
+
+  if(info != NULL)
+  {
+    /* Only report the backlog when it grows beyond the limit, not for
+     * every message that is queued while it stays there. */
+    if(priv->queue_size_limit > 0 &&
+       info->queue_size <= priv->queue_size_limit &&
+       info->queue_size + size > priv->queue_size_limit)
+    {
+      exceeded = TRUE;
+    }
+
+    info->queue_size += size;
+  }
+
+  if(exceeded)
+  {
+    g_signal_emit(
+      entry->registry,
+      registry_signals[QUEUE_SIZE_EXCEEDED],
+      0,
+      entry->key.connection
+    );
+  }
+
+  /* If there is something in the inner queue, don't send directly but wait
+   * until the message has been sent, for better packing. */
+  if(entry->inner_count == 0)
+  {
+    inf_communication_registry_send_real(
+      entry,
+      INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
+    );
+  }
+}
+
 /*
  * GObject overrides.
  */
@@ -709,6 +1061,7 @@ inf_communication_registry_init(InfCommunicationRegistry* registry)
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
 
   priv->connections = g_hash_table_new(NULL, NULL);
+  priv->queue_size_limit = 0;
 
   priv->entries = g_hash_table_new_full(
     inf_communication_registry_key_hash,
@@ -725,10 +1078,16 @@ inf_communication_registry_dispose(GObject* object)
   InfCommunicationRegistryPrivate* priv;
   GHashTableIter iter;
   gpointer key;
+  gpointer value;
 
   registry = INF_COMMUNICATION_REGISTRY(object);
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
 
+  /* The connection infos are freed below, before the entries */
+  g_hash_table_iter_init(&iter, priv->entries);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+    ((InfCommunicationRegistryEntry*)value)->connection_info = NULL;
+
   if(g_hash_table_size(priv->connections))
   {
     g_warning(
@@ -740,7 +1099,7 @@ inf_communication_registry_dispose(GObject* object)
      * the signal handlers cannot be disconnected easily this way as we
      * don't have access to the registry in the FreeFunc. */
     g_hash_table_iter_init(&iter, priv->connections);
-    while(g_hash_table_iter_next(&iter, &key, NULL))
+    while(g_hash_table_iter_next(&iter, &key, &value))
     {
       inf_signal_handlers_disconnect_by_func(
         G_OBJECT(key),
@@ -760,6 +1119,7 @@ inf_communication_registry_dispose(GObject* object)
         registry
       );
 
+      g_slice_free(InfCommunicationRegistryConnection, value);
       g_object_unref(key);
     }
   }
@@ -778,6 +1138,32 @@ inf_communication_registry_class_init(
   object_class = G_OBJECT_CLASS(registry_class);
 
   object_class->dispose = inf_communication_registry_dispose;
+
+  /**
+   * InfCommunicationRegistry::queue-size-exceeded:
+   * @registry: The #InfCommunicationRegistry emitting the signal.
+   * @connection: The connection whose backlog exceeds the limit.
+   *
+   * This signal is emitted when the number of bytes waiting to be sent to
+   * @connection grows beyond the limit set with
+   * inf_communication_registry_set_queue_size_limit(). It is not emitted
+   * again until the backlog has dropped below the limit.
+   *
+   * The signal is emitted while a message is being queued, so handlers
+   * must neither send messages nor close @connection. They can schedule
+   * doing so from the main loop instead.
+   */
+  registry_signals[QUEUE_SIZE_EXCEEDED] = g_signal_new(
+    "queue-size-exceeded",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    g_cclosure_marshal_VOID__OBJECT,
+    G_TYPE_NONE,
+    1,
+    INF_TYPE_XML_CONNECTION
+  );
 }
 
 /**
@@ -802,6 +1188,7 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
+  InfCommunicationRegistryConnection* info;
   InfXmlConnectionStatus status;
   gchar* local_id;
   gchar* remote_id;
@@ -820,7 +1207,7 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     inf_communication_group_get_publisher_id(group, connection);
   key.group_name = inf_communication_group_get_name(group);
 
-  inf_communication_registry_add_connection(registry, connection);
+  info = inf_communication_registry_add_connection(registry, connection);
 
   entry = g_hash_table_lookup(priv->entries, &key);
   if(entry != NULL)
@@ -828,6 +1215,9 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     /* Reactivation */
     g_assert(entry->registered == FALSE);
     entry->registered = TRUE;
+
+    entry->connection_info = info;
+    info->queue_size += entry->queue_size;
   }
   else
   {
@@ -854,10 +1244,13 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
 
     entry->group = group;
     entry->method = method;
+    entry->connection_info = info;
 
     entry->inner_count = 0;
     entry->queue_begin = NULL;
     entry->queue_end = NULL;
+    entry->queue_length = 0;
+    entry->queue_size = 0;
 
     entry->registered = TRUE;
     entry->activation_count = 0;
@@ -894,7 +1287,6 @@ inf_communication_registry_unregister(InfCommunicationRegistry* registry,
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
   InfXmlConnectionStatus status;
-  xmlNodePtr xml;
 
   g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
@@ -919,11 +1311,14 @@ inf_communication_registry_unregister(InfCommunicationRegistry* registry,
     /* The entry has still messages to send, so don't remove it right now
      * but wait until all scheduled messages have been sent. */
     entry->registered = FALSE;
-    entry->activation_count = entry->inner_count;
-    for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
-      ++ entry->activation_count;
+    entry->activation_count = entry->inner_count + entry->queue_length;
     g_assert(entry->activation_count > 0);
 
+    /* The remaining messages no longer count for the connection */
+    g_assert(entry->connection_info->queue_size >= entry->queue_size);
+    entry->connection_info->queue_size -= entry->queue_size;
+    entry->connection_info = NULL;
+
     /* Keep an additional reference on the connection as the connection will
      * be unregistered below. */
     g_object_ref(connection);
@@ -1016,28 +1411,199 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
   g_assert(entry != NULL && entry->registered == TRUE);
 
   xmlUnlinkNode(xml);
-  if(entry->queue_end == NULL)
+  inf_communication_registry_enqueue(entry, xml);
+
+  g_free(key.publisher_id);
+}
+
+/**
+ * inf_communication_registry_send_serialized:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the message #InfCommunicationGroup.
+ * @connection: A registered #InfXmlConnection.
+ * @xml: (transfer none): The message to send.
+ * @serialized: The serialization of @xml.
+ *
+ * Sends an XML message to @connection, like inf_communication_registry_send().
+ * @serialized needs to contain the serialization of @xml alone, as written
+ * by xmlNodeDump(). If @connection supports
+ * inf_xml_connection_send_serialized(), then only the group container is
+ * serialized and sent around @serialized, and @xml is not serialized again.
+ * This allows the caller to send the same message to many connections, or
+ * to the same connection several times, without serializing it each time.
+ * Otherwise, a copy of @xml is sent as usual.
+ *
+ * This function does not take ownership of @xml.
+ */
+void
+inf_communication_registry_send_serialized(InfCommunicationRegistry* registry,
+                                           InfCommunicationGroup* group,
+                                           InfXmlConnection* connection,
+                                           xmlNodePtr xml,
+                                           GBytes* serialized)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+  xmlNodePtr message;
+  GBytes* wrapped;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+  g_return_if_fail(serialized != NULL);
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  key.connection = connection;
+  key.publisher_id =
+    inf_communication_group_get_publisher_id(group, connection);
+  key.group_name = inf_communication_group_get_name(group);
+
+  entry = g_hash_table_lookup(priv->entries, &key);
+  g_assert(entry != NULL && entry->registered == TRUE);
+
+  if(inf_xml_connection_supports_serialized(connection))
   {
-    entry->queue_begin = xml;
-    entry->queue_end = xml;
+    /* As for inf_communication_registry_broadcast(), only the name and
+     * attributes of the message are needed from here on. */
+    message = xmlCopyNode(xml, 2);
+    wrapped = inf_communication_registry_wrap(entry, serialized);
+
+    message->_private =
+      inf_communication_registry_serialized_new(wrapped, NULL);
+
+    g_bytes_unref(wrapped);
   }
   else
   {
-    entry->queue_end->next = xml;
-    entry->queue_end = xml;
+    message = xmlCopyNode(xml, 1);
   }
 
-  /* If there is something in the inner queue, don't send directly but wait
-   * until the message has been sent, for better packing. */
-  if(entry->inner_count == 0)
+  inf_communication_registry_enqueue(entry, message);
+  g_free(key.publisher_id);
+}
+
+/**
+ * inf_communication_registry_broadcast:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the message #InfCommunicationGroup.
+ * @connections: (element-type InfXmlConnection): A list of connections to
+ * send the message to.
+ * @xml: (transfer full): The message to send.
+ *
+ * Sends an XML message to all connections in @connections that are
+ * registered for @group and open. Connections that are not registered, or
+ * that are not open anymore, are skipped. Other than that, this behaves as
+ * if inf_communication_registry_send() was called for each connection with
+ * a copy of @xml.
+ *
+ * The message is serialized only once for all connections which support
+ * inf_xml_connection_send_serialized(), and the serialization is shared
+ * between them. This includes the binary encoding of the message for
+ * connections which negotiated binary framing. Other connections get a copy
+ * of @xml as usual.
+ *
+ * The caller needs to make sure that the connections in @connections stay
+ * alive while this function runs, since callbacks may be invoked as a
+ * result of sending the message. This function takes ownership of @xml.
+ */
+void
+inf_communication_registry_broadcast(InfCommunicationRegistry* registry,
+                                     InfCommunicationGroup* group,
+                                     GSList* connections,
+                                     xmlNodePtr xml)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+  InfXmlConnection* connection;
+  InfXmlConnectionStatus status;
+  GSList* item;
+
+  GBytes* serialized;
+  GBytes* binary;
+  gchar* serialized_publisher;
+  xmlNodePtr message;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(xml != NULL);
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  xmlUnlinkNode(xml);
+
+  serialized = NULL;
+  binary = NULL;
+  serialized_publisher = NULL;
+
+  for(item = connections; item != NULL; item = item->next)
   {
-    inf_communication_registry_send_real(
-      entry,
-      INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
-    );
+    connection = INF_XML_CONNECTION(item->data);
+
+    /* A callback from a prior iteration might have closed or unregistered
+     * the connection, so look up the entry again for every connection. */
+    g_object_get(G_OBJECT(connection), "status", &status, NULL);
+    if(status != INF_XML_CONNECTION_OPEN)
+      continue;
+
+    key.connection = connection;
+    key.publisher_id =
+      inf_communication_group_get_publisher_id(group, connection);
+    key.group_name = inf_communication_group_get_name(group);
+
+    entry = g_hash_table_lookup(priv->entries, &key);
+    g_free(key.publisher_id);
+
+    if(entry == NULL || entry->registered == FALSE)
+      continue;
+
+    if(inf_xml_connection_supports_serialized(connection))
+    {
+      /* The serialization includes the group container, so it can only be
+       * shared between entries using the same publisher string. For hosted
+       * groups, this is the case for all connections. */
+      if(serialized == NULL ||
+         g_strcmp0(serialized_publisher, entry->publisher_string) != 0)
+      {
+        if(serialized != NULL)
+          g_bytes_unref(serialized);
+        if(binary != NULL)
+          g_bytes_unref(binary);
+        g_free(serialized_publisher);
+
+        /* The binary encoding is cheap to produce compared to the XML
+         * text, so we always do both instead of finding out which one is
+         * needed by which connection. Connections decide when sending,
+         * since they can switch to binary framing while the message is
+         * queued. */
+        serialized = inf_communication_registry_serialize(entry, xml);
+        binary = inf_communication_registry_serialize_binary(entry, xml);
+        serialized_publisher = g_strdup(entry->publisher_string);
+      }
+
+      /* Only the name and attributes of the message are copied, which is
+       * what is reported to inf_communication_method_enqueued() and
+       * inf_communication_method_sent(). */
+      message = xmlCopyNode(xml, 2);
+      message->_private =
+        inf_communication_registry_serialized_new(serialized, binary);
+    }
+    else
+    {
+      message = xmlCopyNode(xml, 1);
+    }
+
+    inf_communication_registry_enqueue(entry, message);
   }
 
-  g_free(key.publisher_id);
+  if(serialized != NULL)
+    g_bytes_unref(serialized);
+  if(binary != NULL)
+    g_bytes_unref(binary);
+  g_free(serialized_publisher);
+
+  xmlFreeNode(xml);
 }
 
 /**
@@ -1072,11 +1638,83 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   g_assert(entry != NULL && entry->registered == TRUE);
 
   /* TODO: Don't cancel messages prior activation? */
-  xmlFreeNodeList(entry->queue_begin);
-  entry->queue_begin = NULL;
-  entry->queue_end = NULL;
+  inf_communication_registry_entry_clear_queue(entry);
 
   g_free(key.publisher_id);
 }
 
+/**
+ * inf_communication_registry_get_queue_size:
+ * @registry: A #InfCommunicationRegistry.
+ * @connection: A #InfXmlConnection.
+ *
+ * Returns the number of bytes of messages that are scheduled to be sent to
+ * @connection in any group it is registered for, but that have not yet been
+ * handed to @connection. Messages are only handed to a connection once it
+ * has sent the previous ones, so this grows if the remote host does not
+ * receive messages as fast as they are produced.
+ *
+ * Messages broadcast with inf_communication_registry_broadcast() or sent
+ * with inf_communication_registry_send_serialized() are counted with the
+ * size of their serialization. The size of other messages is estimated.
+ *
+ * Returns: The number of bytes waiting to be sent to @connection, or 0 if
+ * @connection is not registered.
+ */
+gsize
+inf_communication_registry_get_queue_size(InfCommunicationRegistry* registry,
+                                          InfXmlConnection* connection)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryConnection* info;
+
+  g_return_val_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry), 0);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), 0);
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  info = g_hash_table_lookup(priv->connections, connection);
+  if(info == NULL)
+    return 0;
+
+  return info->queue_size;
+}
+
+/**
+ * inf_communication_registry_set_queue_size_limit:
+ * @registry: A #InfCommunicationRegistry.
+ * @limit: The number of bytes that may wait to be sent to a connection, or
+ * 0.
+ *
+ * Makes @registry emit the #InfCommunicationRegistry::queue-size-exceeded
+ * signal whenever the backlog of a connection, as returned by
+ * inf_communication_registry_get_queue_size(), grows beyond @limit. If
+ * @limit is 0, then the signal is not emitted.
+ */
+void
+inf_communication_registry_set_queue_size_limit(
+  InfCommunicationRegistry* registry,
+  gsize limit)
+{
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  INF_COMMUNICATION_REGISTRY_PRIVATE(registry)->queue_size_limit = limit;
+}
+
+/**
+ * inf_communication_registry_get_queue_size_limit:
+ * @registry: A #InfCommunicationRegistry.
+ *
+ * Returns the limit set with
+ * inf_communication_registry_set_queue_size_limit().
+ *
+ * Returns: The number of bytes that may wait to be sent to a connection
+ * before #InfCommunicationRegistry::queue-size-exceeded is emitted, or 0.
+ */
+gsize
+inf_communication_registry_get_queue_size_limit(
+  InfCommunicationRegistry* registry)
+{
+  g_return_val_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry), 0);
+  return INF_COMMUNICATION_REGISTRY_PRIVATE(registry)->queue_size_limit;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -83,11 +83,37 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml);
 
+void
+inf_communication_registry_send_serialized(InfCommunicationRegistry* registry,
+                                           InfCommunicationGroup* group,
+                                           InfXmlConnection* connection,
+                                           xmlNodePtr xml,
+                                           GBytes* serialized);
+
+void
+inf_communication_registry_broadcast(InfCommunicationRegistry* registry,
+                                     InfCommunicationGroup* group,
+                                     GSList* connections,
+                                     xmlNodePtr xml);
+
 void
 inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
                                            InfCommunicationGroup* group,
                                            InfXmlConnection* connection);
 
+gsize
+inf_communication_registry_get_queue_size(InfCommunicationRegistry* registry,
+                                          InfXmlConnection* connection);
+
+void
+inf_communication_registry_set_queue_size_limit(
+  InfCommunicationRegistry* registry,
+  gsize limit);
+
+gsize
+inf_communication_registry_get_queue_size_limit(
+  InfCommunicationRegistry* registry);
+
 G_END_DECLS
 
 #endif /* __INF_COMMUNICATION_REGISTRY_H__ */
@@ -38,6 +38,8 @@
 #include <libinfinity/server/infd-account-storage.h>
 #include <libinfinity/server/infd-request.h>
 #include <libinfinity/server/infd-progress-request.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/common/inf-session.h>
 #include <libinfinity/common/inf-chat-session.h>
 #include <libinfinity/common/inf-request-result.h>
@@ -48,6 +50,7 @@
 #include <libinfinity/communication/inf-communication-object.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
+#include <libinfinity/inf-define-enum.h>
 
 #include <gnutls/gnutls.h>
 
@@ -59,6 +62,8 @@ typedef enum _InfdDirectoryNodeType {
   INFD_DIRECTORY_NODE_UNKNOWN,
 } InfdDirectoryNodeType;
 
+typedef struct _InfdDirectorySaveSessionData InfdDirectorySaveSessionData;
+
 typedef struct _InfdDirectoryNode InfdDirectoryNode;
 struct _InfdDirectoryNode {
   InfdDirectoryNode* parent;
@@ -66,6 +71,9 @@ struct _InfdDirectoryNode {
   InfdDirectoryNode* next;
 
   InfAclSheetSet* acl;
+  /* Whether acl has been read from the storage. Nodes found during
+   * exploration read their ACL only once it is needed for the first time. */
+  gboolean acl_loaded;
   GSList* acl_connections;
 
   InfdDirectoryNodeType type;
@@ -80,6 +88,11 @@ struct _InfdDirectoryNode {
       const InfdNotePlugin* plugin;
       /* Timeout to save the session when inactive for some time */
       InfIoTimeout* save_timeout;
+      /* Time at which the session has become inactive, so that the least
+       * recently active sessions are unloaded first when memory is short */
+      gint64 idle_since;
+      /* Asynchronous save in progress, or NULL */
+      InfdDirectorySaveSessionData* save;
       /* Whether we hold a weak reference or a strong reference on session */
       gboolean weakref;
     } note;
@@ -110,6 +123,78 @@ struct _InfdDirectorySessionSaveTimeoutData {
   InfdDirectoryNode* node;
 };
 
+struct _InfdDirectorySaveSessionData {
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfAsyncOperation* operation;
+  InfdDirectorySaveSessionFunc func;
+  gpointer user_data;
+};
+
+/* A session being read from storage in steps, one per main loop iteration,
+ * for note plugins that support it. Remote hosts subscribing to the session
+ * meanwhile are replied to once it has been read. */
+typedef struct _InfdDirectorySessionRead InfdDirectorySessionRead;
+struct _InfdDirectorySessionRead {
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfdProgressRequest* request;
+
+  /* Handle of the note plugin, NULL once it has been ended */
+  gpointer handle;
+  InfIoDispatch* dispatch;
+
+  guint current;
+  guint total;
+
+  GSList* replies;
+};
+
+typedef struct _InfdDirectorySessionReadReply InfdDirectorySessionReadReply;
+struct _InfdDirectorySessionReadReply {
+  InfXmlConnection* connection;
+  gchar* seq;
+};
+
+typedef struct _InfdDirectoryExplore InfdDirectoryExplore;
+
+/* Reading a subdirectory from storage in a worker thread */
+typedef struct _InfdDirectoryExploreRead InfdDirectoryExploreRead;
+struct _InfdDirectoryExploreRead {
+  InfdDirectoryExplore* explore;
+  InfIo* io;
+  InfdStorage* storage;
+  gchar* path;
+  GSList* list;
+  GError* error;
+};
+
+/* A remote explore request. Once the subdirectory has been read, the
+ * connection is sent the nodes as they are registered, until the
+ * exploration finishes. */
+typedef struct _InfdDirectoryExploreReply InfdDirectoryExploreReply;
+struct _InfdDirectoryExploreReply {
+  InfXmlConnection* connection;
+  gchar* seq;
+};
+
+struct _InfdDirectoryExplore {
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  /* Can be NULL if the exploration was not requested formally */
+  InfdProgressRequest* request;
+
+  /* Set while the subdirectory is being read from storage */
+  InfAsyncOperation* operation;
+  /* Set while the nodes read are being registered */
+  InfIoDispatch* dispatch;
+
+  GSList* list;
+  /* First storage node in list that has not yet been registered */
+  GSList* next;
+  GSList* replies;
+};
+
 typedef struct _InfdDirectorySyncIn InfdDirectorySyncIn;
 struct _InfdDirectorySyncIn {
   InfdDirectory* directory;
@@ -142,6 +227,8 @@ struct _InfdDirectorySubreq {
     struct {
       InfdSessionProxy* session;
       InfdRequest* request;
+      /* State of the client's copy if the subscription is resumed */
+      InfAdoptedStateVector* resume_vector;
     } session;
 
     struct {
@@ -173,6 +260,9 @@ typedef struct _InfdDirectoryConnectionInfo InfdDirectoryConnectionInfo;
 struct _InfdDirectoryConnectionInfo {
   guint seq_id;
   InfAclAccountId account_id;
+
+  /* Whether the connection was throttled because of its send queue */
+  gboolean throttled;
 };
 
 typedef struct _InfdDirectoryTransientAccount InfdDirectoryTransientAccount;
@@ -202,11 +292,25 @@ struct _InfdDirectoryPrivate {
   GHashTable* nodes; /* Mapping from id to node */
   InfdDirectoryNode* root;
   InfAclSheetSet* orig_root_acl; /* in case root->acl is altered */
+  /* used for nodes whose ACL cannot be read */
+  InfAclSheetSet* unreadable_acl;
 
+  GSList* explores;
+  GSList* session_reads;
   GSList* sync_ins;
   GSList* subscription_requests;
 
   InfdSessionProxy* chat_session;
+
+  guint64 memory_budget;
+  InfIoTimeout* memory_timeout;
+
+  guint64 send_queue_limit;
+  InfdDirectorySlowConsumerPolicy slow_consumer_policy;
+  InfIoTimeout* send_queue_timeout;
+  InfIoDispatch* send_queue_dispatch;
+
+  InfdLoopPool* loop_pool;
 };
 
 enum {
@@ -219,9 +323,14 @@ enum {
 
   PROP_PRIVATE_KEY,
   PROP_CERTIFICATE,
+  PROP_MEMORY_BUDGET,
+  PROP_SEND_QUEUE_LIMIT,
+  PROP_SLOW_CONSUMER_POLICY,
+  PROP_LOOP_POOL,
 
   /* read only */
   PROP_CHAT_SESSION,
+  PROP_MEMORY_USAGE,
   PROP_STATUS
 };
 
@@ -279,8 +388,36 @@ static GQuark infd_directory_node_id_quark;
 /* TODO: This should be a property: */
 static const guint INFD_DIRECTORY_SAVE_TIMEOUT = 60000;
 
+/* Interval in which the memory used by sessions is checked against the
+ * memory budget */
+static const guint INFD_DIRECTORY_MEMORY_CHECK_INTERVAL = 10000;
+
+/* Interval in which the send queues of the connections are checked against
+ * the send queue limit */
+static const guint INFD_DIRECTORY_SEND_QUEUE_CHECK_INTERVAL = 1000;
+
+/* Number of nodes registered in one main loop iteration when exploring */
+static const guint INFD_DIRECTORY_EXPLORE_CHUNK_SIZE = 256;
+
+static const GEnumValue infd_directory_slow_consumer_policy_values[] = {
+  {
+    INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT,
+    "INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT",
+    "disconnect"
+  }, {
+    INFD_DIRECTORY_SLOW_CONSUMER_THROTTLE,
+    "INFD_DIRECTORY_SLOW_CONSUMER_THROTTLE",
+    "throttle"
+  }, {
+    0,
+    NULL,
+    NULL
+  }
+};
+
 static void infd_directory_communication_object_iface_init(InfCommunicationObjectInterface* iface);
 static void infd_directory_browser_iface_init(InfBrowserInterface* iface);
+INF_DEFINE_ENUM_TYPE(InfdDirectorySlowConsumerPolicy, infd_directory_slow_consumer_policy, infd_directory_slow_consumer_policy_values)
 G_DEFINE_TYPE_WITH_CODE(InfdDirectory, infd_directory, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfdDirectory)
   G_IMPLEMENT_INTERFACE(INF_COMMUNICATION_TYPE_OBJECT, infd_directory_communication_object_iface_init)
@@ -367,6 +504,66 @@ infd_directory_node_make_path(InfdDirectoryNode* node,
   g_string_free(str, FALSE);
 }
 
+/*
+ * Asynchronous save
+ */
+
+static void
+infd_directory_save_session_finish(InfdDirectorySaveSessionData* data,
+                                   const GError* error)
+{
+  InfBrowserIter iter;
+
+  g_assert(data->node->shared.note.save == data);
+  data->node->shared.note.save = NULL;
+
+  iter.node_id = data->node->id;
+  iter.node = data->node;
+
+  data->func(data->directory, &iter, error, data->user_data);
+  g_slice_free(InfdDirectorySaveSessionData, data);
+}
+
+static void
+infd_directory_save_session_write_func(const GError* error,
+                                       gpointer user_data)
+{
+  infd_directory_save_session_finish(
+    (InfdDirectorySaveSessionData*)user_data,
+    error
+  );
+}
+
+/* Cancels an asynchronous save of the session of node, if any. This needs
+ * to be done before the session is written synchronously, so that the
+ * older snapshot does not replace the newer file when it finishes, and
+ * before the node is freed. */
+static void
+infd_directory_node_cancel_save(InfdDirectoryNode* node)
+{
+  InfdDirectorySaveSessionData* data;
+  GError* error;
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+
+  data = node->shared.note.save;
+  if(data != NULL)
+  {
+    inf_async_operation_free(data->operation);
+
+    error = NULL;
+    g_set_error_literal(
+      &error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_SAVE_CANCELLED,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_SAVE_CANCELLED)
+    );
+
+    infd_directory_save_session_finish(data, error);
+    g_error_free(error);
+  }
+}
+
 /*
  * Save timeout
  */
@@ -383,38 +580,40 @@ infd_directory_session_save_timeout_data_free(gpointer data)
   g_slice_free(InfdDirectorySessionSaveTimeoutData, data);
 }
 
-static void
-infd_directory_session_save_timeout_func(gpointer user_data)
+/* Writes the session of node into the storage and removes it from memory.
+ * If it cannot be written, then it is kept in memory. */
+static gboolean
+infd_directory_node_unload_session(InfdDirectory* directory,
+                                   InfdDirectoryNode* node)
 {
-  InfdDirectorySessionSaveTimeoutData* timeout_data;
   InfdDirectoryPrivate* priv;
   GError* error;
   gchar* path;
   gboolean result;
   InfSession* session;
 
-  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
-
-  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
-  priv = INFD_DIRECTORY_PRIVATE(timeout_data->directory);
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.save_timeout == NULL);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
   error = NULL;
 
-  infd_directory_node_get_path(timeout_data->node, &path, NULL);
+  infd_directory_node_get_path(node, &path, NULL);
 
   g_object_get(
-    G_OBJECT(timeout_data->node->shared.note.session),
+    G_OBJECT(node->shared.note.session),
     "session", &session,
     NULL
   );
 
   /* TODO: Only write if the buffer modified-flag is set */
 
-  result = timeout_data->node->shared.note.plugin->session_write(
+  infd_directory_node_cancel_save(node);
+
+  result = node->shared.note.plugin->session_write(
     priv->storage,
     session,
     path,
-    timeout_data->node->shared.note.plugin->user_data,
+    node->shared.note.plugin->user_data,
     &error
   );
 
@@ -422,9 +621,6 @@ infd_directory_session_save_timeout_func(gpointer user_data)
 
   /* TODO: Unset modified flag of buffer if result == TRUE */
 
-  /* The timeout is removed automatically after it has elapsed */
-  timeout_data->node->shared.note.save_timeout = NULL;
-
   if(result == FALSE)
   {
     g_warning(
@@ -438,14 +634,29 @@ infd_directory_session_save_timeout_func(gpointer user_data)
   }
   else
   {
-    infd_directory_node_unlink_session(
-      timeout_data->directory,
-      timeout_data->node,
-      NULL
-    );
+    infd_directory_node_unlink_session(directory, node, NULL);
   }
 
   g_free(path);
+  return result;
+}
+
+static void
+infd_directory_session_save_timeout_func(gpointer user_data)
+{
+  InfdDirectorySessionSaveTimeoutData* timeout_data;
+  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
+
+  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
+
+  /* The timeout is removed automatically after it has elapsed */
+  timeout_data->node->shared.note.save_timeout = NULL;
+
+  infd_directory_node_unload_session(
+    timeout_data->directory,
+    timeout_data->node
+  );
 }
 
 static void
@@ -462,6 +673,7 @@ infd_directory_start_session_save_timeout(InfdDirectory* directory,
 
   if(priv->storage != NULL)
   {
+    node->shared.note.idle_since = g_get_monotonic_time();
     node->shared.note.save_timeout = inf_io_add_timeout(
       priv->io,
       INFD_DIRECTORY_SAVE_TIMEOUT,
@@ -472,140 +684,434 @@ infd_directory_start_session_save_timeout(InfdDirectory* directory,
   }
 }
 
-static void
-infd_directory_session_weak_ref_cb(gpointer data,
-                                   GObject* where_the_object_was)
+/*
+ * Memory budget
+ */
+
+static gsize
+infd_directory_node_get_memory_usage(InfdDirectoryNode* node)
 {
-  InfdDirectoryNode* node;
-  node = (InfdDirectoryNode*)data;
+  InfSession* session;
+  gsize usage;
 
-  g_assert(G_OBJECT(node->shared.note.session) == where_the_object_was);
-  g_assert(node->shared.note.weakref == TRUE);
-  g_assert(node->shared.note.save_timeout == NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session != NULL);
 
-  node->shared.note.session = NULL;
-  node->shared.note.weakref = FALSE;
+  g_object_get(
+    G_OBJECT(node->shared.note.session),
+    "session", &session,
+    NULL
+  );
+
+  usage = inf_session_get_memory_usage(session);
+  g_object_unref(session);
+
+  return usage;
 }
 
-static void
-infd_directory_session_idle_notify_cb(GObject* object,
-                                      GParamSpec* pspec,
-                                      gpointer user_data)
+static gint
+infd_directory_node_idle_since_cmp(gconstpointer first,
+                                   gconstpointer second)
+{
+  const InfdDirectoryNode* first_node;
+  const InfdDirectoryNode* second_node;
+
+  first_node = (const InfdDirectoryNode*)first;
+  second_node = (const InfdDirectoryNode*)second;
+
+  if(first_node->shared.note.idle_since < second_node->shared.note.idle_since)
+    return -1;
+  if(first_node->shared.note.idle_since > second_node->shared.note.idle_since)
+    return 1;
+  return 0;
+}
+
+/* Returns the memory used by the sessions the directory keeps in memory.
+ * Sessions to which the directory only holds a weak reference are not
+ * counted. If idle is not NULL, then the nodes whose sessions are waiting
+ * for the save timeout are stored in it, least recently active first. */
+static guint64
+infd_directory_compute_memory_usage(InfdDirectory* directory,
+                                    GSList** idle)
 {
-  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  gpointer node_id;
+  GHashTableIter iter;
+  gpointer value;
   InfdDirectoryNode* node;
+  guint64 usage;
 
-  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  node_id = g_object_get_qdata(object, infd_directory_node_id_quark);
-  node = g_hash_table_lookup(priv->nodes, node_id);
-  g_assert(node != NULL);
+  usage = 0;
 
-  /* Drop session from memory if it remains idle */
-  if(infd_session_proxy_is_idle(INFD_SESSION_PROXY(object)))
-  {
-    if(node->shared.note.weakref == FALSE &&
-       node->shared.note.save_timeout == NULL)
-    {
-      infd_directory_start_session_save_timeout(directory, node);
-    }
-  }
-  else
+  if(idle != NULL)
+    *idle = NULL;
+
+  g_hash_table_iter_init(&iter, priv->nodes);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
   {
-    /* If a session becomes non-idle again then strong-ref it */
-    if(node->shared.note.weakref == TRUE)
+    node = (InfdDirectoryNode*)value;
+    if(node->type == INFD_DIRECTORY_NODE_NOTE &&
+       node->shared.note.session != NULL &&
+       node->shared.note.weakref == FALSE)
     {
-      g_object_ref(node->shared.note.session);
-      g_assert(node->shared.note.save_timeout == NULL);
-      node->shared.note.weakref = FALSE;
+      usage += infd_directory_node_get_memory_usage(node);
 
-      g_object_weak_unref(
-        G_OBJECT(node->shared.note.session),
-        infd_directory_session_weak_ref_cb,
-        node
-      );
-    }
-    else if(node->shared.note.save_timeout != NULL)
-    {
-      inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
-      node->shared.note.save_timeout = NULL;
+      if(idle != NULL && node->shared.note.save_timeout != NULL)
+        *idle = g_slist_prepend(*idle, node);
     }
   }
+
+  if(idle != NULL)
+    *idle = g_slist_sort(*idle, infd_directory_node_idle_since_cmp);
+
+  return usage;
 }
 
-static gboolean
-infd_directory_session_reject_user_join_cb(InfdSessionProxy* proxy,
-                                           InfXmlConnection* connection,
-                                           const GArray* user_properties,
-                                           InfUser* rejoin_user,
-                                           gpointer user_data)
+/* Unloads idle sessions before their save timeout elapses, least recently
+ * active first, until the sessions in memory fit into the memory budget.
+ * Sessions with subscriptions are never unloaded, so the usage might still
+ * exceed the budget afterwards. */
+static void
+infd_directory_enforce_memory_budget(InfdDirectory* directory)
 {
-  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  gpointer node_id;
+  GSList* idle;
+  GSList* item;
   InfdDirectoryNode* node;
+  guint64 usage;
+  gsize node_usage;
 
-  InfdDirectoryConnectionInfo* info;
-  InfBrowserIter iter;
-  InfAclMask check_mask;
-  gboolean result;
-
-  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  node_id = g_object_get_qdata(G_OBJECT(proxy), infd_directory_node_id_quark);
-  node = g_hash_table_lookup(priv->nodes, node_id);
-  g_assert(node != NULL);
+  if(priv->memory_budget == 0) return;
 
-  /* ACL cannot prevent local users from joining */
-  if(connection != NULL)
+  usage = infd_directory_compute_memory_usage(directory, &idle);
+  for(item = idle;
+      item != NULL && usage > priv->memory_budget;
+      item = item->next)
   {
-    info = g_hash_table_lookup(priv->connections, connection);
-    g_assert(info != NULL);
+    node = (InfdDirectoryNode*)item->data;
 
-    iter.node_id = node->id;
-    iter.node = node;
+    /* Unloading another session might have made this one active again */
+    if(node->shared.note.save_timeout == NULL)
+      continue;
 
-    inf_acl_mask_set1(&check_mask, INF_ACL_CAN_JOIN_USER);
+    node_usage = infd_directory_node_get_memory_usage(node);
 
-    result = inf_browser_check_acl(
-      INF_BROWSER(directory),
-      &iter,
-      info->account_id,
-      &check_mask,
-      NULL
-    );
+    inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
+    node->shared.note.save_timeout = NULL;
 
-    /* Reject the user join if the permission is not set. */
-    if(result == FALSE)
-      return TRUE;
+    /* The session is reloaded from the storage when it is subscribed to
+     * again. */
+    if(infd_directory_node_unload_session(directory, node) == TRUE)
+      usage -= MIN(usage, node_usage);
   }
 
-  return FALSE;
+  g_slist_free(idle);
 }
 
-/* Releases a session fully from the directory. This is not normally needed
- * because if we don't need a session anymore we still keep a weak reference
- * to it around, in case we need to recover it later. When nobody is holding
- * a strong reference to it anymore we clear the pointer in
- * infd_directory_session_weak_ref_cb(). The only point where this function
- * is being called is when a node with an active session is removed from the
- * directory. */
 static void
-infd_directory_release_session(InfdDirectory* directory,
-                               InfdDirectoryNode* node,
-                               InfdSessionProxy* session)
+infd_directory_memory_timeout_func(gpointer user_data)
 {
+  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
 
+  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(node->shared.note.session == session);
+  priv->memory_timeout = inf_io_add_timeout(
+    priv->io,
+    INFD_DIRECTORY_MEMORY_CHECK_INTERVAL,
+    infd_directory_memory_timeout_func,
+    directory,
+    NULL
+  );
 
-  if(node->shared.note.save_timeout != NULL)
-  {
+  infd_directory_enforce_memory_budget(directory);
+}
+
+/* Throttles or closes connections with more bytes waiting to be sent to
+ * them than the send queue limit, according to the slow consumer policy.
+ * A throttled connection is read from again once its queue has drained to
+ * half the limit. If the queue of a throttled connection keeps growing
+ * anyway, for example with the requests of other users in a session, then
+ * it is closed once it reaches twice the limit. */
+static void
+infd_directory_enforce_send_queue_limit(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  InfXmlConnection* connection;
+  InfdDirectoryConnectionInfo* info;
+  InfXmlConnectionStatus status;
+  GSList* slow;
+  guint64 size;
+  GError* error;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  slow = NULL;
+
+  g_hash_table_iter_init(&iter, priv->connections);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    connection = INF_XML_CONNECTION(key);
+    info = (InfdDirectoryConnectionInfo*)value;
+
+    size = inf_communication_manager_get_queue_size(
+      priv->communication_manager,
+      connection
+    );
+
+    if(info->throttled)
+    {
+      if(priv->send_queue_limit == 0 || size <= priv->send_queue_limit / 2)
+      {
+        info->throttled = FALSE;
+        inf_xml_connection_set_throttled(connection, FALSE);
+      }
+      else if(size / 2 > priv->send_queue_limit)
+      {
+        slow = g_slist_prepend(slow, g_object_ref(connection));
+      }
+    }
+    else if(priv->send_queue_limit > 0 && size > priv->send_queue_limit)
+    {
+      if(priv->slow_consumer_policy == INFD_DIRECTORY_SLOW_CONSUMER_THROTTLE &&
+         inf_xml_connection_supports_throttling(connection))
+      {
+        info->throttled = TRUE;
+        inf_xml_connection_set_throttled(connection, TRUE);
+      }
+      else
+      {
+        slow = g_slist_prepend(slow, g_object_ref(connection));
+      }
+    }
+  }
+
+  /* Closing a connection removes it from the connection table, so this is
+   * done only after iterating over it. */
+  while(slow != NULL)
+  {
+    connection = INF_XML_CONNECTION(slow->data);
+
+    g_object_get(G_OBJECT(connection), "status", &status, NULL);
+    if(status == INF_XML_CONNECTION_OPEN)
+    {
+      error = NULL;
+      g_set_error_literal(
+        &error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_SLOW_CONSUMER,
+        _("Too much data is waiting to be sent to the connection")
+      );
+
+      inf_xml_connection_error(connection, error);
+      g_error_free(error);
+
+      inf_xml_connection_close(connection);
+    }
+
+    g_object_unref(connection);
+    slow = g_slist_delete_link(slow, slow);
+  }
+}
+
+static void
+infd_directory_send_queue_timeout_func(gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+
+  directory = INFD_DIRECTORY(user_data);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  priv->send_queue_timeout = inf_io_add_timeout(
+    priv->io,
+    INFD_DIRECTORY_SEND_QUEUE_CHECK_INTERVAL,
+    infd_directory_send_queue_timeout_func,
+    directory,
+    NULL
+  );
+
+  infd_directory_enforce_send_queue_limit(directory);
+}
+
+static void
+infd_directory_send_queue_dispatch_func(gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+
+  directory = INFD_DIRECTORY(user_data);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  priv->send_queue_dispatch = NULL;
+  infd_directory_enforce_send_queue_limit(directory);
+}
+
+/* Called while a message is being queued, where connections cannot be
+ * closed, so the limit is enforced in the next main loop iteration rather
+ * than waiting for the periodic check. */
+static void
+infd_directory_queue_size_exceeded_cb(InfCommunicationManager* manager,
+                                      InfXmlConnection* connection,
+                                      gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+
+  directory = INFD_DIRECTORY(user_data);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->send_queue_limit > 0 &&
+     priv->send_queue_dispatch == NULL &&
+     g_hash_table_lookup(priv->connections, connection) != NULL)
+  {
+    priv->send_queue_dispatch = inf_io_add_dispatch(
+      priv->io,
+      infd_directory_send_queue_dispatch_func,
+      directory,
+      NULL
+    );
+  }
+}
+
+static void
+infd_directory_session_weak_ref_cb(gpointer data,
+                                   GObject* where_the_object_was)
+{
+  InfdDirectoryNode* node;
+  node = (InfdDirectoryNode*)data;
+
+  g_assert(G_OBJECT(node->shared.note.session) == where_the_object_was);
+  g_assert(node->shared.note.weakref == TRUE);
+  g_assert(node->shared.note.save_timeout == NULL);
+
+  node->shared.note.session = NULL;
+  node->shared.note.weakref = FALSE;
+}
+
+static void
+infd_directory_session_idle_notify_cb(GObject* object,
+                                      GParamSpec* pspec,
+                                      gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+  gpointer node_id;
+  InfdDirectoryNode* node;
+
+  directory = INFD_DIRECTORY(user_data);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node_id = g_object_get_qdata(object, infd_directory_node_id_quark);
+  node = g_hash_table_lookup(priv->nodes, node_id);
+  g_assert(node != NULL);
+
+  /* Drop session from memory if it remains idle */
+  if(infd_session_proxy_is_idle(INFD_SESSION_PROXY(object)))
+  {
+    if(node->shared.note.weakref == FALSE &&
+       node->shared.note.save_timeout == NULL)
+    {
+      infd_directory_start_session_save_timeout(directory, node);
+    }
+  }
+  else
+  {
+    /* If a session becomes non-idle again then strong-ref it */
+    if(node->shared.note.weakref == TRUE)
+    {
+      g_object_ref(node->shared.note.session);
+      g_assert(node->shared.note.save_timeout == NULL);
+      node->shared.note.weakref = FALSE;
+
+      g_object_weak_unref(
+        G_OBJECT(node->shared.note.session),
+        infd_directory_session_weak_ref_cb,
+        node
+      );
+    }
+    else if(node->shared.note.save_timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
+      node->shared.note.save_timeout = NULL;
+    }
+  }
+}
+
+static gboolean
+infd_directory_session_reject_user_join_cb(InfdSessionProxy* proxy,
+                                           InfXmlConnection* connection,
+                                           const GArray* user_properties,
+                                           InfUser* rejoin_user,
+                                           gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+  gpointer node_id;
+  InfdDirectoryNode* node;
+
+  InfdDirectoryConnectionInfo* info;
+  InfBrowserIter iter;
+  InfAclMask check_mask;
+  gboolean result;
+
+  directory = INFD_DIRECTORY(user_data);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node_id = g_object_get_qdata(G_OBJECT(proxy), infd_directory_node_id_quark);
+  node = g_hash_table_lookup(priv->nodes, node_id);
+  g_assert(node != NULL);
+
+  /* ACL cannot prevent local users from joining */
+  if(connection != NULL)
+  {
+    info = g_hash_table_lookup(priv->connections, connection);
+    g_assert(info != NULL);
+
+    iter.node_id = node->id;
+    iter.node = node;
+
+    inf_acl_mask_set1(&check_mask, INF_ACL_CAN_JOIN_USER);
+
+    result = inf_browser_check_acl(
+      INF_BROWSER(directory),
+      &iter,
+      info->account_id,
+      &check_mask,
+      NULL
+    );
+
+    /* Reject the user join if the permission is not set. */
+    if(result == FALSE)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Releases a session fully from the directory. This is not normally needed
+ * because if we don't need a session anymore we still keep a weak reference
+ * to it around, in case we need to recover it later. When nobody is holding
+ * a strong reference to it anymore we clear the pointer in
+ * infd_directory_session_weak_ref_cb(). The only point where this function
+ * is being called is when a node with an active session is removed from the
+ * directory. */
+static void
+infd_directory_release_session(InfdDirectory* directory,
+                               InfdDirectoryNode* node,
+                               InfdSessionProxy* session)
+{
+  InfdDirectoryPrivate* priv;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session == session);
+
+  if(node->shared.note.save_timeout != NULL)
+  {
     inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
     node->shared.note.save_timeout = NULL;
   }
@@ -1490,25 +1996,141 @@ infd_directory_read_acl(InfdDirectory* directory,
   return sheet_set;
 }
 
-static void
-infd_directory_report_support(InfdDirectory* directory,
-                              gboolean* add_account,
-                              gboolean* remove_account)
+/* Reads the ACL of a node found during exploration from the storage, unless
+ * it has been read already. Connections which see the node have received it
+ * without any sheets, so they are told about the sheets that are read. */
+static gboolean
+infd_directory_node_load_acl(InfdDirectory* directory,
+                             InfdDirectoryNode* node,
+                             GError** error)
 {
   InfdDirectoryPrivate* priv;
-  gboolean supports_add_account;
-  gboolean supports_remove_account;
-  InfdAccountStorageSupport support;
+  InfAclSheetSet* sheet_set;
+  GHashTable* verify_table;
+  gchar* path;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  supports_add_account = FALSE;
-  supports_remove_account = FALSE;
 
-  if(priv->account_storage != NULL)
+  if(node->acl_loaded == TRUE)
+    return TRUE;
+
+  if(priv->storage == NULL)
   {
-    support = infd_account_storage_get_support(priv->account_storage);
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_STORAGE,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_NO_STORAGE)
+    );
 
-    if(support & INFD_ACCOUNT_STORAGE_SUPPORT_ADD_ACCOUNT)
+    return FALSE;
+  }
+
+  infd_directory_node_get_path(node, &path, NULL);
+  verify_table = g_hash_table_new(NULL, NULL);
+
+  sheet_set = infd_directory_read_acl(
+    directory,
+    path,
+    NULL,
+    verify_table,
+    error
+  );
+
+  g_hash_table_destroy(verify_table);
+  g_free(path);
+
+  if(sheet_set == NULL)
+    return FALSE;
+
+  g_assert(node->acl == NULL);
+  node->acl_loaded = TRUE;
+
+  if(sheet_set->n_sheets > 0)
+  {
+    node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+
+    infd_directory_announce_acl_sheets(
+      directory,
+      node,
+      NULL,
+      sheet_set,
+      NULL
+    );
+  }
+
+  inf_acl_sheet_set_free(sheet_set);
+  return TRUE;
+}
+
+/* Returns the ACL of the given node, reading it from storage if necessary.
+ * If it cannot be read, then a sheet set is returned which denies all
+ * permissions to everyone, and reading it is tried again next time. */
+static const InfAclSheetSet*
+infd_directory_node_get_acl(InfdDirectory* directory,
+                            InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  GError* error;
+  gchar* path;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  error = NULL;
+  if(!infd_directory_node_load_acl(directory, node, &error))
+  {
+    infd_directory_node_get_path(node, &path, NULL);
+
+    g_warning(
+      _("Failed to read the ACL for node \"%s\", denying access: %s"),
+      path,
+      error->message
+    );
+
+    g_free(path);
+    g_error_free(error);
+    return priv->unreadable_acl;
+  }
+
+  return node->acl;
+}
+
+static void
+infd_directory_node_load_all_acls(InfdDirectory* directory,
+                                  InfdDirectoryNode* node)
+{
+  InfdDirectoryNode* child;
+
+  /* This only prints a warning if the ACL cannot be read */
+  infd_directory_node_get_acl(directory, node);
+
+  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+     node->shared.subdir.explored == TRUE)
+  {
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
+      infd_directory_node_load_all_acls(directory, child);
+  }
+}
+
+static void
+infd_directory_report_support(InfdDirectory* directory,
+                              gboolean* add_account,
+                              gboolean* remove_account)
+{
+  InfdDirectoryPrivate* priv;
+  gboolean supports_add_account;
+  gboolean supports_remove_account;
+  InfdAccountStorageSupport support;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  supports_add_account = FALSE;
+  supports_remove_account = FALSE;
+
+  if(priv->account_storage != NULL)
+  {
+    support = infd_account_storage_get_support(priv->account_storage);
+
+    if(support & INFD_ACCOUNT_STORAGE_SUPPORT_ADD_ACCOUNT)
       if(priv->private_key != NULL && priv->certificate != NULL)
         supports_add_account = TRUE;
 
@@ -1831,6 +2453,7 @@ infd_directory_create_session_proxy_with_group(InfdDirectory* directory,
       "io", priv->io,
       "session", session,
       "subscription-group", g,
+      "loop-pool", priv->loop_pool,
       NULL
     )
   );
@@ -2061,6 +2684,8 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
             NULL
           );
 
+          infd_directory_node_cancel_save(node);
+
           node->shared.note.plugin->session_write(
             priv->storage,
             session,
@@ -2180,6 +2805,7 @@ infd_directory_node_new_common(InfdDirectory* directory,
   node->id = node_id;
   node->name = name;
   node->acl = NULL;
+  node->acl_loaded = TRUE;
   node->acl_connections = NULL;
 
   if(sheet_set != NULL)
@@ -2254,6 +2880,8 @@ infd_directory_node_new_note(InfdDirectory* directory,
   node->shared.note.session = NULL;
   node->shared.note.plugin = plugin;
   node->shared.note.save_timeout = NULL;
+  node->shared.note.idle_since = 0;
+  node->shared.note.save = NULL;
   node->shared.note.weakref = FALSE;
 
   return node;
@@ -2295,6 +2923,14 @@ static void
 infd_directory_remove_subreq(InfdDirectory* directory,
                              InfdDirectorySubreq* request);
 
+static void
+infd_directory_node_cancel_explore(InfdDirectory* directory,
+                                   InfdDirectoryNode* node);
+
+static void
+infd_directory_node_cancel_session_read(InfdDirectory* directory,
+                                        InfdDirectoryNode* node);
+
 static void
 infd_directory_node_free(InfdDirectory* directory,
                          InfdDirectoryNode* node)
@@ -2316,6 +2952,7 @@ infd_directory_node_free(InfdDirectory* directory,
   switch(node->type)
   {
   case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+    infd_directory_node_cancel_explore(directory, node);
     g_slist_free(node->shared.subdir.connections);
 
     /* Free child nodes */
@@ -2334,6 +2971,9 @@ infd_directory_node_free(InfdDirectory* directory,
     g_assert(node->shared.note.session == NULL ||
              node->shared.note.weakref == TRUE);
 
+    infd_directory_node_cancel_session_read(directory, node);
+    infd_directory_node_cancel_save(node);
+
     if(node->shared.note.session != NULL)
     {
       infd_directory_release_session(
@@ -2688,7 +3328,8 @@ infd_directory_enforce_acl(InfdDirectory* directory,
 
   /* If this node has ACLs set for the new account, then add this to the
    * reply XML, so that the remote host knows its own permissions
-   * on the node */
+   * on the node. If the ACL has not been read yet, then the remote host
+   * is told about it when it is read. */
   if(reply_xml != NULL)
   {
     if(node->acl != NULL)
@@ -3510,6 +4151,42 @@ infd_directory_make_seq(InfdDirectory* directory,
   return TRUE;
 }
 
+/* Sends the add-node message for node to connection. The message includes
+ * the ACL sheets that the connection can see, if the ACL of the node has
+ * been read already. */
+static void
+infd_directory_node_send_register(InfdDirectory* directory,
+                                  InfdDirectoryNode* node,
+                                  InfXmlConnection* connection,
+                                  const gchar* seq)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr xml;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  xml = infd_directory_node_register_to_xml(node);
+  if(seq != NULL)
+    inf_xml_util_set_attribute(xml, "seq", seq);
+
+  if(node->acl != NULL)
+  {
+    infd_directory_acl_sheets_to_xml_for_connection(
+      directory,
+      node->acl_connections,
+      node->acl,
+      connection,
+      xml
+    );
+  }
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    xml
+  );
+}
+
 /* Announces the presence of a new node. This is not done in
  * infd_directory_node_new because we do not want to do this for all
  * nodes we create (namely not for the root node). */
@@ -3520,15 +4197,9 @@ infd_directory_node_register(InfdDirectory* directory,
                              InfXmlConnection* except,
                              const gchar* seq)
 {
-  InfdDirectoryPrivate* priv;
   InfBrowserIter iter;
-  InfdDirectoryConnectionInfo* info;
-  xmlNodePtr xml;
-  xmlNodePtr copy_xml;
   GSList* item;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-
   iter.node_id = node->id;
   iter.node = node;
 
@@ -3538,41 +4209,20 @@ infd_directory_node_register(InfdDirectory* directory,
     INF_REQUEST(request)
   );
 
-  xml = infd_directory_node_register_to_xml(node);
-  if(seq != NULL)
-   inf_xml_util_set_attribute(xml, "seq", seq);
-
   for(item = node->parent->shared.subdir.connections;
       item != NULL;
       item = g_slist_next(item))
   {
     if(item->data != except)
     {
-      info = g_hash_table_lookup(priv->connections, item->data);
-      g_assert(info != NULL);
-
-      copy_xml = xmlCopyNode(xml, 1);
-
-      if(node->acl != NULL)
-      {
-        infd_directory_acl_sheets_to_xml_for_connection(
-          directory,
-          node->acl_connections,
-          node->acl,
-          INF_XML_CONNECTION(item->data),
-          copy_xml
-        );
-      }
-
-      inf_communication_group_send_message(
-        INF_COMMUNICATION_GROUP(priv->group),
+      infd_directory_node_send_register(
+        directory,
+        node,
         INF_XML_CONNECTION(item->data),
-        copy_xml
+        seq
       );
     }
   }
-
-  xmlFreeNode(xml);
 }
 
 /* Announces that a node is removed. Again, this is not done in
@@ -3931,6 +4581,7 @@ infd_directory_add_subreq_session(InfdDirectory* directory,
 
   subreq->shared.session.session = proxy; /* take ownership */
   subreq->shared.session.request = request;
+  subreq->shared.session.resume_vector = NULL;
 
   if(request != NULL)
     g_object_ref(request);
@@ -4100,6 +4751,8 @@ infd_directory_free_subreq(InfdDirectorySubreq* request)
     g_object_unref(request->shared.session.session);
     if(request->shared.session.request != NULL)
       g_object_unref(request->shared.session.request);
+    if(request->shared.session.resume_vector != NULL)
+      inf_adopted_state_vector_free(request->shared.session.resume_vector);
     break;
   case INFD_DIRECTORY_SUBREQ_ADD_NODE:
     g_free(request->shared.add_node.name);
@@ -4215,6 +4868,49 @@ infd_directory_find_subreq_by_name(InfdDirectory* directory,
   return NULL;
 }
 
+static InfdDirectoryExplore*
+infd_directory_find_explore(InfdDirectory* directory,
+                            InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  GSList* item;
+  InfdDirectoryExplore* explore;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  for(item = priv->explores; item != NULL; item = item->next)
+  {
+    explore = (InfdDirectoryExplore*)item->data;
+    if(explore->node == node)
+      return explore;
+  }
+
+  return NULL;
+}
+
+/* Finds an exploration of parent which still has to register a node with
+ * the given name. */
+static InfdDirectoryExplore*
+infd_directory_find_explore_by_name(InfdDirectory* directory,
+                                    InfdDirectoryNode* parent,
+                                    const gchar* name)
+{
+  InfdDirectoryExplore* explore;
+  InfdStorageNode* storage_node;
+  GSList* item;
+
+  explore = infd_directory_find_explore(directory, parent);
+  if(explore == NULL) return NULL;
+
+  for(item = explore->next; item != NULL; item = item->next)
+  {
+    storage_node = (InfdStorageNode*)item->data;
+    if(infd_directory_node_name_equal(storage_node->name, name) == TRUE)
+      return explore;
+  }
+
+  return NULL;
+}
+
 /*
  * Directory tree operations.
  */
@@ -4242,6 +4938,7 @@ infd_directory_node_is_name_available(InfdDirectory* directory,
                                       const gchar* name,
                                       GError** error)
 {
+  InfdDirectoryExplore* explore;
   gboolean has_sensible_character = FALSE;
   const gchar* p;
 
@@ -4291,9 +4988,25 @@ infd_directory_node_is_name_available(InfdDirectory* directory,
     return FALSE;
   }
 
+  /* This happens when the root node is read again after the storage has
+   * been changed: the names of the nodes in it are not known yet. */
+  explore = infd_directory_find_explore(directory, parent);
+  if(explore != NULL && explore->operation != NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NOT_EXPLORED,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_NOT_EXPLORED)
+    );
+
+    return FALSE;
+  }
+
   if(infd_directory_node_find_child_by_name(parent, name)         != NULL ||
      infd_directory_find_sync_in_by_name(directory, parent, name) != NULL ||
-     infd_directory_find_subreq_by_name(directory, parent, name)  != NULL)
+     infd_directory_find_subreq_by_name(directory, parent, name)  != NULL ||
+     infd_directory_find_explore_by_name(directory, parent, name) != NULL)
   {
     g_set_error(
       error,
@@ -4309,982 +5022,1675 @@ infd_directory_node_is_name_available(InfdDirectory* directory,
   return TRUE;
 }
 
+/* Required by infd_directory_explore_begin_reply() */
 static gboolean
-infd_directory_node_explore(InfdDirectory* directory,
-                            InfdDirectoryNode* node,
-                            InfdProgressRequest* request,
-                            GError** error)
+infd_directory_check_auth(InfdDirectory* directory,
+                          InfdDirectoryNode* node,
+                          InfXmlConnection* connection,
+                          const InfAclMask* mask,
+                          GError** error);
+
+static void
+infd_directory_explore_free(InfdDirectoryExplore* explore)
 {
   InfdDirectoryPrivate* priv;
-  InfdStorageNode* storage_node;
-  InfdDirectoryNode* new_node;
-  InfBrowserIter iter;
-  InfdNotePlugin* plugin;
-  GError* local_error;
-  GSList* list;
-  InfAclSheetSet* sheet_set;
-  GPtrArray* acls;
-  GHashTable* verify_table;
+  InfdDirectoryExploreReply* reply;
   GSList* item;
-  gchar* path;
-  gsize len;
-  gsize node_len;
-  gsize sep_len;
-  gsize path_len;
-  guint index;
-
-  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(priv->storage != NULL);
-  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-  g_assert(node->shared.subdir.explored == FALSE);
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+  priv->explores = g_slist_remove(priv->explores, explore);
 
-  local_error = NULL;
-  infd_directory_node_get_path(node, &path, &len);
-  list = infd_storage_read_subdirectory(priv->storage, path, &local_error);
+  if(explore->operation != NULL)
+    inf_async_operation_free(explore->operation);
+  if(explore->dispatch != NULL)
+    inf_io_remove_dispatch(priv->io, explore->dispatch);
 
-  if(local_error != NULL)
+  for(item = explore->replies; item != NULL; item = item->next)
   {
-    g_free(path);
-    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
-    return FALSE;
+    reply = (InfdDirectoryExploreReply*)item->data;
+    g_free(reply->seq);
+    g_slice_free(InfdDirectoryExploreReply, reply);
   }
 
-  /* First pass: Count the total number of items and read the ACLs for each
-   * node. If there is a problem reading the ACL for one node, cancel the
-   * full exploration. */
-  path_len = len;
-  acls = g_ptr_array_sized_new(16);
-  verify_table = g_hash_table_new(NULL, NULL);
-  for(item = list; item != NULL; item = g_slist_next(item))
-  {
-    storage_node = (InfdStorageNode*)item->data;
-
-    /* Construct the storage path for this node */
-    node_len = strlen(storage_node->name);
-
-    sep_len = 1;
-    if(path[len - 1] == '/') sep_len = 0;
+  g_slist_free(explore->replies);
+  infd_storage_node_list_free(explore->list);
 
-    if(len + sep_len + node_len < path_len)
-    {
-      path_len = len + sep_len + node_len;
-      path = g_realloc(path, path_len + sep_len);
-    }
+  if(explore->request != NULL)
+    g_object_unref(explore->request);
 
-    if(sep_len > 0)
-      path[len] = '/';
+  g_slice_free(InfdDirectoryExplore, explore);
+}
 
-    memcpy(path + len + sep_len, storage_node->name, node_len + 1);
+/* Sends explore-begin and the children of node registered so far to
+ * connection, and remembers that the connection has explored node so that
+ * it gets notified when changes occur. n_pending is the number of children
+ * that an exploration in progress is still going to register. These are
+ * sent with seq as they are registered, followed by explore-end. */
+static void
+infd_directory_send_explore_begin(InfdDirectory* directory,
+                                  InfdDirectoryNode* node,
+                                  InfXmlConnection* connection,
+                                  const gchar* seq,
+                                  guint n_pending)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* child;
+  xmlNodePtr reply_xml;
+  guint total;
 
-    /* Read ACL */
-    sheet_set = infd_directory_read_acl(
-      directory,
-      path,
-      NULL,
-      verify_table,
-      &local_error
-    );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-    if(local_error != NULL)
-    {
-      for(index = 0; index < acls->len; ++index)
-        inf_acl_sheet_set_free(g_ptr_array_index(acls, index));
-      g_ptr_array_free(acls, TRUE);
-      g_hash_table_destroy(verify_table);
-      infd_storage_node_list_free(list);
-      g_free(path);
-      if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-      g_propagate_error(error, local_error);
-      return FALSE;
-    }
+  total = n_pending;
+  for(child = node->shared.subdir.child; child != NULL; child = child->next)
+    ++ total;
 
-    g_ptr_array_add(acls, sheet_set);
-  }
+  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-begin");
+  inf_xml_util_set_attribute_uint(reply_xml, "total", total);
+  if(seq != NULL)
+    inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
-  g_hash_table_destroy(verify_table);
-  node->shared.subdir.explored = TRUE;
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
+  );
 
-  g_free(path);
-  if(request != NULL) infd_progress_request_initiated(request, acls->len);
+  /* If the ACL of a child has not been read yet, then the sheets are sent
+   * in a set-acl message once it is read. */
+  for(child = node->shared.subdir.child; child != NULL; child = child->next)
+    infd_directory_node_send_register(directory, child, connection, seq);
 
-  /* Second pass, fill the directory tree */
-  index = 0;
-  for(item = list, index = 0;
-      item != NULL;
-      item = g_slist_next(item), ++index)
-  {
-    storage_node = (InfdStorageNode*)item->data;
-    sheet_set = (InfAclSheetSet*)g_ptr_array_index(acls, index);
-    new_node = NULL;
+  node->shared.subdir.connections = g_slist_prepend(
+    node->shared.subdir.connections,
+    connection
+  );
+}
 
-    switch(storage_node->type)
-    {
-    case INFD_STORAGE_NODE_SUBDIRECTORY:
-      new_node = infd_directory_node_new_subdirectory(
-        directory,
-        node,
-        priv->node_counter++,
-        g_strdup(storage_node->name),
-        sheet_set,
-        FALSE
-      );
+static void
+infd_directory_send_explore_end(InfdDirectory* directory,
+                                InfXmlConnection* connection,
+                                const gchar* seq)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr reply_xml;
 
-      break;
-    case INFD_STORAGE_NODE_NOTE:
-      /* TODO: Currently we ignore notes of unknown type. Perhaps we should
-       * report some error. */
-      plugin = g_hash_table_lookup(priv->plugins, storage_node->identifier);
-      if(plugin != NULL)
-      {
-        new_node = infd_directory_node_new_note(
-          directory,
-          node,
-          priv->node_counter++,
-          g_strdup(storage_node->name),
-          sheet_set,
-          FALSE,
-          plugin
-        );
-      }
-      else
-      {
-        new_node = infd_directory_node_new_unknown(
-          directory,
-          node,
-          priv->node_counter++,
-          g_strdup(storage_node->name),
-          sheet_set,
-          FALSE,
-          storage_node->identifier
-        );
-      }
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
 
-      break;
-    default:
-      g_assert_not_reached();
-      break;
-    }
+  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
-    inf_acl_sheet_set_free(sheet_set);
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
+  );
+}
 
-    if(new_node != NULL)
-    {
-      /* Announce the new node. In most cases, this does nothing on the
-       * network because there are no connections that have this node open
-       * (otherwise, we would already have explored the node earlier).
-       * However, if the background storage is replaced by a new one, the root
-       * folder of the new storage will be explored immediately (see below in
-       * infd_directory_set_storage()) and there might still be connections
-       * interesting in root folder changes (because they opened the root
-       * folder from the old storage). Also, local users might be interested
-       * in the new node. */
-      infd_directory_node_register(
-        directory,
-        new_node,
-        INFD_REQUEST(request),
-        NULL,
-        NULL
-      );
-    }
+/* Sends the children of node to connection, and remembers that the
+ * connection has explored node so that it gets notified when changes
+ * occur. */
+static void
+infd_directory_send_explore_reply(InfdDirectory* directory,
+                                  InfdDirectoryNode* node,
+                                  InfXmlConnection* connection,
+                                  const gchar* seq)
+{
+  infd_directory_send_explore_begin(directory, node, connection, seq, 0);
+  infd_directory_send_explore_end(directory, connection, seq);
+}
 
-    if(request != NULL) infd_progress_request_progress(request);
-  }
+static void
+infd_directory_send_request_failed(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   const gchar* seq,
+                                   GError* error)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr reply_xml;
 
-  g_ptr_array_free(acls, TRUE);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  if(request != NULL)
+  reply_xml = inf_xml_util_new_node_from_error(
+    error,
+    NULL,
+    "request-failed"
+  );
+
+  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
+  );
+}
+
+static void
+infd_directory_explore_fail(InfdDirectoryExplore* explore,
+                            GError* error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploreReply* reply;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+  priv->explores = g_slist_remove(priv->explores, explore);
+
+  for(item = explore->replies; item != NULL; item = item->next)
   {
-    iter.node_id = node->id;
-    iter.node = node;
+    reply = (InfdDirectoryExploreReply*)item->data;
 
-    inf_request_finish(
-      INF_REQUEST(request),
-      inf_request_result_make_explore_node(INF_BROWSER(directory), &iter)
+    infd_directory_send_request_failed(
+      explore->directory,
+      reply->connection,
+      reply->seq,
+      error
     );
   }
 
-  infd_storage_node_list_free(list);
+  if(explore->request != NULL)
+    inf_request_fail(INF_REQUEST(explore->request), error);
 
-  return TRUE;
+  infd_directory_explore_free(explore);
 }
 
-static InfdDirectoryNode*
-infd_directory_node_add_subdirectory(InfdDirectory* directory,
-                                     InfdDirectoryNode* parent,
-                                     InfdRequest* request,
-                                     const gchar* name,
-                                     const InfAclSheetSet* sheet_set,
-                                     InfXmlConnection* connection,
-                                     const gchar* seq,
-                                     GError** error)
+/* Returns the seq of the explore request of connection, if connection
+ * requested the exploration and is being sent the nodes as they are
+ * registered. */
+static const gchar*
+infd_directory_explore_get_seq(InfdDirectoryExplore* explore,
+                               InfXmlConnection* connection)
 {
-  InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* node;
-  gboolean result;
-  gchar* path;
-  GError* local_error;
+  InfdDirectoryExploreReply* reply;
+  GSList* item;
 
-  InfBrowserIter parent_iter;
-  InfBrowserIter iter;
+  for(item = explore->replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectoryExploreReply*)item->data;
+    if(reply->connection == connection)
+      return reply->seq;
+  }
 
-  g_assert(parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-  g_assert(parent->shared.subdir.explored == TRUE);
-  g_assert(request != NULL);
+  return NULL;
+}
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+/* Starts sending the nodes of the exploration to the connection of reply,
+ * once the subdirectory has been read. Permissions are checked again, since
+ * they might have changed in the meanwhile. If the connection is no longer
+ * allowed to explore the node, an error is sent instead and the function
+ * returns FALSE. */
+static gboolean
+infd_directory_explore_begin_reply(InfdDirectoryExplore* explore,
+                                   InfdDirectoryExploreReply* reply)
+{
+  InfAclMask perms;
+  GError* error;
 
-  local_error = NULL;
-  node = NULL;
+  g_assert(explore->operation == NULL);
 
-  infd_directory_node_is_name_available(
-    directory,
-    parent,
-    name,
-    &local_error
-  );
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_EXPLORE_NODE);
 
-  if(local_error == NULL)
+  error = NULL;
+  if(!infd_directory_check_auth(explore->directory, explore->node,
+                                reply->connection, &perms, &error))
   {
-    infd_directory_node_make_path(parent, name, &path, NULL);
+    infd_directory_send_request_failed(
+      explore->directory,
+      reply->connection,
+      reply->seq,
+      error
+    );
 
-    if(priv->storage != NULL)
-      result = infd_storage_create_subdirectory(priv->storage, path, error);
-    else
-      result = TRUE;
+    g_error_free(error);
+    return FALSE;
+  }
 
-    g_free(path);
-    if(result == TRUE)
-    {
-      node = infd_directory_node_new_subdirectory(
-        directory,
-        parent,
-        priv->node_counter++,
-        g_strdup(name),
-        sheet_set,
-        TRUE
-      );
+  infd_directory_send_explore_begin(
+    explore->directory,
+    explore->node,
+    reply->connection,
+    reply->seq,
+    g_slist_length(explore->next)
+  );
 
-      node->shared.subdir.explored = TRUE;
+  return TRUE;
+}
 
-      infd_directory_node_register(directory, node, request, NULL, seq);
+static void
+infd_directory_explore_finish(InfdDirectoryExplore* explore)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExploreReply* reply;
+  InfBrowserIter iter;
+  GError* error;
+  GSList* item;
 
-      parent_iter.node_id = parent->id;
-      parent_iter.node = parent;
-      iter.node_id = node->id;
-      iter.node = node;
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+  priv->explores = g_slist_remove(priv->explores, explore);
 
-      inf_request_finish(
-        INF_REQUEST(request),
-        inf_request_result_make_add_node(
-          INF_BROWSER(directory),
-          &parent_iter,
-          &iter
-        )
-      );
-    }
+  iter.node_id = explore->node->id;
+  iter.node = explore->node;
+
+  if(explore->request != NULL)
+  {
+    inf_request_finish(
+      INF_REQUEST(explore->request),
+      inf_request_result_make_explore_node(
+        INF_BROWSER(explore->directory),
+        &iter
+      )
+    );
   }
 
-  if(local_error != NULL)
+  for(item = explore->replies; item != NULL; item = item->next)
   {
-    g_assert(node == NULL);
+    reply = (InfdDirectoryExploreReply*)item->data;
 
-    inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
+    /* The connection is removed from the connections of the node if it
+     * loses the permission to explore it while the nodes are being sent. */
+    if(g_slist_find(explore->node->shared.subdir.connections,
+                    reply->connection) != NULL)
+    {
+      infd_directory_send_explore_end(
+        explore->directory,
+        reply->connection,
+        reply->seq
+      );
+    }
+    else
+    {
+      error = NULL;
+      g_set_error_literal(
+        &error,
+        inf_request_error_quark(),
+        INF_REQUEST_ERROR_NOT_AUTHORIZED,
+        _("Permission denied")
+      );
+
+      infd_directory_send_request_failed(
+        explore->directory,
+        reply->connection,
+        reply->seq,
+        error
+      );
+
+      g_error_free(error);
+    }
   }
 
-  return node;
+  infd_directory_explore_free(explore);
 }
 
-static gboolean
-infd_directory_node_add_note(InfdDirectory* directory,
-                             InfdDirectoryNode* parent,
-                             InfdRequest* request,
-                             const gchar* name,
-                             const InfAclSheetSet* sheet_set,
-                             const InfdNotePlugin* plugin,
-                             InfSession* session,
-                             InfXmlConnection* connection,
-                             gboolean subscribe_connection,
-                             const char* seq,
-                             GError** error)
+static void
+infd_directory_explore_register_node(InfdDirectoryExplore* explore,
+                                     InfdStorageNode* storage_node)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* node;
-  guint node_id;
-  InfCommunicationHostedGroup* group;
-  xmlNodePtr xml;
-  xmlNodePtr child;
-  const gchar* method;
-  InfdDirectorySubreq* subreq;
-  InfdSessionProxy* proxy;
-  gchar* path;
-  gboolean ensured;
-  GError* local_error;
-
-  InfBrowserIter parent_iter;
+  InfdDirectoryNode* new_node;
+  InfdNotePlugin* plugin;
   InfBrowserIter iter;
+  GSList* item;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-
-  g_assert(parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-  g_assert(parent->shared.subdir.explored == TRUE);
-  g_assert(request != NULL);
-
-  local_error = NULL;
-  infd_directory_node_is_name_available(
-    directory,
-    parent,
-    name,
-    &local_error
-  );
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+  new_node = NULL;
 
-  if(local_error == NULL)
+  /* The ACL of the new node is read when it is needed for the first time,
+   * see infd_directory_node_load_acl(). */
+  switch(storage_node->type)
   {
-    node_id = priv->node_counter++;
-    group = infd_directory_create_subscription_group(directory, node_id);
+  case INFD_STORAGE_NODE_SUBDIRECTORY:
+    new_node = infd_directory_node_new_subdirectory(
+      explore->directory,
+      explore->node,
+      priv->node_counter++,
+      g_strdup(storage_node->name),
+      NULL,
+      FALSE
+    );
 
-    if(subscribe_connection == TRUE)
+    break;
+  case INFD_STORAGE_NODE_NOTE:
+    /* TODO: Currently we ignore notes of unknown type. Perhaps we should
+     * report some error. */
+    plugin = g_hash_table_lookup(priv->plugins, storage_node->identifier);
+    if(plugin != NULL)
+    {
+      new_node = infd_directory_node_new_note(
+        explore->directory,
+        explore->node,
+        priv->node_counter++,
+        g_strdup(storage_node->name),
+        NULL,
+        FALSE,
+        plugin
+      );
+    }
+    else
     {
-      /* Note that if session is non-zero at this point, the remote site has
-       * to know the contents of the session. It is not synchronized
-       * automatically.
-       * Note also though this is in principle supported by the code, there is
-       * currently no case that calls this function with non-zero session and
-       * subscribe_connection set. */
-      subreq = infd_directory_add_subreq_add_node(
-        directory,
-        connection,
-        group,
-        request,
-        parent,
-        node_id,
-        name,
-        sheet_set,
-        plugin,
-        session,
-        error
+      new_node = infd_directory_node_new_unknown(
+        explore->directory,
+        explore->node,
+        priv->node_counter++,
+        g_strdup(storage_node->name),
+        NULL,
+        FALSE,
+        storage_node->identifier
       );
+    }
 
-      if(subreq != NULL)
-      {
-        xml = infd_directory_node_desc_register_to_xml(
-          "add-node",
-          node_id,
-          parent,
-          plugin->note_type,
-          name
-        );
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
 
-        inf_xml_util_set_attribute(xml, "seq", seq);
+  if(new_node != NULL)
+  {
+    new_node->acl_loaded = FALSE;
 
-        if(sheet_set != NULL)
-        {
-          infd_directory_acl_sheets_to_xml_for_connection(
-            directory,
-            NULL,
-            sheet_set,
-            connection,
-            xml
-          );
-        }
+    iter.node_id = new_node->id;
+    iter.node = new_node;
 
-        child = xmlNewChild(xml, NULL, (const xmlChar*)"subscribe", NULL);
-        inf_xml_util_set_attribute(
-          child,
-          "group",
-          inf_communication_group_get_name(INF_COMMUNICATION_GROUP(group))
-        );
+    inf_browser_node_added(
+      INF_BROWSER(explore->directory),
+      &iter,
+      INF_REQUEST(explore->request)
+    );
+
+    /* Announce the new node. Remote hosts that requested the exploration
+     * get it with the seq of their request, so that it counts towards the
+     * total announced in explore-begin. Other connections only see the
+     * node if the background storage has been replaced by a new one: the
+     * root folder of the new storage is explored immediately (see below in
+     * infd_directory_set_storage()) and there might still be connections
+     * interested in root folder changes (because they opened the root
+     * folder from the old storage). */
+    for(item = explore->node->shared.subdir.connections;
+        item != NULL;
+        item = item->next)
+    {
+      infd_directory_node_send_register(
+        explore->directory,
+        new_node,
+        INF_XML_CONNECTION(item->data),
+        infd_directory_explore_get_seq(
+          explore,
+          INF_XML_CONNECTION(item->data)
+        )
+      );
+    }
+  }
+}
 
-        method = inf_communication_group_get_method_for_connection(
-          INF_COMMUNICATION_GROUP(group),
-          connection
-        );
+static void
+infd_directory_explore_dispatch_func(gpointer user_data);
 
-        /* "central" method should always be available */
-        g_assert(method != NULL);
+/* Registers up to max_nodes of the nodes read from storage. If there are
+ * nodes left, the rest is registered in a later main loop iteration, so
+ * that a large directory does not block the server. */
+static void
+infd_directory_explore_register(InfdDirectoryExplore* explore,
+                                guint max_nodes)
+{
+  InfdDirectoryPrivate* priv;
+  InfdStorageNode* storage_node;
+  guint i;
 
-        inf_xml_util_set_attribute(child, "method", method);
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
 
-        inf_communication_group_send_message(
-          INF_COMMUNICATION_GROUP(priv->group),
-          connection,
-          xml
-        );
-      }
-    }
-    else
-    {
-      if(session != NULL)
-      {
-        proxy = infd_directory_create_session_proxy_with_group(
-          directory,
-          session,
-          group
-        );
-      }
-      else
-      {
-        infd_directory_node_make_path(parent, name, &path, NULL);
+  for(i = 0; i < max_nodes && explore->next != NULL; ++i)
+  {
+    storage_node = (InfdStorageNode*)explore->next->data;
+    explore->next = explore->next->next;
 
-        proxy = infd_directory_create_session_proxy(
-          directory,
-          plugin,
-          INF_SESSION_RUNNING,
-          NULL,
-          NULL,
-          group,
-          path
-        );
+    infd_directory_explore_register_node(explore, storage_node);
 
-        g_free(path);
-      }
+    if(explore->request != NULL)
+      infd_progress_request_progress(explore->request);
+  }
 
-      ensured = infd_directory_session_proxy_ensure(
-        directory,
-        parent,
-        name,
-        plugin,
-        proxy,
-        &local_error
-      );
+  if(explore->next != NULL)
+  {
+    explore->dispatch = inf_io_add_dispatch(
+      priv->io,
+      infd_directory_explore_dispatch_func,
+      explore,
+      NULL
+    );
+  }
+  else
+  {
+    infd_directory_explore_finish(explore);
+  }
+}
 
-      if(ensured == TRUE)
-      {
-        node = infd_directory_node_new_note(
-          directory,
-          parent,
-          node_id,
-          g_strdup(name),
-          sheet_set,
-          TRUE,
-          plugin
-        );
+static void
+infd_directory_explore_dispatch_func(gpointer user_data)
+{
+  InfdDirectoryExplore* explore;
+  explore = (InfdDirectoryExplore*)user_data;
 
-        infd_directory_node_register(directory, node, request, NULL, seq);
-        infd_directory_node_link_session(directory, node, request, proxy);
-        g_object_unref(proxy);
+  explore->dispatch = NULL;
 
-        parent_iter.node_id = parent->id;
-        parent_iter.node = parent;
-        iter.node_id = node->id;
-        iter.node = node;
+  infd_directory_explore_register(
+    explore,
+    INFD_DIRECTORY_EXPLORE_CHUNK_SIZE
+  );
+}
 
-        inf_request_finish(
-          INF_REQUEST(request),
-          inf_request_result_make_add_node(
-            INF_BROWSER(directory),
-            &parent_iter,
-            &iter
-          )
-        );
-      }
-    }
+/* Registers all remaining nodes of an exploration immediately. */
+static void
+infd_directory_explore_flush(InfdDirectoryExplore* explore)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
 
-    g_object_unref(group);
-  }
+  g_assert(explore->operation == NULL);
 
-  if(local_error != NULL)
+  if(explore->dispatch != NULL)
   {
-    inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
-    return FALSE;
+    inf_io_remove_dispatch(priv->io, explore->dispatch);
+    explore->dispatch = NULL;
   }
 
-  return TRUE;
+  infd_directory_explore_register(explore, G_MAXUINT);
 }
 
-static gboolean
-infd_directory_node_add_sync_in(InfdDirectory* directory,
-                                InfdDirectoryNode* parent,
-                                InfdRequest* request,
-                                const gchar* name,
-                                const InfAclSheetSet* sheet_set,
-                                const InfdNotePlugin* plugin,
-                                InfXmlConnection* sync_conn,
-                                gboolean subscribe_sync_conn,
-                                const gchar *seq,
-                                GError** error)
+static void
+infd_directory_explore_read_release_func(gpointer user_data)
 {
-  InfdDirectoryPrivate* priv;
-  InfCommunicationHostedGroup* subscription_group;
-  InfCommunicationHostedGroup* synchronization_group;
-  guint node_id;
-  gchar* sync_group_name;
-  const gchar* method;
-  InfdDirectorySubreq* subreq;
-  xmlNodePtr xml;
-  xmlNodePtr child;
-  GError* local_error;
+  InfdDirectoryExploreRead* read;
+  read = (InfdDirectoryExploreRead*)user_data;
 
-  /* Synchronization is always between only two peers, so central method
-   * is enough. */
-  static const gchar* const sync_methods[] = { "central", NULL };
+  g_object_unref(read->storage);
+}
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+static void
+infd_directory_explore_read_release_notify(gpointer user_data)
+{
+  InfdDirectoryExploreRead* read;
+  read = (InfdDirectoryExploreRead*)user_data;
 
-  g_assert(parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-  g_assert(parent->shared.subdir.explored == TRUE);
+  g_object_unref(read->io);
+  g_slice_free(InfdDirectoryExploreRead, read);
+}
 
-  local_error = NULL;
-  infd_directory_node_is_name_available(
-    directory,
-    parent,
-    name,
-    &local_error
+static void
+infd_directory_explore_read_free(gpointer data)
+{
+  InfdDirectoryExploreRead* read;
+  read = (InfdDirectoryExploreRead*)data;
+
+  /* This runs in the worker thread if the exploration has been cancelled
+   * while the subdirectory was being read. The reference on the storage
+   * might be the last one, so it is always released in the main thread. */
+  infd_storage_node_list_free(read->list);
+  if(read->error != NULL)
+    g_error_free(read->error);
+  g_free(read->path);
+
+  inf_io_add_dispatch(
+    read->io,
+    infd_directory_explore_read_release_func,
+    read,
+    infd_directory_explore_read_release_notify
   );
+}
 
-  if(local_error == NULL)
-  {
-    node_id = priv->node_counter++;
+static void
+infd_directory_explore_read_run_func(gpointer* run_data,
+                                     GDestroyNotify* run_notify,
+                                     gpointer user_data)
+{
+  InfdDirectoryExploreRead* read;
+  read = (InfdDirectoryExploreRead*)user_data;
 
-    subscription_group =
-      infd_directory_create_subscription_group(directory, node_id);
+  read->list = infd_storage_read_subdirectory(
+    read->storage,
+    read->path,
+    &read->error
+  );
 
-    if(subscribe_sync_conn == TRUE)
-    {
-      synchronization_group = subscription_group;
-      g_object_ref(synchronization_group);
-    }
-    else
-    {
-      sync_group_name = g_strdup_printf("InfSession_SyncIn_%u", node_id);
+  *run_data = read;
+  *run_notify = infd_directory_explore_read_free;
+}
 
-      synchronization_group = inf_communication_manager_open_group(
-        priv->communication_manager,
-        sync_group_name,
-        sync_methods
-      );
+/* Takes ownership of list, the content of the subdirectory of the node
+ * being explored, and starts sending it to the remote hosts that requested
+ * the exploration. The nodes still need to be registered. */
+static void
+infd_directory_explore_set_list(InfdDirectoryExplore* explore,
+                                GSList* list)
+{
+  InfdDirectoryExploreReply* reply;
+  GSList* item;
+  GSList* next;
 
-      g_free(sync_group_name);
-    }
+  g_assert(explore->operation == NULL);
+  g_assert(explore->list == NULL);
 
-    method = inf_communication_group_get_method_for_connection(
-      INF_COMMUNICATION_GROUP(synchronization_group),
-      sync_conn
-    );
+  explore->list = list;
+  explore->next = explore->list;
 
-    /* "central" should always be available */
-    g_assert(method != NULL);
+  explore->node->shared.subdir.explored = TRUE;
 
-    subreq = infd_directory_add_subreq_sync_in(
-      directory,
-      sync_conn,
-      synchronization_group,
-      subscription_group,
-      request,
-      parent,
-      node_id,
-      name,
-      sheet_set,
-      plugin,
-      error
+  if(explore->request != NULL)
+  {
+    infd_progress_request_initiated(
+      explore->request,
+      g_slist_length(explore->list)
     );
+  }
 
-    if(subreq != NULL)
-    {
-      xml = infd_directory_node_desc_register_to_xml(
-        "sync-in",
-        node_id,
-        parent,
-        plugin->note_type,
-        name
-      );
+  /* Remote hosts that requested the exploration are sent the nodes as they
+   * are registered, in the order the requests came in. */
+  explore->replies = g_slist_reverse(explore->replies);
+  item = explore->replies;
+  while(item != NULL)
+  {
+    next = item->next;
+    reply = (InfdDirectoryExploreReply*)item->data;
 
-      if(sheet_set != NULL)
-      {
-        infd_directory_acl_sheets_to_xml_for_connection(
-          directory,
-          NULL,
-          sheet_set,
-          sync_conn,
-          xml
-        );
-      }
+    if(!infd_directory_explore_begin_reply(explore, reply))
+    {
+      explore->replies = g_slist_delete_link(explore->replies, item);
 
-      inf_xml_util_set_attribute(
-        xml,
-        "group",
-        inf_communication_group_get_name(
-          INF_COMMUNICATION_GROUP(synchronization_group)
-        )
-      );
+      g_free(reply->seq);
+      g_slice_free(InfdDirectoryExploreReply, reply);
+    }
 
-      inf_xml_util_set_attribute(xml, "method", method);
-      if(seq != NULL) inf_xml_util_set_attribute(xml, "seq", seq);
+    item = next;
+  }
+}
 
-      if(subscribe_sync_conn == TRUE)
-      {
-        /* Note that if subscribe_sync_conn is set, then sync_group is the
-         * same as the subscription group, so we don't need to query the
-         * subscription group here. */
-        child = xmlNewChild(xml, NULL, (const xmlChar*)"subscribe", NULL);
-        inf_xml_util_set_attribute(child, "method", method);
+static void
+infd_directory_explore_read_done_func(gpointer run_data,
+                                      gpointer user_data)
+{
+  InfdDirectoryExploreRead* read;
+  InfdDirectoryExplore* explore;
 
-        inf_xml_util_set_attribute(
-          child,
-          "group",
-          inf_communication_group_get_name(
-            INF_COMMUNICATION_GROUP(subscription_group)
-          )
-        );
-      }
+  read = (InfdDirectoryExploreRead*)run_data;
+  explore = read->explore;
+  explore->operation = NULL;
 
-      inf_communication_group_send_message(
-        INF_COMMUNICATION_GROUP(priv->group),
-        sync_conn,
-        xml
+  if(read->error != NULL)
+  {
+    /* Only the root node is explored without request, after the storage
+     * has been changed. */
+    if(explore->request == NULL)
+    {
+      g_warning(
+        _("Failed to explore the root directory of the new storage: %s"),
+        read->error->message
       );
     }
 
-    g_object_unref(synchronization_group);
-    g_object_unref(subscription_group);
+    infd_directory_explore_fail(explore, read->error);
+    return;
   }
 
-  if(local_error != NULL)
-  {
-    inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
+  infd_directory_explore_set_list(explore, read->list);
+  read->list = NULL;
 
-  return TRUE;
+  infd_directory_explore_register(
+    explore,
+    INFD_DIRECTORY_EXPLORE_CHUNK_SIZE
+  );
 }
 
+/* Starts reading the subdirectory of the node to be explored from the
+ * storage in a worker thread. Storages that do not support this are read
+ * synchronously, and only the nodes read are registered in the
+ * background. */
 static gboolean
-infd_directory_node_remove(InfdDirectory* directory,
-                           InfdDirectoryNode* node,
-                           InfdRequest* request,
-                           const gchar* seq,
-                           GError** error)
+infd_directory_explore_start(InfdDirectoryExplore* explore,
+                             GError** error)
 {
   InfdDirectoryPrivate* priv;
+  InfdDirectoryExploreRead* read;
+  GSList* list;
   gchar* path;
-  InfBrowserIter iter;
   GError* local_error;
-  const gchar* note_type;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  priv = INFD_DIRECTORY_PRIVATE(explore->directory);
 
-  /* Cannot remove the root node */
-  /* TODO: Move the error check here so we have same error checking for
-   * local and remote requests. */
-  g_assert(node->parent != NULL);
-  g_assert(request != NULL);
+  g_assert(priv->storage != NULL);
+  g_assert(explore->operation == NULL);
+  g_assert(explore->list == NULL);
 
-  local_error = NULL;
-  if(priv->storage != NULL)
+  if(!infd_storage_supports_concurrent_reads(priv->storage))
   {
-    infd_directory_node_get_path(node, &path, NULL);
+    infd_directory_node_get_path(explore->node, &path, NULL);
 
-    switch(node->type)
+    local_error = NULL;
+    list = infd_storage_read_subdirectory(priv->storage, path, &local_error);
+    g_free(path);
+
+    if(local_error != NULL)
     {
-    case INFD_DIRECTORY_NODE_SUBDIRECTORY:
-      note_type = NULL;
-      break;
-    case INFD_DIRECTORY_NODE_NOTE:
-      note_type = node->shared.note.plugin->note_type;
-      break;
-    case INFD_DIRECTORY_NODE_UNKNOWN:
-      note_type = g_quark_to_string(node->shared.unknown.type);
-      break;
-    default:
-      g_assert_not_reached();
-      break;
+      g_propagate_error(error, local_error);
+      return FALSE;
     }
 
-    infd_storage_remove_node(
-      priv->storage,
-      note_type,
-      path,
-      &local_error
+    infd_directory_explore_set_list(explore, list);
+
+    /* Our caller still needs the exploration, so do not finish it here
+     * even if it is small. */
+    explore->dispatch = inf_io_add_dispatch(
+      priv->io,
+      infd_directory_explore_dispatch_func,
+      explore,
+      NULL
     );
-    
-    g_free(path);
-  }
 
-  iter.node_id = node->id;
-  iter.node = node;
-  if(local_error != NULL)
-  {
-    inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
-    return FALSE;
+    return TRUE;
   }
-  else
-  {
-    inf_request_finish(
-      INF_REQUEST(request),
-      inf_request_result_make_remove_node(INF_BROWSER(directory), &iter)
-    );
 
-    /* Need to unlink child sessions explicitely before unregistering, so
-     * remove-session is emitted before node-removed. Don't save changes since
-     * we just removed the note anyway. */
-    infd_directory_node_unlink_child_sessions(
-      directory,
-      node,
-      request,
-      FALSE
-    );
+  read = g_slice_new(InfdDirectoryExploreRead);
+  read->explore = explore;
+  read->io = priv->io;
+  read->storage = priv->storage;
+  read->list = NULL;
+  read->error = NULL;
 
-    infd_directory_node_unregister(directory, node, request, seq);
-    infd_directory_node_free(directory, node);
+  g_object_ref(read->io);
+  g_object_ref(read->storage);
+  infd_directory_node_get_path(explore->node, &read->path, NULL);
 
-    return TRUE;
+  explore->operation = inf_async_operation_new(
+    priv->io,
+    infd_directory_explore_read_run_func,
+    infd_directory_explore_read_done_func,
+    read
+  );
+
+  if(!inf_async_operation_start(explore->operation, error))
+  {
+    explore->operation = NULL;
+
+    infd_directory_explore_read_free(read);
+    return FALSE;
   }
+
+  return TRUE;
 }
 
-/* Returns the session for the given node. This does not link the session
- * (if it isn't already). This means that the next time this function is
- * called, the session will be created again if you don't link it yourself,
- * or if you don't create a subscription request for it. Unref the result. */
-static InfdSessionProxy*
-infd_directory_node_make_session(InfdDirectory* directory,
-                                 InfdDirectoryNode* node,
-                                 GError** error)
+/* Starts exploring node. The storage is read in the background, and the
+ * nodes are registered in chunks once it has been read. node is usually
+ * not explored yet, except for the root node when the storage is
+ * changed. */
+static InfdDirectoryExplore*
+infd_directory_node_explore(InfdDirectory* directory,
+                            InfdDirectoryNode* node,
+                            InfdProgressRequest* request,
+                            GError** error)
 {
   InfdDirectoryPrivate* priv;
-  InfSession* session;
-  GSList* item;
-  InfdDirectorySubreq* subreq;
-  InfCommunicationHostedGroup* group;
-  InfdSessionProxy* proxy;
-  gchar* path;
-
-  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  InfdDirectoryExplore* explore;
+  GError* local_error;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  /* Make sure the session is not already created */
-  g_assert(node->shared.note.session == NULL ||
-           node->shared.note.weakref == TRUE);
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(infd_directory_find_explore(directory, node) == NULL);
+
+  explore = g_slice_new(InfdDirectoryExplore);
+  explore->directory = directory;
+  explore->node = node;
+  explore->request = request;
+  explore->operation = NULL;
+  explore->dispatch = NULL;
+  explore->list = NULL;
+  explore->next = NULL;
+  explore->replies = NULL;
 
-  g_assert(
-    infd_directory_find_subreq_by_node_id(
-      directory,
-      INFD_DIRECTORY_SUBREQ_SESSION,
-      node->id
-    ) == NULL
-  );
+  if(request != NULL)
+    g_object_ref(request);
 
-  /* Note the session might only be weak-refed in which case we re-use it */
-  if(node->shared.note.session != NULL)
+  local_error = NULL;
+  if(!infd_directory_explore_start(explore, &local_error))
   {
-    proxy = node->shared.note.session;
+    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
 
-    g_object_ref(proxy);
-    return proxy;
+    infd_directory_explore_free(explore);
+    return NULL;
   }
 
-  /* If we don't have a background storage then all nodes are in memory */
-  g_assert(priv->storage != NULL);
+  priv->explores = g_slist_prepend(priv->explores, explore);
+  return explore;
+}
 
-  infd_directory_node_get_path(node, &path, NULL);
-  session = node->shared.note.plugin->session_read(
-    priv->storage,
-    priv->io,
-    priv->communication_manager,
-    path,
-    node->shared.note.plugin->user_data,
-    error
-  );
-  g_free(path);
-  if(session == NULL) return NULL;
+static gboolean
+infd_directory_explore_has_connection(InfdDirectoryExplore* explore,
+                                      InfXmlConnection* connection)
+{
+  InfdDirectoryExploreReply* reply;
+  GSList* item;
 
-  /* Buffer might have been marked as modified while reading the session, but
-   * as we just read it from the storage, we don't consider it modified. */
-  inf_buffer_set_modified(inf_session_get_buffer(session), FALSE);
+  for(item = explore->replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectoryExploreReply*)item->data;
+    if(reply->connection == connection)
+      return TRUE;
+  }
 
-  group = infd_directory_create_subscription_group(directory, node->id);
+  return FALSE;
+}
 
-  proxy = infd_directory_create_session_proxy_with_group(
-    directory,
-    session,
-    group
-  );
+static void
+infd_directory_explore_remove_connection(InfdDirectoryExplore* explore,
+                                         InfXmlConnection* connection)
+{
+  InfdDirectoryExploreReply* reply;
+  GSList* item;
 
-  g_object_unref(group);
-  g_object_unref(session);
+  for(item = explore->replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectoryExploreReply*)item->data;
+    if(reply->connection == connection)
+    {
+      explore->replies = g_slist_delete_link(explore->replies, item);
 
-  return proxy;
+      g_free(reply->seq);
+      g_slice_free(InfdDirectoryExploreReply, reply);
+      return;
+    }
+  }
 }
 
-/*
- * Network command handling.
- */
-
-static gboolean
-infd_directory_verify_sheet_set(InfdDirectory* directory,
-                                const InfAclSheetSet* sheet_set,
-                                GError** error)
+/* Cancels the exploration of node, if any. This needs to be done before
+ * the node is freed. */
+static void
+infd_directory_node_cancel_explore(InfdDirectory* directory,
+                                   InfdDirectoryNode* node)
 {
-  InfAclSheetSet* changed_sheets;
-  InfAclSheetSet* copy;
-
-  /* TODO: infd_directory_verify_acl() should be able to operate such that
-   * it leaves the passed-in sheet set unmodified, and so that it just
-   * returns TRUE or FALSE depending on whether changes are needed. */
-  copy = inf_acl_sheet_set_copy(sheet_set);
-  inf_acl_sheet_set_sink(copy);
-
-  changed_sheets = infd_directory_verify_acl(
-    directory,
-    copy,
-    NULL,
-    TRUE,
-    TRUE
-  );
-
-  inf_acl_sheet_set_free(copy);
+  InfdDirectoryExplore* explore;
+  GError* error;
 
-  if(changed_sheets != NULL)
+  explore = infd_directory_find_explore(directory, node);
+  if(explore != NULL)
   {
-    g_assert(changed_sheets->n_sheets > 0);
-
-    g_set_error(
-      error,
+    error = NULL;
+    g_set_error_literal(
+      &error,
       inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
-      "There is no such account with ID \"%s\"",
-      inf_acl_account_id_to_string(changed_sheets->sheets[0].account)
+      INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_NO_SUCH_NODE)
     );
 
-    inf_acl_sheet_set_free(changed_sheets);
-    return FALSE;
+    infd_directory_explore_fail(explore, error);
+    g_error_free(error);
   }
-
-  return TRUE;
 }
 
-static InfAclSheetSet*
-infd_directory_sheet_set_from_xml(InfdDirectory* directory,
-                                  xmlNodePtr xml,
-                                  GError** error)
+static InfdDirectoryNode*
+infd_directory_node_add_subdirectory(InfdDirectory* directory,
+                                     InfdDirectoryNode* parent,
+                                     InfdRequest* request,
+                                     const gchar* name,
+                                     const InfAclSheetSet* sheet_set,
+                                     InfXmlConnection* connection,
+                                     const gchar* seq,
+                                     GError** error)
 {
-  InfAclSheetSet* sheet_set;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  gboolean result;
+  gchar* path;
   GError* local_error;
 
+  InfBrowserIter parent_iter;
+  InfBrowserIter iter;
+
+  g_assert(parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(parent->shared.subdir.explored == TRUE);
+  g_assert(request != NULL);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
   local_error = NULL;
-  sheet_set = inf_acl_sheet_set_from_xml(xml, &local_error);
+  node = NULL;
 
-  if(local_error != NULL)
-  {
-    g_propagate_error(error, local_error);
-    return NULL;
-  }
+  infd_directory_node_is_name_available(
+    directory,
+    parent,
+    name,
+    &local_error
+  );
 
-  if(sheet_set != NULL)
+  if(local_error == NULL)
   {
-    if(infd_directory_verify_sheet_set(directory, sheet_set, error) != TRUE)
-    {
-      inf_acl_sheet_set_free(sheet_set);
-      return NULL;
-    }
-  }
+    infd_directory_node_make_path(parent, name, &path, NULL);
 
-  return sheet_set;
-}
+    if(priv->storage != NULL)
+      result = infd_storage_create_subdirectory(priv->storage, path, error);
+    else
+      result = TRUE;
 
-static gboolean
-infd_directory_check_auth(InfdDirectory* directory,
-                          InfdDirectoryNode* node,
-                          InfXmlConnection* connection,
-                          const InfAclMask* mask,
-                          GError** error)
-{
-  InfdDirectoryPrivate* priv;
-  InfdDirectoryConnectionInfo* info;
-  InfBrowserIter iter;
-  gboolean result;
+    g_free(path);
+    if(result == TRUE)
+    {
+      node = infd_directory_node_new_subdirectory(
+        directory,
+        parent,
+        priv->node_counter++,
+        g_strdup(name),
+        sheet_set,
+        TRUE
+      );
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-  info = g_hash_table_lookup(priv->connections, connection);
-  g_assert(info != NULL);
+      node->shared.subdir.explored = TRUE;
 
-  iter.node_id = node->id;
-  iter.node = node;
+      infd_directory_node_register(directory, node, request, NULL, seq);
 
-  result = inf_browser_check_acl(
-    INF_BROWSER(directory),
-    &iter,
-    info->account_id,
-    mask,
-    NULL
-  );
+      parent_iter.node_id = parent->id;
+      parent_iter.node = parent;
+      iter.node_id = node->id;
+      iter.node = node;
 
-  if(result == FALSE)
+      inf_request_finish(
+        INF_REQUEST(request),
+        inf_request_result_make_add_node(
+          INF_BROWSER(directory),
+          &parent_iter,
+          &iter
+        )
+      );
+    }
+  }
+
+  if(local_error != NULL)
   {
-    g_set_error_literal(
-      error,
-      inf_request_error_quark(),
-      INF_REQUEST_ERROR_NOT_AUTHORIZED,
-      _("Permission denied")
-    );
+    g_assert(node == NULL);
 
-    return FALSE;
+    inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
   }
 
-  return TRUE;
+  return node;
 }
 
-static InfAclAccountId
-infd_directory_create_acl_account_with_certificate(InfdDirectory* directory,
-                                                   const gchar* account_name,
-                                                   gnutls_x509_crt_t cert,
-                                                   InfXmlConnection* conn,
-                                                   GError** error)
+static gboolean
+infd_directory_node_add_note(InfdDirectory* directory,
+                             InfdDirectoryNode* parent,
+                             InfdRequest* request,
+                             const gchar* name,
+                             const InfAclSheetSet* sheet_set,
+                             const InfdNotePlugin* plugin,
+                             InfSession* session,
+                             InfXmlConnection* connection,
+                             gboolean subscribe_connection,
+                             const char* seq,
+                             GError** error)
 {
   InfdDirectoryPrivate* priv;
-  InfAclAccountId existing;
+  InfdDirectoryNode* node;
+  guint node_id;
+  InfCommunicationHostedGroup* group;
+  xmlNodePtr xml;
+  xmlNodePtr child;
+  const gchar* method;
+  InfdDirectorySubreq* subreq;
+  InfdSessionProxy* proxy;
+  gchar* path;
+  gboolean ensured;
   GError* local_error;
-  InfAclMask perms;
-  InfdDirectoryTransientAccount* transient;
-  gchar* dn;
-  gboolean success;
+
+  InfBrowserIter parent_iter;
+  InfBrowserIter iter;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  local_error = NULL;
+  g_assert(parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(parent->shared.subdir.explored == TRUE);
+  g_assert(request != NULL);
 
-  existing = infd_directory_lookup_account_by_name(
+  local_error = NULL;
+  infd_directory_node_is_name_available(
     directory,
-    account_name,
+    parent,
+    name,
     &local_error
   );
-  
-  if(local_error != NULL)
-  {
-    g_propagate_error(error, local_error);
-    return 0;
-  }
-
-  inf_acl_mask_set1(&perms, INF_ACL_CAN_CREATE_ACCOUNT);
-  if(existing != 0)
-    inf_acl_mask_or1(&perms, INF_ACL_CAN_OVERRIDE_ACCOUNT);
 
-  if(!infd_directory_check_auth(directory, priv->root, conn, &perms, error))
-    return 0;
-
-  /* If there is a certificate with the same name, replace its
-   * certificates with the new certificate. */
-  if(existing != 0)
+  if(local_error == NULL)
   {
-    transient = infd_directory_lookup_transient_account(directory, existing);
+    node_id = priv->node_counter++;
+    group = infd_directory_create_subscription_group(directory, node_id);
 
-    if(transient != NULL)
-    {
-      g_free(transient->dn);
-      transient->dn = inf_cert_util_get_dn(cert);
-    }
-    else
+    if(subscribe_connection == TRUE)
     {
-      g_assert(priv->account_storage != NULL);
+      /* Note that if session is non-zero at this point, the remote site has
+       * to know the contents of the session. It is not synchronized
+       * automatically.
+       * Note also though this is in principle supported by the code, there is
+       * currently no case that calls this function with non-zero session and
+       * subscribe_connection set. */
+      subreq = infd_directory_add_subreq_add_node(
+        directory,
+        connection,
+        group,
+        request,
+        parent,
+        node_id,
+        name,
+        sheet_set,
+        plugin,
+        session,
+        error
+      );
 
-      success = infd_account_storage_set_certificate(
-        priv->account_storage,
-        existing,
+      if(subreq != NULL)
+      {
+        xml = infd_directory_node_desc_register_to_xml(
+          "add-node",
+          node_id,
+          parent,
+          plugin->note_type,
+          name
+        );
+
+        inf_xml_util_set_attribute(xml, "seq", seq);
+
+        if(sheet_set != NULL)
+        {
+          infd_directory_acl_sheets_to_xml_for_connection(
+            directory,
+            NULL,
+            sheet_set,
+            connection,
+            xml
+          );
+        }
+
+        child = xmlNewChild(xml, NULL, (const xmlChar*)"subscribe", NULL);
+        inf_xml_util_set_attribute(
+          child,
+          "group",
+          inf_communication_group_get_name(INF_COMMUNICATION_GROUP(group))
+        );
+
+        method = inf_communication_group_get_method_for_connection(
+          INF_COMMUNICATION_GROUP(group),
+          connection
+        );
+
+        /* "central" method should always be available */
+        g_assert(method != NULL);
+
+        inf_xml_util_set_attribute(child, "method", method);
+
+        inf_communication_group_send_message(
+          INF_COMMUNICATION_GROUP(priv->group),
+          connection,
+          xml
+        );
+      }
+    }
+    else
+    {
+      if(session != NULL)
+      {
+        proxy = infd_directory_create_session_proxy_with_group(
+          directory,
+          session,
+          group
+        );
+      }
+      else
+      {
+        infd_directory_node_make_path(parent, name, &path, NULL);
+
+        proxy = infd_directory_create_session_proxy(
+          directory,
+          plugin,
+          INF_SESSION_RUNNING,
+          NULL,
+          NULL,
+          group,
+          path
+        );
+
+        g_free(path);
+      }
+
+      ensured = infd_directory_session_proxy_ensure(
+        directory,
+        parent,
+        name,
+        plugin,
+        proxy,
+        &local_error
+      );
+
+      if(ensured == TRUE)
+      {
+        node = infd_directory_node_new_note(
+          directory,
+          parent,
+          node_id,
+          g_strdup(name),
+          sheet_set,
+          TRUE,
+          plugin
+        );
+
+        infd_directory_node_register(directory, node, request, NULL, seq);
+        infd_directory_node_link_session(directory, node, request, proxy);
+        g_object_unref(proxy);
+
+        parent_iter.node_id = parent->id;
+        parent_iter.node = parent;
+        iter.node_id = node->id;
+        iter.node = node;
+
+        inf_request_finish(
+          INF_REQUEST(request),
+          inf_request_result_make_add_node(
+            INF_BROWSER(directory),
+            &parent_iter,
+            &iter
+          )
+        );
+      }
+    }
+
+    g_object_unref(group);
+  }
+
+  if(local_error != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+infd_directory_node_add_sync_in(InfdDirectory* directory,
+                                InfdDirectoryNode* parent,
+                                InfdRequest* request,
+                                const gchar* name,
+                                const InfAclSheetSet* sheet_set,
+                                const InfdNotePlugin* plugin,
+                                InfXmlConnection* sync_conn,
+                                gboolean subscribe_sync_conn,
+                                const gchar *seq,
+                                GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfCommunicationHostedGroup* subscription_group;
+  InfCommunicationHostedGroup* synchronization_group;
+  guint node_id;
+  gchar* sync_group_name;
+  const gchar* method;
+  InfdDirectorySubreq* subreq;
+  xmlNodePtr xml;
+  xmlNodePtr child;
+  GError* local_error;
+
+  /* Synchronization is always between only two peers, so central method
+   * is enough. */
+  static const gchar* const sync_methods[] = { "central", NULL };
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(parent->shared.subdir.explored == TRUE);
+
+  local_error = NULL;
+  infd_directory_node_is_name_available(
+    directory,
+    parent,
+    name,
+    &local_error
+  );
+
+  if(local_error == NULL)
+  {
+    node_id = priv->node_counter++;
+
+    subscription_group =
+      infd_directory_create_subscription_group(directory, node_id);
+
+    if(subscribe_sync_conn == TRUE)
+    {
+      synchronization_group = subscription_group;
+      g_object_ref(synchronization_group);
+    }
+    else
+    {
+      sync_group_name = g_strdup_printf("InfSession_SyncIn_%u", node_id);
+
+      synchronization_group = inf_communication_manager_open_group(
+        priv->communication_manager,
+        sync_group_name,
+        sync_methods
+      );
+
+      g_free(sync_group_name);
+    }
+
+    method = inf_communication_group_get_method_for_connection(
+      INF_COMMUNICATION_GROUP(synchronization_group),
+      sync_conn
+    );
+
+    /* "central" should always be available */
+    g_assert(method != NULL);
+
+    subreq = infd_directory_add_subreq_sync_in(
+      directory,
+      sync_conn,
+      synchronization_group,
+      subscription_group,
+      request,
+      parent,
+      node_id,
+      name,
+      sheet_set,
+      plugin,
+      error
+    );
+
+    if(subreq != NULL)
+    {
+      xml = infd_directory_node_desc_register_to_xml(
+        "sync-in",
+        node_id,
+        parent,
+        plugin->note_type,
+        name
+      );
+
+      if(sheet_set != NULL)
+      {
+        infd_directory_acl_sheets_to_xml_for_connection(
+          directory,
+          NULL,
+          sheet_set,
+          sync_conn,
+          xml
+        );
+      }
+
+      inf_xml_util_set_attribute(
+        xml,
+        "group",
+        inf_communication_group_get_name(
+          INF_COMMUNICATION_GROUP(synchronization_group)
+        )
+      );
+
+      inf_xml_util_set_attribute(xml, "method", method);
+      if(seq != NULL) inf_xml_util_set_attribute(xml, "seq", seq);
+
+      if(subscribe_sync_conn == TRUE)
+      {
+        /* Note that if subscribe_sync_conn is set, then sync_group is the
+         * same as the subscription group, so we don't need to query the
+         * subscription group here. */
+        child = xmlNewChild(xml, NULL, (const xmlChar*)"subscribe", NULL);
+        inf_xml_util_set_attribute(child, "method", method);
+
+        inf_xml_util_set_attribute(
+          child,
+          "group",
+          inf_communication_group_get_name(
+            INF_COMMUNICATION_GROUP(subscription_group)
+          )
+        );
+      }
+
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->group),
+        sync_conn,
+        xml
+      );
+    }
+
+    g_object_unref(synchronization_group);
+    g_object_unref(subscription_group);
+  }
+
+  if(local_error != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+infd_directory_node_remove(InfdDirectory* directory,
+                           InfdDirectoryNode* node,
+                           InfdRequest* request,
+                           const gchar* seq,
+                           GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  gchar* path;
+  InfBrowserIter iter;
+  GError* local_error;
+  const gchar* note_type;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* Cannot remove the root node */
+  /* TODO: Move the error check here so we have same error checking for
+   * local and remote requests. */
+  g_assert(node->parent != NULL);
+  g_assert(request != NULL);
+
+  local_error = NULL;
+  if(priv->storage != NULL)
+  {
+    infd_directory_node_get_path(node, &path, NULL);
+
+    switch(node->type)
+    {
+    case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+      note_type = NULL;
+      break;
+    case INFD_DIRECTORY_NODE_NOTE:
+      note_type = node->shared.note.plugin->note_type;
+      break;
+    case INFD_DIRECTORY_NODE_UNKNOWN:
+      note_type = g_quark_to_string(node->shared.unknown.type);
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+
+    infd_storage_remove_node(
+      priv->storage,
+      note_type,
+      path,
+      &local_error
+    );
+    
+    g_free(path);
+  }
+
+  iter.node_id = node->id;
+  iter.node = node;
+  if(local_error != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+  else
+  {
+    inf_request_finish(
+      INF_REQUEST(request),
+      inf_request_result_make_remove_node(INF_BROWSER(directory), &iter)
+    );
+
+    /* Need to unlink child sessions explicitely before unregistering, so
+     * remove-session is emitted before node-removed. Don't save changes since
+     * we just removed the note anyway. */
+    infd_directory_node_unlink_child_sessions(
+      directory,
+      node,
+      request,
+      FALSE
+    );
+
+    infd_directory_node_unregister(directory, node, request, seq);
+    infd_directory_node_free(directory, node);
+
+    return TRUE;
+  }
+}
+
+/* Creates the session proxy for a session of node that has just been read
+ * from the storage. */
+static InfdSessionProxy*
+infd_directory_node_wrap_session(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfSession* session)
+{
+  InfCommunicationHostedGroup* group;
+  InfdSessionProxy* proxy;
+
+  /* Buffer might have been marked as modified while reading the session, but
+   * as we just read it from the storage, we don't consider it modified. */
+  inf_buffer_set_modified(inf_session_get_buffer(session), FALSE);
+
+  group = infd_directory_create_subscription_group(directory, node->id);
+
+  proxy = infd_directory_create_session_proxy_with_group(
+    directory,
+    session,
+    group
+  );
+
+  g_object_unref(group);
+  return proxy;
+}
+
+/* Reads the session of node from the storage with the step functions of the
+ * note plugin, without returning to the main loop in between. If request
+ * is a InfdProgressRequest, then the progress is reported on it. */
+static InfSession*
+infd_directory_node_read_session_steps(InfdDirectory* directory,
+                                       InfdDirectoryNode* node,
+                                       InfdRequest* request,
+                                       const gchar* path,
+                                       GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  const InfdNotePlugin* plugin;
+  gpointer handle;
+  GError* local_error;
+  gboolean result;
+  guint total;
+  guint current;
+  guint step;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  plugin = node->shared.note.plugin;
+
+  handle = plugin->session_read_begin(
+    priv->storage,
+    priv->io,
+    priv->communication_manager,
+    path,
+    &total,
+    plugin->user_data,
+    error
+  );
+
+  if(handle == NULL)
+    return NULL;
+
+  if(request != NULL && INFD_IS_PROGRESS_REQUEST(request))
+    infd_progress_request_initiated(INFD_PROGRESS_REQUEST(request), total);
+  else
+    request = NULL;
+
+  local_error = NULL;
+  current = 0;
+  step = 0;
+
+  do
+  {
+    result = plugin->session_read_next(handle, &step, &local_error);
+
+    if(request != NULL)
+      for(; current < MIN(step, total); ++current)
+        infd_progress_request_progress(INFD_PROGRESS_REQUEST(request));
+  } while(result == TRUE);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    plugin->session_read_end(handle);
+    return NULL;
+  }
+
+  return plugin->session_read_end(handle);
+}
+
+/* Returns the session for the given node. This does not link the session
+ * (if it isn't already). This means that the next time this function is
+ * called, the session will be created again if you don't link it yourself,
+ * or if you don't create a subscription request for it. Unref the result.
+ * If request is a InfdProgressRequest, then the progress of reading the
+ * session from the storage is reported on it. */
+static InfdSessionProxy*
+infd_directory_node_make_session(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfdRequest* request,
+                                 GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfSession* session;
+  InfdSessionProxy* proxy;
+  gchar* path;
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* Make sure the session is not already created */
+  g_assert(node->shared.note.session == NULL ||
+           node->shared.note.weakref == TRUE);
+
+  g_assert(
+    infd_directory_find_subreq_by_node_id(
+      directory,
+      INFD_DIRECTORY_SUBREQ_SESSION,
+      node->id
+    ) == NULL
+  );
+
+  /* Note the session might only be weak-refed in which case we re-use it */
+  if(node->shared.note.session != NULL)
+  {
+    proxy = node->shared.note.session;
+
+    g_object_ref(proxy);
+    return proxy;
+  }
+
+  /* If we don't have a background storage then all nodes are in memory */
+  g_assert(priv->storage != NULL);
+
+  infd_directory_node_get_path(node, &path, NULL);
+  if(node->shared.note.plugin->session_read_begin != NULL)
+  {
+    session = infd_directory_node_read_session_steps(
+      directory,
+      node,
+      request,
+      path,
+      error
+    );
+  }
+  else
+  {
+    session = node->shared.note.plugin->session_read(
+      priv->storage,
+      priv->io,
+      priv->communication_manager,
+      path,
+      node->shared.note.plugin->user_data,
+      error
+    );
+  }
+  g_free(path);
+  if(session == NULL) return NULL;
+
+  proxy = infd_directory_node_wrap_session(directory, node, session);
+  g_object_unref(session);
+
+  return proxy;
+}
+
+/*
+ * Network command handling.
+ */
+
+static gboolean
+infd_directory_verify_sheet_set(InfdDirectory* directory,
+                                const InfAclSheetSet* sheet_set,
+                                GError** error)
+{
+  InfAclSheetSet* changed_sheets;
+  InfAclSheetSet* copy;
+
+  /* TODO: infd_directory_verify_acl() should be able to operate such that
+   * it leaves the passed-in sheet set unmodified, and so that it just
+   * returns TRUE or FALSE depending on whether changes are needed. */
+  copy = inf_acl_sheet_set_copy(sheet_set);
+  inf_acl_sheet_set_sink(copy);
+
+  changed_sheets = infd_directory_verify_acl(
+    directory,
+    copy,
+    NULL,
+    TRUE,
+    TRUE
+  );
+
+  inf_acl_sheet_set_free(copy);
+
+  if(changed_sheets != NULL)
+  {
+    g_assert(changed_sheets->n_sheets > 0);
+
+    g_set_error(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
+      "There is no such account with ID \"%s\"",
+      inf_acl_account_id_to_string(changed_sheets->sheets[0].account)
+    );
+
+    inf_acl_sheet_set_free(changed_sheets);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static InfAclSheetSet*
+infd_directory_sheet_set_from_xml(InfdDirectory* directory,
+                                  xmlNodePtr xml,
+                                  GError** error)
+{
+  InfAclSheetSet* sheet_set;
+  GError* local_error;
+
+  local_error = NULL;
+  sheet_set = inf_acl_sheet_set_from_xml(xml, &local_error);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return NULL;
+  }
+
+  if(sheet_set != NULL)
+  {
+    if(infd_directory_verify_sheet_set(directory, sheet_set, error) != TRUE)
+    {
+      inf_acl_sheet_set_free(sheet_set);
+      return NULL;
+    }
+  }
+
+  return sheet_set;
+}
+
+static gboolean
+infd_directory_check_auth(InfdDirectory* directory,
+                          InfdDirectoryNode* node,
+                          InfXmlConnection* connection,
+                          const InfAclMask* mask,
+                          GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryConnectionInfo* info;
+  InfBrowserIter iter;
+  gboolean result;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL);
+
+  iter.node_id = node->id;
+  iter.node = node;
+
+  result = inf_browser_check_acl(
+    INF_BROWSER(directory),
+    &iter,
+    info->account_id,
+    mask,
+    NULL
+  );
+
+  if(result == FALSE)
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_NOT_AUTHORIZED,
+      _("Permission denied")
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static InfAclAccountId
+infd_directory_create_acl_account_with_certificate(InfdDirectory* directory,
+                                                   const gchar* account_name,
+                                                   gnutls_x509_crt_t cert,
+                                                   InfXmlConnection* conn,
+                                                   GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfAclAccountId existing;
+  GError* local_error;
+  InfAclMask perms;
+  InfdDirectoryTransientAccount* transient;
+  gchar* dn;
+  gboolean success;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  local_error = NULL;
+
+  existing = infd_directory_lookup_account_by_name(
+    directory,
+    account_name,
+    &local_error
+  );
+  
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return 0;
+  }
+
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_CREATE_ACCOUNT);
+  if(existing != 0)
+    inf_acl_mask_or1(&perms, INF_ACL_CAN_OVERRIDE_ACCOUNT);
+
+  if(!infd_directory_check_auth(directory, priv->root, conn, &perms, error))
+    return 0;
+
+  /* If there is a certificate with the same name, replace its
+   * certificates with the new certificate. */
+  if(existing != 0)
+  {
+    transient = infd_directory_lookup_transient_account(directory, existing);
+
+    if(transient != NULL)
+    {
+      g_free(transient->dn);
+      transient->dn = inf_cert_util_get_dn(cert);
+    }
+    else
+    {
+      g_assert(priv->account_storage != NULL);
+
+      success = infd_account_storage_set_certificate(
+        priv->account_storage,
+        existing,
         &cert,
         1,
         error
@@ -5477,134 +6883,481 @@ infd_directory_get_node_from_xml(InfdDirectory* directory,
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  has_node = inf_xml_util_get_attribute_uint_required(
+  has_node = inf_xml_util_get_attribute_uint_required(
+    xml,
+    attrib,
+    &node_id,
+    error
+  );
+
+  if(has_node == FALSE) return NULL;
+
+  node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id));
+  if(node == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_NO_SUCH_NODE)
+    );
+
+    return NULL;
+  }
+
+  /* TODO: Verify that the connection has explored this node */
+
+  return node;
+}
+
+static InfdDirectoryNode*
+infd_directory_get_node_from_xml_typed(InfdDirectory* directory,
+                                       xmlNodePtr xml,
+                                       const gchar* attrib,
+                                       InfdDirectoryNodeType type,
+                                       GError** error)
+{
+  InfdDirectoryNode* node;
+  node = infd_directory_get_node_from_xml(directory, xml, attrib, error);
+
+  if(node != NULL && node->type != type)
+  {
+    switch(type)
+    {
+    case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+      g_set_error(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NOT_A_SUBDIRECTORY,
+        _("Node with ID \"%u\" is not a subdirectory node"),
+        node->id
+      );
+
+      return NULL;
+    case INFD_DIRECTORY_NODE_NOTE:
+      if(node->type == INFD_DIRECTORY_NODE_UNKNOWN)
+      {
+        g_set_error(
+          error,
+          inf_directory_error_quark(),
+          INF_DIRECTORY_ERROR_NOTE_TYPE_UNSUPPORTED,
+          _("Node with ID \"%u\" has unsupported type \"%s\""),
+          node->id,
+          g_quark_to_string(node->shared.unknown.type)
+        );
+      }
+      else
+      {
+        g_set_error(
+          error,
+          inf_directory_error_quark(),
+          INF_DIRECTORY_ERROR_NOT_A_NOTE,
+          _("Node with ID \"%u\" is not a leaf node"),
+          node->id
+        );
+      }
+
+      return NULL;
+    case INFD_DIRECTORY_NODE_UNKNOWN:
+      g_assert_not_reached(); /* TODO: Needs to be implemented */
+      break;
+    default:
+      g_assert_not_reached();
+      return NULL;
+    }
+  }
+
+  return node;
+}
+
+static gboolean
+infd_directory_handle_explore_node(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   const xmlNodePtr xml,
+                                   GError** error)
+{
+  InfdDirectoryNode* node;
+  InfAclMask perms;
+  InfdProgressRequest* request;
+  InfdDirectoryExplore* explore;
+  InfdDirectoryExploreReply* reply;
+  InfBrowserIter iter;
+  GError* local_error;
+  gchar* seq;
+
+  node = infd_directory_get_node_from_xml_typed(
+    directory,
+    xml,
+    "id",
+    INFD_DIRECTORY_NODE_SUBDIRECTORY,
+    error
+  );
+
+  if(node == NULL) return FALSE;
+
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_EXPLORE_NODE);
+  if(!infd_directory_check_auth(directory, node, connection, &perms, error))
+    return FALSE;
+
+  explore = infd_directory_find_explore(directory, node);
+
+  if(g_slist_find(node->shared.subdir.connections, connection) != NULL ||
+     (explore != NULL &&
+      infd_directory_explore_has_connection(explore, connection)))
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_ALREADY_EXPLORED,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_ALREADY_EXPLORED)
+    );
+
+    return FALSE;
+  }
+
+  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+    return FALSE;
+
+  if(explore == NULL && node->shared.subdir.explored == FALSE)
+  {
+    request = INFD_PROGRESS_REQUEST(
+      g_object_new(
+        INFD_TYPE_PROGRESS_REQUEST,
+        "type", "explore-node",
+        "node-id", node->id,
+        "requestor", connection,
+        NULL
+      )
+    );
+
+    iter.node_id = node->id;
+    iter.node = node;
+    inf_browser_begin_request(
+      INF_BROWSER(directory),
+      &iter,
+      INF_REQUEST(request)
+    );
+
+    local_error = NULL;
+    explore = infd_directory_node_explore(
+      directory,
+      node,
+      request,
+      &local_error
+    );
+
+    g_object_unref(request);
+
+    if(local_error != NULL)
+    {
+      g_free(seq);
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+  }
+
+  if(explore != NULL)
+  {
+    /* Reply once the subdirectory has been read, or right away if the
+     * nodes read are being registered already */
+    reply = g_slice_new(InfdDirectoryExploreReply);
+    reply->connection = connection;
+    reply->seq = seq;
+
+    if(explore->operation != NULL ||
+       infd_directory_explore_begin_reply(explore, reply))
+    {
+      explore->replies = g_slist_prepend(explore->replies, reply);
+    }
+    else
+    {
+      g_free(reply->seq);
+      g_slice_free(InfdDirectoryExploreReply, reply);
+    }
+  }
+  else
+  {
+    infd_directory_send_explore_reply(directory, node, connection, seq);
+    g_free(seq);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+infd_directory_handle_add_node(InfdDirectory* directory,
+                               InfXmlConnection* connection,
+                               const xmlNodePtr xml,
+                               GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* parent;
+  InfBrowserIter parent_iter;
+  InfdDirectoryNode* node;
+  GError* local_error;
+  InfAclSheetSet* sheet_set;
+  InfAclMask perms;
+  InfdNotePlugin* plugin;
+  InfdRequest* request;
+  xmlChar* name;
+  xmlChar* type;
+  gchar* seq;
+
+  xmlNodePtr child;
+  gboolean perform_sync_in;
+  gboolean subscribe_sync_conn;
+  gboolean is_subdirectory;
+  gboolean node_added;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  parent = infd_directory_get_node_from_xml_typed(
+    directory,
     xml,
-    attrib,
-    &node_id,
+    "parent",
+    INFD_DIRECTORY_NODE_SUBDIRECTORY,
     error
   );
 
-  if(has_node == FALSE) return NULL;
+  if(parent == NULL)
+    return FALSE;
 
-  node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id));
-  if(node == NULL)
+  if(parent->shared.subdir.explored == FALSE)
   {
     g_set_error_literal(
       error,
       inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_NO_SUCH_NODE,
-      inf_directory_strerror(INF_DIRECTORY_ERROR_NO_SUCH_NODE)
+      INF_DIRECTORY_ERROR_NOT_EXPLORED,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_NOT_EXPLORED)
     );
 
-    return NULL;
+    return FALSE;
   }
 
-  /* TODO: Verify that the connection has explored this node */
+  local_error = NULL;
+  sheet_set = infd_directory_sheet_set_from_xml(directory, xml, &local_error);
 
-  return node;
-}
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
 
-static InfdDirectoryNode*
-infd_directory_get_node_from_xml_typed(InfdDirectory* directory,
-                                       xmlNodePtr xml,
-                                       const gchar* attrib,
-                                       InfdDirectoryNodeType type,
-                                       GError** error)
-{
-  InfdDirectoryNode* node;
-  node = infd_directory_get_node_from_xml(directory, xml, attrib, error);
+  type = inf_xml_util_get_attribute_required(xml, "type", error);
+  if(type == NULL)
+  {
+    if(sheet_set != NULL)
+      inf_acl_sheet_set_free(sheet_set);
+    return FALSE;
+  }
 
-  if(node != NULL && node->type != type)
+  if(strcmp((const gchar*)type, "InfSubdirectory") == 0)
+    is_subdirectory = TRUE;
+  else
+    is_subdirectory = FALSE;
+    
+  /* Check for sync-in/subscribe flags */
+  perform_sync_in = subscribe_sync_conn = FALSE;
+  for(child = xml->children; child != NULL; child = child->next)
   {
-    switch(type)
+    if(strcmp((const char*)child->name, "sync-in") == 0)
+      perform_sync_in = TRUE;
+    else if(strcmp((const char*)child->name, "subscribe") == 0)
+      subscribe_sync_conn = TRUE;
+  }
+
+  infd_directory_get_add_node_permissions(
+    directory,
+    &perms,
+    is_subdirectory,
+    subscribe_sync_conn,
+    perform_sync_in,
+    sheet_set
+  );
+
+  if(!infd_directory_check_auth(directory, parent, connection, &perms, error))
+  {
+    if(sheet_set != NULL)
+      inf_acl_sheet_set_free(sheet_set);
+    xmlFree(type);
+    return FALSE;
+  }
+
+  if(is_subdirectory == TRUE)
+  {
+    /* No plugin because we want to create a directory */
+    plugin = NULL;
+    xmlFree(type);
+    
+    /* TODO: Error if perform_sync_in or subscribe are set. Actually we
+     * could interpret subscribe as initially explored... */
+  }
+  else
+  {
+    plugin = g_hash_table_lookup(priv->plugins, (const gchar*)type);
+    xmlFree(type);
+
+    if(plugin == NULL)
     {
-    case INFD_DIRECTORY_NODE_SUBDIRECTORY:
-      g_set_error(
+      if(sheet_set != NULL)
+        inf_acl_sheet_set_free(sheet_set);
+
+      g_set_error_literal(
         error,
         inf_directory_error_quark(),
-        INF_DIRECTORY_ERROR_NOT_A_SUBDIRECTORY,
-        _("Node with ID \"%u\" is not a subdirectory node"),
-        node->id
+        INF_DIRECTORY_ERROR_TYPE_UNKNOWN,
+        inf_directory_strerror(INF_DIRECTORY_ERROR_TYPE_UNKNOWN)
       );
 
-      return NULL;
-    case INFD_DIRECTORY_NODE_NOTE:
-      if(node->type == INFD_DIRECTORY_NODE_UNKNOWN)
-      {
-        g_set_error(
-          error,
-          inf_directory_error_quark(),
-          INF_DIRECTORY_ERROR_NOTE_TYPE_UNSUPPORTED,
-          _("Node with ID \"%u\" has unsupported type \"%s\""),
-          node->id,
-          g_quark_to_string(node->shared.unknown.type)
-        );
-      }
-      else
-      {
-        g_set_error(
-          error,
-          inf_directory_error_quark(),
-          INF_DIRECTORY_ERROR_NOT_A_NOTE,
-          _("Node with ID \"%u\" is not a leaf node"),
-          node->id
-        );
-      }
+      return FALSE;
+    }
+  }
 
-      return NULL;
-    case INFD_DIRECTORY_NODE_UNKNOWN:
-      g_assert_not_reached(); /* TODO: Needs to be implemented */
-      break;
-    default:
-      g_assert_not_reached();
-      return NULL;
+  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+  {
+    if(sheet_set != NULL)
+      inf_acl_sheet_set_free(sheet_set);
+    return FALSE;
+  }
+
+  name = inf_xml_util_get_attribute_required(xml, "name", error);
+  if(name == NULL)
+  {
+    if(sheet_set != NULL)
+      inf_acl_sheet_set_free(sheet_set);
+    g_free(seq);
+    return FALSE;
+  }
+
+  request = INFD_REQUEST(
+    g_object_new(
+      INFD_TYPE_REQUEST,
+      "type", "add-node",
+      "node-id", parent->id,
+      "requestor", connection,
+      NULL
+    )
+  );
+
+  parent_iter.node_id = parent->id;
+  parent_iter.node = parent;
+  inf_browser_begin_request(
+    INF_BROWSER(directory),
+    &parent_iter,
+    INF_REQUEST(request)
+  );
+
+  if(plugin == NULL)
+  {
+    node = infd_directory_node_add_subdirectory(
+      directory,
+      parent,
+      request,
+      (const gchar*)name,
+      sheet_set,
+      connection,
+      seq,
+      error
+    );
+
+    if(node == NULL)
+      node_added = FALSE;
+    else
+      node_added = TRUE;
+  }
+  else
+  {
+    if(perform_sync_in == FALSE)
+    {
+      node_added = infd_directory_node_add_note(
+        directory,
+        parent,
+        request,
+        (const gchar*)name,
+        sheet_set,
+        plugin,
+        NULL,
+        connection,
+        subscribe_sync_conn,
+        seq,
+        error
+      );
+    }
+    else
+    {
+      node_added = infd_directory_node_add_sync_in(
+        directory,
+        parent,
+        request,
+        (const char*)name,
+        sheet_set,
+        plugin,
+        connection,
+        subscribe_sync_conn,
+        seq,
+        error
+      );
+
+      /* Note: The sync-in can still fail for various reasons. Maybe the
+       * client doesn't support the communication method, the synchronization
+       * fails or the parent folder is removed. */
     }
   }
 
-  return node;
+  g_object_unref(request);
+
+  if(sheet_set != NULL)
+    inf_acl_sheet_set_free(sheet_set);
+  xmlFree(name);
+  g_free(seq);
+
+  return node_added;
 }
 
 static gboolean
-infd_directory_handle_explore_node(InfdDirectory* directory,
-                                   InfXmlConnection* connection,
-                                   const xmlNodePtr xml,
-                                   GError** error)
-{
-  InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* node;
-  InfAclMask perms;
-  GSList* item;
-  InfdProgressRequest* request;
-  InfBrowserIter iter;
-  GError* local_error;
-  InfdDirectoryNode* child;
-  xmlNodePtr reply_xml;
+infd_directory_handle_remove_node(InfdDirectory* directory,
+                                  InfXmlConnection* connection,
+                                  const xmlNodePtr xml,
+                                  GError** error)
+{
+  InfdDirectoryNode* node;
   gchar* seq;
-  guint total;
-  const InfAclSheetSet* sheet_set;
-
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  InfdRequest* request;
+  InfBrowserIter iter;
+  gboolean result;
 
-  node = infd_directory_get_node_from_xml_typed(
-    directory,
-    xml,
-    "id",
-    INFD_DIRECTORY_NODE_SUBDIRECTORY,
-    error
-  );
+  InfdDirectoryNode* up;
+  InfAclMask perms;
 
+  node = infd_directory_get_node_from_xml(directory, xml, "id", error);
   if(node == NULL) return FALSE;
 
-  inf_acl_mask_set1(&perms, INF_ACL_CAN_EXPLORE_NODE);
-  if(!infd_directory_check_auth(directory, node, connection, &perms, error))
-    return FALSE;
+  if(node->parent == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_ROOT_NODE_REMOVE_ATTEMPT,
+      _("The root node cannot be removed")
+    );
 
-  if(node->shared.subdir.explored == FALSE)
+    return FALSE;
+  }
+  else
   {
-    request = INFD_PROGRESS_REQUEST(
+    /* Check the remove node permission on the parent node */
+    up = node->parent;
+    inf_acl_mask_set1(&perms, INF_ACL_CAN_REMOVE_NODE);
+    if(!infd_directory_check_auth(directory, up, connection, &perms, error))
+      return FALSE;
+
+    if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+      return FALSE;
+
+    request = INFD_REQUEST(
       g_object_new(
-        INFD_TYPE_PROGRESS_REQUEST,
-        "type", "explore-node",
+        INFD_TYPE_REQUEST,
+        "type", "remove-node",
         "node-id", node->id,
         "requestor", connection,
         NULL
@@ -5619,371 +7372,528 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
       INF_REQUEST(request)
     );
 
-    local_error = NULL;
-    infd_directory_node_explore(directory, node, request, &local_error);
+    result = infd_directory_node_remove(directory, node, request, seq, error);
     g_object_unref(request);
-
-    if(local_error != NULL)
-    {
-      g_propagate_error(error, local_error);
-      return FALSE;
-    }
+    return result;
   }
+}
 
-  if(g_slist_find(node->shared.subdir.connections, connection) != NULL)
-  {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_ALREADY_EXPLORED,
-      inf_directory_strerror(INF_DIRECTORY_ERROR_ALREADY_EXPLORED)
-    );
-
-    return FALSE;
-  }
+/* Returns the state of the client's copy of the session if the client asks
+ * to resume its subscription, and the session can be resumed from there.
+ * Otherwise, the session is synchronized as a whole. */
+static InfAdoptedStateVector*
+infd_directory_get_resume_vector(InfdSessionProxy* proxy,
+                                 xmlNodePtr xml)
+{
+  InfSession* session;
+  InfAdoptedStateVector* vector;
+  xmlChar* identity;
+  xmlChar* vector_str;
+  gboolean matches;
 
-  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
-    return FALSE;
+  identity = inf_xml_util_get_attribute(xml, "resume-identity");
+  if(identity == NULL) return NULL;
 
-  total = 0;
-  for(child = node->shared.subdir.child; child != NULL; child = child->next)
-    ++ total;
+  matches = strcmp(
+    (const char*)identity,
+    infd_session_proxy_get_identity(proxy)
+  ) == 0;
 
-  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-begin");
-  inf_xml_util_set_attribute_uint(reply_xml, "total", total);
-  if(seq != NULL)
-    inf_xml_util_set_attribute(reply_xml, "seq", seq);
+  xmlFree(identity);
+  if(!matches) return NULL;
 
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    connection,
-    reply_xml
-  );
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  vector = NULL;
 
-  for(child = node->shared.subdir.child; child != NULL; child = child->next)
+  if(INF_ADOPTED_IS_SESSION(session))
   {
-    reply_xml = infd_directory_node_register_to_xml(child);
-    if(seq != NULL)
-      inf_xml_util_set_attribute(reply_xml, "seq", seq);
-
-    if(child->acl != NULL)
+    vector_str = inf_xml_util_get_attribute(xml, "resume-vector");
+    if(vector_str != NULL)
     {
-      infd_directory_acl_sheets_to_xml_for_connection(
-        directory,
-        child->acl_connections,
-        child->acl,
-        connection,
-        reply_xml
+      vector = inf_adopted_state_vector_from_string(
+        (const gchar*)vector_str,
+        NULL
       );
+
+      xmlFree(vector_str);
     }
 
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
-      connection,
-      reply_xml
-    );
+    if(vector != NULL &&
+       !inf_adopted_session_can_resume(INF_ADOPTED_SESSION(session), vector))
+    {
+      inf_adopted_state_vector_free(vector);
+      vector = NULL;
+    }
   }
 
-  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
+  g_object_unref(session);
+  return vector;
+}
 
-  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+/* Replies to the subscribe-session request of connection, and adds a
+ * subscription request for it, which takes ownership of proxy and of
+ * resume_vector. */
+static void
+infd_directory_send_subscribe_session(InfdDirectory* directory,
+                                      InfdDirectoryNode* node,
+                                      InfXmlConnection* connection,
+                                      InfdRequest* request,
+                                      InfdSessionProxy* proxy,
+                                      const gchar* seq,
+                                      InfAdoptedStateVector* resume_vector)
+{
+  InfdDirectoryPrivate* priv;
+  InfCommunicationGroup* group;
+  InfdDirectorySubreq* subreq;
+  const gchar* method;
+  xmlNodePtr reply_xml;
 
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    connection,
-    reply_xml
-  );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  /* Remember that this connection explored that node so that it gets
-   * notified when changes occur. */
-  node->shared.subdir.connections = g_slist_prepend(
-    node->shared.subdir.connections,
+  g_object_get(G_OBJECT(proxy), "subscription-group", &group, NULL);
+  method = inf_communication_group_get_method_for_connection(
+    group,
     connection
   );
 
-  g_free(seq);
-  return TRUE;
-}
-
-static gboolean
-infd_directory_handle_add_node(InfdDirectory* directory,
-                               InfXmlConnection* connection,
-                               const xmlNodePtr xml,
-                               GError** error)
-{
-  InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* parent;
-  InfBrowserIter parent_iter;
-  InfdDirectoryNode* node;
-  GError* local_error;
-  InfAclSheetSet* sheet_set;
-  InfAclMask perms;
-  InfdNotePlugin* plugin;
-  InfdRequest* request;
-  xmlChar* name;
-  xmlChar* type;
-  gchar* seq;
+  /* We should always be able to fallback to "central" */
+  g_assert(method != NULL);
 
-  xmlNodePtr child;
-  gboolean perform_sync_in;
-  gboolean subscribe_sync_conn;
-  gboolean is_subdirectory;
-  gboolean node_added;
+  /* Reply that subscription was successful (so far, synchronization may
+   * still fail) and tell identifier. */
+  reply_xml = xmlNewNode(NULL, (const xmlChar*)"subscribe-session");
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  xmlNewProp(
+    reply_xml,
+    (const xmlChar*)"group",
+    (const xmlChar*)inf_communication_group_get_name(group)
+  );
 
-  parent = infd_directory_get_node_from_xml_typed(
-    directory,
-    xml,
-    "parent",
-    INFD_DIRECTORY_NODE_SUBDIRECTORY,
-    error
+  xmlNewProp(
+    reply_xml,
+    (const xmlChar*)"method",
+    (const xmlChar*)method
   );
 
-  if(parent == NULL)
-    return FALSE;
+  g_object_unref(group);
+  inf_xml_util_set_attribute_uint(reply_xml, "id", node->id);
+  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
-  local_error = NULL;
-  sheet_set = infd_directory_sheet_set_from_xml(directory, xml, &local_error);
+  /* Tell the client which copy of the session it subscribes to, so that it
+   * can resume the subscription should its connection get lost. */
+  inf_xml_util_set_attribute(
+    reply_xml,
+    "identity",
+    infd_session_proxy_get_identity(proxy)
+  );
 
-  if(local_error != NULL)
-  {
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
+  if(resume_vector != NULL)
+    inf_xml_util_set_attribute(reply_xml, "resume", "true");
 
-  type = inf_xml_util_get_attribute_required(xml, "type", error);
-  if(type == NULL)
-  {
-    if(sheet_set != NULL)
-      inf_acl_sheet_set_free(sheet_set);
-    return FALSE;
-  }
+  /* This gives ownership of proxy to the subscription request */
+  subreq = infd_directory_add_subreq_session(
+    directory,
+    connection,
+    request,
+    node->id,
+    proxy
+  );
 
-  if(strcmp((const gchar*)type, "InfSubdirectory") == 0)
-    is_subdirectory = TRUE;
-  else
-    is_subdirectory = FALSE;
-    
-  /* Check for sync-in/subscribe flags */
-  perform_sync_in = subscribe_sync_conn = FALSE;
-  for(child = xml->children; child != NULL; child = child->next)
-  {
-    if(strcmp((const char*)child->name, "sync-in") == 0)
-      perform_sync_in = TRUE;
-    else if(strcmp((const char*)child->name, "subscribe") == 0)
-      subscribe_sync_conn = TRUE;
-  }
+  subreq->shared.session.resume_vector = resume_vector;
 
-  infd_directory_get_add_node_permissions(
-    directory,
-    &perms,
-    is_subdirectory,
-    subscribe_sync_conn,
-    perform_sync_in,
-    sheet_set
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
   );
+}
 
-  if(!infd_directory_check_auth(directory, parent, connection, &perms, error))
-  {
-    if(sheet_set != NULL)
-      inf_acl_sheet_set_free(sheet_set);
-    xmlFree(type);
-    return FALSE;
-  }
+static InfdDirectorySessionRead*
+infd_directory_find_session_read(InfdDirectory* directory,
+                                 InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectorySessionRead* read;
+  GSList* item;
 
-  if(is_subdirectory == TRUE)
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  for(item = priv->session_reads; item != NULL; item = item->next)
   {
-    /* No plugin because we want to create a directory */
-    plugin = NULL;
-    xmlFree(type);
-    
-    /* TODO: Error if perform_sync_in or subscribe are set. Actually we
-     * could interpret subscribe as initially explored... */
+    read = (InfdDirectorySessionRead*)item->data;
+    if(read->node == node)
+      return read;
   }
-  else
-  {
-    plugin = g_hash_table_lookup(priv->plugins, (const gchar*)type);
-    xmlFree(type);
 
-    if(plugin == NULL)
-    {
-      if(sheet_set != NULL)
-        inf_acl_sheet_set_free(sheet_set);
+  return NULL;
+}
+
+static void
+infd_directory_session_read_free(InfdDirectorySessionRead* read)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectorySessionReadReply* reply;
+  InfSession* session;
+  GSList* item;
 
-      g_set_error_literal(
-        error,
-        inf_directory_error_quark(),
-        INF_DIRECTORY_ERROR_TYPE_UNKNOWN,
-        inf_directory_strerror(INF_DIRECTORY_ERROR_TYPE_UNKNOWN)
-      );
+  priv = INFD_DIRECTORY_PRIVATE(read->directory);
+  priv->session_reads = g_slist_remove(priv->session_reads, read);
 
-      return FALSE;
-    }
-  }
+  if(read->dispatch != NULL)
+    inf_io_remove_dispatch(priv->io, read->dispatch);
 
-  if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+  if(read->handle != NULL)
   {
-    if(sheet_set != NULL)
-      inf_acl_sheet_set_free(sheet_set);
-    return FALSE;
+    session = read->node->shared.note.plugin->session_read_end(read->handle);
+    if(session != NULL)
+      g_object_unref(session);
   }
 
-  name = inf_xml_util_get_attribute_required(xml, "name", error);
-  if(name == NULL)
+  for(item = read->replies; item != NULL; item = item->next)
   {
-    if(sheet_set != NULL)
-      inf_acl_sheet_set_free(sheet_set);
-    g_free(seq);
-    return FALSE;
+    reply = (InfdDirectorySessionReadReply*)item->data;
+    g_free(reply->seq);
+    g_slice_free(InfdDirectorySessionReadReply, reply);
   }
 
-  request = INFD_REQUEST(
-    g_object_new(
-      INFD_TYPE_REQUEST,
-      "type", "add-node",
-      "node-id", parent->id,
-      "requestor", connection,
-      NULL
-    )
-  );
+  g_slist_free(read->replies);
+  g_object_unref(read->request);
+  g_slice_free(InfdDirectorySessionRead, read);
+}
 
-  parent_iter.node_id = parent->id;
-  parent_iter.node = parent;
-  inf_browser_begin_request(
-    INF_BROWSER(directory),
-    &parent_iter,
-    INF_REQUEST(request)
-  );
+static void
+infd_directory_session_read_fail(InfdDirectorySessionRead* read,
+                                 GError* error)
+{
+  InfdDirectorySessionReadReply* reply;
+  GSList* item;
 
-  if(plugin == NULL)
+  for(item = read->replies; item != NULL; item = item->next)
   {
-    node = infd_directory_node_add_subdirectory(
-      directory,
-      parent,
-      request,
-      (const gchar*)name,
-      sheet_set,
-      connection,
-      seq,
+    reply = (InfdDirectorySessionReadReply*)item->data;
+
+    infd_directory_send_request_failed(
+      read->directory,
+      reply->connection,
+      reply->seq,
       error
     );
-
-    if(node == NULL)
-      node_added = FALSE;
-    else
-      node_added = TRUE;
   }
-  else
+
+  inf_request_fail(INF_REQUEST(read->request), error);
+  infd_directory_session_read_free(read);
+}
+
+/* Replies to the remote hosts waiting for the session once it has been read
+ * completely. */
+static void
+infd_directory_session_read_finish(InfdDirectorySessionRead* read)
+{
+  InfdDirectorySessionReadReply* reply;
+  InfSession* session;
+  InfdSessionProxy* proxy;
+  InfAclMask perms;
+  gboolean subscribed;
+  GError* error;
+  GSList* item;
+
+  session = read->node->shared.note.plugin->session_read_end(read->handle);
+  read->handle = NULL;
+  g_assert(session != NULL);
+
+  for(; read->current < read->total; ++read->current)
+    infd_progress_request_progress(read->request);
+
+  proxy = infd_directory_node_wrap_session(
+    read->directory,
+    read->node,
+    session
+  );
+
+  g_object_unref(session);
+
+  inf_acl_mask_set1(&perms, INF_ACL_CAN_SUBSCRIBE_SESSION);
+  subscribed = FALSE;
+  error = NULL;
+
+  for(item = read->replies; item != NULL; item = item->next)
   {
-    if(perform_sync_in == FALSE)
+    reply = (InfdDirectorySessionReadReply*)item->data;
+
+    /* The ACL might have changed while the session was being read */
+    if(error != NULL)
     {
-      node_added = infd_directory_node_add_note(
-        directory,
-        parent,
-        request,
-        (const gchar*)name,
-        sheet_set,
-        plugin,
-        NULL,
-        connection,
-        subscribe_sync_conn,
-        seq,
+      g_error_free(error);
+      error = NULL;
+    }
+
+    if(!infd_directory_check_auth(read->directory, read->node,
+                                  reply->connection, &perms, &error))
+    {
+      infd_directory_send_request_failed(
+        read->directory,
+        reply->connection,
+        reply->seq,
         error
       );
     }
     else
     {
-      node_added = infd_directory_node_add_sync_in(
-        directory,
-        parent,
-        request,
-        (const char*)name,
-        sheet_set,
-        plugin,
-        connection,
-        subscribe_sync_conn,
-        seq,
-        error
-      );
+      subscribed = TRUE;
 
-      /* Note: The sync-in can still fail for various reasons. Maybe the
-       * client doesn't support the communication method, the synchronization
-       * fails or the parent folder is removed. */
+      /* A freshly read session has a new identity, so the subscription can
+       * not be a resumed one. */
+      g_object_ref(proxy);
+
+      infd_directory_send_subscribe_session(
+        read->directory,
+        read->node,
+        reply->connection,
+        INFD_REQUEST(read->request),
+        proxy,
+        reply->seq,
+        NULL
+      );
     }
   }
 
-  g_object_unref(request);
+  /* The request is finished by the subscription requests otherwise */
+  if(subscribed == FALSE)
+  {
+    g_assert(error != NULL);
+    inf_request_fail(INF_REQUEST(read->request), error);
+  }
 
-  if(sheet_set != NULL)
-    inf_acl_sheet_set_free(sheet_set);
-  xmlFree(name);
-  g_free(seq);
+  if(error != NULL)
+    g_error_free(error);
 
-  return node_added;
+  g_object_unref(proxy);
+  infd_directory_session_read_free(read);
 }
 
+/* Performs the next step of reading the session. Returns FALSE if the read
+ * has been finished or failed, in which case read has been freed. */
 static gboolean
-infd_directory_handle_remove_node(InfdDirectory* directory,
-                                  InfXmlConnection* connection,
-                                  const xmlNodePtr xml,
-                                  GError** error)
+infd_directory_session_read_step(InfdDirectorySessionRead* read)
 {
-  InfdDirectoryNode* node;
-  gchar* seq;
-  InfdRequest* request;
-  InfBrowserIter iter;
+  GError* error;
   gboolean result;
+  guint step;
 
-  InfdDirectoryNode* up;
-  InfAclMask perms;
+  error = NULL;
+  step = 0;
 
-  node = infd_directory_get_node_from_xml(directory, xml, "id", error);
-  if(node == NULL) return FALSE;
+  result = read->node->shared.note.plugin->session_read_next(
+    read->handle,
+    &step,
+    &error
+  );
 
-  if(node->parent == NULL)
+  if(error != NULL)
   {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_ROOT_NODE_REMOVE_ATTEMPT,
-      _("The root node cannot be removed")
-    );
-
+    infd_directory_session_read_fail(read, error);
+    g_error_free(error);
     return FALSE;
   }
-  else
+
+  for(; read->current < MIN(step, read->total); ++read->current)
+    infd_progress_request_progress(read->request);
+
+  if(result == FALSE)
   {
-    /* Check the remove node permission on the parent node */
-    up = node->parent;
-    inf_acl_mask_set1(&perms, INF_ACL_CAN_REMOVE_NODE);
-    if(!infd_directory_check_auth(directory, up, connection, &perms, error))
-      return FALSE;
+    infd_directory_session_read_finish(read);
+    return FALSE;
+  }
 
-    if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
-      return FALSE;
+  return TRUE;
+}
 
-    request = INFD_REQUEST(
-      g_object_new(
-        INFD_TYPE_REQUEST,
-        "type", "remove-node",
-        "node-id", node->id,
-        "requestor", connection,
-        NULL
-      )
+static void
+infd_directory_session_read_dispatch_func(gpointer user_data)
+{
+  InfdDirectorySessionRead* read;
+  InfdDirectoryPrivate* priv;
+
+  read = (InfdDirectorySessionRead*)user_data;
+  priv = INFD_DIRECTORY_PRIVATE(read->directory);
+
+  read->dispatch = NULL;
+
+  if(infd_directory_session_read_step(read))
+  {
+    read->dispatch = inf_io_add_dispatch(
+      priv->io,
+      infd_directory_session_read_dispatch_func,
+      read,
+      NULL
     );
+  }
+}
+
+/* Reads the rest of the session immediately. */
+static void
+infd_directory_session_read_flush(InfdDirectorySessionRead* read)
+{
+  InfdDirectoryPrivate* priv;
+  gboolean result;
+
+  priv = INFD_DIRECTORY_PRIVATE(read->directory);
+
+  if(read->dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->io, read->dispatch);
+    read->dispatch = NULL;
+  }
+
+  do
+  {
+    result = infd_directory_session_read_step(read);
+  } while(result == TRUE);
+}
+
+/* Starts reading the session of node from the storage, one step per main
+ * loop iteration. The progress is reported on request. Remote hosts that
+ * should be replied to when the session has been read need to be added
+ * with infd_directory_session_read_add_reply(). */
+static InfdDirectorySessionRead*
+infd_directory_node_read_session(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfdProgressRequest* request,
+                                 GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  const InfdNotePlugin* plugin;
+  InfdDirectorySessionRead* read;
+  gpointer handle;
+  guint total;
+  gchar* path;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  plugin = node->shared.note.plugin;
+
+  g_assert(priv->storage != NULL);
+  g_assert(plugin->session_read_begin != NULL);
+  g_assert(node->shared.note.session == NULL);
+  g_assert(infd_directory_find_session_read(directory, node) == NULL);
+
+  infd_directory_node_get_path(node, &path, NULL);
+
+  handle = plugin->session_read_begin(
+    priv->storage,
+    priv->io,
+    priv->communication_manager,
+    path,
+    &total,
+    plugin->user_data,
+    error
+  );
+
+  g_free(path);
+  if(handle == NULL) return NULL;
+
+  read = g_slice_new(InfdDirectorySessionRead);
+  read->directory = directory;
+  read->node = node;
+  read->request = request;
+  read->handle = handle;
+  read->current = 0;
+  read->total = total;
+  read->replies = NULL;
+
+  g_object_ref(request);
+  infd_progress_request_initiated(request, total);
+
+  read->dispatch = inf_io_add_dispatch(
+    priv->io,
+    infd_directory_session_read_dispatch_func,
+    read,
+    NULL
+  );
+
+  priv->session_reads = g_slist_prepend(priv->session_reads, read);
+  return read;
+}
+
+static void
+infd_directory_session_read_add_reply(InfdDirectorySessionRead* read,
+                                      InfXmlConnection* connection,
+                                      const gchar* seq)
+{
+  InfdDirectorySessionReadReply* reply;
+
+  reply = g_slice_new(InfdDirectorySessionReadReply);
+  reply->connection = connection;
+  reply->seq = g_strdup(seq);
+
+  read->replies = g_slist_append(read->replies, reply);
+}
+
+static gboolean
+infd_directory_session_read_has_connection(InfdDirectorySessionRead* read,
+                                           InfXmlConnection* connection)
+{
+  InfdDirectorySessionReadReply* reply;
+  GSList* item;
+
+  for(item = read->replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectorySessionReadReply*)item->data;
+    if(reply->connection == connection)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Does not reply to connection when the session has been read. If nobody
+ * is waiting for the session anymore, then reading it is cancelled. The
+ * request is dropped in that case, as it is for subscription requests of
+ * connections that go away. */
+static void
+infd_directory_session_read_remove_connection(InfdDirectorySessionRead* read,
+                                              InfXmlConnection* connection)
+{
+  InfdDirectorySessionReadReply* reply;
+  GSList* item;
+
+  for(item = read->replies; item != NULL; item = item->next)
+  {
+    reply = (InfdDirectorySessionReadReply*)item->data;
+    if(reply->connection == connection)
+    {
+      read->replies = g_slist_delete_link(read->replies, item);
 
-    iter.node_id = node->id;
-    iter.node = node;
-    inf_browser_begin_request(
-      INF_BROWSER(directory),
-      &iter,
-      INF_REQUEST(request)
+      g_free(reply->seq);
+      g_slice_free(InfdDirectorySessionReadReply, reply);
+      break;
+    }
+  }
+
+  if(read->replies == NULL)
+    infd_directory_session_read_free(read);
+}
+
+/* Cancels reading the session of node, if it is being read. This needs to
+ * be done before the node is freed. */
+static void
+infd_directory_node_cancel_session_read(InfdDirectory* directory,
+                                        InfdDirectoryNode* node)
+{
+  InfdDirectorySessionRead* read;
+  GError* error;
+
+  read = infd_directory_find_session_read(directory, node);
+  if(read != NULL)
+  {
+    error = NULL;
+    g_set_error_literal(
+      &error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+      inf_directory_strerror(INF_DIRECTORY_ERROR_NO_SUCH_NODE)
     );
 
-    result = infd_directory_node_remove(directory, node, request, seq, error);
-    g_object_unref(request);
-    return result;
+    infd_directory_session_read_fail(read, error);
+    g_error_free(error);
   }
 }
 
@@ -5998,13 +7908,11 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
   InfAclMask perms;
   GSList* item;
   InfdDirectorySubreq* subreq;
+  InfdDirectorySessionRead* read;
   InfdSessionProxy* proxy;
   InfBrowserIter iter;
   InfdRequest* request;
-  InfCommunicationGroup* group;
-  const gchar* method;
   gchar* seq;
-  xmlNodePtr reply_xml;
   GError* local_error;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -6062,9 +7970,36 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
     proxy = node->shared.note.session;
   }
 
+  /* If the session is being read from storage already, then reply once it
+   * has been read. */
+  read = NULL;
+  if(proxy == NULL)
+  {
+    read = infd_directory_find_session_read(directory, node);
+    if(read != NULL &&
+       infd_directory_session_read_has_connection(read, connection))
+    {
+      g_set_error_literal(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_ALREADY_SUBSCRIBED,
+        inf_directory_strerror(INF_DIRECTORY_ERROR_ALREADY_SUBSCRIBED)
+      );
+
+      return FALSE;
+    }
+  }
+
   if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
     return FALSE;
 
+  if(read != NULL)
+  {
+    infd_directory_session_read_add_reply(read, connection, seq);
+    g_free(seq);
+    return TRUE;
+  }
+
   /* Make a new request if there is no request yet and we don't have a proxy
    * already. If we do have a proxy, then we don't have to read anything from
    * storage. */
@@ -6072,7 +8007,7 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
   {
     request = INFD_REQUEST(
       g_object_new(
-        INFD_TYPE_REQUEST,
+        INFD_TYPE_PROGRESS_REQUEST,
         "type", "subscribe-session",
         "node-id", node->id,
         "requestor", connection,
@@ -6097,7 +8032,37 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
   if(proxy == NULL)
   {
     local_error = NULL;
-    proxy = infd_directory_node_make_session(directory, node, &local_error);
+
+    if(node->shared.note.session == NULL &&
+       node->shared.note.plugin->session_read_begin != NULL)
+    {
+      /* Read the session in the background, and reply when it is done, so
+       * that reading a large session does not block the server. */
+      read = infd_directory_node_read_session(
+        directory,
+        node,
+        INFD_PROGRESS_REQUEST(request),
+        &local_error
+      );
+
+      if(read != NULL)
+      {
+        infd_directory_session_read_add_reply(read, connection, seq);
+        g_object_unref(request);
+        g_free(seq);
+        return TRUE;
+      }
+    }
+    else
+    {
+      proxy = infd_directory_node_make_session(
+        directory,
+        node,
+        request,
+        &local_error
+      );
+    }
+
     if(proxy == NULL)
     {
       /* Only if we have already a proxy we could not have a request here */
@@ -6114,53 +8079,20 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
     g_object_ref(proxy);
   }
 
-  g_object_get(G_OBJECT(proxy), "subscription-group", &group, NULL);
-  method = inf_communication_group_get_method_for_connection(
-    group,
-    connection
-  );
-
-  /* We should always be able to fallback to "central" */
-  g_assert(method != NULL);
-
-  /* Reply that subscription was successful (so far, synchronization may
-   * still fail) and tell identifier. */
-  reply_xml = xmlNewNode(NULL, (const xmlChar*)"subscribe-session");
-
-  xmlNewProp(
-    reply_xml,
-    (const xmlChar*)"group",
-    (const xmlChar*)inf_communication_group_get_name(group)
-  );
-
-  xmlNewProp(
-    reply_xml,
-    (const xmlChar*)"method",
-    (const xmlChar*)method
-  );
-
-  g_object_unref(group);
-  inf_xml_util_set_attribute_uint(reply_xml, "id", node->id);
-  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
-
   /* This gives ownership of proxy to the subscription request */
-  infd_directory_add_subreq_session(
+  infd_directory_send_subscribe_session(
     directory,
+    node,
     connection,
     request,
-    node->id,
-    proxy
+    proxy,
+    seq,
+    infd_directory_get_resume_vector(proxy, xml)
   );
 
   if(request != NULL)
     g_object_unref(request);
 
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    connection,
-    reply_xml
-  );
-
   g_free(seq);
   return TRUE;
 }
@@ -6245,6 +8177,8 @@ infd_directory_handle_save_session(InfdDirectory* directory,
 
   /* TODO: Make a request */
 
+  infd_directory_node_cancel_save(node);
+
   result = node->shared.note.plugin->session_write(
     priv->storage,
     session,
@@ -6959,6 +8893,9 @@ infd_directory_handle_query_acl(InfdDirectory* directory,
   if(!infd_directory_check_auth(directory, node, connection, &perms, error))
     return FALSE;
 
+  if(!infd_directory_node_load_acl(directory, node, error))
+    return FALSE;
+
   if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
     return FALSE;
 
@@ -7046,6 +8983,11 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
   if(!infd_directory_check_auth(directory, node, connection, &perms, error))
     return FALSE;
 
+  /* The new sheets are merged into the current ACL, so it needs to be
+   * known before it is written back to the storage. */
+  if(!infd_directory_node_load_acl(directory, node, error))
+    return FALSE;
+
   /* TODO: Introduce inf_acl_sheet_set_from_xml_required */
   local_error = NULL;
   sheet_set = infd_directory_sheet_set_from_xml(directory, xml, &local_error);
@@ -7182,6 +9124,41 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
   return TRUE;
 }
 
+/* Lets the session of proxy send request batches to connection if the
+ * client announced in its subscribe-ack that it understands them. Old
+ * clients do not set the attribute and keep receiving single requests. */
+static void
+infd_directory_enable_request_batching(InfdSessionProxy* proxy,
+                                       InfXmlConnection* connection,
+                                       xmlNodePtr xml)
+{
+  InfSession* session;
+  xmlChar* batching;
+
+  /* Resuming the subscription might have failed */
+  if(!infd_session_proxy_is_subscribed(proxy, connection)) return;
+
+  batching = inf_xml_util_get_attribute(xml, "request-batching");
+  if(batching == NULL) return;
+
+  if(strcmp((const char*)batching, "true") == 0)
+  {
+    g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+    if(INF_ADOPTED_IS_SESSION(session))
+    {
+      inf_adopted_session_add_batching_connection(
+        INF_ADOPTED_SESSION(session),
+        connection
+      );
+    }
+
+    g_object_unref(session);
+  }
+
+  xmlFree(batching);
+}
+
 static gboolean
 infd_directory_handle_subscribe_ack(InfdDirectory* directory,
                                     InfXmlConnection* connection,
@@ -7359,11 +9336,29 @@ infd_directory_handle_subscribe_ack(InfdDirectory* directory,
         g_error_free(local_error);
     }
 
-    infd_session_proxy_subscribe_to(
+    if(subreq->shared.session.resume_vector != NULL)
+    {
+      infd_session_proxy_resume_to(
+        subreq->shared.session.session,
+        connection,
+        info->seq_id,
+        subreq->shared.session.resume_vector
+      );
+    }
+    else
+    {
+      infd_session_proxy_subscribe_to(
+        subreq->shared.session.session,
+        connection,
+        info->seq_id,
+        TRUE
+      );
+    }
+
+    infd_directory_enable_request_batching(
       subreq->shared.session.session,
       connection,
-      info->seq_id,
-      TRUE
+      xml
     );
 
     break;
@@ -7500,6 +9495,7 @@ infd_directory_handle_subscribe_ack(InfdDirectory* directory,
     /* Don't sync session to client if the client added this node, since the
      * node is empty anyway. */
     infd_session_proxy_subscribe_to(proxy, connection, info->seq_id, FALSE);
+    infd_directory_enable_request_batching(proxy, connection, xml);
     g_object_unref(proxy);
 
     break;
@@ -7613,6 +9609,7 @@ infd_directory_handle_subscribe_ack(InfdDirectory* directory,
       /* subscribe_to adds connection to subscription group which is the
        * same as the synchronization group. */
       infd_session_proxy_subscribe_to(proxy, connection, info->seq_id, FALSE);
+      infd_directory_enable_request_batching(proxy, connection, xml);
     }
 
     g_object_unref(proxy);
@@ -7817,6 +9814,7 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
   InfdDirectorySyncIn* sync_in;
   InfXmlConnection* sync_in_connection;
   InfdDirectorySubreq* request;
+  InfdDirectorySessionRead* read;
   InfdDirectoryConnectionInfo* info;
 
   directory = INFD_DIRECTORY(user_data);
@@ -7854,6 +9852,26 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
       infd_directory_remove_subreq(directory, request);
   }
 
+  /* Do not reply to explore requests of this connection */
+  for(item = priv->explores; item != NULL; item = item->next)
+  {
+    infd_directory_explore_remove_connection(
+      (InfdDirectoryExplore*)item->data,
+      connection
+    );
+  }
+
+  /* Do not reply to subscription requests of this connection for sessions
+   * that are still being read */
+  item = priv->session_reads;
+  while(item != NULL)
+  {
+    read = (InfdDirectorySessionRead*)item->data;
+    item = item->next;
+
+    infd_directory_session_read_remove_connection(read, connection);
+  }
+
   if(priv->root != NULL)
   {
     if(priv->root->shared.subdir.explored == TRUE)
@@ -7926,11 +9944,53 @@ infd_directory_set_storage(InfdDirectory* directory,
 {
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* child;
+  InfdDirectoryExplore* explore;
+  InfdDirectoryExplore* root_explore;
+  GSList* item;
+  GSList* next;
   GError* error;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
   g_assert(priv->root != NULL);
 
+  /* Explorations in progress refer to the old storage. Nodes that have been
+   * read already are registered right away. If the root node is still being
+   * read, then it is read again from the new storage below. Other nodes are
+   * removed anyway when there is a new storage. */
+  root_explore = NULL;
+  for(item = priv->explores; item != NULL; item = next)
+  {
+    next = item->next;
+    explore = (InfdDirectoryExplore*)item->data;
+
+    if(explore->operation == NULL)
+    {
+      infd_directory_explore_flush(explore);
+    }
+    else if(storage != NULL)
+    {
+      if(explore->node == priv->root)
+      {
+        inf_async_operation_free(explore->operation);
+        explore->operation = NULL;
+        root_explore = explore;
+      }
+    }
+    else
+    {
+      error = NULL;
+      g_set_error_literal(
+        &error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NO_STORAGE,
+        inf_directory_strerror(INF_DIRECTORY_ERROR_NO_STORAGE)
+      );
+
+      infd_directory_explore_fail(explore, error);
+      g_error_free(error);
+    }
+  }
+
   /* If we are setting a new storage, then remove all documents. If we are
    * going to no storage, then keep current set of documents. */
   if(storage != NULL)
@@ -7958,6 +10018,12 @@ infd_directory_set_storage(InfdDirectory* directory,
       }
     }
   }
+  else if(priv->storage != NULL)
+  {
+    /* ACLs that have not been read yet cannot be read anymore once the
+     * storage is gone. */
+    infd_directory_node_load_all_acls(directory, priv->root);
+  }
 
   if(priv->storage != NULL)
     g_object_unref(priv->storage);
@@ -7971,29 +10037,29 @@ infd_directory_set_storage(InfdDirectory* directory,
      * then we keep the previous ACL for the root node. */
     infd_directory_read_root_acl(directory);
 
-    /* root folder was explored before storage change, so keep it
-     * explored. */
-    if(priv->root->shared.subdir.explored == TRUE)
+    error = NULL;
+    if(root_explore != NULL)
     {
-      /* Need to set explored flag to FALSE to meet preconditions of
-       * infd_directory_node_explore(). */
-      priv->root->shared.subdir.explored = FALSE;
-
-      /* Do not make a request here, since we don't formally re-explore the
-       * root node -- once a node is explored, it always stays explored. */
-
-      error = NULL;
+      if(!infd_directory_explore_start(root_explore, &error))
+        infd_directory_explore_fail(root_explore, error);
+    }
+    else if(priv->root->shared.subdir.explored == TRUE)
+    {
+      /* root folder was explored before storage change, so keep it
+       * explored, and read its content from the new storage. Do not make a
+       * request here, since we don't formally re-explore the root node --
+       * once a node is explored, it always stays explored. */
       infd_directory_node_explore(directory, priv->root, NULL, &error);
+    }
 
-      if(error != NULL)
-      {
-        g_warning(
-          _("Failed to explore the root directory of the new storage: %s"),
-          error->message
-        );
+    if(error != NULL)
+    {
+      g_warning(
+        _("Failed to explore the root directory of the new storage: %s"),
+        error->message
+      );
 
-        g_error_free(error);
-      }
+      g_error_free(error);
     }
 
     g_object_ref(storage);
@@ -8522,6 +10588,8 @@ static void
 infd_directory_init(InfdDirectory* directory)
 {
   InfdDirectoryPrivate* priv;
+  InfAclSheet* sheet;
+
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
   priv->io = NULL;
@@ -8559,10 +10627,32 @@ infd_directory_init(InfdDirectory* directory)
   );
 
   priv->orig_root_acl = NULL;
+
+  /* Denies everything to everyone */
+  priv->unreadable_acl = inf_acl_sheet_set_new();
+  sheet = inf_acl_sheet_set_add_sheet(
+    priv->unreadable_acl,
+    inf_acl_account_id_from_string("default")
+  );
+
+  sheet->mask = INF_ACL_MASK_ALL;
+
+  priv->explores = NULL;
+  priv->session_reads = NULL;
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
 
   priv->chat_session = NULL;
+
+  priv->memory_budget = 0;
+  priv->memory_timeout = NULL;
+
+  priv->send_queue_limit = 0;
+  priv->slow_consumer_policy = INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT;
+  priv->send_queue_timeout = NULL;
+  priv->send_queue_dispatch = NULL;
+
+  priv->loop_pool = NULL;
 }
 
 static void
@@ -8603,6 +10693,13 @@ infd_directory_constructed(GObject* object)
     INF_COMMUNICATION_OBJECT(directory)
   );
 
+  g_signal_connect(
+    G_OBJECT(priv->communication_manager),
+    "queue-size-exceeded",
+    G_CALLBACK(infd_directory_queue_size_exceeded_cb),
+    directory
+  );
+
   /* If we don't have a background storage then the root node has been
    * explored (there is simply no content yet, it has to be added via
    * infd_directory_add_note). */
@@ -8636,6 +10733,7 @@ infd_directory_dispose(GObject* object)
 {
   InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* child;
   GHashTableIter iter;
   gpointer key;
 
@@ -8655,6 +10753,7 @@ infd_directory_dispose(GObject* object)
   
   g_assert(g_hash_table_size(priv->connections) == 0);
   g_assert(priv->subscription_requests == NULL);
+  g_assert(priv->session_reads == NULL);
   g_assert(priv->sync_ins == NULL);
 
   /* We have dropped all references to connections now, so these do not try
@@ -8669,6 +10768,24 @@ infd_directory_dispose(GObject* object)
   if(priv->chat_session != NULL)
     infd_directory_enable_chat(directory, FALSE);
 
+  if(priv->memory_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->memory_timeout);
+    priv->memory_timeout = NULL;
+  }
+
+  if(priv->send_queue_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->send_queue_timeout);
+    priv->send_queue_timeout = NULL;
+  }
+
+  if(priv->send_queue_dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->io, priv->send_queue_dispatch);
+    priv->send_queue_dispatch = NULL;
+  }
+
   /* This frees the complete directory tree and saves sessions into the
    * storage. */
   infd_directory_node_unlink_child_sessions(
@@ -8678,6 +10795,14 @@ infd_directory_dispose(GObject* object)
     TRUE
   );
 
+  /* Free the tree before removing the storage, so that ACLs which have not
+   * been read yet are not read just to be thrown away. */
+  if(priv->root->shared.subdir.explored == TRUE)
+  {
+    while((child = priv->root->shared.subdir.child) != NULL)
+      infd_directory_node_free(directory, child);
+  }
+
   infd_directory_set_storage(directory, NULL);
   infd_directory_set_account_storage(directory, NULL);
 
@@ -8696,6 +10821,13 @@ infd_directory_dispose(GObject* object)
   priv->nodes = NULL;
 
   g_object_unref(priv->group);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(priv->communication_manager),
+    G_CALLBACK(infd_directory_queue_size_exceeded_cb),
+    directory
+  );
+
   g_object_unref(priv->communication_manager);
 
   g_hash_table_destroy(priv->connections);
@@ -8710,6 +10842,12 @@ infd_directory_dispose(GObject* object)
     priv->certificate = NULL;
   }
 
+  if(priv->loop_pool != NULL)
+  {
+    g_object_unref(priv->loop_pool);
+    priv->loop_pool = NULL;
+  }
+
   if(priv->io != NULL)
   {
     g_object_unref(G_OBJECT(priv->io));
@@ -8736,6 +10874,8 @@ infd_directory_finalize(GObject* object)
   }
   g_free(priv->transient_accounts);
 
+  inf_acl_sheet_set_free(priv->unreadable_acl);
+
   G_OBJECT_CLASS(infd_directory_parent_class)->finalize(object);
 }
 
@@ -8783,8 +10923,28 @@ infd_directory_set_property(GObject* object,
     break;
   case PROP_CERTIFICATE:
     priv->certificate = (InfCertificateChain*)g_value_dup_boxed(value);
+    break;
+  case PROP_MEMORY_BUDGET:
+    infd_directory_set_memory_budget(directory, g_value_get_uint64(value));
+    break;
+  case PROP_SEND_QUEUE_LIMIT:
+    infd_directory_set_send_queue_limit(directory, g_value_get_uint64(value));
+    break;
+  case PROP_SLOW_CONSUMER_POLICY:
+    infd_directory_set_slow_consumer_policy(
+      directory,
+      g_value_get_enum(value)
+    );
+    break;
+  case PROP_LOOP_POOL:
+    infd_directory_set_loop_pool(
+      directory,
+      INFD_LOOP_POOL(g_value_get_object(value))
+    );
+
     break;
   case PROP_CHAT_SESSION:
+  case PROP_MEMORY_USAGE:
   case PROP_STATUS:
     /* read only */
   default:
@@ -8827,6 +10987,25 @@ infd_directory_get_property(GObject* object,
     break;
   case PROP_CHAT_SESSION:
     g_value_set_object(value, G_OBJECT(priv->chat_session));
+    break;
+  case PROP_MEMORY_BUDGET:
+    g_value_set_uint64(value, priv->memory_budget);
+    break;
+  case PROP_SEND_QUEUE_LIMIT:
+    g_value_set_uint64(value, priv->send_queue_limit);
+    break;
+  case PROP_SLOW_CONSUMER_POLICY:
+    g_value_set_enum(value, priv->slow_consumer_policy);
+    break;
+  case PROP_LOOP_POOL:
+    g_value_set_object(value, priv->loop_pool);
+    break;
+  case PROP_MEMORY_USAGE:
+    g_value_set_uint64(
+      value,
+      infd_directory_compute_memory_usage(directory, NULL)
+    );
+
     break;
   case PROP_STATUS:
     g_value_set_enum(value, INF_BROWSER_OPEN);
@@ -9265,6 +11444,7 @@ infd_directory_browser_explore(InfBrowser* browser,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfdProgressRequest* request;
+  InfdDirectoryExplore* explore;
 
   directory = INFD_DIRECTORY(browser);
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -9274,6 +11454,10 @@ infd_directory_browser_explore(InfBrowser* browser,
   node = (InfdDirectoryNode*)iter->node;
   g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY, NULL);
   g_return_val_if_fail(node->shared.subdir.explored == FALSE, NULL);
+  g_return_val_if_fail(
+    inf_browser_get_pending_request(browser, iter, "explore-node") == NULL,
+    NULL
+  );
 
   request = g_object_new(
     INFD_TYPE_PROGRESS_REQUEST,
@@ -9295,7 +11479,7 @@ infd_directory_browser_explore(InfBrowser* browser,
 
   inf_browser_begin_request(browser, iter, INF_REQUEST(request));
 
-  infd_directory_node_explore(
+  explore = infd_directory_node_explore(
     directory,
     node,
     request,
@@ -9303,7 +11487,14 @@ infd_directory_browser_explore(InfBrowser* browser,
   );
 
   g_object_unref(request);
-  return NULL;
+
+  /* The request has failed already if the exploration could not be
+   * started. Otherwise, the exploration keeps it alive until it has
+   * finished. */
+  if(explore == NULL)
+    return NULL;
+
+  return INF_REQUEST(request);
 }
 
 static gboolean
@@ -9569,6 +11760,7 @@ infd_directory_browser_subscribe(InfBrowser* browser,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfdDirectorySubreq* subreq;
+  InfdDirectorySessionRead* read;
   InfdRequest* request;
   InfdSessionProxy* proxy;
   GSList* item;
@@ -9587,6 +11779,13 @@ infd_directory_browser_subscribe(InfBrowser* browser,
     NULL
   );
 
+  /* If the session is being read from storage for remote subscriptions,
+   * then finish reading it right away. This turns the read into
+   * subreqs, which are handled below. */
+  read = infd_directory_find_session_read(directory, node);
+  if(read != NULL)
+    infd_directory_session_read_flush(read);
+
   /* See whether there is a subreq for this node. If yes, take the request
    * from there instead of creating a new one. Note that this usually does
    * not happen, since clients will ask for pending requests first, and if
@@ -9623,7 +11822,7 @@ infd_directory_browser_subscribe(InfBrowser* browser,
   else
   {
     request = g_object_new(
-      INFD_TYPE_REQUEST,
+      INFD_TYPE_PROGRESS_REQUEST,
       "type", "subscribe-session",
       "node-id", node->id,
       "requestor", NULL,
@@ -9681,7 +11880,12 @@ infd_directory_browser_subscribe(InfBrowser* browser,
   error = NULL;
   if(proxy == NULL)
   {
-    proxy = infd_directory_node_make_session(directory, node, &error);
+    proxy = infd_directory_node_make_session(
+      directory,
+      node,
+      request,
+      &error
+    );
   }
 
   if(proxy != NULL)
@@ -9745,6 +11949,7 @@ infd_directory_browser_list_pending_requests(InfBrowser* browser,
   InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
+  InfdDirectoryExplore* explore;
   InfdDirectorySubreq* subreq;
   InfRequest* request;
   gchar* type;
@@ -9763,6 +11968,14 @@ infd_directory_browser_list_pending_requests(InfBrowser* browser,
   }
 
   list = NULL;
+  if(iter != NULL &&
+     (request_type == NULL || strcmp(request_type, "explore-node") == 0))
+  {
+    explore = infd_directory_find_explore(directory, node);
+    if(explore != NULL && explore->request != NULL)
+      list = g_slist_prepend(list, explore->request);
+  }
+
   for(item = priv->subscription_requests; item != NULL; item = item->next)
   {
     request = NULL;
@@ -10357,9 +12570,9 @@ infd_directory_browser_query_acl(InfBrowser* browser,
                                  InfRequestFunc func,
                                  gpointer user_data)
 {
-  /* We always have the full ACL since we read it directly with the
-   * exploration of a node. Therefore, there is nothing to query and the
-   * full ACL is available with inf_browser_get_acl(). */
+  /* We always have the full ACL since we read it from the storage as soon
+   * as it is needed. Therefore, there is nothing to query and the full ACL
+   * is available with inf_browser_get_acl(). */
   g_return_val_if_reached(NULL);
   return NULL;
 }
@@ -10387,7 +12600,7 @@ infd_directory_browser_get_acl(InfBrowser* browser,
   infd_directory_return_val_if_iter_fail(directory, iter, NULL);
   node = (InfdDirectoryNode*)iter->node;
 
-  return node->acl;
+  return infd_directory_node_get_acl(directory, node);
 }
 
 static InfRequest*
@@ -10432,7 +12645,8 @@ infd_directory_browser_set_acl(InfBrowser* browser,
   inf_browser_begin_request(browser, iter, INF_REQUEST(request));
 
   error = NULL;
-  if(infd_directory_verify_sheet_set(directory, sheet_set, &error) != TRUE)
+  if(infd_directory_verify_sheet_set(directory, sheet_set, &error) != TRUE ||
+     infd_directory_node_load_acl(directory, node, &error) != TRUE)
   {
     inf_request_fail(INF_REQUEST(request), error);
     g_object_unref(request);
@@ -10599,6 +12813,76 @@ infd_directory_class_init(InfdDirectoryClass* directory_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_MEMORY_BUDGET,
+    g_param_spec_uint64(
+      "memory-budget",
+      "Memory budget",
+      "The number of bytes that sessions may use before idle sessions are "
+      "removed from memory early, or 0 for no limit",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SEND_QUEUE_LIMIT,
+    g_param_spec_uint64(
+      "send-queue-limit",
+      "Send queue limit",
+      "The number of bytes that may wait to be sent to a connection "
+      "before the slow consumer policy is applied, or 0 for no limit",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SLOW_CONSUMER_POLICY,
+    g_param_spec_enum(
+      "slow-consumer-policy",
+      "Slow consumer policy",
+      "What to do with connections exceeding the send queue limit",
+      INFD_TYPE_DIRECTORY_SLOW_CONSUMER_POLICY,
+      INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_LOOP_POOL,
+    g_param_spec_object(
+      "loop-pool",
+      "Loop pool",
+      "The pool of event loops in which requests to sessions are executed, "
+      "or NULL to execute them in the main loop",
+      INFD_TYPE_LOOP_POOL,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MEMORY_USAGE,
+    g_param_spec_uint64(
+      "memory-usage",
+      "Memory usage",
+      "The estimated number of bytes used by the sessions in memory",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfdDirectory::connection-added:
    * @directory: The #InfdDirectory emitting the signal.
@@ -11096,6 +13380,7 @@ infd_directory_add_connection(InfdDirectory* directory,
   info = g_slice_new(InfdDirectoryConnectionInfo);
   info->seq_id = seq_id;
   info->account_id = 0;
+  info->throttled = FALSE;
 
   g_hash_table_insert(priv->connections, connection, info);
   g_object_ref(connection);
@@ -11343,6 +13628,8 @@ infd_directory_iter_save_session(InfdDirectory* directory,
     NULL
   );
 
+  infd_directory_node_cancel_save(node);
+
   result = node->shared.note.plugin->session_write(
     priv->storage,
     session,
@@ -11358,6 +13645,125 @@ infd_directory_iter_save_session(InfdDirectory* directory,
   return result;
 }
 
+/**
+ * infd_directory_iter_save_session_async:
+ * @directory: A #InfdDirectory.
+ * @iter: A #InfBrowserIter pointing to a note in @directory.
+ * @func: (scope async): Function to call when the session has been saved.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information.
+ *
+ * Attempts to store the session the node @iter points to into the
+ * background storage, like infd_directory_iter_save_session(), but without
+ * blocking the main loop. A snapshot of the session is taken when this
+ * function is called, and written to the storage in a worker thread. The
+ * session can be modified while the snapshot is written. When the snapshot
+ * has been stored, or storing it failed, @func is called.
+ *
+ * If the note plugin of the node does not support asynchronous saving, the
+ * session is saved synchronously, and @func is called before this function
+ * returns.
+ *
+ * If another save of the same session is started, or the node is removed,
+ * before the save has finished, then the save is cancelled and @func is
+ * called with an error of code %INF_DIRECTORY_ERROR_SAVE_CANCELLED.
+ *
+ * If the save cannot be started, the function returns %FALSE, @error is set
+ * and @func is not called. Otherwise, @func is called exactly once.
+ *
+ * Returns: %TRUE if the operation was started, %FALSE otherwise.
+ */
+gboolean
+infd_directory_iter_save_session_async(InfdDirectory* directory,
+                                       const InfBrowserIter* iter,
+                                       InfdDirectorySaveSessionFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfdDirectorySaveSessionData* data;
+  gchar* path;
+  InfSession* session;
+  GError* write_error;
+
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), FALSE);
+  infd_directory_return_val_if_iter_fail(directory, iter, FALSE);
+  g_return_val_if_fail(func != NULL, FALSE);
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node = (InfdDirectoryNode*)iter->node;
+  g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_NOTE, FALSE);
+
+  if(priv->storage == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_STORAGE,
+      _("No background storage available")
+    );
+
+    return FALSE;
+  }
+
+  if(node->shared.note.plugin->session_write_async == NULL)
+  {
+    write_error = NULL;
+    if(!infd_directory_iter_save_session(directory, iter, &write_error))
+    {
+      func(directory, iter, write_error, user_data);
+      g_error_free(write_error);
+    }
+    else
+    {
+      func(directory, iter, NULL, user_data);
+    }
+
+    return TRUE;
+  }
+
+  infd_directory_node_get_path(node, &path, NULL);
+
+  g_object_get(
+    G_OBJECT(node->shared.note.session),
+    "session", &session,
+    NULL
+  );
+
+  /* The new snapshot supersedes a save that is still in progress */
+  infd_directory_node_cancel_save(node);
+
+  data = g_slice_new(InfdDirectorySaveSessionData);
+  data->directory = directory;
+  data->node = node;
+  data->func = func;
+  data->user_data = user_data;
+
+  data->operation = node->shared.note.plugin->session_write_async(
+    priv->storage,
+    priv->io,
+    session,
+    path,
+    infd_directory_save_session_write_func,
+    data,
+    node->shared.note.plugin->user_data,
+    error
+  );
+
+  g_object_unref(session);
+  g_free(path);
+
+  if(data->operation == NULL)
+  {
+    g_slice_free(InfdDirectorySaveSessionData, data);
+    return FALSE;
+  }
+
+  node->shared.note.save = data;
+  return TRUE;
+}
+
 /**
  * infd_directory_enable_chat:
  * @directory: A #InfdDirectory.
@@ -11481,6 +13887,268 @@ infd_directory_get_chat_session(InfdDirectory* directory)
   return INFD_DIRECTORY_PRIVATE(directory)->chat_session;
 }
 
+/**
+ * infd_directory_set_memory_budget:
+ * @directory: A #InfdDirectory.
+ * @budget: The number of bytes that sessions may use, or 0 for no limit.
+ *
+ * Sets a limit on the memory that the sessions in @directory may use, as
+ * estimated by inf_session_get_memory_usage(). If the sessions use more
+ * than that, then sessions without subscriptions are saved and removed from
+ * memory right away instead of after a timeout, least recently active
+ * first. They are read from the storage again when someone subscribes to
+ * them. Sessions with subscriptions are never removed from memory, so the
+ * actual usage, see infd_directory_get_memory_usage(), can exceed the
+ * budget. The usage is checked periodically.
+ */
+void
+infd_directory_set_memory_budget(InfdDirectory* directory,
+                                 guint64 budget)
+{
+  InfdDirectoryPrivate* priv;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  priv->memory_budget = budget;
+
+  if(budget == 0 && priv->memory_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->memory_timeout);
+    priv->memory_timeout = NULL;
+  }
+  else if(budget > 0 && priv->memory_timeout == NULL)
+  {
+    priv->memory_timeout = inf_io_add_timeout(
+      priv->io,
+      INFD_DIRECTORY_MEMORY_CHECK_INTERVAL,
+      infd_directory_memory_timeout_func,
+      directory,
+      NULL
+    );
+  }
+
+  infd_directory_enforce_memory_budget(directory);
+  g_object_notify(G_OBJECT(directory), "memory-budget");
+}
+
+/**
+ * infd_directory_get_memory_budget:
+ * @directory: A #InfdDirectory.
+ *
+ * Returns the memory budget of @directory, see
+ * infd_directory_set_memory_budget().
+ *
+ * Returns: The memory budget in bytes, or 0 if there is no limit.
+ */
+guint64
+infd_directory_get_memory_budget(InfdDirectory* directory)
+{
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), 0);
+  return INFD_DIRECTORY_PRIVATE(directory)->memory_budget;
+}
+
+/**
+ * infd_directory_get_memory_usage:
+ * @directory: A #InfdDirectory.
+ *
+ * Returns the estimated number of bytes used by the sessions that
+ * @directory keeps in memory, see inf_session_get_memory_usage(). This is
+ * computed on every call, so it is not meant to be called very often. No
+ * notification is emitted when it changes.
+ *
+ * Returns: The memory used by the sessions of @directory, in bytes.
+ */
+guint64
+infd_directory_get_memory_usage(InfdDirectory* directory)
+{
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), 0);
+  return infd_directory_compute_memory_usage(directory, NULL);
+}
+
+/**
+ * infd_directory_set_send_queue_limit:
+ * @directory: A #InfdDirectory.
+ * @limit: The maximum number of bytes waiting to be sent to a connection,
+ * or 0.
+ *
+ * Limits the amount of data that may wait to be sent to a single
+ * connection of @directory, as reported by
+ * inf_communication_manager_get_queue_size(). Messages queue up for
+ * connections which do not read fast enough, for example because of a slow
+ * network link, or a client that has stopped reading altogether. If more
+ * than @limit bytes are waiting for a connection, then the policy set with
+ * infd_directory_set_slow_consumer_policy() is applied.
+ *
+ * The policy is applied in the main loop iteration after the backlog of a
+ * connection grew beyond the limit. For this, the limit is also set on the
+ * #InfCommunicationManager of @directory with
+ * inf_communication_manager_set_queue_size_limit(). In addition, the queues
+ * are checked periodically, which lets throttled connections be read from
+ * again once they have caught up. If @limit is 0, then there is no limit,
+ * and throttled connections are read from again.
+ */
+void
+infd_directory_set_send_queue_limit(InfdDirectory* directory,
+                                    guint64 limit)
+{
+  InfdDirectoryPrivate* priv;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  priv->send_queue_limit = limit;
+
+  inf_communication_manager_set_queue_size_limit(
+    priv->communication_manager,
+    (gsize)MIN(limit, G_MAXSIZE)
+  );
+
+  if(limit == 0 && priv->send_queue_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->send_queue_timeout);
+    priv->send_queue_timeout = NULL;
+  }
+  else if(limit > 0 && priv->send_queue_timeout == NULL)
+  {
+    priv->send_queue_timeout = inf_io_add_timeout(
+      priv->io,
+      INFD_DIRECTORY_SEND_QUEUE_CHECK_INTERVAL,
+      infd_directory_send_queue_timeout_func,
+      directory,
+      NULL
+    );
+  }
+
+  infd_directory_enforce_send_queue_limit(directory);
+  g_object_notify(G_OBJECT(directory), "send-queue-limit");
+}
+
+/**
+ * infd_directory_get_send_queue_limit:
+ * @directory: A #InfdDirectory.
+ *
+ * Returns the send queue limit of @directory, see
+ * infd_directory_set_send_queue_limit().
+ *
+ * Returns: The maximum number of bytes waiting to be sent to a connection,
+ * or 0 if there is no limit.
+ */
+guint64
+infd_directory_get_send_queue_limit(InfdDirectory* directory)
+{
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), 0);
+  return INFD_DIRECTORY_PRIVATE(directory)->send_queue_limit;
+}
+
+/**
+ * infd_directory_set_slow_consumer_policy:
+ * @directory: A #InfdDirectory.
+ * @policy: What to do with connections exceeding the send queue limit.
+ *
+ * Sets what @directory does with connections that have more bytes
+ * waiting to be sent to them than allowed by
+ * infd_directory_set_send_queue_limit().
+ *
+ * With %INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT such connections are
+ * closed. With %INFD_DIRECTORY_SLOW_CONSUMER_THROTTLE, no more data is read
+ * from them until their queue has drained to half the limit, so that they
+ * cannot make the server produce even more output for themselves. If the
+ * queue grows to twice the limit anyway, then the connection is closed.
+ * Connections which do not support throttling, see
+ * inf_xml_connection_supports_throttling(), are always closed.
+ */
+void
+infd_directory_set_slow_consumer_policy(InfdDirectory* directory,
+                                        InfdDirectorySlowConsumerPolicy policy)
+{
+  InfdDirectoryPrivate* priv;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->slow_consumer_policy != policy)
+  {
+    priv->slow_consumer_policy = policy;
+    g_object_notify(G_OBJECT(directory), "slow-consumer-policy");
+  }
+}
+
+/**
+ * infd_directory_get_slow_consumer_policy:
+ * @directory: A #InfdDirectory.
+ *
+ * Returns the slow consumer policy of @directory, see
+ * infd_directory_set_slow_consumer_policy().
+ *
+ * Returns: What @directory does with connections exceeding the send queue
+ * limit.
+ */
+InfdDirectorySlowConsumerPolicy
+infd_directory_get_slow_consumer_policy(InfdDirectory* directory)
+{
+  g_return_val_if_fail(
+    INFD_IS_DIRECTORY(directory),
+    INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT
+  );
+
+  return INFD_DIRECTORY_PRIVATE(directory)->slow_consumer_policy;
+}
+
+/**
+ * infd_directory_set_loop_pool:
+ * @directory: A #InfdDirectory.
+ * @pool: (allow-none): A #InfdLoopPool, or %NULL.
+ *
+ * Sets the pool of event loops in which the requests made to sessions of
+ * @directory are executed. Each session that is opened from now on is
+ * owned by one of the loops of @pool, so that the requests for different
+ * sessions can be executed in parallel, see #InfdSessionProxy:loop-pool.
+ * Sessions which are already open stay where they are.
+ *
+ * If @pool is %NULL, then requests are executed in the main loop.
+ */
+void
+infd_directory_set_loop_pool(InfdDirectory* directory,
+                             InfdLoopPool* pool)
+{
+  InfdDirectoryPrivate* priv;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  g_return_if_fail(pool == NULL || INFD_IS_LOOP_POOL(pool));
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->loop_pool != pool)
+  {
+    if(priv->loop_pool != NULL)
+      g_object_unref(priv->loop_pool);
+
+    priv->loop_pool = pool;
+    if(pool != NULL)
+      g_object_ref(pool);
+
+    g_object_notify(G_OBJECT(directory), "loop-pool");
+  }
+}
+
+/**
+ * infd_directory_get_loop_pool:
+ * @directory: A #InfdDirectory.
+ *
+ * Returns the pool of event loops in which the requests made to sessions
+ * of @directory are executed, see infd_directory_set_loop_pool().
+ *
+ * Returns: (transfer none) (allow-none): The #InfdLoopPool of @directory,
+ * or %NULL.
+ */
+InfdLoopPool*
+infd_directory_get_loop_pool(InfdDirectory* directory)
+{
+  g_return_val_if_fail(INFD_IS_DIRECTORY(directory), NULL);
+  return INFD_DIRECTORY_PRIVATE(directory)->loop_pool;
+}
+
 /**
  * infd_directory_create_acl_account:
  * @directory: A #InfdDirectory.
@@ -23,6 +23,7 @@
 #include <libinfinity/server/infd-storage.h>
 #include <libinfinity/server/infd-note-plugin.h>
 #include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/server/infd-loop-pool.h>
 #include <libinfinity/common/inf-browser.h>
 #include <libinfinity/common/inf-certificate-chain.h>
 #include <libinfinity/communication/inf-communication-manager.h>
@@ -40,9 +41,30 @@ G_BEGIN_DECLS
 #define INFD_IS_DIRECTORY_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INFD_TYPE_DIRECTORY))
 #define INFD_DIRECTORY_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INFD_TYPE_DIRECTORY, InfdDirectoryClass))
 
+#define INFD_TYPE_DIRECTORY_SLOW_CONSUMER_POLICY (infd_directory_slow_consumer_policy_get_type())
+
 typedef struct _InfdDirectory InfdDirectory;
 typedef struct _InfdDirectoryClass InfdDirectoryClass;
 
+/**
+ * InfdDirectorySlowConsumerPolicy:
+ * @INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT: Connections with too much data
+ * waiting to be sent to them are closed.
+ * @INFD_DIRECTORY_SLOW_CONSUMER_THROTTLE: No more data is read from
+ * connections with too much data waiting to be sent to them, until it has
+ * been sent. Connections that do not support throttling, and connections
+ * for which the amount of waiting data keeps growing nevertheless, are
+ * closed.
+ *
+ * Specifies what #InfdDirectory does with connections whose remote side
+ * does not receive the messages sent to it fast enough, see
+ * infd_directory_set_send_queue_limit().
+ */
+typedef enum _InfdDirectorySlowConsumerPolicy {
+  INFD_DIRECTORY_SLOW_CONSUMER_DISCONNECT,
+  INFD_DIRECTORY_SLOW_CONSUMER_THROTTLE
+} InfdDirectorySlowConsumerPolicy;
+
 /**
  * InfdDirectoryClass:
  * @connection_added: Default signal handler for the
@@ -86,6 +108,26 @@ struct _InfdDirectory {
 typedef void(*InfdDirectoryForeachConnectionFunc)(InfXmlConnection* conn,
                                                   gpointer user_data);
 
+/**
+ * InfdDirectorySaveSessionFunc:
+ * @directory: The #InfdDirectory in which the session was saved.
+ * @iter: A #InfBrowserIter pointing to the note whose session was saved.
+ * @error: Reason for the failure, or %NULL if the session was saved
+ * successfully.
+ * @user_data: Additional data passed to the call to
+ * infd_directory_iter_save_session_async().
+ *
+ * This is the signature of the callback function passed to
+ * infd_directory_iter_save_session_async().
+ */
+typedef void(*InfdDirectorySaveSessionFunc)(InfdDirectory* directory,
+                                            const InfBrowserIter* iter,
+                                            const GError* error,
+                                            gpointer user_data);
+
+GType
+infd_directory_slow_consumer_policy_get_type(void) G_GNUC_CONST;
+
 GType
 infd_directory_get_type(void) G_GNUC_CONST;
 
@@ -149,6 +191,13 @@ infd_directory_iter_save_session(InfdDirectory* directory,
                                  const InfBrowserIter* iter,
                                  GError** error);
 
+gboolean
+infd_directory_iter_save_session_async(InfdDirectory* directory,
+                                       const InfBrowserIter* iter,
+                                       InfdDirectorySaveSessionFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
 void
 infd_directory_enable_chat(InfdDirectory* directory,
                            gboolean enable);
@@ -156,6 +205,37 @@ infd_directory_enable_chat(InfdDirectory* directory,
 InfdSessionProxy*
 infd_directory_get_chat_session(InfdDirectory* directory);
 
+void
+infd_directory_set_memory_budget(InfdDirectory* directory,
+                                 guint64 budget);
+
+guint64
+infd_directory_get_memory_budget(InfdDirectory* directory);
+
+guint64
+infd_directory_get_memory_usage(InfdDirectory* directory);
+
+void
+infd_directory_set_send_queue_limit(InfdDirectory* directory,
+                                    guint64 limit);
+
+guint64
+infd_directory_get_send_queue_limit(InfdDirectory* directory);
+
+void
+infd_directory_set_slow_consumer_policy(InfdDirectory* directory,
+                                        InfdDirectorySlowConsumerPolicy policy);
+
+InfdDirectorySlowConsumerPolicy
+infd_directory_get_slow_consumer_policy(InfdDirectory* directory);
+
+void
+infd_directory_set_loop_pool(InfdDirectory* directory,
+                             InfdLoopPool* pool);
+
+InfdLoopPool*
+infd_directory_get_loop_pool(InfdDirectory* directory);
+
 InfAclAccountId
 infd_directory_create_acl_account(InfdDirectory* directory,
                                   const gchar* account_name,
@@ -799,6 +799,14 @@ infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
   return TRUE;
 }
 
+static gboolean
+infd_filesystem_storage_storage_supports_concurrent_reads(InfdStorage* storage)
+{
+  /* Only the root directory is stored, and it cannot change after
+   * construction. Everything else is in the file system. */
+  return TRUE;
+}
+
 static void
 infd_filesystem_storage_class_init(
   InfdFilesystemStorageClass* filesystem_storage_class)
@@ -840,6 +848,8 @@ infd_filesystem_storage_storage_iface_init(InfdStorageInterface* iface)
     infd_filesystem_storage_storage_read_acl;
   iface->write_acl =
     infd_filesystem_storage_storage_write_acl;
+  iface->supports_concurrent_reads =
+    infd_filesystem_storage_storage_supports_concurrent_reads;
 }
 
 /**
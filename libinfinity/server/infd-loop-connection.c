@@ -0,0 +1,1566 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:infd-loop-connection
+ * @title: InfdLoopConnection
+ * @short_description: Connection running in another event loop
+ * @include: libinfinity/server/infd-loop-connection.h
+ * @see_also: #InfdLoopPool, #InfdXmppServer
+ * @stability: Unstable
+ *
+ * #InfdLoopConnection is a #InfXmlConnection which forwards to another
+ * #InfXmlConnection, the base connection, that runs in one of the loops of
+ * a #InfdLoopPool. Messages sent through the #InfdLoopConnection are
+ * handed to the base connection in its loop, and messages received by the
+ * base connection, as well as its status changes and errors, are reported
+ * by the #InfdLoopConnection in the main loop. This way, everything that
+ * is done with the connection in the main loop, such as processing of
+ * requests in sessions, works as with any other connection, while the
+ * network I/O, encryption and XML parsing and serialization happen in
+ * another thread.
+ *
+ * #InfdXmppServer creates such connections when its #InfdTcpServer has a
+ * #InfdTcpServer:loop-pool set. infd_loop_connection_invoke() can be used
+ * to run code with the base connection, for example to use API which is
+ * specific to #InfXmppConnection.
+ *
+ * If the pool has #InfdLoopPool:handshake-only set, then an #InfXmppConnection
+ * base connection is handed back to the main loop as soon as it is open,
+ * that is after the TLS handshake and authentication. From then on it is
+ * used directly in the main loop, and the #InfdLoopConnection only passes
+ * on its signals.
+ *
+ * An #InfdLoopConnection cannot be reopened once it has been closed.
+ */
+
+#include <libinfinity/server/infd-loop-connection.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection-private.h>
+#include <libinfinity/common/inf-certificate-chain.h>
+#include <libinfinity/inf-signals.h>
+
+typedef enum _InfdLoopConnectionEventType {
+  INFD_LOOP_CONNECTION_EVENT_STATUS,
+  INFD_LOOP_CONNECTION_EVENT_SENT,
+  INFD_LOOP_CONNECTION_EVENT_RECEIVED,
+  INFD_LOOP_CONNECTION_EVENT_ERROR,
+  /* The base connection is not watched in its loop anymore and continues in
+   * the main loop */
+  INFD_LOOP_CONNECTION_EVENT_HANDED_BACK,
+  /* An operation that reached the loop after the base connection was handed
+   * back, to be performed in the main loop instead */
+  INFD_LOOP_CONNECTION_EVENT_OPERATION
+} InfdLoopConnectionEventType;
+
+typedef struct _InfdLoopConnectionOperation InfdLoopConnectionOperation;
+
+/* Something that happened to the base connection in its loop, to be
+ * reported in the main loop */
+typedef struct _InfdLoopConnectionEvent InfdLoopConnectionEvent;
+struct _InfdLoopConnectionEvent {
+  InfdLoopConnectionEventType type;
+
+  union {
+    struct {
+      InfXmlConnectionStatus status;
+      gpointer local_certificate;
+      InfCertificateChain* remote_certificate;
+    } status;
+
+    xmlNodePtr xml;
+    GError* error;
+    InfTcpConnection* tcp;
+    InfdLoopConnectionOperation* operation;
+  } shared;
+};
+
+/* The part of the connection that is shared between the main loop and the
+ * loop of the base connection. It outlives the InfdLoopConnection until the
+ * base connection has been released in its loop. */
+typedef struct _InfdLoopConnectionLink InfdLoopConnectionLink;
+struct _InfdLoopConnectionLink {
+  gint ref_count;
+
+  InfIo* io;
+  InfdLoopPool* pool;
+  InfIo* loop;
+
+  /* Only accessed in the loop of the base connection */
+  InfXmlConnection* base;
+  /* Only accessed in the main loop, NULL after dispose */
+  InfdLoopConnection* connection;
+
+  /* Protected by the mutex */
+  GMutex mutex;
+  GQueue events;
+  gboolean dispatched;
+
+  /* Whether to hand the base connection back to the main loop once it is
+   * open. The other two flags are only accessed in the loop. */
+  gboolean hand_back;
+  gboolean handing_back;
+  gboolean handed_back;
+
+  /* Only accessed in the main loop. Set when the base connection has been
+   * handed back and everything queued for the loop before has arrived back
+   * in the main loop, so that the base connection can be used directly. */
+  gboolean direct;
+};
+
+typedef void(*InfdLoopConnectionPerformFunc)(
+  InfdLoopConnectionOperation* operation);
+
+/* Something to do with the base connection in its loop, or in the main loop
+ * if the base connection has been handed back */
+struct _InfdLoopConnectionOperation {
+  InfdLoopConnectionLink* link;
+  InfdLoopConnectionPerformFunc perform;
+
+  xmlNodePtr xml;
+  GBytes* serialized;
+  GBytes* binary;
+
+  InfdLoopConnectionFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+typedef struct _InfdLoopConnectionPrivate InfdLoopConnectionPrivate;
+struct _InfdLoopConnectionPrivate {
+  InfIo* io;
+  InfdLoopPool* pool;
+  InfIo* loop;
+  InfXmlConnection* base;
+
+  InfdLoopConnectionLink* link;
+
+  InfXmlConnectionStatus status;
+  gboolean closing;
+
+  gchar* network;
+  gchar* local_id;
+  gchar* remote_id;
+  gpointer local_certificate;
+  InfCertificateChain* remote_certificate;
+};
+
+enum {
+  PROP_0,
+
+  PROP_IO,
+  PROP_LOOP_POOL,
+  PROP_LOOP,
+  PROP_BASE,
+
+  /* From InfXmlConnection */
+  PROP_STATUS,
+  PROP_NETWORK,
+  PROP_LOCAL_ID,
+  PROP_REMOTE_ID,
+  PROP_LOCAL_CERTIFICATE,
+  PROP_REMOTE_CERTIFICATE
+};
+
+#define INFD_LOOP_CONNECTION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_LOOP_CONNECTION, InfdLoopConnectionPrivate))
+
+static void infd_loop_connection_xml_connection_iface_init(InfXmlConnectionInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfdLoopConnection, infd_loop_connection, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfdLoopConnection)
+  G_IMPLEMENT_INTERFACE(INF_TYPE_XML_CONNECTION, infd_loop_connection_xml_connection_iface_init))
+
+static void
+infd_loop_connection_operation_free(gpointer data);
+
+static void
+infd_loop_connection_event_free(InfdLoopConnectionEvent* event)
+{
+  switch(event->type)
+  {
+  case INFD_LOOP_CONNECTION_EVENT_STATUS:
+    if(event->shared.status.remote_certificate != NULL)
+      inf_certificate_chain_unref(event->shared.status.remote_certificate);
+    break;
+  case INFD_LOOP_CONNECTION_EVENT_SENT:
+  case INFD_LOOP_CONNECTION_EVENT_RECEIVED:
+    xmlFreeNode(event->shared.xml);
+    break;
+  case INFD_LOOP_CONNECTION_EVENT_ERROR:
+    g_error_free(event->shared.error);
+    break;
+  case INFD_LOOP_CONNECTION_EVENT_HANDED_BACK:
+    g_object_unref(event->shared.tcp);
+    break;
+  case INFD_LOOP_CONNECTION_EVENT_OPERATION:
+    infd_loop_connection_operation_free(event->shared.operation);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  g_slice_free(InfdLoopConnectionEvent, event);
+}
+
+static void
+infd_loop_connection_base_sent_cb(InfXmlConnection* base,
+                                  xmlNodePtr xml,
+                                  gpointer user_data);
+
+static void
+infd_loop_connection_base_received_cb(InfXmlConnection* base,
+                                      xmlNodePtr xml,
+                                      gpointer user_data);
+
+static void
+infd_loop_connection_base_error_cb(InfXmlConnection* base,
+                                   const GError* error,
+                                   gpointer user_data);
+
+static void
+infd_loop_connection_base_notify_cb(GObject* object,
+                                    GParamSpec* pspec,
+                                    gpointer user_data);
+
+static void
+infd_loop_connection_direct_sent_cb(InfXmlConnection* base,
+                                    xmlNodePtr xml,
+                                    gpointer user_data);
+
+static void
+infd_loop_connection_direct_received_cb(InfXmlConnection* base,
+                                        xmlNodePtr xml,
+                                        gpointer user_data);
+
+static void
+infd_loop_connection_direct_error_cb(InfXmlConnection* base,
+                                     const GError* error,
+                                     gpointer user_data);
+
+static void
+infd_loop_connection_direct_notify_cb(GObject* object,
+                                      GParamSpec* pspec,
+                                      gpointer user_data);
+
+static void
+infd_loop_connection_queue_operation(InfdLoopConnectionLink* link,
+                                     InfdLoopConnectionPerformFunc perform,
+                                     xmlNodePtr xml,
+                                     GBytes* serialized,
+                                     GBytes* binary,
+                                     InfdLoopConnectionFunc user_func,
+                                     gpointer user_data,
+                                     GDestroyNotify notify);
+
+static InfdLoopConnectionLink*
+infd_loop_connection_link_ref(InfdLoopConnectionLink* link)
+{
+  g_atomic_int_inc(&link->ref_count);
+  return link;
+}
+
+static void
+infd_loop_connection_link_connect(InfdLoopConnectionLink* link,
+                                  GCallback sent_cb,
+                                  GCallback received_cb,
+                                  GCallback error_cb,
+                                  GCallback notify_cb)
+{
+  g_signal_connect(G_OBJECT(link->base), "sent", sent_cb, link);
+  g_signal_connect(G_OBJECT(link->base), "received", received_cb, link);
+  g_signal_connect(G_OBJECT(link->base), "error", error_cb, link);
+  g_signal_connect(G_OBJECT(link->base), "notify::status", notify_cb, link);
+
+  g_signal_connect(
+    G_OBJECT(link->base),
+    "notify::remote-certificate",
+    notify_cb,
+    link
+  );
+}
+
+static void
+infd_loop_connection_link_disconnect(InfdLoopConnectionLink* link,
+                                     GCallback sent_cb,
+                                     GCallback received_cb,
+                                     GCallback error_cb,
+                                     GCallback notify_cb)
+{
+  inf_signal_handlers_disconnect_by_func(link->base, sent_cb, link);
+  inf_signal_handlers_disconnect_by_func(link->base, received_cb, link);
+  inf_signal_handlers_disconnect_by_func(link->base, error_cb, link);
+  inf_signal_handlers_disconnect_by_func(link->base, notify_cb, link);
+}
+
+/* Called in the thread that currently runs the base connection */
+static void
+infd_loop_connection_link_release(InfdLoopConnectionLink* link)
+{
+  InfXmlConnectionStatus status;
+
+  if(link->base != NULL)
+  {
+    infd_loop_connection_link_disconnect(
+      link,
+      G_CALLBACK(infd_loop_connection_base_sent_cb),
+      G_CALLBACK(infd_loop_connection_base_received_cb),
+      G_CALLBACK(infd_loop_connection_base_error_cb),
+      G_CALLBACK(infd_loop_connection_base_notify_cb)
+    );
+
+    infd_loop_connection_link_disconnect(
+      link,
+      G_CALLBACK(infd_loop_connection_direct_sent_cb),
+      G_CALLBACK(infd_loop_connection_direct_received_cb),
+      G_CALLBACK(infd_loop_connection_direct_error_cb),
+      G_CALLBACK(infd_loop_connection_direct_notify_cb)
+    );
+
+    g_object_get(G_OBJECT(link->base), "status", &status, NULL);
+    if(status == INF_XML_CONNECTION_OPENING ||
+       status == INF_XML_CONNECTION_OPEN)
+    {
+      inf_xml_connection_close(link->base);
+    }
+
+    g_object_unref(link->base);
+    link->base = NULL;
+  }
+}
+
+static void
+infd_loop_connection_link_unref(gpointer data)
+{
+  InfdLoopConnectionLink* link;
+  link = (InfdLoopConnectionLink*)data;
+
+  if(g_atomic_int_dec_and_test(&link->ref_count))
+  {
+    g_assert(link->connection == NULL);
+
+    /* Normally the base connection has already been released in its loop,
+     * but not if the loop was stopped before. */
+    infd_loop_connection_link_release(link);
+
+    while(!g_queue_is_empty(&link->events))
+    {
+      infd_loop_connection_event_free(
+        (InfdLoopConnectionEvent*)g_queue_pop_head(&link->events)
+      );
+    }
+
+    g_mutex_clear(&link->mutex);
+
+    g_object_unref(link->io);
+    g_object_unref(link->pool);
+    g_object_unref(link->loop);
+    g_slice_free(InfdLoopConnectionLink, link);
+  }
+}
+
+/*
+ * Reporting events of the base connection in the main loop
+ */
+
+static void
+infd_loop_connection_process_event(InfdLoopConnection* connection,
+                                   InfdLoopConnectionEvent* event)
+{
+  InfdLoopConnectionPrivate* priv;
+  InfXmlConnectionStatus status;
+
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+
+  switch(event->type)
+  {
+  case INFD_LOOP_CONNECTION_EVENT_STATUS:
+    g_object_freeze_notify(G_OBJECT(connection));
+
+    if(priv->local_certificate != event->shared.status.local_certificate)
+    {
+      priv->local_certificate = event->shared.status.local_certificate;
+      g_object_notify(G_OBJECT(connection), "local-certificate");
+    }
+
+    if(priv->remote_certificate !=
+       event->shared.status.remote_certificate)
+    {
+      if(priv->remote_certificate != NULL)
+        inf_certificate_chain_unref(priv->remote_certificate);
+
+      priv->remote_certificate = event->shared.status.remote_certificate;
+      event->shared.status.remote_certificate = NULL;
+
+      g_object_notify(G_OBJECT(connection), "remote-certificate");
+    }
+
+    /* Once the connection is being closed from the main loop, it can no
+     * longer become open, even if the base connection was still open when
+     * the event was queued. */
+    status = event->shared.status.status;
+    if(priv->closing && status != INF_XML_CONNECTION_CLOSED)
+      status = priv->status;
+
+    if(priv->status != status)
+    {
+      priv->status = status;
+      g_object_notify(G_OBJECT(connection), "status");
+    }
+
+    g_object_thaw_notify(G_OBJECT(connection));
+    break;
+  case INFD_LOOP_CONNECTION_EVENT_SENT:
+    inf_xml_connection_sent(INF_XML_CONNECTION(connection), event->shared.xml);
+    break;
+  case INFD_LOOP_CONNECTION_EVENT_RECEIVED:
+    inf_xml_connection_received(
+      INF_XML_CONNECTION(connection),
+      event->shared.xml
+    );
+
+    break;
+  case INFD_LOOP_CONNECTION_EVENT_ERROR:
+    inf_xml_connection_error(
+      INF_XML_CONNECTION(connection),
+      event->shared.error
+    );
+
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+infd_loop_connection_handed_back(InfdLoopConnectionLink* link,
+                                 InfTcpConnection* tcp);
+
+static void
+infd_loop_connection_dispatch_func(gpointer user_data)
+{
+  InfdLoopConnectionLink* link;
+  InfdLoopConnection* connection;
+  InfdLoopConnectionEvent* event;
+  GQueue events;
+
+  link = (InfdLoopConnectionLink*)user_data;
+
+  g_mutex_lock(&link->mutex);
+  events = link->events;
+  g_queue_init(&link->events);
+  link->dispatched = FALSE;
+  g_mutex_unlock(&link->mutex);
+
+  connection = link->connection;
+  if(connection != NULL)
+    g_object_ref(connection);
+
+  while(!g_queue_is_empty(&events))
+  {
+    event = (InfdLoopConnectionEvent*)g_queue_pop_head(&events);
+
+    switch(event->type)
+    {
+    case INFD_LOOP_CONNECTION_EVENT_HANDED_BACK:
+      infd_loop_connection_handed_back(link, event->shared.tcp);
+      break;
+    case INFD_LOOP_CONNECTION_EVENT_OPERATION:
+      event->shared.operation->perform(event->shared.operation);
+      break;
+    default:
+      /* A signal handler might have disposed the connection */
+      if(link->connection != NULL)
+        infd_loop_connection_process_event(connection, event);
+      break;
+    }
+
+    infd_loop_connection_event_free(event);
+  }
+
+  if(connection != NULL)
+    g_object_unref(connection);
+}
+
+/* Called in the loop of the base connection */
+static void
+infd_loop_connection_push_event(InfdLoopConnectionLink* link,
+                                InfdLoopConnectionEvent* event)
+{
+  gboolean dispatch;
+
+  g_mutex_lock(&link->mutex);
+  g_queue_push_tail(&link->events, event);
+  dispatch = !link->dispatched;
+  link->dispatched = TRUE;
+  g_mutex_unlock(&link->mutex);
+
+  if(dispatch)
+  {
+    inf_io_add_dispatch(
+      link->io,
+      infd_loop_connection_dispatch_func,
+      infd_loop_connection_link_ref(link),
+      infd_loop_connection_link_unref
+    );
+  }
+}
+
+static InfdLoopConnectionEvent*
+infd_loop_connection_status_event_new(GObject* base)
+{
+  InfdLoopConnectionEvent* event;
+
+  event = g_slice_new(InfdLoopConnectionEvent);
+  event->type = INFD_LOOP_CONNECTION_EVENT_STATUS;
+
+  g_object_get(
+    base,
+    "status", &event->shared.status.status,
+    "local-certificate", &event->shared.status.local_certificate,
+    "remote-certificate", &event->shared.status.remote_certificate,
+    NULL
+  );
+
+  return event;
+}
+
+/*
+ * Signal handlers for the base connection, called in its loop
+ */
+
+static void
+infd_loop_connection_base_sent_cb(InfXmlConnection* base,
+                                  xmlNodePtr xml,
+                                  gpointer user_data)
+{
+  InfdLoopConnectionEvent* event;
+
+  event = g_slice_new(InfdLoopConnectionEvent);
+  event->type = INFD_LOOP_CONNECTION_EVENT_SENT;
+  event->shared.xml = xmlCopyNode(xml, 1);
+
+  infd_loop_connection_push_event(user_data, event);
+}
+
+static void
+infd_loop_connection_base_received_cb(InfXmlConnection* base,
+                                      xmlNodePtr xml,
+                                      gpointer user_data)
+{
+  InfdLoopConnectionEvent* event;
+
+  /* The copy does not refer to the dictionary of the parser in the loop of
+   * the base connection, so it can be used in the main loop. */
+  event = g_slice_new(InfdLoopConnectionEvent);
+  event->type = INFD_LOOP_CONNECTION_EVENT_RECEIVED;
+  event->shared.xml = xmlCopyNode(xml, 1);
+
+  infd_loop_connection_push_event(user_data, event);
+}
+
+static void
+infd_loop_connection_base_error_cb(InfXmlConnection* base,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfdLoopConnectionEvent* event;
+
+  event = g_slice_new(InfdLoopConnectionEvent);
+  event->type = INFD_LOOP_CONNECTION_EVENT_ERROR;
+  event->shared.error = g_error_copy(error);
+
+  infd_loop_connection_push_event(user_data, event);
+}
+
+static void
+infd_loop_connection_hand_back(InfdLoopConnectionOperation* operation);
+
+static void
+infd_loop_connection_base_notify_cb(GObject* object,
+                                    GParamSpec* pspec,
+                                    gpointer user_data)
+{
+  InfdLoopConnectionLink* link;
+  InfdLoopConnectionEvent* event;
+  InfXmlConnectionStatus status;
+
+  link = (InfdLoopConnectionLink*)user_data;
+
+  event = infd_loop_connection_status_event_new(object);
+  status = event->shared.status.status;
+  infd_loop_connection_push_event(link, event);
+
+  /* Don't hand back the connection from within the signal emission, but
+   * after whatever the base connection is currently doing. */
+  if(link->hand_back && !link->handing_back &&
+     status == INF_XML_CONNECTION_OPEN)
+  {
+    link->handing_back = TRUE;
+
+    infd_loop_connection_queue_operation(
+      link,
+      infd_loop_connection_hand_back,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      NULL
+    );
+  }
+}
+
+/*
+ * Signal handlers for the base connection, called in the main loop after it
+ * has been handed back
+ */
+
+static void
+infd_loop_connection_direct_sent_cb(InfXmlConnection* base,
+                                    xmlNodePtr xml,
+                                    gpointer user_data)
+{
+  InfdLoopConnectionLink* link;
+  link = (InfdLoopConnectionLink*)user_data;
+
+  if(link->connection != NULL)
+    inf_xml_connection_sent(INF_XML_CONNECTION(link->connection), xml);
+}
+
+static void
+infd_loop_connection_direct_received_cb(InfXmlConnection* base,
+                                        xmlNodePtr xml,
+                                        gpointer user_data)
+{
+  InfdLoopConnectionLink* link;
+  link = (InfdLoopConnectionLink*)user_data;
+
+  if(link->connection != NULL)
+    inf_xml_connection_received(INF_XML_CONNECTION(link->connection), xml);
+}
+
+static void
+infd_loop_connection_direct_error_cb(InfXmlConnection* base,
+                                     const GError* error,
+                                     gpointer user_data)
+{
+  InfdLoopConnectionLink* link;
+  link = (InfdLoopConnectionLink*)user_data;
+
+  if(link->connection != NULL)
+    inf_xml_connection_error(INF_XML_CONNECTION(link->connection), error);
+}
+
+static void
+infd_loop_connection_direct_notify_cb(GObject* object,
+                                      GParamSpec* pspec,
+                                      gpointer user_data)
+{
+  InfdLoopConnectionLink* link;
+  InfdLoopConnectionEvent* event;
+
+  link = (InfdLoopConnectionLink*)user_data;
+
+  if(link->connection != NULL)
+  {
+    event = infd_loop_connection_status_event_new(object);
+    infd_loop_connection_process_event(link->connection, event);
+    infd_loop_connection_event_free(event);
+  }
+}
+
+/*
+ * Operations on the base connection
+ */
+
+static void
+infd_loop_connection_operation_free(gpointer data)
+{
+  InfdLoopConnectionOperation* operation;
+  operation = (InfdLoopConnectionOperation*)data;
+
+  if(operation->xml != NULL)
+    xmlFreeNode(operation->xml);
+  if(operation->serialized != NULL)
+    g_bytes_unref(operation->serialized);
+  if(operation->binary != NULL)
+    g_bytes_unref(operation->binary);
+  if(operation->notify != NULL)
+    operation->notify(operation->user_data);
+
+  infd_loop_connection_link_unref(operation->link);
+  g_slice_free(InfdLoopConnectionOperation, operation);
+}
+
+/* Runs in the loop of the base connection */
+static void
+infd_loop_connection_operation_func(gpointer user_data)
+{
+  InfdLoopConnectionOperation* operation;
+  InfdLoopConnectionOperation* moved;
+  InfdLoopConnectionEvent* event;
+
+  operation = (InfdLoopConnectionOperation*)user_data;
+
+  if(operation->link->handed_back)
+  {
+    /* The operation is freed when this function returns, so move its
+     * content into a new one for the main loop. */
+    moved = g_slice_dup(InfdLoopConnectionOperation, operation);
+    infd_loop_connection_link_ref(moved->link);
+
+    operation->xml = NULL;
+    operation->serialized = NULL;
+    operation->binary = NULL;
+    operation->notify = NULL;
+
+    event = g_slice_new(InfdLoopConnectionEvent);
+    event->type = INFD_LOOP_CONNECTION_EVENT_OPERATION;
+    event->shared.operation = moved;
+
+    infd_loop_connection_push_event(operation->link, event);
+  }
+  else
+  {
+    operation->perform(operation);
+  }
+}
+
+static void
+infd_loop_connection_queue_operation(InfdLoopConnectionLink* link,
+                                     InfdLoopConnectionPerformFunc perform,
+                                     xmlNodePtr xml,
+                                     GBytes* serialized,
+                                     GBytes* binary,
+                                     InfdLoopConnectionFunc user_func,
+                                     gpointer user_data,
+                                     GDestroyNotify notify)
+{
+  InfdLoopConnectionOperation* operation;
+
+  operation = g_slice_new(InfdLoopConnectionOperation);
+  operation->link = infd_loop_connection_link_ref(link);
+  operation->perform = perform;
+  operation->xml = xml;
+  operation->serialized = serialized;
+  operation->binary = binary;
+  operation->func = user_func;
+  operation->user_data = user_data;
+  operation->notify = notify;
+
+  infd_loop_pool_invoke(
+    link->pool,
+    link->loop,
+    infd_loop_connection_operation_func,
+    operation,
+    infd_loop_connection_operation_free
+  );
+}
+
+static void
+infd_loop_connection_start(InfdLoopConnectionOperation* operation)
+{
+  InfdLoopConnectionLink* link;
+  link = operation->link;
+
+  infd_loop_connection_link_connect(
+    link,
+    G_CALLBACK(infd_loop_connection_base_sent_cb),
+    G_CALLBACK(infd_loop_connection_base_received_cb),
+    G_CALLBACK(infd_loop_connection_base_error_cb),
+    G_CALLBACK(infd_loop_connection_base_notify_cb)
+  );
+
+  /* Report the status in case it changed since the snapshot that was taken
+   * when the connection was created. */
+  infd_loop_connection_base_notify_cb(G_OBJECT(link->base), NULL, link);
+}
+
+static void
+infd_loop_connection_send(InfdLoopConnectionOperation* operation)
+{
+  InfXmlConnection* base;
+  InfXmlConnectionStatus status;
+
+  base = operation->link->base;
+  if(base == NULL)
+    return;
+
+  /* The base connection might have been closed by the remote side while
+   * the message was on its way to the loop. */
+  g_object_get(G_OBJECT(base), "status", &status, NULL);
+  if(status != INF_XML_CONNECTION_OPEN)
+    return;
+
+  if(operation->serialized != NULL)
+  {
+    inf_xml_connection_send_serialized(
+      base,
+      operation->xml,
+      operation->serialized,
+      operation->binary
+    );
+  }
+  else
+  {
+    inf_xml_connection_send(base, operation->xml);
+  }
+
+  operation->xml = NULL;
+}
+
+static void
+infd_loop_connection_close(InfdLoopConnectionOperation* operation)
+{
+  InfXmlConnection* base;
+  InfXmlConnectionStatus status;
+
+  base = operation->link->base;
+  if(base == NULL)
+    return;
+
+  g_object_get(G_OBJECT(base), "status", &status, NULL);
+  if(status == INF_XML_CONNECTION_OPENING ||
+     status == INF_XML_CONNECTION_OPEN)
+  {
+    inf_xml_connection_close(base);
+  }
+}
+
+static void
+infd_loop_connection_throttle(InfdLoopConnectionOperation* operation)
+{
+  InfXmlConnection* base;
+
+  base = operation->link->base;
+  if(base == NULL || !inf_xml_connection_supports_throttling(base))
+    return;
+
+  inf_xml_connection_set_throttled(
+    base,
+    GPOINTER_TO_INT(operation->user_data)
+  );
+}
+
+static void
+infd_loop_connection_release(InfdLoopConnectionOperation* operation)
+{
+  infd_loop_connection_link_release(operation->link);
+}
+
+static void
+infd_loop_connection_invoke_user_func(InfdLoopConnectionOperation* operation)
+{
+  if(operation->link->base != NULL)
+    operation->func(operation->link->base, operation->user_data);
+}
+
+/* Runs in the loop, or in the main loop if the connection has been handed
+ * back already, in which case there is nothing to do. */
+static void
+infd_loop_connection_hand_back(InfdLoopConnectionOperation* operation)
+{
+  InfdLoopConnectionLink* link;
+  InfXmlConnectionStatus status;
+  InfTcpConnection* tcp;
+  InfdLoopConnectionEvent* event;
+
+  link = operation->link;
+  if(link->handed_back || link->base == NULL)
+    return;
+  if(!INF_IS_XMPP_CONNECTION(link->base))
+    return;
+
+  g_object_get(G_OBJECT(link->base), "status", &status, NULL);
+  if(status != INF_XML_CONNECTION_OPEN)
+    return;
+
+  g_object_get(G_OBJECT(link->base), "tcp-connection", &tcp, NULL);
+
+  infd_loop_connection_link_disconnect(
+    link,
+    G_CALLBACK(infd_loop_connection_base_sent_cb),
+    G_CALLBACK(infd_loop_connection_base_received_cb),
+    G_CALLBACK(infd_loop_connection_base_error_cb),
+    G_CALLBACK(infd_loop_connection_base_notify_cb)
+  );
+
+  /* From now on, the loop does not touch the base connection anymore, and
+   * it stays idle until it is attached to the main loop. */
+  _inf_tcp_connection_detach(tcp);
+  link->handed_back = TRUE;
+
+  event = g_slice_new(InfdLoopConnectionEvent);
+  event->type = INFD_LOOP_CONNECTION_EVENT_HANDED_BACK;
+  event->shared.tcp = tcp;
+
+  infd_loop_connection_push_event(link, event);
+}
+
+/* Runs in the main loop once everything that was queued for the loop
+ * before the base connection was handed back has been performed. */
+static void
+infd_loop_connection_drain(InfdLoopConnectionOperation* operation)
+{
+  operation->link->direct = TRUE;
+}
+
+/* Runs in the main loop */
+static void
+infd_loop_connection_handed_back(InfdLoopConnectionLink* link,
+                                 InfTcpConnection* tcp)
+{
+  g_assert(link->base != NULL);
+
+  _inf_tcp_connection_attach(tcp, link->io);
+  infd_loop_pool_unassign(link->pool, link->loop, G_OBJECT(tcp));
+
+  infd_loop_connection_link_connect(
+    link,
+    G_CALLBACK(infd_loop_connection_direct_sent_cb),
+    G_CALLBACK(infd_loop_connection_direct_received_cb),
+    G_CALLBACK(infd_loop_connection_direct_error_cb),
+    G_CALLBACK(infd_loop_connection_direct_notify_cb)
+  );
+
+  /* Operations that are still queued for the loop come back to the main
+   * loop in order. Only use the base connection directly once all of them
+   * have arrived here. */
+  infd_loop_connection_queue_operation(
+    link,
+    infd_loop_connection_drain,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  );
+}
+
+/*
+ * GObject overrides
+ */
+
+static void
+infd_loop_connection_init(InfdLoopConnection* connection)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+
+  priv->io = NULL;
+  priv->pool = NULL;
+  priv->loop = NULL;
+  priv->base = NULL;
+  priv->link = NULL;
+
+  priv->status = INF_XML_CONNECTION_CLOSED;
+  priv->closing = FALSE;
+
+  priv->network = NULL;
+  priv->local_id = NULL;
+  priv->remote_id = NULL;
+  priv->local_certificate = NULL;
+  priv->remote_certificate = NULL;
+}
+
+static void
+infd_loop_connection_constructed(GObject* object)
+{
+  InfdLoopConnectionPrivate* priv;
+  InfdLoopConnectionLink* link;
+
+  G_OBJECT_CLASS(infd_loop_connection_parent_class)->constructed(object);
+
+  priv = INFD_LOOP_CONNECTION_PRIVATE(object);
+
+  g_assert(priv->io != NULL);
+  g_assert(priv->pool != NULL);
+  g_assert(priv->loop != NULL);
+  g_assert(priv->base != NULL);
+
+  /* The base connection is not running in its loop yet, so we can still
+   * access it from here. */
+  g_object_get(
+    G_OBJECT(priv->base),
+    "status", &priv->status,
+    "network", &priv->network,
+    "local-id", &priv->local_id,
+    "remote-id", &priv->remote_id,
+    "local-certificate", &priv->local_certificate,
+    "remote-certificate", &priv->remote_certificate,
+    NULL
+  );
+
+  link = g_slice_new(InfdLoopConnectionLink);
+  link->ref_count = 1;
+  link->io = g_object_ref(priv->io);
+  link->pool = g_object_ref(priv->pool);
+  link->loop = g_object_ref(priv->loop);
+  link->base = priv->base;
+  link->connection = INFD_LOOP_CONNECTION(object);
+  g_mutex_init(&link->mutex);
+  g_queue_init(&link->events);
+  link->dispatched = FALSE;
+  link->hand_back = infd_loop_pool_get_handshake_only(priv->pool);
+  link->handing_back = FALSE;
+  link->handed_back = FALSE;
+  link->direct = FALSE;
+
+  /* The link owns the base connection from now on */
+  priv->base = NULL;
+  priv->link = link;
+
+  infd_loop_connection_queue_operation(
+    link,
+    infd_loop_connection_start,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  );
+}
+
+static void
+infd_loop_connection_dispose(GObject* object)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(object);
+
+  if(priv->link != NULL)
+  {
+    priv->link->connection = NULL;
+
+    if(priv->link->direct)
+    {
+      infd_loop_connection_link_release(priv->link);
+    }
+    else
+    {
+      infd_loop_connection_queue_operation(
+        priv->link,
+        infd_loop_connection_release,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL
+      );
+    }
+
+    infd_loop_connection_link_unref(priv->link);
+    priv->link = NULL;
+  }
+
+  if(priv->base != NULL)
+  {
+    g_object_unref(priv->base);
+    priv->base = NULL;
+  }
+
+  if(priv->remote_certificate != NULL)
+  {
+    inf_certificate_chain_unref(priv->remote_certificate);
+    priv->remote_certificate = NULL;
+  }
+
+  if(priv->loop != NULL)
+  {
+    g_object_unref(priv->loop);
+    priv->loop = NULL;
+  }
+
+  if(priv->pool != NULL)
+  {
+    g_object_unref(priv->pool);
+    priv->pool = NULL;
+  }
+
+  if(priv->io != NULL)
+  {
+    g_object_unref(priv->io);
+    priv->io = NULL;
+  }
+
+  G_OBJECT_CLASS(infd_loop_connection_parent_class)->dispose(object);
+}
+
+static void
+infd_loop_connection_finalize(GObject* object)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(object);
+
+  g_free(priv->network);
+  g_free(priv->local_id);
+  g_free(priv->remote_id);
+
+  G_OBJECT_CLASS(infd_loop_connection_parent_class)->finalize(object);
+}
+
+static void
+infd_loop_connection_set_property(GObject* object,
+                                  guint prop_id,
+                                  const GValue* value,
+                                  GParamSpec* pspec)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(object);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_assert(priv->io == NULL); /* construct only */
+    priv->io = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_LOOP_POOL:
+    g_assert(priv->pool == NULL); /* construct only */
+    priv->pool = INFD_LOOP_POOL(g_value_dup_object(value));
+    break;
+  case PROP_LOOP:
+    g_assert(priv->loop == NULL); /* construct only */
+    priv->loop = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_BASE:
+    g_assert(priv->base == NULL); /* construct only */
+    priv->base = INF_XML_CONNECTION(g_value_dup_object(value));
+    break;
+  case PROP_STATUS:
+  case PROP_NETWORK:
+  case PROP_LOCAL_ID:
+  case PROP_REMOTE_ID:
+  case PROP_LOCAL_CERTIFICATE:
+  case PROP_REMOTE_CERTIFICATE:
+    /* readonly */
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+infd_loop_connection_get_property(GObject* object,
+                                  guint prop_id,
+                                  GValue* value,
+                                  GParamSpec* pspec)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(object);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_value_set_object(value, priv->io);
+    break;
+  case PROP_LOOP_POOL:
+    g_value_set_object(value, priv->pool);
+    break;
+  case PROP_LOOP:
+    g_value_set_object(value, priv->loop);
+    break;
+  case PROP_BASE:
+    if(priv->link != NULL)
+      g_value_set_object(value, priv->link->base);
+    else
+      g_value_set_object(value, NULL);
+    break;
+  case PROP_STATUS:
+    g_value_set_enum(value, priv->status);
+    break;
+  case PROP_NETWORK:
+    g_value_set_string(value, priv->network);
+    break;
+  case PROP_LOCAL_ID:
+    g_value_set_string(value, priv->local_id);
+    break;
+  case PROP_REMOTE_ID:
+    g_value_set_string(value, priv->remote_id);
+    break;
+  case PROP_LOCAL_CERTIFICATE:
+    g_value_set_pointer(value, priv->local_certificate);
+    break;
+  case PROP_REMOTE_CERTIFICATE:
+    g_value_set_boxed(value, priv->remote_certificate);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * InfXmlConnection interface implementation
+ */
+
+static void
+infd_loop_connection_xml_connection_close(InfXmlConnection* connection)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+
+  g_return_if_fail(priv->link != NULL);
+  g_return_if_fail(priv->closing == FALSE);
+  g_return_if_fail(priv->status == INF_XML_CONNECTION_OPENING ||
+                   priv->status == INF_XML_CONNECTION_OPEN);
+
+  priv->closing = TRUE;
+
+  if(priv->link->direct)
+  {
+    /* This updates our status via the notify handler */
+    inf_xml_connection_close(priv->link->base);
+  }
+  else
+  {
+    infd_loop_connection_queue_operation(
+      priv->link,
+      infd_loop_connection_close,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      NULL
+    );
+  }
+
+  if(priv->status == INF_XML_CONNECTION_OPENING ||
+     priv->status == INF_XML_CONNECTION_OPEN)
+  {
+    priv->status = INF_XML_CONNECTION_CLOSING;
+    g_object_notify(G_OBJECT(connection), "status");
+  }
+}
+
+static void
+infd_loop_connection_xml_connection_send(InfXmlConnection* connection,
+                                         xmlNodePtr xml)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+
+  g_return_if_fail(priv->link != NULL);
+  g_return_if_fail(priv->status == INF_XML_CONNECTION_OPEN);
+
+  if(priv->link->direct)
+  {
+    inf_xml_connection_send(priv->link->base, xml);
+    return;
+  }
+
+  infd_loop_connection_queue_operation(
+    priv->link,
+    infd_loop_connection_send,
+    xml,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  );
+}
+
+static void
+infd_loop_connection_xml_connection_send_serialized(
+  InfXmlConnection* connection,
+  xmlNodePtr xml,
+  GBytes* serialized,
+  GBytes* binary)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+
+  g_return_if_fail(priv->link != NULL);
+  g_return_if_fail(priv->status == INF_XML_CONNECTION_OPEN);
+
+  if(priv->link->direct)
+  {
+    inf_xml_connection_send_serialized(
+      priv->link->base,
+      xml,
+      serialized,
+      binary
+    );
+
+    return;
+  }
+
+  infd_loop_connection_queue_operation(
+    priv->link,
+    infd_loop_connection_send,
+    xml,
+    g_bytes_ref(serialized),
+    binary != NULL ? g_bytes_ref(binary) : NULL,
+    NULL,
+    NULL,
+    NULL
+  );
+}
+
+static void
+infd_loop_connection_xml_connection_set_throttled(
+  InfXmlConnection* connection,
+  gboolean throttled)
+{
+  InfdLoopConnectionPrivate* priv;
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+
+  g_return_if_fail(priv->link != NULL);
+
+  if(priv->link->direct)
+  {
+    if(inf_xml_connection_supports_throttling(priv->link->base))
+      inf_xml_connection_set_throttled(priv->link->base, throttled);
+    return;
+  }
+
+  infd_loop_connection_queue_operation(
+    priv->link,
+    infd_loop_connection_throttle,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    GINT_TO_POINTER(throttled),
+    NULL
+  );
+}
+
+/*
+ * GObject type registration
+ */
+
+static void
+infd_loop_connection_class_init(InfdLoopConnectionClass* connection_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(connection_class);
+
+  object_class->constructed = infd_loop_connection_constructed;
+  object_class->dispose = infd_loop_connection_dispose;
+  object_class->finalize = infd_loop_connection_finalize;
+  object_class->set_property = infd_loop_connection_set_property;
+  object_class->get_property = infd_loop_connection_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "The main loop in which the connection is used",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_LOOP_POOL,
+    g_param_spec_object(
+      "loop-pool",
+      "Loop pool",
+      "The pool running the loop of the base connection",
+      INFD_TYPE_LOOP_POOL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_LOOP,
+    g_param_spec_object(
+      "loop",
+      "Loop",
+      "The loop in which the base connection runs",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BASE,
+    g_param_spec_object(
+      "base",
+      "Base",
+      "The connection running in the loop",
+      INF_TYPE_XML_CONNECTION,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_override_property(object_class, PROP_STATUS, "status");
+  g_object_class_override_property(object_class, PROP_NETWORK, "network");
+  g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
+  g_object_class_override_property(object_class, PROP_REMOTE_ID, "remote-id");
+
+  g_object_class_override_property(
+    object_class,
+    PROP_LOCAL_CERTIFICATE,
+    "local-certificate"
+  );
+
+  g_object_class_override_property(
+    object_class,
+    PROP_REMOTE_CERTIFICATE,
+    "remote-certificate"
+  );
+}
+
+static void
+infd_loop_connection_xml_connection_iface_init(
+  InfXmlConnectionInterface* iface)
+{
+  iface->close = infd_loop_connection_xml_connection_close;
+  iface->send = infd_loop_connection_xml_connection_send;
+  iface->send_serialized =
+    infd_loop_connection_xml_connection_send_serialized;
+  iface->set_throttled = infd_loop_connection_xml_connection_set_throttled;
+}
+
+/*
+ * Public API
+ */
+
+/**
+ * infd_loop_connection_new: (constructor)
+ * @io: The main loop in which the new connection is used.
+ * @pool: The #InfdLoopPool running @loop.
+ * @loop: The loop of @pool in which @base runs.
+ * @base: The connection to forward to, which must support
+ * inf_xml_connection_send_serialized().
+ *
+ * Creates a new #InfdLoopConnection forwarding to @base. The function must
+ * be called before @base becomes active in @loop, since it accesses @base
+ * directly to find out its current status. From then on, @base is only
+ * accessed in @loop, and it is closed and released there when the
+ * #InfdLoopConnection is disposed.
+ *
+ * Returns: (transfer full): A new #InfdLoopConnection.
+ */
+InfdLoopConnection*
+infd_loop_connection_new(InfIo* io,
+                         InfdLoopPool* pool,
+                         InfIo* loop,
+                         InfXmlConnection* base)
+{
+  GObject* object;
+
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(INFD_IS_LOOP_POOL(pool), NULL);
+  g_return_val_if_fail(INF_IS_IO(loop), NULL);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(base), NULL);
+  g_return_val_if_fail(inf_xml_connection_supports_serialized(base), NULL);
+
+  object = g_object_new(
+    INFD_TYPE_LOOP_CONNECTION,
+    "io", io,
+    "loop-pool", pool,
+    "loop", loop,
+    "base", base,
+    NULL
+  );
+
+  return INFD_LOOP_CONNECTION(object);
+}
+
+/**
+ * infd_loop_connection_get_base:
+ * @connection: A #InfdLoopConnection.
+ *
+ * Returns the connection that @connection forwards to. The returned
+ * connection might run in another thread, so it must only be used in
+ * functions run with infd_loop_connection_invoke(), or while the
+ * #InfdLoopPool of @connection is paused with infd_loop_pool_pause().
+ *
+ * Returns: (transfer none): The base connection of @connection.
+ */
+InfXmlConnection*
+infd_loop_connection_get_base(InfdLoopConnection* connection)
+{
+  InfdLoopConnectionPrivate* priv;
+
+  g_return_val_if_fail(INFD_IS_LOOP_CONNECTION(connection), NULL);
+
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+  g_return_val_if_fail(priv->link != NULL, NULL);
+
+  return priv->link->base;
+}
+
+/**
+ * infd_loop_connection_invoke:
+ * @connection: A #InfdLoopConnection.
+ * @func: (scope async): The function to call with the base connection.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): A function called to free @user_data, or %NULL.
+ *
+ * Calls @func with the base connection of @connection in the loop in which
+ * the base connection runs. Functions invoked for the same connection are
+ * called in the order in which this function was called, and before
+ * anything the base connection does in response to later calls of
+ * inf_xml_connection_send() or inf_xml_connection_close() on @connection.
+ *
+ * If the #InfdLoopPool of @connection is currently paused, or the base
+ * connection has been handed back to the main loop, then @func is called
+ * right away. If the base connection has been released already,
+ * then @func is not called at all, but @notify is still called.
+ */
+void
+infd_loop_connection_invoke(InfdLoopConnection* connection,
+                            InfdLoopConnectionFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify)
+{
+  InfdLoopConnectionPrivate* priv;
+
+  g_return_if_fail(INFD_IS_LOOP_CONNECTION(connection));
+  g_return_if_fail(func != NULL);
+
+  priv = INFD_LOOP_CONNECTION_PRIVATE(connection);
+  g_return_if_fail(priv->link != NULL);
+
+  if(priv->link->direct || infd_loop_pool_is_paused(priv->link->pool))
+  {
+    if(priv->link->base != NULL)
+      func(priv->link->base, user_data);
+    if(notify != NULL)
+      notify(user_data);
+  }
+  else
+  {
+    infd_loop_connection_queue_operation(
+      priv->link,
+      infd_loop_connection_invoke_user_func,
+      NULL,
+      NULL,
+      NULL,
+      func,
+      user_data,
+      notify
+    );
+  }
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,95 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INFD_LOOP_CONNECTION_H__
+#define __INFD_LOOP_CONNECTION_H__
+
+#include <libinfinity/server/infd-loop-pool.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INFD_TYPE_LOOP_CONNECTION                 (infd_loop_connection_get_type())
+#define INFD_LOOP_CONNECTION(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INFD_TYPE_LOOP_CONNECTION, InfdLoopConnection))
+#define INFD_LOOP_CONNECTION_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INFD_TYPE_LOOP_CONNECTION, InfdLoopConnectionClass))
+#define INFD_IS_LOOP_CONNECTION(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INFD_TYPE_LOOP_CONNECTION))
+#define INFD_IS_LOOP_CONNECTION_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INFD_TYPE_LOOP_CONNECTION))
+#define INFD_LOOP_CONNECTION_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INFD_TYPE_LOOP_CONNECTION, InfdLoopConnectionClass))
+
+typedef struct _InfdLoopConnection InfdLoopConnection;
+typedef struct _InfdLoopConnectionClass InfdLoopConnectionClass;
+
+/**
+ * InfdLoopConnectionClass:
+ *
+ * This structure does not contain any public fields.
+ */
+struct _InfdLoopConnectionClass {
+  /*< private >*/
+  GObjectClass parent_class;
+};
+
+/**
+ * InfdLoopConnection:
+ *
+ * #InfdLoopConnection is an opaque data type. You should only access it via
+ * the public API functions.
+ */
+struct _InfdLoopConnection {
+  /*< private >*/
+  GObject parent;
+};
+
+/**
+ * InfdLoopConnectionFunc:
+ * @base: The connection running in the loop of the #InfdLoopConnection.
+ * @user_data: Additional data passed to infd_loop_connection_invoke().
+ *
+ * This is the signature of the function passed to
+ * infd_loop_connection_invoke().
+ */
+typedef void(*InfdLoopConnectionFunc)(InfXmlConnection* base,
+                                      gpointer user_data);
+
+GType
+infd_loop_connection_get_type(void) G_GNUC_CONST;
+
+InfdLoopConnection*
+infd_loop_connection_new(InfIo* io,
+                         InfdLoopPool* pool,
+                         InfIo* loop,
+                         InfXmlConnection* base);
+
+InfXmlConnection*
+infd_loop_connection_get_base(InfdLoopConnection* connection);
+
+void
+infd_loop_connection_invoke(InfdLoopConnection* connection,
+                            InfdLoopConnectionFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify);
+
+G_END_DECLS
+
+#endif /* __INFD_LOOP_CONNECTION_H__ */
+
+/* vim:set et sw=2 ts=2: */
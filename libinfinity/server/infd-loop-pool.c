@@ -0,0 +1,903 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:infd-loop-pool
+ * @title: InfdLoopPool
+ * @short_description: Event loops running in worker threads
+ * @include: libinfinity/server/infd-loop-pool.h
+ * @see_also: #InfdTcpServer, #InfdLoopConnection, #InfStandaloneIo
+ * @stability: Unstable
+ *
+ * #InfdLoopPool runs a number of #InfStandaloneIo event loops, each in its
+ * own thread. A server can assign each incoming connection to one of these
+ * loops, so that the network I/O, TLS and XML processing of different
+ * connections happens in parallel, instead of all of it being done in the
+ * main loop. See #InfdTcpServer:loop-pool.
+ *
+ * Sessions can be sharded onto the loops as well, see
+ * #InfdDirectory:loop-pool. Each #InfdSessionProxy of an #InfAdoptedSession
+ * then has an owning loop, in which the requests it receives are executed
+ * by the session's #InfAdoptedAlgorithm. The requests received for
+ * different sessions in one iteration of the main loop are executed in
+ * parallel with infd_loop_pool_run_scheduled(), while the main loop waits
+ * for them. Messages sent while executing them are held back and sent from
+ * the main loop afterwards. Everything else, such as subscriptions,
+ * synchronizations, #InfdDirectory, the storage and the communication
+ * manager, stays in the main loop. Note that a session which takes long to
+ * process a request therefore still delays the main loop, but it no longer
+ * delays the requests of other sessions received at the same time.
+ *
+ * If #InfdLoopPool:handshake-only is set, then connections only stay in
+ * their loop until they are established, and are then handed back to the
+ * main loop. This moves the expensive part of accepting connections, the
+ * TLS handshake and authentication, out of the main loop, without paying
+ * for the communication between threads for every message afterwards.
+ *
+ * Objects which are assigned to a loop with infd_loop_pool_assign() must
+ * only be used from within that loop. Code in the main thread can use
+ * infd_loop_pool_invoke() to run a function in a loop, or
+ * infd_loop_pool_pause() to stop all loops temporarily while it accesses
+ * such objects directly.
+ */
+
+#include <libinfinity/server/infd-loop-pool.h>
+#include <libinfinity/common/inf-standalone-io.h>
+
+typedef struct _InfdLoopPoolInvocation InfdLoopPoolInvocation;
+struct _InfdLoopPoolInvocation {
+  InfIoDispatchFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+/* The loop structure is reference-counted since objects assigned to a loop
+ * might be finalized only after the pool itself. */
+typedef struct _InfdLoopPoolLoop InfdLoopPoolLoop;
+struct _InfdLoopPoolLoop {
+  gint ref_count;
+  gint n_objects; /* atomic */
+
+  InfStandaloneIo* io;
+  GThread* thread;
+
+  /* Protected by the mutex of the pool. Invocations are kept in an own
+   * queue so that they are run in the order in which they were made, and
+   * there is at most one dispatch in the event loop to run them. */
+  GQueue invocations;
+  gboolean dispatched;
+};
+
+typedef struct _InfdLoopPoolPrivate InfdLoopPoolPrivate;
+struct _InfdLoopPoolPrivate {
+  guint n_loops;
+  InfdLoopPoolLoop** loops;
+  gboolean handshake_only;
+
+  GMutex mutex;
+  GCond cond;
+  gboolean paused;
+  guint n_paused;
+
+  /* Only accessed from the main thread, except n_running, which is
+   * protected by the mutex. */
+  GQueue scheduled;
+  guint n_running;
+};
+
+enum {
+  PROP_0,
+
+  PROP_N_LOOPS,
+  PROP_HANDSHAKE_ONLY
+};
+
+#define INFD_LOOP_POOL_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_LOOP_POOL, InfdLoopPoolPrivate))
+
+G_DEFINE_TYPE_WITH_CODE(InfdLoopPool, infd_loop_pool, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfdLoopPool))
+
+typedef struct _InfdLoopPoolDispatch InfdLoopPoolDispatch;
+struct _InfdLoopPoolDispatch {
+  InfdLoopPool* pool;
+  InfdLoopPoolLoop* loop;
+};
+
+typedef struct _InfdLoopPoolJob InfdLoopPoolJob;
+struct _InfdLoopPoolJob {
+  InfdLoopPool* pool;
+  InfdLoopPoolLoop* loop;
+  InfIoDispatchFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+static InfdLoopPoolLoop*
+infd_loop_pool_loop_ref(InfdLoopPoolLoop* loop)
+{
+  g_atomic_int_inc(&loop->ref_count);
+  return loop;
+}
+
+static void
+infd_loop_pool_loop_unref(InfdLoopPoolLoop* loop)
+{
+  InfdLoopPoolInvocation* invocation;
+
+  if(g_atomic_int_dec_and_test(&loop->ref_count))
+  {
+    g_assert(loop->thread == NULL);
+
+    /* Functions invoked after the loop has quit are not run anymore */
+    while(!g_queue_is_empty(&loop->invocations))
+    {
+      invocation = (InfdLoopPoolInvocation*)g_queue_pop_head(
+        &loop->invocations
+      );
+
+      if(invocation->notify != NULL)
+        invocation->notify(invocation->user_data);
+      g_slice_free(InfdLoopPoolInvocation, invocation);
+    }
+
+    g_object_unref(loop->io);
+    g_slice_free(InfdLoopPoolLoop, loop);
+  }
+}
+
+static InfdLoopPoolLoop*
+infd_loop_pool_find_loop(InfdLoopPool* pool,
+                         InfIo* io)
+{
+  InfdLoopPoolPrivate* priv;
+  guint i;
+
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+  for(i = 0; i < priv->n_loops; ++i)
+    if(INF_IO(priv->loops[i]->io) == io)
+      return priv->loops[i];
+
+  return NULL;
+}
+
+static gpointer
+infd_loop_pool_thread_func(gpointer data)
+{
+  InfStandaloneIo* io;
+  io = INF_STANDALONE_IO(data);
+
+  inf_standalone_io_loop(io);
+  return NULL;
+}
+
+static void
+infd_loop_pool_quit_func(gpointer user_data)
+{
+  inf_standalone_io_loop_quit(INF_STANDALONE_IO(user_data));
+}
+
+static void
+infd_loop_pool_pause_func(gpointer user_data)
+{
+  InfdLoopPoolPrivate* priv;
+  priv = INFD_LOOP_POOL_PRIVATE(user_data);
+
+  g_mutex_lock(&priv->mutex);
+
+  ++priv->n_paused;
+  g_cond_broadcast(&priv->cond);
+
+  while(priv->paused)
+    g_cond_wait(&priv->cond, &priv->mutex);
+
+  --priv->n_paused;
+  g_cond_broadcast(&priv->cond);
+
+  g_mutex_unlock(&priv->mutex);
+}
+
+/* Runs a job scheduled with infd_loop_pool_schedule() in the thread of its
+ * loop, and lets infd_loop_pool_run_scheduled() know when it is done. */
+static void
+infd_loop_pool_job_func(gpointer user_data)
+{
+  InfdLoopPoolJob* job;
+  InfdLoopPoolPrivate* priv;
+
+  job = (InfdLoopPoolJob*)user_data;
+  priv = INFD_LOOP_POOL_PRIVATE(job->pool);
+
+  job->func(job->user_data);
+
+  g_mutex_lock(&priv->mutex);
+  --priv->n_running;
+  g_cond_broadcast(&priv->cond);
+  g_mutex_unlock(&priv->mutex);
+}
+
+static void
+infd_loop_pool_object_finalized_cb(gpointer data,
+                                   GObject* where_the_object_was)
+{
+  InfdLoopPoolLoop* loop;
+  loop = (InfdLoopPoolLoop*)data;
+
+  g_atomic_int_add(&loop->n_objects, -1);
+  infd_loop_pool_loop_unref(loop);
+}
+
+/* Runs in the thread of the loop */
+static void
+infd_loop_pool_dispatch_func(gpointer user_data)
+{
+  InfdLoopPoolDispatch* dispatch;
+  InfdLoopPoolPrivate* priv;
+  InfdLoopPoolInvocation* invocation;
+  GQueue invocations;
+
+  dispatch = (InfdLoopPoolDispatch*)user_data;
+  priv = INFD_LOOP_POOL_PRIVATE(dispatch->pool);
+
+  g_mutex_lock(&priv->mutex);
+  invocations = dispatch->loop->invocations;
+  g_queue_init(&dispatch->loop->invocations);
+  dispatch->loop->dispatched = FALSE;
+  g_mutex_unlock(&priv->mutex);
+
+  while(!g_queue_is_empty(&invocations))
+  {
+    invocation = (InfdLoopPoolInvocation*)g_queue_pop_head(&invocations);
+
+    invocation->func(invocation->user_data);
+    if(invocation->notify != NULL)
+      invocation->notify(invocation->user_data);
+
+    g_slice_free(InfdLoopPoolInvocation, invocation);
+  }
+}
+
+static void
+infd_loop_pool_dispatch_free(gpointer user_data)
+{
+  InfdLoopPoolDispatch* dispatch;
+  dispatch = (InfdLoopPoolDispatch*)user_data;
+
+  infd_loop_pool_loop_unref(dispatch->loop);
+  g_slice_free(InfdLoopPoolDispatch, dispatch);
+}
+
+static void
+infd_loop_pool_invoke_loop(InfdLoopPool* pool,
+                           InfdLoopPoolLoop* loop,
+                           InfIoDispatchFunc func,
+                           gpointer user_data,
+                           GDestroyNotify notify)
+{
+  InfdLoopPoolPrivate* priv;
+  InfdLoopPoolInvocation* invocation;
+  InfdLoopPoolDispatch* dispatch;
+
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  invocation = g_slice_new(InfdLoopPoolInvocation);
+  invocation->func = func;
+  invocation->user_data = user_data;
+  invocation->notify = notify;
+
+  dispatch = NULL;
+
+  g_mutex_lock(&priv->mutex);
+  g_queue_push_tail(&loop->invocations, invocation);
+  if(!loop->dispatched)
+  {
+    loop->dispatched = TRUE;
+
+    dispatch = g_slice_new(InfdLoopPoolDispatch);
+    dispatch->pool = pool;
+    dispatch->loop = infd_loop_pool_loop_ref(loop);
+  }
+  g_mutex_unlock(&priv->mutex);
+
+  if(dispatch != NULL)
+  {
+    inf_io_add_dispatch(
+      INF_IO(loop->io),
+      infd_loop_pool_dispatch_func,
+      dispatch,
+      infd_loop_pool_dispatch_free
+    );
+  }
+}
+
+static void
+infd_loop_pool_init(InfdLoopPool* pool)
+{
+  InfdLoopPoolPrivate* priv;
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  priv->n_loops = 1;
+  priv->loops = NULL;
+  priv->handshake_only = FALSE;
+
+  g_mutex_init(&priv->mutex);
+  g_cond_init(&priv->cond);
+  priv->paused = FALSE;
+  priv->n_paused = 0;
+
+  g_queue_init(&priv->scheduled);
+  priv->n_running = 0;
+}
+
+static void
+infd_loop_pool_constructed(GObject* object)
+{
+  InfdLoopPoolPrivate* priv;
+  InfdLoopPoolLoop* loop;
+  gchar* name;
+  guint i;
+
+  G_OBJECT_CLASS(infd_loop_pool_parent_class)->constructed(object);
+
+  priv = INFD_LOOP_POOL_PRIVATE(object);
+  priv->loops = g_malloc(sizeof(InfdLoopPoolLoop*) * priv->n_loops);
+
+  for(i = 0; i < priv->n_loops; ++i)
+  {
+    loop = g_slice_new(InfdLoopPoolLoop);
+    loop->ref_count = 1;
+    loop->n_objects = 0;
+    loop->io = inf_standalone_io_new();
+    g_queue_init(&loop->invocations);
+    loop->dispatched = FALSE;
+
+    name = g_strdup_printf("infd-loop-%u", i);
+    loop->thread = g_thread_new(name, infd_loop_pool_thread_func, loop->io);
+    g_free(name);
+
+    priv->loops[i] = loop;
+  }
+}
+
+static void
+infd_loop_pool_finalize(GObject* object)
+{
+  InfdLoopPool* pool;
+  InfdLoopPoolPrivate* priv;
+  guint i;
+
+  pool = INFD_LOOP_POOL(object);
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  g_assert(priv->paused == FALSE);
+  g_assert(g_queue_is_empty(&priv->scheduled));
+
+  /* Quit the loops only after everything that was invoked before, such as
+   * the release of connections, has been run. */
+  for(i = 0; i < priv->n_loops; ++i)
+  {
+    infd_loop_pool_invoke_loop(
+      pool,
+      priv->loops[i],
+      infd_loop_pool_quit_func,
+      priv->loops[i]->io,
+      NULL
+    );
+  }
+
+  for(i = 0; i < priv->n_loops; ++i)
+  {
+    g_thread_join(priv->loops[i]->thread);
+    priv->loops[i]->thread = NULL;
+
+    infd_loop_pool_loop_unref(priv->loops[i]);
+  }
+
+  g_free(priv->loops);
+
+  g_cond_clear(&priv->cond);
+  g_mutex_clear(&priv->mutex);
+
+  G_OBJECT_CLASS(infd_loop_pool_parent_class)->finalize(object);
+}
+
+static void
+infd_loop_pool_set_property(GObject* object,
+                            guint prop_id,
+                            const GValue* value,
+                            GParamSpec* pspec)
+{
+  InfdLoopPoolPrivate* priv;
+  priv = INFD_LOOP_POOL_PRIVATE(object);
+
+  switch(prop_id)
+  {
+  case PROP_N_LOOPS:
+    priv->n_loops = g_value_get_uint(value);
+    break;
+  case PROP_HANDSHAKE_ONLY:
+    priv->handshake_only = g_value_get_boolean(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+infd_loop_pool_get_property(GObject* object,
+                            guint prop_id,
+                            GValue* value,
+                            GParamSpec* pspec)
+{
+  InfdLoopPoolPrivate* priv;
+  priv = INFD_LOOP_POOL_PRIVATE(object);
+
+  switch(prop_id)
+  {
+  case PROP_N_LOOPS:
+    g_value_set_uint(value, priv->n_loops);
+    break;
+  case PROP_HANDSHAKE_ONLY:
+    g_value_set_boolean(value, priv->handshake_only);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+infd_loop_pool_class_init(InfdLoopPoolClass* loop_pool_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(loop_pool_class);
+
+  object_class->constructed = infd_loop_pool_constructed;
+  object_class->finalize = infd_loop_pool_finalize;
+  object_class->set_property = infd_loop_pool_set_property;
+  object_class->get_property = infd_loop_pool_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_N_LOOPS,
+    g_param_spec_uint(
+      "n-loops",
+      "Number of loops",
+      "The number of event loops, each running in its own thread",
+      1,
+      G_MAXUINT,
+      1,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_HANDSHAKE_ONLY,
+    g_param_spec_boolean(
+      "handshake-only",
+      "Handshake only",
+      "Whether connections are handed back to the main loop once they are "
+      "established",
+      FALSE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+}
+
+/**
+ * infd_loop_pool_new: (constructor)
+ * @n_loops: The number of event loops to run.
+ *
+ * Creates a new #InfdLoopPool and starts @n_loops threads, each of them
+ * running its own #InfStandaloneIo. The threads are stopped when the pool
+ * is finalized.
+ *
+ * Returns: (transfer full): A new #InfdLoopPool.
+ */
+InfdLoopPool*
+infd_loop_pool_new(guint n_loops)
+{
+  GObject* object;
+
+  g_return_val_if_fail(n_loops > 0, NULL);
+
+  object = g_object_new(INFD_TYPE_LOOP_POOL, "n-loops", n_loops, NULL);
+  return INFD_LOOP_POOL(object);
+}
+
+/**
+ * infd_loop_pool_get_n_loops:
+ * @pool: A #InfdLoopPool.
+ *
+ * Returns the number of event loops run by @pool.
+ *
+ * Returns: The number of event loops in @pool.
+ */
+guint
+infd_loop_pool_get_n_loops(InfdLoopPool* pool)
+{
+  g_return_val_if_fail(INFD_IS_LOOP_POOL(pool), 0);
+  return INFD_LOOP_POOL_PRIVATE(pool)->n_loops;
+}
+
+/**
+ * infd_loop_pool_get_handshake_only:
+ * @pool: A #InfdLoopPool.
+ *
+ * Returns whether connections run in @pool only until they are established.
+ * See #InfdLoopPool:handshake-only.
+ *
+ * Returns: The value of #InfdLoopPool:handshake-only.
+ */
+gboolean
+infd_loop_pool_get_handshake_only(InfdLoopPool* pool)
+{
+  g_return_val_if_fail(INFD_IS_LOOP_POOL(pool), FALSE);
+  return INFD_LOOP_POOL_PRIVATE(pool)->handshake_only;
+}
+
+/**
+ * infd_loop_pool_choose_loop:
+ * @pool: A #InfdLoopPool.
+ *
+ * Returns the event loop of @pool with the least number of objects
+ * assigned to it with infd_loop_pool_assign().
+ *
+ * Returns: (transfer none): The #InfIo of the least busy loop of @pool.
+ */
+InfIo*
+infd_loop_pool_choose_loop(InfdLoopPool* pool)
+{
+  InfdLoopPoolPrivate* priv;
+  InfdLoopPoolLoop* loop;
+  gint n_objects;
+  gint min_objects;
+  guint i;
+
+  g_return_val_if_fail(INFD_IS_LOOP_POOL(pool), NULL);
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  loop = priv->loops[0];
+  min_objects = g_atomic_int_get(&loop->n_objects);
+
+  for(i = 1; i < priv->n_loops; ++i)
+  {
+    n_objects = g_atomic_int_get(&priv->loops[i]->n_objects);
+    if(n_objects < min_objects)
+    {
+      loop = priv->loops[i];
+      min_objects = n_objects;
+    }
+  }
+
+  return INF_IO(loop->io);
+}
+
+/**
+ * infd_loop_pool_assign:
+ * @pool: A #InfdLoopPool.
+ * @loop: The #InfIo of one of the loops of @pool.
+ * @object: The object that runs in @loop.
+ *
+ * Assigns @object to @loop. The object counts towards the load of the loop,
+ * as seen by infd_loop_pool_choose_loop(), until it is finalized.
+ *
+ * From now on, @object must only be used from within @loop, for example by
+ * accessing it only in functions run with infd_loop_pool_invoke().
+ */
+void
+infd_loop_pool_assign(InfdLoopPool* pool,
+                      InfIo* loop,
+                      GObject* object)
+{
+  InfdLoopPoolLoop* pool_loop;
+
+  g_return_if_fail(INFD_IS_LOOP_POOL(pool));
+  g_return_if_fail(INF_IS_IO(loop));
+  g_return_if_fail(G_IS_OBJECT(object));
+
+  pool_loop = infd_loop_pool_find_loop(pool, loop);
+  g_return_if_fail(pool_loop != NULL);
+
+  g_atomic_int_inc(&pool_loop->n_objects);
+
+  g_object_weak_ref(
+    object,
+    infd_loop_pool_object_finalized_cb,
+    infd_loop_pool_loop_ref(pool_loop)
+  );
+}
+
+/**
+ * infd_loop_pool_unassign:
+ * @pool: A #InfdLoopPool.
+ * @loop: The #InfIo of the loop @object is assigned to.
+ * @object: An object assigned to @loop with infd_loop_pool_assign().
+ *
+ * Removes @object from @loop, for example because it has been moved to
+ * another #InfIo. It no longer counts towards the load of @loop.
+ */
+void
+infd_loop_pool_unassign(InfdLoopPool* pool,
+                        InfIo* loop,
+                        GObject* object)
+{
+  InfdLoopPoolLoop* pool_loop;
+
+  g_return_if_fail(INFD_IS_LOOP_POOL(pool));
+  g_return_if_fail(INF_IS_IO(loop));
+  g_return_if_fail(G_IS_OBJECT(object));
+
+  pool_loop = infd_loop_pool_find_loop(pool, loop);
+  g_return_if_fail(pool_loop != NULL);
+
+  g_object_weak_unref(object, infd_loop_pool_object_finalized_cb, pool_loop);
+  infd_loop_pool_object_finalized_cb(pool_loop, object);
+}
+
+/**
+ * infd_loop_pool_invoke:
+ * @pool: A #InfdLoopPool.
+ * @loop: The #InfIo of one of the loops of @pool.
+ * @func: (scope async): The function to run in @loop.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): A function called to free @user_data after @func
+ * has run, or %NULL.
+ *
+ * Runs @func in the thread of @loop as soon as possible. Functions invoked
+ * for the same loop are run in the order in which this function was called.
+ * This function can be called from any thread.
+ */
+void
+infd_loop_pool_invoke(InfdLoopPool* pool,
+                      InfIo* loop,
+                      InfIoDispatchFunc func,
+                      gpointer user_data,
+                      GDestroyNotify notify)
+{
+  InfdLoopPoolLoop* pool_loop;
+
+  g_return_if_fail(INFD_IS_LOOP_POOL(pool));
+  g_return_if_fail(INF_IS_IO(loop));
+  g_return_if_fail(func != NULL);
+
+  pool_loop = infd_loop_pool_find_loop(pool, loop);
+  g_return_if_fail(pool_loop != NULL);
+
+  infd_loop_pool_invoke_loop(pool, pool_loop, func, user_data, notify);
+}
+
+/**
+ * infd_loop_pool_schedule:
+ * @pool: A #InfdLoopPool.
+ * @loop: The #InfIo of one of the loops of @pool.
+ * @func: (scope async): The function to run in @loop.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): A function called to free @user_data after @func
+ * has run, or %NULL.
+ *
+ * Schedules @func to be run in the thread of @loop by the next call to
+ * infd_loop_pool_run_scheduled(). Unlike with infd_loop_pool_invoke(),
+ * @notify is called in the thread calling infd_loop_pool_run_scheduled(),
+ * after all scheduled functions have run.
+ *
+ * This function must only be called from the main thread.
+ */
+void
+infd_loop_pool_schedule(InfdLoopPool* pool,
+                        InfIo* loop,
+                        InfIoDispatchFunc func,
+                        gpointer user_data,
+                        GDestroyNotify notify)
+{
+  InfdLoopPoolPrivate* priv;
+  InfdLoopPoolLoop* pool_loop;
+  InfdLoopPoolJob* job;
+
+  g_return_if_fail(INFD_IS_LOOP_POOL(pool));
+  g_return_if_fail(INF_IS_IO(loop));
+  g_return_if_fail(func != NULL);
+
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+  pool_loop = infd_loop_pool_find_loop(pool, loop);
+  g_return_if_fail(pool_loop != NULL);
+
+  job = g_slice_new(InfdLoopPoolJob);
+  job->pool = pool;
+  job->loop = pool_loop;
+  job->func = func;
+  job->user_data = user_data;
+  job->notify = notify;
+
+  g_queue_push_tail(&priv->scheduled, job);
+}
+
+/**
+ * infd_loop_pool_run_scheduled:
+ * @pool: A #InfdLoopPool.
+ *
+ * Runs all functions scheduled with infd_loop_pool_schedule() in their
+ * loops, and blocks until they have finished. Functions scheduled for
+ * different loops run in parallel, and functions scheduled for the same
+ * loop run in the order in which they were scheduled. Afterwards, the
+ * notify functions of all of them are called in the calling thread.
+ *
+ * While this function blocks, the scheduled functions can access objects
+ * owned by the calling thread, as long as no two of them access the same
+ * object. This function must only be called from the main thread, and not
+ * while @pool is paused with infd_loop_pool_pause().
+ */
+void
+infd_loop_pool_run_scheduled(InfdLoopPool* pool)
+{
+  InfdLoopPoolPrivate* priv;
+  InfdLoopPoolJob* job;
+  GQueue scheduled;
+  GList* item;
+
+  g_return_if_fail(INFD_IS_LOOP_POOL(pool));
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  if(g_queue_is_empty(&priv->scheduled))
+    return;
+
+  g_mutex_lock(&priv->mutex);
+  if(priv->paused == TRUE)
+  {
+    g_mutex_unlock(&priv->mutex);
+    g_return_if_reached();
+  }
+
+  scheduled = priv->scheduled;
+  g_queue_init(&priv->scheduled);
+  priv->n_running += scheduled.length;
+  g_mutex_unlock(&priv->mutex);
+
+  for(item = scheduled.head; item != NULL; item = item->next)
+  {
+    job = (InfdLoopPoolJob*)item->data;
+
+    infd_loop_pool_invoke_loop(
+      pool,
+      job->loop,
+      infd_loop_pool_job_func,
+      job,
+      NULL
+    );
+  }
+
+  g_mutex_lock(&priv->mutex);
+  while(priv->n_running > 0)
+    g_cond_wait(&priv->cond, &priv->mutex);
+  g_mutex_unlock(&priv->mutex);
+
+  while(!g_queue_is_empty(&scheduled))
+  {
+    job = (InfdLoopPoolJob*)g_queue_pop_head(&scheduled);
+
+    if(job->notify != NULL)
+      job->notify(job->user_data);
+    g_slice_free(InfdLoopPoolJob, job);
+  }
+}
+
+/**
+ * infd_loop_pool_pause:
+ * @pool: A #InfdLoopPool.
+ *
+ * Blocks until all loops of @pool have finished what they are currently
+ * doing, and keeps them from doing anything else until
+ * infd_loop_pool_resume() is called. In the meanwhile, the calling thread
+ * can access objects assigned to the loops directly.
+ *
+ * This function must not be called from one of the loops of @pool, and
+ * calls cannot be nested.
+ */
+void
+infd_loop_pool_pause(InfdLoopPool* pool)
+{
+  InfdLoopPoolPrivate* priv;
+  guint i;
+
+  g_return_if_fail(INFD_IS_LOOP_POOL(pool));
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  g_mutex_lock(&priv->mutex);
+  if(priv->paused == TRUE)
+  {
+    g_mutex_unlock(&priv->mutex);
+    g_return_if_reached();
+  }
+  priv->paused = TRUE;
+  g_mutex_unlock(&priv->mutex);
+
+  for(i = 0; i < priv->n_loops; ++i)
+  {
+    infd_loop_pool_invoke_loop(
+      pool,
+      priv->loops[i],
+      infd_loop_pool_pause_func,
+      pool,
+      NULL
+    );
+  }
+
+  g_mutex_lock(&priv->mutex);
+  while(priv->n_paused < priv->n_loops)
+    g_cond_wait(&priv->cond, &priv->mutex);
+  g_mutex_unlock(&priv->mutex);
+}
+
+/**
+ * infd_loop_pool_resume:
+ * @pool: A #InfdLoopPool.
+ *
+ * Lets the loops of @pool continue after they have been paused with
+ * infd_loop_pool_pause().
+ */
+void
+infd_loop_pool_resume(InfdLoopPool* pool)
+{
+  InfdLoopPoolPrivate* priv;
+
+  g_return_if_fail(INFD_IS_LOOP_POOL(pool));
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  g_mutex_lock(&priv->mutex);
+  if(priv->paused == FALSE)
+  {
+    g_mutex_unlock(&priv->mutex);
+    g_return_if_reached();
+  }
+
+  priv->paused = FALSE;
+  g_cond_broadcast(&priv->cond);
+
+  while(priv->n_paused > 0)
+    g_cond_wait(&priv->cond, &priv->mutex);
+  g_mutex_unlock(&priv->mutex);
+}
+
+/**
+ * infd_loop_pool_is_paused:
+ * @pool: A #InfdLoopPool.
+ *
+ * Returns whether the loops of @pool are currently paused with
+ * infd_loop_pool_pause().
+ *
+ * Returns: %TRUE if @pool is paused, or %FALSE otherwise.
+ */
+gboolean
+infd_loop_pool_is_paused(InfdLoopPool* pool)
+{
+  InfdLoopPoolPrivate* priv;
+  gboolean paused;
+
+  g_return_val_if_fail(INFD_IS_LOOP_POOL(pool), FALSE);
+  priv = INFD_LOOP_POOL_PRIVATE(pool);
+
+  g_mutex_lock(&priv->mutex);
+  paused = priv->paused;
+  g_mutex_unlock(&priv->mutex);
+
+  return paused;
+}
+
+/* vim:set et sw=2 ts=2: */
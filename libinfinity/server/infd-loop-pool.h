@@ -0,0 +1,115 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INFD_LOOP_POOL_H__
+#define __INFD_LOOP_POOL_H__
+
+#include <libinfinity/common/inf-io.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INFD_TYPE_LOOP_POOL                 (infd_loop_pool_get_type())
+#define INFD_LOOP_POOL(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INFD_TYPE_LOOP_POOL, InfdLoopPool))
+#define INFD_LOOP_POOL_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INFD_TYPE_LOOP_POOL, InfdLoopPoolClass))
+#define INFD_IS_LOOP_POOL(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INFD_TYPE_LOOP_POOL))
+#define INFD_IS_LOOP_POOL_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INFD_TYPE_LOOP_POOL))
+#define INFD_LOOP_POOL_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INFD_TYPE_LOOP_POOL, InfdLoopPoolClass))
+
+typedef struct _InfdLoopPool InfdLoopPool;
+typedef struct _InfdLoopPoolClass InfdLoopPoolClass;
+
+/**
+ * InfdLoopPoolClass:
+ *
+ * This structure does not contain any public fields.
+ */
+struct _InfdLoopPoolClass {
+  /*< private >*/
+  GObjectClass parent_class;
+};
+
+/**
+ * InfdLoopPool:
+ *
+ * #InfdLoopPool is an opaque data type. You should only access it via the
+ * public API functions.
+ */
+struct _InfdLoopPool {
+  /*< private >*/
+  GObject parent;
+};
+
+GType
+infd_loop_pool_get_type(void) G_GNUC_CONST;
+
+InfdLoopPool*
+infd_loop_pool_new(guint n_loops);
+
+guint
+infd_loop_pool_get_n_loops(InfdLoopPool* pool);
+
+gboolean
+infd_loop_pool_get_handshake_only(InfdLoopPool* pool);
+
+InfIo*
+infd_loop_pool_choose_loop(InfdLoopPool* pool);
+
+void
+infd_loop_pool_assign(InfdLoopPool* pool,
+                      InfIo* loop,
+                      GObject* object);
+
+void
+infd_loop_pool_unassign(InfdLoopPool* pool,
+                        InfIo* loop,
+                        GObject* object);
+
+void
+infd_loop_pool_invoke(InfdLoopPool* pool,
+                      InfIo* loop,
+                      InfIoDispatchFunc func,
+                      gpointer user_data,
+                      GDestroyNotify notify);
+
+void
+infd_loop_pool_schedule(InfdLoopPool* pool,
+                        InfIo* loop,
+                        InfIoDispatchFunc func,
+                        gpointer user_data,
+                        GDestroyNotify notify);
+
+void
+infd_loop_pool_run_scheduled(InfdLoopPool* pool);
+
+void
+infd_loop_pool_pause(InfdLoopPool* pool);
+
+void
+infd_loop_pool_resume(InfdLoopPool* pool);
+
+gboolean
+infd_loop_pool_is_paused(InfdLoopPool* pool);
+
+G_END_DECLS
+
+#endif /* __INFD_LOOP_POOL_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -24,6 +24,7 @@
 #include <libinfinity/communication/inf-communication-manager.h>
 #include <libinfinity/communication/inf-communication-hosted-group.h>
 #include <libinfinity/common/inf-session.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/common/inf-io.h>
 
 #include <glib-object.h>
@@ -47,12 +48,39 @@ typedef InfSession*(*InfdNotePluginSessionRead)(InfdStorage*,
                                                 gpointer,
                                                 GError**);
 
+typedef gpointer(*InfdNotePluginSessionReadBegin)(InfdStorage*,
+                                                  InfIo*,
+                                                  InfCommunicationManager*,
+                                                  const gchar*,
+                                                  guint*,
+                                                  gpointer,
+                                                  GError**);
+
+typedef gboolean(*InfdNotePluginSessionReadNext)(gpointer,
+                                                 guint*,
+                                                 GError**);
+
+typedef InfSession*(*InfdNotePluginSessionReadEnd)(gpointer);
+
 typedef gboolean(*InfdNotePluginSessionWrite)(InfdStorage*,
                                               InfSession*,
                                               const gchar*,
                                               gpointer,
                                               GError**);
 
+typedef void(*InfdNotePluginSessionWriteFunc)(const GError*,
+                                              gpointer);
+
+typedef InfAsyncOperation*(*InfdNotePluginSessionWriteAsync)(
+  InfdStorage*,
+  InfIo*,
+  InfSession*,
+  const gchar*,
+  InfdNotePluginSessionWriteFunc,
+  gpointer,
+  gpointer,
+  GError**);
+
 typedef struct _InfdNotePlugin InfdNotePlugin;
 struct _InfdNotePlugin {
   gpointer user_data;
@@ -67,6 +95,27 @@ struct _InfdNotePlugin {
   InfdNotePluginSessionNew session_new;
   InfdNotePluginSessionRead session_read;
   InfdNotePluginSessionWrite session_write;
+
+  /* Optional. Writes a snapshot of the session in a worker thread, and calls
+   * the given function in the main thread when done. The returned operation
+   * can be freed to cancel the write. If this is NULL, sessions are always
+   * written with session_write. */
+  InfdNotePluginSessionWriteAsync session_write_async;
+
+  /* Optional. These read a session in steps, so that the server can do
+   * other things in between, and report the progress of subscription
+   * requests. session_read_begin starts reading and stores the number of
+   * steps, which is at least one, in its guint argument, returning a handle
+   * for the read, or NULL on error. session_read_next performs one step on
+   * that handle and stores the number of steps done so far. It returns TRUE
+   * if there are more steps to do, or FALSE if the session has been read
+   * completely or an error occurred, in which case the error is set.
+   * session_read_end frees the handle, and returns the session if it has
+   * been read completely, or NULL if the read was cancelled or failed. If
+   * these are NULL, sessions are always read with session_read. */
+  InfdNotePluginSessionReadBegin session_read_begin;
+  InfdNotePluginSessionReadNext session_read_next;
+  InfdNotePluginSessionReadEnd session_read_end;
 };
 
 G_END_DECLS
@@ -37,15 +37,25 @@
  *
  * #InfdSessionProxy implements the #InfSessionProxy interface, which can be
  * used to access the underlying #InfSession or to join a local user.
+ *
+ * If #InfdSessionProxy:loop-pool is set and the session is an
+ * #InfAdoptedSession, then the proxy is assigned to one of the loops of the
+ * pool, and the requests it receives are executed in that loop, in
+ * parallel to the requests of sessions owned by other loops. See
+ * #InfdLoopPool for details.
  */
 
 #include <libinfinity/server/infd-session-proxy.h>
 #include <libinfinity/server/infd-request.h>
+#include <libinfinity/server/infd-loop-pool.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/common/inf-session-proxy.h>
 #include <libinfinity/common/inf-request-result.h>
 #include <libinfinity/common/inf-io.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/communication/inf-communication-registry.h>
+#include <libinfinity/communication/inf-communication-group-private.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 
@@ -59,6 +69,16 @@ struct _InfdSessionProxySubscription {
   GSList* users; /* Available users joined via this connection */
 };
 
+/* A request received from a subscription, to be executed in the loop owning
+ * the session. Also used for what is deferred to the main loop while the
+ * request is executed. */
+typedef struct _InfdSessionProxyMessage InfdSessionProxyMessage;
+struct _InfdSessionProxyMessage {
+  InfdSessionProxy* proxy;
+  InfXmlConnection* connection;
+  xmlNodePtr xml;
+};
+
 typedef struct _InfdSessionProxyPrivate InfdSessionProxyPrivate;
 struct _InfdSessionProxyPrivate {
   InfIo* io;
@@ -72,6 +92,27 @@ struct _InfdSessionProxyPrivate {
   GSList* local_users;
   /* Whether there are any subscriptions / synchronizations */
   gboolean idle;
+
+  /* Random string identifying this copy of the session, to tell whether a
+   * client can resume its subscription */
+  gchar* identity;
+
+  /* The loop owning the session, if the session is sharded */
+  InfdLoopPool* loop_pool;
+  InfIo* loop;
+
+  /* Requests waiting to be executed in the owning loop */
+  GQueue messages;
+  gboolean scheduled;
+  gboolean processing;
+  InfIoDispatch* dispatch;
+
+  /* Set while the owning loop executes requests. The subscription group
+   * is held meanwhile, and connections unsubscribed meanwhile are only
+   * removed from the group afterwards. */
+  gboolean executing;
+  InfCommunicationGroup* held_group;
+  GSList* unsubscribed;
 };
 
 enum {
@@ -81,6 +122,7 @@ enum {
   PROP_IO,
   PROP_SESSION,
   PROP_SUBSCRIPTION_GROUP,
+  PROP_LOOP_POOL,
 
   /* read/only */
   PROP_IDLE
@@ -224,6 +266,300 @@ infd_session_proxy_user_notify_status_cb(InfUser* user,
  * Utility functions.
  */
 
+static void
+infd_session_proxy_message_free(gpointer data)
+{
+  InfdSessionProxyMessage* message;
+  message = (InfdSessionProxyMessage*)data;
+
+  if(message->xml != NULL)
+    xmlFreeNode(message->xml);
+  g_object_unref(message->connection);
+  if(message->proxy != NULL)
+    g_object_unref(message->proxy);
+
+  g_slice_free(InfdSessionProxyMessage, message);
+}
+
+static void
+infd_session_proxy_clear_messages(InfdSessionProxy* proxy)
+{
+  InfdSessionProxyPrivate* priv;
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  while(!g_queue_is_empty(&priv->messages))
+  {
+    infd_session_proxy_message_free(
+      g_queue_pop_head(&priv->messages)
+    );
+  }
+}
+
+/* Relays a request to the other subscriptions after it has been executed,
+ * which is what the central method does for messages with group scope. Run
+ * in the main loop, since it uses the communication registry. */
+static void
+infd_session_proxy_relay_func(gpointer user_data)
+{
+  InfdSessionProxyMessage* message;
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxySubscription* subscription;
+  InfCommunicationRegistry* registry;
+  GSList* connections;
+  GSList* item;
+
+  message = (InfdSessionProxyMessage*)user_data;
+  priv = INFD_SESSION_PROXY_PRIVATE(message->proxy);
+
+  if(priv->subscription_group == NULL)
+    return;
+
+  g_object_get(
+    G_OBJECT(priv->subscription_group),
+    "communication-registry", &registry,
+    NULL
+  );
+
+  if(registry == NULL)
+    return;
+
+  connections = NULL;
+  for(item = priv->subscriptions; item != NULL; item = item->next)
+  {
+    subscription = (InfdSessionProxySubscription*)item->data;
+    if(subscription->connection != message->connection)
+    {
+      connections = g_slist_prepend(
+        connections,
+        g_object_ref(subscription->connection)
+      );
+    }
+  }
+
+  inf_communication_registry_broadcast(
+    registry,
+    INF_COMMUNICATION_GROUP(priv->subscription_group),
+    connections,
+    message->xml
+  );
+
+  message->xml = NULL;
+
+  while(connections != NULL)
+  {
+    g_object_unref(connections->data);
+    connections = g_slist_delete_link(connections, connections);
+  }
+
+  g_object_unref(registry);
+}
+
+/* Unsubscribes a connection once the requests executed in the owning loop
+ * have been sent, see infd_session_proxy_unsubscribe(). */
+static void
+infd_session_proxy_unsubscribe_func(gpointer user_data)
+{
+  InfdSessionProxyMessage* message;
+  InfdSessionProxyPrivate* priv;
+
+  message = (InfdSessionProxyMessage*)user_data;
+  priv = INFD_SESSION_PROXY_PRIVATE(message->proxy);
+
+  if(priv->session != NULL &&
+     inf_session_get_status(priv->session) == INF_SESSION_RUNNING &&
+     infd_session_proxy_find_subscription(message->proxy,
+                                          message->connection) != NULL)
+  {
+    infd_session_proxy_unsubscribe(message->proxy, message->connection);
+  }
+}
+
+/* Executes the queued requests. This runs in the owning loop of the
+ * session, or in the main loop if the requests have to be processed before
+ * another message. */
+static void
+infd_session_proxy_process_messages(InfdSessionProxy* proxy)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxyMessage* message;
+  InfCommunicationScope scope;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  /* Signal handlers run while executing a request, such as one that
+   * unsubscribes the connection, must not execute the next one. */
+  if(priv->processing)
+    return;
+
+  priv->processing = TRUE;
+
+  while(!g_queue_is_empty(&priv->messages))
+  {
+    message = (InfdSessionProxyMessage*)g_queue_pop_head(&priv->messages);
+
+    /* The connection might have been unsubscribed in the meanwhile, in
+     * which case we would not have received the request at all. */
+    if(priv->session != NULL &&
+       inf_session_get_status(priv->session) == INF_SESSION_RUNNING &&
+       infd_session_proxy_find_subscription(proxy,
+                                            message->connection) != NULL &&
+       g_slist_find(priv->unsubscribed, message->connection) == NULL)
+    {
+      scope = inf_communication_object_received(
+        INF_COMMUNICATION_OBJECT(priv->session),
+        message->connection,
+        message->xml
+      );
+
+      if(scope == INF_COMMUNICATION_SCOPE_GROUP &&
+         priv->subscription_group != NULL)
+      {
+        message->proxy = g_object_ref(proxy);
+
+        _inf_communication_group_defer(
+          INF_COMMUNICATION_GROUP(priv->subscription_group),
+          infd_session_proxy_relay_func,
+          message,
+          infd_session_proxy_message_free
+        );
+
+        continue;
+      }
+    }
+
+    infd_session_proxy_message_free(message);
+  }
+
+  priv->processing = FALSE;
+}
+
+/* Runs in the owning loop of the session */
+static void
+infd_session_proxy_execute_func(gpointer user_data)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+
+  proxy = INFD_SESSION_PROXY(user_data);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  if(priv->subscription_group != NULL)
+  {
+    priv->held_group = INF_COMMUNICATION_GROUP(priv->subscription_group);
+    g_object_ref(priv->held_group);
+    _inf_communication_group_hold(priv->held_group);
+  }
+
+  priv->executing = TRUE;
+  infd_session_proxy_process_messages(proxy);
+  priv->executing = FALSE;
+}
+
+/* Runs in the main loop after the owning loop has executed the requests */
+static void
+infd_session_proxy_execute_notify(gpointer user_data)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+  InfCommunicationGroup* group;
+
+  proxy = INFD_SESSION_PROXY(user_data);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  priv->scheduled = FALSE;
+
+  if(priv->held_group != NULL)
+  {
+    group = priv->held_group;
+    priv->held_group = NULL;
+
+    _inf_communication_group_release(group);
+    g_object_unref(group);
+  }
+
+  g_slist_free(priv->unsubscribed);
+  priv->unsubscribed = NULL;
+
+  g_object_unref(proxy);
+}
+
+static void
+infd_session_proxy_dispatch_func(gpointer user_data)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdLoopPool* pool;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(user_data);
+  priv->dispatch = NULL;
+
+  /* This also runs the requests of all other sessions that were received
+   * in this main loop iteration */
+  pool = priv->loop_pool;
+  g_object_ref(pool);
+  infd_loop_pool_run_scheduled(pool);
+  g_object_unref(pool);
+}
+
+static void
+infd_session_proxy_dispatch_free(gpointer user_data)
+{
+  InfdSessionProxyPrivate* priv;
+  priv = INFD_SESSION_PROXY_PRIVATE(user_data);
+
+  /* If the main loop is shut down before the dispatch ran, then still run
+   * the scheduled requests, since they keep the proxy alive. */
+  if(priv->dispatch != NULL)
+  {
+    priv->dispatch = NULL;
+    infd_loop_pool_run_scheduled(priv->loop_pool);
+  }
+
+  g_object_unref(user_data);
+}
+
+static void
+infd_session_proxy_queue_message(InfdSessionProxy* proxy,
+                                 InfXmlConnection* connection,
+                                 xmlNodePtr xml)
+{
+  InfdSessionProxyPrivate* priv;
+  InfdSessionProxyMessage* message;
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  message = g_slice_new(InfdSessionProxyMessage);
+  message->proxy = NULL;
+  message->connection = connection;
+  message->xml = xmlCopyNode(xml, 1);
+  g_object_ref(connection);
+
+  g_queue_push_tail(&priv->messages, message);
+
+  if(!priv->scheduled)
+  {
+    priv->scheduled = TRUE;
+    g_object_ref(proxy);
+
+    infd_loop_pool_schedule(
+      priv->loop_pool,
+      priv->loop,
+      infd_session_proxy_execute_func,
+      proxy,
+      infd_session_proxy_execute_notify
+    );
+
+    if(priv->dispatch == NULL)
+    {
+      priv->dispatch = inf_io_add_dispatch(
+        priv->io,
+        infd_session_proxy_dispatch_func,
+        g_object_ref(proxy),
+        infd_session_proxy_dispatch_free
+      );
+    }
+  }
+}
+
 static gboolean
 infd_session_proxy_make_seq(InfdSessionProxy* proxy,
                             InfXmlConnection* connection,
@@ -508,6 +844,9 @@ infd_session_proxy_member_removed_cb(InfCommunicationGroup* group,
   proxy = INFD_SESSION_PROXY(user_data);
   priv = INFD_SESSION_PROXY_PRIVATE(proxy);
 
+  /* Execute what the connection sent before it left */
+  infd_session_proxy_process_messages(proxy);
+
   subscription = infd_session_proxy_find_subscription(proxy, connection);
   g_assert(subscription != NULL);
 
@@ -704,6 +1043,9 @@ infd_session_proxy_session_close_cb(InfSession* session,
   proxy = INFD_SESSION_PROXY(user_data);
   priv = INFD_SESSION_PROXY_PRIVATE(proxy);
 
+  /* Requests not executed yet are dropped with the session */
+  infd_session_proxy_clear_messages(proxy);
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(priv->subscription_group),
     G_CALLBACK(infd_session_proxy_member_removed_cb),
@@ -758,6 +1100,24 @@ infd_session_proxy_init(InfdSessionProxy* session_proxy)
   priv->user_id_counter = 1;
   priv->local_users = NULL;
   priv->idle = TRUE;
+
+  priv->loop_pool = NULL;
+  priv->loop = NULL;
+  g_queue_init(&priv->messages);
+  priv->scheduled = FALSE;
+  priv->processing = FALSE;
+  priv->dispatch = NULL;
+  priv->executing = FALSE;
+  priv->held_group = NULL;
+  priv->unsubscribed = NULL;
+
+  priv->identity = g_strdup_printf(
+    "%08x%08x%08x%08x",
+    g_random_int(),
+    g_random_int(),
+    g_random_int(),
+    g_random_int()
+  );
 }
 
 static void
@@ -787,6 +1147,14 @@ infd_session_proxy_constructed(GObject* object)
     priv->session,
     INF_COMMUNICATION_GROUP(priv->subscription_group)
   );
+
+  /* Only the requests of adopted sessions are executed in the loop owning
+   * the session. Everything else stays in the main loop. */
+  if(priv->loop_pool != NULL && INF_ADOPTED_IS_SESSION(priv->session))
+  {
+    priv->loop = infd_loop_pool_choose_loop(priv->loop_pool);
+    infd_loop_pool_assign(priv->loop_pool, priv->loop, object);
+  }
 }
 
 static void
@@ -805,6 +1173,8 @@ infd_session_proxy_dispose(GObject* object)
   g_slist_free(priv->local_users);
   priv->local_users = NULL;
 
+  infd_session_proxy_clear_messages(proxy);
+
   /* We need to close the session explicitely before we unref so that
    * the signal handler for the close signal is called. */
   /* Note this emits the close signal, removing all subscriptions and
@@ -857,11 +1227,31 @@ infd_session_proxy_dispose(GObject* object)
   g_object_unref(priv->io);
   priv->io = NULL;
 
+  if(priv->loop_pool != NULL)
+  {
+    g_object_unref(priv->loop_pool);
+    priv->loop_pool = NULL;
+  }
+
   g_object_unref(manager);
 
   G_OBJECT_CLASS(infd_session_proxy_parent_class)->dispose(object);
 }
 
+static void
+infd_session_proxy_finalize(GObject* object)
+{
+  InfdSessionProxy* proxy;
+  InfdSessionProxyPrivate* priv;
+
+  proxy = INFD_SESSION_PROXY(object);
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+
+  g_free(priv->identity);
+
+  G_OBJECT_CLASS(infd_session_proxy_parent_class)->finalize(object);
+}
+
 static void
 infd_session_proxy_session_init_user_func(InfUser* user,
                                           gpointer user_data)
@@ -965,6 +1355,10 @@ infd_session_proxy_set_property(GObject* object,
       proxy
     );
 
+    break;
+  case PROP_LOOP_POOL:
+    g_assert(priv->loop_pool == NULL); /* construct only */
+    priv->loop_pool = INFD_LOOP_POOL(g_value_dup_object(value));
     break;
   case PROP_IDLE:
     /* read/only */
@@ -997,6 +1391,9 @@ infd_session_proxy_get_property(GObject* object,
   case PROP_SUBSCRIPTION_GROUP:
     g_value_set_object(value, priv->subscription_group);
     break;
+  case PROP_LOOP_POOL:
+    g_value_set_object(value, priv->loop_pool);
+    break;
   case PROP_IDLE:
     g_value_set_boolean(value, priv->idle);
     break;
@@ -1214,6 +1611,19 @@ infd_session_proxy_communication_object_received(InfCommunicationObject* obj,
   status = inf_session_get_synchronization_status(priv->session, connection);
   local_error = NULL;
 
+  if(priv->loop != NULL && status == INF_SESSION_SYNC_NONE &&
+     inf_session_get_status(priv->session) == INF_SESSION_RUNNING &&
+     (strcmp((const char*)node->name, "request") == 0 ||
+      strcmp((const char*)node->name, "request-batch") == 0))
+  {
+    /* Relayed to the other subscriptions once it has been executed */
+    infd_session_proxy_queue_message(proxy, connection, node);
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
+
+  /* Keep the order in which messages were received */
+  infd_session_proxy_process_messages(proxy);
+
   if(status != INF_SESSION_SYNC_NONE)
   {
     return inf_communication_object_received(
@@ -1370,6 +1780,7 @@ infd_session_proxy_class_init(InfdSessionProxyClass* proxy_class)
 
   object_class->constructed = infd_session_proxy_constructed;
   object_class->dispose = infd_session_proxy_dispose;
+  object_class->finalize = infd_session_proxy_finalize;
   object_class->set_property = infd_session_proxy_set_property;
   object_class->get_property = infd_session_proxy_get_property;
 
@@ -1401,6 +1812,19 @@ infd_session_proxy_class_init(InfdSessionProxyClass* proxy_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_LOOP_POOL,
+    g_param_spec_object(
+      "loop-pool",
+      "Loop pool",
+      "The pool of event loops in which requests to the session are "
+      "executed, or NULL to execute them in the main loop",
+      INFD_TYPE_LOOP_POOL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_IDLE,
@@ -1574,6 +1998,11 @@ infd_session_proxy_subscribe_to(InfdSessionProxy* proxy,
     (synchronize == FALSE)
   );
 
+  /* Requests that are held back are already contained in the
+   * synchronization, so they must not reach the new subscriber. */
+  infd_session_proxy_process_messages(proxy);
+  inf_session_flush(priv->session);
+
   /* Note we can't do this in the default signal handler since it doesn't
    * know the parent group. TODO: We can, meanwhile. */
   inf_communication_hosted_group_add_member(
@@ -1607,6 +2036,68 @@ infd_session_proxy_subscribe_to(InfdSessionProxy* proxy,
   }
 }
 
+/**
+ * infd_session_proxy_resume_to:
+ * @proxy: A #InfdSessionProxy whose session is a #InfAdoptedSession.
+ * @connection: A #InfXmlConnection that is not yet subscribed.
+ * @seq_id: The sequence identifier for @connection.
+ * @vector: The state of the copy of the session that @connection has.
+ *
+ * Subscribes @connection to @proxy's session like
+ * infd_session_proxy_subscribe_to(), but instead of synchronizing the whole
+ * session, only the users and the requests that have been executed since
+ * @vector are sent, see inf_adopted_session_resume_to(). This is used when
+ * a client reconnects after having lost its connection, and still has a
+ * copy of the session. The copy must stem from @proxy, which the client can
+ * tell by infd_session_proxy_get_identity().
+ *
+ * If the session can not be resumed from @vector anymore because the
+ * requests since then have been removed from the request logs, then
+ * @connection is subscribed and then unsubscribed again, so that the
+ * client closes its copy of the session. In that case it needs to
+ * subscribe again normally.
+ *
+ * Returns: %TRUE if the subscription has been resumed, or %FALSE if the
+ * session could not be resumed from @vector.
+ **/
+gboolean
+infd_session_proxy_resume_to(InfdSessionProxy* proxy,
+                             InfXmlConnection* connection,
+                             guint seq_id,
+                             InfAdoptedStateVector* vector)
+{
+  InfdSessionProxyPrivate* priv;
+  InfAdoptedSession* session;
+
+  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), FALSE);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+  g_return_val_if_fail(vector != NULL, FALSE);
+
+  priv = INFD_SESSION_PROXY_PRIVATE(proxy);
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION(priv->session), FALSE);
+
+  session = INF_ADOPTED_SESSION(priv->session);
+
+  /* This flushes held back requests before connection is added to the
+   * subscription group, as required by inf_adopted_session_resume_to(). */
+  infd_session_proxy_subscribe_to(proxy, connection, seq_id, FALSE);
+
+  if(!inf_adopted_session_can_resume(session, vector))
+  {
+    infd_session_proxy_unsubscribe(proxy, connection);
+    return FALSE;
+  }
+
+  inf_adopted_session_resume_to(
+    session,
+    INF_COMMUNICATION_GROUP(priv->subscription_group),
+    connection,
+    vector
+  );
+
+  return TRUE;
+}
+
 /**
  * infd_session_proxy_unsubscribe:
  * @proxy: A #InfdSessionProxy.
@@ -1616,6 +2107,11 @@ infd_session_proxy_subscribe_to(InfdSessionProxy* proxy,
  * prevent all users joined via @connection to continue modifying the
  * session's buffer, and it will cancel ongoing synchronization to
  * @connection, if not yet finished.
+ *
+ * If this is called while a request is executed in the loop owning the
+ * session, see #InfdSessionProxy:loop-pool, then @connection is only
+ * unsubscribed once the main loop has sent the messages resulting from the
+ * request, but no further requests from @connection are executed.
  */
 void
 infd_session_proxy_unsubscribe(InfdSessionProxy* proxy,
@@ -1623,6 +2119,7 @@ infd_session_proxy_unsubscribe(InfdSessionProxy* proxy,
 {
   InfdSessionProxyPrivate* priv;
   InfdSessionProxySubscription* subscription;
+  InfdSessionProxyMessage* message;
   InfSessionSyncStatus status;
   xmlNodePtr xml;
 
@@ -1638,6 +2135,35 @@ infd_session_proxy_unsubscribe(InfdSessionProxy* proxy,
   subscription = infd_session_proxy_find_subscription(proxy, connection);
   g_return_if_fail(subscription != NULL);
 
+  if(priv->executing)
+  {
+    /* Called while executing a request in the owning loop, for example by
+     * a InfAdoptedSession::check-request handler. The subscription group
+     * is only used in the main loop, so unsubscribe from there, but do not
+     * execute any further requests from the connection until then. */
+    if(g_slist_find(priv->unsubscribed, connection) == NULL)
+    {
+      priv->unsubscribed = g_slist_prepend(priv->unsubscribed, connection);
+
+      message = g_slice_new(InfdSessionProxyMessage);
+      message->proxy = g_object_ref(proxy);
+      message->connection = g_object_ref(connection);
+      message->xml = NULL;
+
+      _inf_communication_group_defer(
+        INF_COMMUNICATION_GROUP(priv->subscription_group),
+        infd_session_proxy_unsubscribe_func,
+        message,
+        infd_session_proxy_message_free
+      );
+    }
+
+    return;
+  }
+
+  /* Execute what the connection sent before */
+  infd_session_proxy_process_messages(proxy);
+
   status = inf_session_get_synchronization_status(
     priv->session,
     subscription->connection
@@ -1738,4 +2264,23 @@ infd_session_proxy_is_idle(InfdSessionProxy* proxy)
   return INFD_SESSION_PROXY_PRIVATE(proxy)->idle;
 }
 
+/**
+ * infd_session_proxy_get_identity:
+ * @proxy: A #InfdSessionProxy.
+ *
+ * Returns a random string that identifies @proxy. It is sent to clients
+ * subscribing to the session, so that they can later resume their
+ * subscription with infd_session_proxy_resume_to() if they are still
+ * talking to the same copy of the session. A new identity is chosen every
+ * time the session is loaded from storage.
+ *
+ * Returns: The identity of @proxy.
+ **/
+const gchar*
+infd_session_proxy_get_identity(InfdSessionProxy* proxy)
+{
+  g_return_val_if_fail(INFD_IS_SESSION_PROXY(proxy), NULL);
+  return INFD_SESSION_PROXY_PRIVATE(proxy)->identity;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -20,6 +20,7 @@
 #ifndef __INFD_SESSION_PROXY_H__
 #define __INFD_SESSION_PROXY_H__
 
+#include <libinfinity/adopted/inf-adopted-state-vector.h>
 #include <libinfinity/common/inf-session.h>
 
 #include <glib-object.h>
@@ -88,6 +89,12 @@ infd_session_proxy_subscribe_to(InfdSessionProxy* proxy,
                                 guint seq_id,
                                 gboolean synchronize);
 
+gboolean
+infd_session_proxy_resume_to(InfdSessionProxy* proxy,
+                             InfXmlConnection* connection,
+                             guint seq_id,
+                             InfAdoptedStateVector* vector);
+
 void
 infd_session_proxy_unsubscribe(InfdSessionProxy* proxy,
                                InfXmlConnection* connection);
@@ -102,6 +109,9 @@ infd_session_proxy_is_subscribed(InfdSessionProxy* proxy,
 gboolean
 infd_session_proxy_is_idle(InfdSessionProxy* proxy);
 
+const gchar*
+infd_session_proxy_get_identity(InfdSessionProxy* proxy);
+
 G_END_DECLS
 
 #endif /* __INFD_SESSION_PROXY_H__ */
@@ -243,6 +243,10 @@ infd_storage_acl_list_free(GSList* node_list)
  * InfdStorageNode objects. Both the list and the objects need to
  * be freed by the caller via infd_storage_node_list_free().
  *
+ * If infd_storage_supports_concurrent_reads() returns %TRUE for @storage,
+ * then #InfdDirectory calls this function in a worker thread, so that
+ * reading a large directory does not block the server.
+ *
  * Returns: (transfer full) (element-type InfdStorageNode) (allow-none): A
  * #GSList that contains #InfdStorageNode objects, or %NULL if either the
  * subdirectory is empty or an error occurred.
@@ -380,4 +384,29 @@ infd_storage_write_acl(InfdStorage* storage,
   return iface->write_acl(storage, path, sheet_set, error);
 }
 
+/**
+ * infd_storage_supports_concurrent_reads:
+ * @storage: A #InfdStorage.
+ *
+ * Returns whether infd_storage_read_subdirectory() may be called in another
+ * thread while other functions are called on @storage. Storages declare
+ * this by implementing the supports_concurrent_reads virtual function;
+ * for storages that do not, this function returns %FALSE.
+ *
+ * Returns: Whether @storage supports reading subdirectories concurrently.
+ */
+gboolean
+infd_storage_supports_concurrent_reads(InfdStorage* storage)
+{
+  InfdStorageInterface* iface;
+
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), FALSE);
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+  if(iface->supports_concurrent_reads == NULL)
+    return FALSE;
+
+  return iface->supports_concurrent_reads(storage);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -91,6 +91,10 @@ struct _InfdStorageInterface {
                         const gchar* path,
                         const InfAclSheetSet* sheet_set,
                         GError** error);
+
+  /* Optional. Returns whether read_subdirectory may run in another thread
+   * at the same time as other calls. If not implemented, it may not. */
+  gboolean (*supports_concurrent_reads)(InfdStorage* storage);
 };
 
 GType
@@ -157,6 +161,9 @@ infd_storage_write_acl(InfdStorage* storage,
                        const InfAclSheetSet* sheet_set,
                        GError** error);
 
+gboolean
+infd_storage_supports_concurrent_reads(InfdStorage* storage);
+
 G_END_DECLS
 
 #endif /* __INFD_STORAGE_H__ */
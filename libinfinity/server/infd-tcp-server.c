@@ -67,6 +67,7 @@ struct _InfdTcpServerPrivate {
   guint local_port;
 
   InfKeepalive keepalive;
+  InfdLoopPool* loop_pool;
 };
 
 enum {
@@ -79,7 +80,8 @@ enum {
   PROP_LOCAL_ADDRESS,
   PROP_LOCAL_PORT,
 
-  PROP_KEEPALIVE
+  PROP_KEEPALIVE,
+  PROP_LOOP_POOL
 };
 
 enum {
@@ -154,6 +156,12 @@ infd_tcp_server_system_error(InfdTcpServer* server,
   g_error_free(error);
 }
 
+static void
+infd_tcp_server_start_func(gpointer user_data)
+{
+  _inf_tcp_connection_accepted_start(INF_TCP_CONNECTION(user_data));
+}
+
 static void
 infd_tcp_server_io(InfNativeSocket* socket,
                    InfIoEvent events,
@@ -165,6 +173,8 @@ infd_tcp_server_io(InfNativeSocket* socket,
   InfNativeSocket new_socket;
   int errcode;
   InfTcpConnection* connection;
+  InfdLoopPool* loop_pool;
+  InfIo* loop;
   GError* error;
 
   union {
@@ -233,19 +243,46 @@ infd_tcp_server_io(InfNativeSocket* socket,
         }
 
         error = NULL;
-        connection = _inf_tcp_connection_accepted(
-          priv->io,
-          new_socket,
-          address,
-          port,
-          &priv->keepalive,
-          &error
-        );
+        loop_pool = priv->loop_pool;
+
+        if(loop_pool != NULL)
+        {
+          /* The connection runs in one of the loops of the pool. It is
+           * started in its loop only after the signal handlers of
+           * new-connection had a chance to set it up for that loop. */
+          g_object_ref(loop_pool);
+          loop = infd_loop_pool_choose_loop(loop_pool);
+
+          connection = _inf_tcp_connection_accepted_deferred(
+            loop,
+            new_socket,
+            address,
+            port,
+            &priv->keepalive,
+            &error
+          );
+        }
+        else
+        {
+          loop = NULL;
+
+          connection = _inf_tcp_connection_accepted(
+            priv->io,
+            new_socket,
+            address,
+            port,
+            &priv->keepalive,
+            &error
+          );
+        }
 
         /* _inf_tcp_connection_accepted() takes ownership of address */
 
         if(connection != NULL)
         {
+          if(loop_pool != NULL)
+            infd_loop_pool_assign(loop_pool, loop, G_OBJECT(connection));
+
           g_signal_emit(
             G_OBJECT(server),
             tcp_server_signals[NEW_CONNECTION],
@@ -253,7 +290,20 @@ infd_tcp_server_io(InfNativeSocket* socket,
             connection
           );
 
-          g_object_unref(connection);
+          if(loop_pool != NULL)
+          {
+            infd_loop_pool_invoke(
+              loop_pool,
+              loop,
+              infd_tcp_server_start_func,
+              connection,
+              g_object_unref
+            );
+          }
+          else
+          {
+            g_object_unref(connection);
+          }
         }
         else
         {
@@ -267,6 +317,9 @@ infd_tcp_server_io(InfNativeSocket* socket,
           g_error_free(error);
           closesocket(new_socket);
         }
+
+        if(loop_pool != NULL)
+          g_object_unref(loop_pool);
       }
     } while( (new_socket != INVALID_SOCKET ||
               (new_socket == INVALID_SOCKET &&
@@ -292,6 +345,7 @@ infd_tcp_server_init(InfdTcpServer* server)
   priv->local_port = 0;
 
   priv->keepalive.mask = 0;
+  priv->loop_pool = NULL;
 }
 
 static void
@@ -312,6 +366,12 @@ infd_tcp_server_dispose(GObject* object)
     priv->io = NULL;
   }
 
+  if(priv->loop_pool != NULL)
+  {
+    g_object_unref(priv->loop_pool);
+    priv->loop_pool = NULL;
+  }
+
   G_OBJECT_CLASS(infd_tcp_server_parent_class)->dispose(object);
 }
 
@@ -363,6 +423,10 @@ infd_tcp_server_set_property(GObject* object,
     g_assert(g_value_get_boxed(value) != NULL);
     priv->keepalive = *(const InfKeepalive*)g_value_get_boxed(value);
     break;
+  case PROP_LOOP_POOL:
+    if(priv->loop_pool != NULL) g_object_unref(priv->loop_pool);
+    priv->loop_pool = INFD_LOOP_POOL(g_value_dup_object(value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -398,6 +462,9 @@ infd_tcp_server_get_property(GObject* object,
   case PROP_KEEPALIVE:
     g_value_set_boxed(value, &priv->keepalive);
     break;
+  case PROP_LOOP_POOL:
+    g_value_set_object(value, priv->loop_pool);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -508,6 +575,29 @@ infd_tcp_server_class_init(InfdTcpServerClass* tcp_server_class)
     )
   );
 
+  /**
+   * InfdTcpServer:loop-pool:
+   *
+   * If set, then accepted connections are not run in
+   * #InfdTcpServer:io, but each of them is assigned to one of the loops of
+   * the pool instead. Such a connection is passed to the
+   * #InfdTcpServer::new-connection signal in status
+   * %INF_TCP_CONNECTION_CONNECTING, and it is started in its loop after the
+   * signal handlers have run. From then on it must only be accessed from
+   * within its loop, see #InfdLoopPool.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_LOOP_POOL,
+    g_param_spec_object(
+      "loop-pool",
+      "Loop pool",
+      "Event loops to run accepted connections in",
+      INFD_TYPE_LOOP_POOL,
+      G_PARAM_READWRITE
+    )
+  );
+
   tcp_server_signals[NEW_CONNECTION] = g_signal_new(
     "new-connection",
     G_OBJECT_CLASS_TYPE(object_class),
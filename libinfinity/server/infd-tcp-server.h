@@ -20,6 +20,7 @@
 #ifndef __INFD_TCP_SERVER_H__
 #define __INFD_TCP_SERVER_H__
 
+#include <libinfinity/server/infd-loop-pool.h>
 #include <libinfinity/common/inf-tcp-connection.h>
 
 #include <glib-object.h>
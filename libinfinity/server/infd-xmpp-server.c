@@ -20,6 +20,7 @@
 #include <libinfinity/server/infd-xmpp-server.h>
 #include <libinfinity/server/infd-tcp-server.h>
 #include <libinfinity/server/infd-xml-server.h>
+#include <libinfinity/server/infd-loop-connection.h>
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-signals.h>
 
@@ -47,6 +48,16 @@ struct _InfdXmppServerPrivate {
   InfSaslContext* sasl_context;
   InfSaslContext* sasl_own_context;
   gchar* sasl_mechanisms;
+
+  /* Admission control */
+  guint max_accept_rate;
+  gdouble accept_tokens;
+  gint64 accept_time;
+
+  guint max_handshakes;
+  GSList* handshakes;
+
+  gint compression_level;
 };
 
 enum {
@@ -61,6 +72,11 @@ enum {
 
   PROP_SECURITY_POLICY,
 
+  PROP_MAX_ACCEPT_RATE,
+  PROP_MAX_HANDSHAKES,
+
+  PROP_COMPRESSION_LEVEL,
+
   /* Overridden from XML server */
   PROP_STATUS
 };
@@ -80,6 +96,70 @@ G_DEFINE_TYPE_WITH_CODE(InfdXmppServer, infd_xmpp_server, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfdXmppServer)
   G_IMPLEMENT_INTERFACE(INFD_TYPE_XML_SERVER, infd_xmpp_server_xml_server_iface_init))
 
+static void
+infd_xmpp_server_handshake_notify_status_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfdXmppServer* xmpp;
+  InfdXmppServerPrivate* priv;
+  InfXmlConnectionStatus status;
+
+  xmpp = INFD_XMPP_SERVER(user_data);
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+
+  g_object_get(object, "status", &status, NULL);
+  if(status != INF_XML_CONNECTION_OPENING)
+  {
+    /* The handshake has either completed or failed */
+    inf_signal_handlers_disconnect_by_func(
+      object,
+      G_CALLBACK(infd_xmpp_server_handshake_notify_status_cb),
+      xmpp
+    );
+
+    priv->handshakes = g_slist_remove(priv->handshakes, object);
+    g_object_unref(object);
+  }
+}
+
+/* Returns whether a new connection may be accepted, based on the maximum
+ * accept rate and the maximum number of concurrent handshakes. The accept
+ * rate is enforced with a token bucket that allows bursts of up to one
+ * second worth of connections. */
+static gboolean
+infd_xmpp_server_admit(InfdXmppServer* xmpp)
+{
+  InfdXmppServerPrivate* priv;
+  gint64 now;
+
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp);
+
+  if(priv->max_handshakes > 0 &&
+     g_slist_length(priv->handshakes) >= priv->max_handshakes)
+  {
+    return FALSE;
+  }
+
+  if(priv->max_accept_rate > 0)
+  {
+    now = g_get_monotonic_time();
+
+    priv->accept_tokens +=
+      (gdouble)(now - priv->accept_time) * priv->max_accept_rate / 1e6;
+    if(priv->accept_tokens > priv->max_accept_rate)
+      priv->accept_tokens = priv->max_accept_rate;
+    priv->accept_time = now;
+
+    if(priv->accept_tokens < 1.0)
+      return FALSE;
+
+    priv->accept_tokens -= 1.0;
+  }
+
+  return TRUE;
+}
+
 static void
 infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
                                    InfTcpConnection* tcp_connection,
@@ -88,12 +168,24 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
   InfdXmppServer* xmpp_server;
   InfdXmppServerPrivate* priv;
   InfXmppConnection* xmpp_connection;
+  InfdLoopPool* loop_pool;
+  InfIo* io;
+  InfIo* loop;
+  InfXmlConnection* connection;
   InfIpAddress* addr;
   gchar* addr_str;
 
   xmpp_server = INFD_XMPP_SERVER(user_data);
   priv = INFD_XMPP_SERVER_PRIVATE(xmpp_server);
 
+  /* Drop the connection right away if we are over the limits, before any
+   * resources are spent on a TLS or SASL handshake for it. */
+  if(!infd_xmpp_server_admit(xmpp_server))
+  {
+    inf_tcp_connection_close(tcp_connection);
+    return;
+  }
+
   /* TODO: We could perform a reverse DNS lookup to find the client hostname
    * here. */
   g_object_get(G_OBJECT(tcp_connection), "remote-address", &addr, NULL);
@@ -113,15 +205,59 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
 
   g_free(addr_str);
 
+  g_object_set(
+    G_OBJECT(xmpp_connection),
+    "compression-level", priv->compression_level,
+    NULL
+  );
+
+  /* If the TCP connection runs in a loop of a loop pool, then so does the
+   * XMPP connection, and we hand out a connection that forwards to it in
+   * our own loop instead. */
+  g_object_get(G_OBJECT(tcp_server), "loop-pool", &loop_pool, NULL);
+  if(loop_pool != NULL)
+  {
+    g_object_get(G_OBJECT(tcp_server), "io", &io, NULL);
+    g_object_get(G_OBJECT(tcp_connection), "io", &loop, NULL);
+
+    connection = INF_XML_CONNECTION(
+      infd_loop_connection_new(
+        io,
+        loop_pool,
+        loop,
+        INF_XML_CONNECTION(xmpp_connection)
+      )
+    );
+
+    g_object_unref(loop);
+    g_object_unref(io);
+    g_object_unref(loop_pool);
+    g_object_unref(xmpp_connection);
+  }
+  else
+  {
+    connection = INF_XML_CONNECTION(xmpp_connection);
+  }
+
+  if(priv->max_handshakes > 0)
+  {
+    priv->handshakes = g_slist_prepend(priv->handshakes, connection);
+    g_object_ref(connection);
+
+    g_signal_connect(
+      G_OBJECT(connection),
+      "notify::status",
+      G_CALLBACK(infd_xmpp_server_handshake_notify_status_cb),
+      xmpp_server
+    );
+  }
+
   /* We could, alternatively, keep the connection around until authentication
    * has completed and emit the new_connection signal after that, to guarantee
    * that the connection is open when new_connection is emitted. */
-  infd_xml_server_new_connection(
-    INFD_XML_SERVER(xmpp_server),
-    INF_XML_CONNECTION(xmpp_connection)
-  );
+  infd_xml_server_new_connection(INFD_XML_SERVER(xmpp_server), connection);
 
-  g_object_unref(G_OBJECT(xmpp_connection));
+  g_object_unref(connection);
 }
 
 static void
@@ -358,6 +494,15 @@ infd_xmpp_server_init(InfdXmppServer* xmpp)
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_mechanisms = NULL;
+
+  priv->max_accept_rate = 0;
+  priv->accept_tokens = 0.0;
+  priv->accept_time = 0;
+
+  priv->max_handshakes = 0;
+  priv->handshakes = NULL;
+
+  priv->compression_level = 0;
 }
 
 static void
@@ -374,6 +519,20 @@ infd_xmpp_server_dispose(GObject* object)
 
   infd_xmpp_server_set_tcp(xmpp, NULL);
 
+  while(priv->handshakes != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->handshakes->data),
+      G_CALLBACK(infd_xmpp_server_handshake_notify_status_cb),
+      xmpp
+    );
+
+    g_object_unref(priv->handshakes->data);
+
+    priv->handshakes =
+      g_slist_delete_link(priv->handshakes, priv->handshakes);
+  }
+
   if(priv->sasl_own_context != NULL)
   {
     inf_sasl_context_unref(priv->sasl_own_context);
@@ -462,6 +621,15 @@ infd_xmpp_server_set_property(GObject* object,
   case PROP_SECURITY_POLICY:
     infd_xmpp_server_set_security_policy(xmpp, g_value_get_enum(value));
     break;
+  case PROP_MAX_ACCEPT_RATE:
+    infd_xmpp_server_set_max_accept_rate(xmpp, g_value_get_uint(value));
+    break;
+  case PROP_MAX_HANDSHAKES:
+    infd_xmpp_server_set_max_handshakes(xmpp, g_value_get_uint(value));
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    infd_xmpp_server_set_compression_level(xmpp, g_value_get_int(value));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -515,6 +683,15 @@ infd_xmpp_server_get_property(GObject* object,
   case PROP_SECURITY_POLICY:
     g_value_set_enum(value, priv->security_policy);
     break;
+  case PROP_MAX_ACCEPT_RATE:
+    g_value_set_uint(value, priv->max_accept_rate);
+    break;
+  case PROP_MAX_HANDSHAKES:
+    g_value_set_uint(value, priv->max_handshakes);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_int(value, priv->compression_level);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -628,6 +805,51 @@ infd_xmpp_server_class_init(InfdXmppServerClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_ACCEPT_RATE,
+    g_param_spec_uint(
+      "max-accept-rate",
+      "Maximum accept rate",
+      "The maximum number of connections accepted per second, or 0 for no "
+      "limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_HANDSHAKES,
+    g_param_spec_uint(
+      "max-handshakes",
+      "Maximum handshakes",
+      "The maximum number of connections which are not yet fully "
+      "established, or 0 for no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_int(
+      "compression-level",
+      "Compression level",
+      "The zlib compression level offered to new connections, or 0 to not "
+      "offer stream compression",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
 
   xmpp_server_signals[ERROR] = g_signal_new(
@@ -676,6 +898,12 @@ infd_xmpp_server_xml_server_iface_init(InfdXmlServerInterface* iface)
  * @sasl_mechanisms is %NULL, then all available mechanims will be offered.
  * If @sasl_context is %NULL, then this parameter is ignored.
  *
+ * If @tcp has a #InfdTcpServer:loop-pool set, then each XMPP connection
+ * runs in the loop its TCP connection was assigned to, and the server hands
+ * out a #InfdLoopConnection forwarding to it instead. The callbacks of
+ * @sasl_context and a certificate callback set on the XMPP connection are
+ * then called in that loop, too.
+ *
  * Return Value: (transfer full): A new #InfdXmppServer.
  **/
 InfdXmppServer*
@@ -757,4 +985,143 @@ infd_xmpp_server_get_security_policy(InfdXmppServer* server)
   return INFD_XMPP_SERVER_PRIVATE(server)->security_policy;
 }
 
+/**
+ * infd_xmpp_server_set_max_accept_rate:
+ * @server: A #InfdXmppServer.
+ * @rate: The maximum number of connections to accept per second, or 0.
+ *
+ * Limits the rate at which @server accepts new connections. Up to @rate
+ * connections can be accepted in a burst, after that one connection every
+ * 1/@rate seconds. Connections coming in faster than that are closed right
+ * after they have been accepted by the underlying #InfdTcpServer, before
+ * any handshake is made, and #InfdXmlServer::new-connection is not emitted
+ * for them. This protects the server from floods of new connections. If
+ * @rate is 0, then there is no limit.
+ */
+void
+infd_xmpp_server_set_max_accept_rate(InfdXmppServer* server,
+                                     guint rate)
+{
+  InfdXmppServerPrivate* priv;
+
+  g_return_if_fail(INFD_IS_XMPP_SERVER(server));
+  priv = INFD_XMPP_SERVER_PRIVATE(server);
+
+  if(priv->max_accept_rate != rate)
+  {
+    /* Start with a full bucket */
+    priv->max_accept_rate = rate;
+    priv->accept_tokens = rate;
+    priv->accept_time = g_get_monotonic_time();
+
+    g_object_notify(G_OBJECT(server), "max-accept-rate");
+  }
+}
+
+/**
+ * infd_xmpp_server_get_max_accept_rate:
+ * @server: A #InfdXmppServer.
+ *
+ * Returns the maximum accept rate of @server, see
+ * infd_xmpp_server_set_max_accept_rate().
+ *
+ * Returns: The maximum number of connections accepted per second, or 0 if
+ * there is no limit.
+ */
+guint
+infd_xmpp_server_get_max_accept_rate(InfdXmppServer* server)
+{
+  g_return_val_if_fail(INFD_IS_XMPP_SERVER(server), 0);
+  return INFD_XMPP_SERVER_PRIVATE(server)->max_accept_rate;
+}
+
+/**
+ * infd_xmpp_server_set_max_handshakes:
+ * @server: A #InfdXmppServer.
+ * @max_handshakes: The maximum number of concurrent handshakes, or 0.
+ *
+ * Limits the number of connections of @server which are still in status
+ * %INF_XML_CONNECTION_OPENING, i.e. for which the TLS and SASL handshakes
+ * have not yet completed. New connections exceeding the limit are closed in
+ * the same way as for infd_xmpp_server_set_max_accept_rate(). Connections
+ * accepted while there was no limit are not counted. If @max_handshakes is
+ * 0, then there is no limit.
+ */
+void
+infd_xmpp_server_set_max_handshakes(InfdXmppServer* server,
+                                    guint max_handshakes)
+{
+  InfdXmppServerPrivate* priv;
+
+  g_return_if_fail(INFD_IS_XMPP_SERVER(server));
+  priv = INFD_XMPP_SERVER_PRIVATE(server);
+
+  if(priv->max_handshakes != max_handshakes)
+  {
+    priv->max_handshakes = max_handshakes;
+    g_object_notify(G_OBJECT(server), "max-handshakes");
+  }
+}
+
+/**
+ * infd_xmpp_server_get_max_handshakes:
+ * @server: A #InfdXmppServer.
+ *
+ * Returns the maximum number of concurrent handshakes of @server, see
+ * infd_xmpp_server_set_max_handshakes().
+ *
+ * Returns: The maximum number of concurrent handshakes, or 0 if there is no
+ * limit.
+ */
+guint
+infd_xmpp_server_get_max_handshakes(InfdXmppServer* server)
+{
+  g_return_val_if_fail(INFD_IS_XMPP_SERVER(server), 0);
+  return INFD_XMPP_SERVER_PRIVATE(server)->max_handshakes;
+}
+
+/**
+ * infd_xmpp_server_set_compression_level:
+ * @server: A #InfdXmppServer.
+ * @level: The zlib compression level from 1 to 9, or 0.
+ *
+ * Sets the #InfXmppConnection:compression-level of connections accepted by
+ * @server from now on. If it is nonzero, the server offers stream
+ * compression to clients using binary framing. Compression is off by
+ * default, since it can leak the content of encrypted connections, see the
+ * documentation of #InfXmppConnection.
+ */
+void
+infd_xmpp_server_set_compression_level(InfdXmppServer* server,
+                                       gint level)
+{
+  InfdXmppServerPrivate* priv;
+
+  g_return_if_fail(INFD_IS_XMPP_SERVER(server));
+  g_return_if_fail(level >= 0 && level <= 9);
+  priv = INFD_XMPP_SERVER_PRIVATE(server);
+
+  if(priv->compression_level != level)
+  {
+    priv->compression_level = level;
+    g_object_notify(G_OBJECT(server), "compression-level");
+  }
+}
+
+/**
+ * infd_xmpp_server_get_compression_level:
+ * @server: A #InfdXmppServer.
+ *
+ * Returns the compression level offered to new connections of @server, see
+ * infd_xmpp_server_set_compression_level().
+ *
+ * Returns: The zlib compression level, or 0 if compression is not offered.
+ */
+gint
+infd_xmpp_server_get_compression_level(InfdXmppServer* server)
+{
+  g_return_val_if_fail(INFD_IS_XMPP_SERVER(server), 0);
+  return INFD_XMPP_SERVER_PRIVATE(server)->compression_level;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -70,6 +70,27 @@ infd_xmpp_server_set_security_policy(InfdXmppServer* server,
 InfXmppConnectionSecurityPolicy
 infd_xmpp_server_get_security_policy(InfdXmppServer* server);
 
+void
+infd_xmpp_server_set_max_accept_rate(InfdXmppServer* server,
+                                     guint rate);
+
+guint
+infd_xmpp_server_get_max_accept_rate(InfdXmppServer* server);
+
+void
+infd_xmpp_server_set_max_handshakes(InfdXmppServer* server,
+                                    guint max_handshakes);
+
+guint
+infd_xmpp_server_get_max_handshakes(InfdXmppServer* server);
+
+void
+infd_xmpp_server_set_compression_level(InfdXmppServer* server,
+                                       gint level);
+
+gint
+infd_xmpp_server_get_compression_level(InfdXmppServer* server);
+
 G_END_DECLS
 
 #endif /* __INFD_XMPP_SERVER_H__ */
@@ -50,6 +50,10 @@
 
 #include <string.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 G_DEFINE_BOXED_TYPE(InfTextChunkIter, inf_text_chunk_iter, inf_text_chunk_iter_copy, inf_text_chunk_iter_free)
 G_DEFINE_BOXED_TYPE(InfTextChunk, inf_text_chunk, inf_text_chunk_copy, inf_text_chunk_free)
 
@@ -62,47 +66,239 @@ struct _InfTextChunkPath {
                           gchar* text,
                           gsize bytes,
                           guint offset);
+
+  /* Whether all characters have the same number of bytes. In that case
+   * get_byte_index runs in constant time, and no checkpoints are kept. */
+  gboolean fixed_width;
 };
 
+typedef struct _InfTextChunkSegment InfTextChunkSegment;
+
+/* The byte index at which a character of a segment starts */
+typedef struct _InfTextChunkCheckpoint InfTextChunkCheckpoint;
+struct _InfTextChunkCheckpoint {
+  guint chars;
+  gsize bytes;
+};
+
+/* For encodings with a variable number of bytes per character, segments
+ * with more than twice this many characters remember the byte index of
+ * every this-many-th character, so that finding the byte index of a
+ * character does not need to scan the segment from its beginning. */
+#define INF_TEXT_CHUNK_CHECKPOINT_INTERVAL 1024
+
+/* The segments of a chunk are stored in an AVL tree, ordered by their
+ * position in the text. Segments do not store their absolute offset.
+ * Instead, each node caches the number of characters and bytes in its
+ * subtree, so that the segment at a given character offset can be found,
+ * and the offset of a given segment can be computed, in logarithmic time.
+ * Inserting or erasing text then only needs to update the nodes on the path
+ * to the root, instead of shifting the offsets of all following segments. */
 struct _InfTextChunk {
-  GSequence* segments;
+  InfTextChunkSegment* root;
   guint length; /* in characters */
   GQuark encoding;
 
   const InfTextChunkPath* path;
 };
 
-typedef struct _InfTextChunkSegment InfTextChunkSegment;
+/* The text of a segment is reference counted, so that copies of a chunk can
+ * share it. The reference count is stored in front of the text. Shared text
+ * is never modified; inf_text_chunk_segment_make_writable() makes a private
+ * copy first. The reference count is changed atomically, so that a copy of
+ * a chunk can be read and freed in another thread while the original chunk
+ * is being modified. */
+typedef struct _InfTextChunkText InfTextChunkText;
+struct _InfTextChunkText {
+  gint ref_count;
+};
+
+#define INF_TEXT_CHUNK_TEXT_HEADER(text) \
+  ((InfTextChunkText*)((text) - sizeof(InfTextChunkText)))
+
 struct _InfTextChunkSegment {
+  InfTextChunkSegment* parent;
+  InfTextChunkSegment* left;
+  InfTextChunkSegment* right;
+  guint height;
+
   guint author;
   /* This is gchar so that we can do pointer arithmetic. It does not
    * necessarily store a full character in each byte. This depends on the
    * encoding specified in the InfTextChunk. */
   gchar* text;
   gsize length; /* in bytes */
-  guint offset; /* absolute to chunk begin in characters, sort criteria */
+  guint chars; /* in characters */
+
+  /* Sum of the above for this segment and all its descendants */
+  gsize subtree_length;
+  guint subtree_chars;
+
+  /* Sorted by character offset, or NULL if not yet needed. These are not
+   * shared between copies, and they are updated along with the text,
+   * see inf_text_chunk_segment_get_byte_index(). */
+  InfTextChunkCheckpoint* checkpoints;
+  guint n_checkpoints;
 };
 
 /*
  * get_byte_index paths
  */
 
-gsize inf_text_chunk_get_byte_index_utf8(InfTextChunk* self,
-                                         gchar* text,
-                                         gsize bytes,
-                                         guint offset)
+/* Bytes with the lowest and the highest bit set, respectively */
+#define INF_TEXT_CHUNK_LOW_BITS G_GUINT64_CONSTANT(0x0101010101010101)
+#define INF_TEXT_CHUNK_HIGH_BITS G_GUINT64_CONSTANT(0x8080808080808080)
+
+static gsize
+inf_text_chunk_get_byte_index_utf8(InfTextChunk* self,
+                                   gchar* text,
+                                   gsize bytes,
+                                   guint offset)
 {
+  const guchar* begin;
+  const guchar* end;
+  const guchar* p;
+  guint64 word;
+  guint n;
+#ifdef __SSE2__
+  __m128i block;
+  __m128i sums;
+#endif
+
 #ifdef CHUNK_CHECK_INTEGRITY
-  g_assert(offset <= g_utf8_strlen(text, bytes));
+  g_assert(offset < g_utf8_strlen(text, bytes));
+#endif
+
+  begin = (const guchar*)text;
+  end = begin + bytes;
+  p = begin;
+
+  /* Skip blocks of bytes as long as the character we are looking for does
+   * not start within them, by counting the bytes which are not
+   * continuation bytes (10xxxxxx), i.e. the bytes starting a character. */
+#ifdef __SSE2__
+  while(end - p >= 16)
+  {
+    /* As signed chars, continuation bytes are those less than -64 */
+    block = _mm_loadu_si128((const __m128i*)p);
+    block = _mm_cmplt_epi8(block, _mm_set1_epi8(-64));
+    block = _mm_and_si128(block, _mm_set1_epi8(1));
+    sums = _mm_sad_epu8(block, _mm_setzero_si128());
+
+    n = 16 - _mm_cvtsi128_si32(sums) - _mm_extract_epi16(sums, 4);
+    if(n > offset) break;
+
+    offset -= n;
+    p += 16;
+  }
 #endif
 
-  return g_utf8_offset_to_pointer(text, offset) - text;
+  while(end - p >= 8)
+  {
+    memcpy(&word, p, 8);
+    word = word & ~(word << 1) & INF_TEXT_CHUNK_HIGH_BITS;
+
+    n = 8 - (guint)(((word >> 7) * INF_TEXT_CHUNK_LOW_BITS) >> 56);
+    if(n > offset) break;
+
+    offset -= n;
+    p += 8;
+  }
+
+  /* The character is the offset-th one starting from here. We might be in
+   * the middle of a character, but its continuation bytes are skipped. */
+  for(; p < end; ++p)
+  {
+    if((*p & 0xc0) != 0x80)
+    {
+      if(offset == 0)
+        return p - begin;
+      --offset;
+    }
+  }
+
+  g_assert_not_reached();
+  return bytes;
+}
+
+/* high is the index of the more significant byte within a code unit */
+static gsize
+inf_text_chunk_get_byte_index_utf16(const guchar* text,
+                                    gsize bytes,
+                                    guint offset,
+                                    guint high)
+{
+  gsize i;
+
+  /* Each code unit starts a character, except for low surrogates (0xdc00
+   * to 0xdfff), which complete the high surrogate in front of them. */
+  for(i = 0; i + 1 < bytes; i += 2)
+  {
+    if((text[i + high] & 0xfc) != 0xdc)
+    {
+      if(offset == 0)
+        return i;
+      --offset;
+    }
+  }
+
+  g_assert_not_reached();
+  return bytes;
 }
 
-gsize inf_text_chunk_get_byte_index_iconv(InfTextChunk* self,
+static gsize
+inf_text_chunk_get_byte_index_utf16le(InfTextChunk* self,
+                                      gchar* text,
+                                      gsize bytes,
+                                      guint offset)
+{
+  return inf_text_chunk_get_byte_index_utf16(
+    (const guchar*)text,
+    bytes,
+    offset,
+    1
+  );
+}
+
+static gsize
+inf_text_chunk_get_byte_index_utf16be(InfTextChunk* self,
+                                      gchar* text,
+                                      gsize bytes,
+                                      guint offset)
+{
+  return inf_text_chunk_get_byte_index_utf16(
+    (const guchar*)text,
+    bytes,
+    offset,
+    0
+  );
+}
+
+static gsize
+inf_text_chunk_get_byte_index_single_byte(InfTextChunk* self,
                                           gchar* text,
                                           gsize bytes,
                                           guint offset)
+{
+  g_assert(offset <= bytes);
+  return offset;
+}
+
+static gsize
+inf_text_chunk_get_byte_index_ucs4(InfTextChunk* self,
+                                   gchar* text,
+                                   gsize bytes,
+                                   guint offset)
+{
+  g_assert((gsize)offset * 4 <= bytes);
+  return (gsize)offset * 4;
+}
+
+static gsize
+inf_text_chunk_get_byte_index_iconv(InfTextChunk* self,
+                                    gchar* text,
+                                    gsize bytes,
+                                    guint offset)
 {
   /* We convert the segment's text into UCS-4, character by character.
    * This assumes every UCS-4 character is 4 bytes in length */
@@ -144,184 +340,970 @@ gsize inf_text_chunk_get_byte_index_iconv(InfTextChunk* self,
   return bytes - inlen;
 }
 
-const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF8 = {
-  inf_text_chunk_get_byte_index_utf8
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF8 = {
+  inf_text_chunk_get_byte_index_utf8,
+  FALSE
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF16LE = {
+  inf_text_chunk_get_byte_index_utf16le,
+  FALSE
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_UTF16BE = {
+  inf_text_chunk_get_byte_index_utf16be,
+  FALSE
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_SINGLE_BYTE = {
+  inf_text_chunk_get_byte_index_single_byte,
+  TRUE
+};
+
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_UCS4 = {
+  inf_text_chunk_get_byte_index_ucs4,
+  TRUE
 };
 
-const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV = {
-  inf_text_chunk_get_byte_index_iconv
+static const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV = {
+  inf_text_chunk_get_byte_index_iconv,
+  FALSE
 };
 
+typedef struct _InfTextChunkPathEncoding InfTextChunkPathEncoding;
+struct _InfTextChunkPathEncoding {
+  const gchar* encoding;
+  const InfTextChunkPath* path;
+};
+
+/* Encodings for which we do not need iconv to find character boundaries.
+ * Any ISO-8859 variant uses INF_TEXT_CHUNK_PATH_SINGLE_BYTE as well. */
+static const InfTextChunkPathEncoding INF_TEXT_CHUNK_PATH_ENCODINGS[] = {
+  { "UTF-8", &INF_TEXT_CHUNK_PATH_UTF8 },
+  { "UTF-16LE", &INF_TEXT_CHUNK_PATH_UTF16LE },
+  { "UTF-16BE", &INF_TEXT_CHUNK_PATH_UTF16BE },
+  { "UCS-4", &INF_TEXT_CHUNK_PATH_UCS4 },
+  { "UCS-4LE", &INF_TEXT_CHUNK_PATH_UCS4 },
+  { "UCS-4BE", &INF_TEXT_CHUNK_PATH_UCS4 },
+  { "UTF-32LE", &INF_TEXT_CHUNK_PATH_UCS4 },
+  { "UTF-32BE", &INF_TEXT_CHUNK_PATH_UCS4 },
+  { "LATIN1", &INF_TEXT_CHUNK_PATH_SINGLE_BYTE },
+  { "ASCII", &INF_TEXT_CHUNK_PATH_SINGLE_BYTE },
+  { "US-ASCII", &INF_TEXT_CHUNK_PATH_SINGLE_BYTE }
+};
+
+static const InfTextChunkPath*
+inf_text_chunk_path_for_encoding(const gchar* encoding)
+{
+  guint i;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEXT_CHUNK_PATH_ENCODINGS); ++i)
+    if(g_ascii_strcasecmp(INF_TEXT_CHUNK_PATH_ENCODINGS[i].encoding,
+                          encoding) == 0)
+      return INF_TEXT_CHUNK_PATH_ENCODINGS[i].path;
+
+  if(g_ascii_strncasecmp(encoding, "ISO-8859-", 9) == 0)
+    return &INF_TEXT_CHUNK_PATH_SINGLE_BYTE;
+
+  return &INF_TEXT_CHUNK_PATH_ICONV;
+}
+
 /*
  * Helper functions
  */
 
+static gchar*
+inf_text_chunk_text_new(gconstpointer text,
+                        gsize length)
+{
+  InfTextChunkText* header;
+
+  header = g_malloc(sizeof(InfTextChunkText) + length);
+  header->ref_count = 1;
+  memcpy(header + 1, text, length);
+
+  return (gchar*)(header + 1);
+}
+
+static gchar*
+inf_text_chunk_text_ref(gchar* text)
+{
+  g_atomic_int_inc(&INF_TEXT_CHUNK_TEXT_HEADER(text)->ref_count);
+  return text;
+}
+
+static void
+inf_text_chunk_text_unref(gchar* text)
+{
+  InfTextChunkText* header;
+
+  if(text != NULL)
+  {
+    header = INF_TEXT_CHUNK_TEXT_HEADER(text);
+    if(g_atomic_int_dec_and_test(&header->ref_count))
+      g_free(header);
+  }
+}
+
+/* Creates a new segment, taking ownership of a reference of text */
+static InfTextChunkSegment*
+inf_text_chunk_segment_new_take(guint author,
+                                gchar* text,
+                                gsize length,
+                                guint chars)
+{
+  InfTextChunkSegment* segment;
+  segment = g_slice_new(InfTextChunkSegment);
+
+  segment->parent = NULL;
+  segment->left = NULL;
+  segment->right = NULL;
+  segment->height = 1;
+
+  segment->author = author;
+  segment->text = text;
+  segment->length = length;
+  segment->chars = chars;
+
+  segment->subtree_length = length;
+  segment->subtree_chars = chars;
+
+  segment->checkpoints = NULL;
+  segment->n_checkpoints = 0;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_new(guint author,
+                           gconstpointer text,
+                           gsize length,
+                           guint chars)
+{
+  return inf_text_chunk_segment_new_take(
+    author,
+    inf_text_chunk_text_new(text, length),
+    length,
+    chars
+  );
+}
+
 static void
 inf_text_chunk_segment_free(InfTextChunkSegment* segment)
 {
-  g_free(segment->text);
+  inf_text_chunk_text_unref(segment->text);
+  g_free(segment->checkpoints);
   g_slice_free(InfTextChunkSegment, segment);
 }
 
-static int
-inf_text_chunk_segment_cmp(gconstpointer first,
-                           gconstpointer second,
-                           gpointer userdata)
-{
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
- 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
+/* Makes sure that the text of segment is not shared with another chunk and
+ * has room for at least size bytes, so that it can be modified. */
+static void
+inf_text_chunk_segment_make_writable(InfTextChunkSegment* segment,
+                                     gsize size)
+{
+  InfTextChunkText* header;
+  InfTextChunkText* new_header;
+
+  header = INF_TEXT_CHUNK_TEXT_HEADER(segment->text);
+
+  /* Only holders of a reference can add another one, so if we are the only
+   * holder, nobody else can start sharing the text concurrently. */
+  if(g_atomic_int_get(&header->ref_count) == 1)
+  {
+    header = g_realloc(header, sizeof(InfTextChunkText) + size);
+  }
+  else
+  {
+    new_header = g_malloc(sizeof(InfTextChunkText) + size);
+    new_header->ref_count = 1;
+    memcpy(new_header + 1, segment->text, segment->length);
+
+    inf_text_chunk_text_unref(segment->text);
+    header = new_header;
+  }
+
+  segment->text = (gchar*)(header + 1);
+}
+
+static void
+inf_text_chunk_segment_free_subtree(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+  {
+    inf_text_chunk_segment_free_subtree(segment->left);
+    inf_text_chunk_segment_free_subtree(segment->right);
+    inf_text_chunk_segment_free(segment);
+  }
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_copy_subtree(InfTextChunkSegment* segment,
+                                    InfTextChunkSegment* parent)
+{
+  InfTextChunkSegment* new_segment;
+
+  if(segment == NULL)
+    return NULL;
+
+  new_segment = g_slice_new(InfTextChunkSegment);
+  *new_segment = *segment;
+
+  new_segment->parent = parent;
+  new_segment->text = inf_text_chunk_text_ref(segment->text);
+  new_segment->checkpoints = g_memdup(
+    segment->checkpoints,
+    segment->n_checkpoints * sizeof(InfTextChunkCheckpoint)
+  );
+
+  new_segment->left =
+    inf_text_chunk_segment_copy_subtree(segment->left, new_segment);
+  new_segment->right =
+    inf_text_chunk_segment_copy_subtree(segment->right, new_segment);
+
+  return new_segment;
+}
+
+static guint
+inf_text_chunk_segment_height(InfTextChunkSegment* segment)
+{
+  if(segment == NULL) return 0;
+  return segment->height;
+}
+
+static guint
+inf_text_chunk_segment_subtree_chars(InfTextChunkSegment* segment)
+{
+  if(segment == NULL) return 0;
+  return segment->subtree_chars;
+}
+
+/* Recomputes the cached values of segment from its children */
+static void
+inf_text_chunk_segment_update(InfTextChunkSegment* segment)
+{
+  guint left_height;
+  guint right_height;
+
+  left_height = inf_text_chunk_segment_height(segment->left);
+  right_height = inf_text_chunk_segment_height(segment->right);
+  segment->height = MAX(left_height, right_height) + 1;
+
+  segment->subtree_length = segment->length;
+  segment->subtree_chars = segment->chars;
+
+  if(segment->left != NULL)
+  {
+    segment->subtree_length += segment->left->subtree_length;
+    segment->subtree_chars += segment->left->subtree_chars;
+  }
+
+  if(segment->right != NULL)
+  {
+    segment->subtree_length += segment->right->subtree_length;
+    segment->subtree_chars += segment->right->subtree_chars;
+  }
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_first(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+    while(segment->left != NULL)
+      segment = segment->left;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_last(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+    while(segment->right != NULL)
+      segment = segment->right;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_next(InfTextChunkSegment* segment)
+{
+  if(segment->right != NULL)
+    return inf_text_chunk_segment_first(segment->right);
+
+  while(segment->parent != NULL && segment->parent->right == segment)
+    segment = segment->parent;
+  return segment->parent;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_prev(InfTextChunkSegment* segment)
+{
+  if(segment->left != NULL)
+    return inf_text_chunk_segment_last(segment->left);
+
+  while(segment->parent != NULL && segment->parent->left == segment)
+    segment = segment->parent;
+  return segment->parent;
+}
+
+/* Recomputes all checkpoints of segment, which must have more than
+ * INF_TEXT_CHUNK_CHECKPOINT_INTERVAL characters. */
+static void
+inf_text_chunk_segment_build_checkpoints(InfTextChunk* self,
+                                         InfTextChunkSegment* segment)
+{
+  InfTextChunkCheckpoint* checkpoint;
+  guint chars;
+  gsize bytes;
+  guint i;
+
+  g_free(segment->checkpoints);
+
+  segment->n_checkpoints =
+    (segment->chars - 1) / INF_TEXT_CHUNK_CHECKPOINT_INTERVAL;
+  segment->checkpoints =
+    g_new(InfTextChunkCheckpoint, segment->n_checkpoints);
+
+  chars = 0;
+  bytes = 0;
+  for(i = 0; i < segment->n_checkpoints; ++i)
+  {
+    bytes += self->path->get_byte_index(
+      self,
+      segment->text + bytes,
+      segment->length - bytes,
+      INF_TEXT_CHUNK_CHECKPOINT_INTERVAL
+    );
+
+    chars += INF_TEXT_CHUNK_CHECKPOINT_INTERVAL;
+
+    checkpoint = &segment->checkpoints[i];
+    checkpoint->chars = chars;
+    checkpoint->bytes = bytes;
+  }
+}
+
+/* Returns the last checkpoint of segment at or before offset, or NULL if
+ * there is none. */
+static const InfTextChunkCheckpoint*
+inf_text_chunk_segment_find_checkpoint(InfTextChunkSegment* segment,
+                                       guint offset)
+{
+  guint begin;
+  guint end;
+  guint mid;
+
+  begin = 0;
+  end = segment->n_checkpoints;
+  while(begin < end)
+  {
+    mid = begin + (end - begin) / 2;
+    if(segment->checkpoints[mid].chars <= offset)
+      begin = mid + 1;
+    else
+      end = mid;
+  }
+
+  if(begin == 0)
+    return NULL;
+  return &segment->checkpoints[begin - 1];
+}
+
+/* Adjusts the checkpoints of segment when chars characters which take
+ * bytes bytes are inserted at character offset offset. */
+static void
+inf_text_chunk_segment_shift_checkpoints(InfTextChunkSegment* segment,
+                                         guint offset,
+                                         guint chars,
+                                         gsize bytes)
+{
+  guint i;
+
+  for(i = segment->n_checkpoints; i > 0; --i)
+  {
+    if(segment->checkpoints[i - 1].chars <= offset)
+      break;
+
+    segment->checkpoints[i - 1].chars += chars;
+    segment->checkpoints[i - 1].bytes += bytes;
+  }
+}
+
+/* Moves the checkpoints of segment behind character offset offset, at byte
+ * index index, to new_segment, which takes the text of segment from there
+ * on. Checkpoints exactly at offset are dropped. */
+static void
+inf_text_chunk_segment_split_checkpoints(InfTextChunkSegment* segment,
+                                         InfTextChunkSegment* new_segment,
+                                         guint offset,
+                                         gsize index)
+{
+  const InfTextChunkCheckpoint* checkpoint;
+  guint n_kept;
+  guint i;
+
+  g_assert(new_segment->checkpoints == NULL);
+
+  n_kept = 0;
+  checkpoint = inf_text_chunk_segment_find_checkpoint(segment, offset);
+  if(checkpoint != NULL)
+    n_kept = checkpoint - segment->checkpoints + 1;
+  if(checkpoint != NULL && checkpoint->chars == offset)
+    n_kept = n_kept - 1;
+
+  if(n_kept < segment->n_checkpoints)
+  {
+    new_segment->n_checkpoints = 0;
+    new_segment->checkpoints = g_new(
+      InfTextChunkCheckpoint,
+      segment->n_checkpoints - n_kept
+    );
+
+    for(i = n_kept; i < segment->n_checkpoints; ++i)
+    {
+      if(segment->checkpoints[i].chars == offset)
+        continue;
+
+      checkpoint = &segment->checkpoints[i];
+      new_segment->checkpoints[new_segment->n_checkpoints].chars =
+        checkpoint->chars - offset;
+      new_segment->checkpoints[new_segment->n_checkpoints].bytes =
+        checkpoint->bytes - index;
+      ++new_segment->n_checkpoints;
+    }
+  }
+
+  segment->n_checkpoints = n_kept;
+  if(n_kept == 0)
+  {
+    g_free(segment->checkpoints);
+    segment->checkpoints = NULL;
+  }
+}
+
+/* Appends the checkpoints of next to the ones of segment, before the text
+ * of next is appended to the text of segment. The boundary between the
+ * two becomes a checkpoint as well. */
+static void
+inf_text_chunk_segment_append_checkpoints(InfTextChunkSegment* segment,
+                                          InfTextChunkSegment* next)
+{
+  InfTextChunkCheckpoint* checkpoint;
+  guint i;
+
+  if(segment->checkpoints == NULL && next->checkpoints == NULL)
+    return;
+
+  segment->checkpoints = g_renew(
+    InfTextChunkCheckpoint,
+    segment->checkpoints,
+    segment->n_checkpoints + 1 + next->n_checkpoints
+  );
+
+  checkpoint = &segment->checkpoints[segment->n_checkpoints];
+  checkpoint->chars = segment->chars;
+  checkpoint->bytes = segment->length;
+
+  for(i = 0; i < next->n_checkpoints; ++i)
+  {
+    ++checkpoint;
+    checkpoint->chars = next->checkpoints[i].chars + segment->chars;
+    checkpoint->bytes = next->checkpoints[i].bytes + segment->length;
+  }
+
+  segment->n_checkpoints += 1 + next->n_checkpoints;
+}
+
+/* Returns the byte index of the character at offset within segment. For
+ * large segments, this starts scanning the text at the closest checkpoint
+ * instead of at the segment's beginning. The checkpoints are created on
+ * first use, and afterwards updated whenever the segment is modified.
+ * Text inserted between two checkpoints increases the distance between
+ * them, so they are recomputed once the distance becomes too large. */
+static gsize
+inf_text_chunk_segment_get_byte_index(InfTextChunk* self,
+                                      InfTextChunkSegment* segment,
+                                      guint offset)
+{
+  const InfTextChunkCheckpoint* checkpoint;
+  guint distance;
+
+  g_assert(offset <= segment->chars);
+
+  if(offset == 0)
+    return 0;
+  if(offset == segment->chars)
+    return segment->length;
+
+  if(self->path->fixed_width ||
+     segment->chars <= 2 * INF_TEXT_CHUNK_CHECKPOINT_INTERVAL)
+  {
+    return self->path->get_byte_index(
+      self,
+      segment->text,
+      segment->length,
+      offset
+    );
+  }
+
+  checkpoint = inf_text_chunk_segment_find_checkpoint(segment, offset);
+
+  distance = offset;
+  if(checkpoint != NULL)
+    distance -= checkpoint->chars;
+
+  if(segment->checkpoints == NULL ||
+     distance > 2 * INF_TEXT_CHUNK_CHECKPOINT_INTERVAL)
+  {
+    inf_text_chunk_segment_build_checkpoints(self, segment);
+    checkpoint = inf_text_chunk_segment_find_checkpoint(segment, offset);
+  }
+
+  if(checkpoint == NULL)
+  {
+    return self->path->get_byte_index(
+      self,
+      segment->text,
+      segment->length,
+      offset
+    );
+  }
+
+  return checkpoint->bytes + self->path->get_byte_index(
+    self,
+    segment->text + checkpoint->bytes,
+    segment->length - checkpoint->bytes,
+    offset - checkpoint->chars
+  );
+}
+
+/* Replaces the link from segment's parent to segment by replacement */
+static void
+inf_text_chunk_replace_child(InfTextChunk* self,
+                             InfTextChunkSegment* segment,
+                             InfTextChunkSegment* replacement)
+{
+  if(replacement != NULL)
+    replacement->parent = segment->parent;
+
+  if(segment->parent == NULL)
+    self->root = replacement;
+  else if(segment->parent->left == segment)
+    segment->parent->left = replacement;
+  else
+    segment->parent->right = replacement;
+}
+
+static void
+inf_text_chunk_rotate_left(InfTextChunk* self,
+                           InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* pivot;
+
+  pivot = segment->right;
+  segment->right = pivot->left;
+  if(pivot->left != NULL)
+    pivot->left->parent = segment;
+
+  inf_text_chunk_replace_child(self, segment, pivot);
+  pivot->left = segment;
+  segment->parent = pivot;
+
+  inf_text_chunk_segment_update(segment);
+  inf_text_chunk_segment_update(pivot);
+}
+
+static void
+inf_text_chunk_rotate_right(InfTextChunk* self,
+                            InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* pivot;
+
+  pivot = segment->left;
+  segment->left = pivot->right;
+  if(pivot->right != NULL)
+    pivot->right->parent = segment;
+
+  inf_text_chunk_replace_child(self, segment, pivot);
+  pivot->right = segment;
+  segment->parent = pivot;
+
+  inf_text_chunk_segment_update(segment);
+  inf_text_chunk_segment_update(pivot);
+}
+
+/* Updates the cached values of segment and all its ancestors, and restores
+ * the AVL balance on the way up to the root. This needs to be called
+ * whenever the tree structure or a segment's length changed. */
+static void
+inf_text_chunk_rebalance(InfTextChunk* self,
+                         InfTextChunkSegment* segment)
+{
+  guint left_height;
+  guint right_height;
+
+  while(segment != NULL)
+  {
+    inf_text_chunk_segment_update(segment);
+
+    left_height = inf_text_chunk_segment_height(segment->left);
+    right_height = inf_text_chunk_segment_height(segment->right);
+
+    if(left_height > right_height + 1)
+    {
+      if(inf_text_chunk_segment_height(segment->left->left) <
+         inf_text_chunk_segment_height(segment->left->right))
+      {
+        inf_text_chunk_rotate_left(self, segment->left);
+      }
+
+      inf_text_chunk_rotate_right(self, segment);
+      /* segment is now a child of the new subtree root, which has already
+       * been updated by the rotation. */
+      segment = segment->parent;
+    }
+    else if(right_height > left_height + 1)
+    {
+      if(inf_text_chunk_segment_height(segment->right->right) <
+         inf_text_chunk_segment_height(segment->right->left))
+      {
+        inf_text_chunk_rotate_right(self, segment->right);
+      }
+
+      inf_text_chunk_rotate_left(self, segment);
+      segment = segment->parent;
+    }
+
+    segment = segment->parent;
+  }
+}
+
+/* Links segment into the tree so that it comes right before the segment
+ * before. If before is NULL, segment is appended at the end of the chunk.
+ * This does not change self->length. */
+static void
+inf_text_chunk_insert_segment(InfTextChunk* self,
+                              InfTextChunkSegment* before,
+                              InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* parent;
+
+  g_assert(segment->left == NULL && segment->right == NULL);
+
+  if(self->root == NULL)
+  {
+    g_assert(before == NULL);
+    segment->parent = NULL;
+    self->root = segment;
+    return;
+  }
+
+  if(before == NULL)
+  {
+    parent = inf_text_chunk_segment_last(self->root);
+    parent->right = segment;
+  }
+  else if(before->left == NULL)
+  {
+    parent = before;
+    parent->left = segment;
+  }
+  else
+  {
+    parent = inf_text_chunk_segment_last(before->left);
+    parent->right = segment;
+  }
+
+  segment->parent = parent;
+  inf_text_chunk_rebalance(self, parent);
+}
+
+/* Unlinks segment from the tree and frees it. Note that this might move the
+ * content of another segment into a different tree node, so other segment
+ * pointers into the tree must not be relied upon after this call, except
+ * for the predecessor of segment. This does not change self->length. */
+static void
+inf_text_chunk_remove_segment(InfTextChunk* self,
+                              InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* successor;
+  InfTextChunkSegment* child;
+  InfTextChunkSegment* parent;
+
+  if(segment->left != NULL && segment->right != NULL)
+  {
+    /* Move the successor's content into this node, and remove the
+     * successor's node instead, which has no left child. */
+    successor = inf_text_chunk_segment_first(segment->right);
+
+    inf_text_chunk_text_unref(segment->text);
+    segment->author = successor->author;
+    segment->text = successor->text;
+    segment->length = successor->length;
+    segment->chars = successor->chars;
+
+    g_free(segment->checkpoints);
+    segment->checkpoints = successor->checkpoints;
+    segment->n_checkpoints = successor->n_checkpoints;
+
+    successor->text = NULL;
+    successor->checkpoints = NULL;
+    segment = successor;
+  }
+
+  if(segment->left != NULL)
+    child = segment->left;
+  else
+    child = segment->right;
+
+  parent = segment->parent;
+  inf_text_chunk_replace_child(self, segment, child);
+  inf_text_chunk_segment_free(segment);
+
+  inf_text_chunk_rebalance(self, parent);
+}
+
+/* Returns the segment containing the character at position pos, and sets
+ * segment_offset to the position of that character relative to the
+ * segment's beginning. If pos is at the border of two segments, the second
+ * one is returned with segment_offset 0. If pos is the end of the chunk,
+ * the last segment is returned, with segment_offset being its length.
+ * Returns NULL if the chunk is empty. */
+static InfTextChunkSegment*
+inf_text_chunk_get_segment(InfTextChunk* self,
+                           guint pos,
+                           guint* segment_offset)
+{
+  InfTextChunkSegment* segment;
+  guint left_chars;
+
+  g_assert(pos <= self->length);
+
+  segment = self->root;
+  while(segment != NULL)
+  {
+    left_chars = inf_text_chunk_segment_subtree_chars(segment->left);
+    if(pos < left_chars)
+    {
+      segment = segment->left;
+    }
+    else
+    {
+      pos -= left_chars;
+      if(pos < segment->chars || segment->right == NULL)
+      {
+        g_assert(pos <= segment->chars);
+        *segment_offset = pos;
+        return segment;
+      }
+
+      pos -= segment->chars;
+      segment = segment->right;
+    }
+  }
+
+  return NULL;
+}
+
+/* Makes sure that a segment begins at character offset pos, splitting the
+ * segment containing pos if necessary. Returns the segment starting at pos,
+ * or NULL if pos is the end of the chunk. */
+static InfTextChunkSegment*
+inf_text_chunk_split(InfTextChunk* self,
+                     guint pos)
+{
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* new_segment;
+  guint segment_offset;
+  gsize index;
+
+  if(pos == self->length)
+    return NULL;
+
+  segment = inf_text_chunk_get_segment(self, pos, &segment_offset);
+  if(segment_offset == 0)
+    return segment;
+
+  index = inf_text_chunk_segment_get_byte_index(self, segment, segment_offset);
+
+  new_segment = inf_text_chunk_segment_new(
+    segment->author,
+    segment->text + index,
+    segment->length - index,
+    segment->chars - segment_offset
+  );
+
+  inf_text_chunk_segment_split_checkpoints(
+    segment,
+    new_segment,
+    segment_offset,
+    index
+  );
+
+  /* Don't realloc to make smaller */
+  segment->length = index;
+  segment->chars = segment_offset;
+  inf_text_chunk_rebalance(self, segment);
 
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
+  inf_text_chunk_insert_segment(
+    self,
+    inf_text_chunk_segment_next(segment),
+    new_segment
+  );
 
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return 0;
-  else
-    return 1;
+  return new_segment;
 }
 
-/* This is a special comparison function which is only used
- * in inf_text_chunk_get_segment. It makes sure that when two segments
- * have the same offset, the second one gets sorted behind. This ensures
- * that the first segment in the sequence is never returned, since it
- * always has offset 0, which is a precondition for the algorithm
- * in inf_text_chunk_get_segment. See also libinfinity github issue #10. */
-static int
-inf_text_chunk_segment_cmp_for_get_segment(gconstpointer first,
-                                           gconstpointer second,
-                                           gpointer userdata)
+/* Appends the content of the segment following segment to it, and removes
+ * the following segment. */
+static void
+inf_text_chunk_merge_next(InfTextChunk* self,
+                          InfTextChunkSegment* segment)
 {
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
+  InfTextChunkSegment* next;
 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
+  next = inf_text_chunk_segment_next(segment);
+  g_assert(next != NULL && next->author == segment->author);
 
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
+  inf_text_chunk_segment_make_writable(
+    segment,
+    segment->length + next->length
+  );
 
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return -1;
-  else
-    return 1;
+  inf_text_chunk_segment_append_checkpoints(segment, next);
+
+  memcpy(segment->text + segment->length, next->text, next->length);
+  segment->length += next->length;
+  segment->chars += next->chars;
+  inf_text_chunk_rebalance(self, segment);
+
+  inf_text_chunk_remove_segment(self, next);
 }
 
+#ifdef CHUNK_CHECK_INTEGRITY
+/* Returns the offset of the first character of segment within the chunk */
 static guint
-inf_text_chunk_next_offset(InfTextChunk* self,
-                           GSequenceIter* iter)
+inf_text_chunk_get_segment_offset(InfTextChunkSegment* segment)
 {
-  GSequenceIter* next_iter;
+  guint offset;
 
-  g_assert(iter != g_sequence_get_end_iter(self->segments));
-  
-  next_iter = g_sequence_iter_next(iter);
-  if(next_iter == g_sequence_get_end_iter(self->segments))
-    return self->length;
-  else
-    return ((InfTextChunkSegment*)g_sequence_get(next_iter))->offset;
+  offset = inf_text_chunk_segment_subtree_chars(segment->left);
+  while(segment->parent != NULL)
+  {
+    if(segment->parent->right == segment)
+    {
+      offset += segment->parent->chars;
+      offset += inf_text_chunk_segment_subtree_chars(segment->parent->left);
+    }
+
+    segment = segment->parent;
+  }
+
+  return offset;
 }
 
-#ifdef CHUNK_CHECK_INTEGRITY
 static gboolean
-inf_text_chunk_check_integrity(InfTextChunk* self)
+inf_text_chunk_check_subtree_integrity(InfTextChunkSegment* segment)
 {
-  GSequenceIter* iter;
-  InfTextChunkSegment* segment;
-  guint offset;
-  guint new_offset;
+  guint left_height;
+  guint right_height;
+  gsize subtree_length;
+  guint subtree_chars;
 
-  offset = 0;
+  if(segment == NULL)
+    return TRUE;
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    if(offset != segment->offset)
-      return FALSE;
+  if(segment->left != NULL && segment->left->parent != segment)
+    return FALSE;
+  if(segment->right != NULL && segment->right->parent != segment)
+    return FALSE;
 
-    new_offset = inf_text_chunk_next_offset(self, iter);
-    if(new_offset <= offset)
-      return FALSE;
+  if(!inf_text_chunk_check_subtree_integrity(segment->left))
+    return FALSE;
+  if(!inf_text_chunk_check_subtree_integrity(segment->right))
+    return FALSE;
 
-    if(new_offset - offset > segment->length)
-      return FALSE;
+  left_height = inf_text_chunk_segment_height(segment->left);
+  right_height = inf_text_chunk_segment_height(segment->right);
+  if(segment->height != MAX(left_height, right_height) + 1)
+    return FALSE;
+  if(left_height > right_height + 1 || right_height > left_height + 1)
+    return FALSE;
 
-    offset = new_offset;
+  subtree_length = segment->length;
+  subtree_chars = segment->chars;
+  if(segment->left != NULL)
+  {
+    subtree_length += segment->left->subtree_length;
+    subtree_chars += segment->left->subtree_chars;
+  }
+  if(segment->right != NULL)
+  {
+    subtree_length += segment->right->subtree_length;
+    subtree_chars += segment->right->subtree_chars;
   }
 
+  if(segment->subtree_length != subtree_length)
+    return FALSE;
+  if(segment->subtree_chars != subtree_chars)
+    return FALSE;
+
   return TRUE;
 }
-#endif
 
-static GSequenceIter*
-inf_text_chunk_get_segment(InfTextChunk* self,
-                           guint pos,
-                           gsize* index)
+static gboolean
+inf_text_chunk_check_integrity(InfTextChunk* self)
 {
-  InfTextChunkSegment* found;
-  InfTextChunkSegment key;
-  GSequenceIter* iter;
-
-  g_assert(pos <= self->length);
-
-  /* only offset is relevant for lookup */
-  key.offset = pos;
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* prev;
+  const InfTextChunkCheckpoint* checkpoint;
+  gsize index;
+  guint i;
 
-  /* TODO: Verify this does binary search */
-  iter = g_sequence_search(
-    self->segments,
-    &key,
-    inf_text_chunk_segment_cmp_for_get_segment,
-    NULL
-  );
+  if(self->root != NULL && self->root->parent != NULL)
+    return FALSE;
+  if(!inf_text_chunk_check_subtree_integrity(self->root))
+    return FALSE;
+  if(inf_text_chunk_segment_subtree_chars(self->root) != self->length)
+    return FALSE;
 
-  if(self->length > 0)
+  prev = NULL;
+  for(segment = inf_text_chunk_segment_first(self->root);
+      segment != NULL;
+      segment = inf_text_chunk_segment_next(segment))
   {
-    g_assert(iter != g_sequence_get_begin_iter(self->segments));
-
-    iter = g_sequence_iter_prev(iter);
-    found = g_sequence_get(iter);
+    /* Segments are never empty, and adjacent segments are always written
+     * by different authors. */
+    if(segment->chars == 0 || segment->chars > segment->length)
+      return FALSE;
+    if(prev != NULL && prev->author == segment->author)
+      return FALSE;
 
-    g_assert(pos >= found->offset);
+    /* Checkpoints lie strictly within the segment, in ascending order, at
+     * the byte index of their character. */
+    for(i = 0; i < segment->n_checkpoints; ++i)
+    {
+      checkpoint = &segment->checkpoints[i];
+      if(checkpoint->chars == 0 || checkpoint->chars >= segment->chars)
+        return FALSE;
+      if(i > 0 && checkpoint->chars <= segment->checkpoints[i - 1].chars)
+        return FALSE;
 
-    /* This is not "<=" because it should rather find position 0 on the
-     * next segment in that case. */
-    g_assert(pos <= inf_text_chunk_next_offset(self, iter));
+      index = self->path->get_byte_index(
+        self,
+        segment->text,
+        segment->length,
+        checkpoint->chars
+      );
 
-    /* Find byte index in the segment where the specified character starts.
-     * This is rather ugly, I wish iconv or glib or someone had some nice(r)
-     * API for this. */
-    if(index != NULL)
-    {
-      if(pos == inf_text_chunk_next_offset(self, iter))
-      {
-        *index = found->length;
-      }
-      else
-      {
-        *index = self->path->get_byte_index(
-          self,
-          found->text,
-          found->length,
-          pos - found->offset
-        );
-      }
+      if(checkpoint->bytes != index)
+        return FALSE;
     }
+
+    prev = segment;
   }
-  else
-  {
-    if(index != NULL)
-      *index = 0;
-  }
-  
-  return iter;
+
+  return TRUE;
 }
+#endif
 
 /*
  * Public API
@@ -373,18 +1355,12 @@ InfTextChunk*
 inf_text_chunk_new(const gchar* encoding)
 {
   InfTextChunk* chunk = g_slice_new(InfTextChunk);
-  
-  chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
 
+  chunk->root = NULL;
   chunk->length = 0;
   chunk->encoding = g_quark_from_string(encoding);
 
-  if(chunk->encoding == g_quark_from_static_string("UTF-8"))
-    chunk->path = &INF_TEXT_CHUNK_PATH_UTF8;
-  else
-    chunk->path = &INF_TEXT_CHUNK_PATH_ICONV;
+  chunk->path = inf_text_chunk_path_for_encoding(encoding);
 
   return chunk;
 }
@@ -393,7 +1369,10 @@ inf_text_chunk_new(const gchar* encoding)
  * inf_text_chunk_copy:
  * @self: A #InfTextChunk.
  *
- * Returns a copy of @self.
+ * Returns a copy of @self. The text is shared between @self and the copy
+ * until one of them is modified, so this only needs to copy the segment
+ * structure, not the text itself. The copy can be read and freed in a
+ * different thread than the one which modifies @self.
  *
  * Returns: (transfer full): A new #InfTextChunk.
  **/
@@ -401,28 +1380,11 @@ InfTextChunk*
 inf_text_chunk_copy(InfTextChunk* self)
 {
   InfTextChunk* new_chunk;
-  GSequenceIter* iter;
 
   g_return_val_if_fail(self != NULL, NULL);
 
   new_chunk = g_slice_new(InfTextChunk);
-  new_chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
-  
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    InfTextChunkSegment* segment = g_sequence_get(iter);
-    InfTextChunkSegment* new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(segment->text, segment->length);
-    new_segment->length = segment->length;
-    new_segment->offset = segment->offset;
-    g_sequence_append(new_chunk->segments, new_segment);
-  }
-
+  new_chunk->root = inf_text_chunk_segment_copy_subtree(self->root, NULL);
   new_chunk->length = self->length;
   new_chunk->encoding = self->encoding;
   new_chunk->path = self->path;
@@ -441,7 +1403,7 @@ void
 inf_text_chunk_free(InfTextChunk* self)
 {
   g_return_if_fail(self != NULL);
-  g_sequence_free(self->segments);
+  inf_text_chunk_segment_free_subtree(self->root);
   g_slice_free(InfTextChunk, self);
 }
 
@@ -482,7 +1444,9 @@ inf_text_chunk_get_length(InfTextChunk* self)
  * @length: The length of the text to extract.
  *
  * Returns a new #InfTextChunk containing a substring of @self, beginning
- * at character offset @begin and @length characters long.
+ * at character offset @begin and @length characters long. Like with
+ * inf_text_chunk_copy(), segments that are contained completely in the
+ * substring share their text with @self.
  *
  * Returns: (transfer full): A new #InfTextChunk.
  **/
@@ -491,86 +1455,72 @@ inf_text_chunk_substring(InfTextChunk* self,
                          guint begin,
                          guint length)
 {
-  GSequenceIter* begin_iter;
-  GSequenceIter* end_iter;
-  gsize begin_index;
-  gsize end_index;
-
   InfTextChunk* result;
   InfTextChunkSegment* segment;
   InfTextChunkSegment* new_segment;
-  guint current_length;
+  guint segment_offset;
+  guint segment_length;
+  gsize begin_index;
+  gsize end_index;
 
   g_return_val_if_fail(self != NULL, NULL);
   g_return_val_if_fail(begin + length <= self->length, NULL);
 
-  if(self->length > 0 && length > 0)
+  /* Shares all of the text */
+  if(begin == 0 && length == self->length)
+    return inf_text_chunk_copy(self);
+
+  result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+
+  if(length > 0)
   {
-    begin_iter = inf_text_chunk_get_segment(self, begin, &begin_index);
-    end_iter = inf_text_chunk_get_segment(self, begin + length, &end_index);
+    segment = inf_text_chunk_get_segment(self, begin, &segment_offset);
+    result->length = length;
 
-    if(end_index == 0)
+    while(length > 0)
     {
-      g_assert(end_iter != g_sequence_get_end_iter(self->segments));
-      end_iter = g_sequence_iter_prev(end_iter);
-      end_index = ((InfTextChunkSegment*)g_sequence_get(end_iter))->length;
-    }
-
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+      g_assert(segment != NULL);
 
-    current_length = 0;
-    segment = g_sequence_get(begin_iter);
+      segment_length = MIN(segment->chars - segment_offset, length);
 
-    while(begin_iter != end_iter)
-    {
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = segment->author;
+      begin_index = inf_text_chunk_segment_get_byte_index(
+        self,
+        segment,
+        segment_offset
+      );
 
-      new_segment->text = g_memdup(
-        segment->text + begin_index,
-        segment->length - begin_index
+      end_index = inf_text_chunk_segment_get_byte_index(
+        self,
+        segment,
+        segment_offset + segment_length
       );
-      
-      new_segment->length = segment->length - begin_index;
-      new_segment->offset = current_length;
-
-      begin_iter = g_sequence_iter_next(begin_iter);
-      segment = g_sequence_get(begin_iter);
-
-      /* Add (remaining) length of this segment to current length */
-      current_length = segment->offset - begin;
-
-      /* So we get the next segment from the beginning. This may only be
-       * non-zero during the first iteration. */
-      begin_index = 0;
-    /*  begin = new_segment->offset;*/
-      
-      g_sequence_append(result->segments, new_segment);
-    }
 
-    /* Don't forget last segment */
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(
-      segment->text + begin_index,
-      end_index - begin_index
-    );
-    
-    new_segment->length = end_index - begin_index;
-    new_segment->offset = current_length;
-    
-    g_sequence_append(result->segments, new_segment);
+      if(begin_index == 0 && end_index == segment->length)
+      {
+        /* Share the text of segments that are taken as a whole */
+        new_segment = inf_text_chunk_segment_new_take(
+          segment->author,
+          inf_text_chunk_text_ref(segment->text),
+          segment->length,
+          segment->chars
+        );
+      }
+      else
+      {
+        new_segment = inf_text_chunk_segment_new(
+          segment->author,
+          segment->text + begin_index,
+          end_index - begin_index,
+          segment_length
+        );
+      }
 
-    result->length = length;
-    result->encoding = self->encoding;
-    result->path = self->path;
-  }
-  else
-  {
-    g_assert(length == 0 || begin == 0);
+      inf_text_chunk_insert_segment(result, NULL, new_segment);
 
-    /* New, empty chunk */
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+      length -= segment_length;
+      segment = inf_text_chunk_segment_next(segment);
+      segment_offset = 0;
+    }
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -601,105 +1551,84 @@ inf_text_chunk_insert_text(InfTextChunk* self,
                            guint length,
                            guint author)
 {
-  GSequenceIter* iter;
-  gsize offset_index;
   InfTextChunkSegment* segment;
-  InfTextChunkSegment* new_segment;
+  InfTextChunkSegment* prev;
+  InfTextChunkSegment* before;
+  guint segment_offset;
+  gsize index;
 
   g_return_if_fail(self != NULL);
   g_return_if_fail(offset <= self->length);
 
-  if(self->length > 0)
-  {
-    iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-
-    /* Have to split segment, unless it is between two segments in which
-     * case we can perhaps append to the previous. */
-    if(segment->author != author && offset > 0 && offset_index == 0)
-    {
-      g_assert(iter != g_sequence_get_begin_iter(self->segments));
+  /* Don't create empty segments */
+  if(length == 0)
+    return;
 
-      iter = g_sequence_iter_prev(iter);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-      offset_index = segment->length;
-    }
+  segment = inf_text_chunk_get_segment(self, offset, &segment_offset);
 
-    if(segment->author != author)
+  /* If inserting between two segments, prefer appending to the previous
+   * one in case the next one was written by someone else. */
+  if(segment != NULL && segment->author != author && segment_offset == 0)
+  {
+    prev = inf_text_chunk_segment_prev(segment);
+    if(prev != NULL && prev->author == author)
     {
-      /* No luck, split if necessary */
-      if(offset_index > 0 && offset_index < segment->length)
-      {
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(
-          segment->text + offset_index,
-          segment->length - offset_index
-        );
-
-        new_segment->length = segment->length - offset_index;
-        new_segment->offset = offset;
-
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
+      segment = prev;
+      segment_offset = prev->chars;
+    }
+  }
 
-        /* Don't realloc to make smaller */
-        segment->length = offset_index;
-        /* Note that we did not invalidate offsets so far */
-      }
-      else if(offset_index == segment->length)
-      {
-        /* Insert behind segment */
-        iter = g_sequence_iter_next(iter);
-      }
+  if(segment != NULL && segment->author == author)
+  {
+    index = inf_text_chunk_segment_get_byte_index(
+      self,
+      segment,
+      segment_offset
+    );
 
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = author;
-      new_segment->text = g_memdup(text, bytes);
-      new_segment->length = bytes;
-      new_segment->offset = offset;
-      g_sequence_insert_before(iter, new_segment);
-    }
-    else
+    /* TODO: g_malloc + g_free + 2*memcpy? */
+    inf_text_chunk_segment_make_writable(segment, segment->length + bytes);
+    if(index < segment->length)
     {
-      /* TODO: g_malloc + g_free + 2*memcpy? */
-      segment->text = g_realloc(segment->text, segment->length + bytes);
-      if(offset_index < segment->length)
-      {
-        g_memmove(
-          segment->text + offset_index + bytes,
-          segment->text + offset_index,
-          segment->length - offset_index
-        );
-      }
-      
-      memcpy(segment->text + offset_index, text, bytes);
-      segment->length += bytes;
-      iter = g_sequence_iter_next(iter);
+      g_memmove(
+        segment->text + index + bytes,
+        segment->text + index,
+        segment->length - index
+      );
     }
 
-    /* Adjust offsets */
-    while(iter != g_sequence_get_end_iter(self->segments))
-    {
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-      segment->offset += length;
-      iter = g_sequence_iter_next(iter);
-    }
+    inf_text_chunk_segment_shift_checkpoints(
+      segment,
+      segment_offset,
+      length,
+      bytes
+    );
+
+    memcpy(segment->text + index, text, bytes);
+    segment->length += bytes;
+    segment->chars += length;
 
-    self->length += length;
+    inf_text_chunk_rebalance(self, segment);
   }
   else
   {
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = author;
-    new_segment->text = g_memdup(text, bytes);
-    new_segment->length = bytes;
-    new_segment->offset = 0;
-
-    g_sequence_append(self->segments, new_segment);
-    self->length = length;
+    /* No luck, split if necessary */
+    if(segment == NULL || segment_offset == 0)
+      before = segment;
+    else if(segment_offset == segment->chars)
+      before = inf_text_chunk_segment_next(segment);
+    else
+      before = inf_text_chunk_split(self, offset);
+
+    inf_text_chunk_insert_segment(
+      self,
+      before,
+      inf_text_chunk_segment_new(author, text, bytes, length)
+    );
   }
 
+  self->length += length;
+
 #ifdef CHUNK_CHECK_INTEGRITY
   g_assert(inf_text_chunk_check_integrity(self) == TRUE);
 #endif
@@ -719,267 +1648,32 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
                             guint offset,
                             InfTextChunk* text)
 {
-  GSequenceIter* iter;
-  GSequenceIter* text_iter;
-  gsize offset_index;
   InfTextChunkSegment* segment;
-  InfTextChunkSegment* new_segment;
-
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
-  InfTextChunkSegment* first;
-  InfTextChunkSegment* last;
-
-  InfTextChunkSegment* first_merge;
-  InfTextChunkSegment* last_merge;
-  GSequenceIter* beyond;
 
   g_return_if_fail(self != NULL);
   g_return_if_fail(offset <= self->length);
   g_return_if_fail(text != NULL);
+  g_return_if_fail(text != self);
   g_return_if_fail(self->encoding == text->encoding);
 
-  if(self->length > 0 && text->length > 0)
-  {
-    if(g_sequence_get_length(text->segments) == 1)
-    {
-      segment = g_sequence_get(g_sequence_get_begin_iter(text->segments));
-
-      inf_text_chunk_insert_text(
-        self,
-        offset,
-        segment->text,
-        segment->length,
-        text->length,
-        segment->author
-      );
-    }
-    else
-    {
-      iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-
-      /* First, we insert the first and last segment of text into self,
-       * possibly merging with adjacent segments. Then, the rest is
-       * copied. */
-      first_iter = g_sequence_get_begin_iter(text->segments);
-      last_iter = g_sequence_iter_prev(
-        g_sequence_get_end_iter(text->segments)
-      );
-
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      last = (InfTextChunkSegment*)g_sequence_get(last_iter);
-
-      /* 0 and 1 segment special cases have been handled above */
-      g_assert(first != last);
-
-      last_merge = segment;
-      first_merge = segment;
-
-      /* beyond points to the first segment that needs offset adjustment
-       * after insertion */
-      beyond = iter;
-
-      /* Try merge with end of previous segment if inserting inbetween two
-       * segments. */
-      if(offset_index == 0 && offset > 0)
-      {
-        g_assert(iter != g_sequence_get_begin_iter(self->segments));
-
-        iter = g_sequence_iter_prev(iter);
-        first_merge = (InfTextChunkSegment*)g_sequence_get(iter);
-        offset_index = first_merge->length;
-      }
-
-      if(offset == 0 || offset == self->length || first_merge != last_merge)
-      {
-        /* Insert between two segments, or at beginning/end */
-        if(first_merge->author == first->author && offset > 0)
-        {
-          /* Can merge first segment */
-          first_merge->length += first->length;
-
-          first_merge->text = g_realloc(
-            first_merge->text,
-            first_merge->length
-          );
-
-          memcpy(
-            first_merge->text + first_merge->length - first->length,
-            first->text,
-            first->length
-          );
-
-          /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-
-        if(last_merge->author == last->author && offset < self->length)
-        {
-          /* Can merge last segment */
-          last_merge->length += last->length;
-          last_merge->text = g_realloc(last_merge->text, last_merge->length);
-
-          g_memmove(
-            last_merge->text + last->length,
-            last_merge->text,
-            last_merge->length - last->length
-          );
-
-          memcpy(last_merge->text, last->text, last->length);
-          last_merge->offset = offset + last->offset;
-
-          /* Merged with last, so don't need to adjust last_merge->offset
-           * anymore, continue behind with offset adjustment. */
-          beyond = g_sequence_iter_next(beyond);
-        }
-        else
-        {
-          /* Could not merge last segment, so we have to insert it. Therefore,
-           * make last_iter point to the end of the sequence. */
-          last_iter = g_sequence_iter_next(last_iter);
-
-          if(offset_index > 0) /* Note: This is only false for offset == 0 */
-            beyond = g_sequence_iter_next(iter);
-        }
-
-        if(offset_index > 0) /* Note: This is only false for offset == 0 */
-        {
-          /* Pointing to the position before which to insert
-           * the rest of text. */
-          iter = g_sequence_iter_next(iter);
-        }
-      }
-      else
-      {
-        /* Insert within a segment, split segment */
-
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = last_merge->author;
-
-        if(last_merge->author == last->author)
-        {
-          /* Merge last part into new segment */
-          new_segment->length = last_merge->length - offset_index +
-            last->length;
-
-          new_segment->text = g_malloc(new_segment->length);
-          memcpy(new_segment->text, last->text, last->length);
-
-          memcpy(
-            new_segment->text + last->length,
-            last_merge->text + offset_index,
-            last_merge->length - offset_index
-          );
-
-          new_segment->offset = offset + last->offset;
-        }
-        else
-        {
-          /* Split up last part */
-          new_segment->length = last_merge->length - offset_index;
-          new_segment->text = g_malloc(new_segment->length);
-
-          memcpy(
-            new_segment->text,
-            last_merge->text + offset_index,
-            new_segment->length
-          );
-
-          new_segment->offset = offset + text->length;
-
-          /* We still have to insert last segment since we could not merge */
-          last_iter = g_sequence_iter_next(last_iter);
-        }
-
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
-
-        /* The segment just inserted is the last one being inserted, so
-         * we need to adjust beyond that */
-        beyond = g_sequence_iter_next(iter);
-
-        /* Note first_merge == last_merge */
-        if(first_merge->author == first->author)
-        {
-          /* Merge into first */
-          if(first_merge->length < offset_index + first->length)
-          {
-            first_merge->text = g_realloc(
-              first_merge->text,
-              offset_index + first->length
-            );
-          }
-
-          first_merge->length = offset_index + first->length;
-
-          memcpy(
-            first_merge->text + offset_index,
-            first->text,
-            first->length
-          );
-
-          /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-        else
-        {
-          /* Cannot merge, just cut */
-          first_merge->length = offset_index;
-        }
-      }
-
-      /* iter now points to the segment before which the rest of text has to
-       * be inserted */
-
-      for(text_iter = first_iter;
-          text_iter != last_iter;
-          text_iter = g_sequence_iter_next(text_iter))
-      {
-        segment = g_sequence_get(text_iter);
-        new_segment = g_slice_new(InfTextChunkSegment);
-
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(segment->text, segment->length);
-        new_segment->length = segment->length;
-        new_segment->offset = offset + segment->offset;
-        g_sequence_insert_before(iter, new_segment);
-      }
-
-      for(iter = beyond;
-          iter != g_sequence_get_end_iter(self->segments);
-          iter = g_sequence_iter_next(iter))
-      {
-        segment = g_sequence_get(iter);
-        segment->offset += inf_text_chunk_get_length(text);
-      }
-
-      self->length += text->length;
-    }
-  }
-  else
+  /* Inserting segment by segment merges the first and last segment of text
+   * with the adjacent segments of self if possible. Segments in between are
+   * written by different authors than their neighbours anyway. */
+  for(segment = inf_text_chunk_segment_first(text->root);
+      segment != NULL;
+      segment = inf_text_chunk_segment_next(segment))
   {
-    for(text_iter = g_sequence_get_begin_iter(text->segments);
-        text_iter != g_sequence_get_end_iter(text->segments);
-        text_iter = g_sequence_iter_next(text_iter))
-    {
-      segment = (InfTextChunkSegment*)g_sequence_get(text_iter);
-      new_segment = g_slice_new(InfTextChunkSegment);
-
-      new_segment->author = segment->author;
-      new_segment->text = g_memdup(segment->text, segment->length);
-      new_segment->length = segment->length;
-      new_segment->offset = segment->offset;
-
-      g_sequence_append(self->segments, new_segment);
-    }
+    inf_text_chunk_insert_text(
+      self,
+      offset,
+      segment->text,
+      segment->length,
+      segment->chars,
+      segment->author
+    );
 
-    self->length += text->length;
+    offset += segment->chars;
   }
-
-#ifdef CHUNK_CHECK_INTEGRITY
-  g_assert(inf_text_chunk_check_integrity(self) == TRUE);
-#endif
 }
 
 /**
@@ -995,178 +1689,45 @@ inf_text_chunk_erase(InfTextChunk* self,
                      guint begin,
                      guint length)
 {
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
-  GSequenceIter* beyond;
-  gsize first_index;
-  gsize last_index;
-  InfTextChunkSegment* first;
-  InfTextChunkSegment* last;
+  InfTextChunkSegment* segment;
+  guint segment_offset;
+  guint remaining;
 
   g_return_if_fail(self != NULL);
   g_return_if_fail(begin + length <= self->length);
 
-  if(self->length > 0 && length > 0)
-  {
-    first_iter = inf_text_chunk_get_segment(self, begin, &first_index);
-    last_iter = inf_text_chunk_get_segment(self, begin + length, &last_index);
-
-    first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-    last = (InfTextChunkSegment*)g_sequence_get(last_iter);
-
-    if(begin > 0 && begin + length < self->length)
-    {
-      if(first_index == 0)
-      {
-        g_assert(first_iter != g_sequence_get_end_iter(self->segments));
-        first_iter = g_sequence_iter_prev(first_iter);
-        first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-        first_index = first->length;
-      }
-
-      if(first->author == last->author)
-      {
-        /* Can merge */
-        if(first == last)
-        {
-          /* Remove within a segment */
-          g_memmove(
-            first->text + first_index,
-            first->text + last_index,
-            first->length - last_index
-          );
-
-          first->length -= (last_index - first_index);
-          beyond = g_sequence_iter_next(last_iter);
-        }
-        else
-        {
-          if(first->length < first_index + last->length - last_index)
-          {
-            first->text = g_realloc(
-              first->text,
-              first_index + last->length - last_index
-            );
-          }
-
-          first->length = first_index + last->length - last_index;
-
-          memcpy(
-            first->text + first_index,
-            last->text + last_index,
-            last->length - last_index
-          );
-
-          last_iter = g_sequence_iter_next(last_iter);
-          beyond = last_iter;
-        }
-      }
-      else
-      {
-        /* This could only happen if these are the first or last segment,
-         * of the whole chunk, respectively, which they are not
-         * (as checked above). */
-        g_assert(first_index > 0);
-        g_assert(last_index < last->length);
-        
-        /* Erase from border segments */
-        first->length = first_index;
-
-        if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-        }
-
-        last->length -= last_index;
-        last->offset = begin;
-
-        /* We already adjusted offset of last, so only adjust behind */
-        beyond = g_sequence_iter_next(last_iter);
-      }
-
-      /* Keep first alive, we merged stuff into it */
-      first_iter = g_sequence_iter_next(first_iter);
-    }
-    else
-    {
-      if(begin == 0 && length == self->length)
-      {
-        /* Erase everything */
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
-
-        beyond = last_iter;
-      }
-      else if(begin == 0)
-      {
-        g_assert(last_index < last->length);
-
-        /* Erase from beginning */
-        if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-
-          last->length -= last_index;
-          last->offset = 0;
-
-          beyond = g_sequence_iter_next(last_iter);
-        }
-        else
-        {
-          /* First segments are completely removed */
-          beyond = last_iter;
-        }
-      }
-      else
-      {
-        /* Erase until end */
-
-        /* This could only be possible in the last segment, but then we
-         * would erase 0-length, which is a special case we would have
-         * catched elsewhere. */
-        g_assert(first_index < first->length);
-
-
-        if(first_index > 0)
-        {
-          /* Cannot erase whole first chunk */
-          first->length = first_index;
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-        
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
-
-        beyond = last_iter;
-      }
-    }
+  if(length == 0)
+    return;
 
-    /* first_iter and last_iter have been adjusted so that we have to
-     * remove [first_iter, last_iter). */
+  /* Split the border segments so that only whole segments need to be
+   * removed. */
+  inf_text_chunk_split(self, begin);
+  inf_text_chunk_split(self, begin + length);
 
-    /* segments are freed through the sequence's destroy function */
-    g_sequence_remove_range(first_iter, last_iter);
+  /* Removing a segment can invalidate pointers to other segments, so look
+   * up each one again. */
+  remaining = length;
+  while(remaining > 0)
+  {
+    segment = inf_text_chunk_get_segment(self, begin, &segment_offset);
+    g_assert(segment != NULL && segment_offset == 0);
+    g_assert(segment->chars <= remaining);
 
-    /* adjust offsets */
-    for(first_iter = beyond;
-        first_iter != g_sequence_get_end_iter(self->segments);
-        first_iter = g_sequence_iter_next(first_iter))
-    {
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      first->offset -= length;
-    }
+    remaining -= segment->chars;
+    inf_text_chunk_remove_segment(self, segment);
   }
 
   self->length -= length;
 
+  /* Merge the segments at the border if they were written by the same
+   * author. */
+  if(begin > 0 && begin < self->length)
+  {
+    segment = inf_text_chunk_get_segment(self, begin - 1, &segment_offset);
+    if(segment->author == inf_text_chunk_segment_next(segment)->author)
+      inf_text_chunk_merge_next(self, segment);
+  }
+
 #ifdef CHUNK_CHECK_INTEGRITY
   g_assert(inf_text_chunk_check_integrity(self) == TRUE);
 #endif
@@ -1188,33 +1749,24 @@ gpointer
 inf_text_chunk_get_text(InfTextChunk* self,
                         gsize* length)
 {
-  GSequenceIter* iter;
   InfTextChunkSegment* segment;
   gsize bytes;
   gsize cur;
   gchar* result;
-  
+
   g_return_val_if_fail(self != NULL, NULL);
-  bytes = 0;
 
-  /* First pass, determine size */
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    bytes += segment->length;
-  }
+  bytes = 0;
+  if(self->root != NULL)
+    bytes = self->root->subtree_length;
 
-  /* Second pass, copy */
   result = g_malloc(bytes);
   cur = 0;
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
+  for(segment = inf_text_chunk_segment_first(self->root);
+      segment != NULL;
+      segment = inf_text_chunk_segment_next(segment))
   {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
     memcpy(result + cur, segment->text, segment->length);
     cur += segment->length;
   }
@@ -1237,8 +1789,6 @@ gboolean
 inf_text_chunk_equal(InfTextChunk* self,
                      InfTextChunk* other)
 {
-  GSequenceIter* iter1;
-  GSequenceIter* iter2;
   InfTextChunkSegment* segment1;
   InfTextChunkSegment* segment2;
 
@@ -1246,30 +1796,23 @@ inf_text_chunk_equal(InfTextChunk* self,
   g_return_val_if_fail(other != NULL, FALSE);
   g_return_val_if_fail(self->encoding == other->encoding, FALSE);
 
-  iter1 = g_sequence_get_begin_iter(self->segments);
-  iter2 = g_sequence_get_begin_iter(other->segments);
+  segment1 = inf_text_chunk_segment_first(self->root);
+  segment2 = inf_text_chunk_segment_first(other->root);
 
-  while(iter1 != g_sequence_get_end_iter(self->segments) &&
-        iter2 != g_sequence_get_end_iter(other->segments))
+  while(segment1 != NULL && segment2 != NULL)
   {
-    segment1 = (InfTextChunkSegment*)g_sequence_get(iter1);
-    segment2 = (InfTextChunkSegment*)g_sequence_get(iter2);
-
     if(segment1->length != segment2->length)
       return FALSE;
 
     if(memcmp(segment1->text, segment2->text, segment1->length) != 0)
       return FALSE;
 
-    iter1 = g_sequence_iter_next(iter1);
-    iter2 = g_sequence_iter_next(iter2);
+    segment1 = inf_text_chunk_segment_next(segment1);
+    segment2 = inf_text_chunk_segment_next(segment2);
   }
 
-  if(iter1 != g_sequence_get_end_iter(self->segments) ||
-     iter2 != g_sequence_get_end_iter(other->segments))
-  {
+  if(segment1 != NULL || segment2 != NULL)
     return FALSE;
-  }
 
   return TRUE;
 }
@@ -1295,8 +1838,8 @@ inf_text_chunk_iter_init_begin(InfTextChunk* self,
   if(self->length > 0)
   {
     iter->chunk = self;
-    iter->first = g_sequence_get_begin_iter(self->segments);
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->segment = inf_text_chunk_segment_first(self->root);
+    iter->offset = 0;
     return TRUE;
   }
   else
@@ -1320,14 +1863,18 @@ gboolean
 inf_text_chunk_iter_init_end(InfTextChunk* self,
                              InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* last;
+
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(iter != NULL, FALSE);
 
   if(self->length > 0)
   {
+    last = inf_text_chunk_segment_last(self->root);
+
     iter->chunk = self;
-    iter->second = g_sequence_get_end_iter(self->segments);
-    iter->first = g_sequence_iter_prev(iter->second);
+    iter->segment = last;
+    iter->offset = self->length - last->chars;
     return TRUE;
   }
   else
@@ -1348,12 +1895,18 @@ inf_text_chunk_iter_init_end(InfTextChunk* self,
 gboolean
 inf_text_chunk_iter_next(InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* next;
+
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_end(iter->second) == FALSE)
+  segment = (InfTextChunkSegment*)iter->segment;
+  next = inf_text_chunk_segment_next(segment);
+
+  if(next != NULL)
   {
-    iter->first = iter->second;
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->segment = next;
+    iter->offset += segment->chars;
     return TRUE;
   }
   else
@@ -1374,12 +1927,16 @@ inf_text_chunk_iter_next(InfTextChunkIter* iter)
 gboolean
 inf_text_chunk_iter_prev(InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* prev;
+
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_begin(iter->first) == FALSE)
+  prev = inf_text_chunk_segment_prev((InfTextChunkSegment*)iter->segment);
+
+  if(prev != NULL)
   {
-    iter->second = iter->first;
-    iter->first = g_sequence_iter_prev(iter->first);
+    iter->segment = prev;
+    iter->offset -= prev->chars;
     return TRUE;
   }
   else
@@ -1401,7 +1958,7 @@ gconstpointer
 inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, NULL);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->text;
+  return ((InfTextChunkSegment*)iter->segment)->text;
 }
 
 /**
@@ -1416,12 +1973,16 @@ inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-
   g_return_val_if_fail(iter != NULL, 0);
 
-  first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-  return first->offset;
+#ifdef CHUNK_CHECK_INTEGRITY
+  g_assert(
+    iter->offset ==
+    inf_text_chunk_get_segment_offset((InfTextChunkSegment*)iter->segment)
+  );
+#endif
+
+  return iter->offset;
 }
 
 /**
@@ -1435,22 +1996,8 @@ inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_length(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-  InfTextChunkSegment* second;
-
   g_return_val_if_fail(iter != NULL, 0);
-
-  if(g_sequence_iter_is_end(iter->second) == TRUE)
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    return iter->chunk->length - first->offset;
-  }
-  else
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    second = (InfTextChunkSegment*)g_sequence_get(iter->second);
-    return second->offset - first->offset;
-  }
+  return ((InfTextChunkSegment*)iter->segment)->chars;
 }
 
 /**
@@ -1465,7 +2012,7 @@ gsize
 inf_text_chunk_iter_get_bytes(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->length;
+  return ((InfTextChunkSegment*)iter->segment)->length;
 }
 
 /**
@@ -1480,7 +2027,7 @@ guint
 inf_text_chunk_iter_get_author(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->author;
+  return ((InfTextChunkSegment*)iter->segment)->author;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -74,6 +74,23 @@ inf_text_default_insert_operation_finalize(GObject* object)
   G_OBJECT_CLASS(inf_text_default_insert_operation_parent_class)->finalize(object);
 }
 
+/* Creates a new operation without going through the GObject property
+ * machinery, taking ownership of @chunk. */
+static InfTextDefaultInsertOperation*
+inf_text_default_insert_operation_new_take(guint position,
+                                           InfTextChunk* chunk)
+{
+  GObject* object;
+  InfTextDefaultInsertOperationPrivate* priv;
+
+  object = g_object_new(INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION, NULL);
+  priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(object);
+
+  priv->position = position;
+  priv->chunk = chunk;
+  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
+}
+
 static void
 inf_text_default_insert_operation_set_property(GObject* object,
                                                guint prop_id,
@@ -185,11 +202,9 @@ inf_text_default_insert_operation_copy(InfAdoptedOperation* operation)
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
   return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-      "position", priv->position,
-      "chunk", priv->chunk,
-      NULL
+    inf_text_default_insert_operation_new_take(
+      priv->position,
+      inf_text_chunk_copy(priv->chunk)
     )
   );
 }
@@ -270,18 +285,14 @@ inf_text_default_insert_operation_transform_position(
   guint position)
 {
   InfTextDefaultInsertOperationPrivate* priv;
-  GObject* result;
-
   priv = INF_TEXT_DEFAULT_INSERT_OPERATION_PRIVATE(operation);
 
-  result = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", position,
-    "chunk", priv->chunk,
-    NULL
+  return INF_TEXT_INSERT_OPERATION(
+    inf_text_default_insert_operation_new_take(
+      position,
+      inf_text_chunk_copy(priv->chunk)
+    )
   );
-
-  return INF_TEXT_INSERT_OPERATION(result);
 }
 
 static void
@@ -362,18 +373,12 @@ InfTextDefaultInsertOperation*
 inf_text_default_insert_operation_new(guint pos,
                                       InfTextChunk* chunk)
 {
-  GObject* object;
-
   g_return_val_if_fail(chunk != NULL, NULL);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_DEFAULT_INSERT_OPERATION,
-    "position", pos,
-    "chunk", chunk,
-    NULL
+  return inf_text_default_insert_operation_new_take(
+    pos,
+    inf_text_chunk_copy(chunk)
   );
-
-  return INF_TEXT_DEFAULT_INSERT_OPERATION(object);
 }
 
 /**
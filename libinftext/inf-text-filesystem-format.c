@@ -36,37 +36,91 @@
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <libxml/parser.h>
+#include <glib/gstdio.h>
+
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 
-typedef struct _InfTextFilesystemFormatWriteData {
-  xmlNodePtr root;
-  GHashTable* encountered_authors;
-} InfTextFilesystemFormatWriteData;
+#ifdef G_OS_WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
 
-static GQuark
-inf_text_filesystem_format_error_quark()
-{
-  return g_quark_from_static_string("INF_TEXT_FILESYSTEM_FORMAT_ERROR");
-}
+typedef struct _InfTextFilesystemFormatUser {
+  guint id;
+  gchar* name;
+  gdouble hue;
+} InfTextFilesystemFormatUser;
 
-static int
-inf_text_filesystem_format_read_read_func(void* context,
-                                          char* buffer,
-                                          int len)
-{
-  gsize res;
-  res = infd_filesystem_storage_stream_read((FILE*)context, buffer, len);
+typedef struct _InfTextFilesystemFormatSnapshot {
+  InfTextChunk* chunk;
+  GArray* users; /* of InfTextFilesystemFormatUser */
 
-  if(ferror((FILE*)context))
-    return -1;
+  gboolean has_journal;
+  guint64 journal_sequence;
+} InfTextFilesystemFormatSnapshot;
 
-  return (int)res;
-}
+typedef struct _InfTextFilesystemFormatWriteAsync {
+  InfTextFilesystemFormatSnapshot* snapshot;
+  gchar* full_path;
+  gchar* temp_path;
+  gchar* journal_path;
+  gboolean has_journal;
+  GWeakRef journal;
+  guint64 journal_sequence;
+  GError* error;
+
+  InfTextFilesystemFormatWriteFunc func;
+  gpointer user_data;
+} InfTextFilesystemFormatWriteAsync;
+
+/* The file is read in blocks of this size. Segment text is inserted into
+ * the buffer as soon as this much of it has been parsed, so that a long
+ * segment is not held in memory as a whole either. */
+#define INF_TEXT_FILESYSTEM_FORMAT_READER_BLOCK_SIZE (64 * 1024)
+
+typedef enum _InfTextFilesystemFormatReaderState {
+  INF_TEXT_FILESYSTEM_FORMAT_READER_START,
+  INF_TEXT_FILESYSTEM_FORMAT_READER_SESSION,
+  INF_TEXT_FILESYSTEM_FORMAT_READER_BUFFER,
+  INF_TEXT_FILESYSTEM_FORMAT_READER_SEGMENT
+} InfTextFilesystemFormatReaderState;
+
+struct _InfTextFilesystemFormatReader {
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  gboolean is_utf8;
+
+  FILE* stream;
+  guint64 size;
+  guint64 position;
+  gchar* block;
+  xmlParserCtxtPtr parser;
 
-static int
-inf_text_filesystem_format_read_close_func(void* context)
+  InfTextFilesystemFormatReaderState state;
+  guint skip_depth;
+
+  /* Text of the current segment which has not yet been inserted */
+  InfUser* author;
+  GString* text;
+  guint chars;
+
+  gboolean has_journal;
+  guint64 journal_sequence;
+
+  GError* error;
+  gboolean done;
+};
+
+static GQuark
+inf_text_filesystem_format_error_quark()
 {
-  return infd_filesystem_storage_stream_close((FILE*)context);
+  return g_quark_from_static_string("INF_TEXT_FILESYSTEM_FORMAT_ERROR");
 }
 
 static gboolean
@@ -138,252 +192,196 @@ inf_text_filesystem_format_read_user(InfUserTable* user_table,
   return result;
 }
 
-static gboolean
-inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
-                                       InfUserTable* user_table,
-                                       xmlNodePtr node,
-                                       GError** error)
+/* Creates an element node with the attributes passed to a SAX2
+ * startElementNs handler, so that the inf_xml_util functions can be used to
+ * read them. */
+static xmlNodePtr
+inf_text_filesystem_format_reader_make_node(const xmlChar* localname,
+                                            int nb_attributes,
+                                            const xmlChar** attributes)
 {
-  xmlNodePtr child;
-  guint author;
-  gchar* content;
-  gboolean result;
-  gboolean res;
-  InfUser* user;
-  gsize bytes;
-  guint chars;
-
-  gboolean is_utf8;
-  gchar* converted;
-  gsize converted_bytes;
-
-  g_assert(inf_text_buffer_get_length(buffer) == 0);
+  xmlNodePtr node;
+  const xmlChar* value;
+  const xmlChar* end;
+  GString* str;
+  int i;
 
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
+  node = xmlNewNode(NULL, localname);
+  str = g_string_sized_new(16);
 
-  for(child = node->children; child != NULL; child = child->next)
+  /* Each attribute is given as localname, prefix, URI, value and end */
+  for(i = 0; i < nb_attributes; ++i)
   {
-    if(child->type != XML_ELEMENT_NODE)
-      continue;
-
-    if(strcmp((const gchar*)child->name, "segment") == 0)
+    value = attributes[i * 5 + 3];
+    end = attributes[i * 5 + 4];
+
+    /* Without entity substitution, libxml2 decodes all references in
+     * attribute values except for the ampersand, which it passes on as
+     * "&#38;". */
+    g_string_truncate(str, 0);
+    while(value < end)
     {
-      res = inf_xml_util_get_attribute_uint_required(
-        child,
-        "author",
-        &author,
-        error
-      );
-
-      if(res == FALSE)
-        return FALSE;
-
-      if(author != 0)
+      if(end - value >= 5 && memcmp(value, "&#38;", 5) == 0)
       {
-        user = inf_user_table_lookup_user_by_id(user_table, author);
-
-        if(user == NULL)
-        {
-          g_set_error(
-            error,
-            g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
-            INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
-            _("User with ID \"%u\" does not exist"),
-            author
-          );
-
-          return FALSE;
-        }
+        g_string_append_c(str, '&');
+        value += 5;
       }
       else
       {
-        user = NULL;
-      }
-
-      content = inf_xml_util_get_child_text(child, &bytes, &chars, error);
-      if(!content) return FALSE;
-
-      if(*content != '\0')
-      {
-        if(is_utf8)
-        {
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
-            content,
-            bytes,
-            chars,
-            user
-          );
-
-          g_free(content);
-        }
-        else
-        {
-          /* Convert from UTF-8 to buffer encoding */
-          converted = g_convert(
-            content,
-            bytes,
-            inf_text_buffer_get_encoding(buffer),
-            "UTF-8",
-            NULL,
-            &converted_bytes, error
-          );
-
-          g_free(content);
-
-          if(converted == NULL)
-            return FALSE;
-
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
-            converted,
-            converted_bytes,
-            chars,
-            user
-          );
-
-          g_free(converted);
-        }
+        g_string_append_c(str, *value);
+        ++value;
       }
     }
+
+    xmlNewProp(node, attributes[i * 5], (const xmlChar*)str->str);
   }
 
-  return TRUE;
+  g_string_free(str, TRUE);
+  return node;
 }
 
-static void
-inf_text_filesystem_format_write_foreach_user_func(InfUser* user,
-                                                   gpointer user_data)
+/* Inserts the text of the current segment that has been parsed so far at
+ * the end of the buffer. */
+static gboolean
+inf_text_filesystem_format_reader_flush(InfTextFilesystemFormatReader* reader,
+                                        GError** error)
 {
-  InfTextFilesystemFormatWriteData* data;
-  gpointer user_id;
-  xmlNodePtr node;
+  gchar* converted;
+  gsize converted_bytes;
 
-  data = (InfTextFilesystemFormatWriteData*)user_data;
-  user_id = GUINT_TO_POINTER(inf_user_get_id(user));
+  if(reader->text->len == 0)
+    return TRUE;
 
-  /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
-  if(g_hash_table_lookup(data->encountered_authors, user_id) != NULL)
+  if(reader->is_utf8)
+  {
+    inf_text_buffer_insert_text(
+      reader->buffer,
+      inf_text_buffer_get_length(reader->buffer),
+      reader->text->str,
+      reader->text->len,
+      reader->chars,
+      reader->author
+    );
+  }
+  else
   {
-    node = xmlNewChild(data->root, NULL, (const xmlChar*)"user", NULL);
+    /* Convert from UTF-8 to buffer encoding */
+    converted = g_convert(
+      reader->text->str,
+      reader->text->len,
+      inf_text_buffer_get_encoding(reader->buffer),
+      "UTF-8",
+      NULL,
+      &converted_bytes,
+      error
+    );
 
-    inf_xml_util_set_attribute_uint(node, "id", inf_user_get_id(user));
-    inf_xml_util_set_attribute(node, "name", inf_user_get_name(user));
-    inf_xml_util_set_attribute_double(
-      node,
-      "hue",
-      inf_text_user_get_hue(INF_TEXT_USER(user))
+    if(converted == NULL)
+      return FALSE;
+
+    inf_text_buffer_insert_text(
+      reader->buffer,
+      inf_text_buffer_get_length(reader->buffer),
+      converted,
+      converted_bytes,
+      reader->chars,
+      reader->author
     );
+
+    g_free(converted);
   }
+
+  g_string_truncate(reader->text, 0);
+  reader->chars = 0;
+  return TRUE;
 }
 
-/**
- * inf_text_filesystem_format_read:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path to retrieve the session from.
- * @user_table: An empty #InfUserTable to use as the new session's user table.
- * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Reads a text session from @path in @storage. The file is expected to have
- * been saved with inf_text_filesystem_format_write() before. The @user_table
- * parameter should be an empty user table that will be used for the session,
- * and the @buffer parameter should be an empty #InfTextBuffer, and the
- * document will be written into this buffer. If the function succeeds, the
- * user table and buffer can be used to create an #InfTextSession with
- * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
-                                const gchar* path,
-                                InfUserTable* user_table,
-                                InfTextBuffer* buffer,
-                                GError** error)
+static gboolean
+inf_text_filesystem_format_reader_start_segment(
+  InfTextFilesystemFormatReader* reader,
+  xmlNodePtr node,
+  GError** error)
 {
-  FILE* stream;
-  gchar* full_path;
-  gchar* uri;
+  guint author;
+  InfUser* user;
 
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  xmlNodePtr root;
-  xmlNodePtr child;
-  gboolean result;
+  if(!inf_xml_util_get_attribute_uint_required(node, "author", &author,
+                                                error))
+  {
+    return FALSE;
+  }
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+  user = NULL;
+  if(author != 0)
+  {
+    user = inf_user_table_lookup_user_by_id(reader->user_table, author);
 
-  /* TODO: Use a SAX parser for better performance */
-  full_path = NULL;
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "r",
-    &full_path,
-    error
-  );
+    if(user == NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+        _("User with ID \"%u\" does not exist"),
+        author
+      );
 
-  if(stream == NULL)
-  {
-    g_free(full_path);
-    return FALSE;
+      return FALSE;
+    }
   }
 
-  uri = g_filename_to_uri(full_path, NULL, error);
-  g_free(full_path);
+  reader->author = user;
+  return TRUE;
+}
 
-  if(uri == NULL)
-    return FALSE;
+static void
+inf_text_filesystem_format_reader_start_element_cb(
+  void* ctx,
+  const xmlChar* localname,
+  const xmlChar* prefix,
+  const xmlChar* uri,
+  int nb_namespaces,
+  const xmlChar** namespaces,
+  int nb_attributes,
+  int nb_defaulted,
+  const xmlChar** attributes)
+{
+  InfTextFilesystemFormatReader* reader;
+  const gchar* name;
+  xmlNodePtr node;
+  xmlChar* sequence;
+  guint codepoint;
+  gboolean result;
 
-  doc = xmlReadIO(
-    inf_text_filesystem_format_read_read_func,
-    inf_text_filesystem_format_read_close_func,
-    stream,
-    uri,
-    "UTF-8",
-    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
-  );
+  reader = (InfTextFilesystemFormatReader*)ctx;
+  name = (const gchar*)localname;
 
-  g_free(uri);
+  if(reader->error != NULL)
+    return;
 
-  if(doc == NULL)
+  /* Unknown elements are skipped together with their content */
+  if(reader->skip_depth > 0)
   {
-    xmlerror = xmlGetLastError();
+    ++reader->skip_depth;
+    return;
+  }
 
-    g_set_error(
-      error,
-      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
-      xmlerror->code,
-      _("Error parsing XML in file \"%s\": [%d]: %s"),
-      path,
-      xmlerror->line,
-      xmlerror->message
-    );
+  node = inf_text_filesystem_format_reader_make_node(
+    localname,
+    nb_attributes,
+    attributes
+  );
 
-    result = FALSE;
-  }
-  else
+  result = TRUE;
+  switch(reader->state)
   {
-    root = xmlDocGetRootElement(doc);
-    if(strcmp((const char*)root->name, "inf-text-session") != 0)
+  case INF_TEXT_FILESYSTEM_FORMAT_READER_START:
+    if(strcmp(name, "inf-text-session") != 0)
     {
-      g_set_error(
-        error,
+      g_set_error_literal(
+        &reader->error,
         inf_text_filesystem_format_error_quark(),
         INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
-        _("Error processing file \"%s\": %s"),
-        path,
         _("The document is not a text session")
       );
 
@@ -391,121 +389,288 @@ inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
     }
     else
     {
-      for(child = root->children; child != NULL; child = child->next)
+      /* Only replay the journal if the file was written with one.
+       * Otherwise the journal, if any, is left over from an earlier
+       * session. */
+      sequence = inf_xml_util_get_attribute(node, "journal-sequence");
+      if(sequence != NULL)
       {
-        if(child->type != XML_ELEMENT_NODE)
-          continue;
-
-        if(strcmp((const char*)child->name, "user") == 0)
-        {
-          if(!inf_text_filesystem_format_read_user(user_table, child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-        else if(strcmp((const char*)child->name, "buffer") == 0)
-        {
-          if(!inf_text_filesystem_format_read_buffer(buffer, user_table,
-                                                     child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
+        reader->has_journal = TRUE;
+        reader->journal_sequence =
+          g_ascii_strtoull((const gchar*)sequence, NULL, 10);
+        xmlFree(sequence);
       }
 
-      if(child == NULL)
-        result = TRUE;
+      reader->state = INF_TEXT_FILESYSTEM_FORMAT_READER_SESSION;
     }
 
-    xmlFreeDoc(doc);
+    break;
+  case INF_TEXT_FILESYSTEM_FORMAT_READER_SESSION:
+    if(strcmp(name, "user") == 0)
+    {
+      result = inf_text_filesystem_format_read_user(
+        reader->user_table,
+        node,
+        &reader->error
+      );
+
+      reader->skip_depth = 1;
+    }
+    else if(strcmp(name, "buffer") == 0)
+    {
+      reader->state = INF_TEXT_FILESYSTEM_FORMAT_READER_BUFFER;
+    }
+    else
+    {
+      reader->skip_depth = 1;
+    }
+
+    break;
+  case INF_TEXT_FILESYSTEM_FORMAT_READER_BUFFER:
+    if(strcmp(name, "segment") == 0)
+    {
+      result = inf_text_filesystem_format_reader_start_segment(
+        reader,
+        node,
+        &reader->error
+      );
+
+      reader->state = INF_TEXT_FILESYSTEM_FORMAT_READER_SEGMENT;
+    }
+    else
+    {
+      reader->skip_depth = 1;
+    }
+
+    break;
+  case INF_TEXT_FILESYSTEM_FORMAT_READER_SEGMENT:
+    /* Characters which are not allowed in XML are written as
+     * <uchar codepoint="..."/>, see inf_xml_util_add_child_text(). */
+    if(strcmp(name, "uchar") == 0)
+    {
+      result = inf_xml_util_get_attribute_uint_required(
+        node,
+        "codepoint",
+        &codepoint,
+        &reader->error
+      );
+
+      if(result == TRUE)
+      {
+        g_string_append_unichar(reader->text, (gunichar)codepoint);
+        ++reader->chars;
+      }
+    }
+
+    reader->skip_depth = 1;
+    break;
+  default:
+    g_assert_not_reached();
+    break;
   }
 
-  return result;
+  xmlFreeNode(node);
+
+  if(result == FALSE)
+    xmlStopParser(reader->parser);
 }
 
-/**
- * inf_text_filesystem_format_write:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path where to write the session to.
- * @user_table: The #InfUserTable to write.
- * @buffer: The #InfTextBuffer to write.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Writes the given user table and buffer into the filesystem storage at
- * @path. If successful, the session can then be read back with
- * inf_text_filesystem_format_read(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
-                                 const gchar* path,
-                                 InfUserTable* user_table,
-                                 InfTextBuffer* buffer,
-                                 GError** error)
+static void
+inf_text_filesystem_format_reader_end_element_cb(void* ctx,
+                                                 const xmlChar* localname,
+                                                 const xmlChar* prefix,
+                                                 const xmlChar* uri)
 {
-  InfTextBufferIter* iter;
-  xmlNodePtr buffer_node;
-  xmlNodePtr segment_node;
+  InfTextFilesystemFormatReader* reader;
+  reader = (InfTextFilesystemFormatReader*)ctx;
 
-  guint author;
-  gchar* content;
-  gsize bytes;
-  gchar* converted;
-  gsize converted_bytes;
-
-  FILE* stream;
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  gboolean is_utf8;
+  if(reader->error != NULL)
+    return;
 
-  InfTextFilesystemFormatWriteData data;
+  if(reader->skip_depth > 0)
+  {
+    --reader->skip_depth;
+    return;
+  }
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  switch(reader->state)
+  {
+  case INF_TEXT_FILESYSTEM_FORMAT_READER_SEGMENT:
+    if(!inf_text_filesystem_format_reader_flush(reader, &reader->error))
+      xmlStopParser(reader->parser);
+
+    reader->author = NULL;
+    reader->state = INF_TEXT_FILESYSTEM_FORMAT_READER_BUFFER;
+    break;
+  case INF_TEXT_FILESYSTEM_FORMAT_READER_BUFFER:
+    reader->state = INF_TEXT_FILESYSTEM_FORMAT_READER_SESSION;
+    break;
+  default:
+    break;
+  }
+}
 
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
+static void
+inf_text_filesystem_format_reader_characters_cb(void* ctx,
+                                                const xmlChar* ch,
+                                                int len)
+{
+  InfTextFilesystemFormatReader* reader;
+  reader = (InfTextFilesystemFormatReader*)ctx;
 
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "w",
-    NULL,
-    error
-  );
+  if(reader->error != NULL || reader->skip_depth > 0)
+    return;
 
-  if(stream == NULL)
-    return FALSE;
+  if(reader->state != INF_TEXT_FILESYSTEM_FORMAT_READER_SEGMENT)
+    return;
 
-  data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
-  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  /* libxml2 never splits a character across two calls, so the text can be
+   * inserted into the buffer at any point in between. */
+  g_string_append_len(reader->text, (const gchar*)ch, len);
+  reader->chars += g_utf8_strlen((const gchar*)ch, len);
 
-  buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
-  iter = inf_text_buffer_create_begin_iter(buffer);
-  if(iter != NULL)
+  if(reader->text->len >= INF_TEXT_FILESYSTEM_FORMAT_READER_BLOCK_SIZE &&
+     !inf_text_filesystem_format_reader_flush(reader, &reader->error))
   {
-    do
-    {
-      author = inf_text_buffer_iter_get_author(buffer, iter);
-      content = inf_text_buffer_iter_get_text(buffer, iter);
-      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+    xmlStopParser(reader->parser);
+  }
+}
 
-      /* TODO: Use g_hash_table_add with glib 2.32 */
-      g_hash_table_insert(
-        data.encountered_authors,
+static void
+inf_text_filesystem_format_snapshot_foreach_user_func(InfUser* user,
+                                                      gpointer user_data)
+{
+  GArray* users;
+  InfTextFilesystemFormatUser entry;
+
+  users = (GArray*)user_data;
+
+  entry.id = inf_user_get_id(user);
+  entry.name = g_strdup(inf_user_get_name(user));
+  entry.hue = inf_text_user_get_hue(INF_TEXT_USER(user));
+  g_array_append_val(users, entry);
+}
+
+/* Takes a snapshot of what is written to disk. For InfTextDefaultBuffer, the
+ * chunk shares the segment text with the buffer, so this is cheap even for
+ * large documents. The snapshot does not refer to any GObject anymore, and
+ * can be serialized in a worker thread while the session continues. */
+static InfTextFilesystemFormatSnapshot*
+inf_text_filesystem_format_snapshot_new(InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        InfTextJournal* journal)
+{
+  InfTextFilesystemFormatSnapshot* snapshot;
+
+  snapshot = g_slice_new(InfTextFilesystemFormatSnapshot);
+
+  snapshot->has_journal = FALSE;
+  snapshot->journal_sequence = 0;
+  if(journal != NULL)
+  {
+    snapshot->has_journal = TRUE;
+    snapshot->journal_sequence = inf_text_journal_get_sequence(journal);
+  }
+
+  snapshot->chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  snapshot->users = g_array_new(
+    FALSE,
+    FALSE,
+    sizeof(InfTextFilesystemFormatUser)
+  );
+
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_snapshot_foreach_user_func,
+    snapshot->users
+  );
+
+  return snapshot;
+}
+
+static void
+inf_text_filesystem_format_snapshot_free(
+  InfTextFilesystemFormatSnapshot* snapshot)
+{
+  guint i;
+
+  for(i = 0; i < snapshot->users->len; ++i)
+  {
+    g_free(
+      g_array_index(snapshot->users, InfTextFilesystemFormatUser, i).name
+    );
+  }
+
+  g_array_free(snapshot->users, TRUE);
+  inf_text_chunk_free(snapshot->chunk);
+  g_slice_free(InfTextFilesystemFormatSnapshot, snapshot);
+}
+
+/* Builds the XML document for the given snapshot. This is used by both the
+ * synchronous and the asynchronous writer. */
+static xmlDocPtr
+inf_text_filesystem_format_snapshot_to_xml(
+  InfTextFilesystemFormatSnapshot* snapshot,
+  GError** error)
+{
+  InfTextChunkIter iter;
+  xmlNodePtr root;
+  xmlNodePtr buffer_node;
+  xmlNodePtr segment_node;
+  xmlNodePtr node;
+  xmlDocPtr doc;
+  GHashTable* encountered_authors;
+  InfTextFilesystemFormatUser* user;
+  const gchar* encoding;
+  gboolean is_utf8;
+  guint i;
+
+  guint author;
+  gconstpointer content;
+  gsize bytes;
+  gchar* converted;
+  gsize converted_bytes;
+  gchar sequence[G_ASCII_DTOSTR_BUF_SIZE];
+
+  encoding = inf_text_chunk_get_encoding(snapshot->chunk);
+
+  is_utf8 = TRUE;
+  if(strcmp(encoding, "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
+  encountered_authors = g_hash_table_new(NULL, NULL);
+
+  /* The journal records up to this one are contained in the snapshot */
+  if(snapshot->has_journal)
+  {
+    g_snprintf(
+      sequence,
+      sizeof(sequence),
+      "%" G_GUINT64_FORMAT,
+      snapshot->journal_sequence
+    );
+
+    inf_xml_util_set_attribute(root, "journal-sequence", sequence);
+  }
+
+  buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
+  if(inf_text_chunk_iter_init_begin(snapshot->chunk, &iter))
+  {
+    do
+    {
+      author = inf_text_chunk_iter_get_author(&iter);
+      content = inf_text_chunk_iter_get_text(&iter);
+      bytes = inf_text_chunk_iter_get_bytes(&iter);
+
+      /* TODO: Use g_hash_table_add with glib 2.32 */
+      g_hash_table_insert(
+        encountered_authors,
         GUINT_TO_POINTER(author),
         GUINT_TO_POINTER(author)
       );
@@ -523,7 +688,6 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
       {
         /* Buffer is UTF-8, no conversion necessary */
         inf_xml_util_add_child_text(segment_node, content, bytes);
-        g_free(content);
       }
       else
       {
@@ -532,70 +696,974 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
           content,
           bytes,
           "UTF-8",
-          inf_text_buffer_get_encoding(buffer),
+          encoding,
           NULL,
           &converted_bytes,
           error
         );
 
-        g_free(content);
-
         if(converted == NULL)
         {
           xmlFreeNode(buffer_node);
-          xmlFreeNode(data.root);
-          g_hash_table_destroy(data.encountered_authors);
-          infd_filesystem_storage_stream_close(stream);
-          return FALSE;
+          xmlFreeNode(root);
+          g_hash_table_destroy(encountered_authors);
+          return NULL;
         }
 
         inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
         g_free(converted);
       }
-    } while(inf_text_buffer_iter_next(buffer, iter));
-
-    inf_text_buffer_destroy_iter(buffer, iter);
+    } while(inf_text_chunk_iter_next(&iter));
   }
 
   /* After we wrote the buffer, now write the user table, but only for those
    * users that have contributed to the document. The others we drop, to
    * avoid cluttering the user table too much. */
-  inf_user_table_foreach_user(
-    user_table,
-    inf_text_filesystem_format_write_foreach_user_func,
-    &data
-  );
+  for(i = 0; i < snapshot->users->len; ++i)
+  {
+    user = &g_array_index(snapshot->users, InfTextFilesystemFormatUser, i);
 
-  g_hash_table_destroy(data.encountered_authors);
+    /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
+    if(g_hash_table_lookup(encountered_authors,
+                           GUINT_TO_POINTER(user->id)) != NULL)
+    {
+      node = xmlNewChild(root, NULL, (const xmlChar*)"user", NULL);
+
+      inf_xml_util_set_attribute_uint(node, "id", user->id);
+      inf_xml_util_set_attribute(node, "name", user->name);
+      inf_xml_util_set_attribute_double(node, "hue", user->hue);
+    }
+  }
+
+  g_hash_table_destroy(encountered_authors);
 
   /* Write the buffer after the users */
-  xmlAddChild(data.root, buffer_node);
+  xmlAddChild(root, buffer_node);
 
   doc = xmlNewDoc((const xmlChar*)"1.0");
-  xmlDocSetRootElement(doc, data.root);
+  xmlDocSetRootElement(doc, root);
+  return doc;
+}
+
+static void
+inf_text_filesystem_format_set_xml_output_error(GError** error)
+{
+  xmlErrorPtr xmlerror;
+  xmlerror = xmlGetLastError();
+
+  g_set_error_literal(
+    error,
+    g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+    xmlerror->code,
+    xmlerror->message
+  );
+}
+
+static void
+inf_text_filesystem_format_set_system_error(int code,
+                                            GError** error)
+{
+  g_set_error_literal(
+    error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+}
+
+/* Writes doc into a new temporary file next to full_path and flushes it to
+ * disk. On success, the name of the temporary file is returned, which can
+ * then be renamed to full_path. */
+static gchar*
+inf_text_filesystem_format_write_temporary(xmlDocPtr doc,
+                                           const gchar* full_path,
+                                           GError** error)
+{
+  gchar* temp_path;
+  FILE* stream;
+  int fd;
+  int save_errno;
+
+  temp_path = g_strconcat(full_path, ".tmp-XXXXXX", NULL);
+  fd = g_mkstemp_full(temp_path, O_WRONLY, 0644);
+  if(fd == -1)
+  {
+    inf_text_filesystem_format_set_system_error(errno, error);
+    g_free(temp_path);
+    return NULL;
+  }
+
+  stream = fdopen(fd, "w");
+  if(stream == NULL)
+  {
+    save_errno = errno;
+    close(fd);
+    g_unlink(temp_path);
+    g_free(temp_path);
+
+    inf_text_filesystem_format_set_system_error(save_errno, error);
+    return NULL;
+  }
 
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
   if(xmlDocFormatDump(stream, doc, 1) == -1)
   {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
+    inf_text_filesystem_format_set_xml_output_error(error);
+    fclose(stream);
+    g_unlink(temp_path);
+    g_free(temp_path);
+    return NULL;
+  }
+
+  /* Make sure the data is on disk before the rename makes it visible, so
+   * that a crash cannot leave behind an empty or truncated file. */
+  save_errno = 0;
+  if(fflush(stream) != 0)
+    save_errno = errno;
+#ifdef G_OS_WIN32
+  else if(_commit(fd) != 0)
+    save_errno = errno;
+#else
+  else if(fsync(fd) != 0)
+    save_errno = errno;
+#endif
+
+  if(fclose(stream) != 0 && save_errno == 0)
+    save_errno = errno;
+
+  if(save_errno != 0)
+  {
+    g_unlink(temp_path);
+    g_free(temp_path);
+
+    inf_text_filesystem_format_set_system_error(save_errno, error);
+    return NULL;
+  }
+
+  return temp_path;
+}
+
+/* Called after a new snapshot has been renamed to its final name. If the
+ * snapshot was taken with a journal, the records contained in it are
+ * removed from the journal. Otherwise, a journal left behind from an
+ * earlier session is removed, since it does not belong to the snapshot. */
+static void
+inf_text_filesystem_format_finish_journal(const gchar* journal_path,
+                                          InfTextJournal* journal,
+                                          guint64 journal_sequence)
+{
+  GError* error;
+  int save_errno;
+
+  if(journal != NULL)
+  {
+    error = NULL;
+    if(!inf_text_journal_compact(journal, journal_sequence, &error))
+    {
+      /* Not fatal, the journal just keeps growing until the next snapshot
+       * is written. */
+      g_warning(
+        _("Failed to compact journal \"%s\": %s"),
+        journal_path,
+        error->message
+      );
+
+      g_error_free(error);
+    }
+  }
+  else
+  {
+    if(g_unlink(journal_path) == -1)
+    {
+      save_errno = errno;
+      if(save_errno != ENOENT)
+      {
+        g_warning(
+          _("Failed to remove stale journal \"%s\": %s"),
+          journal_path,
+          g_strerror(save_errno)
+        );
+      }
+    }
+  }
+}
+
+static void
+inf_text_filesystem_format_write_async_free(gpointer data)
+{
+  InfTextFilesystemFormatWriteAsync* async;
+  async = (InfTextFilesystemFormatWriteAsync*)data;
+
+  /* The temporary file is still there if the operation was cancelled or the
+   * rename failed. */
+  if(async->temp_path != NULL)
+  {
+    g_unlink(async->temp_path);
+    g_free(async->temp_path);
+  }
+
+  if(async->snapshot != NULL)
+    inf_text_filesystem_format_snapshot_free(async->snapshot);
+  if(async->error != NULL)
+    g_error_free(async->error);
+  /* This might run in the worker thread if the operation has been
+   * cancelled, which is why there is no strong reference to the journal. */
+  g_weak_ref_clear(&async->journal);
+
+  g_free(async->journal_path);
+  g_free(async->full_path);
+  g_slice_free(InfTextFilesystemFormatWriteAsync, async);
+}
+
+static void
+inf_text_filesystem_format_write_async_run_func(gpointer* run_data,
+                                                GDestroyNotify* run_notify,
+                                                gpointer user_data)
+{
+  InfTextFilesystemFormatWriteAsync* async;
+  xmlDocPtr doc;
+
+  async = (InfTextFilesystemFormatWriteAsync*)user_data;
+
+  doc = inf_text_filesystem_format_snapshot_to_xml(
+    async->snapshot,
+    &async->error
+  );
+
+  /* Release the shared text as early as possible, so that the session does
+   * not need to copy segments it modifies in the meanwhile. */
+  inf_text_filesystem_format_snapshot_free(async->snapshot);
+  async->snapshot = NULL;
+
+  if(doc != NULL)
+  {
+    async->temp_path = inf_text_filesystem_format_write_temporary(
+      doc,
+      async->full_path,
+      &async->error
+    );
+
     xmlFreeDoc(doc);
+  }
 
-    g_set_error_literal(
+  *run_data = async;
+  *run_notify = inf_text_filesystem_format_write_async_free;
+}
+
+static void
+inf_text_filesystem_format_write_async_done_func(gpointer run_data,
+                                                 gpointer user_data)
+{
+  InfTextFilesystemFormatWriteAsync* async;
+  InfTextJournal* journal;
+
+  async = (InfTextFilesystemFormatWriteAsync*)run_data;
+
+  /* The rename happens in the main thread, so that a file written by a
+   * synchronous save in the meanwhile is never replaced by an older one:
+   * the caller cancels the operation before such a save. */
+  if(async->temp_path != NULL)
+  {
+    if(g_rename(async->temp_path, async->full_path) == 0)
+    {
+      g_free(async->temp_path);
+      async->temp_path = NULL;
+
+      /* If the journal has been finalized meanwhile, it keeps the records
+       * contained in the snapshot until it is compacted next time. */
+      journal = g_weak_ref_get(&async->journal);
+      if(journal != NULL || !async->has_journal)
+      {
+        inf_text_filesystem_format_finish_journal(
+          async->journal_path,
+          journal,
+          async->journal_sequence
+        );
+      }
+
+      if(journal != NULL)
+        g_object_unref(journal);
+    }
+    else
+    {
+      inf_text_filesystem_format_set_system_error(errno, &async->error);
+    }
+  }
+
+  async->func(async->error, async->user_data);
+}
+
+/**
+ * inf_text_filesystem_format_reader_new:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Opens the text session at @path in @storage for reading it incrementally.
+ * Nothing is read until inf_text_filesystem_format_reader_read_next() is
+ * called. Users and text are added to @user_table and @buffer as they are
+ * parsed, and the document is never held in memory as a whole. This is the
+ * incremental version of inf_text_filesystem_format_read(), which should be
+ * used instead if progress does not need to be reported.
+ *
+ * If the file cannot be opened, the function returns %NULL and @error is
+ * set.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemFormatReader, or %NULL
+ * on error. Free with inf_text_filesystem_format_reader_free().
+ */
+InfTextFilesystemFormatReader*
+inf_text_filesystem_format_reader_new(InfdFilesystemStorage* storage,
+                                      const gchar* path,
+                                      InfUserTable* user_table,
+                                      InfTextBuffer* buffer,
+                                      GError** error)
+{
+  InfTextFilesystemFormatReader* reader;
+  xmlSAXHandler sax;
+  GStatBuf st;
+  FILE* stream;
+  gchar* full_path;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, NULL);
+
+  full_path = NULL;
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    "InfText",
+    path,
+    "r",
+    &full_path,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_free(full_path);
+    return NULL;
+  }
+
+  if(g_stat(full_path, &st) == -1)
+  {
+    inf_text_filesystem_format_set_system_error(errno, error);
+    infd_filesystem_storage_stream_close(stream);
+    g_free(full_path);
+    return NULL;
+  }
+
+  reader = g_slice_new(InfTextFilesystemFormatReader);
+  reader->storage = storage;
+  reader->path = g_strdup(path);
+  reader->user_table = user_table;
+  reader->buffer = buffer;
+
+  reader->is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    reader->is_utf8 = FALSE;
+
+  reader->stream = stream;
+  reader->size = st.st_size;
+  reader->position = 0;
+  reader->block = g_malloc(INF_TEXT_FILESYSTEM_FORMAT_READER_BLOCK_SIZE);
+
+  /* Only install the callbacks we need, so that libxml2 does not build a
+   * document tree in the background. */
+  memset(&sax, 0, sizeof(sax));
+  sax.initialized = XML_SAX2_MAGIC;
+  sax.startElementNs = inf_text_filesystem_format_reader_start_element_cb;
+  sax.endElementNs = inf_text_filesystem_format_reader_end_element_cb;
+  sax.characters = inf_text_filesystem_format_reader_characters_cb;
+  sax.cdataBlock = inf_text_filesystem_format_reader_characters_cb;
+
+  reader->parser = xmlCreatePushParserCtxt(&sax, reader, NULL, 0, full_path);
+  xmlCtxtUseOptions(reader->parser, XML_PARSE_NOWARNING | XML_PARSE_NOERROR);
+  g_free(full_path);
+
+  reader->state = INF_TEXT_FILESYSTEM_FORMAT_READER_START;
+  reader->skip_depth = 0;
+
+  reader->author = NULL;
+  reader->text = g_string_sized_new(16);
+  reader->chars = 0;
+
+  reader->has_journal = FALSE;
+  reader->journal_sequence = 0;
+
+  reader->error = NULL;
+  reader->done = FALSE;
+
+  g_object_ref(storage);
+  g_object_ref(user_table);
+  g_object_ref(buffer);
+  return reader;
+}
+
+/**
+ * inf_text_filesystem_format_reader_get_size:
+ * @reader: A #InfTextFilesystemFormatReader.
+ *
+ * Returns the size of the file that @reader reads, in bytes. This does not
+ * include the journal of the session, if any.
+ *
+ * Returns: The size of the file being read.
+ */
+guint64
+inf_text_filesystem_format_reader_get_size(
+  InfTextFilesystemFormatReader* reader)
+{
+  g_return_val_if_fail(reader != NULL, 0);
+  return reader->size;
+}
+
+/**
+ * inf_text_filesystem_format_reader_get_position:
+ * @reader: A #InfTextFilesystemFormatReader.
+ *
+ * Returns the number of bytes of the file that have been read so far. Once
+ * the whole file has been read, this is equal to
+ * inf_text_filesystem_format_reader_get_size(), unless the file has been
+ * changed in the meanwhile.
+ *
+ * Returns: The number of bytes read.
+ */
+guint64
+inf_text_filesystem_format_reader_get_position(
+  InfTextFilesystemFormatReader* reader)
+{
+  g_return_val_if_fail(reader != NULL, 0);
+  return reader->position;
+}
+
+/**
+ * inf_text_filesystem_format_reader_read_next:
+ * @reader: A #InfTextFilesystemFormatReader.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads and parses the next block of the file, and adds the users and text
+ * contained in it to the user table and buffer of @reader. After the last
+ * block, the journal of the session is replayed, if the session was written
+ * together with a #InfTextJournal.
+ *
+ * If an error occurs, then this function returns %FALSE and @error is set.
+ * If the whole session has been read, then it also returns %FALSE, but
+ * @error is left untouched. Otherwise, it returns %TRUE, and the function
+ * should be called again to read more. Once it has returned %FALSE, the
+ * function must not be called anymore.
+ *
+ * Returns: %TRUE if there is more to read, or %FALSE otherwise.
+ */
+gboolean
+inf_text_filesystem_format_reader_read_next(
+  InfTextFilesystemFormatReader* reader,
+  GError** error)
+{
+  gsize len;
+  gboolean terminate;
+  xmlErrorPtr xmlerror;
+  gchar* journal_path;
+  gboolean result;
+  int res;
+
+  g_return_val_if_fail(reader != NULL, FALSE);
+  g_return_val_if_fail(reader->done == FALSE, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  len = infd_filesystem_storage_stream_read(
+    reader->stream,
+    reader->block,
+    INF_TEXT_FILESYSTEM_FORMAT_READER_BLOCK_SIZE
+  );
+
+  if(ferror(reader->stream))
+  {
+    inf_text_filesystem_format_set_system_error(errno, error);
+    reader->done = TRUE;
+    return FALSE;
+  }
+
+  reader->position += len;
+
+  /* fread() only reads less than requested at the end of the file */
+  terminate = FALSE;
+  if(len < INF_TEXT_FILESYSTEM_FORMAT_READER_BLOCK_SIZE)
+    terminate = TRUE;
+
+  res = xmlParseChunk(reader->parser, reader->block, (int)len, terminate);
+
+  if(reader->error != NULL)
+  {
+    g_propagate_prefixed_error(
+      error,
+      reader->error,
+      _("Error processing file \"%s\": "),
+      reader->path
+    );
+
+    reader->error = NULL;
+    reader->done = TRUE;
+    return FALSE;
+  }
+
+  if(res != 0)
+  {
+    xmlerror = xmlCtxtGetLastError(reader->parser);
+
+    g_set_error(
       error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
       xmlerror->code,
+      _("Error parsing XML in file \"%s\": [%d]: %s"),
+      reader->path,
+      xmlerror->line,
       xmlerror->message
     );
 
+    reader->done = TRUE;
+    return FALSE;
+  }
+
+  if(terminate == FALSE)
+    return TRUE;
+
+  reader->done = TRUE;
+  if(reader->has_journal == FALSE)
+    return FALSE;
+
+  journal_path = infd_filesystem_storage_get_path(
+    reader->storage,
+    "InfText.journal",
+    reader->path,
+    error
+  );
+
+  if(journal_path == NULL)
+    return FALSE;
+
+  if(g_file_test(journal_path, G_FILE_TEST_EXISTS))
+  {
+    result = inf_text_journal_replay(
+      journal_path,
+      reader->journal_sequence,
+      reader->user_table,
+      reader->buffer,
+      NULL,
+      error
+    );
+
+    if(result == FALSE)
+    {
+      g_prefix_error(
+        error,
+        _("Error replaying journal of \"%s\": "),
+        reader->path
+      );
+    }
+  }
+
+  g_free(journal_path);
+  return FALSE;
+}
+
+/**
+ * inf_text_filesystem_format_reader_free:
+ * @reader: A #InfTextFilesystemFormatReader.
+ *
+ * Closes the file read by @reader and releases all resources associated to
+ * it. If the session has not been read completely, the user table and
+ * buffer contain only part of it, and should be discarded.
+ */
+void
+inf_text_filesystem_format_reader_free(InfTextFilesystemFormatReader* reader)
+{
+  g_return_if_fail(reader != NULL);
+
+  xmlFreeParserCtxt(reader->parser);
+  infd_filesystem_storage_stream_close(reader->stream);
+  g_free(reader->block);
+
+  g_string_free(reader->text, TRUE);
+  if(reader->error != NULL)
+    g_error_free(reader->error);
+
+  g_object_unref(reader->buffer);
+  g_object_unref(reader->user_table);
+  g_object_unref(reader->storage);
+  g_free(reader->path);
+  g_slice_free(InfTextFilesystemFormatReader, reader);
+}
+
+/**
+ * inf_text_filesystem_format_read:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a text session from @path in @storage. The file is expected to have
+ * been saved with inf_text_filesystem_format_write() before. The @user_table
+ * parameter should be an empty user table that will be used for the session,
+ * and the @buffer parameter should be an empty #InfTextBuffer, and the
+ * document will be written into this buffer. If the function succeeds, the
+ * user table and buffer can be used to create an #InfTextSession with
+ * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * If the session was written together with a #InfTextJournal, then the
+ * records in the journal that are not yet contained in the file are applied
+ * as well, so that the result reflects the last change recorded before the
+ * session was closed or the server crashed.
+ *
+ * The file is parsed as a stream, see #InfTextFilesystemFormatReader, which
+ * can also be used directly to read the session incrementally.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                GError** error)
+{
+  InfTextFilesystemFormatReader* reader;
+  GError* local_error;
+  gboolean result;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+
+  reader = inf_text_filesystem_format_reader_new(
+    storage,
+    path,
+    user_table,
+    buffer,
+    error
+  );
+
+  if(reader == NULL)
+    return FALSE;
+
+  local_error = NULL;
+  do
+  {
+    result = inf_text_filesystem_format_reader_read_next(
+      reader,
+      &local_error
+    );
+  } while(result == TRUE);
+
+  inf_text_filesystem_format_reader_free(reader);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_format_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @journal: (allow-none): The #InfTextJournal of the session, or %NULL.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path. If successful, the session can then be read back with
+ * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * returned and @error is set, and the previous content at @path is left
+ * untouched.
+ *
+ * If @journal is not %NULL, it should be the journal of the session as
+ * returned by inf_text_filesystem_format_open_journal(). The current
+ * sequence number of the journal is stored with the session, and the
+ * journal is compacted once the file has been written. If @journal is
+ * %NULL, any journal for @path is removed.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 InfTextJournal* journal,
+                                 GError** error)
+{
+  InfTextFilesystemFormatSnapshot* snapshot;
+  gchar* full_path;
+  gchar* temp_path;
+  gchar* journal_path;
+  guint64 journal_sequence;
+  xmlDocPtr doc;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(journal == NULL || INF_TEXT_IS_JOURNAL(journal), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  /* Look up the paths before exporting buffer to XML so possible errors are
+   * catched earlier. */
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText",
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  journal_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText.journal",
+    path,
+    error
+  );
+
+  if(journal_path == NULL)
+  {
+    g_free(full_path);
     return FALSE;
   }
 
-  infd_filesystem_storage_stream_close(stream);
+  snapshot =
+    inf_text_filesystem_format_snapshot_new(user_table, buffer, journal);
+  journal_sequence = snapshot->journal_sequence;
+
+  doc = inf_text_filesystem_format_snapshot_to_xml(snapshot, error);
+  inf_text_filesystem_format_snapshot_free(snapshot);
+
+  if(doc == NULL)
+  {
+    g_free(journal_path);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  /* Write to a temporary file first, so that a crash while writing does not
+   * destroy the previous version, which the journal builds upon. */
+  temp_path = inf_text_filesystem_format_write_temporary(
+    doc,
+    full_path,
+    error
+  );
+
   xmlFreeDoc(doc);
+
+  if(temp_path == NULL)
+  {
+    g_free(journal_path);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  if(g_rename(temp_path, full_path) != 0)
+  {
+    inf_text_filesystem_format_set_system_error(errno, error);
+    g_unlink(temp_path);
+    g_free(temp_path);
+    g_free(journal_path);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  inf_text_filesystem_format_finish_journal(
+    journal_path,
+    journal,
+    journal_sequence
+  );
+
+  g_free(temp_path);
+  g_free(journal_path);
+  g_free(full_path);
   return TRUE;
 }
 
+/**
+ * inf_text_filesystem_format_write_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo object of the main thread.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @journal: (allow-none): The #InfTextJournal of the session, or %NULL.
+ * @func: (scope async): Function to call when the session has been written.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path, like inf_text_filesystem_format_write(), but without blocking the
+ * main loop. The function takes a snapshot of @user_table and @buffer, and
+ * then converts the snapshot to XML and writes it to a temporary file in a
+ * worker thread. The session can continue to be modified meanwhile; the
+ * file contains the state at the time this function was called. Once the
+ * file has been written and flushed to disk, it is renamed to its final
+ * name in the thread of @io, and @func is called. If the file could not be
+ * written, the error is passed to @func, and the previous content at @path
+ * is left untouched.
+ *
+ * The sequence number of @journal is taken together with the snapshot, and
+ * the journal is compacted after the rename, before @func is called.
+ * Records written to the journal while the operation is running are kept.
+ * The operation does not keep @journal alive; if it is finalized before the
+ * operation finishes, it is not compacted. If @journal is %NULL, any
+ * journal for @path is removed after the rename.
+ *
+ * Taking the snapshot is cheap if @buffer is a #InfTextDefaultBuffer, since
+ * the snapshot shares the text with the buffer. Other buffer implementations
+ * need to copy the text.
+ *
+ * The returned operation can be cancelled with inf_async_operation_free() as
+ * long as @func has not been called, in which case @func will not be called
+ * and nothing is written to @path. After @func has been called, the
+ * operation is freed automatically. If the operation cannot be started,
+ * %NULL is returned and @error is set.
+ *
+ * Returns: (transfer full) (allow-none): A #InfAsyncOperation for the
+ * running write operation, or %NULL on error.
+ */
+InfAsyncOperation*
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfTextJournal* journal,
+                                       InfTextFilesystemFormatWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  InfTextFilesystemFormatWriteAsync* async;
+  InfAsyncOperation* op;
+  gchar* full_path;
+  gchar* journal_path;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(journal == NULL || INF_TEXT_IS_JOURNAL(journal), NULL);
+  g_return_val_if_fail(func != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText",
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return NULL;
+
+  journal_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText.journal",
+    path,
+    error
+  );
+
+  if(journal_path == NULL)
+  {
+    g_free(full_path);
+    return NULL;
+  }
+
+  async = g_slice_new(InfTextFilesystemFormatWriteAsync);
+  async->snapshot =
+    inf_text_filesystem_format_snapshot_new(user_table, buffer, journal);
+  async->full_path = full_path;
+  async->temp_path = NULL;
+  async->journal_path = journal_path;
+  async->has_journal = async->snapshot->has_journal;
+  async->journal_sequence = async->snapshot->journal_sequence;
+  async->error = NULL;
+  async->func = func;
+  async->user_data = user_data;
+
+  g_weak_ref_init(&async->journal, journal);
+
+  op = inf_async_operation_new(
+    io,
+    inf_text_filesystem_format_write_async_run_func,
+    inf_text_filesystem_format_write_async_done_func,
+    async
+  );
+
+  if(!inf_async_operation_start(op, error))
+  {
+    inf_text_filesystem_format_write_async_free(async);
+    return NULL;
+  }
+
+  return op;
+}
+
+/**
+ * inf_text_filesystem_format_open_journal:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the session.
+ * @session: The #InfTextSession stored at @path.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Creates a #InfTextJournal for @session, which is stored next to the
+ * session file at @path in @storage. The journal should be passed to
+ * inf_text_filesystem_format_write() and
+ * inf_text_filesystem_format_write_async() when the session is saved, and
+ * it is replayed automatically by inf_text_filesystem_format_read().
+ *
+ * If the journal cannot be opened, %NULL is returned and @error is set.
+ *
+ * Returns: (transfer full) (allow-none): A new #InfTextJournal, or %NULL.
+ */
+InfTextJournal*
+inf_text_filesystem_format_open_journal(InfdFilesystemStorage* storage,
+                                        const gchar* path,
+                                        InfTextSession* session,
+                                        GError** error)
+{
+  InfTextJournal* journal;
+  gchar* journal_path;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_TEXT_IS_SESSION(session), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  /* The directory listing takes the part after the last dot as the note
+   * type, and ignores it since it does not start with "Inf". */
+  journal_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText.journal",
+    path,
+    error
+  );
+
+  if(journal_path == NULL)
+    return NULL;
+
+  journal = inf_text_journal_new(session, journal_path, error);
+  g_free(journal_path);
+
+  return journal;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -21,7 +21,10 @@
 #define __INF_TEXT_FILESYSTEM_FORMAT_H__
 
 #include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-journal.h>
 #include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-async-operation.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <glib.h>
 
@@ -45,6 +48,51 @@ typedef enum _InfTextFilesystemFormatError {
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER
 } InfTextFilesystemFormatError;
 
+/**
+ * InfTextFilesystemFormatWriteFunc:
+ * @error: Reason for the failure, or %NULL if the session was written
+ * successfully.
+ * @user_data: User data passed to inf_text_filesystem_format_write_async().
+ *
+ * This is the signature of the function called when an asynchronous write
+ * operation started with inf_text_filesystem_format_write_async() has
+ * finished.
+ */
+typedef void(*InfTextFilesystemFormatWriteFunc)(const GError* error,
+                                                gpointer user_data);
+
+/**
+ * InfTextFilesystemFormatReader:
+ *
+ * #InfTextFilesystemFormatReader is an opaque data type. It reads a text
+ * session from a #InfdFilesystemStorage incrementally, see
+ * inf_text_filesystem_format_reader_new().
+ */
+typedef struct _InfTextFilesystemFormatReader InfTextFilesystemFormatReader;
+
+InfTextFilesystemFormatReader*
+inf_text_filesystem_format_reader_new(InfdFilesystemStorage* storage,
+                                      const gchar* path,
+                                      InfUserTable* user_table,
+                                      InfTextBuffer* buffer,
+                                      GError** error);
+
+guint64
+inf_text_filesystem_format_reader_get_size(
+  InfTextFilesystemFormatReader* reader);
+
+guint64
+inf_text_filesystem_format_reader_get_position(
+  InfTextFilesystemFormatReader* reader);
+
+gboolean
+inf_text_filesystem_format_reader_read_next(
+  InfTextFilesystemFormatReader* reader,
+  GError** error);
+
+void
+inf_text_filesystem_format_reader_free(InfTextFilesystemFormatReader* reader);
+
 gboolean
 inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
                                 const gchar* path,
@@ -57,8 +105,26 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
                                  const gchar* path,
                                  InfUserTable* user_table,
                                  InfTextBuffer* buffer,
+                                 InfTextJournal* journal,
                                  GError** error);
 
+InfAsyncOperation*
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfTextJournal* journal,
+                                       InfTextFilesystemFormatWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error);
+
+InfTextJournal*
+inf_text_filesystem_format_open_journal(InfdFilesystemStorage* storage,
+                                        const gchar* path,
+                                        InfTextSession* session,
+                                        GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_FILESYSTEM_FORMAT_H__ */
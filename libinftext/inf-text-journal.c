@@ -0,0 +1,1501 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-text-journal
+ * @title: InfTextJournal
+ * @short_description: Write-ahead journal for text sessions
+ * @include: libinftext/inf-text-journal.h
+ * @see_also: #InfTextSession, #InfAdoptedSessionRecord
+ * @stability: Unstable
+ *
+ * #InfTextJournal appends every change made to the buffer of a
+ * #InfTextSession to a file, as soon as the change has been made. Together
+ * with a snapshot of the session written with
+ * inf_text_filesystem_format_write(), the journal allows to recover the
+ * most recent state of the session after a crash, by replaying it with
+ * inf_text_journal_replay() on top of the snapshot.
+ *
+ * Every executed request that modifies the buffer is written as a single
+ * record with a sequence number. The sequence number of the journal at the
+ * time a snapshot is taken is stored with the snapshot, so that only the
+ * records that are not yet contained in the snapshot are replayed. Once a
+ * snapshot has been written, the journal can be shrunk with
+ * inf_text_journal_compact().
+ *
+ * Records are written with a single write() call but not flushed to disk
+ * individually. This protects against crashes of the process, but not
+ * necessarily against a crash of the whole system. A record that has been
+ * written only partially is discarded when the journal is opened or
+ * replayed.
+ */
+
+#include <libinftext/inf-text-journal.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/inf-i18n.h>
+#include <libinfinity/inf-signals.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include <glib/gstdio.h>
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef G_OS_WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+# define O_BINARY 0
+#endif
+
+/* Each record in the journal file is an XML element preceded by its length
+ * in bytes, as a decimal number on its own line, and followed by a newline
+ * character. This allows to detect a record that has been cut off by a
+ * crash without having to parse it, and to copy records on compaction
+ * without parsing them. */
+
+typedef struct _InfTextJournalPrivate InfTextJournalPrivate;
+struct _InfTextJournalPrivate {
+  InfTextSession* session;
+  gchar* filename;
+  int fd;
+
+  guint64 sequence;
+
+  /* The record for the request currently being executed */
+  xmlNodePtr request;
+};
+
+enum {
+  PROP_0,
+
+  /* construct only */
+  PROP_SESSION,
+
+  /* read only */
+  PROP_FILENAME
+};
+
+#define INF_TEXT_JOURNAL_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_JOURNAL, InfTextJournalPrivate))
+
+G_DEFINE_TYPE_WITH_CODE(InfTextJournal, inf_text_journal, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfTextJournal))
+
+static GQuark
+inf_text_journal_error_quark(void)
+{
+  return g_quark_from_static_string("INF_TEXT_JOURNAL_ERROR");
+}
+
+static void
+inf_text_journal_set_system_error(int code,
+                                  GError** error)
+{
+  g_set_error_literal(
+    error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+}
+
+/* Writes all of data to fd. Returns 0 on success or the errno value
+ * otherwise. */
+static int
+inf_text_journal_write_all(int fd,
+                           const gchar* data,
+                           gsize len)
+{
+  gssize res;
+
+  while(len > 0)
+  {
+    res = write(fd, data, len);
+    if(res < 0)
+    {
+      if(errno == EINTR)
+        continue;
+      return errno;
+    }
+
+    data += res;
+    len -= res;
+  }
+
+  return 0;
+}
+
+/* Appends the framed serialization of node to str. */
+static void
+inf_text_journal_frame_node(GString* str,
+                            xmlNodePtr node)
+{
+  xmlBufferPtr buffer;
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, NULL, node, 0, 0);
+
+  g_string_append_printf(
+    str,
+    "%d\n%s\n",
+    xmlBufferLength(buffer),
+    (const gchar*)xmlBufferContent(buffer)
+  );
+
+  xmlBufferFree(buffer);
+}
+
+/* Parses the record starting at *offset in data. Returns NULL if there is
+ * no complete record at *offset, which is the case at the end of the
+ * journal or if the last record was cut off. Otherwise, the returned
+ * document contains the record, and *offset is advanced to the next one. */
+static xmlDocPtr
+inf_text_journal_next_frame(const gchar* data,
+                            gsize len,
+                            gsize* offset)
+{
+  const gchar* pos;
+  const gchar* end;
+  guint64 frame_len;
+  xmlDocPtr doc;
+
+  if(*offset >= len)
+    return NULL;
+
+  pos = data + *offset;
+  end = data + len;
+
+  frame_len = 0;
+  while(pos < end && *pos >= '0' && *pos <= '9')
+  {
+    frame_len = frame_len * 10 + (*pos - '0');
+    if(frame_len > G_MAXINT)
+      return NULL;
+    ++pos;
+  }
+
+  if(pos == data + *offset || pos == end || *pos != '\n')
+    return NULL;
+  ++pos;
+
+  if((guint64)(end - pos) < frame_len + 1 || pos[frame_len] != '\n')
+    return NULL;
+
+  doc = xmlReadMemory(
+    pos,
+    (int)frame_len,
+    NULL,
+    "UTF-8",
+    XML_PARSE_NOWARNING | XML_PARSE_NOERROR | XML_PARSE_NONET
+  );
+
+  if(doc == NULL)
+    return NULL;
+
+  if(xmlDocGetRootElement(doc) == NULL)
+  {
+    xmlFreeDoc(doc);
+    return NULL;
+  }
+
+  *offset = (pos - data) + frame_len + 1;
+  return doc;
+}
+
+static gboolean
+inf_text_journal_get_sequence_attribute(xmlNodePtr node,
+                                        guint64* sequence)
+{
+  xmlChar* value;
+  gchar* endptr;
+
+  value = inf_xml_util_get_attribute(node, "seq");
+  if(value == NULL)
+    return FALSE;
+
+  *sequence = g_ascii_strtoull((const gchar*)value, &endptr, 10);
+  if(*endptr != '\0' || endptr == (gchar*)value)
+  {
+    xmlFree(value);
+    return FALSE;
+  }
+
+  xmlFree(value);
+  return TRUE;
+}
+
+static void
+inf_text_journal_set_sequence_attribute(xmlNodePtr node,
+                                        guint64 sequence)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_snprintf(buf, sizeof(buf), "%" G_GUINT64_FORMAT, sequence);
+  inf_xml_util_set_attribute(node, "seq", buf);
+}
+
+static void
+inf_text_journal_stop(InfTextJournal* journal,
+                      const gchar* reason)
+{
+  InfTextJournalPrivate* priv;
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  g_warning(
+    _("Error writing journal \"%s\", no longer journaling: %s"),
+    priv->filename,
+    reason
+  );
+
+  close(priv->fd);
+  priv->fd = -1;
+}
+
+static void
+inf_text_journal_write_frame(InfTextJournal* journal,
+                             xmlNodePtr node)
+{
+  InfTextJournalPrivate* priv;
+  GString* str;
+  int res;
+
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+  if(priv->fd == -1)
+    return;
+
+  str = g_string_sized_new(128);
+  inf_text_journal_frame_node(str, node);
+
+  res = inf_text_journal_write_all(priv->fd, str->str, str->len);
+  g_string_free(str, TRUE);
+
+  if(res != 0)
+    inf_text_journal_stop(journal, g_strerror(res));
+}
+
+static xmlNodePtr
+inf_text_journal_user_to_xml(InfUser* user)
+{
+  xmlNodePtr node;
+
+  node = xmlNewNode(NULL, (const xmlChar*)"user");
+  inf_xml_util_set_attribute_uint(node, "id", inf_user_get_id(user));
+  inf_xml_util_set_attribute(node, "name", inf_user_get_name(user));
+
+  inf_xml_util_set_attribute_double(
+    node,
+    "hue",
+    inf_text_user_get_hue(INF_TEXT_USER(user))
+  );
+
+  return node;
+}
+
+/* Returns the node to which the operations of the current request are
+ * added. Changes to the buffer that are not caused by a request are written
+ * as a record of their own. */
+static xmlNodePtr
+inf_text_journal_get_request(InfTextJournal* journal)
+{
+  InfTextJournalPrivate* priv;
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  if(priv->request != NULL)
+    return priv->request;
+
+  return xmlNewNode(NULL, (const xmlChar*)"request");
+}
+
+static void
+inf_text_journal_finish_request(InfTextJournal* journal,
+                                xmlNodePtr request)
+{
+  InfTextJournalPrivate* priv;
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  /* The record is written by the end-execute-request handler */
+  if(request == priv->request)
+    return;
+
+  inf_text_journal_set_sequence_attribute(request, ++priv->sequence);
+  inf_text_journal_write_frame(journal, request);
+  xmlFreeNode(request);
+}
+
+static void
+inf_text_journal_text_inserted_cb(InfTextBuffer* buffer,
+                                  guint pos,
+                                  InfTextChunk* chunk,
+                                  InfUser* user,
+                                  gpointer user_data)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+  InfTextChunkIter iter;
+  xmlNodePtr request;
+  xmlNodePtr insert;
+  xmlNodePtr segment;
+  const gchar* encoding;
+  gchar* converted;
+  gsize converted_bytes;
+  GError* error;
+
+  journal = INF_TEXT_JOURNAL(user_data);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+  if(priv->fd == -1)
+    return;
+
+  encoding = inf_text_chunk_get_encoding(chunk);
+  request = inf_text_journal_get_request(journal);
+
+  insert = xmlNewChild(request, NULL, (const xmlChar*)"insert", NULL);
+  inf_xml_util_set_attribute_uint(insert, "pos", pos);
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      segment = xmlNewChild(insert, NULL, (const xmlChar*)"segment", NULL);
+
+      inf_xml_util_set_attribute_uint(
+        segment,
+        "author",
+        inf_text_chunk_iter_get_author(&iter)
+      );
+
+      if(strcmp(encoding, "UTF-8") == 0)
+      {
+        inf_xml_util_add_child_text(
+          segment,
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter)
+        );
+      }
+      else
+      {
+        error = NULL;
+        converted = g_convert(
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter),
+          "UTF-8",
+          encoding,
+          NULL,
+          &converted_bytes,
+          &error
+        );
+
+        if(converted == NULL)
+        {
+          if(request != priv->request)
+            xmlFreeNode(request);
+
+          inf_text_journal_stop(journal, error->message);
+          g_error_free(error);
+          return;
+        }
+
+        inf_xml_util_add_child_text(segment, converted, converted_bytes);
+        g_free(converted);
+      }
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  inf_text_journal_finish_request(journal, request);
+}
+
+static void
+inf_text_journal_text_erased_cb(InfTextBuffer* buffer,
+                                guint pos,
+                                InfTextChunk* chunk,
+                                InfUser* user,
+                                gpointer user_data)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+  xmlNodePtr request;
+  xmlNodePtr node;
+
+  journal = INF_TEXT_JOURNAL(user_data);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+  if(priv->fd == -1)
+    return;
+
+  request = inf_text_journal_get_request(journal);
+
+  node = xmlNewChild(request, NULL, (const xmlChar*)"delete", NULL);
+  inf_xml_util_set_attribute_uint(node, "pos", pos);
+  inf_xml_util_set_attribute_uint(
+    node,
+    "len",
+    inf_text_chunk_get_length(chunk)
+  );
+
+  inf_text_journal_finish_request(journal, request);
+}
+
+static void
+inf_text_journal_begin_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                          InfAdoptedUser* user,
+                                          InfAdoptedRequest* request,
+                                          gpointer user_data)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+
+  journal = INF_TEXT_JOURNAL(user_data);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  g_assert(priv->request == NULL);
+  priv->request = xmlNewNode(NULL, (const xmlChar*)"request");
+}
+
+static void
+inf_text_journal_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
+                                        InfAdoptedUser* user,
+                                        InfAdoptedRequest* request,
+                                        InfAdoptedRequest* translated,
+                                        const GError* error,
+                                        gpointer user_data)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+  xmlNodePtr node;
+
+  journal = INF_TEXT_JOURNAL(user_data);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  g_assert(priv->request != NULL);
+  node = priv->request;
+  priv->request = NULL;
+
+  /* Requests that did not change the buffer, such as no-op requests or
+   * requests that failed to execute, are not recorded. */
+  if(node->children != NULL)
+    inf_text_journal_finish_request(journal, node);
+  else
+    xmlFreeNode(node);
+}
+
+static void
+inf_text_journal_add_user_cb(InfUserTable* user_table,
+                             InfUser* user,
+                             gpointer user_data)
+{
+  InfTextJournal* journal;
+  xmlNodePtr node;
+
+  journal = INF_TEXT_JOURNAL(user_data);
+
+  node = inf_text_journal_user_to_xml(user);
+  inf_text_journal_write_frame(journal, node);
+  xmlFreeNode(node);
+}
+
+static void
+inf_text_journal_foreach_user_func(InfUser* user,
+                                   gpointer user_data)
+{
+  GString* str;
+  xmlNodePtr node;
+
+  str = (GString*)user_data;
+
+  node = inf_text_journal_user_to_xml(user);
+  inf_text_journal_frame_node(str, node);
+  xmlFreeNode(node);
+}
+
+/* Writes records for all users in the session, since the snapshot only
+ * contains the users that have contributed text, but records in the journal
+ * might refer to other users. */
+static void
+inf_text_journal_write_users(InfTextJournal* journal)
+{
+  InfTextJournalPrivate* priv;
+  GString* str;
+  int res;
+
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+  if(priv->fd == -1)
+    return;
+
+  str = g_string_sized_new(256);
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(priv->session)),
+    inf_text_journal_foreach_user_func,
+    str
+  );
+
+  res = inf_text_journal_write_all(priv->fd, str->str, str->len);
+  g_string_free(str, TRUE);
+
+  if(res != 0)
+    inf_text_journal_stop(journal, g_strerror(res));
+}
+
+static void
+inf_text_journal_real_start(InfTextJournal* journal)
+{
+  InfTextJournalPrivate* priv;
+  InfAdoptedAlgorithm* algorithm;
+
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+  algorithm = inf_adopted_session_get_algorithm(
+    INF_ADOPTED_SESSION(priv->session)
+  );
+
+  g_signal_connect(
+    G_OBJECT(algorithm),
+    "begin-execute-request",
+    G_CALLBACK(inf_text_journal_begin_execute_request_cb),
+    journal
+  );
+
+  g_signal_connect(
+    G_OBJECT(algorithm),
+    "end-execute-request",
+    G_CALLBACK(inf_text_journal_end_execute_request_cb),
+    journal
+  );
+
+  g_signal_connect(
+    G_OBJECT(inf_session_get_buffer(INF_SESSION(priv->session))),
+    "text-inserted",
+    G_CALLBACK(inf_text_journal_text_inserted_cb),
+    journal
+  );
+
+  g_signal_connect(
+    G_OBJECT(inf_session_get_buffer(INF_SESSION(priv->session))),
+    "text-erased",
+    G_CALLBACK(inf_text_journal_text_erased_cb),
+    journal
+  );
+
+  g_signal_connect(
+    G_OBJECT(inf_session_get_user_table(INF_SESSION(priv->session))),
+    "add-user",
+    G_CALLBACK(inf_text_journal_add_user_cb),
+    journal
+  );
+
+  inf_text_journal_write_users(journal);
+}
+
+static void
+inf_text_journal_synchronization_complete_cb(InfSession* session,
+                                             InfXmlConnection* connection,
+                                             gpointer user_data)
+{
+  InfTextJournal* journal;
+  journal = INF_TEXT_JOURNAL(user_data);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(inf_text_journal_synchronization_complete_cb),
+    journal
+  );
+
+  inf_text_journal_real_start(journal);
+}
+
+/* Scans the journal in data, and returns the length of the part of it that
+ * consists of complete records. The highest sequence number found is
+ * stored in sequence. */
+static gsize
+inf_text_journal_scan(const gchar* data,
+                      gsize len,
+                      guint64* sequence)
+{
+  xmlDocPtr doc;
+  guint64 seq;
+  gsize offset;
+
+  offset = 0;
+  *sequence = 0;
+
+  while((doc = inf_text_journal_next_frame(data, len, &offset)) != NULL)
+  {
+    if(inf_text_journal_get_sequence_attribute(xmlDocGetRootElement(doc),
+                                               &seq))
+    {
+      if(seq > *sequence)
+        *sequence = seq;
+    }
+
+    xmlFreeDoc(doc);
+  }
+
+  return offset;
+}
+
+static gboolean
+inf_text_journal_open(InfTextJournal* journal,
+                      const gchar* filename,
+                      GError** error)
+{
+  InfTextJournalPrivate* priv;
+  gchar* data;
+  gsize len;
+  gsize valid_len;
+  GError* local_error;
+  int res;
+
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  local_error = NULL;
+  if(!g_file_get_contents(filename, &data, &len, &local_error))
+  {
+    if(local_error->domain != G_FILE_ERROR ||
+       local_error->code != G_FILE_ERROR_NOENT)
+    {
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+
+    g_error_free(local_error);
+    data = NULL;
+    len = 0;
+  }
+
+  valid_len = inf_text_journal_scan(data, len, &priv->sequence);
+  g_free(data);
+
+  priv->fd = g_open(
+    filename,
+    O_WRONLY | O_APPEND | O_CREAT | O_BINARY,
+    0644
+  );
+
+  if(priv->fd == -1)
+  {
+    inf_text_journal_set_system_error(errno, error);
+    return FALSE;
+  }
+
+  /* Drop a record that was cut off by a crash, so that new records are not
+   * appended to garbage. */
+  if(valid_len < len)
+  {
+#ifdef G_OS_WIN32
+    res = _chsize(priv->fd, valid_len);
+#else
+    res = ftruncate(priv->fd, valid_len);
+#endif
+
+    if(res != 0)
+    {
+      inf_text_journal_set_system_error(errno, error);
+      close(priv->fd);
+      priv->fd = -1;
+      return FALSE;
+    }
+  }
+
+  priv->filename = g_strdup(filename);
+  return TRUE;
+}
+
+/*
+ * GObject overrides.
+ */
+
+static void
+inf_text_journal_init(InfTextJournal* journal)
+{
+  InfTextJournalPrivate* priv;
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  priv->session = NULL;
+  priv->filename = NULL;
+  priv->fd = -1;
+  priv->sequence = 0;
+  priv->request = NULL;
+}
+
+static void
+inf_text_journal_dispose(GObject* object)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+  InfSessionStatus status;
+  InfAdoptedAlgorithm* algorithm;
+
+  journal = INF_TEXT_JOURNAL(object);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  if(priv->session != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->session),
+      G_CALLBACK(inf_text_journal_synchronization_complete_cb),
+      journal
+    );
+
+    /* In synchronizing state we did not yet connect to the signals, and the
+     * algorithm has been destroyed when the session has been closed. */
+    status = inf_session_get_status(INF_SESSION(priv->session));
+    if(status == INF_SESSION_RUNNING)
+    {
+      algorithm = inf_adopted_session_get_algorithm(
+        INF_ADOPTED_SESSION(priv->session)
+      );
+
+      inf_signal_handlers_disconnect_by_func(
+        G_OBJECT(algorithm),
+        G_CALLBACK(inf_text_journal_begin_execute_request_cb),
+        journal
+      );
+
+      inf_signal_handlers_disconnect_by_func(
+        G_OBJECT(algorithm),
+        G_CALLBACK(inf_text_journal_end_execute_request_cb),
+        journal
+      );
+    }
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(inf_session_get_buffer(INF_SESSION(priv->session))),
+      G_CALLBACK(inf_text_journal_text_inserted_cb),
+      journal
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(inf_session_get_buffer(INF_SESSION(priv->session))),
+      G_CALLBACK(inf_text_journal_text_erased_cb),
+      journal
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(inf_session_get_user_table(INF_SESSION(priv->session))),
+      G_CALLBACK(inf_text_journal_add_user_cb),
+      journal
+    );
+
+    g_object_unref(priv->session);
+    priv->session = NULL;
+  }
+
+  if(priv->request != NULL)
+  {
+    xmlFreeNode(priv->request);
+    priv->request = NULL;
+  }
+
+  if(priv->fd != -1)
+  {
+    close(priv->fd);
+    priv->fd = -1;
+  }
+
+  G_OBJECT_CLASS(inf_text_journal_parent_class)->dispose(object);
+}
+
+static void
+inf_text_journal_finalize(GObject* object)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+
+  journal = INF_TEXT_JOURNAL(object);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  g_free(priv->filename);
+
+  G_OBJECT_CLASS(inf_text_journal_parent_class)->finalize(object);
+}
+
+static void
+inf_text_journal_set_property(GObject* object,
+                              guint prop_id,
+                              const GValue* value,
+                              GParamSpec* pspec)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+
+  journal = INF_TEXT_JOURNAL(object);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  switch(prop_id)
+  {
+  case PROP_SESSION:
+    g_assert(priv->session == NULL); /* construct only */
+    priv->session = INF_TEXT_SESSION(g_value_dup_object(value));
+    break;
+  case PROP_FILENAME:
+    /* read only */
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_text_journal_get_property(GObject* object,
+                              guint prop_id,
+                              GValue* value,
+                              GParamSpec* pspec)
+{
+  InfTextJournal* journal;
+  InfTextJournalPrivate* priv;
+
+  journal = INF_TEXT_JOURNAL(object);
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+
+  switch(prop_id)
+  {
+  case PROP_SESSION:
+    g_value_set_object(value, G_OBJECT(priv->session));
+    break;
+  case PROP_FILENAME:
+    g_value_set_string(value, priv->filename);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * GType registration.
+ */
+
+static void
+inf_text_journal_class_init(InfTextJournalClass* journal_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(journal_class);
+
+  object_class->dispose = inf_text_journal_dispose;
+  object_class->finalize = inf_text_journal_finalize;
+  object_class->set_property = inf_text_journal_set_property;
+  object_class->get_property = inf_text_journal_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SESSION,
+    g_param_spec_object(
+      "session",
+      "Session",
+      "The session whose changes are journaled",
+      INF_TEXT_TYPE_SESSION,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_FILENAME,
+    g_param_spec_string(
+      "filename",
+      "Filename",
+      "The filename of the journal file",
+      NULL,
+      G_PARAM_READABLE
+    )
+  );
+}
+
+/*
+ * Replay.
+ */
+
+static gboolean
+inf_text_journal_replay_user(InfUserTable* user_table,
+                             xmlNodePtr node,
+                             GError** error)
+{
+  guint id;
+  gdouble hue;
+  xmlChar* name;
+  InfUser* user;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "id", &id, error))
+    return FALSE;
+
+  if(!inf_xml_util_get_attribute_double_required(node, "hue", &hue, error))
+    return FALSE;
+
+  name = inf_xml_util_get_attribute_required(node, "name", error);
+  if(name == NULL)
+    return FALSE;
+
+  /* User records are repeated whenever the journal is opened or compacted,
+   * and the snapshot may contain the user already. */
+  if(inf_user_table_lookup_user_by_id(user_table, id) == NULL)
+  {
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", id,
+        "name", name,
+        "hue", hue,
+        NULL
+      )
+    );
+
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+  }
+
+  xmlFree(name);
+  return TRUE;
+}
+
+static gboolean
+inf_text_journal_replay_insert(InfUserTable* user_table,
+                               InfTextBuffer* buffer,
+                               xmlNodePtr node,
+                               GError** error)
+{
+  InfTextChunk* chunk;
+  xmlNodePtr child;
+  const gchar* encoding;
+  guint pos;
+  guint author;
+  gchar* content;
+  gsize bytes;
+  guint chars;
+  gchar* converted;
+  gsize converted_bytes;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "pos", &pos, error))
+    return FALSE;
+
+  if(pos > inf_text_buffer_get_length(buffer))
+  {
+    g_set_error(
+      error,
+      inf_text_journal_error_quark(),
+      INF_TEXT_JOURNAL_ERROR_INVALID_RECORD,
+      _("Insertion at position %u is beyond the end of the buffer"),
+      pos
+    );
+
+    return FALSE;
+  }
+
+  encoding = inf_text_buffer_get_encoding(buffer);
+  chunk = inf_text_chunk_new(encoding);
+
+  for(child = node->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE)
+      continue;
+    if(strcmp((const char*)child->name, "segment") != 0)
+      continue;
+
+    if(!inf_xml_util_get_attribute_uint_required(child, "author", &author,
+                                                 error))
+    {
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    if(author != 0 &&
+       inf_user_table_lookup_user_by_id(user_table, author) == NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_journal_error_quark(),
+        INF_TEXT_JOURNAL_ERROR_NO_SUCH_USER,
+        _("User with ID \"%u\" does not exist"),
+        author
+      );
+
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    content = inf_xml_util_get_child_text(child, &bytes, &chars, error);
+    if(content == NULL)
+    {
+      inf_text_chunk_free(chunk);
+      return FALSE;
+    }
+
+    if(strcmp(encoding, "UTF-8") != 0)
+    {
+      converted = g_convert(
+        content,
+        bytes,
+        encoding,
+        "UTF-8",
+        NULL,
+        &converted_bytes,
+        error
+      );
+
+      g_free(content);
+
+      if(converted == NULL)
+      {
+        inf_text_chunk_free(chunk);
+        return FALSE;
+      }
+
+      content = converted;
+      bytes = converted_bytes;
+    }
+
+    inf_text_chunk_insert_text(
+      chunk,
+      inf_text_chunk_get_length(chunk),
+      content,
+      bytes,
+      chars,
+      author
+    );
+
+    g_free(content);
+  }
+
+  inf_text_buffer_insert_chunk(buffer, pos, chunk, NULL);
+  inf_text_chunk_free(chunk);
+  return TRUE;
+}
+
+static gboolean
+inf_text_journal_replay_delete(InfTextBuffer* buffer,
+                               xmlNodePtr node,
+                               GError** error)
+{
+  guint pos;
+  guint len;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "pos", &pos, error))
+    return FALSE;
+  if(!inf_xml_util_get_attribute_uint_required(node, "len", &len, error))
+    return FALSE;
+
+  if(pos + len < pos || pos + len > inf_text_buffer_get_length(buffer))
+  {
+    g_set_error(
+      error,
+      inf_text_journal_error_quark(),
+      INF_TEXT_JOURNAL_ERROR_INVALID_RECORD,
+      _("Deletion of %u characters at position %u is beyond the end of the "
+        "buffer"),
+      len,
+      pos
+    );
+
+    return FALSE;
+  }
+
+  inf_text_buffer_erase_text(buffer, pos, len, NULL);
+  return TRUE;
+}
+
+static gboolean
+inf_text_journal_replay_request(InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                xmlNodePtr node,
+                                GError** error)
+{
+  xmlNodePtr child;
+
+  for(child = node->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE)
+      continue;
+
+    if(strcmp((const char*)child->name, "insert") == 0)
+    {
+      if(!inf_text_journal_replay_insert(user_table, buffer, child, error))
+        return FALSE;
+    }
+    else if(strcmp((const char*)child->name, "delete") == 0)
+    {
+      if(!inf_text_journal_replay_delete(buffer, child, error))
+        return FALSE;
+    }
+    else
+    {
+      g_set_error(
+        error,
+        inf_text_journal_error_quark(),
+        INF_TEXT_JOURNAL_ERROR_INVALID_RECORD,
+        _("Unexpected operation \"%s\" in request"),
+        (const gchar*)child->name
+      );
+
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/*
+ * Public API.
+ */
+
+/**
+ * inf_text_journal_new: (constructor)
+ * @session: A #InfTextSession.
+ * @filename: (type filename): The file in which to store the journal.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Creates a new #InfTextJournal which appends all changes made to the
+ * buffer of @session to @filename. If @filename exists already, the new
+ * records are appended to it, and the sequence numbers continue where the
+ * existing journal left off. An incomplete record at the end of the file is
+ * removed.
+ *
+ * If @session is still synchronizing, then journaling starts when the
+ * synchronization has completed. Journaling stops when the journal is
+ * disposed. If a record cannot be written, a warning is emitted and
+ * journaling stops as well.
+ *
+ * If @filename cannot be opened, %NULL is returned and @error is set.
+ *
+ * Returns: (transfer full) (allow-none): A new #InfTextJournal, or %NULL.
+ */
+InfTextJournal*
+inf_text_journal_new(InfTextSession* session,
+                     const gchar* filename,
+                     GError** error)
+{
+  InfTextJournal* journal;
+  InfSessionStatus status;
+
+  g_return_val_if_fail(INF_TEXT_IS_SESSION(session), NULL);
+  g_return_val_if_fail(filename != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  status = inf_session_get_status(INF_SESSION(session));
+  g_return_val_if_fail(status != INF_SESSION_CLOSED, NULL);
+
+  journal = INF_TEXT_JOURNAL(
+    g_object_new(INF_TEXT_TYPE_JOURNAL, "session", session, NULL)
+  );
+
+  if(!inf_text_journal_open(journal, filename, error))
+  {
+    g_object_unref(journal);
+    return NULL;
+  }
+
+  switch(status)
+  {
+  case INF_SESSION_SYNCHRONIZING:
+    g_signal_connect_after(
+      G_OBJECT(session),
+      "synchronization-complete",
+      G_CALLBACK(inf_text_journal_synchronization_complete_cb),
+      journal
+    );
+
+    break;
+  case INF_SESSION_RUNNING:
+    inf_text_journal_real_start(journal);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  return journal;
+}
+
+/**
+ * inf_text_journal_get_sequence:
+ * @journal: A #InfTextJournal.
+ *
+ * Returns the sequence number of the last record written to @journal. The
+ * buffer state at the time this function is called corresponds to the
+ * journal replayed up to and including this record. When a snapshot of the
+ * session is taken, this number should be stored with it, so that
+ * inf_text_journal_replay() can skip the records already contained in the
+ * snapshot.
+ *
+ * Returns: The current sequence number of @journal.
+ */
+guint64
+inf_text_journal_get_sequence(InfTextJournal* journal)
+{
+  g_return_val_if_fail(INF_TEXT_IS_JOURNAL(journal), 0);
+  return INF_TEXT_JOURNAL_PRIVATE(journal)->sequence;
+}
+
+/**
+ * inf_text_journal_compact:
+ * @journal: A #InfTextJournal.
+ * @sequence: The sequence number of the most recent record that is
+ * contained in a snapshot on disk.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Removes all records up to and including @sequence from the journal. This
+ * should be called after a snapshot of the session containing these records
+ * has been written to disk. Records written after the snapshot has been
+ * taken are kept.
+ *
+ * The journal file is replaced atomically, so that a crash during
+ * compaction leaves either the old or the new journal behind, both of which
+ * are valid for the new snapshot. If the function fails, %FALSE is returned
+ * and @error is set. In that case the previous journal stays in use.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_journal_compact(InfTextJournal* journal,
+                         guint64 sequence,
+                         GError** error)
+{
+  InfTextJournalPrivate* priv;
+  gchar* data;
+  gsize len;
+  gsize offset;
+  gsize frame_offset;
+  xmlDocPtr doc;
+  xmlNodePtr node;
+  guint64 seq;
+  gboolean keep;
+  GString* str;
+  gchar* temp_path;
+  int fd;
+  int res;
+
+  g_return_val_if_fail(INF_TEXT_IS_JOURNAL(journal), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  priv = INF_TEXT_JOURNAL_PRIVATE(journal);
+  g_return_val_if_fail(sequence <= priv->sequence, FALSE);
+
+  /* Journaling stopped because of an error. The journal on disk is still
+   * consistent with all snapshots taken since then. */
+  if(priv->fd == -1)
+    return TRUE;
+
+  if(!g_file_get_contents(priv->filename, &data, &len, error))
+    return FALSE;
+
+  str = g_string_sized_new(len);
+
+  node = xmlNewNode(NULL, (const xmlChar*)"compacted");
+  inf_text_journal_set_sequence_attribute(node, sequence);
+  inf_text_journal_frame_node(str, node);
+  xmlFreeNode(node);
+
+  if(inf_session_get_status(INF_SESSION(priv->session)) == INF_SESSION_RUNNING)
+  {
+    inf_user_table_foreach_user(
+      inf_session_get_user_table(INF_SESSION(priv->session)),
+      inf_text_journal_foreach_user_func,
+      str
+    );
+  }
+
+  /* Keep the records that are not yet contained in the snapshot. They are
+   * copied verbatim. */
+  offset = 0;
+  frame_offset = 0;
+  while((doc = inf_text_journal_next_frame(data, len, &offset)) != NULL)
+  {
+    node = xmlDocGetRootElement(doc);
+
+    keep = FALSE;
+    if(strcmp((const char*)node->name, "request") == 0)
+      if(inf_text_journal_get_sequence_attribute(node, &seq))
+        if(seq > sequence)
+          keep = TRUE;
+
+    if(keep)
+      g_string_append_len(str, data + frame_offset, offset - frame_offset);
+
+    xmlFreeDoc(doc);
+    frame_offset = offset;
+  }
+
+  g_free(data);
+
+  temp_path = g_strconcat(priv->filename, ".tmp-XXXXXX", NULL);
+  fd = g_mkstemp_full(temp_path, O_WRONLY | O_BINARY, 0644);
+  if(fd == -1)
+  {
+    inf_text_journal_set_system_error(errno, error);
+    g_string_free(str, TRUE);
+    g_free(temp_path);
+    return FALSE;
+  }
+
+  res = inf_text_journal_write_all(fd, str->str, str->len);
+  g_string_free(str, TRUE);
+
+#ifdef G_OS_WIN32
+  if(res == 0 && _commit(fd) != 0)
+    res = errno;
+#else
+  if(res == 0 && fsync(fd) != 0)
+    res = errno;
+#endif
+
+  if(close(fd) != 0 && res == 0)
+    res = errno;
+
+  /* The old journal file needs to be closed before it can be replaced on
+   * Windows. No records can be written in between, since everything
+   * happens in the main thread. */
+  if(res == 0)
+  {
+    close(priv->fd);
+    priv->fd = -1;
+
+    if(g_rename(temp_path, priv->filename) != 0)
+      res = errno;
+
+    priv->fd = g_open(priv->filename, O_WRONLY | O_APPEND | O_BINARY, 0);
+    if(priv->fd == -1)
+    {
+      if(res == 0)
+        res = errno;
+
+      g_warning(
+        _("Error reopening journal \"%s\", no longer journaling: %s"),
+        priv->filename,
+        g_strerror(res)
+      );
+    }
+  }
+
+  if(res != 0)
+  {
+    g_unlink(temp_path);
+    g_free(temp_path);
+
+    inf_text_journal_set_system_error(res, error);
+    return FALSE;
+  }
+
+  g_free(temp_path);
+  return TRUE;
+}
+
+/**
+ * inf_text_journal_replay:
+ * @filename: (type filename): The journal file to replay.
+ * @sequence: The sequence number of the last record that is already
+ * contained in @buffer.
+ * @user_table: The #InfUserTable of the session to recover.
+ * @buffer: The #InfTextBuffer of the session to recover.
+ * @last_sequence: (out) (allow-none): Location to store the sequence number
+ * of the last record in the journal, or %NULL.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Applies all records in the journal at @filename with a sequence number
+ * higher than @sequence to @buffer. Users recorded in the journal are added
+ * to @user_table unless a user with the same ID exists already. Usually,
+ * @user_table and @buffer have been filled with
+ * inf_text_filesystem_format_read() before, and @sequence is the sequence
+ * number stored with the snapshot.
+ *
+ * An incomplete record at the end of the journal, as left behind by a
+ * crash, is silently ignored. If a record cannot be applied, the function
+ * returns %FALSE and @error is set. In that case, @buffer contains the
+ * changes of the preceding records.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_journal_replay(const gchar* filename,
+                        guint64 sequence,
+                        InfUserTable* user_table,
+                        InfTextBuffer* buffer,
+                        guint64* last_sequence,
+                        GError** error)
+{
+  gchar* data;
+  gsize len;
+  gsize offset;
+  xmlDocPtr doc;
+  xmlNodePtr node;
+  guint64 seq;
+  guint64 last;
+  gboolean result;
+
+  g_return_val_if_fail(filename != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  if(!g_file_get_contents(filename, &data, &len, error))
+    return FALSE;
+
+  result = TRUE;
+  last = sequence;
+  offset = 0;
+
+  while(result &&
+        (doc = inf_text_journal_next_frame(data, len, &offset)) != NULL)
+  {
+    node = xmlDocGetRootElement(doc);
+
+    if(strcmp((const char*)node->name, "user") == 0)
+    {
+      result = inf_text_journal_replay_user(user_table, node, error);
+    }
+    else if(strcmp((const char*)node->name, "request") == 0)
+    {
+      if(!inf_text_journal_get_sequence_attribute(node, &seq))
+      {
+        g_set_error_literal(
+          error,
+          inf_text_journal_error_quark(),
+          INF_TEXT_JOURNAL_ERROR_INVALID_RECORD,
+          _("Request record has no valid sequence number")
+        );
+
+        result = FALSE;
+      }
+      else if(seq > sequence)
+      {
+        result = inf_text_journal_replay_request(
+          user_table,
+          buffer,
+          node,
+          error
+        );
+
+        if(seq > last)
+          last = seq;
+      }
+    }
+
+    xmlFreeDoc(doc);
+  }
+
+  g_free(data);
+
+  if(result && last_sequence != NULL)
+    *last_sequence = last;
+
+  return result;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,106 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TEXT_JOURNAL_H__
+#define __INF_TEXT_JOURNAL_H__
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-buffer.h>
+#include <libinfinity/common/inf-user-table.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INF_TEXT_TYPE_JOURNAL                 (inf_text_journal_get_type())
+#define INF_TEXT_JOURNAL(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INF_TEXT_TYPE_JOURNAL, InfTextJournal))
+#define INF_TEXT_JOURNAL_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INF_TEXT_TYPE_JOURNAL, InfTextJournalClass))
+#define INF_TEXT_IS_JOURNAL(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INF_TEXT_TYPE_JOURNAL))
+#define INF_TEXT_IS_JOURNAL_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INF_TEXT_TYPE_JOURNAL))
+#define INF_TEXT_JOURNAL_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INF_TEXT_TYPE_JOURNAL, InfTextJournalClass))
+
+typedef struct _InfTextJournal InfTextJournal;
+typedef struct _InfTextJournalClass InfTextJournalClass;
+
+/**
+ * InfTextJournalError:
+ * @INF_TEXT_JOURNAL_ERROR_INVALID_RECORD: A record in the journal could not
+ * be applied to the buffer, for example because it refers to a position
+ * beyond the end of the buffer.
+ * @INF_TEXT_JOURNAL_ERROR_NO_SUCH_USER: A record in the journal inserts text
+ * written by a user which does not exist.
+ *
+ * Errors that can occur when replaying a journal with
+ * inf_text_journal_replay().
+ */
+typedef enum _InfTextJournalError {
+  INF_TEXT_JOURNAL_ERROR_INVALID_RECORD,
+  INF_TEXT_JOURNAL_ERROR_NO_SUCH_USER
+} InfTextJournalError;
+
+/**
+ * InfTextJournalClass:
+ *
+ * This structure does not contain any public fields.
+ */
+struct _InfTextJournalClass {
+  /*< private >*/
+  GObjectClass parent_class;
+};
+
+/**
+ * InfTextJournal:
+ *
+ * #InfTextJournal is an opaque data type. You should only access it via the
+ * public API functions.
+ */
+struct _InfTextJournal {
+  /*< private >*/
+  GObject parent;
+};
+
+GType
+inf_text_journal_get_type(void);
+
+InfTextJournal*
+inf_text_journal_new(InfTextSession* session,
+                     const gchar* filename,
+                     GError** error);
+
+guint64
+inf_text_journal_get_sequence(InfTextJournal* journal);
+
+gboolean
+inf_text_journal_compact(InfTextJournal* journal,
+                         guint64 sequence,
+                         GError** error);
+
+gboolean
+inf_text_journal_replay(const gchar* filename,
+                        guint64 sequence,
+                        InfUserTable* user_table,
+                        InfTextBuffer* buffer,
+                        guint64* last_sequence,
+                        GError** error);
+
+G_END_DECLS
+
+#endif /* __INF_TEXT_JOURNAL_H__ */
+
+/* vim:set et sw=2 ts=2: */
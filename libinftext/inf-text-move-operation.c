@@ -166,34 +166,21 @@ inf_text_move_operation_transform(InfAdoptedOperation* operation,
     return NULL;
   }
 
-  return INF_ADOPTED_OPERATION(
-    g_object_new(
-      INF_TEXT_TYPE_MOVE_OPERATION,
-      "position", new_pos,
-      "length", new_len,
-      NULL
-    )
-  );
+  return INF_ADOPTED_OPERATION(inf_text_move_operation_new(new_pos, new_len));
 }
 
 static InfAdoptedOperation*
 inf_text_move_operation_copy(InfAdoptedOperation* operation)
 {
   InfTextMoveOperationPrivate* priv;
-  GObject* object;
 
   g_assert(INF_TEXT_IS_MOVE_OPERATION(operation));
 
   priv = INF_TEXT_MOVE_OPERATION_PRIVATE(operation);
 
-  object = g_object_new(
-    INF_TEXT_TYPE_MOVE_OPERATION,
-    "position", priv->position,
-    "length", priv->length,
-    NULL
+  return INF_ADOPTED_OPERATION(
+    inf_text_move_operation_new(priv->position, priv->length)
   );
-
-  return INF_ADOPTED_OPERATION(object);
 }
 
 static InfAdoptedOperationFlags
@@ -311,14 +298,16 @@ inf_text_move_operation_new(guint position,
                             gint length)
 {
   GObject* object;
+  InfTextMoveOperationPrivate* priv;
 
-  object = g_object_new(
-    INF_TEXT_TYPE_MOVE_OPERATION,
-    "position", position,
-    "length", length,
-    NULL
-  );
+  /* Set the fields directly instead of going through the property
+   * machinery, since move operations are created on every transformation
+   * of a caret movement. */
+  object = g_object_new(INF_TEXT_TYPE_MOVE_OPERATION, NULL);
+  priv = INF_TEXT_MOVE_OPERATION_PRIVATE(object);
 
+  priv->position = position;
+  priv->length = length;
   return INF_TEXT_MOVE_OPERATION(object);
 }
 
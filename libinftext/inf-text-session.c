@@ -51,6 +51,11 @@ typedef struct _InfTextSessionPrivate InfTextSessionPrivate;
 struct _InfTextSessionPrivate {
   guint caret_update_interval;
   GSList* local_users;
+
+  /* Converters between the buffer's encoding and UTF-8, opened on first
+   * use. Not used if the buffer is in UTF-8 itself. */
+  GIConv to_utf8;
+  GIConv from_utf8;
 };
 
 enum {
@@ -80,6 +85,9 @@ struct _InfTextSessionEraseForeachData {
 
 static GQuark inf_text_session_error_quark;
 
+/* Estimated memory used by a segment of the buffer besides its text */
+static const gsize INF_TEXT_SESSION_SEGMENT_SIZE = 64;
+
 G_DEFINE_TYPE_WITH_CODE(InfTextSession, inf_text_session, INF_ADOPTED_TYPE_SESSION,
   G_ADD_PRIVATE(InfTextSession))
 
@@ -101,9 +109,87 @@ inf_text_session_timeval_diff(GTimeVal* first,
          (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
 }
 
+/* Returns the converter from the buffer's encoding to UTF-8, or from UTF-8
+ * to the buffer's encoding if to_utf8 is FALSE. Returns NULL if the buffer
+ * is in UTF-8 already, in which case no conversion is needed at all. The
+ * converter is kept open for the lifetime of the session, instead of being
+ * opened for every request. */
+static GIConv*
+inf_text_session_get_converter(InfTextSession* session,
+                               gboolean to_utf8)
+{
+  InfTextSessionPrivate* priv;
+  InfTextBuffer* buffer;
+  const gchar* encoding;
+  GIConv* cd;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+  encoding = inf_text_buffer_get_encoding(buffer);
+
+  if(strcmp(encoding, "UTF-8") == 0)
+    return NULL;
+
+  if(to_utf8)
+  {
+    cd = &priv->to_utf8;
+    if(*cd == (GIConv)(-1))
+      *cd = g_iconv_open("UTF-8", encoding);
+  }
+  else
+  {
+    cd = &priv->from_utf8;
+    if(*cd == (GIConv)(-1))
+      *cd = g_iconv_open(encoding, "UTF-8");
+  }
+
+  g_assert(*cd != (GIConv)(-1));
+
+  /* Reset the shift state in case a previous conversion was aborted */
+  g_iconv(*cd, NULL, NULL, NULL, NULL);
+  return cd;
+}
+
+/* Converts utf8_text, which is freed, into the buffer's encoding with cd,
+ * as returned by inf_text_session_get_converter(). If cd is NULL, the text
+ * is only validated and returned as-is. */
+static gpointer
+inf_text_session_convert_from_utf8(GIConv* cd,
+                                   gchar* utf8_text,
+                                   gsize utf8_bytes,
+                                   gsize* bytes,
+                                   GError** error)
+{
+  gpointer text;
+
+  if(cd == NULL)
+  {
+    if(!g_utf8_validate(utf8_text, utf8_bytes, NULL))
+    {
+      g_set_error_literal(
+        error,
+        G_CONVERT_ERROR,
+        G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+        _("Invalid byte sequence in conversion input")
+      );
+
+      g_free(utf8_text);
+      return NULL;
+    }
+
+    *bytes = utf8_bytes;
+    return utf8_text;
+  }
+
+  text = g_convert_with_iconv(utf8_text, utf8_bytes, *cd, NULL, bytes, error);
+  g_free(utf8_text);
+  return text;
+}
+
 /* Converts at most *bytes bytes with cd and writes the result, which are
  * at most 1024 bytes, into xml, setting the given author. *bytes will be
- * set to the number of bytes not yet processed. */
+ * set to the number of bytes not yet processed. If cd is NULL, the text is
+ * in UTF-8 already and is written without conversion. */
 static void
 inf_text_session_segment_to_xml(GIConv* cd,
                                 xmlNodePtr xml,
@@ -119,6 +205,23 @@ inf_text_session_segment_to_xml(GIConv* cd,
   gchar* inbuf;
   gchar* outbuf;
 
+  if(cd == NULL)
+  {
+    inbuf = *(gchar**)(gpointer)&text; /* cast const away without warning */
+
+    /* Don't split a multibyte character */
+    bytes_left = MIN(*bytes, 1024);
+    if(bytes_left < *bytes)
+      while(bytes_left > 0 && (inbuf[bytes_left] & 0xc0) == 0x80)
+        --bytes_left;
+
+    inf_xml_util_add_child_text(xml, inbuf, bytes_left);
+    inf_xml_util_set_attribute_uint(xml, "author", author);
+
+    *bytes -= bytes_left;
+    return;
+  }
+
   bytes_left = 1024;
 
   inbuf = *(gchar**)(gpointer)&text; /* cast const away without warning */
@@ -149,7 +252,6 @@ inf_text_session_segment_from_xml(GIConv* cd,
 {
   gsize bytes_read;
   gchar* utf8_text;
-  gpointer text;
 
   if(!inf_xml_util_get_attribute_uint_required(xml, "author", author, error))
     return NULL;
@@ -158,17 +260,13 @@ inf_text_session_segment_from_xml(GIConv* cd,
   if(!utf8_text)
     return NULL;
 
-  text = g_convert_with_iconv(
+  return inf_text_session_convert_from_utf8(
+    cd,
     utf8_text,
     bytes_read,
-    *cd,
-    NULL,
     bytes,
     error
   );
-
-  g_free(utf8_text);
-  return text;
 }
 
 /*
@@ -545,6 +643,7 @@ inf_text_session_buffer_text_inserted_cb(InfTextBuffer* buffer,
   session = INF_TEXT_SESSION(user_data);
   priv = INF_TEXT_SESSION_PRIVATE(session);
   user_table = inf_session_get_user_table(INF_SESSION(session));
+  inf_session_invalidate_sync_snapshot(INF_SESSION(session));
   algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
   execute_request = inf_adopted_algorithm_get_execute_request(algorithm);
 
@@ -623,6 +722,7 @@ inf_text_session_buffer_text_erased_cb(InfTextBuffer* buffer,
   session = INF_TEXT_SESSION(user_data);
   priv = INF_TEXT_SESSION_PRIVATE(session);
   user_table = inf_session_get_user_table(INF_SESSION(session));
+  inf_session_invalidate_sync_snapshot(INF_SESSION(session));
   algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
   execute_request = inf_adopted_algorithm_get_execute_request(algorithm);
 
@@ -741,6 +841,8 @@ inf_text_session_init(InfTextSession* session)
   priv = INF_TEXT_SESSION_PRIVATE(session);
 
   priv->caret_update_interval = 500;
+  priv->to_utf8 = (GIConv)(-1);
+  priv->from_utf8 = (GIConv)(-1);
 }
 
 static void
@@ -851,6 +953,11 @@ inf_text_session_finalize(GObject* object)
   session = INF_TEXT_SESSION(object);
   priv = INF_TEXT_SESSION_PRIVATE(session);
 
+  if(priv->to_utf8 != (GIConv)(-1))
+    g_iconv_close(priv->to_utf8);
+  if(priv->from_utf8 != (GIConv)(-1))
+    g_iconv_close(priv->from_utf8);
+
   G_OBJECT_CLASS(inf_text_session_parent_class)->finalize(object);
 }
 
@@ -987,7 +1094,7 @@ inf_text_session_to_xml_sync(InfSession* session,
   gchar* text;
   gsize total_bytes;
   gsize bytes_left;
-  GIConv cd;
+  GIConv* cd;
 
   INF_SESSION_CLASS(inf_text_session_parent_class)->to_xml_sync(
     session,
@@ -995,7 +1102,7 @@ inf_text_session_to_xml_sync(InfSession* session,
   );
 
   buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
-  cd = g_iconv_open("UTF-8", inf_text_buffer_get_encoding(buffer));
+  cd = inf_text_session_get_converter(INF_TEXT_SESSION(session), TRUE);
 
   iter = inf_text_buffer_create_begin_iter(buffer);
   if(iter != NULL)
@@ -1012,7 +1119,7 @@ inf_text_session_to_xml_sync(InfSession* session,
       {
         xml = xmlNewChild(parent, NULL, (const xmlChar*)"sync-segment", NULL);
         inf_text_session_segment_to_xml(
-          &cd,
+          cd,
           xml,
           text + total_bytes - bytes_left,
           &bytes_left,
@@ -1026,8 +1133,6 @@ inf_text_session_to_xml_sync(InfSession* session,
 
     inf_text_buffer_destroy_iter(buffer, iter);
   }
-
-  g_iconv_close(cd);
 }
 
 static gboolean
@@ -1037,7 +1142,7 @@ inf_text_session_process_xml_sync(InfSession* session,
                                   GError** error)
 {
   InfTextBuffer* buffer;
-  GIConv cd;
+  GIConv* cd;
 
   gpointer text;
   gsize bytes;
@@ -1048,10 +1153,10 @@ inf_text_session_process_xml_sync(InfSession* session,
   if(strcmp((const char*)xml->name, "sync-segment") == 0)
   {
     buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
-    cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
+    cd = inf_text_session_get_converter(INF_TEXT_SESSION(session), FALSE);
 
     text = inf_text_session_segment_from_xml(
-      &cd,
+      cd,
       xml,
       &length,
       &bytes,
@@ -1059,7 +1164,6 @@ inf_text_session_process_xml_sync(InfSession* session,
       error
     );
 
-    g_iconv_close(cd);
     if(text == NULL) return FALSE;
 
     if(author != 0)
@@ -1315,6 +1419,36 @@ inf_text_session_synchronization_complete(InfSession* session,
     inf_text_session_init_text_handlers(INF_TEXT_SESSION(session));
 }
 
+static gsize
+inf_text_session_get_memory_usage(InfSession* session)
+{
+  InfSessionClass* parent_class;
+  InfTextBuffer* buffer;
+  InfTextBufferIter* iter;
+  gboolean result;
+  gsize usage;
+
+  parent_class = INF_SESSION_CLASS(inf_text_session_parent_class);
+  usage = parent_class->get_memory_usage(session);
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    result = TRUE;
+    while(result == TRUE)
+    {
+      usage += inf_text_buffer_iter_get_bytes(buffer, iter) +
+        INF_TEXT_SESSION_SEGMENT_SIZE;
+      result = inf_text_buffer_iter_next(buffer, iter);
+    }
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  return usage;
+}
+
 /*
  * InfAdoptedSession overrides
  */
@@ -1335,7 +1469,7 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
   gsize bytes_read;
   gsize bytes_written;
 
-  GIConv cd;
+  GIConv* cd;
   xmlNodePtr child;
   const gchar* text;
   gsize total_bytes;
@@ -1369,22 +1503,33 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
       result = inf_text_chunk_iter_init_begin(chunk, &iter);
       g_assert(result == TRUE);
 
-      utf8_text = g_convert(
-        inf_text_chunk_iter_get_text(&iter),
-        inf_text_chunk_iter_get_bytes(&iter),
-        "UTF-8",
-        inf_text_chunk_get_encoding(chunk),
-        &bytes_read,
-        &bytes_written,
-        NULL
-      );
+      cd = inf_text_session_get_converter(INF_TEXT_SESSION(session), TRUE);
+      if(cd == NULL)
+      {
+        inf_xml_util_add_child_text(
+          op_xml,
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter)
+        );
+      }
+      else
+      {
+        utf8_text = g_convert_with_iconv(
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter),
+          *cd,
+          &bytes_read,
+          &bytes_written,
+          NULL
+        );
 
-      /* Conversion to UTF-8 should always succeed */
-      g_assert(utf8_text != NULL);
-      g_assert(bytes_read == inf_text_chunk_iter_get_bytes(&iter));
+        /* Conversion to UTF-8 should always succeed */
+        g_assert(utf8_text != NULL);
+        g_assert(bytes_read == inf_text_chunk_iter_get_bytes(&iter));
 
-      inf_xml_util_add_child_text(op_xml, utf8_text, bytes_written);
-      g_free(utf8_text);
+        inf_xml_util_add_child_text(op_xml, utf8_text, bytes_written);
+        g_free(utf8_text);
+      }
 
       /* We only allow a single segment because the whole inserted text must
        * be written by a single user. */
@@ -1412,7 +1557,7 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
         );
 
         /* Need to transmit all deleted data */
-        cd = g_iconv_open("UTF-8", inf_text_chunk_get_encoding(chunk));
+        cd = inf_text_session_get_converter(INF_TEXT_SESSION(session), TRUE);
         result = inf_text_chunk_iter_init_begin(chunk, &iter);
 
         while(result == TRUE)
@@ -1425,7 +1570,7 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
           while(bytes_left > 0)
           {
             inf_text_session_segment_to_xml(
-              &cd,
+              cd,
               child,
               text + total_bytes - bytes_left,
               &bytes_left,
@@ -1435,8 +1580,6 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
 
           result = inf_text_chunk_iter_next(&iter);
         }
-
-        g_iconv_close(cd);
       }
       else
       {
@@ -1528,7 +1671,7 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
   guint length;
 
   xmlNodePtr child;
-  GIConv cd;
+  GIConv* cd;
   guint author;
   gboolean cmp;
 
@@ -1561,17 +1704,14 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
     if(!utf8_text)
       goto fail;
 
-    text = g_convert(
+    text = inf_text_session_convert_from_utf8(
+      inf_text_session_get_converter(INF_TEXT_SESSION(session), FALSE),
       utf8_text,
       in_bytes,
-      inf_text_buffer_get_encoding(buffer),
-      "UTF-8",
-      NULL,
       &bytes,
       error
     );
 
-    g_free(utf8_text);
     if(text == NULL) goto fail;
 
     chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
@@ -1595,15 +1735,14 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
     if(for_sync == TRUE)
     {
       chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
-      cd = g_iconv_open(inf_text_buffer_get_encoding(buffer), "UTF-8");
-      g_assert(cd != (GIConv)(-1));
+      cd = inf_text_session_get_converter(INF_TEXT_SESSION(session), FALSE);
 
       for(child = op_xml->children; child != NULL; child = child->next)
       {
         if(strcmp((const char*)child->name, "segment") == 0)
         {
           text = inf_text_session_segment_from_xml(
-            &cd,
+            cd,
             child,
             &length,
             &bytes,
@@ -1614,7 +1753,6 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
           if(text == NULL)
           {
             inf_text_chunk_free(chunk);
-            g_iconv_close(cd);
             goto fail;
           }
           else
@@ -1637,8 +1775,6 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
         }
       }
 
-      g_iconv_close(cd);
-
       operation = INF_ADOPTED_OPERATION(
         inf_text_default_delete_operation_new(pos, chunk)
       );
@@ -1775,6 +1911,7 @@ inf_text_session_class_init(InfTextSessionClass* text_session_class)
   session_class->set_xml_user_props = inf_text_session_set_xml_user_props;
   session_class->validate_user_props = inf_text_session_validate_user_props;
   session_class->user_new = inf_text_session_user_new;
+  session_class->get_memory_usage = inf_text_session_get_memory_usage;
   session_class->synchronization_complete =
     inf_text_session_synchronization_complete;
 
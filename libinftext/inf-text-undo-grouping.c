@@ -42,15 +42,28 @@
 #include <libinftext/inf-text-move-operation.h>
 #include <libinftext/inf-text-chunk.h>
 
+#include <string.h>
+
+typedef struct _InfTextUndoGroupingPrivate InfTextUndoGroupingPrivate;
+struct _InfTextUndoGroupingPrivate {
+  /* Converter from the encoding of the operations' text to UTF-8, opened on
+   * first use for text that is not in UTF-8 already */
+  GIConv cd;
+  GQuark encoding;
+};
+
 #define INF_TEXT_UNDO_GROUPING_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_UNDO_GROUPING, InfTextUndoGroupingPrivate))
 
-G_DEFINE_TYPE(InfTextUndoGrouping, inf_text_undo_grouping, INF_ADOPTED_TYPE_UNDO_GROUPING)
+G_DEFINE_TYPE_WITH_CODE(InfTextUndoGrouping, inf_text_undo_grouping, INF_ADOPTED_TYPE_UNDO_GROUPING,
+  G_ADD_PRIVATE(InfTextUndoGrouping))
 
 /* Returns the gunichar of the first character of a InfTextChunk */
 static gunichar
-inf_text_undo_grouping_get_char_from_chunk(InfTextChunk* chunk)
+inf_text_undo_grouping_get_char_from_chunk(InfTextUndoGrouping* grouping,
+                                           InfTextChunk* chunk)
 {
-  GIConv cd;
+  InfTextUndoGroupingPrivate* priv;
+  const gchar* encoding;
   InfTextChunkIter iter;
   gchar* inbuf;
   size_t inlen;
@@ -59,21 +72,37 @@ inf_text_undo_grouping_get_char_from_chunk(InfTextChunk* chunk)
   size_t result;
   gchar buffer[6];
 
-  cd = g_iconv_open("UTF-8", inf_text_chunk_get_encoding(chunk));
-  g_assert(cd != (GIConv)-1);
-
+  priv = INF_TEXT_UNDO_GROUPING_PRIVATE(grouping);
+  encoding = inf_text_chunk_get_encoding(chunk);
   inf_text_chunk_iter_init_begin(chunk, &iter);
+
+  /* No conversion needed */
+  if(strcmp(encoding, "UTF-8") == 0)
+    return g_utf8_get_char(inf_text_chunk_iter_get_text(&iter));
+
+  if(priv->encoding != g_quark_from_string(encoding))
+  {
+    if(priv->cd != (GIConv)-1)
+      g_iconv_close(priv->cd);
+
+    priv->cd = g_iconv_open("UTF-8", encoding);
+    priv->encoding = g_quark_from_string(encoding);
+    g_assert(priv->cd != (GIConv)-1);
+  }
+
+  /* Reset the shift state */
+  g_iconv(priv->cd, NULL, NULL, NULL, NULL);
+
   /* cast const away without warning */ /* more or less */
   *(gconstpointer*) &inbuf = inf_text_chunk_iter_get_text(&iter);
   inlen = inf_text_chunk_iter_get_bytes(&iter);
   outbuf = buffer;
   outlen = 6; /* max length of a UTF-8 character */
 
-  result = g_iconv(cd, &inbuf, &inlen, &outbuf, &outlen);
+  result = g_iconv(priv->cd, &inbuf, &inlen, &outbuf, &outlen);
   /* we expect exactly one char in chunk, so there should be enough space */
   g_assert(result == 0);/* || (result == (size_t)(-1) && errno == E2BIG));*/
 
-  g_iconv_close(cd);
   return g_utf8_get_char(buffer);
 }
 
@@ -225,11 +254,13 @@ inf_text_undo_grouping_group_requests(InfAdoptedUndoGrouping* grouping,
 
       /* start new group when going from whitespace to non-whitespace */
       first_char = inf_text_undo_grouping_get_char_from_chunk(
+        INF_TEXT_UNDO_GROUPING(grouping),
         inf_text_default_insert_operation_get_chunk(
           INF_TEXT_DEFAULT_INSERT_OPERATION(first_op)
         )
       );
       second_char = inf_text_undo_grouping_get_char_from_chunk(
+        INF_TEXT_UNDO_GROUPING(grouping),
         inf_text_default_insert_operation_get_chunk(
           INF_TEXT_DEFAULT_INSERT_OPERATION(second_op)
         )
@@ -276,11 +307,13 @@ inf_text_undo_grouping_group_requests(InfAdoptedUndoGrouping* grouping,
 
       /* start new group when going from whitespace to non-whitespace */
       first_char = inf_text_undo_grouping_get_char_from_chunk(
+        INF_TEXT_UNDO_GROUPING(grouping),
         inf_text_default_delete_operation_get_chunk(
           INF_TEXT_DEFAULT_DELETE_OPERATION(first_op)
         )
       );
       second_char = inf_text_undo_grouping_get_char_from_chunk(
+        INF_TEXT_UNDO_GROUPING(grouping),
         inf_text_default_delete_operation_get_chunk(
           INF_TEXT_DEFAULT_DELETE_OPERATION(second_op)
         )
@@ -302,17 +335,37 @@ inf_text_undo_grouping_group_requests(InfAdoptedUndoGrouping* grouping,
 static void
 inf_text_undo_grouping_init(InfTextUndoGrouping* grouping)
 {
+  InfTextUndoGroupingPrivate* priv;
+  priv = INF_TEXT_UNDO_GROUPING_PRIVATE(grouping);
+
+  priv->cd = (GIConv)-1;
+  priv->encoding = 0;
+}
+
+static void
+inf_text_undo_grouping_finalize(GObject* object)
+{
+  InfTextUndoGroupingPrivate* priv;
+  priv = INF_TEXT_UNDO_GROUPING_PRIVATE(object);
+
+  if(priv->cd != (GIConv)-1)
+    g_iconv_close(priv->cd);
+
+  G_OBJECT_CLASS(inf_text_undo_grouping_parent_class)->finalize(object);
 }
 
 static void
 inf_text_undo_grouping_class_init(
   InfTextUndoGroupingClass* text_undo_grouping_class)
 {
+  GObjectClass* object_class;
   InfAdoptedUndoGroupingClass* undo_grouping_class;
 
+  object_class = G_OBJECT_CLASS(text_undo_grouping_class);
   undo_grouping_class =
     INF_ADOPTED_UNDO_GROUPING_CLASS(text_undo_grouping_class);
 
+  object_class->finalize = inf_text_undo_grouping_finalize;
   undo_grouping_class->group_requests = inf_text_undo_grouping_group_requests;
 }
 
@@ -0,0 +1,459 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Executes random insertions with InfAdoptedAlgorithm while users join, leave,
+ * rejoin with old vectors and catch up with the current state. Before every
+ * call to inf_adopted_algorithm_cleanup(), the least common predecessor of
+ * the current state and the vectors of all available users is computed from
+ * scratch, and the requests which cleanup should remove with it are
+ * determined the way cleanup did before it kept the lcp up to date
+ * incrementally. Cleanup must remove exactly these requests. */
+
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INF_TEST_ALGORITHM_CLEANUP_MAX_USERS 12
+#define INF_TEST_ALGORITHM_CLEANUP_STEPS 3000
+
+static const guint INF_TEST_ALGORITHM_CLEANUP_LOG_SIZES[] = { 3, 10 };
+
+typedef struct _InfTestAlgorithmCleanup InfTestAlgorithmCleanup;
+struct _InfTestAlgorithmCleanup {
+  GRand* rand;
+  InfUserTable* user_table;
+  InfAdoptedAlgorithm* algorithm;
+  guint max_total_log_size;
+
+  InfAdoptedUser* users[INF_TEST_ALGORITHM_CLEANUP_MAX_USERS];
+  guint n_users;
+};
+
+static gboolean
+inf_test_algorithm_cleanup_is_available(InfAdoptedUser* user)
+{
+  return inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE;
+}
+
+/* Returns a random user that is available, or unavailable, or NULL if
+ * there is none. */
+static InfAdoptedUser*
+inf_test_algorithm_cleanup_choose_user(InfTestAlgorithmCleanup* test,
+                                       gboolean available)
+{
+  InfAdoptedUser* candidates[INF_TEST_ALGORITHM_CLEANUP_MAX_USERS];
+  guint n_candidates;
+  guint i;
+
+  n_candidates = 0;
+  for(i = 0; i < test->n_users; ++i)
+  {
+    if(inf_test_algorithm_cleanup_is_available(test->users[i]) == available)
+      candidates[n_candidates++] = test->users[i];
+  }
+
+  if(n_candidates == 0)
+    return NULL;
+
+  return candidates[g_rand_int_range(test->rand, 0, n_candidates)];
+}
+
+static guint
+inf_test_algorithm_cleanup_n_available(InfTestAlgorithmCleanup* test)
+{
+  guint n;
+  guint i;
+
+  n = 0;
+  for(i = 0; i < test->n_users; ++i)
+    if(inf_test_algorithm_cleanup_is_available(test->users[i]))
+      ++n;
+
+  return n;
+}
+
+static void
+inf_test_algorithm_cleanup_join(InfTestAlgorithmCleanup* test)
+{
+  InfAdoptedStateVector* vector;
+  InfTextUser* user;
+  gchar* name;
+  guint id;
+
+  id = test->n_users + 1;
+  name = g_strdup_printf("User_%u", id);
+
+  /* A new user starts at the current state */
+  vector = inf_adopted_state_vector_copy(
+    inf_adopted_algorithm_get_current(test->algorithm)
+  );
+
+  user = INF_TEXT_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", id,
+      "name", name,
+      "status", INF_USER_ACTIVE,
+      "vector", vector,
+      "flags", 0,
+      NULL
+    )
+  );
+
+  inf_adopted_state_vector_free(vector);
+  g_free(name);
+
+  inf_user_table_add_user(test->user_table, INF_USER(user));
+  test->users[test->n_users++] = INF_ADOPTED_USER(user);
+  g_object_unref(user);
+}
+
+/* Lets user catch up with the current state, as it does when it
+ * acknowledges the requests it has received */
+static void
+inf_test_algorithm_cleanup_catch_up(InfTestAlgorithmCleanup* test,
+                                    InfAdoptedUser* user)
+{
+  inf_adopted_user_set_vector(
+    user,
+    inf_adopted_state_vector_copy(
+      inf_adopted_algorithm_get_current(test->algorithm)
+    )
+  );
+}
+
+static gboolean
+inf_test_algorithm_cleanup_execute(InfTestAlgorithmCleanup* test,
+                                   InfAdoptedUser* user)
+{
+  InfAdoptedStateVector* current;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  InfTextChunk* chunk;
+  GError* error;
+  gboolean result;
+  guint id;
+
+  id = inf_user_get_id(INF_USER(user));
+
+  /* The request is made at the current state, so the user has seen
+   * everything before. */
+  inf_test_algorithm_cleanup_catch_up(test, user);
+  current = inf_adopted_algorithm_get_current(test->algorithm);
+
+  chunk = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_insert_text(chunk, 0, "a", 1, 1, id);
+
+  operation = INF_ADOPTED_OPERATION(
+    inf_text_default_insert_operation_new(0, chunk)
+  );
+
+  request = inf_adopted_request_new_do(current, id, operation, 0);
+
+  inf_text_chunk_free(chunk);
+  g_object_unref(operation);
+
+  error = NULL;
+  result = inf_adopted_algorithm_execute_request(
+    test->algorithm,
+    request,
+    TRUE,
+    &error
+  );
+
+  g_object_unref(request);
+
+  if(result == FALSE)
+  {
+    fprintf(stderr, "Failed to execute request: %s\n", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  /* The user has seen its own request as well */
+  inf_test_algorithm_cleanup_catch_up(test, user);
+  return TRUE;
+}
+
+/* The least common predecessor of the current state and the vectors of all
+ * available users, computed from scratch */
+static InfAdoptedStateVector*
+inf_test_algorithm_cleanup_lcp(InfTestAlgorithmCleanup* test)
+{
+  InfAdoptedStateVector* lcp;
+  InfAdoptedStateVector* vector;
+  guint id;
+  guint i, j;
+
+  lcp = inf_adopted_state_vector_copy(
+    inf_adopted_algorithm_get_current(test->algorithm)
+  );
+
+  for(i = 0; i < test->n_users; ++i)
+  {
+    if(!inf_test_algorithm_cleanup_is_available(test->users[i]))
+      continue;
+
+    vector = inf_adopted_user_get_vector(test->users[i]);
+    for(j = 0; j < test->n_users; ++j)
+    {
+      id = inf_user_get_id(INF_USER(test->users[j]));
+      inf_adopted_state_vector_set(
+        lcp,
+        id,
+        MIN(
+          inf_adopted_state_vector_get(lcp, id),
+          inf_adopted_state_vector_get(vector, id)
+        )
+      );
+    }
+  }
+
+  return lcp;
+}
+
+/* Returns the index of the first request in the log of user that remains
+ * after cleanup with the given lcp. This is how cleanup worked before the
+ * lcp was maintained incrementally. */
+static guint
+inf_test_algorithm_cleanup_expected_begin(InfTestAlgorithmCleanup* test,
+                                          InfAdoptedUser* user,
+                                          InfAdoptedStateVector* lcp)
+{
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  InfAdoptedStateVector* vector;
+  guint id;
+  guint n;
+
+  id = inf_user_get_id(INF_USER(user));
+  log = inf_adopted_user_get_request_log(user);
+  n = inf_adopted_request_log_get_begin(log);
+
+  while(n < inf_adopted_request_log_get_end(log))
+  {
+    request = inf_adopted_request_log_upper_related(log, n);
+    vector = inf_adopted_request_get_vector(request);
+
+    if(!inf_adopted_state_vector_causally_before_inc(vector, lcp, id))
+      break;
+
+    request = inf_adopted_request_log_get_request(log, n);
+    if(inf_adopted_state_vector_vdiff(
+         inf_adopted_request_get_vector(request), lcp) <
+       test->max_total_log_size)
+    {
+      break;
+    }
+
+    n = inf_adopted_state_vector_get(vector, id) + 1;
+  }
+
+  return n;
+}
+
+static gboolean
+inf_test_algorithm_cleanup_check(InfTestAlgorithmCleanup* test)
+{
+  InfAdoptedStateVector* lcp;
+  guint expected[INF_TEST_ALGORITHM_CLEANUP_MAX_USERS];
+  InfAdoptedRequestLog* log;
+  gchar* lcp_str;
+  guint begin;
+  guint i;
+
+  lcp = inf_test_algorithm_cleanup_lcp(test);
+  for(i = 0; i < test->n_users; ++i)
+  {
+    expected[i] = inf_test_algorithm_cleanup_expected_begin(
+      test,
+      test->users[i],
+      lcp
+    );
+  }
+
+  inf_adopted_algorithm_cleanup(test->algorithm);
+
+  for(i = 0; i < test->n_users; ++i)
+  {
+    log = inf_adopted_user_get_request_log(test->users[i]);
+    begin = inf_adopted_request_log_get_begin(log);
+
+    if(begin != expected[i])
+    {
+      lcp_str = inf_adopted_state_vector_to_string(lcp);
+
+      fprintf(
+        stderr,
+        "User %u: log begins at %u after cleanup, but should begin at %u "
+        "for lcp %s\n",
+        inf_user_get_id(INF_USER(test->users[i])),
+        begin,
+        expected[i],
+        lcp_str
+      );
+
+      g_free(lcp_str);
+      inf_adopted_state_vector_free(lcp);
+      return FALSE;
+    }
+  }
+
+  inf_adopted_state_vector_free(lcp);
+  return TRUE;
+}
+
+static gboolean
+inf_test_algorithm_cleanup_step(InfTestAlgorithmCleanup* test)
+{
+  InfAdoptedUser* user;
+
+  switch(g_rand_int_range(test->rand, 0, 10))
+  {
+  case 0:
+    if(test->n_users < INF_TEST_ALGORITHM_CLEANUP_MAX_USERS)
+      inf_test_algorithm_cleanup_join(test);
+    break;
+  case 1:
+    /* Keep at least one user around to make requests */
+    if(inf_test_algorithm_cleanup_n_available(test) > 1)
+    {
+      user = inf_test_algorithm_cleanup_choose_user(test, TRUE);
+      g_object_set(G_OBJECT(user), "status", INF_USER_UNAVAILABLE, NULL);
+    }
+    break;
+  case 2:
+    /* The user rejoins with the vector it had when it left, which is
+     * usually behind the lcp by now. */
+    user = inf_test_algorithm_cleanup_choose_user(test, FALSE);
+    if(user != NULL)
+      g_object_set(G_OBJECT(user), "status", INF_USER_ACTIVE, NULL);
+    break;
+  case 3:
+  case 4:
+    user = inf_test_algorithm_cleanup_choose_user(test, TRUE);
+    inf_test_algorithm_cleanup_catch_up(test, user);
+    break;
+  default:
+    user = inf_test_algorithm_cleanup_choose_user(test, TRUE);
+    if(!inf_test_algorithm_cleanup_execute(test, user))
+      return FALSE;
+    break;
+  }
+
+  return inf_test_algorithm_cleanup_check(test);
+}
+
+static gboolean
+inf_test_algorithm_cleanup_run(guint max_total_log_size,
+                               guint seed)
+{
+  InfTestAlgorithmCleanup test;
+  InfTextBuffer* buffer;
+  gboolean result;
+  guint i;
+
+  test.rand = g_rand_new_with_seed(seed);
+  test.user_table = inf_user_table_new();
+  test.max_total_log_size = max_total_log_size;
+  test.n_users = 0;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  test.algorithm = inf_adopted_algorithm_new_full(
+    test.user_table,
+    INF_BUFFER(buffer),
+    max_total_log_size
+  );
+
+  inf_test_algorithm_cleanup_join(&test);
+  inf_test_algorithm_cleanup_join(&test);
+
+  result = TRUE;
+  for(i = 0; i < INF_TEST_ALGORITHM_CLEANUP_STEPS && result; ++i)
+    result = inf_test_algorithm_cleanup_step(&test);
+
+  g_object_unref(test.algorithm);
+  g_object_unref(buffer);
+  g_object_unref(test.user_table);
+  g_rand_free(test.rand);
+
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GError* error;
+  guint seed;
+  gboolean result;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  if(argc > 1)
+    seed = atoi(argv[1]);
+  else
+    seed = time(NULL);
+
+  printf("Using random seed %u\n", seed);
+
+  result = TRUE;
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_ALGORITHM_CLEANUP_LOG_SIZES); ++i)
+  {
+    printf(
+      "max-total-log-size %u... ",
+      INF_TEST_ALGORITHM_CLEANUP_LOG_SIZES[i]
+    );
+
+    fflush(stdout);
+
+    if(inf_test_algorithm_cleanup_run(
+         INF_TEST_ALGORITHM_CLEANUP_LOG_SIZES[i], seed))
+    {
+      printf("OK\n");
+    }
+    else
+    {
+      printf("FAILED\n");
+      result = FALSE;
+    }
+  }
+
+  inf_deinit();
+
+  if(result == FALSE)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,376 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures the CPU time it takes to broadcast a message to a group, as a
+ * function of the number of group members. The members are XMPP connections
+ * over the loopback interface. For comparison, the same message is also sent
+ * to every member individually, which copies and serializes it once for
+ * every connection. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _InfTestBroadcast InfTestBroadcast;
+struct _InfTestBroadcast {
+  InfStandaloneIo* io;
+  GSList* server_connections;
+  GSList* client_connections;
+  guint n_open;
+  guint n_sent;
+};
+
+static const guint INF_TEST_BROADCAST_SUBSCRIBERS[] = {
+  1, 10, 25, 50, 100, 150
+};
+
+static void
+inf_test_broadcast_sent_cb(InfXmlConnection* connection,
+                           xmlNodePtr xml,
+                           gpointer user_data)
+{
+  InfTestBroadcast* test;
+  test = (InfTestBroadcast*)user_data;
+
+  ++test->n_sent;
+}
+
+static void
+inf_test_broadcast_notify_status_cb(GObject* object,
+                                    GParamSpec* pspec,
+                                    gpointer user_data)
+{
+  InfTestBroadcast* test;
+  InfXmlConnectionStatus status;
+
+  test = (InfTestBroadcast*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_XML_CONNECTION_OPEN)
+    ++test->n_open;
+}
+
+static void
+inf_test_broadcast_new_connection_cb(InfdXmlServer* server,
+                                     InfXmlConnection* connection,
+                                     gpointer user_data)
+{
+  InfTestBroadcast* test;
+  test = (InfTestBroadcast*)user_data;
+
+  g_object_ref(connection);
+  test->server_connections =
+    g_slist_append(test->server_connections, connection);
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "notify::status",
+    G_CALLBACK(inf_test_broadcast_notify_status_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "sent",
+    G_CALLBACK(inf_test_broadcast_sent_cb),
+    test
+  );
+}
+
+static xmlNodePtr
+inf_test_broadcast_make_message(void)
+{
+  xmlNodePtr xml;
+  xmlNodePtr op;
+
+  /* Something resembling a typical text request */
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+  inf_xml_util_set_attribute(xml, "user", "1");
+  inf_xml_util_set_attribute(xml, "time", "2:174;3:12;5:1");
+
+  op = xmlNewChild(xml, NULL, (const xmlChar*)"insert-caret", NULL);
+  inf_xml_util_set_attribute_uint(op, "pos", 1234);
+  inf_xml_util_add_child_text(op, "Hello World!", strlen("Hello World!"));
+
+  return xml;
+}
+
+/* Sends messages to the first n_subscribers members and returns the CPU
+ * time spent in the send calls per message, in microseconds. */
+static double
+inf_test_broadcast_run(InfTestBroadcast* test,
+                       InfCommunicationManager* manager,
+                       guint n_subscribers,
+                       guint n_messages,
+                       gboolean broadcast)
+{
+  static const gchar* const methods[] = { "central", NULL };
+
+  InfCommunicationHostedGroup* group;
+  xmlNodePtr message;
+  GSList* item;
+  guint i, j;
+  guint n_expected;
+  gint64 total;
+  gint64 start;
+
+  group = inf_communication_manager_open_group(manager, "broadcast", methods);
+
+  for(item = test->server_connections, i = 0;
+      item != NULL && i < n_subscribers;
+      item = item->next, ++i)
+  {
+    inf_communication_hosted_group_add_member(
+      group,
+      INF_XML_CONNECTION(item->data)
+    );
+  }
+
+  message = inf_test_broadcast_make_message();
+  total = 0;
+
+  for(i = 0; i < n_messages; ++i)
+  {
+    test->n_sent = 0;
+    start = g_get_monotonic_time();
+
+    if(broadcast)
+    {
+      inf_communication_group_send_group_message(
+        INF_COMMUNICATION_GROUP(group),
+        xmlCopyNode(message, 1)
+      );
+    }
+    else
+    {
+      for(item = test->server_connections, j = 0;
+          item != NULL && j < n_subscribers;
+          item = item->next, ++j)
+      {
+        inf_communication_group_send_message(
+          INF_COMMUNICATION_GROUP(group),
+          INF_XML_CONNECTION(item->data),
+          xmlCopyNode(message, 1)
+        );
+      }
+    }
+
+    total += g_get_monotonic_time() - start;
+
+    /* Wait until the message has been sent to everyone, so that the next
+     * message is sent directly instead of being queued. */
+    n_expected = MIN(n_subscribers, g_slist_length(test->server_connections));
+    while(test->n_sent < n_expected)
+      inf_standalone_io_iteration(test->io);
+  }
+
+  xmlFreeNode(message);
+  g_object_unref(group);
+
+  return (double)total / n_messages;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestBroadcast test;
+  InfdTcpServer* server;
+  InfdXmppServer* xmpp_server;
+  InfCommunicationManager* manager;
+  InfIpAddress* addr;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  guint port;
+  guint n_messages;
+  guint max_subscribers;
+  double broadcast_time;
+  double single_time;
+  GError* error;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  n_messages = 1000;
+  if(argc > 1)
+    n_messages = atoi(argv[1]);
+
+  max_subscribers = INF_TEST_BROADCAST_SUBSCRIBERS[
+    G_N_ELEMENTS(INF_TEST_BROADCAST_SUBSCRIBERS) - 1
+  ];
+
+  test.io = inf_standalone_io_new();
+  test.server_connections = NULL;
+  test.client_connections = NULL;
+  test.n_open = 0;
+  test.n_sent = 0;
+
+  addr = inf_ip_address_new_loopback4();
+
+  server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test.io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  if(infd_tcp_server_open(server, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    inf_ip_address_free(addr);
+    g_object_unref(server);
+    g_object_unref(test.io);
+    return EXIT_FAILURE;
+  }
+
+  g_object_get(G_OBJECT(server), "local-port", &port, NULL);
+
+  xmpp_server = infd_xmpp_server_new(
+    server,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp_server),
+    "new-connection",
+    G_CALLBACK(inf_test_broadcast_new_connection_cb),
+    &test
+  );
+
+  for(i = 0; i < max_subscribers; ++i)
+  {
+    tcp = inf_tcp_connection_new(INF_IO(test.io), addr, port);
+    xmpp = inf_xmpp_connection_new(
+      tcp,
+      INF_XMPP_CONNECTION_CLIENT,
+      NULL,
+      "localhost",
+      INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      NULL,
+      NULL,
+      NULL
+    );
+
+    g_signal_connect(
+      G_OBJECT(xmpp),
+      "notify::status",
+      G_CALLBACK(inf_test_broadcast_notify_status_cb),
+      &test
+    );
+
+    if(inf_tcp_connection_open(tcp, &error) == FALSE)
+    {
+      fprintf(stderr, "Could not connect: %s\n", error->message);
+      g_error_free(error);
+      return EXIT_FAILURE;
+    }
+
+    test.client_connections = g_slist_prepend(test.client_connections, xmpp);
+    g_object_unref(tcp);
+  }
+
+  /* Both the client and the server side of each connection need to be
+   * established. */
+  while(test.n_open < 2 * max_subscribers)
+    inf_standalone_io_iteration(test.io);
+
+  manager = inf_communication_manager_new();
+
+  printf("subscribers  broadcast (us/msg)  individual (us/msg)  speedup\n");
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_BROADCAST_SUBSCRIBERS); ++i)
+  {
+    broadcast_time = inf_test_broadcast_run(
+      &test,
+      manager,
+      INF_TEST_BROADCAST_SUBSCRIBERS[i],
+      n_messages,
+      TRUE
+    );
+
+    single_time = inf_test_broadcast_run(
+      &test,
+      manager,
+      INF_TEST_BROADCAST_SUBSCRIBERS[i],
+      n_messages,
+      FALSE
+    );
+
+    printf(
+      "%11u  %18.2f  %19.2f  %6.2fx\n",
+      INF_TEST_BROADCAST_SUBSCRIBERS[i],
+      broadcast_time,
+      single_time,
+      single_time / broadcast_time
+    );
+  }
+
+  g_object_unref(manager);
+
+  while(test.client_connections != NULL)
+  {
+    inf_xml_connection_close(INF_XML_CONNECTION(test.client_connections->data));
+    g_object_unref(test.client_connections->data);
+
+    test.client_connections = g_slist_delete_link(
+      test.client_connections,
+      test.client_connections
+    );
+  }
+
+  while(test.server_connections != NULL)
+  {
+    g_object_unref(test.server_connections->data);
+
+    test.server_connections = g_slist_delete_link(
+      test.server_connections,
+      test.server_connections
+    );
+  }
+
+  g_object_unref(xmpp_server);
+  infd_tcp_server_close(server);
+  g_object_unref(server);
+  inf_ip_address_free(addr);
+  g_object_unref(test.io);
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,171 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures how the time of insert, erase and substring operations on an
+ * InfTextChunk scales with the number of segments, and how the time of
+ * insert and erase operations scales with the size of a single segment.
+ * This is a benchmark and not run as part of the test suite. */
+
+#include <libinftext/inf-text-chunk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const guint INF_TEST_CHUNK_BENCHMARK_SEGMENTS[] = {
+  100, 1000, 10000, 100000
+};
+
+static const guint INF_TEST_CHUNK_BENCHMARK_CHARS[] = {
+  1000, 10000, 100000, 1000000
+};
+
+#define INF_TEST_CHUNK_BENCHMARK_OPERATIONS 10000
+
+/* Creates a chunk with n_segments one-character segments, written
+ * alternately by two different authors. */
+static InfTextChunk*
+inf_test_chunk_benchmark_create(guint n_segments)
+{
+  InfTextChunk* chunk;
+  guint i;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  for(i = 0; i < n_segments; ++i)
+    inf_text_chunk_insert_text(chunk, i, "a", 1, 1, 1 + i % 2);
+
+  return chunk;
+}
+
+/* Measures the time it takes to insert a character at a random position,
+ * splitting a segment, and to erase it again, so that the segments are
+ * merged again. Returns the time per operation in microseconds. */
+static double
+inf_test_chunk_benchmark_segments(guint n_segments)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* substring;
+  GTimer* timer;
+  guint pos;
+  guint i;
+  double elapsed;
+
+  chunk = inf_test_chunk_benchmark_create(n_segments);
+  timer = g_timer_new();
+
+  for(i = 0; i < INF_TEST_CHUNK_BENCHMARK_OPERATIONS; ++i)
+  {
+    pos = rand() % n_segments;
+
+    inf_text_chunk_insert_text(chunk, pos, "x", 1, 1, 3);
+    inf_text_chunk_erase(chunk, pos, 1);
+
+    substring = inf_text_chunk_substring(chunk, pos, MIN(n_segments - pos, 4));
+    inf_text_chunk_free(substring);
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  g_assert(inf_text_chunk_get_length(chunk) == n_segments);
+  inf_text_chunk_free(chunk);
+
+  return elapsed * 1e6 / INF_TEST_CHUNK_BENCHMARK_OPERATIONS;
+}
+
+/* Measures the time it takes to insert a character at a random position
+ * within a single segment of n_chars characters, most of which take more
+ * than one byte in UTF-8, and to erase it again. Returns the time per
+ * operation in microseconds. */
+static double
+inf_test_chunk_benchmark_segment(guint n_chars)
+{
+  static const gchar PATTERN[] = "a\xc3\xbc\xe2\x82\xac"; /* aü€ */
+
+  InfTextChunk* chunk;
+  GString* text;
+  gchar* result;
+  gsize bytes;
+  GTimer* timer;
+  guint pos;
+  guint i;
+  double elapsed;
+
+  text = g_string_sized_new(n_chars * 2);
+  for(i = 0; i < n_chars / 3; ++i)
+    g_string_append(text, PATTERN);
+  n_chars = i * 3;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_insert_text(chunk, 0, text->str, text->len, n_chars, 1);
+  timer = g_timer_new();
+
+  for(i = 0; i < INF_TEST_CHUNK_BENCHMARK_OPERATIONS; ++i)
+  {
+    pos = rand() % n_chars;
+
+    inf_text_chunk_insert_text(chunk, pos, "\xc3\xbc", 2, 1, 1);
+    inf_text_chunk_erase(chunk, pos, 1);
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  result = inf_text_chunk_get_text(chunk, &bytes);
+  g_assert(bytes == text->len && memcmp(result, text->str, bytes) == 0);
+  g_free(result);
+
+  g_string_free(text, TRUE);
+  inf_text_chunk_free(chunk);
+
+  return elapsed * 1e6 / INF_TEST_CHUNK_BENCHMARK_OPERATIONS;
+}
+
+int main()
+{
+  guint i;
+
+  /* The time per operation should grow only logarithmically with the
+   * number of segments. */
+  printf("segments  insert+erase+substring (us/op)\n");
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_CHUNK_BENCHMARK_SEGMENTS); ++i)
+  {
+    printf(
+      "%8u  %30.3f\n",
+      INF_TEST_CHUNK_BENCHMARK_SEGMENTS[i],
+      inf_test_chunk_benchmark_segments(INF_TEST_CHUNK_BENCHMARK_SEGMENTS[i])
+    );
+  }
+
+  /* Finding a position within a segment should not need to scan the
+   * segment from its beginning. */
+  printf("characters  insert+erase within a segment (us/op)\n");
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_CHUNK_BENCHMARK_CHARS); ++i)
+  {
+    printf(
+      "%10u  %33.3f\n",
+      INF_TEST_CHUNK_BENCHMARK_CHARS[i],
+      inf_test_chunk_benchmark_segment(INF_TEST_CHUNK_BENCHMARK_CHARS[i])
+    );
+  }
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
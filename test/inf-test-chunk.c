@@ -19,6 +19,85 @@
 
 #include <libinftext/inf-text-chunk.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Inserts and erases characters at random positions of a chunk with many
+ * segments, so that segments are split and merged again, and verifies that
+ * the text is unchanged afterwards. */
+static void
+inf_test_chunk_segments(void)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* substring;
+  gchar* text;
+  gsize bytes;
+  guint pos;
+  guint i;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  for(i = 0; i < 1000; ++i)
+    inf_text_chunk_insert_text(chunk, i, "a", 1, 1, 1 + i % 2);
+
+  for(i = 0; i < 1000; ++i)
+  {
+    pos = rand() % 1000;
+
+    inf_text_chunk_insert_text(chunk, pos, "x", 1, 1, 3);
+    inf_text_chunk_erase(chunk, pos, 1);
+
+    substring = inf_text_chunk_substring(chunk, pos, MIN(1000 - pos, 4));
+    g_assert(inf_text_chunk_get_length(substring) == MIN(1000 - pos, 4));
+    inf_text_chunk_free(substring);
+  }
+
+  g_assert(inf_text_chunk_get_length(chunk) == 1000);
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  g_assert(bytes == 1000);
+  for(i = 0; i < 1000; ++i)
+    g_assert(text[i] == 'a');
+  g_free(text);
+
+  inf_text_chunk_free(chunk);
+}
+
+/* Verifies that a copy of a chunk, which shares the segment text with the
+ * original, is not affected by later modifications of the original. */
+static void
+inf_test_chunk_snapshot(void)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* snapshot;
+  InfTextChunk* expected;
+  gchar* text;
+  gsize bytes;
+
+  chunk = inf_text_chunk_new("UTF-8");
+  inf_text_chunk_insert_text(chunk, 0, "hello", 5, 5, 1);
+  inf_text_chunk_insert_text(chunk, 5, "world", 5, 5, 2);
+
+  snapshot = inf_text_chunk_copy(chunk);
+  expected = inf_text_chunk_copy(chunk);
+
+  /* Extends the segments in place if their text is not shared */
+  inf_text_chunk_insert_text(chunk, 5, "!!", 2, 2, 1);
+  inf_text_chunk_insert_text(chunk, 2, "xy", 2, 2, 2);
+  inf_text_chunk_insert_text(chunk, 0, "__", 2, 2, 2);
+  inf_text_chunk_erase(chunk, 3, 4);
+
+  g_assert(inf_text_chunk_equal(snapshot, expected));
+
+  text = inf_text_chunk_get_text(snapshot, &bytes);
+  g_assert(bytes == 10 && memcmp(text, "helloworld", 10) == 0);
+  g_free(text);
+
+  inf_text_chunk_free(chunk);
+  inf_text_chunk_free(expected);
+  inf_text_chunk_free(snapshot);
+}
+
 int main()
 {
   InfTextChunk* chunk;
@@ -35,5 +114,7 @@ int main()
   inf_text_chunk_free(chunk);
   inf_text_chunk_free(chunk2);
 
+  inf_test_chunk_segments();
+  inf_test_chunk_snapshot();
   return 0;
 }
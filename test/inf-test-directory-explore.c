@@ -0,0 +1,392 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Explores a directory with many notes in a temporary filesystem storage
+ * with InfdDirectory. It verifies that all nodes show up and that the ACLs
+ * of the nodes, which are only read when they are needed, are applied. A
+ * node with a corrupt ACL must not be accessible. It prints the time the
+ * exploration took and the longest time a timeout was delayed meanwhile,
+ * which is how long the main loop was blocked at most. */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+typedef struct _InfTestDirectoryExplore InfTestDirectoryExplore;
+struct _InfTestDirectoryExplore {
+  InfStandaloneIo* io;
+  InfIoTimeout* timeout;
+  gint64 timeout_due;
+  gint64 max_delay;
+
+  gboolean finished;
+  gboolean failed;
+};
+
+/* Interval of the timeout measuring main loop latency, in milliseconds */
+#define INF_TEST_DIRECTORY_EXPLORE_INTERVAL 1
+
+static void
+inf_test_directory_explore_timeout_func(gpointer user_data)
+{
+  InfTestDirectoryExplore* test;
+  gint64 now;
+
+  test = (InfTestDirectoryExplore*)user_data;
+  now = g_get_monotonic_time();
+
+  if(now - test->timeout_due > test->max_delay)
+    test->max_delay = now - test->timeout_due;
+
+  test->timeout_due = now + INF_TEST_DIRECTORY_EXPLORE_INTERVAL * 1000;
+  test->timeout = inf_io_add_timeout(
+    INF_IO(test->io),
+    INF_TEST_DIRECTORY_EXPLORE_INTERVAL,
+    inf_test_directory_explore_timeout_func,
+    test,
+    NULL
+  );
+}
+
+static void
+inf_test_directory_explore_finished_cb(InfRequest* request,
+                                       const InfRequestResult* result,
+                                       const GError* error,
+                                       gpointer user_data)
+{
+  InfTestDirectoryExplore* test;
+  test = (InfTestDirectoryExplore*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Exploration failed: %s\n", error->message);
+    test->failed = TRUE;
+  }
+
+  test->finished = TRUE;
+}
+
+/* Creates n_notes notes, a subdirectory and a few ACLs in root */
+static gboolean
+inf_test_directory_explore_fill(InfdStorage* storage,
+                                const gchar* root,
+                                guint n_notes,
+                                GError** error)
+{
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* sheet;
+  gchar* name;
+  gchar* path;
+  gboolean result;
+  guint i;
+
+  for(i = 0; i < n_notes; ++i)
+  {
+    name = g_strdup_printf("note-%05u.InfTest", i);
+    path = g_build_filename(root, name, NULL);
+    g_free(name);
+
+    result = g_file_set_contents(path, "", 0, error);
+    g_free(path);
+
+    if(result == FALSE)
+      return FALSE;
+  }
+
+  path = g_build_filename(root, "subdirectory", NULL);
+  if(g_mkdir(path, 0700) != 0)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    g_free(path);
+    return FALSE;
+  }
+
+  g_free(path);
+
+  /* note-00007 may not be subscribed to by the default account */
+  sheet_set = inf_acl_sheet_set_new();
+  sheet = inf_acl_sheet_set_add_sheet(
+    sheet_set,
+    inf_acl_account_id_from_string("default")
+  );
+
+  inf_acl_mask_set1(&sheet->mask, INF_ACL_CAN_SUBSCRIBE_SESSION);
+  result = infd_storage_write_acl(storage, "/note-00007", sheet_set, error);
+  inf_acl_sheet_set_free(sheet_set);
+
+  if(result == FALSE)
+    return FALSE;
+
+  /* The ACL of note-00008 cannot be read */
+  path = g_build_filename(root, "note-00008.xml.acl", NULL);
+  result = g_file_set_contents(path, "<inf-acl><sheet", -1, error);
+  g_free(path);
+
+  return result;
+}
+
+static gboolean
+inf_test_directory_explore_find(InfBrowser* browser,
+                                InfBrowserIter* iter,
+                                const gchar* name)
+{
+  gboolean result;
+
+  inf_browser_get_root(browser, iter);
+  result = inf_browser_get_child(browser, iter);
+
+  while(result == TRUE)
+  {
+    if(strcmp(inf_browser_get_node_name(browser, iter), name) == 0)
+      return TRUE;
+    result = inf_browser_get_next(browser, iter);
+  }
+
+  return FALSE;
+}
+
+/* Checks whether the default account can subscribe to the given node */
+static gboolean
+inf_test_directory_explore_check(InfBrowser* browser,
+                                 const gchar* name,
+                                 gboolean expected)
+{
+  InfBrowserIter iter;
+  InfAclMask mask;
+  gboolean result;
+
+  if(!inf_test_directory_explore_find(browser, &iter, name))
+  {
+    fprintf(stderr, "Node \"%s\" not found\n", name);
+    return FALSE;
+  }
+
+  inf_acl_mask_set1(&mask, INF_ACL_CAN_SUBSCRIBE_SESSION);
+
+  result = inf_browser_check_acl(
+    browser,
+    &iter,
+    inf_acl_account_id_from_string("default"),
+    &mask,
+    NULL
+  );
+
+  if(result != expected)
+  {
+    fprintf(
+      stderr,
+      "Default account %s subscribe to \"%s\", but it %s\n",
+      result ? "can" : "cannot",
+      name,
+      expected ? "should" : "should not"
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_directory_explore_run(InfTestDirectoryExplore* test,
+                               InfdDirectory* directory,
+                               guint n_notes)
+{
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  InfRequest* request;
+  gint64 start;
+  gint64 elapsed;
+  guint count;
+  gboolean result;
+
+  browser = INF_BROWSER(directory);
+  inf_browser_get_root(browser, &iter);
+
+  test->finished = FALSE;
+  test->failed = FALSE;
+  test->max_delay = 0;
+
+  start = g_get_monotonic_time();
+  test->timeout_due = start + INF_TEST_DIRECTORY_EXPLORE_INTERVAL * 1000;
+  test->timeout = inf_io_add_timeout(
+    INF_IO(test->io),
+    INF_TEST_DIRECTORY_EXPLORE_INTERVAL,
+    inf_test_directory_explore_timeout_func,
+    test,
+    NULL
+  );
+
+  request = inf_browser_explore(
+    browser,
+    &iter,
+    inf_test_directory_explore_finished_cb,
+    test
+  );
+
+  if(request == NULL || test->finished)
+  {
+    fprintf(stderr, "Exploration did not happen in the background\n");
+    inf_io_remove_timeout(INF_IO(test->io), test->timeout);
+    return FALSE;
+  }
+
+  while(!test->finished)
+    inf_standalone_io_iteration(test->io);
+
+  elapsed = g_get_monotonic_time() - start;
+  inf_io_remove_timeout(INF_IO(test->io), test->timeout);
+
+  if(test->failed)
+    return FALSE;
+
+  count = 0;
+  result = inf_browser_get_child(browser, &iter);
+  while(result == TRUE)
+  {
+    ++count;
+    result = inf_browser_get_next(browser, &iter);
+  }
+
+  printf(
+    "Explored %u nodes in %.1f ms, main loop blocked for at most %.1f ms\n",
+    count,
+    (double)elapsed / 1e3,
+    (double)test->max_delay / 1e3
+  );
+
+  if(count != n_notes + 1)
+  {
+    fprintf(stderr, "Expected %u nodes\n", n_notes + 1);
+    return FALSE;
+  }
+
+  if(!inf_test_directory_explore_check(browser, "note-00006", TRUE))
+    return FALSE;
+  if(!inf_test_directory_explore_check(browser, "note-00007", FALSE))
+    return FALSE;
+
+  printf("Checking a corrupt ACL, a warning is expected\n");
+  if(!inf_test_directory_explore_check(browser, "note-00008", FALSE))
+    return FALSE;
+
+  return TRUE;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestDirectoryExplore test;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  gchar* root;
+  guint n_notes;
+  gboolean result;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  n_notes = 20000;
+  if(argc > 1)
+    n_notes = atoi(argv[1]);
+  if(n_notes < 10)
+    n_notes = 10;
+
+  root = g_dir_make_tmp("inf-test-directory-explore-XXXXXX", &error);
+  if(root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  storage = infd_filesystem_storage_new(root);
+
+  result = inf_test_directory_explore_fill(
+    INFD_STORAGE(storage),
+    root,
+    n_notes,
+    &error
+  );
+
+  if(result == TRUE)
+  {
+    test.io = inf_standalone_io_new();
+    manager = inf_communication_manager_new();
+
+    directory = infd_directory_new(
+      INF_IO(test.io),
+      INFD_STORAGE(storage),
+      manager
+    );
+
+    result = inf_test_directory_explore_run(&test, directory, n_notes);
+
+    g_object_unref(directory);
+    g_object_unref(manager);
+    g_object_unref(test.io);
+  }
+  else
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_object_unref(storage);
+
+  if(!inf_file_util_delete_directory(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    result = FALSE;
+  }
+
+  g_free(root);
+  inf_deinit();
+
+  if(!result)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
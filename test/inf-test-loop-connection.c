@@ -0,0 +1,491 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Verifies that InfdLoopConnection forwards messages to a base connection
+ * running in a loop of an InfdLoopPool, and that the events of the base
+ * connection are handed over to the main loop in the order in which they
+ * happened. A simulated connection in the loop echoes every message it
+ * receives. Functions run with infd_loop_connection_invoke() need to run in
+ * the loop after everything sent before, and a connection closed in the
+ * loop needs to be reported as closed in the main loop. The base connection
+ * needs to be released when the InfdLoopConnection is disposed, also while
+ * events for it are still queued. */
+
+#include <libinfinity/server/infd-loop-connection.h>
+#include <libinfinity/server/infd-loop-pool.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INF_TEST_LOOP_CONNECTION_N_LOOPS 2
+#define INF_TEST_LOOP_CONNECTION_N_MESSAGES 5000
+#define INF_TEST_LOOP_CONNECTION_TIMEOUT (10 * G_TIME_SPAN_SECOND)
+
+typedef struct _InfTestLoopConnection InfTestLoopConnection;
+struct _InfTestLoopConnection {
+  InfStandaloneIo* io;
+  InfdLoopPool* pool;
+  InfIo* loop;
+  GThread* main_thread;
+
+  /* Only accessed in the loop, or while the pool is paused */
+  InfSimulatedConnection* base;
+  InfSimulatedConnection* peer;
+  GThread* loop_thread;
+  guint n_echoed;
+  guint n_invoked;
+  gboolean loop_failed;
+
+  /* Only accessed in the main loop */
+  InfdLoopConnection* connection;
+  guint n_sent;
+  guint n_received;
+  gboolean main_failed;
+};
+
+static void
+inf_test_loop_connection_check_loop_thread(InfTestLoopConnection* test)
+{
+  if(test->loop_thread == NULL)
+    test->loop_thread = g_thread_self();
+  if(test->loop_thread != g_thread_self() ||
+     test->loop_thread == test->main_thread)
+  {
+    test->loop_failed = TRUE;
+  }
+}
+
+static guint
+inf_test_loop_connection_get_seq(xmlNodePtr xml)
+{
+  guint seq;
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "seq", &seq, NULL))
+    return G_MAXUINT;
+  return seq;
+}
+
+/* Runs in the loop */
+static void
+inf_test_loop_connection_peer_received_cb(InfXmlConnection* peer,
+                                          xmlNodePtr xml,
+                                          gpointer user_data)
+{
+  InfTestLoopConnection* test;
+  xmlNodePtr echo;
+
+  test = (InfTestLoopConnection*)user_data;
+  inf_test_loop_connection_check_loop_thread(test);
+
+  if(inf_test_loop_connection_get_seq(xml) != test->n_echoed)
+    test->loop_failed = TRUE;
+
+  echo = xmlNewNode(NULL, (const xmlChar*)"echo");
+  inf_xml_util_set_attribute_uint(echo, "seq", test->n_echoed);
+  ++test->n_echoed;
+
+  inf_xml_connection_send(peer, echo);
+}
+
+/* Runs in the loop */
+static void
+inf_test_loop_connection_check_func(InfXmlConnection* base,
+                                    gpointer user_data)
+{
+  InfTestLoopConnection* test;
+  test = (InfTestLoopConnection*)user_data;
+
+  inf_test_loop_connection_check_loop_thread(test);
+
+  /* Everything sent before has been performed already */
+  if(base != INF_XML_CONNECTION(test->base))
+    test->loop_failed = TRUE;
+  if(test->n_echoed != INF_TEST_LOOP_CONNECTION_N_MESSAGES)
+    test->loop_failed = TRUE;
+
+  ++test->n_invoked;
+}
+
+/* Runs in the loop */
+static void
+inf_test_loop_connection_close_func(InfXmlConnection* base,
+                                    gpointer user_data)
+{
+  InfTestLoopConnection* test;
+  test = (InfTestLoopConnection*)user_data;
+
+  inf_test_loop_connection_check_loop_thread(test);
+  inf_xml_connection_close(base);
+
+  ++test->n_invoked;
+}
+
+static void
+inf_test_loop_connection_sent_cb(InfXmlConnection* connection,
+                                 xmlNodePtr xml,
+                                 gpointer user_data)
+{
+  InfTestLoopConnection* test;
+  test = (InfTestLoopConnection*)user_data;
+
+  if(g_thread_self() != test->main_thread)
+    test->main_failed = TRUE;
+  if(inf_test_loop_connection_get_seq(xml) != test->n_sent)
+    test->main_failed = TRUE;
+
+  ++test->n_sent;
+}
+
+static void
+inf_test_loop_connection_received_cb(InfXmlConnection* connection,
+                                     xmlNodePtr xml,
+                                     gpointer user_data)
+{
+  InfTestLoopConnection* test;
+  test = (InfTestLoopConnection*)user_data;
+
+  if(g_thread_self() != test->main_thread)
+    test->main_failed = TRUE;
+  if(inf_test_loop_connection_get_seq(xml) != test->n_received)
+    test->main_failed = TRUE;
+
+  /* The echo of a message is received only after it has been sent */
+  if(test->n_received >= test->n_sent)
+    test->main_failed = TRUE;
+
+  ++test->n_received;
+}
+
+static void
+inf_test_loop_connection_setup(InfTestLoopConnection* test)
+{
+  test->loop = infd_loop_pool_choose_loop(test->pool);
+
+  /* Both simulated connections are only used in the loop from now on, so
+   * they deliver messages immediately within that loop. */
+  test->base = inf_simulated_connection_new_with_io(test->loop);
+  test->peer = inf_simulated_connection_new_with_io(test->loop);
+  inf_simulated_connection_connect(test->base, test->peer);
+
+  g_object_add_weak_pointer(G_OBJECT(test->base), (gpointer*)&test->base);
+
+  g_signal_connect(
+    G_OBJECT(test->peer),
+    "received",
+    G_CALLBACK(inf_test_loop_connection_peer_received_cb),
+    test
+  );
+
+  test->loop_thread = NULL;
+  test->n_echoed = 0;
+  test->n_invoked = 0;
+  test->loop_failed = FALSE;
+
+  infd_loop_pool_assign(test->pool, test->loop, G_OBJECT(test->base));
+
+  test->connection = infd_loop_connection_new(
+    INF_IO(test->io),
+    test->pool,
+    test->loop,
+    INF_XML_CONNECTION(test->base)
+  );
+
+  g_object_unref(test->base);
+
+  g_signal_connect(
+    G_OBJECT(test->connection),
+    "sent",
+    G_CALLBACK(inf_test_loop_connection_sent_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->connection),
+    "received",
+    G_CALLBACK(inf_test_loop_connection_received_cb),
+    test
+  );
+
+  test->n_sent = 0;
+  test->n_received = 0;
+  test->main_failed = FALSE;
+}
+
+static void
+inf_test_loop_connection_send(InfTestLoopConnection* test)
+{
+  xmlBufferPtr buffer;
+  xmlNodePtr xml;
+  GBytes* serialized;
+  guint i;
+
+  buffer = xmlBufferCreate();
+
+  /* Send every other message in serialized form, which is what the
+   * communication registry does for connections that support it. */
+  for(i = 0; i < INF_TEST_LOOP_CONNECTION_N_MESSAGES; ++i)
+  {
+    xml = xmlNewNode(NULL, (const xmlChar*)"message");
+    inf_xml_util_set_attribute_uint(xml, "seq", i);
+
+    if(i % 2 == 0)
+    {
+      inf_xml_connection_send(INF_XML_CONNECTION(test->connection), xml);
+    }
+    else
+    {
+      xmlBufferEmpty(buffer);
+      xmlNodeDump(buffer, NULL, xml, 0, 0);
+
+      serialized =
+        g_bytes_new(xmlBufferContent(buffer), xmlBufferLength(buffer));
+
+      inf_xml_connection_send_serialized(
+        INF_XML_CONNECTION(test->connection),
+        xml,
+        serialized,
+        NULL
+      );
+
+      g_bytes_unref(serialized);
+    }
+  }
+
+  xmlBufferFree(buffer);
+}
+
+static gboolean
+inf_test_loop_connection_wait_closed(InfTestLoopConnection* test)
+{
+  InfXmlConnectionStatus status;
+  gint64 deadline;
+
+  deadline = g_get_monotonic_time() + INF_TEST_LOOP_CONNECTION_TIMEOUT;
+
+  for(;;)
+  {
+    g_object_get(G_OBJECT(test->connection), "status", &status, NULL);
+    if(status == INF_XML_CONNECTION_CLOSED)
+      return TRUE;
+
+    if(g_get_monotonic_time() >= deadline)
+      return FALSE;
+
+    inf_standalone_io_iteration_timeout(test->io, 100);
+  }
+}
+
+/* Pauses the pool to access the objects used in the loop */
+static gboolean
+inf_test_loop_connection_check_released(InfTestLoopConnection* test,
+                                        guint n_invoked)
+{
+  InfXmlConnectionStatus status;
+  gboolean result;
+
+  result = TRUE;
+  infd_loop_pool_pause(test->pool);
+
+  g_object_get(G_OBJECT(test->peer), "status", &status, NULL);
+
+  if(test->loop_failed)
+  {
+    fprintf(stderr, "Loop ran callbacks out of order or in wrong thread\n");
+    result = FALSE;
+  }
+  else if(test->n_echoed != INF_TEST_LOOP_CONNECTION_N_MESSAGES)
+  {
+    fprintf(
+      stderr,
+      "Peer received %u of %u messages\n",
+      test->n_echoed,
+      INF_TEST_LOOP_CONNECTION_N_MESSAGES
+    );
+
+    result = FALSE;
+  }
+  else if(test->n_invoked != n_invoked)
+  {
+    fprintf(
+      stderr,
+      "%u of %u invoked functions have run\n",
+      test->n_invoked,
+      n_invoked
+    );
+
+    result = FALSE;
+  }
+  else if(test->base != NULL)
+  {
+    fprintf(stderr, "Base connection has not been released\n");
+    result = FALSE;
+  }
+  else if(status != INF_XML_CONNECTION_CLOSED)
+  {
+    fprintf(stderr, "Base connection has not been closed\n");
+    result = FALSE;
+  }
+
+  g_object_unref(test->peer);
+  test->peer = NULL;
+
+  infd_loop_pool_resume(test->pool);
+  return result;
+}
+
+static gboolean
+inf_test_loop_connection_echo(InfTestLoopConnection* test)
+{
+  InfXmlConnectionStatus status;
+  gboolean result;
+
+  inf_test_loop_connection_setup(test);
+
+  g_object_get(G_OBJECT(test->connection), "status", &status, NULL);
+  if(status != INF_XML_CONNECTION_OPEN)
+  {
+    fprintf(stderr, "Loop connection is not open initially\n");
+    g_object_unref(test->connection);
+    inf_test_loop_connection_check_released(test, 0);
+    return FALSE;
+  }
+
+  inf_test_loop_connection_send(test);
+
+  infd_loop_connection_invoke(
+    test->connection,
+    inf_test_loop_connection_check_func,
+    test,
+    NULL
+  );
+
+  infd_loop_connection_invoke(
+    test->connection,
+    inf_test_loop_connection_close_func,
+    test,
+    NULL
+  );
+
+  /* All echoes need to arrive before the connection is reported as closed,
+   * since they happened before in the loop. */
+  result = TRUE;
+  if(!inf_test_loop_connection_wait_closed(test))
+  {
+    fprintf(stderr, "Closing the base connection was not reported\n");
+    result = FALSE;
+  }
+  else if(test->main_failed)
+  {
+    fprintf(stderr, "Main loop got events out of order or in wrong thread\n");
+    result = FALSE;
+  }
+  else if(test->n_sent != INF_TEST_LOOP_CONNECTION_N_MESSAGES ||
+          test->n_received != INF_TEST_LOOP_CONNECTION_N_MESSAGES)
+  {
+    fprintf(
+      stderr,
+      "Got %u sent and %u received of %u messages before closing\n",
+      test->n_sent,
+      test->n_received,
+      INF_TEST_LOOP_CONNECTION_N_MESSAGES
+    );
+
+    result = FALSE;
+  }
+
+  g_object_unref(test->connection);
+  test->connection = NULL;
+
+  if(!inf_test_loop_connection_check_released(test, 2))
+    result = FALSE;
+
+  return result;
+}
+
+static gboolean
+inf_test_loop_connection_dispose(InfTestLoopConnection* test)
+{
+  gboolean result;
+  guint i;
+
+  inf_test_loop_connection_setup(test);
+
+  /* Drop the connection while the events of the loop are still on their
+   * way to the main loop. */
+  inf_test_loop_connection_send(test);
+  g_object_unref(test->connection);
+  test->connection = NULL;
+
+  result = inf_test_loop_connection_check_released(test, 0);
+
+  /* The queued events need to be dropped without reaching anyone */
+  for(i = 0; i < 10; ++i)
+    inf_standalone_io_iteration_timeout(test->io, 10);
+
+  if(test->n_sent != 0 || test->n_received != 0)
+  {
+    fprintf(stderr, "Events were reported after dispose\n");
+    result = FALSE;
+  }
+
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestLoopConnection test;
+  GError* error;
+  gboolean result;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.pool = infd_loop_pool_new(INF_TEST_LOOP_CONNECTION_N_LOOPS);
+  test.main_thread = g_thread_self();
+
+  result = TRUE;
+  if(!inf_test_loop_connection_echo(&test))
+    result = FALSE;
+  else if(!inf_test_loop_connection_dispose(&test))
+    result = FALSE;
+
+  g_object_unref(test.pool);
+  g_object_unref(test.io);
+
+  inf_deinit();
+
+  if(result == FALSE)
+    return EXIT_FAILURE;
+
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
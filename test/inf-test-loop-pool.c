@@ -0,0 +1,333 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Verifies that InfdLoopPool spreads objects evenly over its loops, that
+ * functions invoked for a loop run in that loop's thread and in order, that
+ * pausing the pool waits for everything invoked before, that scheduled
+ * functions have all run before their notify functions are called in the
+ * main thread, and that the data of every invocation is freed, even if the
+ * pool goes away first. */
+
+#include <libinfinity/server/infd-loop-pool.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INF_TEST_LOOP_POOL_N_LOOPS 4
+#define INF_TEST_LOOP_POOL_N_INVOCATIONS 10000
+#define INF_TEST_LOOP_POOL_N_SCHEDULED 100
+
+typedef struct _InfTestLoopPoolLoop InfTestLoopPoolLoop;
+struct _InfTestLoopPoolLoop {
+  InfIo* io;
+  GThread* thread;
+  guint n_run;
+  gboolean failed;
+};
+
+typedef struct _InfTestLoopPoolInvocation InfTestLoopPoolInvocation;
+struct _InfTestLoopPoolInvocation {
+  InfTestLoopPoolLoop* loop;
+  guint index;
+  gint* n_freed;
+};
+
+static void
+inf_test_loop_pool_invocation_func(gpointer user_data)
+{
+  InfTestLoopPoolInvocation* invocation;
+  InfTestLoopPoolLoop* loop;
+
+  invocation = (InfTestLoopPoolInvocation*)user_data;
+  loop = invocation->loop;
+
+  /* All functions for a loop need to run in the same thread, which is not
+   * the main thread, and in the order in which they were invoked. */
+  if(loop->thread == NULL)
+    loop->thread = g_thread_self();
+  if(loop->thread != g_thread_self())
+    loop->failed = TRUE;
+  if(invocation->index != loop->n_run)
+    loop->failed = TRUE;
+
+  ++loop->n_run;
+}
+
+static void
+inf_test_loop_pool_invocation_free(gpointer user_data)
+{
+  InfTestLoopPoolInvocation* invocation;
+  invocation = (InfTestLoopPoolInvocation*)user_data;
+
+  g_atomic_int_inc(invocation->n_freed);
+  g_slice_free(InfTestLoopPoolInvocation, invocation);
+}
+
+static void
+inf_test_loop_pool_scheduled_free(gpointer user_data)
+{
+  InfTestLoopPoolInvocation* invocation;
+  InfTestLoopPoolLoop* loop;
+
+  invocation = (InfTestLoopPoolInvocation*)user_data;
+  loop = invocation->loop;
+
+  if(loop->thread == g_thread_self())
+    loop->failed = TRUE;
+  if(loop->n_run !=
+     INF_TEST_LOOP_POOL_N_INVOCATIONS + INF_TEST_LOOP_POOL_N_SCHEDULED)
+  {
+    loop->failed = TRUE;
+  }
+
+  inf_test_loop_pool_invocation_free(invocation);
+}
+
+static gboolean
+inf_test_loop_pool_run_scheduled(InfdLoopPool* pool,
+                                 InfTestLoopPoolLoop* loops,
+                                 gint* n_freed)
+{
+  InfTestLoopPoolInvocation* invocation;
+  gboolean result;
+  guint i;
+  guint j;
+
+  for(i = 0; i < INF_TEST_LOOP_POOL_N_SCHEDULED; ++i)
+  {
+    for(j = 0; j < INF_TEST_LOOP_POOL_N_LOOPS; ++j)
+    {
+      invocation = g_slice_new(InfTestLoopPoolInvocation);
+      invocation->loop = &loops[j];
+      invocation->index = INF_TEST_LOOP_POOL_N_INVOCATIONS + i;
+      invocation->n_freed = n_freed;
+
+      infd_loop_pool_schedule(
+        pool,
+        loops[j].io,
+        inf_test_loop_pool_invocation_func,
+        invocation,
+        inf_test_loop_pool_scheduled_free
+      );
+    }
+  }
+
+  /* Nothing runs before it is asked to */
+  for(j = 0; j < INF_TEST_LOOP_POOL_N_LOOPS; ++j)
+    if(loops[j].n_run != INF_TEST_LOOP_POOL_N_INVOCATIONS)
+      loops[j].failed = TRUE;
+
+  infd_loop_pool_run_scheduled(pool);
+
+  result = TRUE;
+  for(j = 0; j < INF_TEST_LOOP_POOL_N_LOOPS; ++j)
+  {
+    if(loops[j].failed)
+    {
+      fprintf(stderr, "Loop %u ran scheduled functions wrongly\n", j);
+      result = FALSE;
+    }
+  }
+
+  return result;
+}
+
+static void
+inf_test_loop_pool_invoke(InfdLoopPool* pool,
+                          InfTestLoopPoolLoop* loops,
+                          guint n_invocations,
+                          gint* n_freed)
+{
+  InfTestLoopPoolInvocation* invocation;
+  guint i;
+  guint j;
+
+  for(i = 0; i < n_invocations; ++i)
+  {
+    for(j = 0; j < INF_TEST_LOOP_POOL_N_LOOPS; ++j)
+    {
+      invocation = g_slice_new(InfTestLoopPoolInvocation);
+      invocation->loop = &loops[j];
+      invocation->index = i;
+      invocation->n_freed = n_freed;
+
+      infd_loop_pool_invoke(
+        pool,
+        loops[j].io,
+        inf_test_loop_pool_invocation_func,
+        invocation,
+        inf_test_loop_pool_invocation_free
+      );
+    }
+  }
+}
+
+static gboolean
+inf_test_loop_pool_assign(InfdLoopPool* pool,
+                          InfTestLoopPoolLoop* loops,
+                          GObject** objects)
+{
+  InfIo* io;
+  guint i;
+  guint j;
+
+  /* Each new object should go to a loop that has no object yet */
+  for(i = 0; i < INF_TEST_LOOP_POOL_N_LOOPS; ++i)
+  {
+    io = infd_loop_pool_choose_loop(pool);
+    for(j = 0; j < i; ++j)
+    {
+      if(loops[j].io == io)
+      {
+        fprintf(stderr, "Loop %u was chosen twice\n", j);
+        return FALSE;
+      }
+    }
+
+    loops[i].io = io;
+    loops[i].thread = NULL;
+    loops[i].n_run = 0;
+    loops[i].failed = FALSE;
+
+    objects[i] = g_object_new(G_TYPE_OBJECT, NULL);
+    infd_loop_pool_assign(pool, io, objects[i]);
+  }
+
+  /* Once an object is gone, its loop should be the least busy one */
+  g_object_unref(objects[2]);
+  objects[2] = NULL;
+
+  if(infd_loop_pool_choose_loop(pool) != loops[2].io)
+  {
+    fprintf(stderr, "Loop of finalized object was not chosen\n");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestLoopPoolLoop loops[INF_TEST_LOOP_POOL_N_LOOPS];
+  GObject* objects[INF_TEST_LOOP_POOL_N_LOOPS];
+  InfdLoopPool* pool;
+  GError* error;
+  gint n_freed;
+  gboolean result;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  result = TRUE;
+  n_freed = 0;
+  for(i = 0; i < INF_TEST_LOOP_POOL_N_LOOPS; ++i)
+    objects[i] = NULL;
+
+  pool = infd_loop_pool_new(INF_TEST_LOOP_POOL_N_LOOPS);
+  if(!inf_test_loop_pool_assign(pool, loops, objects))
+  {
+    result = FALSE;
+  }
+  else
+  {
+    inf_test_loop_pool_invoke(
+      pool,
+      loops,
+      INF_TEST_LOOP_POOL_N_INVOCATIONS,
+      &n_freed
+    );
+
+    /* After pausing, everything invoked before must have run */
+    infd_loop_pool_pause(pool);
+    g_assert(infd_loop_pool_is_paused(pool));
+
+    for(i = 0; i < INF_TEST_LOOP_POOL_N_LOOPS; ++i)
+    {
+      if(loops[i].failed)
+      {
+        fprintf(stderr, "Loop %u ran functions out of order\n", i);
+        result = FALSE;
+      }
+      else if(loops[i].n_run != INF_TEST_LOOP_POOL_N_INVOCATIONS)
+      {
+        fprintf(
+          stderr,
+          "Loop %u ran %u of %u functions when paused\n",
+          i,
+          loops[i].n_run,
+          INF_TEST_LOOP_POOL_N_INVOCATIONS
+        );
+
+        result = FALSE;
+      }
+      else if(loops[i].thread == g_thread_self())
+      {
+        fprintf(stderr, "Loop %u runs in the main thread\n", i);
+        result = FALSE;
+      }
+    }
+
+    infd_loop_pool_resume(pool);
+    g_assert(!infd_loop_pool_is_paused(pool));
+
+    if(!inf_test_loop_pool_run_scheduled(pool, loops, &n_freed))
+      result = FALSE;
+
+    /* Invoke some more, and drop the pool before they have run */
+    inf_test_loop_pool_invoke(
+      pool,
+      loops,
+      INF_TEST_LOOP_POOL_N_INVOCATIONS,
+      &n_freed
+    );
+  }
+
+  g_object_unref(pool);
+
+  for(i = 0; i < INF_TEST_LOOP_POOL_N_LOOPS; ++i)
+    if(objects[i] != NULL)
+      g_object_unref(objects[i]);
+
+  if(result == TRUE &&
+     n_freed != INF_TEST_LOOP_POOL_N_LOOPS *
+                (2 * INF_TEST_LOOP_POOL_N_INVOCATIONS +
+                 INF_TEST_LOOP_POOL_N_SCHEDULED))
+  {
+    fprintf(stderr, "Only %d invocations have been freed\n", n_freed);
+    result = FALSE;
+  }
+
+  inf_deinit();
+
+  if(result == FALSE)
+    return EXIT_FAILURE;
+
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
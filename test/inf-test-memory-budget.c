@@ -0,0 +1,568 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Creates a few text notes of the same size in a temporary filesystem
+ * storage with InfdDirectory and sets a memory budget that only fits some
+ * of them. It verifies that idle sessions are unloaded least recently
+ * active first until the rest fits into the budget, that a session with a
+ * local user is never unloaded, and that an unloaded session is read back
+ * from the storage unchanged when it is subscribed to again. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-request-result.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_MEMORY_BUDGET_NOTES 4
+#define INF_TEST_MEMORY_BUDGET_TEXT_LENGTH 65536
+
+typedef struct _InfTestMemoryBudget InfTestMemoryBudget;
+struct _InfTestMemoryBudget {
+  InfStandaloneIo* io;
+  InfdDirectory* directory;
+  InfBrowserIter notes[INF_TEST_MEMORY_BUDGET_NOTES];
+  guint n_added;
+  guint n_reads;
+  guint n_writes;
+  gboolean finished;
+  gboolean failed;
+};
+
+static InfSession*
+inf_test_memory_budget_session_new(InfIo* io,
+                                   InfCommunicationManager* manager,
+                                   InfSessionStatus status,
+                                   InfCommunicationGroup* sync_group,
+                                   InfXmlConnection* sync_connection,
+                                   const gchar* path,
+                                   gpointer user_data)
+{
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_memory_budget_session_read(InfdStorage* storage,
+                                    InfIo* io,
+                                    InfCommunicationManager* manager,
+                                    const gchar* path,
+                                    gpointer user_data,
+                                    GError** error)
+{
+  InfTestMemoryBudget* test;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+  gboolean result;
+
+  test = (InfTestMemoryBudget*)user_data;
+  ++test->n_reads;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  result = inf_text_filesystem_format_read(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    user_table,
+    buffer,
+    error
+  );
+
+  session = NULL;
+  if(result == TRUE)
+  {
+    session = inf_text_session_new_with_user_table(
+      manager,
+      buffer,
+      io,
+      user_table,
+      INF_SESSION_RUNNING,
+      NULL,
+      NULL
+    );
+  }
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static gboolean
+inf_test_memory_budget_session_write(InfdStorage* storage,
+                                     InfSession* session,
+                                     const gchar* path,
+                                     gpointer user_data,
+                                     GError** error)
+{
+  InfTestMemoryBudget* test;
+  test = (InfTestMemoryBudget*)user_data;
+
+  ++test->n_writes;
+
+  return inf_text_filesystem_format_write(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    NULL,
+    error
+  );
+}
+
+static InfdNotePlugin INF_TEST_MEMORY_BUDGET_PLUGIN = {
+  NULL,
+  "InfdFilesystemStorage",
+  "InfTestMemoryBudget",
+  inf_test_memory_budget_session_new,
+  inf_test_memory_budget_session_read,
+  inf_test_memory_budget_session_write,
+  NULL,
+  NULL
+};
+
+static void
+inf_test_memory_budget_finished_cb(InfRequest* request,
+                                   const InfRequestResult* result,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfTestMemoryBudget* test;
+  test = (InfTestMemoryBudget*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Request failed: %s\n", error->message);
+    test->failed = TRUE;
+  }
+
+  test->finished = TRUE;
+}
+
+static void
+inf_test_memory_budget_add_note_cb(InfRequest* request,
+                                   const InfRequestResult* result,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfTestMemoryBudget* test;
+  const InfBrowserIter* new_node;
+
+  test = (InfTestMemoryBudget*)user_data;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Adding note failed: %s\n", error->message);
+    test->failed = TRUE;
+  }
+  else
+  {
+    inf_request_result_get_add_node(result, NULL, NULL, &new_node);
+    test->notes[test->n_added] = *new_node;
+  }
+
+  test->finished = TRUE;
+}
+
+static InfSession*
+inf_test_memory_budget_get_session(InfTestMemoryBudget* test,
+                                   guint index)
+{
+  InfSessionProxy* proxy;
+  InfSession* session;
+
+  proxy = inf_browser_get_session(
+    INF_BROWSER(test->directory),
+    &test->notes[index]
+  );
+
+  if(proxy == NULL)
+    return NULL;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  g_object_unref(session);
+  return session;
+}
+
+/* Checks which of the notes are held in memory. loaded is a string with
+ * one character for each note, 'x' if it should be loaded or '-' if not. */
+static gboolean
+inf_test_memory_budget_check_loaded(InfTestMemoryBudget* test,
+                                    const gchar* loaded)
+{
+  gboolean result;
+  gboolean is_loaded;
+  guint i;
+
+  result = TRUE;
+  for(i = 0; i < INF_TEST_MEMORY_BUDGET_NOTES; ++i)
+  {
+    is_loaded = inf_test_memory_budget_get_session(test, i) != NULL;
+    if(is_loaded != (loaded[i] == 'x'))
+    {
+      fprintf(
+        stderr,
+        "Note %u is %s, but it should %s\n",
+        i,
+        is_loaded ? "loaded" : "not loaded",
+        loaded[i] == 'x' ? "be" : "not be"
+      );
+
+      result = FALSE;
+    }
+  }
+
+  return result;
+}
+
+static guint64
+inf_test_memory_budget_get_usage(InfTestMemoryBudget* test)
+{
+  guint64 usage;
+  g_object_get(G_OBJECT(test->directory), "memory-usage", &usage, NULL);
+  return usage;
+}
+
+/* Adds the notes one after the other, so that the first one is the least
+ * recently active. */
+static gboolean
+inf_test_memory_budget_add_notes(InfTestMemoryBudget* test)
+{
+  InfBrowser* browser;
+  InfBrowserIter root;
+  InfSession* session;
+  gchar* text;
+  gchar* name;
+  guint i;
+
+  browser = INF_BROWSER(test->directory);
+  inf_browser_get_root(browser, &root);
+
+  test->finished = FALSE;
+  test->failed = FALSE;
+  inf_browser_explore(
+    browser,
+    &root,
+    inf_test_memory_budget_finished_cb,
+    test
+  );
+
+  while(!test->finished)
+    inf_standalone_io_iteration(test->io);
+  if(test->failed)
+    return FALSE;
+
+  text = g_malloc(INF_TEST_MEMORY_BUDGET_TEXT_LENGTH);
+  memset(text, 'a', INF_TEST_MEMORY_BUDGET_TEXT_LENGTH);
+
+  for(i = 0; i < INF_TEST_MEMORY_BUDGET_NOTES; ++i)
+  {
+    name = g_strdup_printf("note-%u", i);
+
+    test->finished = FALSE;
+    test->n_added = i;
+
+    inf_browser_add_note(
+      browser,
+      &root,
+      name,
+      "InfTestMemoryBudget",
+      NULL,
+      NULL,
+      FALSE,
+      inf_test_memory_budget_add_note_cb,
+      test
+    );
+
+    g_free(name);
+
+    while(!test->finished)
+      inf_standalone_io_iteration(test->io);
+
+    if(test->failed)
+    {
+      g_free(text);
+      return FALSE;
+    }
+
+    session = inf_test_memory_budget_get_session(test, i);
+    if(session == NULL)
+    {
+      fprintf(stderr, "Note %u was not created\n", i);
+      g_free(text);
+      return FALSE;
+    }
+
+    inf_text_buffer_insert_text(
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      0,
+      text,
+      INF_TEST_MEMORY_BUDGET_TEXT_LENGTH,
+      INF_TEST_MEMORY_BUDGET_TEXT_LENGTH,
+      NULL
+    );
+
+    /* Make sure the notes became idle at different times */
+    g_usleep(2000);
+  }
+
+  g_free(text);
+  return TRUE;
+}
+
+static gboolean
+inf_test_memory_budget_run(InfTestMemoryBudget* test)
+{
+  InfSessionProxy* proxy;
+  InfSession* session;
+  guint64 note_usage;
+  guint64 budget;
+  guint n_writes;
+  guint i;
+
+  if(!inf_test_memory_budget_add_notes(test))
+    return FALSE;
+
+  if(!inf_test_memory_budget_check_loaded(test, "xxxx"))
+    return FALSE;
+
+  note_usage = inf_session_get_memory_usage(
+    inf_test_memory_budget_get_session(test, 0)
+  );
+
+  if(note_usage < INF_TEST_MEMORY_BUDGET_TEXT_LENGTH)
+  {
+    fprintf(
+      stderr,
+      "Note uses %" G_GUINT64_FORMAT " bytes, less than its text\n",
+      note_usage
+    );
+
+    return FALSE;
+  }
+
+  if(inf_test_memory_budget_get_usage(test) <
+     INF_TEST_MEMORY_BUDGET_NOTES * note_usage)
+  {
+    fprintf(stderr, "Memory usage does not include all notes\n");
+    return FALSE;
+  }
+
+  /* The least recently active note has a local user now, so it must stay
+   * in memory even though it would be the first one to go otherwise. */
+  proxy = inf_browser_get_session(
+    INF_BROWSER(test->directory),
+    &test->notes[0]
+  );
+
+  test->finished = FALSE;
+  test->failed = FALSE;
+
+  inf_text_session_join_user(
+    proxy,
+    "local",
+    INF_USER_ACTIVE,
+    0.0,
+    0,
+    0,
+    inf_test_memory_budget_finished_cb,
+    test
+  );
+
+  while(!test->finished)
+    inf_standalone_io_iteration(test->io);
+  if(test->failed)
+    return FALSE;
+
+  /* Room for two and a half notes, so that notes 1 and 2 need to go */
+  budget = 2 * note_usage + note_usage / 2;
+  n_writes = test->n_writes;
+
+  infd_directory_set_memory_budget(test->directory, budget);
+
+  if(!inf_test_memory_budget_check_loaded(test, "x--x"))
+    return FALSE;
+
+  if(test->n_writes != n_writes + 2)
+  {
+    fprintf(
+      stderr,
+      "%u notes were written, expected 2\n",
+      test->n_writes - n_writes
+    );
+
+    return FALSE;
+  }
+
+  if(inf_test_memory_budget_get_usage(test) > budget)
+  {
+    fprintf(stderr, "Memory usage exceeds the budget\n");
+    return FALSE;
+  }
+
+  /* Subscribing to note 1 reads it from the storage again, and makes it
+   * more recently active than note 3. */
+  test->finished = FALSE;
+  test->failed = FALSE;
+
+  inf_browser_subscribe(
+    INF_BROWSER(test->directory),
+    &test->notes[1],
+    inf_test_memory_budget_finished_cb,
+    test
+  );
+
+  while(!test->finished)
+    inf_standalone_io_iteration(test->io);
+  if(test->failed)
+    return FALSE;
+
+  if(test->n_reads != 1)
+  {
+    fprintf(stderr, "Note was read %u times, expected once\n", test->n_reads);
+    return FALSE;
+  }
+
+  session = inf_test_memory_budget_get_session(test, 1);
+  if(session == NULL ||
+     inf_text_buffer_get_length(
+       INF_TEXT_BUFFER(inf_session_get_buffer(session))) !=
+     INF_TEST_MEMORY_BUDGET_TEXT_LENGTH)
+  {
+    fprintf(stderr, "Note was not read back correctly\n");
+    return FALSE;
+  }
+
+  /* Setting the budget again checks it right away */
+  infd_directory_set_memory_budget(test->directory, budget);
+  if(!inf_test_memory_budget_check_loaded(test, "xx--"))
+    return FALSE;
+
+  /* Without a budget, nothing is unloaded early */
+  infd_directory_set_memory_budget(test->directory, 0);
+  for(i = 2; i < INF_TEST_MEMORY_BUDGET_NOTES; ++i)
+  {
+    test->finished = FALSE;
+    inf_browser_subscribe(
+      INF_BROWSER(test->directory),
+      &test->notes[i],
+      inf_test_memory_budget_finished_cb,
+      test
+    );
+
+    while(!test->finished)
+      inf_standalone_io_iteration(test->io);
+    if(test->failed)
+      return FALSE;
+  }
+
+  return inf_test_memory_budget_check_loaded(test, "xxxx");
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestMemoryBudget test;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* manager;
+  gchar* root;
+  gboolean result;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  root = g_dir_make_tmp("inf-test-memory-budget-XXXXXX", &error);
+  if(root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.n_reads = 0;
+  test.n_writes = 0;
+
+  storage = infd_filesystem_storage_new(root);
+  manager = inf_communication_manager_new();
+
+  test.directory = infd_directory_new(
+    INF_IO(test.io),
+    INFD_STORAGE(storage),
+    manager
+  );
+
+  INF_TEST_MEMORY_BUDGET_PLUGIN.user_data = &test;
+  infd_directory_add_plugin(test.directory, &INF_TEST_MEMORY_BUDGET_PLUGIN);
+
+  result = inf_test_memory_budget_run(&test);
+
+  g_object_unref(test.directory);
+  g_object_unref(manager);
+  g_object_unref(storage);
+  g_object_unref(test.io);
+
+  if(!inf_file_util_delete_directory(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    result = FALSE;
+  }
+
+  g_free(root);
+  inf_deinit();
+
+  if(!result)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
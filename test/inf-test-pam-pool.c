@@ -0,0 +1,391 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Logs in to server SASL sessions with PLAIN, and verifies the password
+ * with an InfinotedPamPool the same way infinoted does. The user does not
+ * exist, so PAM rejects every login. The test verifies that the result is
+ * reported asynchronously in the main thread and fails the SASL session,
+ * and that a session which is stopped while PAM is still busy, as when the
+ * connection closes, is neither continued nor accessed after it has been
+ * freed. */
+
+#include <infinoted/infinoted-pam.h>
+#include <infinoted/infinoted-log.h>
+
+#include <libinfinity/common/inf-sasl-context.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_PAM_POOL_SERVICE "inf-test-pam-pool"
+#define INF_TEST_PAM_POOL_USERNAME "inf-test-pam-pool-nonexistent-user"
+#define INF_TEST_PAM_POOL_PASSWORD "secret"
+
+#define INF_TEST_PAM_POOL_N_WORKERS 2
+#define INF_TEST_PAM_POOL_N_COMPLETED 4
+#define INF_TEST_PAM_POOL_N_CANCELLED 2
+#define INF_TEST_PAM_POOL_N_LOGINS \
+  (INF_TEST_PAM_POOL_N_COMPLETED + INF_TEST_PAM_POOL_N_CANCELLED)
+
+typedef struct _InfTestPamPool InfTestPamPool;
+struct _InfTestPamPool {
+  InfStandaloneIo* io;
+  GThread* main_thread;
+  InfSaslContext* context;
+  InfinotedPamPool* pool;
+  InfinotedOptions options;
+
+  guint n_verified;
+  guint n_fed;
+  gboolean timed_out;
+  gboolean failed;
+};
+
+typedef struct _InfTestPamPoolLogin InfTestPamPoolLogin;
+struct _InfTestPamPoolLogin {
+  InfTestPamPool* test;
+  InfSaslContextSession* session;
+  gboolean cancel;
+  gboolean verifying;
+  gboolean stopped;
+};
+
+static void
+inf_test_pam_pool_check_done(InfTestPamPool* test)
+{
+  if(test->n_verified == INF_TEST_PAM_POOL_N_LOGINS &&
+     test->n_fed == INF_TEST_PAM_POOL_N_COMPLETED)
+  {
+    inf_standalone_io_loop_quit(test->io);
+  }
+}
+
+static void
+inf_test_pam_pool_timeout_func(gpointer user_data)
+{
+  InfTestPamPool* test;
+  test = (InfTestPamPool*)user_data;
+
+  test->timed_out = TRUE;
+  inf_standalone_io_loop_quit(test->io);
+}
+
+/* Mirrors infinoted_startup_pam_login_done_cb() */
+static void
+inf_test_pam_pool_verified_cb(const GError* error,
+                              gpointer user_data)
+{
+  InfTestPamPoolLogin* login;
+  InfTestPamPool* test;
+
+  login = (InfTestPamPoolLogin*)user_data;
+  test = login->test;
+
+  if(g_thread_self() != test->main_thread)
+  {
+    fprintf(stderr, "PAM result reported outside of the main thread\n");
+    test->failed = TRUE;
+  }
+
+  if(!login->verifying)
+  {
+    fprintf(stderr, "PAM result reported twice\n");
+    test->failed = TRUE;
+  }
+
+  if(error == NULL ||
+     error->domain != inf_authentication_detail_error_quark() ||
+     error->code != INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED)
+  {
+    fprintf(
+      stderr,
+      "PAM accepted a user that does not exist: %s\n",
+      error != NULL ? error->message : "no error"
+    );
+
+    test->failed = TRUE;
+  }
+
+  login->verifying = FALSE;
+  ++test->n_verified;
+
+  if(inf_sasl_context_session_is_processing(login->session))
+  {
+    if(login->stopped)
+    {
+      fprintf(stderr, "Stopped session is still processing\n");
+      test->failed = TRUE;
+    }
+
+    inf_sasl_context_session_continue(
+      login->session,
+      GSASL_AUTHENTICATION_ERROR
+    );
+  }
+  else if(!login->stopped)
+  {
+    fprintf(stderr, "Session stopped processing while PAM was busy\n");
+    test->failed = TRUE;
+  }
+  else
+  {
+    /* These must be harmless on a stopped session */
+    if(inf_sasl_context_session_get_property(login->session,
+                                             GSASL_AUTHID) != NULL)
+    {
+      fprintf(stderr, "Stopped session still has properties\n");
+      test->failed = TRUE;
+    }
+
+    inf_sasl_context_session_continue(
+      login->session,
+      GSASL_AUTHENTICATION_ERROR
+    );
+  }
+
+  inf_sasl_context_session_unref(login->session);
+  inf_test_pam_pool_check_done(test);
+}
+
+static void
+inf_test_pam_pool_sasl_callback(InfSaslContextSession* session,
+                                Gsasl_property prop,
+                                gpointer session_data,
+                                gpointer user_data)
+{
+  InfTestPamPoolLogin* login;
+  InfTestPamPool* test;
+  const char* username;
+  const char* password;
+
+  login = (InfTestPamPoolLogin*)session_data;
+  test = login->test;
+
+  if(prop != GSASL_VALIDATE_SIMPLE)
+  {
+    inf_sasl_context_session_continue(session, GSASL_NO_CALLBACK);
+    return;
+  }
+
+  username = inf_sasl_context_session_get_property(session, GSASL_AUTHID);
+  password = inf_sasl_context_session_get_property(session, GSASL_PASSWORD);
+
+  login->verifying = TRUE;
+  inf_sasl_context_session_ref(session);
+
+  infinoted_pam_pool_verify(
+    test->pool,
+    INF_IO(test->io),
+    &test->options,
+    username,
+    password,
+    inf_test_pam_pool_verified_cb,
+    login
+  );
+
+  if(!login->verifying)
+  {
+    fprintf(stderr, "PAM result reported before verify() returned\n");
+    test->failed = TRUE;
+  }
+
+  /* This is what InfXmppConnection does when the connection is closed
+   * while authentication is in progress. The result of the verification
+   * is only reported once we are back in the main loop, so it is certainly
+   * still pending here. */
+  if(login->cancel)
+  {
+    login->stopped = TRUE;
+    inf_sasl_context_stop_session(test->context, session);
+  }
+}
+
+static void
+inf_test_pam_pool_fed_cb(InfSaslContextSession* session,
+                         const char* data,
+                         gboolean needs_more,
+                         const GError* error,
+                         gpointer user_data)
+{
+  InfTestPamPoolLogin* login;
+  InfTestPamPool* test;
+
+  login = (InfTestPamPoolLogin*)user_data;
+  test = login->test;
+
+  if(login->cancel)
+  {
+    fprintf(stderr, "Stopped session has been continued\n");
+    test->failed = TRUE;
+  }
+  else if(login->verifying)
+  {
+    fprintf(stderr, "Session finished before PAM did\n");
+    test->failed = TRUE;
+  }
+  else if(error == NULL)
+  {
+    fprintf(stderr, "Session succeeded although PAM failed\n");
+    test->failed = TRUE;
+  }
+
+  ++test->n_fed;
+  inf_test_pam_pool_check_done(test);
+}
+
+int
+main(int argc, char* argv[])
+{
+  static const char plain[] =
+    "\0" INF_TEST_PAM_POOL_USERNAME "\0" INF_TEST_PAM_POOL_PASSWORD;
+
+  InfTestPamPool test;
+  InfTestPamPoolLogin logins[INF_TEST_PAM_POOL_N_LOGINS];
+  guint histogram[INFINOTED_PAM_POOL_N_LATENCY_BUCKETS];
+  InfinotedLog* log;
+  InfIoTimeout* timeout;
+  gchar* plain64;
+  GError* error;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  test.context = inf_sasl_context_new(&error);
+  if(test.context == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    inf_deinit();
+    return EXIT_FAILURE;
+  }
+
+  inf_sasl_context_set_callback(
+    test.context,
+    inf_test_pam_pool_sasl_callback,
+    &test,
+    NULL
+  );
+
+  test.io = inf_standalone_io_new();
+  test.main_thread = g_thread_self();
+  test.n_verified = 0;
+  test.n_fed = 0;
+  test.timed_out = FALSE;
+  test.failed = FALSE;
+
+  memset(&test.options, 0, sizeof(test.options));
+  test.options.pam_service = INF_TEST_PAM_POOL_SERVICE;
+  test.options.pam_threads = INF_TEST_PAM_POOL_N_WORKERS;
+
+  log = infinoted_log_new();
+  test.pool = infinoted_pam_pool_new(log, INF_TEST_PAM_POOL_N_WORKERS);
+  g_object_unref(log);
+
+  plain64 = g_base64_encode((const guchar*)plain, sizeof(plain) - 1);
+
+  for(i = 0; i < INF_TEST_PAM_POOL_N_LOGINS; ++i)
+  {
+    logins[i].test = &test;
+    logins[i].cancel = (i >= INF_TEST_PAM_POOL_N_COMPLETED);
+    logins[i].verifying = FALSE;
+    logins[i].stopped = FALSE;
+
+    logins[i].session = inf_sasl_context_server_start_session(
+      test.context,
+      INF_IO(test.io),
+      "PLAIN",
+      &logins[i],
+      &error
+    );
+
+    if(logins[i].session == NULL)
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      return EXIT_FAILURE;
+    }
+
+    inf_sasl_context_session_feed(
+      logins[i].session,
+      plain64,
+      inf_test_pam_pool_fed_cb,
+      &logins[i]
+    );
+  }
+
+  g_free(plain64);
+
+  timeout = inf_io_add_timeout(
+    INF_IO(test.io),
+    30000,
+    inf_test_pam_pool_timeout_func,
+    &test,
+    NULL
+  );
+
+  inf_standalone_io_loop(test.io);
+
+  if(test.timed_out)
+  {
+    fprintf(
+      stderr,
+      "Timed out with %u of %u logins verified\n",
+      test.n_verified,
+      INF_TEST_PAM_POOL_N_LOGINS
+    );
+
+    return EXIT_FAILURE;
+  }
+
+  inf_io_remove_timeout(INF_IO(test.io), timeout);
+
+  for(i = 0; i < INF_TEST_PAM_POOL_N_LOGINS; ++i)
+    if(!logins[i].stopped)
+      inf_sasl_context_stop_session(test.context, logins[i].session);
+
+  if(infinoted_pam_pool_take_latency_histogram(test.pool, histogram) !=
+     INF_TEST_PAM_POOL_N_LOGINS)
+  {
+    fprintf(stderr, "Latency histogram misses logins\n");
+    test.failed = TRUE;
+  }
+
+  infinoted_pam_pool_unref(test.pool);
+  inf_sasl_context_unref(test.context);
+  g_object_unref(test.io);
+  inf_deinit();
+
+  if(test.failed)
+    return EXIT_FAILURE;
+
+  printf("All tests passed\n");
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,762 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Subscribes a client to a text session through simulated connections,
+ * disconnects it, makes changes on the server, and resumes the
+ * subscription with infd_session_proxy_resume_to(). It verifies that only
+ * the missed requests are sent, including those of a user who joined while
+ * the client was disconnected, and that the client ends up in the same
+ * state as the server. It also checks that inf_adopted_session_can_resume()
+ * rejects vectors ahead of the request logs or with unknown users, and that
+ * a client whose requests have been removed from the logs is unsubscribed
+ * and can subscribe again with a full synchronization. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/client/infc-session-proxy.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Maximum number of main loop iterations to wait for the client */
+#define INF_TEST_SESSION_RESUME_MAX_ITERATIONS 1000
+
+typedef struct _InfTestSessionResume InfTestSessionResume;
+struct _InfTestSessionResume {
+  InfStandaloneIo* io;
+  guint seq_id;
+
+  InfCommunicationManager* server_manager;
+  InfCommunicationHostedGroup* server_group;
+  InfTextSession* server_session;
+  InfdSessionProxy* server_proxy;
+
+  InfCommunicationManager* client_manager;
+  InfCommunicationJoinedGroup* client_group;
+  InfcSessionProxy* client_proxy;
+
+  InfSimulatedConnection* server_connection;
+  InfSimulatedConnection* client_connection;
+
+  /* Messages received by the client through the current connection */
+  guint n_sync_begin;
+  guint n_resume_request;
+};
+
+typedef struct _InfTestSessionResumeCheckUser InfTestSessionResumeCheckUser;
+struct _InfTestSessionResumeCheckUser {
+  InfUserTable* user_table;
+  gboolean result;
+};
+
+static void
+inf_test_session_resume_received_cb(InfXmlConnection* connection,
+                                    xmlNodePtr xml,
+                                    gpointer user_data)
+{
+  InfTestSessionResume* test;
+  xmlNodePtr child;
+
+  test = (InfTestSessionResume*)user_data;
+
+  /* Messages are wrapped in the group container */
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+
+    if(strcmp((const char*)child->name, "sync-begin") == 0)
+      ++test->n_sync_begin;
+    else if(strcmp((const char*)child->name, "resume-request") == 0)
+      ++test->n_resume_request;
+  }
+}
+
+static InfAdoptedAlgorithm*
+inf_test_session_resume_get_algorithm(InfSession* session)
+{
+  return inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+}
+
+static InfSession*
+inf_test_session_resume_get_client_session(InfTestSessionResume* test)
+{
+  InfSession* session;
+
+  g_object_get(G_OBJECT(test->client_proxy), "session", &session, NULL);
+  g_object_unref(session);
+
+  return session;
+}
+
+/* Creates a new pair of connections between server and client, and joins
+ * the client to the subscription group through it. */
+static void
+inf_test_session_resume_connect(InfTestSessionResume* test)
+{
+  if(test->client_group != NULL)
+    g_object_unref(test->client_group);
+  if(test->server_connection != NULL)
+    g_object_unref(test->server_connection);
+  if(test->client_connection != NULL)
+    g_object_unref(test->client_connection);
+
+  test->server_connection =
+    inf_simulated_connection_new_with_io(INF_IO(test->io));
+  test->client_connection =
+    inf_simulated_connection_new_with_io(INF_IO(test->io));
+
+  inf_simulated_connection_connect(
+    test->server_connection,
+    test->client_connection
+  );
+
+  inf_simulated_connection_set_mode(
+    test->server_connection,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  inf_simulated_connection_set_mode(
+    test->client_connection,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->client_connection),
+    "received",
+    G_CALLBACK(inf_test_session_resume_received_cb),
+    test
+  );
+
+  test->client_group = inf_communication_manager_join_group(
+    test->client_manager,
+    "InfTestSessionResume",
+    INF_XML_CONNECTION(test->client_connection),
+    "central"
+  );
+
+  test->n_sync_begin = 0;
+  test->n_resume_request = 0;
+  ++test->seq_id;
+}
+
+/* Connects a new client and subscribes it with a full synchronization */
+static void
+inf_test_session_resume_subscribe(InfTestSessionResume* test)
+{
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  inf_test_session_resume_connect(test);
+
+  if(test->client_proxy != NULL)
+    g_object_unref(test->client_proxy);
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    test->client_manager,
+    buffer,
+    INF_IO(test->io),
+    INF_SESSION_SYNCHRONIZING,
+    INF_COMMUNICATION_GROUP(test->client_group),
+    INF_XML_CONNECTION(test->client_connection)
+  );
+
+  g_object_unref(buffer);
+
+  test->client_proxy = INFC_SESSION_PROXY(
+    g_object_new(INFC_TYPE_SESSION_PROXY, "session", session, NULL)
+  );
+
+  g_object_unref(session);
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->client_group),
+    INF_COMMUNICATION_OBJECT(test->client_proxy)
+  );
+
+  infc_session_proxy_set_connection(
+    test->client_proxy,
+    test->client_group,
+    INF_XML_CONNECTION(test->client_connection),
+    test->seq_id
+  );
+
+  infd_session_proxy_subscribe_to(
+    test->server_proxy,
+    INF_XML_CONNECTION(test->server_connection),
+    test->seq_id,
+    TRUE
+  );
+}
+
+/* Reconnects the existing client and asks the server to resume its
+ * subscription from the state the client's session is in. */
+static gboolean
+inf_test_session_resume_resume(InfTestSessionResume* test)
+{
+  InfAdoptedStateVector* vector;
+  gboolean result;
+
+  vector = inf_adopted_state_vector_copy(
+    inf_adopted_algorithm_get_current(
+      inf_test_session_resume_get_algorithm(
+        inf_test_session_resume_get_client_session(test)
+      )
+    )
+  );
+
+  inf_test_session_resume_connect(test);
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->client_group),
+    INF_COMMUNICATION_OBJECT(test->client_proxy)
+  );
+
+  infc_session_proxy_set_connection(
+    test->client_proxy,
+    test->client_group,
+    INF_XML_CONNECTION(test->client_connection),
+    test->seq_id
+  );
+
+  result = infd_session_proxy_resume_to(
+    test->server_proxy,
+    INF_XML_CONNECTION(test->server_connection),
+    test->seq_id,
+    vector
+  );
+
+  inf_adopted_state_vector_free(vector);
+  return result;
+}
+
+static void
+inf_test_session_resume_disconnect(InfTestSessionResume* test)
+{
+  inf_xml_connection_close(INF_XML_CONNECTION(test->client_connection));
+}
+
+static InfUser*
+inf_test_session_resume_join(InfTestSessionResume* test,
+                             const gchar* name)
+{
+  inf_text_session_join_user(
+    INF_SESSION_PROXY(test->server_proxy),
+    name,
+    INF_USER_ACTIVE,
+    0.5,
+    0,
+    0,
+    NULL,
+    NULL
+  );
+
+  return inf_user_table_lookup_user_by_name(
+    inf_session_get_user_table(INF_SESSION(test->server_session)),
+    name
+  );
+}
+
+/* Inserts n characters at the beginning of the server's buffer */
+static void
+inf_test_session_resume_insert(InfTestSessionResume* test,
+                               InfUser* user,
+                               guint n)
+{
+  InfTextBuffer* buffer;
+  guint i;
+
+  buffer = INF_TEXT_BUFFER(
+    inf_session_get_buffer(INF_SESSION(test->server_session))
+  );
+
+  for(i = 0; i < n; ++i)
+    inf_text_buffer_insert_text(buffer, 0, "a", 1, 1, user);
+}
+
+/* Checks that a user of the server exists with the same name and status
+ * in the user table of the client. */
+static void
+inf_test_session_resume_check_user_func(InfUser* user,
+                                        gpointer user_data)
+{
+  InfTestSessionResumeCheckUser* check;
+  InfUser* other;
+
+  check = (InfTestSessionResumeCheckUser*)user_data;
+  other = inf_user_table_lookup_user_by_id(
+    check->user_table,
+    inf_user_get_id(user)
+  );
+
+  if(other == NULL ||
+     strcmp(inf_user_get_name(user), inf_user_get_name(other)) != 0 ||
+     inf_user_get_status(user) != inf_user_get_status(other))
+  {
+    check->result = FALSE;
+  }
+}
+
+/* Returns whether the client has the same content, state and users as the
+ * server. */
+static gboolean
+inf_test_session_resume_in_sync(InfTestSessionResume* test)
+{
+  InfSession* client_session;
+  InfTextBuffer* server_buffer;
+  InfTextBuffer* client_buffer;
+  InfTextChunk* server_chunk;
+  InfTextChunk* client_chunk;
+  InfTestSessionResumeCheckUser check;
+  gboolean result;
+
+  client_session = inf_test_session_resume_get_client_session(test);
+  if(inf_session_get_status(client_session) != INF_SESSION_RUNNING)
+    return FALSE;
+
+  if(inf_adopted_state_vector_compare(
+       inf_adopted_algorithm_get_current(
+         inf_test_session_resume_get_algorithm(
+           INF_SESSION(test->server_session)
+         )
+       ),
+       inf_adopted_algorithm_get_current(
+         inf_test_session_resume_get_algorithm(client_session)
+       )) != 0)
+  {
+    return FALSE;
+  }
+
+  server_buffer = INF_TEXT_BUFFER(
+    inf_session_get_buffer(INF_SESSION(test->server_session))
+  );
+  client_buffer = INF_TEXT_BUFFER(inf_session_get_buffer(client_session));
+
+  server_chunk = inf_text_buffer_get_slice(
+    server_buffer,
+    0,
+    inf_text_buffer_get_length(server_buffer)
+  );
+
+  client_chunk = inf_text_buffer_get_slice(
+    client_buffer,
+    0,
+    inf_text_buffer_get_length(client_buffer)
+  );
+
+  result = inf_text_chunk_equal(server_chunk, client_chunk);
+  inf_text_chunk_free(server_chunk);
+  inf_text_chunk_free(client_chunk);
+
+  if(result == TRUE)
+  {
+    check.user_table = inf_session_get_user_table(client_session);
+    check.result = TRUE;
+
+    inf_user_table_foreach_user(
+      inf_session_get_user_table(INF_SESSION(test->server_session)),
+      inf_test_session_resume_check_user_func,
+      &check
+    );
+
+    result = check.result;
+  }
+
+  return result;
+}
+
+static gboolean
+inf_test_session_resume_wait_in_sync(InfTestSessionResume* test)
+{
+  guint i;
+
+  for(i = 0; i < INF_TEST_SESSION_RESUME_MAX_ITERATIONS; ++i)
+  {
+    if(inf_test_session_resume_in_sync(test))
+      return TRUE;
+
+    inf_standalone_io_iteration_timeout(test->io, 10);
+  }
+
+  fprintf(stderr, "Client did not catch up with the server\n");
+  return FALSE;
+}
+
+static gboolean
+inf_test_session_resume_wait_closed(InfTestSessionResume* test)
+{
+  InfSession* session;
+  guint i;
+
+  session = inf_test_session_resume_get_client_session(test);
+
+  for(i = 0; i < INF_TEST_SESSION_RESUME_MAX_ITERATIONS; ++i)
+  {
+    if(inf_session_get_status(session) == INF_SESSION_CLOSED)
+      return TRUE;
+
+    inf_standalone_io_iteration_timeout(test->io, 10);
+  }
+
+  fprintf(stderr, "Client session was not closed\n");
+  return FALSE;
+}
+
+static void
+inf_test_session_resume_init(InfTestSessionResume* test,
+                             guint max_total_log_size)
+{
+  const gchar* const methods[] = { "central", NULL };
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+
+  test->io = inf_standalone_io_new();
+  test->seq_id = 0;
+
+  test->server_manager = inf_communication_manager_new();
+  test->server_group = inf_communication_manager_open_group(
+    test->server_manager,
+    "InfTestSessionResume",
+    methods
+  );
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  user_table = inf_user_table_new();
+
+  test->server_session = INF_TEXT_SESSION(
+    g_object_new(
+      INF_TEXT_TYPE_SESSION,
+      "communication-manager", test->server_manager,
+      "buffer", buffer,
+      "user-table", user_table,
+      "status", INF_SESSION_RUNNING,
+      "io", test->io,
+      "max-total-log-size", max_total_log_size,
+      NULL
+    )
+  );
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+
+  test->server_proxy = INFD_SESSION_PROXY(
+    g_object_new(
+      INFD_TYPE_SESSION_PROXY,
+      "io", test->io,
+      "session", test->server_session,
+      "subscription-group", test->server_group,
+      NULL
+    )
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->server_group),
+    INF_COMMUNICATION_OBJECT(test->server_proxy)
+  );
+
+  test->client_manager = inf_communication_manager_new();
+  test->client_group = NULL;
+  test->client_proxy = NULL;
+  test->server_connection = NULL;
+  test->client_connection = NULL;
+}
+
+static void
+inf_test_session_resume_finalize(InfTestSessionResume* test)
+{
+  if(test->client_proxy != NULL)
+  {
+    inf_session_close(inf_test_session_resume_get_client_session(test));
+    g_object_unref(test->client_proxy);
+  }
+
+  inf_session_close(INF_SESSION(test->server_session));
+  g_object_unref(test->server_proxy);
+  g_object_unref(test->server_session);
+
+  if(test->client_group != NULL)
+    g_object_unref(test->client_group);
+  if(test->server_connection != NULL)
+    g_object_unref(test->server_connection);
+  if(test->client_connection != NULL)
+    g_object_unref(test->client_connection);
+
+  g_object_unref(test->server_group);
+  g_object_unref(test->server_manager);
+  g_object_unref(test->client_manager);
+  g_object_unref(test->io);
+}
+
+/* Resumes from a few requests behind, with a user who joined while the
+ * client was disconnected. */
+static gboolean
+inf_test_session_resume_missed_requests(void)
+{
+  InfTestSessionResume test;
+  InfUser* alice;
+  InfUser* bob;
+  gboolean result;
+
+  inf_test_session_resume_init(&test, 2048);
+
+  alice = inf_test_session_resume_join(&test, "alice");
+  inf_test_session_resume_insert(&test, alice, 5);
+
+  inf_test_session_resume_subscribe(&test);
+  result = inf_test_session_resume_wait_in_sync(&test);
+
+  if(result)
+  {
+    inf_test_session_resume_insert(&test, alice, 2);
+    result = inf_test_session_resume_wait_in_sync(&test);
+  }
+
+  if(result)
+  {
+    inf_test_session_resume_disconnect(&test);
+
+    inf_test_session_resume_insert(&test, alice, 3);
+    bob = inf_test_session_resume_join(&test, "bob");
+    inf_test_session_resume_insert(&test, bob, 4);
+
+    if(!inf_test_session_resume_resume(&test))
+    {
+      fprintf(stderr, "Session could not be resumed\n");
+      result = FALSE;
+    }
+  }
+
+  if(result)
+    result = inf_test_session_resume_wait_in_sync(&test);
+
+  if(result && (test.n_sync_begin != 0 || test.n_resume_request != 7))
+  {
+    fprintf(
+      stderr,
+      "Resuming sent %u synchronizations and %u requests, expected 0 and "
+      "7\n",
+      test.n_sync_begin,
+      test.n_resume_request
+    );
+
+    result = FALSE;
+  }
+
+  /* Changes after resuming reach the client as usual */
+  if(result)
+  {
+    inf_test_session_resume_insert(&test, bob, 1);
+    inf_test_session_resume_insert(&test, alice, 1);
+    result = inf_test_session_resume_wait_in_sync(&test);
+  }
+
+  inf_test_session_resume_finalize(&test);
+  return result;
+}
+
+/* Vectors which are not reachable from the request logs */
+static gboolean
+inf_test_session_resume_reject(void)
+{
+  InfTestSessionResume test;
+  InfAdoptedSession* session;
+  InfAdoptedStateVector* vector;
+  InfUser* alice;
+  gboolean result;
+
+  inf_test_session_resume_init(&test, 2048);
+  session = INF_ADOPTED_SESSION(test.server_session);
+
+  alice = inf_test_session_resume_join(&test, "alice");
+  inf_test_session_resume_insert(&test, alice, 3);
+
+  result = TRUE;
+  vector = inf_adopted_state_vector_copy(
+    inf_adopted_algorithm_get_current(
+      inf_adopted_session_get_algorithm(session)
+    )
+  );
+
+  if(!inf_adopted_session_can_resume(session, vector))
+  {
+    fprintf(stderr, "Cannot resume from the current state\n");
+    result = FALSE;
+  }
+
+  inf_adopted_state_vector_add(vector, inf_user_get_id(alice), -3);
+  if(result && !inf_adopted_session_can_resume(session, vector))
+  {
+    fprintf(stderr, "Cannot resume from the initial state\n");
+    result = FALSE;
+  }
+
+  /* Requests the server does not know about */
+  inf_adopted_state_vector_add(vector, inf_user_get_id(alice), 4);
+  if(result && inf_adopted_session_can_resume(session, vector))
+  {
+    fprintf(stderr, "Can resume from a state ahead of the server\n");
+    result = FALSE;
+  }
+
+  /* A user the server does not know about */
+  inf_adopted_state_vector_add(vector, inf_user_get_id(alice), -1);
+  inf_adopted_state_vector_set(vector, inf_user_get_id(alice) + 100, 1);
+  if(result && inf_adopted_session_can_resume(session, vector))
+  {
+    fprintf(stderr, "Can resume from a state with an unknown user\n");
+    result = FALSE;
+  }
+
+  inf_adopted_state_vector_free(vector);
+  inf_test_session_resume_finalize(&test);
+  return result;
+}
+
+/* The requests missed by the client have been removed from the request
+ * logs, so it needs to subscribe again with a full synchronization. */
+static gboolean
+inf_test_session_resume_fallback(void)
+{
+  InfTestSessionResume test;
+  InfAdoptedSession* session;
+  InfAdoptedStateVector* vector;
+  InfUser* alice;
+  gboolean result;
+
+  inf_test_session_resume_init(&test, 4);
+  session = INF_ADOPTED_SESSION(test.server_session);
+
+  alice = inf_test_session_resume_join(&test, "alice");
+  inf_test_session_resume_insert(&test, alice, 2);
+
+  inf_test_session_resume_subscribe(&test);
+  result = inf_test_session_resume_wait_in_sync(&test);
+
+  if(result)
+  {
+    vector = inf_adopted_state_vector_copy(
+      inf_adopted_algorithm_get_current(
+        inf_test_session_resume_get_algorithm(
+          inf_test_session_resume_get_client_session(&test)
+        )
+      )
+    );
+
+    inf_test_session_resume_disconnect(&test);
+    inf_test_session_resume_insert(&test, alice, 10);
+    inf_adopted_algorithm_cleanup(inf_adopted_session_get_algorithm(session));
+
+    if(inf_adopted_session_can_resume(session, vector))
+    {
+      fprintf(stderr, "Can resume although the requests were removed\n");
+      result = FALSE;
+    }
+
+    inf_adopted_state_vector_free(vector);
+  }
+
+  if(result && inf_test_session_resume_resume(&test))
+  {
+    fprintf(stderr, "Resumed although the requests were removed\n");
+    result = FALSE;
+  }
+
+  /* The server unsubscribed the client again, which closes its copy */
+  if(result)
+    result = inf_test_session_resume_wait_closed(&test);
+
+  if(result)
+  {
+    inf_test_session_resume_subscribe(&test);
+    result = inf_test_session_resume_wait_in_sync(&test);
+  }
+
+  if(result && test.n_sync_begin != 1)
+  {
+    fprintf(stderr, "Client was not synchronized again\n");
+    result = FALSE;
+  }
+
+  inf_test_session_resume_finalize(&test);
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GError* error;
+  int result;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  result = EXIT_SUCCESS;
+
+  printf("Missed requests... ");
+  if(inf_test_session_resume_missed_requests())
+  {
+    printf("OK\n");
+  }
+  else
+  {
+    printf("FAILED\n");
+    result = EXIT_FAILURE;
+  }
+
+  printf("Rejected vectors... ");
+  if(inf_test_session_resume_reject())
+  {
+    printf("OK\n");
+  }
+  else
+  {
+    printf("FAILED\n");
+    result = EXIT_FAILURE;
+  }
+
+  printf("Fallback to synchronization... ");
+  if(inf_test_session_resume_fallback())
+  {
+    printf("OK\n");
+  }
+  else
+  {
+    printf("FAILED\n");
+    result = EXIT_FAILURE;
+  }
+
+  inf_deinit();
+  return result;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,295 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures the time of a main loop iteration of InfStandaloneIo as a
+ * function of the number of idle connections. Every idle connection is a
+ * socket pair with a watch on one end and a long-running timeout, like the
+ * keepalive of a real connection. A single active socket pair is ready in
+ * every iteration, and every iteration also adds and removes a short
+ * timeout. Ideally, the time per iteration does not depend on the number of
+ * idle connections. */
+
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _InfTestStandaloneIo InfTestStandaloneIo;
+struct _InfTestStandaloneIo {
+  InfStandaloneIo* io;
+
+  InfNativeSocket* sockets;
+  int* peers;
+  InfIoWatch** watches;
+  InfIoTimeout** timeouts;
+  guint n_idle;
+
+  InfNativeSocket active_socket;
+  int active_peer;
+  guint n_active;
+};
+
+static const guint INF_TEST_STANDALONE_IO_IDLE[] = {
+  0, 100, 1000, 5000, 10000
+};
+
+static void
+inf_test_standalone_io_idle_cb(InfNativeSocket* socket,
+                               InfIoEvent events,
+                               gpointer user_data)
+{
+  /* Idle connections never become ready */
+  g_assert_not_reached();
+}
+
+static void
+inf_test_standalone_io_timeout_cb(gpointer user_data)
+{
+  /* Neither do their timeouts elapse */
+  g_assert_not_reached();
+}
+
+static void
+inf_test_standalone_io_active_cb(InfNativeSocket* socket,
+                                 InfIoEvent events,
+                                 gpointer user_data)
+{
+  InfTestStandaloneIo* test;
+  InfIoTimeout* timeout;
+  char c;
+
+  test = (InfTestStandaloneIo*)user_data;
+
+  /* Echo the byte back, so that the socket is ready again in the next
+   * iteration. */
+  if(read(*socket, &c, 1) != 1 || write(test->active_peer, &c, 1) != 1)
+    g_error("Failed to echo data: %s", strerror(errno));
+
+  /* Like a noop timer that is rescheduled for every request */
+  timeout = inf_io_add_timeout(
+    INF_IO(test->io),
+    1000,
+    inf_test_standalone_io_timeout_cb,
+    NULL,
+    NULL
+  );
+
+  inf_io_remove_timeout(INF_IO(test->io), timeout);
+  ++test->n_active;
+}
+
+static void
+inf_test_standalone_io_raise_fd_limit(void)
+{
+  struct rlimit limit;
+
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static gboolean
+inf_test_standalone_io_add_idle(InfTestStandaloneIo* test,
+                                guint n_idle)
+{
+  int fds[2];
+  guint i;
+
+  test->sockets = g_malloc(sizeof(InfNativeSocket) * n_idle);
+  test->peers = g_malloc(sizeof(int) * n_idle);
+  test->watches = g_malloc(sizeof(InfIoWatch*) * n_idle);
+  test->timeouts = g_malloc(sizeof(InfIoTimeout*) * n_idle);
+
+  for(test->n_idle = 0; test->n_idle < n_idle; ++test->n_idle)
+  {
+    i = test->n_idle;
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+    {
+      fprintf(stderr, "socketpair() failed: %s\n", strerror(errno));
+      return FALSE;
+    }
+
+    test->sockets[i] = fds[0];
+    test->peers[i] = fds[1];
+
+    test->watches[i] = inf_io_add_watch(
+      INF_IO(test->io),
+      &test->sockets[i],
+      INF_IO_INCOMING | INF_IO_ERROR,
+      inf_test_standalone_io_idle_cb,
+      test,
+      NULL
+    );
+
+    test->timeouts[i] = inf_io_add_timeout(
+      INF_IO(test->io),
+      3600 * 1000 + g_random_int_range(0, 60 * 1000),
+      inf_test_standalone_io_timeout_cb,
+      test,
+      NULL
+    );
+  }
+
+  return TRUE;
+}
+
+static void
+inf_test_standalone_io_remove_idle(InfTestStandaloneIo* test)
+{
+  guint i;
+
+  for(i = 0; i < test->n_idle; ++i)
+  {
+    inf_io_remove_watch(INF_IO(test->io), test->watches[i]);
+    inf_io_remove_timeout(INF_IO(test->io), test->timeouts[i]);
+    close(test->sockets[i]);
+    close(test->peers[i]);
+  }
+
+  g_free(test->sockets);
+  g_free(test->peers);
+  g_free(test->watches);
+  g_free(test->timeouts);
+  test->n_idle = 0;
+}
+
+/* Returns the time per iteration in microseconds, or a negative value if
+ * the idle connections could not be created. */
+static double
+inf_test_standalone_io_run(InfTestStandaloneIo* test,
+                           guint n_idle,
+                           guint n_iterations)
+{
+  InfIoWatch* watch;
+  int fds[2];
+  gint64 start;
+  gint64 total;
+  guint i;
+
+  test->io = inf_standalone_io_new();
+
+  if(!inf_test_standalone_io_add_idle(test, n_idle))
+  {
+    inf_test_standalone_io_remove_idle(test);
+    g_object_unref(test->io);
+    return -1.0;
+  }
+
+  if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+  {
+    fprintf(stderr, "socketpair() failed: %s\n", strerror(errno));
+    inf_test_standalone_io_remove_idle(test);
+    g_object_unref(test->io);
+    return -1.0;
+  }
+
+  test->active_socket = fds[0];
+  test->active_peer = fds[1];
+  test->n_active = 0;
+
+  watch = inf_io_add_watch(
+    INF_IO(test->io),
+    &test->active_socket,
+    INF_IO_INCOMING | INF_IO_ERROR,
+    inf_test_standalone_io_active_cb,
+    test,
+    NULL
+  );
+
+  if(write(test->active_peer, "x", 1) != 1)
+    g_error("Failed to write data: %s", strerror(errno));
+
+  /* Warm up */
+  for(i = 0; i < n_iterations / 10; ++i)
+    inf_standalone_io_iteration(test->io);
+
+  test->n_active = 0;
+  start = g_get_monotonic_time();
+
+  for(i = 0; i < n_iterations; ++i)
+    inf_standalone_io_iteration(test->io);
+
+  total = g_get_monotonic_time() - start;
+  g_assert(test->n_active == n_iterations);
+
+  inf_io_remove_watch(INF_IO(test->io), watch);
+  close(test->active_socket);
+  close(test->active_peer);
+
+  inf_test_standalone_io_remove_idle(test);
+  g_object_unref(test->io);
+
+  return (double)total / n_iterations;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestStandaloneIo test;
+  GError* error;
+  guint n_iterations;
+  double elapsed;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  n_iterations = 100000;
+  if(argc > 1)
+    n_iterations = atoi(argv[1]);
+
+  inf_test_standalone_io_raise_fd_limit();
+
+  printf("idle connections  time (us/iteration)\n");
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_STANDALONE_IO_IDLE); ++i)
+  {
+    elapsed = inf_test_standalone_io_run(
+      &test,
+      INF_TEST_STANDALONE_IO_IDLE[i],
+      n_iterations
+    );
+
+    /* Probably ran out of file descriptors */
+    if(elapsed < 0.0)
+      break;
+
+    printf("%16u  %19.3f\n", INF_TEST_STANDALONE_IO_IDLE[i], elapsed);
+  }
+
+  inf_deinit();
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -19,8 +19,16 @@
 
 #include <libinfinity/adopted/inf-adopted-state-vector.h>
 #include <libinfinity/common/inf-user.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+/* Number of users for which the state vector microbenchmark is run. Up to
+ * 8 users the components are stored within the vector itself. */
+static const guint INF_TEST_STATE_VECTOR_USERS[] = { 2, 8, 16, 64 };
+
+#define INF_TEST_STATE_VECTOR_REQUESTS 20000
+
 static void cmp(const char* should_be, InfAdoptedStateVector* vec) {
   char* is;
   InfAdoptedStateVector* should_be_vec;
@@ -36,7 +44,10 @@ static void cmp(const char* should_be, InfAdoptedStateVector* vec) {
   should_be_vec = inf_adopted_state_vector_from_string(should_be, NULL);
   if (!should_be_vec
       || inf_adopted_state_vector_compare(vec, should_be_vec) != 0
-      || inf_adopted_state_vector_compare(should_be_vec, vec) != 0) {
+      || inf_adopted_state_vector_compare(should_be_vec, vec) != 0
+      || !inf_adopted_state_vector_equal(vec, should_be_vec)
+      || inf_adopted_state_vector_hash(vec)
+         != inf_adopted_state_vector_hash(should_be_vec)) {
     printf("should be: %s\n"
            "is:        %s\n"
            "compare failed\n", should_be, is);
@@ -122,9 +133,287 @@ static void l_test() {
   vec  = apply(from_string, ("1:0;5:0", NULL));
   vec_ = apply(new, ());
   g_assert(apply(compare, (vec, vec_)) == 0);
+  g_assert(apply(equal, (vec, vec_)));
+  g_assert(apply(hash, (vec)) == apply(hash, (vec_)));
 
   apply(free, (vec));
   apply(free, (vec_));
+
+  /* Vectors which do not fit into the inline storage anymore */
+  vec = apply(new, ());
+  for (i = 0; i < 20; ++i)
+    apply(set, (vec, i, i + 1));
+  vec_ = apply(copy, (vec));
+  g_assert(apply(equal, (vec, vec_)));
+  g_assert(apply(hash, (vec)) == apply(hash, (vec_)));
+  g_assert(apply(vdiff, (vec, vec_)) == 0);
+
+  apply(add, (vec_, 19, 1));
+  g_assert(!apply(equal, (vec, vec_)));
+  g_assert(apply(causally_before, (vec, vec_)));
+  g_assert(!apply(causally_before, (vec_, vec)));
+  g_assert(apply(causally_before_inc, (vec, vec_, 19)));
+  g_assert(apply(vdiff, (vec, vec_)) == 1);
+
+  apply(add, (vec_, 19, -1));
+  g_assert(apply(equal, (vec, vec_)));
+  g_assert(apply(hash, (vec)) == apply(hash, (vec_)));
+
+  apply(free, (vec));
+  apply(free, (vec_));
+}
+
+/* Number of user IDs, and of random modifications, for the comparison of
+ * state vectors with a plain array of components */
+#define INF_TEST_STATE_VECTOR_IDS 24
+#define INF_TEST_STATE_VECTOR_MODIFICATIONS 2000
+
+/* Builds a state vector from the given components, inserting them in the
+ * order given by ids */
+static InfAdoptedStateVector*
+inf_test_state_vector_build(const guint* model,
+                            const guint* ids)
+{
+  InfAdoptedStateVector* vec;
+  guint i;
+
+  vec = inf_adopted_state_vector_new();
+  for (i = 0; i < INF_TEST_STATE_VECTOR_IDS; ++i)
+    if (model[ids[i]] > 0)
+      inf_adopted_state_vector_set(vec, ids[i] + 1, model[ids[i]]);
+
+  return vec;
+}
+
+static void
+inf_test_state_vector_shuffle(guint* ids)
+{
+  guint i, j;
+  guint temp;
+
+  for (i = INF_TEST_STATE_VECTOR_IDS - 1; i > 0; --i) {
+    j = rand() % (i + 1);
+    temp = ids[i];
+    ids[i] = ids[j];
+    ids[j] = temp;
+  }
+}
+
+/* Checks vec against the components in model, and against a vector built
+ * from model in a different insertion order */
+static void
+inf_test_state_vector_check_model(InfAdoptedStateVector* vec,
+                                  const guint* model,
+                                  guint* ids)
+{
+  InfAdoptedStateVector* built;
+  guint i;
+
+  for (i = 0; i < INF_TEST_STATE_VECTOR_IDS; ++i)
+    g_assert(inf_adopted_state_vector_get(vec, i + 1) == model[i]);
+
+  inf_test_state_vector_shuffle(ids);
+  built = inf_test_state_vector_build(model, ids);
+
+  g_assert(inf_adopted_state_vector_compare(vec, built) == 0);
+  g_assert(inf_adopted_state_vector_equal(vec, built));
+  g_assert(inf_adopted_state_vector_equal(built, vec));
+  g_assert(inf_adopted_state_vector_hash(vec) ==
+           inf_adopted_state_vector_hash(built));
+  g_assert(inf_adopted_state_vector_causally_before(vec, built));
+  g_assert(inf_adopted_state_vector_causally_before(built, vec));
+  g_assert(inf_adopted_state_vector_vdiff(vec, built) == 0);
+
+  inf_adopted_state_vector_free(built);
+}
+
+/* Compares causally_before, causally_before_inc and vdiff, which take
+ * shortcuts based on the sum of the components, with a plain comparison of
+ * all components */
+static void
+inf_test_state_vector_check_order(const guint* first_model,
+                                  const guint* second_model,
+                                  guint* ids)
+{
+  InfAdoptedStateVector* first;
+  InfAdoptedStateVector* second;
+  gboolean before;
+  gboolean before_inc;
+  guint first_sum;
+  guint second_sum;
+  guint inc;
+  guint i;
+
+  inf_test_state_vector_shuffle(ids);
+  first = inf_test_state_vector_build(first_model, ids);
+  inf_test_state_vector_shuffle(ids);
+  second = inf_test_state_vector_build(second_model, ids);
+
+  before = TRUE;
+  first_sum = 0;
+  second_sum = 0;
+  for (i = 0; i < INF_TEST_STATE_VECTOR_IDS; ++i) {
+    if (first_model[i] > second_model[i])
+      before = FALSE;
+    first_sum += first_model[i];
+    second_sum += second_model[i];
+  }
+
+  g_assert(inf_adopted_state_vector_causally_before(first, second) == before);
+  if (before)
+    g_assert(inf_adopted_state_vector_vdiff(first, second) ==
+             second_sum - first_sum);
+
+  /* Also try a component that is not in any of the vectors */
+  for (inc = 0; inc <= INF_TEST_STATE_VECTOR_IDS; ++inc) {
+    before_inc = TRUE;
+    for (i = 0; i < INF_TEST_STATE_VECTOR_IDS; ++i) {
+      if (first_model[i] + (i == inc ? 1 : 0) > second_model[i])
+        before_inc = FALSE;
+    }
+
+    if (inc == INF_TEST_STATE_VECTOR_IDS)
+      before_inc = FALSE;
+
+    g_assert(
+      inf_adopted_state_vector_causally_before_inc(first, second, inc + 1) ==
+      before_inc
+    );
+  }
+
+  inf_adopted_state_vector_free(first);
+  inf_adopted_state_vector_free(second);
+}
+
+/* Modifies a vector with more components than fit into the inline storage
+ * randomly, including setting components to lower values and to zero, and
+ * verifies after every modification that the running sum and hash are
+ * still correct. */
+static void
+inf_test_state_vector_running_values(void)
+{
+  guint model[INF_TEST_STATE_VECTOR_IDS];
+  guint other[INF_TEST_STATE_VECTOR_IDS];
+  guint ids[INF_TEST_STATE_VECTOR_IDS];
+  InfAdoptedStateVector* vec;
+  guint id;
+  guint value;
+  guint i, j;
+
+  for (i = 0; i < INF_TEST_STATE_VECTOR_IDS; ++i) {
+    model[i] = 0;
+    ids[i] = i;
+  }
+
+  vec = inf_adopted_state_vector_new();
+
+  for (i = 0; i < INF_TEST_STATE_VECTOR_MODIFICATIONS; ++i) {
+    id = rand() % INF_TEST_STATE_VECTOR_IDS;
+
+    switch (rand() % 4) {
+    case 0:
+      /* Set to any value, which might be lower than the current one */
+      value = rand() % 10;
+      inf_adopted_state_vector_set(vec, id + 1, value);
+      model[id] = value;
+      break;
+    case 1:
+      /* Lower a component, possibly to zero */
+      if (model[id] > 0) {
+        value = rand() % model[id];
+        inf_adopted_state_vector_set(vec, id + 1, value);
+        model[id] = value;
+      }
+      break;
+    case 2:
+      value = 1 + rand() % 3;
+      inf_adopted_state_vector_add(vec, id + 1, value);
+      model[id] += value;
+      break;
+    case 3:
+      if (model[id] > 0) {
+        inf_adopted_state_vector_add(vec, id + 1, -1);
+        --model[id];
+      }
+      break;
+    }
+
+    inf_test_state_vector_check_model(vec, model, ids);
+
+    /* Compare with a vector that is mostly, but not always, a successor */
+    for (j = 0; j < INF_TEST_STATE_VECTOR_IDS; ++j) {
+      other[j] = model[j];
+      if (rand() % 4 == 0)
+        other[j] += rand() % 3;
+      if (rand() % 16 == 0 && other[j] > 0)
+        --other[j];
+    }
+
+    inf_test_state_vector_check_order(model, other, ids);
+    inf_test_state_vector_check_order(other, model, ids);
+  }
+
+  inf_adopted_state_vector_free(vec);
+  printf("running sum and hash ok!\n");
+}
+
+/* Simulates the state vector operations done when executing a request in a
+ * session with n_users users: The request's vector is copied, the current
+ * state is checked for causality and the request is translated, which
+ * needs a few more copies and comparisons. Returns the time per request in
+ * microseconds. */
+static double
+inf_test_state_vector_benchmark(guint n_users)
+{
+  InfAdoptedStateVector* current;
+  InfAdoptedStateVector* request;
+  InfAdoptedStateVector* copy;
+  GTimer* timer;
+  guint user;
+  guint i, j;
+  guint check;
+  double elapsed;
+
+  current = inf_adopted_state_vector_new();
+  for (i = 0; i < n_users; ++i)
+    inf_adopted_state_vector_set(current, i + 1, 0);
+
+  check = 0;
+  timer = g_timer_new();
+
+  for (i = 0; i < INF_TEST_STATE_VECTOR_REQUESTS; ++i) {
+    user = 1 + rand() % n_users;
+
+    /* The request was issued a bit earlier than the current state */
+    request = inf_adopted_state_vector_copy(current);
+    if (inf_adopted_state_vector_get(request, user) > 0)
+      inf_adopted_state_vector_add(request, user, -1);
+
+    g_assert(inf_adopted_state_vector_causally_before(request, current));
+    check += inf_adopted_state_vector_vdiff(request, current);
+
+    /* Translation creates intermediate vectors */
+    for (j = 0; j < 4; ++j) {
+      copy = inf_adopted_state_vector_copy(request);
+      if (inf_adopted_state_vector_equal(copy, current))
+        ++check;
+      check += inf_adopted_state_vector_hash(copy) & 1;
+      inf_adopted_state_vector_free(copy);
+    }
+
+    inf_adopted_state_vector_free(request);
+    inf_adopted_state_vector_add(current, user, 1);
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  inf_adopted_state_vector_free(current);
+
+  /* Keep the compiler from optimizing the loop away */
+  if (check == 0)
+    printf("(no work)\n");
+
+  return elapsed * 1e6 / INF_TEST_STATE_VECTOR_REQUESTS;
 }
 
 int main(int argc, char* argv[])
@@ -132,6 +421,7 @@ int main(int argc, char* argv[])
   guint users[2];
   InfAdoptedStateVector* vec;
   InfAdoptedStateVector* vec2;
+  guint i;
 
   users[0] = 1;
   users[1] = 2;
@@ -158,6 +448,19 @@ int main(int argc, char* argv[])
 
   inf_adopted_state_vector_free(vec);
   l_test();
+  inf_test_state_vector_running_values();
+
+  /* Up to 8 users, copying a vector needs a single allocation for the
+   * vector itself. Larger vectors need a second one for the components. */
+  printf("users  time (us/request)\n");
+  for (i = 0; i < G_N_ELEMENTS(INF_TEST_STATE_VECTOR_USERS); ++i) {
+    printf(
+      "%5u  %17.3f\n",
+      INF_TEST_STATE_VECTOR_USERS[i],
+      inf_test_state_vector_benchmark(INF_TEST_STATE_VECTOR_USERS[i])
+    );
+  }
+
   return 0;
 }
 
@@ -0,0 +1,442 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Synchronizes a text session to several clients at the same time through
+ * simulated connections, which receive what the registry serialized. It
+ * verifies that the synchronization messages are only created once for
+ * all of them, that they are created again after the buffer or the users
+ * of the session changed, and that every client ends up with the same
+ * content and users as the session it was synchronized from. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_SYNC_SNAPSHOT_CLIENTS 3
+
+/* A text session which counts how often its synchronization messages are
+ * created. */
+typedef struct _InfTestSyncSnapshotSession InfTestSyncSnapshotSession;
+struct _InfTestSyncSnapshotSession {
+  InfTextSession parent;
+  guint n_to_xml_sync;
+};
+
+typedef struct _InfTestSyncSnapshotSessionClass
+  InfTestSyncSnapshotSessionClass;
+struct _InfTestSyncSnapshotSessionClass {
+  InfTextSessionClass parent_class;
+};
+
+GType inf_test_sync_snapshot_session_get_type(void) G_GNUC_CONST;
+G_DEFINE_TYPE(InfTestSyncSnapshotSession, inf_test_sync_snapshot_session,
+              INF_TEXT_TYPE_SESSION)
+
+typedef struct _InfTestSyncSnapshotClient InfTestSyncSnapshotClient;
+struct _InfTestSyncSnapshotClient {
+  InfCommunicationManager* manager;
+  InfSimulatedConnection* server_connection;
+  InfSimulatedConnection* client_connection;
+  InfCommunicationJoinedGroup* group;
+  InfSession* session;
+};
+
+typedef struct _InfTestSyncSnapshot InfTestSyncSnapshot;
+struct _InfTestSyncSnapshot {
+  InfStandaloneIo* io;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfTestSyncSnapshotSession* session;
+  InfTextUser* user;
+  gboolean failed;
+};
+
+static void
+inf_test_sync_snapshot_session_to_xml_sync(InfSession* session,
+                                           xmlNodePtr parent)
+{
+  ++((InfTestSyncSnapshotSession*)session)->n_to_xml_sync;
+
+  INF_SESSION_CLASS(inf_test_sync_snapshot_session_parent_class)->
+    to_xml_sync(session, parent);
+}
+
+static void
+inf_test_sync_snapshot_session_init(InfTestSyncSnapshotSession* session)
+{
+  session->n_to_xml_sync = 0;
+}
+
+static void
+inf_test_sync_snapshot_session_class_init(
+  InfTestSyncSnapshotSessionClass* session_class)
+{
+  INF_SESSION_CLASS(session_class)->to_xml_sync =
+    inf_test_sync_snapshot_session_to_xml_sync;
+}
+
+static void
+inf_test_sync_snapshot_failed_cb(InfSession* session,
+                                 InfXmlConnection* connection,
+                                 const GError* error,
+                                 gpointer user_data)
+{
+  InfTestSyncSnapshot* test;
+  test = (InfTestSyncSnapshot*)user_data;
+
+  fprintf(stderr, "Synchronization failed: %s\n", error->message);
+  test->failed = TRUE;
+}
+
+static void
+inf_test_sync_snapshot_client_start(InfTestSyncSnapshot* test,
+                                    InfTestSyncSnapshotClient* client)
+{
+  InfTextBuffer* buffer;
+
+  client->manager = inf_communication_manager_new();
+  client->server_connection =
+    inf_simulated_connection_new_with_io(INF_IO(test->io));
+  client->client_connection =
+    inf_simulated_connection_new_with_io(INF_IO(test->io));
+
+  inf_simulated_connection_connect(
+    client->server_connection,
+    client->client_connection
+  );
+
+  inf_simulated_connection_set_mode(
+    client->server_connection,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  inf_simulated_connection_set_mode(
+    client->client_connection,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  inf_communication_hosted_group_add_member(
+    test->group,
+    INF_XML_CONNECTION(client->server_connection)
+  );
+
+  client->group = inf_communication_manager_join_group(
+    client->manager,
+    "InfTestSyncSnapshot",
+    INF_XML_CONNECTION(client->client_connection),
+    "central"
+  );
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  client->session = INF_SESSION(
+    inf_text_session_new(
+      client->manager,
+      buffer,
+      INF_IO(test->io),
+      INF_SESSION_SYNCHRONIZING,
+      INF_COMMUNICATION_GROUP(client->group),
+      INF_XML_CONNECTION(client->client_connection)
+    )
+  );
+
+  g_object_unref(buffer);
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(client->group),
+    INF_COMMUNICATION_OBJECT(client->session)
+  );
+
+  g_signal_connect(
+    G_OBJECT(client->session),
+    "synchronization-failed",
+    G_CALLBACK(inf_test_sync_snapshot_failed_cb),
+    test
+  );
+
+  inf_session_synchronize_to(
+    INF_SESSION(test->session),
+    INF_COMMUNICATION_GROUP(test->group),
+    INF_XML_CONNECTION(client->server_connection)
+  );
+}
+
+static gboolean
+inf_test_sync_snapshot_client_done(InfTestSyncSnapshot* test,
+                                   InfTestSyncSnapshotClient* client)
+{
+  if(inf_session_get_status(client->session) != INF_SESSION_RUNNING)
+    return FALSE;
+
+  return inf_session_get_synchronization_status(
+    INF_SESSION(test->session),
+    INF_XML_CONNECTION(client->server_connection)
+  ) == INF_SESSION_SYNC_NONE;
+}
+
+static void
+inf_test_sync_snapshot_client_finish(InfTestSyncSnapshot* test,
+                                     InfTestSyncSnapshotClient* client)
+{
+  inf_session_close(client->session);
+  g_object_unref(client->session);
+  g_object_unref(client->group);
+
+  inf_communication_hosted_group_remove_member(
+    test->group,
+    INF_XML_CONNECTION(client->server_connection)
+  );
+
+  inf_xml_connection_close(INF_XML_CONNECTION(client->client_connection));
+  g_object_unref(client->server_connection);
+  g_object_unref(client->client_connection);
+  g_object_unref(client->manager);
+}
+
+/* Returns whether the buffer of session has the same content as the one
+ * of the session of the test. */
+static gboolean
+inf_test_sync_snapshot_check_content(InfTestSyncSnapshot* test,
+                                     InfSession* session)
+{
+  InfTextBuffer* expected_buffer;
+  InfTextBuffer* buffer;
+  InfTextChunk* expected;
+  InfTextChunk* chunk;
+  gboolean result;
+
+  expected_buffer =
+    INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(test->session)));
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+
+  expected = inf_text_buffer_get_slice(
+    expected_buffer,
+    0,
+    inf_text_buffer_get_length(expected_buffer)
+  );
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  result = inf_text_chunk_equal(expected, chunk);
+
+  inf_text_chunk_free(expected);
+  inf_text_chunk_free(chunk);
+  return result;
+}
+
+/* Synchronizes the session to n_clients clients at the same time, and
+ * checks that the synchronization messages were created n_created times
+ * for them. */
+static gboolean
+inf_test_sync_snapshot_run(InfTestSyncSnapshot* test,
+                           guint n_clients,
+                           guint n_created)
+{
+  InfTestSyncSnapshotClient clients[INF_TEST_SYNC_SNAPSHOT_CLIENTS];
+  InfUser* user;
+  guint n_to_xml_sync;
+  gboolean done;
+  gboolean result;
+  guint i;
+
+  g_assert(n_clients <= INF_TEST_SYNC_SNAPSHOT_CLIENTS);
+
+  n_to_xml_sync = test->session->n_to_xml_sync;
+  test->failed = FALSE;
+
+  for(i = 0; i < n_clients; ++i)
+    inf_test_sync_snapshot_client_start(test, &clients[i]);
+
+  do
+  {
+    inf_standalone_io_iteration(test->io);
+
+    done = TRUE;
+    for(i = 0; i < n_clients; ++i)
+      if(!inf_test_sync_snapshot_client_done(test, &clients[i]))
+        done = FALSE;
+  } while(!done && !test->failed);
+
+  result = !test->failed;
+
+  if(result && test->session->n_to_xml_sync - n_to_xml_sync != n_created)
+  {
+    fprintf(
+      stderr,
+      "Synchronization messages were created %u times, expected %u\n",
+      test->session->n_to_xml_sync - n_to_xml_sync,
+      n_created
+    );
+
+    result = FALSE;
+  }
+
+  for(i = 0; result && i < n_clients; ++i)
+  {
+    if(!inf_test_sync_snapshot_check_content(test, clients[i].session))
+    {
+      fprintf(stderr, "Client %u has different content\n", i);
+      result = FALSE;
+    }
+
+    user = inf_user_table_lookup_user_by_id(
+      inf_session_get_user_table(clients[i].session),
+      inf_user_get_id(INF_USER(test->user))
+    );
+
+    if(user == NULL ||
+       inf_text_user_get_hue(INF_TEXT_USER(user)) !=
+       inf_text_user_get_hue(test->user))
+    {
+      fprintf(stderr, "Client %u has different users\n", i);
+      result = FALSE;
+    }
+  }
+
+  for(i = 0; i < n_clients; ++i)
+    inf_test_sync_snapshot_client_finish(test, &clients[i]);
+
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestSyncSnapshot test;
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+  const gchar* const methods[] = { "central", NULL };
+  gboolean result;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.manager = inf_communication_manager_new();
+  test.group = inf_communication_manager_open_group(
+    test.manager,
+    "InfTestSyncSnapshot",
+    methods
+  );
+
+  /* A local user to make changes to the buffer with */
+  test.user = INF_TEXT_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", 1,
+      "name", "local",
+      "status", INF_USER_ACTIVE,
+      "flags", INF_USER_LOCAL,
+      "hue", 0.25,
+      NULL
+    )
+  );
+
+  user_table = inf_user_table_new();
+  inf_user_table_add_user(user_table, INF_USER(test.user));
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  test.session = g_object_new(
+    inf_test_sync_snapshot_session_get_type(),
+    "communication-manager", test.manager,
+    "buffer", buffer,
+    "user-table", user_table,
+    "status", INF_SESSION_RUNNING,
+    "io", test.io,
+    NULL
+  );
+
+  inf_session_set_subscription_group(
+    INF_SESSION(test.session),
+    INF_COMMUNICATION_GROUP(test.group)
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test.group),
+    INF_COMMUNICATION_OBJECT(test.session)
+  );
+
+  inf_text_buffer_insert_text(
+    buffer,
+    0,
+    "Hello World!",
+    12,
+    12,
+    INF_USER(test.user)
+  );
+
+  /* All clients share the same messages */
+  result = inf_test_sync_snapshot_run(&test, INF_TEST_SYNC_SNAPSHOT_CLIENTS, 1);
+
+  /* Nothing changed, so they can be used again */
+  if(result)
+    result = inf_test_sync_snapshot_run(&test, 1, 0);
+
+  /* A change to the buffer */
+  if(result)
+  {
+    inf_text_buffer_insert_text(buffer, 5, ",", 1, 1, INF_USER(test.user));
+    result = inf_test_sync_snapshot_run(&test, 2, 1);
+  }
+
+  /* A change to a user */
+  if(result)
+  {
+    g_object_set(G_OBJECT(test.user), "hue", 0.75, NULL);
+    result = inf_test_sync_snapshot_run(&test, 2, 1);
+  }
+
+  inf_session_close(INF_SESSION(test.session));
+  g_object_unref(test.session);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  g_object_unref(test.user);
+  g_object_unref(test.group);
+  g_object_unref(test.manager);
+  g_object_unref(test.io);
+
+  inf_deinit();
+
+  if(!result)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,286 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Transfers a stream of data over a TCP connection on the loopback
+ * interface, once in small pieces like single requests and once in large
+ * pieces like a session synchronization. It verifies that the data arrives
+ * unchanged, and prints the throughput and the number of send and receive
+ * system calls per MiB for each case. */
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct _InfTestTcpTransfer InfTestTcpTransfer;
+struct _InfTestTcpTransfer {
+  InfStandaloneIo* io;
+  InfTcpConnection* server_connection;
+
+  guint8* data;
+  gsize received;
+  gboolean failed;
+};
+
+static const guint INF_TEST_TCP_TRANSFER_PIECES[] = {
+  64, 16384
+};
+
+/* Do not let more than this amount of data queue up in the sender */
+#define INF_TEST_TCP_TRANSFER_WINDOW (4 * 1024 * 1024)
+
+static void
+inf_test_tcp_transfer_received_cb(InfTcpConnection* connection,
+                                  gconstpointer data,
+                                  guint len,
+                                  gpointer user_data)
+{
+  InfTestTcpTransfer* test;
+  const guint8* bytes;
+  guint i;
+
+  test = (InfTestTcpTransfer*)user_data;
+  bytes = (const guint8*)data;
+
+  for(i = 0; i < len; ++i)
+    if(bytes[i] != (guint8)((test->received + i) % 251))
+      test->failed = TRUE;
+
+  test->received += len;
+}
+
+static void
+inf_test_tcp_transfer_new_connection_cb(InfdTcpServer* server,
+                                        InfTcpConnection* connection,
+                                        gpointer user_data)
+{
+  InfTestTcpTransfer* test;
+  test = (InfTestTcpTransfer*)user_data;
+
+  g_assert(test->server_connection == NULL);
+  test->server_connection = connection;
+  g_object_ref(connection);
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_tcp_transfer_received_cb),
+    test
+  );
+}
+
+/* Sends total bytes to port in pieces of piece bytes, and prints the
+ * results. Returns FALSE on error. */
+static gboolean
+inf_test_tcp_transfer_run(InfTestTcpTransfer* test,
+                          InfIpAddress* addr,
+                          guint port,
+                          gsize total,
+                          guint piece)
+{
+  InfTcpConnection* client;
+  InfTcpConnectionStatus status;
+  GError* error;
+  gint64 start;
+  gint64 elapsed;
+  gsize sent;
+  guint64 send_calls;
+  guint64 receive_calls;
+  guint receive_buffer_size;
+
+  test->server_connection = NULL;
+  test->received = 0;
+  test->failed = FALSE;
+
+  client = inf_tcp_connection_new(INF_IO(test->io), addr, port);
+
+  error = NULL;
+  if(inf_tcp_connection_open(client, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not connect: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(client);
+    return FALSE;
+  }
+
+  do
+  {
+    inf_standalone_io_iteration(test->io);
+    g_object_get(G_OBJECT(client), "status", &status, NULL);
+  } while(status == INF_TCP_CONNECTION_CONNECTING ||
+          test->server_connection == NULL);
+
+  if(status != INF_TCP_CONNECTION_CONNECTED)
+  {
+    fprintf(stderr, "Could not connect\n");
+    g_object_unref(client);
+    return FALSE;
+  }
+
+  start = g_get_monotonic_time();
+
+  for(sent = 0; sent < total && !test->failed; sent += piece)
+  {
+    inf_tcp_connection_send(client, test->data + sent % 251, piece);
+
+    while(sent + piece - test->received > INF_TEST_TCP_TRANSFER_WINDOW &&
+          !test->failed)
+    {
+      inf_standalone_io_iteration(test->io);
+    }
+  }
+
+  while(test->received < total && !test->failed)
+    inf_standalone_io_iteration(test->io);
+
+  elapsed = g_get_monotonic_time() - start;
+
+  g_object_get(G_OBJECT(client), "send-calls", &send_calls, NULL);
+
+  g_object_get(
+    G_OBJECT(test->server_connection),
+    "receive-calls", &receive_calls,
+    "receive-buffer-size", &receive_buffer_size,
+    NULL
+  );
+
+  inf_tcp_connection_close(client);
+  g_object_unref(client);
+
+  inf_tcp_connection_close(test->server_connection);
+  g_object_unref(test->server_connection);
+
+  if(test->failed)
+  {
+    fprintf(stderr, "Received data does not match sent data\n");
+    return FALSE;
+  }
+
+  printf(
+    "%10u  %12.1f  %17.1f  %20.1f  %14u\n",
+    piece,
+    (double)total / 1048576.0 / ((double)elapsed / 1e6),
+    (double)send_calls * 1048576.0 / total,
+    (double)receive_calls * 1048576.0 / total,
+    receive_buffer_size
+  );
+
+  return TRUE;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestTcpTransfer test;
+  InfdTcpServer* server;
+  InfIpAddress* addr;
+  guint port;
+  gsize total;
+  gsize size;
+  gboolean result;
+  guint i;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  total = 64;
+  if(argc > 1)
+    total = atoi(argv[1]);
+  total *= 1024 * 1024;
+
+  /* The data at offset n is n % 251, so that a piece starting at any offset
+   * can be taken from the same buffer. */
+  size = INF_TEST_TCP_TRANSFER_PIECES[
+    G_N_ELEMENTS(INF_TEST_TCP_TRANSFER_PIECES) - 1
+  ] + 251;
+
+  test.data = g_malloc(size);
+  for(i = 0; i < size; ++i)
+    test.data[i] = (guint8)(i % 251);
+
+  test.io = inf_standalone_io_new();
+  addr = inf_ip_address_new_loopback4();
+
+  server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test.io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  if(infd_tcp_server_open(server, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    inf_ip_address_free(addr);
+    g_object_unref(server);
+    g_object_unref(test.io);
+    g_free(test.data);
+    return EXIT_FAILURE;
+  }
+
+  g_object_get(G_OBJECT(server), "local-port", &port, NULL);
+
+  g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_tcp_transfer_new_connection_cb),
+    &test
+  );
+
+  printf("piece size  rate (MiB/s)  send calls (/MiB)  receive calls (/MiB)"
+         "  receive buffer\n");
+
+  result = TRUE;
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_TCP_TRANSFER_PIECES) && result; ++i)
+  {
+    /* Make the total a multiple of the piece size */
+    result = inf_test_tcp_transfer_run(
+      &test,
+      addr,
+      port,
+      total - total % INF_TEST_TCP_TRANSFER_PIECES[i],
+      INF_TEST_TCP_TRANSFER_PIECES[i]
+    );
+  }
+
+  infd_tcp_server_close(server);
+  g_object_unref(server);
+  inf_ip_address_free(addr);
+  g_object_unref(test.io);
+  g_free(test.data);
+
+  if(!result)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
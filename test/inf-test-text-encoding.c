@@ -0,0 +1,422 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Reads and writes all requests of the test files in the session/
+ * subdirectory with InfTextSession, and measures how long this takes per
+ * request. This is done once for a buffer in UTF-8, for which no conversion
+ * is necessary, and once for a buffer in UTF-16, for which the text of every
+ * request is converted with iconv. Both must result in the same XML. */
+
+#include "util/inf-test-util.h"
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* How many times to read and write each request for the measurement */
+#define INF_TEST_TEXT_ENCODING_ITERATIONS 200
+
+static const gchar* const INF_TEST_TEXT_ENCODING_ENCODINGS[] = {
+  "UTF-8",
+  "UTF-16LE"
+};
+
+#define INF_TEST_TEXT_ENCODING_N_ENCODINGS \
+  G_N_ELEMENTS(INF_TEST_TEXT_ENCODING_ENCODINGS)
+
+typedef struct _InfTestTextEncodingResult InfTestTextEncodingResult;
+struct _InfTestTextEncodingResult {
+  guint total;
+  guint passed;
+  guint n_requests;
+  gdouble time[INF_TEST_TEXT_ENCODING_N_ENCODINGS];
+};
+
+static InfTextSession*
+inf_test_text_encoding_create_session(const gchar* encoding,
+                                      GSList* users)
+{
+  InfTextBuffer* buffer;
+  InfCommunicationManager* manager;
+  InfIo* io;
+  InfUserTable* user_table;
+  InfTextSession* session;
+  InfTextUser* user;
+  gchar* user_name;
+  GSList* item;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new(encoding));
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+  user_table = inf_user_table_new();
+
+  for(item = users; item != NULL; item = g_slist_next(item))
+  {
+    user_name = g_strdup_printf("User_%u", GPOINTER_TO_UINT(item->data));
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", GPOINTER_TO_UINT(item->data),
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(buffer);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(user_table);
+  return session;
+}
+
+/* Reads the request in xml with session and writes it back. Returns the
+ * resulting XML as a string, or NULL on error. */
+static gchar*
+inf_test_text_encoding_round_trip(InfTextSession* session,
+                                  xmlNodePtr xml,
+                                  GError** error)
+{
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  xmlNodePtr result;
+  xmlBufferPtr buffer;
+  gchar* str;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+
+  request = session_class->xml_to_request(
+    INF_ADOPTED_SESSION(session),
+    xml,
+    NULL,
+    FALSE,
+    error
+  );
+
+  if(request == NULL)
+    return NULL;
+
+  result = xmlNewNode(NULL, (const xmlChar*)"request");
+  session_class->request_to_xml(
+    INF_ADOPTED_SESSION(session),
+    result,
+    request,
+    NULL,
+    FALSE
+  );
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, NULL, result, 0, 0);
+  str = g_strdup((const gchar*)xmlBufferContent(buffer));
+
+  xmlBufferFree(buffer);
+  xmlFreeNode(result);
+  g_object_unref(request);
+  return str;
+}
+
+/* Returns the time in seconds it takes to read and write all requests
+ * INF_TEST_TEXT_ENCODING_ITERATIONS times. */
+static gdouble
+inf_test_text_encoding_measure(InfTextSession* session,
+                               GSList* requests)
+{
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  xmlNodePtr result;
+  GSList* item;
+  GTimer* timer;
+  gdouble elapsed;
+  guint i;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  timer = g_timer_new();
+
+  for(i = 0; i < INF_TEST_TEXT_ENCODING_ITERATIONS; ++i)
+  {
+    for(item = requests; item != NULL; item = item->next)
+    {
+      request = session_class->xml_to_request(
+        INF_ADOPTED_SESSION(session),
+        (xmlNodePtr)item->data,
+        NULL,
+        FALSE,
+        NULL
+      );
+
+      g_assert(request != NULL);
+
+      result = xmlNewNode(NULL, (const xmlChar*)"request");
+      session_class->request_to_xml(
+        INF_ADOPTED_SESSION(session),
+        result,
+        request,
+        NULL,
+        FALSE
+      );
+
+      xmlFreeNode(result);
+      g_object_unref(request);
+    }
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return elapsed;
+}
+
+static gboolean
+inf_test_text_encoding_perform(GSList* users,
+                               GSList* requests,
+                               InfTestTextEncodingResult* result)
+{
+  InfTextSession* sessions[INF_TEST_TEXT_ENCODING_N_ENCODINGS];
+  gchar* expected;
+  gchar* xml;
+  GSList* item;
+  GError* error;
+  gboolean retval;
+  guint i;
+
+  for(i = 0; i < INF_TEST_TEXT_ENCODING_N_ENCODINGS; ++i)
+  {
+    sessions[i] = inf_test_text_encoding_create_session(
+      INF_TEST_TEXT_ENCODING_ENCODINGS[i],
+      users
+    );
+  }
+
+  /* First make sure that all encodings produce the same result */
+  error = NULL;
+  retval = TRUE;
+  for(item = requests; item != NULL && retval == TRUE; item = item->next)
+  {
+    expected = NULL;
+    for(i = 0; i < INF_TEST_TEXT_ENCODING_N_ENCODINGS; ++i)
+    {
+      xml = inf_test_text_encoding_round_trip(
+        sessions[i],
+        (xmlNodePtr)item->data,
+        &error
+      );
+
+      if(xml == NULL)
+      {
+        printf(
+          "%s: %s ",
+          INF_TEST_TEXT_ENCODING_ENCODINGS[i],
+          error->message
+        );
+
+        g_error_free(error);
+        error = NULL;
+
+        retval = FALSE;
+        break;
+      }
+
+      if(expected == NULL)
+      {
+        expected = xml;
+      }
+      else
+      {
+        if(strcmp(expected, xml) != 0)
+        {
+          printf("(%s vs. %s) ", expected, xml);
+          retval = FALSE;
+        }
+
+        g_free(xml);
+      }
+    }
+
+    g_free(expected);
+  }
+
+  if(retval == TRUE)
+  {
+    for(i = 0; i < INF_TEST_TEXT_ENCODING_N_ENCODINGS; ++i)
+      result->time[i] += inf_test_text_encoding_measure(sessions[i], requests);
+
+    result->n_requests +=
+      g_slist_length(requests) * INF_TEST_TEXT_ENCODING_ITERATIONS;
+  }
+
+  for(i = 0; i < INF_TEST_TEXT_ENCODING_N_ENCODINGS; ++i)
+    g_object_unref(sessions[i]);
+
+  return retval;
+}
+
+static void
+inf_test_text_encoding_foreach_test_func(const gchar* testfile,
+                                         gpointer user_data)
+{
+  InfTestTextEncodingResult* result;
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  GSList* requests;
+  GSList* users;
+  GError* error;
+
+  /* Only process XML files, not the Makefiles or other stuff */
+  if(!g_str_has_suffix(testfile, ".xml"))
+    return;
+
+  result = (InfTestTextEncodingResult*)user_data;
+  doc = xmlParseFile(testfile);
+  if(doc == NULL)
+    return;
+
+  requests = NULL;
+  users = NULL;
+  error = NULL;
+
+  printf("%s... ", testfile);
+  fflush(stdout);
+
+  ++result->total;
+
+  root = xmlDocGetRootElement(doc);
+  for(child = root->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+
+    if(strcmp((const char*)child->name, "user") == 0)
+    {
+      if(inf_test_util_parse_user(child, &users, &error) == FALSE)
+        break;
+    }
+    else if(strcmp((const char*)child->name, "request") == 0)
+    {
+      requests = g_slist_prepend(requests, child);
+    }
+  }
+
+  if(error != NULL)
+  {
+    printf("Failed to parse: %s\n", error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    requests = g_slist_reverse(requests);
+
+    if(inf_test_text_encoding_perform(users, requests, result))
+    {
+      ++result->passed;
+      printf("OK\n");
+    }
+    else
+    {
+      printf("FAILED\n");
+    }
+  }
+
+  g_slist_free(requests);
+  g_slist_free(users);
+  xmlFreeDoc(doc);
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestTextEncodingResult result;
+  const char* dir;
+  GError* error;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  if(argc > 1)
+    dir = argv[1];
+  else
+    dir = "session";
+
+  result.total = 0;
+  result.passed = 0;
+  result.n_requests = 0;
+  for(i = 0; i < INF_TEST_TEXT_ENCODING_N_ENCODINGS; ++i)
+    result.time[i] = 0.0;
+
+  if(!inf_test_util_dir_foreach(
+       dir,
+       inf_test_text_encoding_foreach_test_func,
+       &result,
+       &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  printf("%u out of %u tests passed\n", result.passed, result.total);
+
+  if(result.n_requests > 0)
+  {
+    for(i = 0; i < INF_TEST_TEXT_ENCODING_N_ENCODINGS; ++i)
+    {
+      printf(
+        "%s: %.3g us per request\n",
+        INF_TEST_TEXT_ENCODING_ENCODINGS[i],
+        result.time[i] * 1e6 / result.n_requests
+      );
+    }
+  }
+
+  inf_deinit();
+
+  if(result.passed < result.total)
+    return -1;
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,466 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Writes a large text document with several authors into a filesystem
+ * storage, reads it back incrementally with InfTextFilesystemFormatReader
+ * and verifies that the result matches the original. It prints the time it
+ * took to read the document, the number of read steps, and by how much the
+ * peak memory usage of the process grew while reading. It also verifies
+ * that malformed documents are rejected. */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#ifndef G_OS_WIN32
+# include <sys/resource.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const gchar* const INF_TEST_TEXT_LOAD_USERS[] = {
+  "alice", "bob & carol", "<dave>"
+};
+
+/* Characters which the document is made of. \001 is not allowed in XML and
+ * written as <uchar/>, the others need to be escaped or are multibyte. */
+static const gchar* const INF_TEST_TEXT_LOAD_CHARS[] = {
+  "a", "b", "c", " ", "\n", "&", "<", "\303\251", "\342\202\254", "\001"
+};
+
+/* Returns the peak memory usage of the process in KiB, or 0 if it is not
+ * known. */
+static long
+inf_test_text_load_get_max_rss(void)
+{
+#ifndef G_OS_WIN32
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+  return 0;
+}
+
+static void
+inf_test_text_load_append(InfTextBuffer* buffer,
+                          InfUser* author,
+                          guint chars)
+{
+  GString* text;
+  guint i;
+
+  text = g_string_sized_new(chars);
+  for(i = 0; i < chars; ++i)
+  {
+    g_string_append(
+      text,
+      INF_TEST_TEXT_LOAD_CHARS[
+        g_random_int_range(0, G_N_ELEMENTS(INF_TEST_TEXT_LOAD_CHARS))
+      ]
+    );
+  }
+
+  inf_text_buffer_insert_text(
+    buffer,
+    inf_text_buffer_get_length(buffer),
+    text->str,
+    text->len,
+    chars,
+    author
+  );
+
+  g_string_free(text, TRUE);
+}
+
+/* Fills buffer with text in segments of random length and author, so that
+ * the file is about size bytes large. The first segment is longer than a
+ * read block. */
+static void
+inf_test_text_load_fill(InfTextBuffer* buffer,
+                        InfUserTable* user_table,
+                        gsize size)
+{
+  InfUser* author;
+  guint id;
+
+  inf_test_text_load_append(
+    buffer,
+    inf_user_table_lookup_user_by_id(user_table, 1),
+    200 * 1024
+  );
+
+  /* A character takes about four bytes in the file on average, mostly
+   * because of the <uchar/> elements. */
+  while(inf_text_buffer_get_length(buffer) < size / 4)
+  {
+    /* Author 0 means no author */
+    id = g_random_int_range(0, G_N_ELEMENTS(INF_TEST_TEXT_LOAD_USERS) + 1);
+    author = NULL;
+    if(id != 0)
+      author = inf_user_table_lookup_user_by_id(user_table, id);
+
+    inf_test_text_load_append(
+      buffer,
+      author,
+      g_random_int_range(1, 2000)
+    );
+  }
+}
+
+static gboolean
+inf_test_text_load_chunk_equal(InfTextChunk* chunk1,
+                               InfTextChunk* chunk2)
+{
+  InfTextChunkIter iter1;
+  InfTextChunkIter iter2;
+  gboolean result1;
+  gboolean result2;
+
+  result1 = inf_text_chunk_iter_init_begin(chunk1, &iter1);
+  result2 = inf_text_chunk_iter_init_begin(chunk2, &iter2);
+
+  while(result1 && result2)
+  {
+    if(inf_text_chunk_iter_get_author(&iter1) !=
+       inf_text_chunk_iter_get_author(&iter2))
+    {
+      return FALSE;
+    }
+
+    if(inf_text_chunk_iter_get_bytes(&iter1) !=
+       inf_text_chunk_iter_get_bytes(&iter2))
+    {
+      return FALSE;
+    }
+
+    if(memcmp(inf_text_chunk_iter_get_text(&iter1),
+              inf_text_chunk_iter_get_text(&iter2),
+              inf_text_chunk_iter_get_bytes(&iter1)) != 0)
+    {
+      return FALSE;
+    }
+
+    result1 = inf_text_chunk_iter_next(&iter1);
+    result2 = inf_text_chunk_iter_next(&iter2);
+  }
+
+  return result1 == result2;
+}
+
+static gboolean
+inf_test_text_load_verify(InfTextBuffer* buffer,
+                          InfUserTable* user_table,
+                          InfTextBuffer* loaded_buffer,
+                          InfUserTable* loaded_user_table)
+{
+  InfTextChunk* chunk;
+  InfTextChunk* loaded_chunk;
+  InfUser* user;
+  gboolean result;
+  guint i;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_TEXT_LOAD_USERS); ++i)
+  {
+    user = inf_user_table_lookup_user_by_id(loaded_user_table, i + 1);
+    if(user == NULL ||
+       strcmp(inf_user_get_name(user), INF_TEST_TEXT_LOAD_USERS[i]) != 0)
+    {
+      fprintf(stderr, "User %u was not loaded correctly\n", i + 1);
+      return FALSE;
+    }
+  }
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  loaded_chunk = inf_text_buffer_get_slice(
+    loaded_buffer,
+    0,
+    inf_text_buffer_get_length(loaded_buffer)
+  );
+
+  result = inf_test_text_load_chunk_equal(chunk, loaded_chunk);
+  if(result == FALSE)
+    fprintf(stderr, "Loaded document does not match written document\n");
+
+  inf_text_chunk_free(chunk);
+  inf_text_chunk_free(loaded_chunk);
+  return result;
+}
+
+static gboolean
+inf_test_text_load_run(InfdFilesystemStorage* storage,
+                       gsize size)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfUserTable* loaded_user_table;
+  InfTextBuffer* loaded_buffer;
+  InfTextFilesystemFormatReader* reader;
+  InfUser* user;
+  GError* error;
+  guint n_steps;
+  gint64 start;
+  gint64 elapsed;
+  long max_rss;
+  guint64 file_size;
+  gboolean result;
+  guint i;
+
+  user_table = inf_user_table_new();
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_TEXT_LOAD_USERS); ++i)
+  {
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i + 1,
+        "name", INF_TEST_TEXT_LOAD_USERS[i],
+        "hue", 0.25 * i,
+        NULL
+      )
+    );
+
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+  }
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  inf_test_text_load_fill(buffer, user_table, size);
+
+  error = NULL;
+  result = inf_text_filesystem_format_write(
+    storage,
+    "load",
+    user_table,
+    buffer,
+    NULL,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    fprintf(stderr, "Failed to write document: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(buffer);
+    g_object_unref(user_table);
+    return FALSE;
+  }
+
+  loaded_user_table = inf_user_table_new();
+  loaded_buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  max_rss = inf_test_text_load_get_max_rss();
+  start = g_get_monotonic_time();
+
+  reader = inf_text_filesystem_format_reader_new(
+    storage,
+    "load",
+    loaded_user_table,
+    loaded_buffer,
+    &error
+  );
+
+  n_steps = 0;
+  file_size = 0;
+  if(reader != NULL)
+  {
+    file_size = inf_text_filesystem_format_reader_get_size(reader);
+
+    do
+    {
+      ++n_steps;
+      result = inf_text_filesystem_format_reader_read_next(reader, &error);
+    } while(result == TRUE);
+
+    g_assert(
+      error != NULL ||
+      inf_text_filesystem_format_reader_get_position(reader) == file_size
+    );
+
+    inf_text_filesystem_format_reader_free(reader);
+  }
+
+  elapsed = g_get_monotonic_time() - start;
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "Failed to read document: %s\n", error->message);
+    g_error_free(error);
+    result = FALSE;
+  }
+  else
+  {
+    printf(
+      "%8.1f MiB  %9.1f ms  %10u  %24ld\n",
+      (double)file_size / 1048576.0,
+      (double)elapsed / 1e3,
+      n_steps,
+      inf_test_text_load_get_max_rss() - max_rss
+    );
+
+    result = inf_test_text_load_verify(
+      buffer,
+      user_table,
+      loaded_buffer,
+      loaded_user_table
+    );
+  }
+
+  g_object_unref(loaded_buffer);
+  g_object_unref(loaded_user_table);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+/* Verifies that reading content from the storage fails */
+static gboolean
+inf_test_text_load_run_invalid(InfdFilesystemStorage* storage,
+                               const gchar* content)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  GError* error;
+  gchar* full_path;
+  gboolean result;
+
+  error = NULL;
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText",
+    "invalid",
+    &error
+  );
+
+  if(full_path == NULL ||
+     !g_file_set_contents(full_path, content, -1, &error))
+  {
+    fprintf(stderr, "Failed to write document: %s\n", error->message);
+    g_error_free(error);
+    g_free(full_path);
+    return FALSE;
+  }
+
+  g_free(full_path);
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  result = inf_text_filesystem_format_read(
+    storage,
+    "invalid",
+    user_table,
+    buffer,
+    &error
+  );
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+
+  if(result == TRUE)
+  {
+    fprintf(stderr, "Invalid document was read successfully:\n%s\n",
+            content);
+    return FALSE;
+  }
+
+  g_error_free(error);
+  return TRUE;
+}
+
+int
+main(int argc, char* argv[])
+{
+  static const gchar* const INVALID[] = {
+    "",
+    "<inf-chat-session/>",
+    "<inf-text-session><buffer><segment author=\"0\">abc</segment>",
+    "<inf-text-session><buffer><segment author=\"1\">abc</segment>"
+      "</buffer></inf-text-session>",
+    "<inf-text-session><user id=\"1\" name=\"a\" hue=\"0\"/>"
+      "<user id=\"1\" name=\"b\" hue=\"0\"/></inf-text-session>"
+  };
+
+  InfdFilesystemStorage* storage;
+  GError* error;
+  gchar* root;
+  gsize size;
+  gboolean result;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  size = 8;
+  if(argc > 1)
+    size = atoi(argv[1]);
+  size *= 1024 * 1024;
+
+  root = g_dir_make_tmp("inf-test-text-load-XXXXXX", &error);
+  if(root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  storage = infd_filesystem_storage_new(root);
+
+  printf(
+    "%12s  %12s  %10s  %24s\n",
+    "size", "time", "read steps", "peak memory growth (KiB)"
+  );
+
+  result = inf_test_text_load_run(storage, size);
+
+  for(i = 0; i < G_N_ELEMENTS(INVALID) && result; ++i)
+    result = inf_test_text_load_run_invalid(storage, INVALID[i]);
+
+  g_object_unref(storage);
+
+  if(!inf_file_util_delete_directory(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(root);
+  inf_deinit();
+
+  if(!result)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */
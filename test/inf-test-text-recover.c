@@ -17,15 +17,46 @@
  * MA 02110-1301, USA.
  */
 
+/* Without options, replays a record and prints the document before the
+ * given occurrence of an erasure of most of the document, in order to
+ * recover content that has been deleted accidentally.
+ *
+ * With --journal, crash-tests InfTextJournal instead: the record is
+ * replayed into a filesystem storage with a journal, with snapshots written
+ * at random points in between. At a random request, the server "crashes",
+ * that is all objects are dropped without saving. Sometimes, the crash also
+ * leaves a partially written record at the end of the journal, or happens
+ * between writing a snapshot and compacting the journal. The session is
+ * then recovered from the storage, and must match the state at the time of
+ * the crash. */
+
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-default-buffer.h>
 #include <libinftext/inf-text-insert-operation.h>
 #include <libinftext/inf-text-delete-operation.h>
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-journal.h>
 #include <libinfinity/adopted/inf-adopted-session-replay.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
 #include <libinfinity/common/inf-init.h>
 
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+typedef struct _InfTestTextRecoverJournal InfTestTextRecoverJournal;
+struct _InfTestTextRecoverJournal {
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  const gchar* record;
+
+  InfAsyncOperation* save;
+  GError* save_error;
+};
+
 static void
 inf_test_util_print_buffer(InfTextBuffer* buffer)
 {
@@ -120,6 +151,417 @@ inf_test_text_recover_text_erased_cb(InfTextBuffer* buffer,
   g_object_unref(buffer);
 }
 
+/*
+ * Journal crash test
+ */
+
+/* Returns the buffer content with the author of each run of text, so that
+ * buffers can be compared independently of how the text is split into
+ * segments. */
+static gchar*
+inf_test_text_recover_buffer_to_string(InfTextBuffer* buffer)
+{
+  InfTextChunk* chunk;
+  InfTextChunkIter iter;
+  GString* str;
+  guint author;
+  gboolean first;
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  str = g_string_new(NULL);
+  first = TRUE;
+  author = 0;
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      if(first || inf_text_chunk_iter_get_author(&iter) != author)
+      {
+        author = inf_text_chunk_iter_get_author(&iter);
+        g_string_append_printf(str, "[%u]", author);
+        first = FALSE;
+      }
+
+      g_string_append_len(
+        str,
+        inf_text_chunk_iter_get_text(&iter),
+        inf_text_chunk_iter_get_bytes(&iter)
+      );
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  inf_text_chunk_free(chunk);
+  return g_string_free(str, FALSE);
+}
+
+static InfAdoptedSessionReplay*
+inf_test_text_recover_replay_new(const gchar* record,
+                                 GError** error)
+{
+  InfAdoptedSessionReplay* replay;
+
+  replay = inf_adopted_session_replay_new();
+  if(!inf_adopted_session_replay_set_record(replay, record,
+                                            &INF_TEST_TEXT_RECOVER_TEXT_PLUGIN,
+                                            error))
+  {
+    g_object_unref(replay);
+    return NULL;
+  }
+
+  return replay;
+}
+
+/* Returns the number of requests in the record, or -1 on error */
+static gint
+inf_test_text_recover_count_steps(const gchar* record,
+                                  GError** error)
+{
+  InfAdoptedSessionReplay* replay;
+  gint n_steps;
+
+  replay = inf_test_text_recover_replay_new(record, error);
+  if(replay == NULL)
+    return -1;
+
+  n_steps = 0;
+  while(inf_adopted_session_replay_play_next(replay, error))
+    ++n_steps;
+
+  g_object_unref(replay);
+
+  if(error != NULL && *error != NULL)
+    return -1;
+  return n_steps;
+}
+
+static void
+inf_test_text_recover_save_func(const GError* error,
+                                gpointer user_data)
+{
+  InfTestTextRecoverJournal* test;
+  test = (InfTestTextRecoverJournal*)user_data;
+
+  test->save = NULL;
+  if(error != NULL)
+    test->save_error = g_error_copy(error);
+}
+
+/* Appends the beginning of a record to the journal, as if the process had
+ * crashed while writing it. */
+static gboolean
+inf_test_text_recover_tear_journal(const gchar* journal_path)
+{
+  static const gchar RECORD[] =
+    "999\n<request seq=\"18446744073709551615\"><delete pos=\"0\" len=\"1\"/>";
+  FILE* file;
+
+  file = g_fopen(journal_path, "ab");
+  if(file == NULL)
+    return FALSE;
+
+  fwrite(RECORD, 1, g_random_int_range(1, sizeof(RECORD)), file);
+  fclose(file);
+  return TRUE;
+}
+
+/* Replays the record up to crash_step into the storage, crashes, and then
+ * verifies that the session can be recovered. */
+static gboolean
+inf_test_text_recover_crash(InfTestTextRecoverJournal* test,
+                            const gchar* path,
+                            gint crash_step,
+                            GError** error)
+{
+  InfAdoptedSessionReplay* replay;
+  InfSession* session;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextJournal* journal;
+  gchar* journal_path;
+  gchar* old_journal;
+  gsize old_journal_len;
+  gboolean just_saved;
+  gboolean result;
+  gchar* expected;
+  gchar* recovered;
+  gint step;
+
+  journal = NULL;
+  old_journal = NULL;
+  old_journal_len = 0;
+  expected = NULL;
+
+  replay = inf_test_text_recover_replay_new(test->record, error);
+  if(replay == NULL)
+    return FALSE;
+
+  session = INF_SESSION(inf_adopted_session_replay_get_session(replay));
+  user_table = inf_session_get_user_table(session);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+
+  journal_path = infd_filesystem_storage_get_path(
+    test->storage,
+    "InfText.journal",
+    path,
+    error
+  );
+
+  g_assert(journal_path != NULL);
+
+  /* Like the note-text plugin of infinoted does */
+  journal = inf_text_filesystem_format_open_journal(
+    test->storage,
+    path,
+    INF_TEXT_SESSION(session),
+    error
+  );
+
+  result = FALSE;
+  if(journal == NULL)
+    goto out;
+
+  if(!inf_text_filesystem_format_write(test->storage, path, user_table,
+                                       buffer, journal, error))
+  {
+    goto out;
+  }
+
+  just_saved = FALSE;
+
+  for(step = 0; step < crash_step; ++step)
+  {
+    if(!inf_adopted_session_replay_play_next(replay, error))
+      goto out;
+
+    just_saved = FALSE;
+
+    if(test->save != NULL)
+    {
+      /* Keep the asynchronous save running for a few requests */
+      if(g_random_int_range(0, 3) == 0)
+      {
+        while(test->save != NULL)
+          inf_standalone_io_iteration(test->io);
+
+        if(test->save_error != NULL)
+        {
+          g_propagate_error(error, test->save_error);
+          test->save_error = NULL;
+          goto out;
+        }
+      }
+    }
+    else if(g_random_int_range(0, 10) == 0)
+    {
+      g_free(old_journal);
+      old_journal = NULL;
+
+      if(!g_file_get_contents(journal_path, &old_journal, &old_journal_len,
+                              error))
+      {
+        goto out;
+      }
+
+      if(g_random_boolean())
+      {
+        if(!inf_text_filesystem_format_write(test->storage, path,
+                                             user_table, buffer, journal,
+                                             error))
+        {
+          goto out;
+        }
+
+        just_saved = TRUE;
+      }
+      else
+      {
+        test->save = inf_text_filesystem_format_write_async(
+          test->storage,
+          INF_IO(test->io),
+          path,
+          user_table,
+          buffer,
+          journal,
+          inf_test_text_recover_save_func,
+          test,
+          error
+        );
+
+        if(test->save == NULL)
+          goto out;
+      }
+    }
+  }
+
+  /* Crash */
+  expected = inf_test_text_recover_buffer_to_string(buffer);
+
+  if(test->save != NULL)
+  {
+    inf_async_operation_free(test->save);
+    test->save = NULL;
+  }
+
+  g_object_unref(journal);
+  journal = NULL;
+  g_object_unref(replay);
+  replay = NULL;
+
+  /* Crashed after the new snapshot has been renamed into place, but before
+   * the journal has been compacted */
+  if(just_saved && g_random_boolean())
+  {
+    if(!g_file_set_contents(journal_path, old_journal, old_journal_len,
+                            error))
+    {
+      goto out;
+    }
+  }
+
+  /* Crashed while writing a record */
+  if(g_random_boolean())
+  {
+    if(!inf_test_text_recover_tear_journal(journal_path))
+    {
+      g_set_error_literal(error, G_FILE_ERROR, 0, "Failed to tear journal");
+      goto out;
+    }
+  }
+
+  /* Recover */
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  result = inf_text_filesystem_format_read(
+    test->storage,
+    path,
+    user_table,
+    buffer,
+    error
+  );
+
+  if(result == TRUE)
+  {
+    recovered = inf_test_text_recover_buffer_to_string(buffer);
+    if(strcmp(expected, recovered) != 0)
+    {
+      g_set_error(
+        error,
+        g_quark_from_static_string("INF_TEST_TEXT_RECOVER_ERROR"),
+        0,
+        "Recovered document does not match the document at request %d",
+        crash_step
+      );
+
+      result = FALSE;
+    }
+
+    g_free(recovered);
+  }
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+
+out:
+  if(test->save != NULL)
+  {
+    inf_async_operation_free(test->save);
+    test->save = NULL;
+  }
+
+  if(journal != NULL)
+    g_object_unref(journal);
+  if(replay != NULL)
+    g_object_unref(replay);
+
+  g_free(old_journal);
+  g_free(expected);
+  g_free(journal_path);
+  return result;
+}
+
+static int
+inf_test_text_recover_journal(const gchar* record,
+                              guint n_trials)
+{
+  InfTestTextRecoverJournal test;
+  GError* error;
+  gchar* root;
+  gchar* path;
+  gint n_steps;
+  gint crash_step;
+  guint i;
+  int ret;
+
+  error = NULL;
+  n_steps = inf_test_text_recover_count_steps(record, &error);
+  if(n_steps < 0)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  root = g_dir_make_tmp("inf-test-text-recover-XXXXXX", &error);
+  if(root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.storage = infd_filesystem_storage_new(root);
+  test.record = record;
+  test.save = NULL;
+  test.save_error = NULL;
+
+  ret = 0;
+  for(i = 0; i < n_trials && ret == 0; ++i)
+  {
+    crash_step = g_random_int_range(0, n_steps + 1);
+    path = g_strdup_printf("trial-%u", i);
+
+    printf("Crash after request %d of %d... ", crash_step, n_steps);
+    fflush(stdout);
+
+    if(!inf_test_text_recover_crash(&test, path, crash_step, &error))
+    {
+      printf("FAILED\n");
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      error = NULL;
+
+      ret = -1;
+    }
+    else
+    {
+      printf("OK\n");
+    }
+
+    g_free(path);
+  }
+
+  g_object_unref(test.storage);
+  g_object_unref(test.io);
+
+  if(!inf_file_util_delete_directory(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(root);
+  return ret;
+}
+
 /*
  * Entry point
  */
@@ -135,16 +577,15 @@ int main(int argc, char* argv[])
   InfBuffer* buffer;
   GSList* item;
   gint counter;
+  guint n_trials;
 
   if(argc < 2)
   {
     fprintf(stderr, "Usage: %s <record-file> [index]\n", argv[0]);
+    fprintf(stderr, "       %s --journal <record-file> [trials]\n", argv[0]);
     return -1;
   }
 
-  counter = 0;
-  if(argc > 2) counter = atoi(argv[2]);
-
   error = NULL;
   if(!inf_init(&error))
   {
@@ -153,6 +594,23 @@ int main(int argc, char* argv[])
     return -1;
   }
 
+  if(strcmp(argv[1], "--journal") == 0)
+  {
+    if(argc < 3)
+    {
+      fprintf(stderr, "Usage: %s --journal <record-file> [trials]\n", argv[0]);
+      return -1;
+    }
+
+    n_trials = 20;
+    if(argc > 3) n_trials = atoi(argv[3]);
+
+    return inf_test_text_recover_journal(argv[2], n_trials);
+  }
+
+  counter = 0;
+  if(argc > 2) counter = atoi(argv[2]);
+
   ret = 0;
   for(i = 1; i < 2; ++ i)
   {
@@ -17,6 +17,15 @@
  * MA 02110-1301, USA.
  */
 
+/* Replays one or more records as recorded with InfAdoptedSessionRecord and
+ * prints the resulting documents.
+ *
+ * With --shuffle, each record is replayed a second time with the requests
+ * of different users interleaved randomly, so that many of them arrive
+ * before the requests they depend on and have to be buffered by the
+ * session. The resulting document must be the same as when replaying the
+ * record in order. */
+
 #include "util/inf-test-util.h"
 
 #include <libinftext/inf-text-session.h>
@@ -29,9 +38,18 @@
 #include <libinftext/inf-text-delete-operation.h>
 #include <libinfinity/adopted/inf-adopted-session-replay.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-init.h>
 
+#include <glib/gstdio.h>
+
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+/* The maximum number of requests of one user that are put in a row in a
+ * shuffled record */
+#define INF_TEST_TEXT_REPLAY_MAX_BURST 64
 
 typedef struct _InfTestTextReplayUndoGroupingInfo
   InfTestTextReplayUndoGroupingInfo;
@@ -303,6 +321,18 @@ inf_test_text_replay_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
   }
 }
 
+static void
+inf_test_text_replay_count_request_cb(InfAdoptedAlgorithm* algorithm,
+                                      InfAdoptedUser* user,
+                                      InfAdoptedRequest* request,
+                                      InfAdoptedRequest* translated,
+                                      const GError* error,
+                                      gpointer user_data)
+{
+  if(error == NULL)
+    ++*(guint*)user_data;
+}
+
 /*
  * Undo grouping
  */
@@ -336,16 +366,176 @@ inf_test_text_replay_play_user_table_foreach_func(InfUser* user,
 }
 
 /*
- * Entry point
+ * Shuffling
  */
 
-int main(int argc, char* argv[])
+/* Writes a copy of the record in filename to a temporary file, in which the
+ * requests of different users are interleaved randomly. The requests of a
+ * single user are kept in order, since their state vectors are stored
+ * relative to the previous request of the same user. Returns the path of
+ * the temporary file, or NULL on error. */
+static gchar*
+inf_test_text_replay_shuffle(const gchar* filename,
+                             GRand* rand,
+                             GError** error)
+{
+  xmlDocPtr doc;
+  xmlDocPtr shuffled;
+  xmlNodePtr root;
+  xmlNodePtr shuffled_root;
+  xmlNodePtr child;
+  GHashTable* streams;
+  GPtrArray* queues;
+  GQueue* queue;
+  const gchar* attribute;
+  guint user_id;
+  guint index;
+  guint burst;
+  gchar* path;
+  gint fd;
+  gboolean result;
+
+  doc = xmlReadFile(filename, NULL, XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+  if(doc == NULL || xmlDocGetRootElement(doc) == NULL)
+  {
+    if(doc != NULL) xmlFreeDoc(doc);
+    g_set_error(
+      error,
+      G_FILE_ERROR,
+      G_FILE_ERROR_FAILED,
+      "Failed to read record \"%s\"",
+      filename
+    );
+
+    return NULL;
+  }
+
+  root = xmlDocGetRootElement(doc);
+  shuffled = xmlNewDoc((const xmlChar*)"1.0");
+  shuffled_root = xmlDocCopyNode(root, shuffled, 2);
+  xmlDocSetRootElement(shuffled, shuffled_root);
+
+  streams = g_hash_table_new(NULL, NULL);
+  queues = g_ptr_array_new();
+  result = TRUE;
+
+  for(child = root->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE)
+      continue;
+
+    if(strcmp((const char*)child->name, "initial") == 0)
+    {
+      xmlAddChild(shuffled_root, xmlDocCopyNode(child, shuffled, 1));
+      continue;
+    }
+
+    /* A user join goes into the stream of the joining user, so that it
+     * still comes before the user's first request. */
+    if(strcmp((const char*)child->name, "user") == 0)
+      attribute = "id";
+    else
+      attribute = "user";
+
+    if(!inf_xml_util_get_attribute_uint_required(child, attribute,
+                                                 &user_id, error))
+    {
+      result = FALSE;
+      break;
+    }
+
+    queue = g_hash_table_lookup(streams, GUINT_TO_POINTER(user_id));
+    if(queue == NULL)
+    {
+      queue = g_queue_new();
+      g_hash_table_insert(streams, GUINT_TO_POINTER(user_id), queue);
+      g_ptr_array_add(queues, queue);
+    }
+
+    g_queue_push_tail(queue, child);
+  }
+
+  /* Take bursts of requests of one user at a time, so that the other users
+   * fall behind and their requests have to wait for each other. */
+  while(queues->len > 0)
+  {
+    index = g_rand_int_range(rand, 0, queues->len);
+    queue = g_ptr_array_index(queues, index);
+
+    burst = g_rand_int_range(rand, 1, INF_TEST_TEXT_REPLAY_MAX_BURST + 1);
+    while(burst > 0 && !g_queue_is_empty(queue))
+    {
+      child = g_queue_pop_head(queue);
+      xmlAddChild(shuffled_root, xmlDocCopyNode(child, shuffled, 1));
+      --burst;
+    }
+
+    if(g_queue_is_empty(queue))
+    {
+      g_queue_free(queue);
+      g_ptr_array_remove_index_fast(queues, index);
+    }
+  }
+
+  g_ptr_array_free(queues, TRUE);
+  g_hash_table_destroy(streams);
+  xmlFreeDoc(doc);
+
+  path = NULL;
+  if(result == TRUE)
+  {
+    fd = g_file_open_tmp("inf-test-text-replay-XXXXXX.xml", &path, error);
+    if(fd == -1)
+    {
+      result = FALSE;
+    }
+    else
+    {
+      g_close(fd, NULL);
+
+      if(xmlSaveFileEnc(path, shuffled, "UTF-8") == -1)
+      {
+        g_set_error(
+          error,
+          G_FILE_ERROR,
+          G_FILE_ERROR_FAILED,
+          "Failed to write shuffled record to \"%s\"",
+          path
+        );
+
+        g_unlink(path);
+        g_free(path);
+        path = NULL;
+      }
+    }
+  }
+
+  xmlFreeDoc(shuffled);
+  return path;
+}
+
+/*
+ * Replay
+ */
+
+/* Plays the record in filename to the end. If verbose is set, it warns
+ * about requests that take long to transform and prints the resulting
+ * document and the number of requests executed per second. If content_out
+ * or rate_out are not NULL, the resulting document and that rate are stored
+ * in them. Returns FALSE if the record could not be played. */
+static gboolean
+inf_test_text_replay_play(const gchar* filename,
+                          gboolean verbose,
+                          gchar** content_out,
+                          gdouble* rate_out)
 {
   InfAdoptedSessionReplay* replay;
   InfAdoptedSession* session;
   GError* error;
-  int i;
-  int ret;
+  gboolean result;
+  guint n_requests;
+  gint64 start;
+  gint64 duration;
 
   GString* content;
   InfBuffer* buffer;
@@ -353,65 +543,60 @@ int main(int argc, char* argv[])
   InfTestTextReplayUndoGroupingInfo data;
   GSList* item;
 
-  if(argc < 2)
-  {
-    fprintf(stderr, "Usage: %s <record-file1> <record-file2> ...\n", argv[0]);
-    return -1;
-  }
-
   error = NULL;
-  if(!inf_init(&error))
+  result = TRUE;
+
+  replay = inf_adopted_session_replay_new();
+  inf_adopted_session_replay_set_record(
+    replay,
+    filename,
+    &INF_TEST_TEXT_REPLAY_TEXT_PLUGIN,
+    &error
+  );
+
+  if(error != NULL)
   {
     fprintf(stderr, "%s\n", error->message);
     g_error_free(error);
-    return -1;
-  }
+    error = NULL;
 
-  ret = 0;
-  for(i = 1; i < argc; ++ i)
+    result = FALSE;
+  }
+  else
   {
-    fprintf(stderr, "%s... ", argv[i]);
-    fflush(stderr);
+    session = inf_adopted_session_replay_get_session(replay);
+    buffer = inf_session_get_buffer(INF_SESSION(session));
+    content = inf_test_text_replay_load_buffer(INF_TEXT_BUFFER(buffer));
+    user_table = inf_session_get_user_table(INF_SESSION(session));
+    data.algorithm = inf_adopted_session_get_algorithm(session);
+    data.undo_groupings = NULL;
+
+    g_signal_connect(
+      inf_session_get_buffer(INF_SESSION(session)),
+      "text-inserted",
+      G_CALLBACK(inf_test_text_replay_text_inserted_cb),
+      content
+    );
 
-    replay = inf_adopted_session_replay_new();
-    inf_adopted_session_replay_set_record(
-      replay,
-      argv[i],
-      &INF_TEST_TEXT_REPLAY_TEXT_PLUGIN,
-      &error
+    g_signal_connect(
+      inf_session_get_buffer(INF_SESSION(session)),
+      "text-erased",
+      G_CALLBACK(inf_test_text_replay_text_erased_cb),
+      content
     );
 
-    if(error != NULL)
-    {
-      fprintf(stderr, "%s\n", error->message);
-      g_error_free(error);
-      error = NULL;
+    /* Count the executed requests to report the transformation
+     * throughput */
+    n_requests = 0;
+    g_signal_connect(
+      data.algorithm,
+      "end-execute-request",
+      G_CALLBACK(inf_test_text_replay_count_request_cb),
+      &n_requests
+    );
 
-      ret = -1;
-    }
-    else
+    if(verbose)
     {
-      session = inf_adopted_session_replay_get_session(replay);
-      buffer = inf_session_get_buffer(INF_SESSION(session));
-      content = inf_test_text_replay_load_buffer(INF_TEXT_BUFFER(buffer));
-      user_table = inf_session_get_user_table(INF_SESSION(session));
-      data.algorithm = inf_adopted_session_get_algorithm(session);
-      data.undo_groupings = NULL;
-
-      g_signal_connect(
-        inf_session_get_buffer(INF_SESSION(session)),
-        "text-inserted",
-        G_CALLBACK(inf_test_text_replay_text_inserted_cb),
-        content
-      );
-
-      g_signal_connect(
-        inf_session_get_buffer(INF_SESSION(session)),
-        "text-erased",
-        G_CALLBACK(inf_test_text_replay_text_erased_cb),
-        content
-      );
-
       g_signal_connect(
         data.algorithm,
         "begin-execute-request",
@@ -425,45 +610,203 @@ int main(int argc, char* argv[])
         G_CALLBACK(inf_test_text_replay_end_execute_request_cb),
         content
       );
+    }
 
-      /* Let an undo grouper group stuff, just as a consistency check
-       * that it does not crash or behave otherwise badly. */
-      inf_user_table_foreach_user(
-        user_table,
-        inf_test_text_replay_play_user_table_foreach_func,
-        &data
-      );
+    /* Let an undo grouper group stuff, just as a consistency check
+     * that it does not crash or behave otherwise badly. */
+    inf_user_table_foreach_user(
+      user_table,
+      inf_test_text_replay_play_user_table_foreach_func,
+      &data
+    );
 
-      g_signal_connect_after(
-        user_table,
-        "add-user",
-        G_CALLBACK(inf_test_text_replay_add_user_cb),
-        &data
-      );
+    g_signal_connect_after(
+      user_table,
+      "add-user",
+      G_CALLBACK(inf_test_text_replay_add_user_cb),
+      &data
+    );
 
-      if(!inf_adopted_session_replay_play_to_end(replay, &error))
-      {
-        fprintf(stderr, "%s\n", error->message);
-        g_error_free(error);
-        error = NULL;
+    start = g_get_monotonic_time();
+    if(!inf_adopted_session_replay_play_to_end(replay, &error))
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      error = NULL;
 
-        ret = -1;
-      }
-      else
+      result = FALSE;
+    }
+    else
+    {
+      duration = MAX(g_get_monotonic_time() - start, 1);
+
+      if(verbose)
       {
         fprintf(stderr, "\n");
         inf_test_util_print_buffer(INF_TEXT_BUFFER(buffer));
+
+        fprintf(
+          stderr,
+          "%u requests in %.3g ms, %.0f requests/s\n",
+          n_requests,
+          duration / 1000.,
+          n_requests * 1000000. / duration
+        );
       }
 
-      g_string_free(content, TRUE);
-      for(item = data.undo_groupings; item != NULL; item = item->next)
-        g_object_unref(item->data);
-      g_slist_free(data.undo_groupings);
+      if(content_out != NULL)
+        *content_out = g_strdup(content->str);
+      if(rate_out != NULL)
+        *rate_out = n_requests * 1000000. / duration;
     }
 
-    g_object_unref(replay);
+    g_string_free(content, TRUE);
+    for(item = data.undo_groupings; item != NULL; item = item->next)
+      g_object_unref(item->data);
+    g_slist_free(data.undo_groupings);
   }
 
+  g_object_unref(replay);
+  return result;
+}
+
+/* Replays filename in order and shuffled, and verifies that both result in
+ * the same document. */
+static gboolean
+inf_test_text_replay_play_shuffled(const gchar* filename,
+                                   GRand* rand)
+{
+  gchar* shuffled_path;
+  gchar* expected;
+  gchar* content;
+  gdouble in_order_rate;
+  gdouble shuffled_rate;
+  GError* error;
+  gboolean result;
+
+  if(!inf_test_text_replay_play(filename, FALSE, &expected, &in_order_rate))
+    return FALSE;
+
+  error = NULL;
+  shuffled_path = inf_test_text_replay_shuffle(filename, rand, &error);
+  if(shuffled_path == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_free(expected);
+    return FALSE;
+  }
+
+  result = inf_test_text_replay_play(
+    shuffled_path,
+    FALSE,
+    &content,
+    &shuffled_rate
+  );
+
+  g_unlink(shuffled_path);
+  g_free(shuffled_path);
+
+  if(result == TRUE)
+  {
+    if(strcmp(content, expected) != 0)
+    {
+      fprintf(stderr, "Shuffled replay results in a different document\n");
+      result = FALSE;
+    }
+    else
+    {
+      fprintf(
+        stderr,
+        "in order: %.0f requests/s, shuffled: %.0f requests/s\n",
+        in_order_rate,
+        shuffled_rate
+      );
+    }
+
+    g_free(content);
+  }
+
+  g_free(expected);
+  return result;
+}
+
+/*
+ * Entry point
+ */
+
+int main(int argc, char* argv[])
+{
+  GError* error;
+  gboolean shuffle;
+  guint32 rseed;
+  GRand* rand;
+  int first;
+  int i;
+  int ret;
+
+  shuffle = argc > 1 && strcmp(argv[1], "--shuffle") == 0;
+  first = 1;
+  rseed = time(NULL);
+
+  if(shuffle)
+  {
+    first = 2;
+    if(argc > 2 && atoi(argv[2]) > 0)
+    {
+      rseed = atoi(argv[2]);
+      first = 3;
+    }
+  }
+
+  if(argc <= first)
+  {
+    fprintf(stderr, "Usage: %s <record-file1> <record-file2> ...\n", argv[0]);
+    fprintf(
+      stderr,
+      "       %s --shuffle [seed] <record-file1> <record-file2> ...\n",
+      argv[0]
+    );
+
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  rand = NULL;
+  if(shuffle)
+  {
+    printf("Using random seed %u\n", rseed);
+    rand = g_rand_new_with_seed(rseed);
+  }
+
+  ret = 0;
+  for(i = first; i < argc; ++ i)
+  {
+    fprintf(stderr, "%s... ", argv[i]);
+    fflush(stderr);
+
+    if(shuffle)
+    {
+      if(!inf_test_text_replay_play_shuffled(argv[i], rand))
+        ret = -1;
+    }
+    else
+    {
+      if(!inf_test_text_replay_play(argv[i], TRUE, NULL, NULL))
+        ret = -1;
+    }
+  }
+
+  if(rand != NULL)
+    g_rand_free(rand);
+
   return ret;
 }
 
@@ -72,6 +72,27 @@ struct _InfTestTrafficReplayConnection {
   GHashTable* group_queues; /* group name -> GQueue */
 };
 
+/* Outgoing requests of a single user in one group, collected to measure the
+ * effect of request batching, see inf_test_traffic_replay_batch_log(). */
+typedef struct _InfTestTrafficReplayBatch InfTestTrafficReplayBatch;
+struct _InfTestTrafficReplayBatch {
+  xmlNodePtr xml;
+  gchar* user;
+  gint64 begin;
+  guint count;
+};
+
+typedef struct _InfTestTrafficReplayBatchStats InfTestTrafficReplayBatchStats;
+struct _InfTestTrafficReplayBatchStats {
+  guint window; /* milliseconds */
+  guint size;
+
+  guint64 messages_before;
+  guint64 bytes_before;
+  guint64 messages_after;
+  guint64 bytes_after;
+};
+
 typedef enum _InfTestTrafficReplayError {
   INF_TEST_TRAFFIC_REPLAY_ERROR_INVALID_LINE,
   INF_TEST_TRAFFIC_REPLAY_ERROR_UNEXPECTED_EOF
@@ -327,6 +348,248 @@ inf_test_traffic_replay_get_next_message(InfTestTrafficReplayConnection* conn,
   return message;
 }
 
+static gsize
+inf_test_traffic_replay_xml_size(xmlNodePtr xml)
+{
+  xmlBufferPtr buffer;
+  gsize size;
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, xml->doc, xml, 0, 0);
+  size = xmlBufferLength(buffer);
+  xmlBufferFree(buffer);
+
+  return size;
+}
+
+/* Accounts for a batch as it would be sent by InfAdoptedSession: A single
+ * request is sent as is, otherwise the user is only stored in the batch. */
+static void
+inf_test_traffic_replay_batch_close(InfTestTrafficReplayBatch* batch,
+                                    InfTestTrafficReplayBatchStats* stats)
+{
+  xmlNodePtr child;
+
+  if(batch->xml == NULL)
+    return;
+
+  if(batch->count == 1)
+  {
+    child = batch->xml->children;
+    stats->bytes_after += inf_test_traffic_replay_xml_size(child);
+  }
+  else
+  {
+    for(child = batch->xml->children; child != NULL; child = child->next)
+      xmlUnsetProp(child, (const xmlChar*)"user");
+    stats->bytes_after += inf_test_traffic_replay_xml_size(batch->xml);
+  }
+
+  ++stats->messages_after;
+
+  xmlFreeNode(batch->xml);
+  g_free(batch->user);
+  batch->xml = NULL;
+  batch->user = NULL;
+  batch->count = 0;
+}
+
+static void
+inf_test_traffic_replay_batch_free(InfTestTrafficReplayBatch* batch)
+{
+  if(batch->xml != NULL)
+    xmlFreeNode(batch->xml);
+  g_free(batch->user);
+  g_slice_free(InfTestTrafficReplayBatch, batch);
+}
+
+/* Reads all messages of a traffic log, and coalesces consecutive outgoing
+ * requests of the same user to the same group into batches, in the same
+ * way as InfAdoptedSession does with request batching enabled. The request
+ * times in the log are already diffs to the previous request of the same
+ * user, so the requests can be put into a batch unmodified. */
+static gboolean
+inf_test_traffic_replay_batch_log(InfTestTrafficReplayConnection* conn,
+                                  InfTestTrafficReplayBatchStats* stats,
+                                  GError** error)
+{
+  GHashTable* batches; /* group name -> InfTestTrafficReplayBatch */
+  InfTestTrafficReplayMessage* message;
+  InfTestTrafficReplayBatch* batch;
+  GHashTableIter iter;
+  GError* local_error;
+  xmlChar* group_name;
+  xmlChar* user;
+  xmlNodePtr child;
+  xmlNodePtr next;
+
+  batches = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    (GDestroyNotify)inf_test_traffic_replay_batch_free
+  );
+
+  local_error = NULL;
+  while( (message = inf_test_traffic_replay_get_next_message(conn,
+                                                             &local_error)))
+  {
+    if(message->type != INF_TEST_TRAFFIC_REPLAY_MESSAGE_OUTGOING ||
+       strcmp((const char*)message->xml->name, "group") != 0)
+    {
+      inf_test_traffic_replay_message_free(message);
+      continue;
+    }
+
+    group_name = xmlGetProp(message->xml, (const xmlChar*)"name");
+    if(group_name == NULL)
+    {
+      inf_test_traffic_replay_message_free(message);
+      continue;
+    }
+
+    batch = g_hash_table_lookup(batches, group_name);
+    if(batch == NULL)
+    {
+      batch = g_slice_new(InfTestTrafficReplayBatch);
+      batch->xml = NULL;
+      batch->user = NULL;
+      batch->begin = 0;
+      batch->count = 0;
+      g_hash_table_insert(batches, g_strdup((const gchar*)group_name), batch);
+    }
+
+    xmlFree(group_name);
+
+    for(child = message->xml->children; child != NULL; child = next)
+    {
+      next = child->next;
+      if(child->type != XML_ELEMENT_NODE)
+        continue;
+
+      user = NULL;
+      if(strcmp((const char*)child->name, "request") == 0)
+        user = xmlGetProp(child, (const xmlChar*)"user");
+
+      if(user == NULL)
+      {
+        /* Other messages are never delayed, so a pending batch has to be
+         * sent before them. */
+        inf_test_traffic_replay_batch_close(batch, stats);
+        continue;
+      }
+
+      ++stats->messages_before;
+      stats->bytes_before += inf_test_traffic_replay_xml_size(child);
+
+      if(batch->xml != NULL &&
+         (strcmp(batch->user, (const char*)user) != 0 ||
+          message->timestamp - batch->begin >= (gint64)stats->window * 1000))
+      {
+        inf_test_traffic_replay_batch_close(batch, stats);
+      }
+
+      if(batch->xml == NULL)
+      {
+        batch->xml = xmlNewNode(NULL, (const xmlChar*)"request-batch");
+        xmlNewProp(batch->xml, (const xmlChar*)"user", user);
+        batch->user = g_strdup((const gchar*)user);
+        batch->begin = message->timestamp;
+      }
+
+      xmlFree(user);
+
+      xmlUnlinkNode(child);
+      xmlAddChild(batch->xml, child);
+      ++batch->count;
+
+      if(batch->count >= stats->size)
+        inf_test_traffic_replay_batch_close(batch, stats);
+    }
+
+    inf_test_traffic_replay_message_free(message);
+  }
+
+  g_hash_table_iter_init(&iter, batches);
+  while(g_hash_table_iter_next(&iter, NULL, (gpointer*)&batch))
+    inf_test_traffic_replay_batch_close(batch, stats);
+  g_hash_table_destroy(batches);
+
+  /* The log simply ends at some point */
+  if(local_error->domain == inf_test_traffic_replay_error_quark() &&
+     local_error->code == INF_TEST_TRAFFIC_REPLAY_ERROR_UNEXPECTED_EOF)
+  {
+    g_error_free(local_error);
+    return TRUE;
+  }
+
+  g_propagate_error(error, local_error);
+  return FALSE;
+}
+
+static int
+inf_test_traffic_replay_batch_main(int argc,
+                                   char* argv[],
+                                   InfTestTrafficReplayBatchStats* stats)
+{
+  InfTestTrafficReplayConnection conn;
+  GError* error;
+  int i;
+
+  stats->messages_before = 0;
+  stats->bytes_before = 0;
+  stats->messages_after = 0;
+  stats->bytes_after = 0;
+
+  error = NULL;
+  for(i = 0; i < argc; ++i)
+  {
+    conn.name = argv[i];
+    conn.file = fopen(argv[i], "r");
+    if(!conn.file)
+    {
+      fprintf(stderr, "Failed to open %s: %s\n", argv[i], strerror(errno));
+      return 1;
+    }
+
+    if(!inf_test_traffic_replay_batch_log(&conn, stats, &error))
+    {
+      fprintf(stderr, "Failed to read %s: %s\n", argv[i], error->message);
+      g_error_free(error);
+      fclose(conn.file);
+      return 1;
+    }
+
+    fclose(conn.file);
+  }
+
+  printf(
+    "Batching window %u ms, at most %u requests per message\n",
+    stats->window,
+    stats->size
+  );
+
+  printf(
+    "          %10s  %12s\n"
+    "unbatched %10" G_GUINT64_FORMAT "  %12" G_GUINT64_FORMAT "\n"
+    "batched   %10" G_GUINT64_FORMAT "  %12" G_GUINT64_FORMAT "\n",
+    "messages", "bytes",
+    stats->messages_before, stats->bytes_before,
+    stats->messages_after, stats->bytes_after
+  );
+
+  if(stats->messages_before > 0 && stats->bytes_before > 0)
+  {
+    printf(
+      "reduction %9.1f%%  %11.1f%%\n",
+      100.0 * (1.0 - (double)stats->messages_after / stats->messages_before),
+      100.0 * (1.0 - (double)stats->bytes_after / stats->bytes_before)
+    );
+  }
+
+  return 0;
+}
+
 static void
 inf_test_traffic_replay_connection_close(InfTestTrafficReplayConnection* conn)
 {
@@ -957,6 +1220,7 @@ inf_test_traffic_replay_start_func(gpointer user_data)
 int main(int argc, char* argv[])
 {
   InfTestTrafficReplay replay;
+  InfTestTrafficReplayBatchStats batch_stats;
   InfdTcpServer* server;
   InfCertificateCredentials* creds;
   GError* error;
@@ -970,9 +1234,29 @@ int main(int argc, char* argv[])
   as_server = FALSE;
   port = 6524;
 
-  if(argc < 2)
+  batch_stats.window = 0;
+  batch_stats.size = 32;
+
+  /* With --batch-window, the logs are not replayed but only analyzed for how
+   * much request batching would save. */
+  for(i = 1; i < argc && strncmp(argv[i], "--batch-", 8) == 0; ++i)
+  {
+    if(strncmp(argv[i], "--batch-window=", 15) == 0)
+      batch_stats.window = strtoul(argv[i] + 15, NULL, 10);
+    else if(strncmp(argv[i], "--batch-size=", 13) == 0)
+      batch_stats.size = MAX(strtoul(argv[i] + 13, NULL, 10), 1);
+    else
+      break;
+  }
+
+  if(i >= argc || (i > 1 && batch_stats.window == 0))
   {
-    fprintf(stderr, "Usage: %s <traffic-log>\n", argv[0]);
+    fprintf(
+      stderr,
+      "Usage: %s [--batch-window=MS [--batch-size=N]] <traffic-log>...\n",
+      argv[0]
+    );
+
     return -1;
   }
 
@@ -984,6 +1268,9 @@ int main(int argc, char* argv[])
     return -1;
   }
 
+  if(batch_stats.window > 0)
+    return inf_test_traffic_replay_batch_main(argc - i, argv + i, &batch_stats);
+
   replay.io = inf_standalone_io_new();
   replay.port = port;
   replay.xmpp = NULL;
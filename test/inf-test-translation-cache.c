@@ -0,0 +1,587 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Replays all test files in the session/ subdirectory with different sizes
+ * of the translation cache of InfAdoptedAlgorithm, and verifies that all of
+ * them result in the expected buffer. With a cache size of 0 there must not
+ * be any cache hits. Afterwards, two concurrent requests generated at the
+ * same state are translated past each other with a cache of one and of two
+ * entries, to verify that hits, misses and evictions happen exactly when
+ * they should. */
+
+#include "util/inf-test-util.h"
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* The default size, no cache at all, and one that is so small that entries
+ * are evicted all the time */
+static const guint INF_TEST_TRANSLATION_CACHE_SIZES[] = { 1024, 0, 4 };
+
+#define INF_TEST_TRANSLATION_CACHE_N_SIZES \
+  G_N_ELEMENTS(INF_TEST_TRANSLATION_CACHE_SIZES)
+
+typedef struct _InfTestTranslationCacheResult InfTestTranslationCacheResult;
+struct _InfTestTranslationCacheResult {
+  guint total;
+  guint passed;
+  guint n_evictions_checked;
+};
+
+/* A request and a state to translate it to, which is the state of the
+ * request plus one concurrent request of another user that was generated
+ * at the same state. Translating it therefore takes exactly one
+ * transformation, and looks up exactly one entry in the cache. */
+typedef struct _InfTestTranslationCachePair InfTestTranslationCachePair;
+struct _InfTestTranslationCachePair {
+  InfAdoptedRequest* request;
+  InfAdoptedStateVector* to;
+};
+
+static void
+inf_test_translation_cache_collect_users_func(InfUser* user,
+                                              gpointer user_data)
+{
+  GSList** users;
+  users = (GSList**)user_data;
+
+  *users = g_slist_prepend(*users, user);
+}
+
+static InfTextSession*
+inf_test_translation_cache_replay(InfTextChunk* initial,
+                                  GSList* users,
+                                  GSList* requests,
+                                  guint cache_size)
+{
+  InfTextBuffer* buffer;
+  InfCommunicationManager* manager;
+  InfIo* io;
+  InfUserTable* user_table;
+  InfTextSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  InfTextUser* user;
+  gchar* user_name;
+  GSList* item;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  inf_text_buffer_insert_chunk(buffer, 0, initial, NULL);
+
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+  user_table = inf_user_table_new();
+
+  for(item = users; item != NULL; item = g_slist_next(item))
+  {
+    user_name = g_strdup_printf("User_%u", GPOINTER_TO_UINT(item->data));
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", GPOINTER_TO_UINT(item->data),
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(buffer);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(user_table);
+
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+  g_object_set(
+    G_OBJECT(algorithm),
+    "translation-cache-size", cache_size,
+    NULL
+  );
+
+  for(item = requests; item != NULL; item = item->next)
+  {
+    inf_communication_object_received(
+      INF_COMMUNICATION_OBJECT(session),
+      NULL,
+      (xmlNodePtr)item->data
+    );
+  }
+
+  return session;
+}
+
+/* Finds two requests of different users which were generated at the same
+ * state. Returns FALSE if there are none. */
+static gboolean
+inf_test_translation_cache_find_pairs(InfAdoptedSession* session,
+                                      InfTestTranslationCachePair* first,
+                                      InfTestTranslationCachePair* second)
+{
+  InfUserTable* user_table;
+  GSList* users;
+  GSList* item;
+  GSList* item2;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequestLog* log2;
+  InfAdoptedRequest* request;
+  InfAdoptedRequest* request2;
+  InfAdoptedStateVector* vector;
+  guint user_id;
+  guint user_id2;
+  guint index2;
+  guint i;
+
+  user_table = inf_session_get_user_table(INF_SESSION(session));
+  users = NULL;
+  inf_user_table_foreach_user(
+    user_table,
+    inf_test_translation_cache_collect_users_func,
+    &users
+  );
+
+  for(item = users; item != NULL; item = item->next)
+  {
+    user_id = inf_user_get_id(INF_USER(item->data));
+    log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(item->data));
+
+    for(i = inf_adopted_request_log_get_begin(log);
+        i < inf_adopted_request_log_get_end(log);
+        ++i)
+    {
+      request = inf_adopted_request_log_get_request(log, i);
+      if(inf_adopted_request_log_original_request(log, request) != request)
+        continue;
+
+      vector = inf_adopted_request_get_vector(request);
+      for(item2 = users; item2 != NULL; item2 = item2->next)
+      {
+        user_id2 = inf_user_get_id(INF_USER(item2->data));
+        if(user_id2 == user_id) continue;
+
+        log2 = inf_adopted_user_get_request_log(INF_ADOPTED_USER(item2->data));
+        index2 = inf_adopted_state_vector_get(vector, user_id2);
+        if(index2 < inf_adopted_request_log_get_begin(log2) ||
+           index2 >= inf_adopted_request_log_get_end(log2))
+        {
+          continue;
+        }
+
+        request2 = inf_adopted_request_log_get_request(log2, index2);
+        if(inf_adopted_request_log_original_request(log2, request2) !=
+           request2)
+        {
+          continue;
+        }
+
+        if(!inf_adopted_state_vector_equal(
+             inf_adopted_request_get_vector(request2),
+             vector))
+        {
+          continue;
+        }
+
+        first->request = request;
+        first->to = inf_adopted_state_vector_copy(vector);
+        inf_adopted_state_vector_add(first->to, user_id2, 1);
+
+        second->request = request2;
+        second->to = inf_adopted_state_vector_copy(vector);
+        inf_adopted_state_vector_add(second->to, user_id, 1);
+
+        g_slist_free(users);
+        return TRUE;
+      }
+    }
+  }
+
+  g_slist_free(users);
+  return FALSE;
+}
+
+/* Translates the pair and checks that this was a cache hit if expect_hit
+ * is TRUE and a cache miss otherwise. */
+static gboolean
+inf_test_translation_cache_translate(InfAdoptedAlgorithm* algorithm,
+                                     InfTestTranslationCachePair* pair,
+                                     gboolean expect_hit,
+                                     InfAdoptedRequest** result)
+{
+  InfAdoptedRequest* translated;
+  guint hits_before;
+  guint misses_before;
+  guint hits;
+  guint misses;
+
+  g_object_get(
+    G_OBJECT(algorithm),
+    "translation-cache-hits", &hits_before,
+    "translation-cache-misses", &misses_before,
+    NULL
+  );
+
+  translated = inf_adopted_algorithm_translate_request(
+    algorithm,
+    pair->request,
+    pair->to
+  );
+
+  g_object_get(
+    G_OBJECT(algorithm),
+    "translation-cache-hits", &hits,
+    "translation-cache-misses", &misses,
+    NULL
+  );
+
+  /* A hit must hand out the very request that was cached before */
+  if(expect_hit && result != NULL && *result != translated)
+  {
+    printf("(cache hit returned a different request) ");
+    g_object_unref(translated);
+    return FALSE;
+  }
+
+  if(result != NULL && *result == NULL)
+    *result = translated;
+  else
+    g_object_unref(translated);
+
+  if(expect_hit && (hits != hits_before + 1 || misses != misses_before))
+  {
+    printf("(expected a cache hit) ");
+    return FALSE;
+  }
+
+  if(!expect_hit && (hits != hits_before || misses != misses_before + 1))
+  {
+    printf("(expected a cache miss) ");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_translation_cache_check_eviction(InfAdoptedAlgorithm* algorithm,
+                                          InfTestTranslationCachePair* first,
+                                          InfTestTranslationCachePair* second)
+{
+  InfAdoptedRequest* first_result;
+  gboolean retval;
+
+  first_result = NULL;
+
+  /* Start with an empty cache, then keep a single entry */
+  g_object_set(G_OBJECT(algorithm), "translation-cache-size", 0, NULL);
+  g_object_set(G_OBJECT(algorithm), "translation-cache-size", 1, NULL);
+
+  retval =
+    inf_test_translation_cache_translate(
+      algorithm, first, FALSE, &first_result) &&
+    inf_test_translation_cache_translate(
+      algorithm, first, TRUE, &first_result) &&
+    /* This evicts the first translation */
+    inf_test_translation_cache_translate(
+      algorithm, second, FALSE, NULL) &&
+    inf_test_translation_cache_translate(
+      algorithm, first, FALSE, NULL);
+
+  if(retval)
+  {
+    /* The cache has room for both translations now. The second one has
+     * been evicted by the one before, though. */
+    g_object_set(G_OBJECT(algorithm), "translation-cache-size", 2, NULL);
+
+    retval =
+      inf_test_translation_cache_translate(
+        algorithm, second, FALSE, NULL) &&
+      inf_test_translation_cache_translate(
+        algorithm, first, TRUE, NULL) &&
+      inf_test_translation_cache_translate(
+        algorithm, second, TRUE, NULL);
+  }
+
+  if(retval)
+  {
+    /* Shrinking the cache to 0 drops everything, and nothing is added */
+    g_object_set(G_OBJECT(algorithm), "translation-cache-size", 0, NULL);
+
+    retval =
+      inf_test_translation_cache_translate(
+        algorithm, first, FALSE, NULL) &&
+      inf_test_translation_cache_translate(
+        algorithm, first, FALSE, NULL);
+  }
+
+  if(first_result != NULL)
+    g_object_unref(first_result);
+
+  return retval;
+}
+
+static gboolean
+inf_test_translation_cache_perform(InfTextChunk* initial,
+                                   InfTextChunk* final,
+                                   GSList* users,
+                                   GSList* requests,
+                                   InfTestTranslationCacheResult* result)
+{
+  InfTextSession* sessions[INF_TEST_TRANSLATION_CACHE_N_SIZES];
+  InfAdoptedAlgorithm* algorithm;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  InfTestTranslationCachePair first;
+  InfTestTranslationCachePair second;
+  gboolean retval;
+  guint hits;
+  guint i;
+
+  retval = TRUE;
+  for(i = 0; i < INF_TEST_TRANSLATION_CACHE_N_SIZES; ++i)
+  {
+    sessions[i] = inf_test_translation_cache_replay(
+      initial,
+      users,
+      requests,
+      INF_TEST_TRANSLATION_CACHE_SIZES[i]
+    );
+
+    buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(sessions[i])));
+    chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    if(retval && !inf_text_chunk_equal(chunk, final))
+    {
+      printf(
+        "(cache size %u: unexpected buffer) ",
+        INF_TEST_TRANSLATION_CACHE_SIZES[i]
+      );
+
+      retval = FALSE;
+    }
+
+    inf_text_chunk_free(chunk);
+
+    algorithm =
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(sessions[i]));
+    g_object_get(G_OBJECT(algorithm), "translation-cache-hits", &hits, NULL);
+
+    if(retval && INF_TEST_TRANSLATION_CACHE_SIZES[i] == 0 && hits > 0)
+    {
+      printf("(%u cache hits without a cache) ", hits);
+      retval = FALSE;
+    }
+  }
+
+  if(retval &&
+     inf_test_translation_cache_find_pairs(
+       INF_ADOPTED_SESSION(sessions[0]), &first, &second))
+  {
+    algorithm =
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(sessions[0]));
+
+    retval = inf_test_translation_cache_check_eviction(
+      algorithm,
+      &first,
+      &second
+    );
+
+    inf_adopted_state_vector_free(first.to);
+    inf_adopted_state_vector_free(second.to);
+    ++result->n_evictions_checked;
+  }
+
+  for(i = 0; i < INF_TEST_TRANSLATION_CACHE_N_SIZES; ++i)
+    g_object_unref(sessions[i]);
+
+  return retval;
+}
+
+static void
+inf_test_translation_cache_foreach_test_func(const gchar* testfile,
+                                             gpointer user_data)
+{
+  InfTestTranslationCacheResult* result;
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  GSList* requests;
+  InfTextChunk* initial;
+  InfTextChunk* final;
+  GSList* users;
+  GError* error;
+
+  /* Only process XML files, not the Makefiles or other stuff */
+  if(!g_str_has_suffix(testfile, ".xml"))
+    return;
+
+  result = (InfTestTranslationCacheResult*)user_data;
+  doc = xmlParseFile(testfile);
+  if(doc == NULL)
+    return;
+
+  requests = NULL;
+  initial = NULL;
+  final = NULL;
+  users = NULL;
+  error = NULL;
+
+  printf("%s... ", testfile);
+  fflush(stdout);
+
+  ++result->total;
+
+  root = xmlDocGetRootElement(doc);
+  for(child = root->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+
+    if(strcmp((const char*)child->name, "initial-buffer") == 0)
+    {
+      if(initial != NULL) inf_text_chunk_free(initial);
+      initial = inf_test_util_parse_buffer(child, &error);
+      if(initial == NULL) break;
+    }
+    else if(strcmp((const char*)child->name, "final-buffer") == 0)
+    {
+      if(final != NULL) inf_text_chunk_free(final);
+      final = inf_test_util_parse_buffer(child, &error);
+      if(final == NULL) break;
+    }
+    else if(strcmp((const char*)child->name, "user") == 0)
+    {
+      if(inf_test_util_parse_user(child, &users, &error) == FALSE)
+        break;
+    }
+    else if(strcmp((const char*)child->name, "request") == 0)
+    {
+      requests = g_slist_prepend(requests, child);
+    }
+  }
+
+  if(error != NULL)
+  {
+    printf("Failed to parse: %s\n", error->message);
+    g_error_free(error);
+  }
+  else if(initial == NULL || final == NULL)
+  {
+    printf("No initial or final buffer\n");
+  }
+  else
+  {
+    requests = g_slist_reverse(requests);
+
+    if(inf_test_translation_cache_perform(initial, final, users, requests,
+                                          result))
+    {
+      ++result->passed;
+      printf("OK\n");
+    }
+    else
+    {
+      printf("FAILED\n");
+    }
+  }
+
+  if(initial != NULL) inf_text_chunk_free(initial);
+  if(final != NULL) inf_text_chunk_free(final);
+  g_slist_free(requests);
+  g_slist_free(users);
+  xmlFreeDoc(doc);
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestTranslationCacheResult result;
+  const char* dir;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  if(argc > 1)
+    dir = argv[1];
+  else
+    dir = "session";
+
+  result.total = 0;
+  result.passed = 0;
+  result.n_evictions_checked = 0;
+
+  if(!inf_test_util_dir_foreach(
+       dir,
+       inf_test_translation_cache_foreach_test_func,
+       &result,
+       &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  printf("%u out of %u tests passed\n", result.passed, result.total);
+  inf_deinit();
+
+  if(result.passed < result.total)
+    return -1;
+
+  /* Make sure that the eviction checks did not silently pass because no
+   * test file had concurrent requests */
+  if(result.n_evictions_checked == 0)
+  {
+    fprintf(stderr, "No concurrent requests to check cache evictions\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,786 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Broadcasts typical messages from a server to a group of clients
+ * connected over XMPP on the loopback interface, with plain XML, with
+ * binary framing and with binary framing plus zlib compression. It
+ * verifies that every message arrives unchanged at every client, and prints
+ * the time per broadcast and the number of bytes sent per message and
+ * client for each case. Finally, it sends binary frames with names and
+ * text that cannot be represented in XML to the server, and verifies that
+ * the server closes the connection instead of accepting them. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_XMPP_BINARY_CLIENTS 4
+
+typedef struct _InfTestXmppBinaryMode InfTestXmppBinaryMode;
+struct _InfTestXmppBinaryMode {
+  const gchar* name;
+  gboolean binary_framing;
+  gint compression_level;
+};
+
+typedef struct _InfTestXmppBinary InfTestXmppBinary;
+
+typedef struct _InfTestXmppBinaryClient InfTestXmppBinaryClient;
+struct _InfTestXmppBinaryClient {
+  InfTestXmppBinary* test;
+  InfXmlConnection* connection;
+  guint n_received;
+};
+
+struct _InfTestXmppBinary {
+  InfStandaloneIo* io;
+  const InfTestXmppBinaryMode* mode;
+  GSList* server_connections;
+  InfTestXmppBinaryClient clients[INF_TEST_XMPP_BINARY_CLIENTS];
+  guint n_open;
+
+  GPtrArray* messages;
+  guint n_received;
+  gsize bytes;
+  gboolean failed;
+};
+
+static const InfTestXmppBinaryMode INF_TEST_XMPP_BINARY_MODES[] = {
+  { "xml", FALSE, 0 },
+  { "binary", TRUE, 0 },
+  { "zlib", TRUE, 6 }
+};
+
+typedef struct _InfTestXmppBinaryFrame InfTestXmppBinaryFrame;
+struct _InfTestXmppBinaryFrame {
+  const gchar* description;
+  const gchar* data;
+  guint len;
+  gboolean valid;
+};
+
+#define INF_TEST_XMPP_BINARY_FRAME(description, data, valid) \
+  { description, data, sizeof(data) - 1, valid }
+
+/* Complete binary frames, each with the frame type, the length and an
+ * encoded element, see inf-xml-binary.c. */
+static const InfTestXmppBinaryFrame INF_TEST_XMPP_BINARY_FRAMES[] = {
+  /* <a x="y">z</a>, to make sure that frames written this way arrive */
+  INF_TEST_XMPP_BINARY_FRAME(
+    "valid element",
+    "\x02\x0e" "\x00\x01" "a" "\x01" "\x00\x01" "x" "\x00\x01" "y"
+    "\x01" "\x01\x01" "z",
+    TRUE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "markup in element name",
+    "\x02\x10" "\x00\x0c" "a/><b></b><c" "\x00" "\x00",
+    FALSE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "prefix in element name",
+    "\x02\x10" "\x00\x0c" "stream:error" "\x00" "\x00",
+    FALSE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "space in attribute name",
+    "\x02\x09" "\x01" "\x01" "\x00\x03" "a b" "\x01" "\x00",
+    FALSE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "namespace declaration",
+    "\x02\x0b" "\x01" "\x01" "\x00\x05" "xmlns" "\x01" "\x00",
+    FALSE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "duplicate attribute",
+    "\x02\x07" "\x01" "\x02" "\x07\x01" "\x07\x02" "\x00",
+    FALSE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "control character in attribute value",
+    "\x02\x07" "\x01" "\x01" "\x02" "\x00\x01\x1b" "\x00",
+    FALSE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "control character in text",
+    "\x02\x07" "\x01" "\x00" "\x01" "\x01" "\x02" "a\x08",
+    FALSE
+  ),
+  INF_TEST_XMPP_BINARY_FRAME(
+    "noncharacter in text",
+    "\x02\x08" "\x01" "\x00" "\x01" "\x01" "\x03" "\xef\xbf\xbf",
+    FALSE
+  )
+};
+
+static xmlNodePtr
+inf_test_xmpp_binary_make_request(const gchar* time,
+                                  guint user)
+{
+  xmlNodePtr xml;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+  inf_xml_util_set_attribute_uint(xml, "user", user);
+  inf_xml_util_set_attribute(xml, "time", time);
+  return xml;
+}
+
+static GPtrArray*
+inf_test_xmpp_binary_make_messages(void)
+{
+  static const gchar special[] = "<a href=\"x\">&amp; 'quoted'</a>";
+  static const gchar utf8[] =
+    "Gr\xc3\xbc\xc3\x9f" "e \xe2\x82\xac \xf0\x9f\x98\x80";
+
+  GPtrArray* messages;
+  GString* text;
+  xmlNodePtr request;
+  xmlNodePtr batch;
+  xmlNodePtr op;
+  xmlNodePtr child;
+  guint i;
+
+  messages = g_ptr_array_new_with_free_func((GDestroyNotify)xmlFreeNode);
+
+  /* Typed character */
+  request = inf_test_xmpp_binary_make_request("2:174;3:12;5:1", 1);
+  op = xmlNewChild(request, NULL, (const xmlChar*)"insert-caret", NULL);
+  inf_xml_util_set_attribute_uint(op, "pos", 1234);
+  inf_xml_util_add_child_text(op, "a", 1);
+  g_ptr_array_add(messages, request);
+
+  /* Caret movement */
+  request = inf_test_xmpp_binary_make_request("", 2);
+  op = xmlNewChild(request, NULL, (const xmlChar*)"move", NULL);
+  inf_xml_util_set_attribute_uint(op, "caret", 1235);
+  inf_xml_util_set_attribute_int(op, "selection", -17);
+  g_ptr_array_add(messages, request);
+
+  /* Deletion with segments, special characters and non-ASCII text */
+  request = inf_test_xmpp_binary_make_request("1:2", 1);
+  op = xmlNewChild(request, NULL, (const xmlChar*)"delete-caret", NULL);
+  inf_xml_util_set_attribute_uint(op, "pos", 0);
+  child = xmlNewChild(op, NULL, (const xmlChar*)"segment", NULL);
+  inf_xml_util_set_attribute_uint(child, "author", 1);
+  inf_xml_util_add_child_text(child, special, strlen(special));
+  child = xmlNewChild(op, NULL, (const xmlChar*)"segment", NULL);
+  inf_xml_util_set_attribute_uint(child, "author", 0);
+  inf_xml_util_add_child_text(child, utf8, strlen(utf8));
+  g_ptr_array_add(messages, request);
+
+  /* Request batch */
+  batch = xmlNewNode(NULL, (const xmlChar*)"request-batch");
+  inf_xml_util_set_attribute_uint(batch, "user", 3);
+  for(i = 0; i < 8; ++i)
+  {
+    request = xmlNewChild(batch, NULL, (const xmlChar*)"request", NULL);
+    inf_xml_util_set_attribute(request, "time", i == 0 ? "3:1000" : "");
+    op = xmlNewChild(request, NULL, (const xmlChar*)"insert-caret", NULL);
+    inf_xml_util_set_attribute_uint(op, "pos", 100 + i);
+    inf_xml_util_add_child_text(op, "x", 1);
+  }
+  g_ptr_array_add(messages, batch);
+
+  /* Attribute values that look like numbers but are not in canonical form,
+   * or are out of range, need to survive unchanged. */
+  request = inf_test_xmpp_binary_make_request("007", 4294967295u);
+  inf_xml_util_set_attribute(request, "num", "");
+  op = xmlNewChild(request, NULL, (const xmlChar*)"no-op", NULL);
+  inf_xml_util_set_attribute(op, "unknown-attribute", "1234567890");
+  g_ptr_array_add(messages, request);
+
+  /* Something that is not a request, with a larger text */
+  text = g_string_new(NULL);
+  for(i = 0; i < 200; ++i)
+    g_string_append(text, "The quick brown fox jumps over the lazy dog. ");
+
+  child = xmlNewNode(NULL, (const xmlChar*)"sync-segment");
+  inf_xml_util_set_attribute_uint(child, "author", 2);
+  inf_xml_util_add_child_text(child, text->str, text->len);
+  g_ptr_array_add(messages, child);
+  g_string_free(text, TRUE);
+
+  return messages;
+}
+
+static gchar*
+inf_test_xmpp_binary_dump(xmlNodePtr xml)
+{
+  xmlBufferPtr buffer;
+  gchar* result;
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, NULL, xml, 0, 0);
+  result = g_strdup((const gchar*)xmlBufferContent(buffer));
+  xmlBufferFree(buffer);
+
+  return result;
+}
+
+static gboolean
+inf_test_xmpp_binary_check(InfTestXmppBinary* test,
+                           xmlNodePtr xml,
+                           guint index)
+{
+  gchar* expected;
+  gchar* received;
+  gboolean result;
+
+  expected = inf_test_xmpp_binary_dump(
+    g_ptr_array_index(test->messages, index % test->messages->len)
+  );
+
+  received = inf_test_xmpp_binary_dump(xml);
+
+  result = TRUE;
+  if(strcmp(expected, received) != 0)
+  {
+    fprintf(stderr, "Expected: %s\nReceived: %s\n", expected, received);
+    result = FALSE;
+  }
+
+  g_free(expected);
+  g_free(received);
+  return result;
+}
+
+
+static void
+inf_test_xmpp_binary_received_cb(InfXmlConnection* connection,
+                                 xmlNodePtr xml,
+                                 gpointer user_data)
+{
+  InfTestXmppBinaryClient* client;
+  xmlChar* name;
+  xmlNodePtr child;
+
+  client = (InfTestXmppBinaryClient*)user_data;
+
+  name = xmlGetProp(xml, (const xmlChar*)"name");
+  if(strcmp((const char*)xml->name, "group") != 0 || name == NULL ||
+     strcmp((const char*)name, "InfTestXmppBinary") != 0)
+  {
+    fprintf(stderr, "Received message outside of the group\n");
+    client->test->failed = TRUE;
+  }
+
+  xmlFree(name);
+
+  /* Shared serializations are sent in a container of their own, but do not
+   * rely on it here. */
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE)
+      continue;
+
+    if(!inf_test_xmpp_binary_check(client->test, child, client->n_received))
+      client->test->failed = TRUE;
+
+    ++client->n_received;
+    ++client->test->n_received;
+  }
+}
+
+static void
+inf_test_xmpp_binary_sent_cb(InfTcpConnection* connection,
+                             gconstpointer data,
+                             guint len,
+                             gpointer user_data)
+{
+  InfTestXmppBinary* test;
+  test = (InfTestXmppBinary*)user_data;
+
+  test->bytes += len;
+}
+
+static void
+inf_test_xmpp_binary_notify_status_cb(GObject* object,
+                                      GParamSpec* pspec,
+                                      gpointer user_data)
+{
+  InfTestXmppBinary* test;
+  InfXmlConnectionStatus status;
+
+  test = (InfTestXmppBinary*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_XML_CONNECTION_OPEN)
+    ++test->n_open;
+}
+
+static void
+inf_test_xmpp_binary_new_connection_cb(InfdXmlServer* server,
+                                       InfXmlConnection* connection,
+                                       gpointer user_data)
+{
+  InfTestXmppBinary* test;
+  test = (InfTestXmppBinary*)user_data;
+
+  g_object_ref(connection);
+  test->server_connections =
+    g_slist_prepend(test->server_connections, connection);
+
+  /* The server decides whether compression is offered */
+  g_object_set(
+    G_OBJECT(connection),
+    "binary-framing", test->mode->binary_framing,
+    "compression-level", test->mode->compression_level,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "notify::status",
+    G_CALLBACK(inf_test_xmpp_binary_notify_status_cb),
+    test
+  );
+}
+
+static void
+inf_test_xmpp_binary_server_received_cb(InfXmlConnection* connection,
+                                        xmlNodePtr xml,
+                                        gpointer user_data)
+{
+  guint* n_received;
+  n_received = (guint*)user_data;
+
+  ++*n_received;
+}
+
+/* Connects a client to port with binary framing, writes frame to the
+ * connection as it is, and verifies that the server accepts it if it is
+ * valid, and closes the connection without accepting it otherwise. */
+static gboolean
+inf_test_xmpp_binary_send_frame(InfTestXmppBinary* test,
+                                InfIpAddress* addr,
+                                guint port,
+                                const InfTestXmppBinaryFrame* frame)
+{
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  InfXmlConnection* server_connection;
+  InfXmlConnectionStatus status;
+  guint n_received;
+  gboolean result;
+  GError* error;
+
+  test->mode = &INF_TEST_XMPP_BINARY_MODES[1];
+  test->server_connections = NULL;
+  test->n_open = 0;
+
+  tcp = inf_tcp_connection_new(INF_IO(test->io), addr, port);
+  xmpp = inf_xmpp_connection_new(
+    tcp,
+    INF_XMPP_CONNECTION_CLIENT,
+    NULL,
+    "localhost",
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_object_set(G_OBJECT(xmpp), "binary-framing", TRUE, NULL);
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "notify::status",
+    G_CALLBACK(inf_test_xmpp_binary_notify_status_cb),
+    test
+  );
+
+  error = NULL;
+  if(inf_tcp_connection_open(tcp, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not connect: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(xmpp);
+    g_object_unref(tcp);
+    return FALSE;
+  }
+
+  while(test->n_open < 2)
+    inf_standalone_io_iteration(test->io);
+
+  server_connection = INF_XML_CONNECTION(test->server_connections->data);
+  n_received = 0;
+
+  g_signal_connect(
+    G_OBJECT(server_connection),
+    "received",
+    G_CALLBACK(inf_test_xmpp_binary_server_received_cb),
+    &n_received
+  );
+
+  /* The client has switched to binary framing once it is open, so the
+   * server reads the frame as if the client had sent it. */
+  inf_tcp_connection_send(tcp, frame->data, frame->len);
+
+  result = TRUE;
+  if(frame->valid)
+  {
+    while(n_received == 0)
+      inf_standalone_io_iteration(test->io);
+
+    g_object_get(G_OBJECT(server_connection), "status", &status, NULL);
+    if(status != INF_XML_CONNECTION_OPEN)
+    {
+      fprintf(
+        stderr,
+        "Server closed connection on %s\n",
+        frame->description
+      );
+
+      result = FALSE;
+    }
+
+    inf_xml_connection_close(INF_XML_CONNECTION(xmpp));
+  }
+  else
+  {
+    do
+    {
+      inf_standalone_io_iteration(test->io);
+      g_object_get(G_OBJECT(server_connection), "status", &status, NULL);
+    } while(status != INF_XML_CONNECTION_CLOSED);
+
+    if(n_received > 0)
+    {
+      fprintf(stderr, "Server accepted %s\n", frame->description);
+      result = FALSE;
+    }
+  }
+
+  g_object_unref(xmpp);
+  g_object_unref(tcp);
+
+  g_slist_free_full(test->server_connections, g_object_unref);
+  test->server_connections = NULL;
+
+  return result;
+}
+
+/* Connects the clients to port, broadcasts n_messages messages to them and
+ * waits until every client has received all of them. Returns the time this
+ * took, in microseconds per message, or a negative value on error. */
+static double
+inf_test_xmpp_binary_run(InfTestXmppBinary* test,
+                         InfCommunicationManager* manager,
+                         InfIpAddress* addr,
+                         guint port,
+                         guint n_messages)
+{
+  static const gchar* const methods[] = { "central", NULL };
+
+  InfCommunicationHostedGroup* group;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  GSList* item;
+  GError* error;
+  gint64 start;
+  gint64 total;
+  guint i;
+
+  test->server_connections = NULL;
+  test->n_open = 0;
+  test->n_received = 0;
+  test->bytes = 0;
+  test->failed = FALSE;
+
+  for(i = 0; i < INF_TEST_XMPP_BINARY_CLIENTS; ++i)
+  {
+    tcp = inf_tcp_connection_new(INF_IO(test->io), addr, port);
+    xmpp = inf_xmpp_connection_new(
+      tcp,
+      INF_XMPP_CONNECTION_CLIENT,
+      NULL,
+      "localhost",
+      INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      NULL,
+      NULL,
+      NULL
+    );
+
+    g_object_set(
+      G_OBJECT(xmpp),
+      "binary-framing", test->mode->binary_framing,
+      "compression-level", test->mode->compression_level,
+      NULL
+    );
+
+    test->clients[i].test = test;
+    test->clients[i].connection = INF_XML_CONNECTION(xmpp);
+    test->clients[i].n_received = 0;
+
+    g_signal_connect(
+      G_OBJECT(xmpp),
+      "notify::status",
+      G_CALLBACK(inf_test_xmpp_binary_notify_status_cb),
+      test
+    );
+
+    g_signal_connect(
+      G_OBJECT(xmpp),
+      "received",
+      G_CALLBACK(inf_test_xmpp_binary_received_cb),
+      &test->clients[i]
+    );
+
+    error = NULL;
+    if(inf_tcp_connection_open(tcp, &error) == FALSE)
+    {
+      fprintf(stderr, "Could not connect: %s\n", error->message);
+      g_error_free(error);
+      g_object_unref(tcp);
+      return -1.0;
+    }
+
+    g_object_unref(tcp);
+  }
+
+  /* Both the client and the server side of each connection need to be
+   * established. */
+  while(test->n_open < 2 * INF_TEST_XMPP_BINARY_CLIENTS)
+    inf_standalone_io_iteration(test->io);
+
+  group = inf_communication_manager_open_group(
+    manager,
+    "InfTestXmppBinary",
+    methods
+  );
+
+  for(item = test->server_connections; item != NULL; item = item->next)
+  {
+    inf_communication_hosted_group_add_member(
+      group,
+      INF_XML_CONNECTION(item->data)
+    );
+
+    /* Only count the data sent after the connection was established */
+    g_object_get(G_OBJECT(item->data), "tcp-connection", &tcp, NULL);
+
+    g_signal_connect(
+      G_OBJECT(tcp),
+      "sent",
+      G_CALLBACK(inf_test_xmpp_binary_sent_cb),
+      test
+    );
+
+    g_object_unref(tcp);
+  }
+
+  start = g_get_monotonic_time();
+
+  for(i = 0; i < n_messages; ++i)
+  {
+    inf_communication_group_send_group_message(
+      INF_COMMUNICATION_GROUP(group),
+      xmlCopyNode(g_ptr_array_index(test->messages, i % test->messages->len), 1)
+    );
+
+    /* Don't let too much data queue up */
+    while((i + 1) * INF_TEST_XMPP_BINARY_CLIENTS - test->n_received >
+          64 * INF_TEST_XMPP_BINARY_CLIENTS && !test->failed)
+    {
+      inf_standalone_io_iteration(test->io);
+    }
+  }
+
+  while(test->n_received < n_messages * INF_TEST_XMPP_BINARY_CLIENTS &&
+        !test->failed)
+  {
+    inf_standalone_io_iteration(test->io);
+  }
+
+  total = g_get_monotonic_time() - start;
+
+  g_object_unref(group);
+
+  for(i = 0; i < INF_TEST_XMPP_BINARY_CLIENTS; ++i)
+  {
+    inf_xml_connection_close(test->clients[i].connection);
+    g_object_unref(test->clients[i].connection);
+  }
+
+  while(test->server_connections != NULL)
+  {
+    g_object_unref(test->server_connections->data);
+
+    test->server_connections = g_slist_delete_link(
+      test->server_connections,
+      test->server_connections
+    );
+  }
+
+  if(test->failed)
+    return -1.0;
+  return (double)total / n_messages;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestXmppBinary test;
+  InfdTcpServer* server;
+  InfdXmppServer* xmpp_server;
+  InfCommunicationManager* manager;
+  InfIpAddress* addr;
+  guint port;
+  guint n_messages;
+  double times[3];
+  gsize bytes[3];
+  gboolean rejected;
+  guint i;
+  guint n;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return EXIT_FAILURE;
+  }
+
+  n_messages = 10000;
+  if(argc > 1)
+    n_messages = atoi(argv[1]);
+
+  test.io = inf_standalone_io_new();
+  test.messages = inf_test_xmpp_binary_make_messages();
+
+  addr = inf_ip_address_new_loopback4();
+
+  server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test.io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  if(infd_tcp_server_open(server, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    inf_ip_address_free(addr);
+    g_object_unref(server);
+    g_object_unref(test.io);
+    return EXIT_FAILURE;
+  }
+
+  g_object_get(G_OBJECT(server), "local-port", &port, NULL);
+
+  xmpp_server = infd_xmpp_server_new(
+    server,
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp_server),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_binary_new_connection_cb),
+    &test
+  );
+
+  manager = inf_communication_manager_new();
+
+  for(i = 0; i < 3; ++i)
+  {
+    test.mode = &INF_TEST_XMPP_BINARY_MODES[i];
+    times[i] = inf_test_xmpp_binary_run(
+      &test,
+      manager,
+      addr,
+      port,
+      n_messages
+    );
+
+    bytes[i] = test.bytes;
+    if(times[i] < 0.0)
+      break;
+  }
+
+  rejected = TRUE;
+  for(n = 0; n < G_N_ELEMENTS(INF_TEST_XMPP_BINARY_FRAMES); ++n)
+  {
+    if(!inf_test_xmpp_binary_send_frame(&test,
+                                        addr,
+                                        port,
+                                        &INF_TEST_XMPP_BINARY_FRAMES[n]))
+    {
+      rejected = FALSE;
+    }
+  }
+
+  g_object_unref(manager);
+  g_object_unref(xmpp_server);
+  infd_tcp_server_close(server);
+  g_object_unref(server);
+  inf_ip_address_free(addr);
+  g_ptr_array_free(test.messages, TRUE);
+  g_object_unref(test.io);
+
+  if(i < 3 || !rejected)
+    return EXIT_FAILURE;
+
+  printf("framing  time (us/msg)  sent (bytes/msg/client)\n");
+  for(i = 0; i < 3; ++i)
+  {
+    printf(
+      "%-8s %13.2f  %23.1f\n",
+      INF_TEST_XMPP_BINARY_MODES[i].name,
+      times[i],
+      (double)bytes[i] / n_messages / INF_TEST_XMPP_BINARY_CLIENTS
+    );
+  }
+
+  /* If binary framing or compression was not used for the broadcasts, the
+   * respective run sent at least as much data as the previous one. */
+  if(bytes[1] >= bytes[0])
+  {
+    fprintf(stderr, "Binary framing was not used\n");
+    return EXIT_FAILURE;
+  }
+
+  if(bytes[2] >= bytes[1])
+  {
+    fprintf(stderr, "Compression was not used\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* vim:set et sw=2 ts=2: */